@@ -30,9 +30,16 @@ weight(const float4 c1, const float4 c2, const float sharpen)
 }
 
 
+/* decompose one scale and add its thresholded and boosted detail to the accumulated ones, so that no detail
+   scale has to be stored. the first scale starts from zero, the last one adds the coarse residue to produce
+   the final image. */
 __kernel void
-eaw_decompose (__read_only image2d_t in, __write_only image2d_t coarse, __write_only image2d_t detail,
-     const int width, const int height, const int scale, const float sharpen, global const float *filter)
+eaw_decompose_synthesize (__read_only image2d_t in, __write_only image2d_t coarse,
+     __read_only image2d_t accum_in, __write_only image2d_t accum_out,
+     const int width, const int height, const int scale, const float sharpen, global const float *filter,
+     const float t0, const float t1, const float t2, const float t3,
+     const float b0, const float b1, const float b2, const float b3,
+     const int first, const int last)
 {
   const int x = get_global_id(0);
   const int y = get_global_id(1);
@@ -59,29 +66,20 @@ eaw_decompose (__read_only image2d_t in, __write_only image2d_t coarse, __write_
   sum /= wgt;
   sum.w = pixel.w;
 
-  write_imagef (detail, (int2)(x, y), pixel - sum);
   write_imagef (coarse, (int2)(x, y), sum);
-}
-
-
-__kernel void
-eaw_synthesize (__write_only image2d_t out, __read_only image2d_t coarse, __read_only image2d_t detail,
-     const int width, const int height,
-     const float t0, const float t1, const float t2, const float t3,
-     const float b0, const float b1, const float b2, const float b3)
-{
-  const int x = get_global_id(0);
-  const int y = get_global_id(1);
-
-  if(x >= width || y >= height) return;
 
   const float4 threshold = (float4)(t0, t1, t2, t3);
   const float4 boost     = (float4)(b0, b1, b2, b3);
-  float4 c = read_imagef(coarse, sampleri, (int2)(x, y));
-  float4 d = read_imagef(detail, sampleri, (int2)(x, y));
-  float4 amount = copysign(max((float4)(0.0f), fabs(d) - threshold), d);
-  float4 sum = c + boost*amount;
-  sum.w = c.w;
-  write_imagef (out, (int2)(x, y), sum);
-}
+  const float4 d = pixel - sum;
+  const float4 amount = copysign(max((float4)(0.0f), fabs(d) - threshold), d);
 
+  float4 accum = first ? (float4)(0.0f) : read_imagef(accum_in, sampleri, (int2)(x, y));
+  accum += boost*amount;
+  accum.w = 0.0f;
+  if(last)
+  {
+    // the residue also carries the alpha channel
+    accum += sum;
+  }
+  write_imagef (accum_out, (int2)(x, y), accum);
+}
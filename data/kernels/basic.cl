@@ -198,6 +198,60 @@ highlights_1f_clip (read_only image2d_t in, write_only image2d_t out, const int
   write_imagef (out, (int2)(x, y), pixel);
 }
 
+/* one directional pass of the bayer color inpainting, one work item per row (dim 0) or column (dim 1).
+   the passes accumulate from acc_in into acc_out, the last one also writes the unclipped pixels. */
+kernel void
+highlights_1f_inpaint_bayer (read_only image2d_t in, read_only image2d_t acc_in, write_only image2d_t acc_out,
+                             const int width, const int height, const float4 clips, const unsigned int filters,
+                             const int dim, const int dir, const int pass)
+{
+  const int line = get_global_id(0);
+
+  if(line >= (dim ? width : height)) return;
+
+  const float clip[4] = { clips.x, clips.y, clips.z, clips.w };
+  const int len = dim ? height : width;
+  const int beg = dir > 0 ? 0 : len - 1;
+  const int end = dir > 0 ? len : -1;
+  float ratio = 1.0f;
+
+  for(int k = beg; k != end; k += dir)
+  {
+    const int i = dim ? line : k;
+    const int j = dim ? k : line;
+    const float val = read_imagef(in, sampleri, (int2)(i, j)).x;
+    float acc = pass ? read_imagef(acc_in, sampleri, (int2)(i, j)).x : 0.0f;
+
+    if(i == 0 || i == width - 1 || j == 0 || j == height - 1)
+    {
+      if(pass == 3) acc = val;
+    }
+    else
+    {
+      const float clip0 = clip[FC(j, i, filters)];
+      const float clip1 = clip[FC(dim ? (j + 1) : j, dim ? i : (i + 1), filters)];
+      const float next = read_imagef(in, sampleri, dim ? (int2)(i, j + dir) : (int2)(i + dir, j)).x;
+
+      if(val < clip0 && val > 1e-5f && next < clip1 && next > 1e-5f)
+      {
+        // update ratio, exponential decay. ratio = in[odd]/in[even]
+        ratio = (k & 1) ? (3.0f * ratio + val / next) / 4.0f : (3.0f * ratio + next / val) / 4.0f;
+      }
+
+      if(val >= clip0 - 1e-5f)
+      {
+        // clipped, restore it as the neighbour adjusted according to ratio
+        const float add = (next >= clip1 - 1e-5f) ? fmax(clip0, clip1) : ((k & 1) ? next * ratio : next / ratio);
+        acc = (pass == 0) ? add : ((pass == 3) ? (acc + add) / 4.0f : acc + add);
+      }
+      else if(pass == 3)
+        acc = val;
+    }
+
+    write_imagef(acc_out, (int2)(i, j), acc);
+  }
+}
+
 #define SQRT3 1.7320508075688772935274463415058723669f
 #define SQRT12 3.4641016151377545870548926830117447339f // 2*SQRT3
 kernel void
@@ -1750,6 +1804,36 @@ lens_vignette (read_only image2d_t in, write_only image2d_t out, const int width
 
 
 
+/* bilinear interpolation of a coarse mesh of lens corrections (coordinates or vignetting) to every pixel */
+kernel void
+lens_mesh(global const float *mesh, global float *out, const int width, const int height,
+          const int mesh_width, const int step, const int components)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const int mx = x / step;
+  const int my = y / step;
+  const float fx = (float)(x - mx * step) / step;
+  const float fy = (float)(y - my * step) / step;
+
+  global const float *m00 = mesh + mad24(my, mesh_width, mx) * components;
+  global const float *m01 = m00 + components;
+  global const float *m10 = m00 + mesh_width * components;
+  global const float *m11 = m10 + components;
+  global float *o = out + mad24(y, width, x) * components;
+
+  for(int c = 0; c < components; c++)
+  {
+    const float top = mix(m00[c], m01[c], fx);
+    const float bottom = mix(m10[c], m11[c], fx);
+    o[c] = mix(top, bottom, fy);
+  }
+}
+
+
 /* kernel for flip */
 __kernel void
 flip(read_only image2d_t in, write_only image2d_t out, const int width, const int height, const int orientation)
@@ -1900,6 +1984,72 @@ colorout (read_only image2d_t in, write_only image2d_t out, const int width, con
   write_imagef (out, (int2)(x, y), pixel);
 }
 
+/* kernel for the plugin colorout, lcms2 transform baked into a Lab grid of level^3 points */
+kernel void
+colorout_clut (read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+               global const float *clut, const int level)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  const int level2 = level * level;
+
+  // same grid as in colorout.c: L in [0, 100], a and b in [-128, 128]
+  float4 pos = (float4)(pixel.x / 100.0f, (pixel.y + 128.0f) / 256.0f, (pixel.z + 128.0f) / 256.0f, 0.0f);
+  pos = clamp(pos, (float4)0.0f, (float4)1.0f) * (float)(level - 1);
+  const int4 posi = min(convert_int4(pos), (int4)(level - 2));
+  const float4 d = pos - convert_float4(posi);
+
+  const int i000 = (posi.x + posi.y * level + posi.z * level2) * 3;
+  const int i111 = i000 + (1 + level + level2) * 3;
+  int i1, i2;
+  float4 w;
+  if(d.x > d.y)
+  {
+    if(d.y > d.z)
+    {
+      i1 = i000 + 3; i2 = i000 + (1 + level) * 3;
+      w = (float4)(1.0f - d.x, d.x - d.y, d.y - d.z, d.z);
+    }
+    else if(d.x > d.z)
+    {
+      i1 = i000 + 3; i2 = i000 + (1 + level2) * 3;
+      w = (float4)(1.0f - d.x, d.x - d.z, d.z - d.y, d.y);
+    }
+    else
+    {
+      i1 = i000 + level2 * 3; i2 = i000 + (1 + level2) * 3;
+      w = (float4)(1.0f - d.z, d.z - d.x, d.x - d.y, d.y);
+    }
+  }
+  else
+  {
+    if(d.z > d.y)
+    {
+      i1 = i000 + level2 * 3; i2 = i000 + (level + level2) * 3;
+      w = (float4)(1.0f - d.z, d.z - d.y, d.y - d.x, d.x);
+    }
+    else if(d.z > d.x)
+    {
+      i1 = i000 + level * 3; i2 = i000 + (level + level2) * 3;
+      w = (float4)(1.0f - d.y, d.y - d.z, d.z - d.x, d.x);
+    }
+    else
+    {
+      i1 = i000 + level * 3; i2 = i000 + (1 + level) * 3;
+      w = (float4)(1.0f - d.y, d.y - d.x, d.x - d.z, d.z);
+    }
+  }
+
+  pixel.x = w.x * clut[i000] + w.y * clut[i1] + w.z * clut[i2] + w.w * clut[i111];
+  pixel.y = w.x * clut[i000 + 1] + w.y * clut[i1 + 1] + w.z * clut[i2 + 1] + w.w * clut[i111 + 1];
+  pixel.z = w.x * clut[i000 + 2] + w.y * clut[i1 + 2] + w.z * clut[i2 + 2] + w.w * clut[i111 + 2];
+  write_imagef (out, (int2)(x, y), pixel);
+}
+
 
 /* kernel for the levels plugin */
 kernel void
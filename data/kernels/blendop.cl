@@ -1320,6 +1320,112 @@ blendop_set_mask (__write_only image2d_t mask, const int width, const int height
 }
 
 
+// the drawn shapes and combine modes of src/develop/masks.h the device can render without the host
+typedef enum dt_masks_cl_shape_t
+{
+  DT_MASKS_CL_CIRCLE = 0,
+  DT_MASKS_CL_ELLIPSE = 1,
+  DT_MASKS_CL_GRADIENT = 2
+} dt_masks_cl_shape_t;
+
+typedef enum dt_masks_state_t
+{
+  DT_MASKS_STATE_INVERSE = 1 << 2,
+  DT_MASKS_STATE_UNION = 1 << 3,
+  DT_MASKS_STATE_INTERSECTION = 1 << 4,
+  DT_MASKS_STATE_DIFFERENCE = 1 << 5,
+  DT_MASKS_STATE_EXCLUSION = 1 << 6
+} dt_masks_state_t;
+
+/* evaluate one shape at the pixels of the roi and combine it into the group mask.
+   origin, step_x and step_y map a pixel of the roi affinely to input image coordinates.
+   with first set the previous contents of mask are ignored. */
+__kernel void
+blendop_mask_shape(global float *mask, const int width, const int height, const float2 origin,
+                   const float2 step_x, const float2 step_y, const int shape, constant float *p,
+                   const int state, const float opacity, const int first)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float2 pt = origin + (float)x * step_x + (float)y * step_y;
+  float f = 0.0f;
+
+  if(shape == DT_MASKS_CL_CIRCLE)
+  {
+    // p: center, total2, border2
+    const float l2 = (pt.x - p[0]) * (pt.x - p[0]) + (pt.y - p[1]) * (pt.y - p[1]);
+    const float ratio = clamp((p[2] - l2) / p[3], 0.0f, 1.0f);
+    f = ratio * ratio;
+  }
+  else if(shape == DT_MASKS_CL_ELLIPSE)
+  {
+    // p: center, a2, b2, ta2, tb2, cos alpha, sin alpha
+    const float dx = pt.x - p[0];
+    const float dy = pt.y - p[1];
+    const float l2 = dx * dx + dy * dy;
+    const float l = sqrt(l2);
+    const float x_norm = l ? dx / l : 0.0f;
+    const float y_norm = l ? dy / l : 1.0f;
+    const float x_rot = x_norm * p[6] + y_norm * p[7];
+    const float y_rot = -x_norm * p[7] + y_norm * p[6];
+    const float cosv2 = x_rot * x_rot;
+    const float sinv2 = y_rot * y_rot;
+    const float radius2 = p[2] * p[3] / (p[2] * sinv2 + p[3] * cosv2);
+    const float total2 = p[4] * p[5] / (p[4] * sinv2 + p[5] * cosv2);
+    const float ratio = clamp((total2 - l2) / (total2 - radius2), 0.0f, 1.0f);
+    f = ratio * ratio;
+  }
+  else if(shape == DT_MASKS_CL_GRADIENT)
+  {
+    // p: cos v, sin v, x and y offset, hwscale, curvature, compression, linear
+    const float x0 = (p[0] * pt.x + p[1] * pt.y - p[2]) * p[4];
+    const float y0 = (p[1] * pt.x - p[0] * pt.y - p[3]) * p[4];
+    const float distance = y0 - p[5] * x0 * x0;
+    const float compression = p[6];
+    if(distance >= 4.0f * compression)
+      f = 1.0f;
+    else if(distance > -4.0f * compression)
+      f = clamp(0.5f + 0.5f * (p[7] != 0.0f ? distance / compression : erf(distance / compression)), 0.0f, 1.0f);
+  }
+
+  const float m = opacity * ((state & DT_MASKS_STATE_INVERSE) ? 1.0f - f : f);
+  const int k = mad24(y, width, x);
+  const float b1 = first ? 0.0f : mask[k];
+  float res;
+
+  if(state & DT_MASKS_STATE_UNION)
+    res = fmax(b1, m);
+  else if(state & DT_MASKS_STATE_INTERSECTION)
+    res = fmin(fmax(b1, 0.0f), fmax(m, 0.0f));
+  else if(state & DT_MASKS_STATE_DIFFERENCE)
+    res = (b1 > 0.0f && m > 0.0f) ? b1 * (1.0f - m) : b1;
+  else if(state & DT_MASKS_STATE_EXCLUSION)
+    res = (b1 > 0.0f && m > 0.0f) ? fmax((1.0f - b1) * m, b1 * (1.0f - m)) : fmax(b1, m);
+  else
+    res = m;
+
+  mask[k] = res;
+}
+
+
+/* write the group mask rendered by blendop_mask_shape into the mask image, inverted if requested */
+__kernel void
+blendop_mask_shape_write(global const float *in, __write_only image2d_t mask, const int width, const int height,
+                         const int invert)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float v = in[mad24(y, width, x)];
+  write_imagef(mask, (int2)(x, y), invert ? 1.0f - v : v);
+}
+
+
 __kernel void
 blendop_display_channel(__read_only image2d_t in_a, __read_only image2d_t in_b, __read_only image2d_t mask,
                         __write_only image2d_t out, const int width, const int height, const int2 offs,
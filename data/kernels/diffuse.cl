@@ -375,3 +375,73 @@ inpaint_mask(write_only image2d_t inpainted, read_only image2d_t original,
 
   write_imagef(inpainted, (int2)(x, y), pix_out);
 }
+
+kernel void
+diffuse_downsample(read_only image2d_t in, write_only image2d_t out,
+                   const int width, const int height)
+{
+  // width and height are the ones of the half size output
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+  const float4 acc = read_imagef(in, samplerA, (int2)(2 * x, 2 * y))
+                     + read_imagef(in, samplerA, (int2)(2 * x + 1, 2 * y))
+                     + read_imagef(in, samplerA, (int2)(2 * x, 2 * y + 1))
+                     + read_imagef(in, samplerA, (int2)(2 * x + 1, 2 * y + 1));
+  write_imagef(out, (int2)(x, y), 0.25f * acc);
+}
+
+kernel void
+diffuse_add_delta(read_only image2d_t in, read_only image2d_t coarse_out, read_only image2d_t coarse_in,
+                  write_only image2d_t out, const int width, const int height)
+{
+  // out = in + what the half size iterations changed, interpolated to full size
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const int cwidth = width / 2;
+  const int cheight = height / 2;
+  const float fx = clamp((x + 0.5f) / 2.f - 0.5f, 0.f, cwidth - 1.f);
+  const float fy = clamp((y + 0.5f) / 2.f - 0.5f, 0.f, cheight - 1.f);
+  const int x0 = (int)fx;
+  const int y0 = (int)fy;
+  const int x1 = min(x0 + 1, cwidth - 1);
+  const int y1 = min(y0 + 1, cheight - 1);
+  const float wx = fx - x0;
+  const float wy = fy - y0;
+
+  const float4 d00 = read_imagef(coarse_out, samplerA, (int2)(x0, y0)) - read_imagef(coarse_in, samplerA, (int2)(x0, y0));
+  const float4 d01 = read_imagef(coarse_out, samplerA, (int2)(x1, y0)) - read_imagef(coarse_in, samplerA, (int2)(x1, y0));
+  const float4 d10 = read_imagef(coarse_out, samplerA, (int2)(x0, y1)) - read_imagef(coarse_in, samplerA, (int2)(x0, y1));
+  const float4 d11 = read_imagef(coarse_out, samplerA, (int2)(x1, y1)) - read_imagef(coarse_in, samplerA, (int2)(x1, y1));
+
+  const float4 delta = (1.f - wy) * ((1.f - wx) * d00 + wx * d01) + wy * ((1.f - wx) * d10 + wx * d11);
+  write_imagef(out, (int2)(x, y), read_imagef(in, samplerA, (int2)(x, y)) + delta);
+}
+
+kernel void
+diffuse_update_norm(read_only image2d_t before, read_only image2d_t after, global float *sums,
+                    const int width, const int height)
+{
+  // one work item per row, summing the absolute RGB change and the RGB magnitude
+  const int y = get_global_id(0);
+
+  if(y >= height) return;
+
+  float change = 0.f;
+  float norm = 0.f;
+  for(int x = 0; x < width; x++)
+  {
+    const float4 b = read_imagef(before, samplerA, (int2)(x, y));
+    const float4 a = read_imagef(after, samplerA, (int2)(x, y));
+    const float4 d = fabs(a - b);
+    const float4 m = fabs(b);
+    change += d.x + d.y + d.z;
+    norm += m.x + m.y + m.z;
+  }
+  sums[2 * y] = change;
+  sums[2 * y + 1] = norm;
+}
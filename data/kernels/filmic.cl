@@ -576,7 +576,8 @@ filmicrgb_chroma (read_only image2d_t in, write_only image2d_t out,
 kernel void
 filmic_mask_clipped_pixels(read_only image2d_t in, write_only image2d_t out,
                            int width, int height,
-                           const float normalize, const float feathering, write_only image2d_t is_clipped)
+                           const float normalize, const float feathering, write_only image2d_t is_clipped,
+                           write_only image2d_t tiles, const int tile_size, const float sparse_threshold)
 {
   const unsigned int x = get_global_id(0);
   const unsigned int y = get_global_id(1);
@@ -592,6 +593,9 @@ filmic_mask_clipped_pixels(read_only image2d_t in, write_only image2d_t out,
 
   if(4.f > argument) write_imageui(is_clipped, (int2)(0, 0), 1);
 
+  // flag the tiles the reconstruction has to run around
+  if(weight > sparse_threshold) write_imageui(tiles, (int2)(x / tile_size, y / tile_size), 1);
+
   write_imagef(out, (int2)(x, y), weight);
 }
 
@@ -1,3 +1,49 @@
+// interval between two value-changed while dragging, following the measured latency of the full pipe
+static int _slider_postponed_delay(void)
+{
+  return CLAMP(darktable.develop->average_delay * 3 / 2, DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN,
+               DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MAX);
+}
+
+// the run started for the previous value is still going and should be done soon: rather than cancelling it,
+// let it finish and send only the latest value after it. a run overshooting its usual time gets superseded.
+static gboolean _slider_pipe_finishing(const dt_bauhaus_slider_data_t *d)
+{
+  const dt_develop_t *dev = darktable.develop;
+  if(!dev || !dev->gui_attached || !dev->pipe || !dev->pipe->processing) return FALSE;
+  const double elapsed = (dt_get_wtime() - d->last_changed) * 1000.0;
+  return elapsed < dev->average_delay + DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN;
+}
+
+static gboolean dt_bauhaus_slider_postponed_value_change(gpointer data)
+{
+  if(!GTK_IS_WIDGET(data)) return 0;
+
+  dt_bauhaus_widget_t *w = (dt_bauhaus_widget_t *)data;
+  dt_bauhaus_slider_data_t *d = &w->data.slider;
+  if(d->is_changed)
+  {
+    if(_slider_pipe_finishing(d))
+    {
+      // check again shortly, later motion events only update the value to send
+      d->timeout_handle = g_timeout_add(DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN,
+                                        dt_bauhaus_slider_postponed_value_change, w);
+      return FALSE;
+    }
+    g_signal_emit_by_name(G_OBJECT(w), "value-changed");
+    d->is_changed = 0;
+    d->last_changed = dt_get_wtime();
+    // re-arm with the current latency, it changes while dragging over different parts of the image
+    d->timeout_handle = g_timeout_add(_slider_postponed_delay(), dt_bauhaus_slider_postponed_value_change, w);
+    return FALSE;
+  }
+  else
+  {
+    d->timeout_handle = 0;
+    return FALSE;
+  }
+}
+
 /*
     This file is part of darktable,
     Copyright (C) 2012-2022 darktable developers.
@@ -2631,11 +2677,7 @@ static void dt_bauhaus_slider_set_normalized(dt_bauhaus_widget_t *w, float pos)
     else
     {
       if(!d->timeout_handle)
-      {
-        const int delay = CLAMP(darktable.develop->average_delay * 3 / 2, DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN,
-                                DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MAX);
-        d->timeout_handle = g_timeout_add(delay, dt_bauhaus_slider_postponed_value_change, w);
-      }
+        d->timeout_handle = g_timeout_add(_slider_postponed_delay(), dt_bauhaus_slider_postponed_value_change, w);
     }
   }
 }
@@ -87,6 +87,7 @@ typedef struct dt_bauhaus_slider_data_t
   int is_dragging;      // indicates is mouse is dragging slider
   int is_changed;       // indicates new data
   guint timeout_handle; // used to store id of timeout routine
+  double last_changed;  // time value-changed was last emitted during the drag
   float (*curve)(GtkWidget*, float, dt_bauhaus_curve_t); // callback function
 } dt_bauhaus_slider_data_t;
 
@@ -140,6 +140,47 @@ static inline int solve(double *As, double *w, double *v, const double *b, doubl
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wvla"
 
+// appends column col of A to the factorisation As = Q R of the chosen columns, where R = L^t is the
+// cholesky factor of As^t As. the new column is orthogonalised against the previous ones by gram-schmidt
+// (twice, to keep Q orthogonal), which is the stable way of computing the new row of L. Q holds column k
+// at Q + k * wd, L is S x S row major. returns 1 if the column is (close to) linearly dependent.
+static inline int append_column(const double *A, const int wd, const int col, double *Q, double *L,
+                                const int k, const int S)
+{
+  double *q = Q + (size_t)k * wd;
+  double *l = L + (size_t)k * S;
+  for(int j = 0; j < wd; j++) q[j] = A[j * wd + col];
+  for(int i = 0; i < k; i++) l[i] = 0.0;
+  for(int pass = 0; pass < 2; pass++)
+    for(int i = 0; i < k; i++)
+    {
+      const double *qi = Q + (size_t)i * wd;
+      double dot = 0.0;
+      for(int j = 0; j < wd; j++) dot += qi[j] * q[j];
+      for(int j = 0; j < wd; j++) q[j] -= dot * qi[j];
+      l[i] += dot;
+    }
+  double d = 0.0;
+  for(int j = 0; j < wd; j++) d += q[j] * q[j];
+  d = sqrt(d);
+  // same limit as for the smallest singular value in solve()
+  if(d < 1e-3) return 1;
+  for(int j = 0; j < wd; j++) q[j] /= d;
+  l[k] = d;
+  return 0;
+}
+
+// solves L^t c = z for the first n coefficients
+static inline void back_substitute(const double *L, const double *z, double *coeff, const int n, const int S)
+{
+  for(int j = n - 1; j >= 0; j--)
+  {
+    double sum = z[j];
+    for(int i = j + 1; i < n; i++) sum -= L[i * S + j] * coeff[i];
+    coeff[j] = sum / L[j * S + j];
+  }
+}
+
 // returns sparsity <= S
 int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (needed for error estimation)
                     int dim,                  // dimensionality of points
@@ -199,6 +240,13 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
   double *w = malloc(sizeof(double) * S);
   double *v = malloc(sizeof(double) * S * S);
   double *As = calloc((size_t)wd * S, sizeof(double));
+  // incremental least squares: orthonormal basis Q of the chosen columns, cholesky factor L of their gram
+  // matrix and the projections z of the targets onto Q. only the first `factored' columns are in there.
+  double *Q = malloc(sizeof(double) * wd * S);
+  double *L = calloc((size_t)S * S, sizeof(double));
+  double(*z)[S] = malloc(sizeof(double) * dim * S);
+  double *dots = malloc(sizeof(double) * wd);
+  int factored = 0;
 
   // for rank from 0 to sparsity level
   int s = 0, patches = 0;
@@ -215,6 +263,10 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
       free(w);
       free(v);
       free(As);
+      free(Q);
+      free(L);
+      free(z);
+      free(dots);
       free(norm);
       free(A);
       return sparsity;
@@ -225,6 +277,30 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
     // by searching over all three residuals
     double maxdot = 0.0;
     int maxcol = 0;
+#ifndef EXACT
+    // correlate all remaining columns with the residuals, independently per column
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(A, dim, norm, wd) \
+    shared(dots, r) \
+    schedule(static)
+#endif
+    for(int t = 0; t < wd; t++)
+    {
+      double dot = 0.0;
+      if(norm[t] > 0.0)
+      {
+        for(int ch = 0; ch < dim; ch++)
+        {
+          double chdot = 0.0;
+          for(int j = 0; j < wd; j++) chdot += A[j * wd + t] * r[ch][j];
+          dot += fabs(chdot);
+        }
+        dot *= norm[t];
+      }
+      dots[t] = dot;
+    }
+#endif
     for(int t = 0; t < wd; t++)
     {
       double dot = 0.0;
@@ -246,6 +322,10 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
             free(w);
             free(v);
             free(As);
+            free(Q);
+            free(L);
+            free(z);
+            free(dots);
             free(norm);
             free(A);
             return sparsity;
@@ -264,13 +344,7 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
         const double err = compute_error(curve, target, r[0], r[1], r[2], wd, 0);
         dot = 1. / err; // searching for smallest error or largest dot
 #else                   // use dot product
-        for(int ch = 0; ch < dim; ch++)
-        {
-          double chdot = 0.0;
-          for(int j = 0; j < wd; j++) chdot += A[j * wd + t] * r[ch][j];
-          dot += fabs(chdot);
-        }
-        dot *= norm[t];
+        dot = dots[t];
 #endif
       }
       // fprintf(stderr, "dot %d = %g\n", i, dot);
@@ -313,6 +387,10 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
             free(w);
             free(v);
             free(As);
+            free(Q);
+            free(L);
+            free(z);
+            free(dots);
             free(norm);
             free(A);
             return s;
@@ -357,6 +435,17 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
         fprintf(stderr, "replacing %d <- %d\n", mincol, maxcol);
         // replace column
         permutation[mincol] = maxcol;
+        // the factorisation is only valid up to the replaced column, redo the rest
+        if(factored > mincol)
+        {
+          factored = mincol;
+          for(int ch = 0; ch < dim; ch++)
+            for(int j = 0; j < wd; j++)
+            {
+              r[ch][j] = b[ch][j];
+              for(int i = 0; i < factored; i++) r[ch][j] -= z[ch][i] * Q[(size_t)i * wd + j];
+            }
+        }
         // reset norm[] of discarded column to something > 0
 #ifdef EXACT
         norm[mincol] = 1.0;
@@ -373,35 +462,37 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
     double err = 1. / maxdot;
 #else
     const int sp = MIN(sparsity, S-1); // need to fix up for replacement
-    // solve linear least squares for sparse c for every output channel:
-    for(int ch = 0; ch < dim; ch++)
+    // solve linear least squares for sparse c for every output channel. the columns chosen before are
+    // already factored, so this only adds the new one and updates the residuals by its projection:
+    for(; factored <= sp; factored++)
     {
-      // re-init all of the previous columns in As since
-      // svd will destroy its contents:
-      for(int i = 0; i <= sp; i++)
-        for(int j = 0; j < wd; j++) As[j * S + i] = A[j * wd + permutation[i]];
-
       // on error, return last valid configuration
-      if(solve(As, w, v, b[ch], coeff[ch], wd, sp, S))
+      if(append_column(A, wd, permutation[factored], Q, L, factored, S))
       {
         free(r);
         free(b);
         free(w);
         free(v);
         free(As);
+        free(Q);
+        free(L);
+        free(z);
+        free(dots);
         free(norm);
         free(A);
         return sparsity;
       }
-
-      // compute new residual:
-      // r = b - As c
-      for(int j = 0; j < wd; j++)
+      const double *q = Q + (size_t)factored * wd;
+      for(int ch = 0; ch < dim; ch++)
       {
-        r[ch][j] = b[ch][j];
-        for(int i = 0; i <= sp; i++) r[ch][j] -= A[j * wd + permutation[i]] * coeff[ch][i];
+        double dot = 0.0;
+        for(int j = 0; j < wd; j++) dot += q[j] * b[ch][j];
+        z[ch][factored] = dot;
+        // new residual: r = b - As c = b - Q z
+        for(int j = 0; j < wd; j++) r[ch][j] -= dot * q[j];
       }
     }
+    for(int ch = 0; ch < dim; ch++) back_substitute(L, z[ch], coeff[ch], sp + 1, S);
 
     double merr = 0.0;
     const double err = compute_error(curve, target, r[0], r[1], r[2], wd, &merr);
@@ -425,6 +516,10 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
   free(w);
   free(v);
   free(As);
+  free(Q);
+  free(L);
+  free(z);
+  free(dots);
   free(norm);
   free(A);
   return -1;
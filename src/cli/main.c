@@ -37,10 +37,19 @@
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
+#include "common/opencl.h"
 #include "common/points.h"
 #include "control/conf.h"
 #include "develop/imageop.h"
 
+#ifdef HAVE_HTTP_SERVER
+#include "common/http_server.h"
+#ifndef _WIN32
+#include <glib-unix.h>
+#include <signal.h>
+#endif
+#endif
+
 #include <inttypes.h>
 #include <libintl.h>
 #include <sys/time.h>
@@ -83,11 +92,63 @@ static void usage(const char *progname)
   fprintf(stderr, "   --icc-file <file> specify icc filename, default to NONE\n");
   fprintf(stderr, "   --icc-intent <intent> specify icc intent, default to LAST\n");
   fprintf(stderr, "                     use --help icc-intent for list of supported intents\n");
+  fprintf(stderr, "   --bench <iterations> export every image once to warm up, then <iterations>\n");
+  fprintf(stderr, "                        times and print load/pipe/encode timings\n");
+  fprintf(stderr, "   --batch <file|-> process the jobs of a file or of stdin in this process, one per line as\n");
+  fprintf(stderr, "                <input file or dir> [<xmp file>] <output destination> [options]\n");
+  fprintf(stderr, "                the options given here are the defaults of each job\n");
+#ifdef HAVE_HTTP_SERVER
+  fprintf(stderr, "   --serve <port> run a render service on localhost:<port> taking the jobs of --batch\n");
+  fprintf(stderr, "                  as http posts to /export and sending back the exported file\n");
+  fprintf(stderr, "   --serve-jobs <n> number of jobs run at the same time, default: 1\n");
+  fprintf(stderr, "   --serve-queue <n> number of jobs accepted before refusing more, default: 16\n");
+#endif
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h [option]\n");
   fprintf(stderr, "   --version\n");
 }
 
+static int _bench_compare(const void *a, const void *b)
+{
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// nearest rank percentile of an already sorted array
+static double _bench_percentile(const GArray *times, const double p)
+{
+  if(times->len == 0) return 0.0;
+  const guint rank = (guint)ceil(p / 100.0 * times->len);
+  return g_array_index(times, double, CLAMP(rank, 1, times->len) - 1);
+}
+
+static void _bench_print_stage(const char *stage, GArray *times)
+{
+  g_array_sort(times, _bench_compare);
+  printf("  %-8s median %8.3f s   p95 %8.3f s\n", stage, _bench_percentile(times, 50.0),
+         _bench_percentile(times, 95.0));
+}
+
+static void _bench_print_config(const int iterations, const int images)
+{
+  printf("[bench] %d image(s), %d warm iteration(s) each\n", images, iterations);
+  printf("  cpu threads   %d\n", darktable.num_openmp_threads);
+  printf("  total memory  %zuMB\n", darktable.dtresources.total_memory / 1024lu / 1024lu);
+  printf("  available mem %zuMB\n", dt_get_available_mem() / 1024lu / 1024lu);
+#ifdef HAVE_OPENCL
+  if(dt_opencl_is_inited() && darktable.opencl->enabled && !darktable.opencl->stopped)
+  {
+    for(int i = 0; i < darktable.opencl->num_devs; i++)
+      printf("  opencl device %d  %s\n", i, darktable.opencl->dev[i].name);
+  }
+  else
+    printf("  opencl        disabled\n");
+#else
+  printf("  opencl        not compiled in\n");
+#endif
+}
+
 static void icc_types()
 {
   // TODO: Can this be automated to keep in sync with colorspaces.h?
@@ -164,16 +225,909 @@ static void icc_intents()
   fprintf(stderr, " SATURATION\n");
   fprintf(stderr, " ABSOLUTE_COLORIMETRIC\n");
 }
-#define ICC_INTENT_FROM_STR(name) if(!strcmp(option, #name)) return DT_INTENT_ ## name;
-static dt_iop_color_intent_t get_icc_intent(const char* option)
+#define ICC_INTENT_FROM_STR(name) if(!strcmp(option, #name)) return DT_INTENT_ ## name;
+static dt_iop_color_intent_t get_icc_intent(const char* option)
+{
+  ICC_INTENT_FROM_STR(PERCEPTUAL);
+  ICC_INTENT_FROM_STR(RELATIVE_COLORIMETRIC);
+  ICC_INTENT_FROM_STR(SATURATION);
+  ICC_INTENT_FROM_STR(ABSOLUTE_COLORIMETRIC);
+  return DT_INTENT_LAST;
+}
+#undef ICC_INTENT_FROM_STR
+
+// the settings applying to each image of an export
+typedef struct dt_cli_options_t
+{
+  int width, height;
+  gboolean high_quality, upscale, style_overwrite, export_masks;
+  const char *style;
+  const char *output_ext;
+  dt_colorspaces_color_profile_type_t icc_type;
+  const char *icc_filename;
+  dt_iop_color_intent_t icc_intent;
+} dt_cli_options_t;
+
+static GList *_import_inputs(GList *inputs)
+{
+  GList *id_list = NULL;
+
+  for(GList *l = inputs; l != NULL; l=g_list_next(l))
+  {
+    gchar* input = l->data;
+
+    if(g_file_test(input, G_FILE_TEST_IS_DIR))
+    {
+      const int filmid = dt_film_import(input);
+      if(!filmid)
+      {
+        // one of inputs was a failure, no prob
+        fprintf(stderr, _("error: can't open folder %s"), input);
+        fprintf(stderr, "\n");
+        continue;
+      }
+      id_list = g_list_concat(id_list, dt_film_get_image_ids(filmid));
+    }
+    else
+    {
+      dt_film_t film;
+      int filmid = 0;
+
+      gchar *directory = g_path_get_dirname(input);
+      filmid = dt_film_new(&film, directory);
+      const int32_t id = dt_image_import(filmid, input, TRUE, TRUE);
+      g_free(directory);
+      if(!id)
+      {
+        fprintf(stderr, _("error: can't open file %s"), input);
+        fprintf(stderr, "\n");
+        continue;
+      }
+      id_list = g_list_append(id_list, GINT_TO_POINTER(id));
+    }
+  }
+  return id_list;
+}
+
+static int _attach_xmp(GList *id_list, const char *xmp_filename)
+{
+  for(GList *iter = id_list; iter; iter = g_list_next(iter))
+  {
+    int id = GPOINTER_TO_INT(iter->data);
+    dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
+    const int failed = dt_exif_xmp_read(image, xmp_filename, 1) != 0;
+    // don't write new xmp:
+    dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+    if(failed)
+    {
+      fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
+      fprintf(stderr, "\n");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// turn the output destination into the disk storage pattern and find the format extension
+static int _output_destination(gchar **output_filename, gchar **output_ext)
+{
+  gboolean output_to_dir = FALSE;
+
+  if(g_file_test(*output_filename, G_FILE_TEST_IS_DIR))
+  {
+    output_to_dir = TRUE;
+    if(!*output_ext)
+    {
+      *output_ext = g_strdup("jpg");
+    }
+    fprintf(stderr, _("notice: output location is a directory. assuming '%s/$(FILE_NAME).%s' output pattern"), *output_filename, *output_ext);
+    fprintf(stderr, "\n");
+    gchar* temp_of = g_strdup(*output_filename);
+    g_free(*output_filename);
+    if(g_str_has_suffix(temp_of, "/"))
+      temp_of[strlen(temp_of) - 1] = '\0';
+    *output_filename = g_strconcat(temp_of, "/$(FILE_NAME)", NULL);
+    g_free(temp_of);
+  }
+
+  // the output file already exists, so there will be a sequence number added
+  if(g_file_test(*output_filename, G_FILE_TEST_EXISTS) && !output_to_dir)
+  {
+    if(!*output_ext || (*output_ext && g_str_has_suffix(*output_filename, *output_ext) && !g_strcmp0(*output_ext,strrchr(*output_filename, '.')+1))){
+      //output file exists or there's output ext specified and it's same as file...
+      fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
+    }
+    //TODO: test if file with replaced ext exists
+    // or not if we decide we don't replace file ext with output ext specified
+  }
+
+  if(!*output_ext)
+  {
+    // by this point we're sure output is not dir, there's no output ext specified
+    // so only place to look for it is in filename
+    // try to find out the export format from the output_filename
+    char *ext = strrchr(*output_filename, '.');
+    if(ext && strlen(ext) > DT_MAX_OUTPUT_EXT_LENGTH)
+    {
+      // too long ext, no point in wasting time
+      fprintf(stderr, _("too long output file extension: %s\n"), ext);
+      return 1;
+    }
+    else if(!ext || strlen(ext) <= 1)
+    {
+      // no ext or empty ext, no point in wasting time
+      fprintf(stderr, _("no output file extension given\n"));
+      return 1;
+    }
+    *ext = '\0';
+    ext++;
+    *output_ext = g_strdup(ext);
+  } else {
+    // check and remove redundant file ext
+    char *ext = strrchr(*output_filename, '.');
+    if(ext && !strcmp(*output_ext, ext+1))
+    {
+      *ext = '\0';
+    }
+  }
+
+  if(!strcmp(*output_ext, "jpg"))
+  {
+    g_free(*output_ext);
+    *output_ext = g_strdup("jpeg");
+  }
+
+  if(!strcmp(*output_ext, "tif"))
+  {
+    g_free(*output_ext);
+    *output_ext = g_strdup("tiff");
+  }
+  return 0;
+}
+
+static void _print_history(GList *id_list)
+{
+  // print the history stack. only look at the first image and assume all got the same processing applied
+  int id = GPOINTER_TO_INT(id_list->data);
+  gchar *history = dt_history_get_items_as_string(id);
+  if(history)
+    printf("%s\n", history);
+  else
+    printf("[%s]\n", _("empty history stack"));
+  g_free(history);
+}
+
+// export the images to the disk storage. with bench > 0 each image is exported bench more times and the
+// timings of these appended to times: load, pipe, encode and total.
+static int _export_images(GList *id_list, const gchar *output_filename, const gchar *output_ext,
+                          const dt_cli_options_t *opt, const int bench, GArray *times[4])
+{
+  // init the export data structures
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata, *fdata;
+
+  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
+  if(storage == NULL)
+  {
+    fprintf(
+        stderr, "%s\n",
+        _("cannot find disk storage module. please check your installation, something seems to be broken."));
+    return 1;
+  }
+
+  // the repeated exports of a benchmark have to land on the same file
+  const int onconflict = dt_conf_get_int("plugins/imageio/storage/disk/overwrite");
+  if(bench) dt_conf_set_int("plugins/imageio/storage/disk/overwrite", 1);
+  sdata = storage->get_params(storage);
+  dt_conf_set_int("plugins/imageio/storage/disk/overwrite", onconflict);
+  if(sdata == NULL)
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
+    return 1;
+  }
+
+  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
+  // any longer ...
+  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
+  // all is good now, the last line didn't happen.
+
+  format = dt_imageio_get_format_by_name(output_ext);
+  if(format == NULL)
+  {
+    fprintf(stderr, _("unknown extension '.%s'"), output_ext);
+    fprintf(stderr, "\n");
+    storage->free_params(storage, sdata);
+    return 1;
+  }
+
+  fdata = format->get_params(format);
+  if(fdata == NULL)
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
+    storage->free_params(storage, sdata);
+    return 1;
+  }
+
+  uint32_t w, h, fw, fh, sw, sh;
+  fw = fh = sw = sh = 0;
+  storage->dimension(storage, sdata, &sw, &sh);
+  format->dimension(format, fdata, &fw, &fh);
+
+  if(sw == 0 || fw == 0)
+    w = sw > fw ? sw : fw;
+  else
+    w = sw < fw ? sw : fw;
+
+  if(sh == 0 || fh == 0)
+    h = sh > fh ? sh : fh;
+  else
+    h = sh < fh ? sh : fh;
+
+  fdata->max_width = opt->width;
+  fdata->max_height = opt->height;
+  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
+  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
+  fdata->style[0] = '\0';
+  fdata->style_append = 1; // make append the default and override with --style-overwrite
+
+  if(opt->style)
+  {
+    g_strlcpy((char *)fdata->style, opt->style, DT_MAX_STYLE_NAME_LENGTH);
+    fdata->style[127] = '\0';
+    if(opt->style_overwrite)
+      fdata->style_append = 0;
+  }
+
+  // the export list may be changed by the storage
+  GList *list = g_list_copy(id_list);
+  if(storage->initialize_store)
+  {
+    storage->initialize_store(storage, sdata, &format, &fdata, &list, opt->high_quality, opt->upscale);
+
+    format->set_params(format, fdata, format->params_size(format));
+    storage->set_params(storage, sdata, storage->params_size(storage));
+  }
+
+  // TODO: add a callback to set the bpp without going through the config
+
+  const int total = g_list_length(list);
+  int num = 1, res = 0;
+  for(GList *iter = list; iter; iter = g_list_next(iter), num++)
+  {
+    const int id = GPOINTER_TO_INT(iter->data);
+    // a benchmark runs one cold export to fill the caches and then only keeps the warm ones
+    for(int run = 0; run <= bench; run++)
+    {
+      // TODO: have a parameter in command line to get the export presets
+      dt_export_metadata_t metadata;
+      metadata.flags = dt_lib_export_metadata_default_flags();
+      metadata.list = NULL;
+      const double start = dt_get_wtime();
+      if(storage->store(storage, sdata, id, format, fdata, num, total, opt->high_quality, opt->upscale,
+                        opt->export_masks, opt->icc_type, opt->icc_filename, opt->icc_intent, &metadata) != 0)
+      {
+        res = 1;
+        break;
+      }
+      if(run == 0) continue;
+
+      const double elapsed = dt_get_wtime() - start;
+      dt_imageio_export_times_t export_times;
+      dt_imageio_export_get_times(&export_times);
+      g_array_append_val(times[0], export_times.load);
+      g_array_append_val(times[1], export_times.pipe);
+      g_array_append_val(times[2], export_times.encode);
+      g_array_append_val(times[3], elapsed);
+    }
+  }
+
+  if(storage->finalize_store) storage->finalize_store(storage, sdata);
+  storage->free_params(storage, sdata);
+  format->free_params(format, fdata);
+  g_list_free(list);
+
+  return res;
+}
+
+static gboolean _parse_bool(const char *value, gboolean *out)
+{
+  gchar *str = g_ascii_strup(value, -1);
+  gboolean valid = TRUE;
+  if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
+    *out = FALSE;
+  else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
+    *out = TRUE;
+  else
+    valid = FALSE;
+  g_free(str);
+  return valid;
+}
+
+static gchar *_batch_read_line(FILE *f)
+{
+  GString *line = g_string_new(NULL);
+  char buf[1024];
+  while(fgets(buf, sizeof(buf), f))
+  {
+    g_string_append(line, buf);
+    if(line->len && line->str[line->len - 1] == '\n') break;
+  }
+  if(!line->len)
+  {
+    g_string_free(line, TRUE);
+    return NULL;
+  }
+  return g_string_free(line, FALSE);
+}
+
+// one job per line, written like the command line: <input file or dir> [<xmp file>] <output destination>
+// [options]. the strings of opt point into argv, the options not given keep the values of the command line.
+static int _batch_parse_job(gchar **argv, dt_cli_options_t *opt, gchar **input, gchar **xmp, gchar **output)
+{
+  int file_counter = 0;
+  gchar *files[3] = { NULL, NULL, NULL };
+  for(int k = 0; argv[k]; k++)
+  {
+    const gboolean has_value = argv[k + 1] != NULL;
+    if(argv[k][0] != '-')
+    {
+      if(file_counter < 3) files[file_counter] = argv[k];
+      file_counter++;
+    }
+    else if(!strcmp(argv[k], "--width") && has_value)
+      opt->width = MAX(atoi(argv[++k]), 0);
+    else if(!strcmp(argv[k], "--height") && has_value)
+      opt->height = MAX(atoi(argv[++k]), 0);
+    else if(!strcmp(argv[k], "--hq") && has_value)
+    {
+      if(!_parse_bool(argv[++k], &opt->high_quality)) return 1;
+    }
+    else if(!strcmp(argv[k], "--upscale") && has_value)
+    {
+      if(!_parse_bool(argv[++k], &opt->upscale)) return 1;
+    }
+    else if(!strcmp(argv[k], "--export_masks") && has_value)
+    {
+      if(!_parse_bool(argv[++k], &opt->export_masks)) return 1;
+    }
+    else if(!strcmp(argv[k], "--style") && has_value)
+      opt->style = argv[++k];
+    else if(!strcmp(argv[k], "--style-overwrite"))
+      opt->style_overwrite = TRUE;
+    else if(!strcmp(argv[k], "--out-ext") && has_value)
+    {
+      k++;
+      if(strlen(argv[k]) > DT_MAX_OUTPUT_EXT_LENGTH) return 1;
+      opt->output_ext = argv[k][0] == '.' ? argv[k] + 1 : argv[k];
+    }
+    else if(!strcmp(argv[k], "--icc-type") && has_value)
+    {
+      gchar *str = g_ascii_strup(argv[++k], -1);
+      opt->icc_type = get_icc_type(str);
+      g_free(str);
+      if(opt->icc_type >= DT_COLORSPACE_LAST) return 1;
+    }
+    else if(!strcmp(argv[k], "--icc-file") && has_value)
+      opt->icc_filename = argv[++k];
+    else if(!strcmp(argv[k], "--icc-intent") && has_value)
+    {
+      gchar *str = g_ascii_strup(argv[++k], -1);
+      opt->icc_intent = get_icc_intent(str);
+      g_free(str);
+      if(opt->icc_intent >= DT_INTENT_LAST) return 1;
+    }
+    else
+      return 1;
+  }
+
+  if(file_counter < 2 || file_counter > 3) return 1;
+  *input = files[0];
+  *xmp = file_counter == 3 ? files[1] : NULL;
+  *output = files[file_counter - 1];
+  return 0;
+}
+
+// process the jobs of a manifest, or of stdin for "-", in this process so the modules, caches and compiled
+// opencl kernels are only set up once. a line per job is reported on stdout.
+static int _batch_run(const char *manifest, const dt_cli_options_t *defaults, const gboolean verbose)
+{
+  FILE *f = !strcmp(manifest, "-") ? stdin : g_fopen(manifest, "r");
+  if(!f)
+  {
+    fprintf(stderr, _("error: can't open batch file %s"), manifest);
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  int res = 0, job = 0;
+  gchar *line;
+  while((line = _batch_read_line(f)))
+  {
+    g_strstrip(line);
+    if(!line[0] || line[0] == '#')
+    {
+      g_free(line);
+      continue;
+    }
+    job++;
+
+    gchar **argv = NULL;
+    GError *error = NULL;
+    dt_cli_options_t opt = *defaults;
+    gchar *input = NULL, *xmp = NULL, *output = NULL;
+    int failed = !g_shell_parse_argv(line, NULL, &argv, &error) || _batch_parse_job(argv, &opt, &input, &xmp, &output);
+    if(failed)
+      fprintf(stderr, _("error: can't parse batch job %d: %s\n"), job, error ? error->message : line);
+    if(error) g_error_free(error);
+
+    GList *id_list = NULL;
+    if(!failed && !g_file_test(input, G_FILE_TEST_EXISTS))
+    {
+      fprintf(stderr, _("notice: input file or dir '%s' doesn't exist, skipping\n"), input);
+      failed = 1;
+    }
+    if(!failed)
+    {
+      GList *inputs = g_list_prepend(NULL, input);
+      id_list = _import_inputs(inputs);
+      g_list_free(inputs);
+      failed = !id_list || (xmp && _attach_xmp(id_list, xmp));
+    }
+    if(!failed)
+    {
+      gchar *output_filename = g_strdup(output);
+      gchar *output_ext = g_strdup(opt.output_ext);
+      if(verbose) _print_history(id_list);
+      failed = _output_destination(&output_filename, &output_ext)
+               || _export_images(id_list, output_filename, output_ext, &opt, 0, NULL);
+      g_free(output_filename);
+      g_free(output_ext);
+    }
+
+    // the next job starts from its own files again, not what this one left in the library
+    for(GList *iter = id_list; iter; iter = g_list_next(iter))
+      dt_image_remove(GPOINTER_TO_INT(iter->data));
+    g_list_free(id_list);
+
+    printf("[batch] job %d %s\n", job, failed ? "failed" : "done");
+    fflush(stdout);
+    res |= failed;
+    g_strfreev(argv);
+    g_free(line);
+  }
+
+  if(f != stdin) fclose(f);
+  return res;
+}
+
+#ifdef HAVE_HTTP_SERVER
+// a render service: export jobs are posted over http and run in this process, like the jobs of --batch, by a
+// pool of serve_jobs threads. the requests wait paused in libsoup until their job is done.
+typedef struct _serve_t
+{
+  const dt_cli_options_t *defaults;
+  gboolean verbose;
+  GThreadPool *pool;
+  int max_queued;
+  int queued; // accepted and not yet answered, only touched in the main context
+  gint running;
+  int done, failed;
+  gboolean stopping;
+  GMainLoop *loop;
+} _serve_t;
+
+typedef struct _serve_job_t
+{
+  _serve_t *serve;
+  SoupServer *server;
+  SoupMessage *msg;
+  gulong finished_handler;
+  gboolean gone; // the client went away before the job was done
+  gchar *dir;    // scratch dir with the uploads in in/ and the result in out/
+  GPtrArray *args;
+  dt_cli_options_t opt;
+  gchar *input, *xmp, *output;
+  gchar *result;
+  GMappedFile *mapped;
+} _serve_job_t;
+
+static void _serve_remove_dir(const gchar *path)
+{
+  GDir *dir = g_dir_open(path, 0, NULL);
+  if(dir)
+  {
+    const gchar *name;
+    while((name = g_dir_read_name(dir)))
+    {
+      gchar *child = g_build_filename(path, name, NULL);
+      if(g_file_test(child, G_FILE_TEST_IS_DIR))
+        _serve_remove_dir(child);
+      else
+        g_unlink(child);
+      g_free(child);
+    }
+    g_dir_close(dir);
+  }
+  g_rmdir(path);
+}
+
+static void _serve_job_free(gpointer data)
+{
+  _serve_job_t *job = (_serve_job_t *)data;
+  if(job->mapped) g_mapped_file_unref(job->mapped);
+  if(job->dir) _serve_remove_dir(job->dir);
+  g_free(job->dir);
+  g_free(job->result);
+  if(job->args) g_ptr_array_free(job->args, TRUE);
+  g_free(job);
+}
+
+static void _serve_reply_text(SoupMessage *msg, const guint status, const char *text)
+{
+  soup_message_set_status(msg, status);
+  soup_message_set_response(msg, "text/plain", SOUP_MEMORY_COPY, text, strlen(text));
+}
+
+static void _serve_message_finished(SoupMessage *msg, gpointer user_data)
+{
+  ((_serve_job_t *)user_data)->gone = TRUE;
+}
+
+// the fields of a request are the batch options without their leading dashes
+static gboolean _serve_add_option(GPtrArray *args, const char *key, const char *value)
+{
+  static const char *const options[]
+      = { "width", "height", "hq", "upscale", "export_masks", "style", "out-ext", "icc-type", "icc-file",
+          "icc-intent", NULL };
+
+  if(!g_strcmp0(key, "style-overwrite"))
+  {
+    gboolean overwrite = FALSE;
+    if(!_parse_bool(value, &overwrite)) return FALSE;
+    if(overwrite) g_ptr_array_add(args, g_strdup("--style-overwrite"));
+    return TRUE;
+  }
+  if(!g_strcmp0(key, "format")) key = "out-ext";
+  for(int k = 0; options[k]; k++)
+  {
+    if(!g_strcmp0(key, options[k]))
+    {
+      g_ptr_array_add(args, g_strconcat("--", key, NULL));
+      g_ptr_array_add(args, g_strdup(value));
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// store an upload in the in/ dir of the job under the base name the client gave it
+static gchar *_serve_store_upload(const _serve_job_t *job, const char *filename, const char *data,
+                                  const gsize length)
+{
+  gchar *base = filename ? g_path_get_basename(filename) : NULL;
+  gchar *path = NULL;
+  if(base && base[0] && base[0] != '.' && strcmp(base, G_DIR_SEPARATOR_S))
+  {
+    path = g_build_filename(job->dir, "in", base, NULL);
+    if(!g_file_set_contents(path, data, length, NULL))
+    {
+      g_free(path);
+      path = NULL;
+    }
+  }
+  g_free(base);
+  return path;
+}
+
+// fill the job from the request, either multipart/form-data with the image (and xmp) uploads and the
+// options as fields, or the image as the body with the options in the query. returns an error text.
+static const char *_serve_parse_request(_serve_job_t *job, SoupMessage *msg, GHashTable *query)
+{
+  gchar *image = NULL, *xmp = NULL;
+  GPtrArray *options = g_ptr_array_new_with_free_func(g_free);
+  const char *error = NULL;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  if(query)
+  {
+    g_hash_table_iter_init(&iter, query);
+    while(!error && g_hash_table_iter_next(&iter, &key, &value))
+    {
+      if(!strcmp(key, "image") || !strcmp(key, "xmp"))
+      {
+        if(!g_file_test(value, G_FILE_TEST_IS_REGULAR))
+          error = "image or xmp file not found";
+        else if(!strcmp(key, "image"))
+          image = g_strdup(value);
+        else
+          xmp = g_strdup(value);
+      }
+      else if(strcmp(key, "filename") && !_serve_add_option(options, key, value))
+        error = "unknown or invalid option";
+    }
+  }
+
+  const char *content_type = soup_message_headers_get_content_type(msg->request_headers, NULL);
+  SoupBuffer *body = soup_message_body_flatten(msg->request_body);
+  if(!error && content_type && !g_ascii_strcasecmp(content_type, "multipart/form-data"))
+  {
+    SoupMultipart *multipart = soup_multipart_new_from_message(msg->request_headers, msg->request_body);
+    const int parts = multipart ? soup_multipart_get_length(multipart) : 0;
+    if(!multipart) error = "broken multipart body";
+    for(int k = 0; !error && k < parts; k++)
+    {
+      SoupMessageHeaders *headers;
+      SoupBuffer *part;
+      GHashTable *params = NULL;
+      if(!soup_multipart_get_part(multipart, k, &headers, &part)
+         || !soup_message_headers_get_content_disposition(headers, NULL, &params))
+      {
+        error = "broken multipart body";
+        break;
+      }
+      const char *name = g_hash_table_lookup(params, "name");
+      const char *filename = g_hash_table_lookup(params, "filename");
+      if(!g_strcmp0(name, "image") || !g_strcmp0(name, "xmp"))
+      {
+        const gboolean is_image = !g_strcmp0(name, "image");
+        gchar *path = _serve_store_upload(job, is_image ? filename : "job.xmp", part->data, part->length);
+        if(!path)
+          error = "can't store the upload, the image needs a file name";
+        else if(is_image)
+        {
+          g_free(image);
+          image = path;
+        }
+        else
+        {
+          g_free(xmp);
+          xmp = path;
+        }
+      }
+      else
+      {
+        gchar *text = g_strndup(part->data, part->length);
+        if(!_serve_add_option(options, name, text)) error = "unknown or invalid option";
+        g_free(text);
+      }
+      g_hash_table_destroy(params);
+    }
+    if(multipart) soup_multipart_free(multipart);
+  }
+  else if(!error && body->length)
+  {
+    const char *filename = query ? g_hash_table_lookup(query, "filename") : NULL;
+    g_free(image);
+    image = _serve_store_upload(job, filename, body->data, body->length);
+    if(!image) error = "can't store the upload, give its file name as the filename parameter";
+  }
+  soup_buffer_free(body);
+
+  if(!error && !image) error = "no image given";
+
+  if(!error)
+  {
+    // the job as a line of --batch: <input> [<xmp>] <output dir> [options]
+    job->args = g_ptr_array_new_with_free_func(g_free);
+    g_ptr_array_add(job->args, image);
+    if(xmp) g_ptr_array_add(job->args, xmp);
+    g_ptr_array_add(job->args, g_build_filename(job->dir, "out", NULL));
+    for(guint k = 0; k < options->len; k++) g_ptr_array_add(job->args, g_strdup(options->pdata[k]));
+    g_ptr_array_add(job->args, NULL);
+    image = xmp = NULL;
+
+    job->opt = *job->serve->defaults;
+    if(_batch_parse_job((gchar **)job->args->pdata, &job->opt, &job->input, &job->xmp, &job->output))
+      error = "invalid option value";
+  }
+
+  g_free(image);
+  g_free(xmp);
+  g_ptr_array_free(options, TRUE);
+  return error;
+}
+
+// answer a job in the main context, this is where its message is resumed
+static gboolean _serve_job_reply(gpointer data)
+{
+  _serve_job_t *job = (_serve_job_t *)data;
+  _serve_t *serve = job->serve;
+  gboolean owned = FALSE;
+
+  if(job->result)
+    serve->done++;
+  else
+    serve->failed++;
+
+  if(!job->gone)
+  {
+    GError *error = NULL;
+    if(job->result) job->mapped = g_mapped_file_new(job->result, FALSE, &error);
+    if(job->mapped)
+    {
+      gchar *basename = g_path_get_basename(job->result);
+      gchar *content_type = g_content_type_guess(basename, NULL, 0, NULL);
+      gchar *mime = g_content_type_get_mime_type(content_type);
+      GHashTable *params = g_hash_table_new(g_str_hash, g_str_equal);
+      g_hash_table_insert(params, "filename", basename);
+      soup_message_headers_set_content_disposition(job->msg->response_headers, "attachment", params);
+      soup_message_headers_set_content_type(job->msg->response_headers,
+                                            mime ? mime : "application/octet-stream", NULL);
+      // the result is sent from the mapped file, the job is freed with the buffer
+      SoupBuffer *buffer = soup_buffer_new_with_owner(g_mapped_file_get_contents(job->mapped),
+                                                      g_mapped_file_get_length(job->mapped), job,
+                                                      _serve_job_free);
+      soup_message_body_append_buffer(job->msg->response_body, buffer);
+      soup_buffer_free(buffer);
+      soup_message_set_status(job->msg, SOUP_STATUS_OK);
+      owned = TRUE;
+      g_hash_table_destroy(params);
+      g_free(mime);
+      g_free(content_type);
+      g_free(basename);
+    }
+    else
+      _serve_reply_text(job->msg, SOUP_STATUS_UNPROCESSABLE_ENTITY, error ? error->message : "export failed");
+    if(error) g_error_free(error);
+    soup_server_unpause_message(job->server, job->msg);
+  }
+
+  g_signal_handler_disconnect(job->msg, job->finished_handler);
+  g_object_unref(job->msg);
+  job->msg = NULL;
+  if(!owned) _serve_job_free(job);
+
+  serve->queued--;
+  if(serve->stopping && serve->queued == 0) g_main_loop_quit(serve->loop);
+  return G_SOURCE_REMOVE;
+}
+
+static void _serve_job_run(gpointer data, gpointer user_data)
+{
+  _serve_job_t *job = (_serve_job_t *)data;
+  _serve_t *serve = (_serve_t *)user_data;
+  g_atomic_int_inc(&serve->running);
+
+  GList *inputs = g_list_prepend(NULL, job->input);
+  GList *id_list = _import_inputs(inputs);
+  g_list_free(inputs);
+  int failed = !id_list || (job->xmp && _attach_xmp(id_list, job->xmp));
+  if(!failed)
+  {
+    gchar *output_filename = g_strdup(job->output);
+    gchar *output_ext = g_strdup(job->opt.output_ext);
+    if(serve->verbose) _print_history(id_list);
+    failed = _output_destination(&output_filename, &output_ext)
+             || _export_images(id_list, output_filename, output_ext, &job->opt, 0, NULL);
+    g_free(output_filename);
+    g_free(output_ext);
+  }
+  for(GList *iter = id_list; iter; iter = g_list_next(iter))
+    dt_image_remove(GPOINTER_TO_INT(iter->data));
+  g_list_free(id_list);
+
+  // the export of a single image leaves a single file
+  GDir *dir = failed ? NULL : g_dir_open(job->output, 0, NULL);
+  const gchar *name = dir ? g_dir_read_name(dir) : NULL;
+  if(name) job->result = g_build_filename(job->output, name, NULL);
+  if(dir) g_dir_close(dir);
+
+  g_atomic_int_add(&serve->running, -1);
+  g_main_context_invoke(NULL, _serve_job_reply, job);
+}
+
+static void _serve_status(_serve_t *serve, SoupMessage *msg)
+{
+  gchar *status = g_strdup_printf("{\"queued\":%d,\"running\":%d,\"done\":%d,\"failed\":%d,\"max_queued\":%d}\n",
+                                  serve->queued - g_atomic_int_get(&serve->running),
+                                  g_atomic_int_get(&serve->running), serve->done, serve->failed,
+                                  serve->max_queued);
+  soup_message_set_status(msg, SOUP_STATUS_OK);
+  soup_message_set_response(msg, "application/json", SOUP_MEMORY_TAKE, status, strlen(status));
+}
+
+static void _serve_request(SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+                           SoupClientContext *client, gpointer user_data)
+{
+  _serve_t *serve = (_serve_t *)user_data;
+
+  if(!strcmp(path, "/status") && msg->method == SOUP_METHOD_GET)
+  {
+    _serve_status(serve, msg);
+    return;
+  }
+  if(strcmp(path, "/export"))
+  {
+    _serve_reply_text(msg, SOUP_STATUS_NOT_FOUND, "unknown path, use /export or /status");
+    return;
+  }
+  if(msg->method != SOUP_METHOD_POST)
+  {
+    _serve_reply_text(msg, SOUP_STATUS_METHOD_NOT_ALLOWED, "post the export jobs");
+    return;
+  }
+  if(serve->stopping || serve->queued >= serve->max_queued)
+  {
+    soup_message_headers_replace(msg->response_headers, "Retry-After", "1");
+    _serve_reply_text(msg, SOUP_STATUS_SERVICE_UNAVAILABLE, "the queue is full");
+    return;
+  }
+
+  _serve_job_t *job = g_malloc0(sizeof(_serve_job_t));
+  job->serve = serve;
+  job->dir = g_dir_make_tmp("darktable-serve-XXXXXX", NULL);
+  gchar *in = job->dir ? g_build_filename(job->dir, "in", NULL) : NULL;
+  gchar *out = job->dir ? g_build_filename(job->dir, "out", NULL) : NULL;
+  if(!in || g_mkdir(in, 0700) || g_mkdir(out, 0700))
+  {
+    g_free(in);
+    g_free(out);
+    _serve_job_free(job);
+    _serve_reply_text(msg, SOUP_STATUS_INTERNAL_SERVER_ERROR, "can't create the scratch dir of the job");
+    return;
+  }
+  g_free(in);
+  g_free(out);
+
+  const char *error = _serve_parse_request(job, msg, query);
+  if(error)
+  {
+    _serve_job_free(job);
+    _serve_reply_text(msg, SOUP_STATUS_BAD_REQUEST, error);
+    return;
+  }
+
+  job->server = server;
+  job->msg = g_object_ref(msg);
+  job->finished_handler = g_signal_connect(msg, "finished", G_CALLBACK(_serve_message_finished), job);
+  soup_server_pause_message(server, msg);
+  serve->queued++;
+  g_thread_pool_push(serve->pool, job, NULL);
+}
+
+#ifndef _WIN32
+static gboolean _serve_stop(gpointer user_data)
+{
+  _serve_t *serve = (_serve_t *)user_data;
+  // finish the accepted jobs, refuse new ones
+  fprintf(stderr, "[serve] stopping after %d queued job(s)\n", serve->queued);
+  serve->stopping = TRUE;
+  if(serve->queued == 0) g_main_loop_quit(serve->loop);
+  return G_SOURCE_CONTINUE;
+}
+#endif
+
+static int _serve_run(const int port, const int jobs, const int max_queued, const dt_cli_options_t *defaults,
+                      const gboolean verbose)
 {
-  ICC_INTENT_FROM_STR(PERCEPTUAL);
-  ICC_INTENT_FROM_STR(RELATIVE_COLORIMETRIC);
-  ICC_INTENT_FROM_STR(SATURATION);
-  ICC_INTENT_FROM_STR(ABSOLUTE_COLORIMETRIC);
-  return DT_INTENT_LAST;
+  _serve_t serve = { .defaults = defaults, .verbose = verbose, .max_queued = MAX(max_queued, 1) };
+
+  serve.pool = g_thread_pool_new(_serve_job_run, &serve, MAX(jobs, 1), TRUE, NULL);
+  dt_http_server_t *server = dt_http_server_create_service(port, _serve_request, &serve);
+  if(!serve.pool || !server)
+  {
+    fprintf(stderr, _("error: can't serve on port %d\n"), port);
+    if(serve.pool) g_thread_pool_free(serve.pool, TRUE, TRUE);
+    return 1;
+  }
+  printf("[serve] listening on %s with %d job(s) at a time\n", server->url, MAX(jobs, 1));
+  fflush(stdout);
+
+  serve.loop = g_main_loop_new(NULL, FALSE);
+#ifndef _WIN32
+  g_unix_signal_add(SIGINT, _serve_stop, &serve);
+  g_unix_signal_add(SIGTERM, _serve_stop, &serve);
+#endif
+  g_main_loop_run(serve.loop);
+
+  dt_http_server_kill(server);
+  g_thread_pool_free(serve.pool, FALSE, TRUE);
+  g_main_loop_unref(serve.loop);
+  return 0;
 }
-#undef ICC_INTENT_FROM_STR
+#endif // HAVE_HTTP_SERVER
 
 int main(int argc, char *arg[])
 {
@@ -195,11 +1149,12 @@ int main(int argc, char *arg[])
   gchar *output_filename = NULL;
   gchar *output_ext = NULL;
   char *style = NULL;
+  char *batch = NULL;
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
+  int width = 0, height = 0, bpp = 0, bench = 0;
+  int serve_port = 0, serve_jobs = 1, serve_queue = 16;
   gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE,
-           style_overwrite = FALSE, custom_presets = TRUE, export_masks = FALSE,
-           output_to_dir = FALSE;
+           style_overwrite = FALSE, custom_presets = TRUE, export_masks = FALSE;
 
   GList* inputs = NULL;
 
@@ -381,6 +1336,39 @@ int main(int argc, char *arg[])
           exit(1);
         }
       }
+      else if(!strcmp(arg[k], "--bench") && argc > k + 1)
+      {
+        k++;
+        bench = MAX(atoi(arg[k]), 0);
+      }
+      else if(!strcmp(arg[k], "--batch") && argc > k + 1)
+      {
+        k++;
+        batch = arg[k];
+      }
+#ifdef HAVE_HTTP_SERVER
+      else if(!strcmp(arg[k], "--serve") && argc > k + 1)
+      {
+        k++;
+        serve_port = atoi(arg[k]);
+        if(serve_port <= 0 || serve_port > 65535)
+        {
+          fprintf(stderr, "%s: %s\n", _("invalid port for --serve"), arg[k]);
+          usage(arg[0]);
+          exit(1);
+        }
+      }
+      else if(!strcmp(arg[k], "--serve-jobs") && argc > k + 1)
+      {
+        k++;
+        serve_jobs = MAX(atoi(arg[k]), 1);
+      }
+      else if(!strcmp(arg[k], "--serve-queue") && argc > k + 1)
+      {
+        k++;
+        serve_queue = MAX(atoi(arg[k]), 1);
+      }
+#endif
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
         verbose = TRUE;
@@ -420,6 +1408,63 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
+  dt_cli_options_t options = { .width = width, .height = height, .high_quality = high_quality,
+                               .upscale = upscale, .style_overwrite = style_overwrite,
+                               .export_masks = export_masks, .style = style, .output_ext = NULL,
+                               .icc_type = icc_type, .icc_filename = icc_filename, .icc_intent = icc_intent };
+
+  if(batch)
+  {
+    if(file_counter > 0 || inputs)
+    {
+      fprintf(stderr, _("error: --batch takes the inputs and outputs from its jobs only\n"));
+      usage(arg[0]);
+      free(m_arg);
+      exit(1);
+    }
+    // init dt without gui and without data.db:
+    if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
+    {
+      free(m_arg);
+      exit(1);
+    }
+    // the options of the command line are the defaults of each job
+    options.output_ext = output_ext;
+    const int res = _batch_run(batch, &options, verbose);
+    g_free(output_ext);
+    g_free(icc_filename);
+    dt_cleanup();
+    free(m_arg);
+    exit(res);
+  }
+
+#ifdef HAVE_HTTP_SERVER
+  if(serve_port)
+  {
+    if(file_counter > 0 || inputs || batch)
+    {
+      fprintf(stderr, _("error: --serve takes the inputs and outputs from its requests only\n"));
+      usage(arg[0]);
+      free(m_arg);
+      exit(1);
+    }
+    // init dt without gui and without data.db:
+    if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
+    {
+      free(m_arg);
+      exit(1);
+    }
+    // the options of the command line are the defaults of each request
+    options.output_ext = output_ext;
+    const int res = _serve_run(serve_port, serve_jobs, serve_queue, &options, verbose);
+    g_free(output_ext);
+    g_free(icc_filename);
+    dt_cleanup();
+    free(m_arg);
+    exit(res);
+  }
+#endif
+
   if( (inputs && file_counter < 1) || (!inputs && file_counter < 2) || file_counter > 3)
   {
     usage(arg[0]);
@@ -477,32 +1522,15 @@ int main(int argc, char *arg[])
     input_filename = NULL;
   }
 
-  if(g_file_test(output_filename, G_FILE_TEST_IS_DIR))
+  if(_output_destination(&output_filename, &output_ext))
   {
-    output_to_dir = TRUE;
-    if(!output_ext)
-    {
-      output_ext = g_strdup("jpg");
-    }
-    fprintf(stderr, _("notice: output location is a directory. assuming '%s/$(FILE_NAME).%s' output pattern"), output_filename, output_ext);
-    fprintf(stderr, "\n");
-    gchar* temp_of = g_strdup(output_filename);
+    usage(arg[0]);
+    free(m_arg);
     g_free(output_filename);
-    if(g_str_has_suffix(temp_of, "/"))
-      temp_of[strlen(temp_of) - 1] = '\0';
-    output_filename = g_strconcat(temp_of, "/$(FILE_NAME)", NULL);
-    g_free(temp_of);
-  }
-
-  // the output file already exists, so there will be a sequence number added
-  if(g_file_test(output_filename, G_FILE_TEST_EXISTS) && !output_to_dir)
-  {
-    if(!output_ext || (output_ext && g_str_has_suffix(output_filename, output_ext) && !g_strcmp0(output_ext,strrchr(output_filename, '.')+1))){
-      //output file exists or there's output ext specified and it's same as file...
-      fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
-    }
-    //TODO: test if file with replaced ext exists
-    // or not if we decide we don't replace file ext with output ext specified
+    g_free(output_ext);
+    if(inputs)
+      g_list_free_full(inputs, g_free);
+    exit(1);
   }
 
   // init dt without gui and without data.db:
@@ -517,42 +1545,7 @@ int main(int argc, char *arg[])
     exit(1);
   }
 
-  GList *id_list = NULL;
-
-  for(GList *l = inputs; l != NULL; l=g_list_next(l))
-  {
-    gchar* input = l->data;
-
-    if(g_file_test(input, G_FILE_TEST_IS_DIR))
-    {
-      const int filmid = dt_film_import(input);
-      if(!filmid)
-      {
-        // one of inputs was a failure, no prob
-        fprintf(stderr, _("error: can't open folder %s"), input);
-        fprintf(stderr, "\n");
-        continue;
-      }
-      id_list = g_list_concat(id_list, dt_film_get_image_ids(filmid));
-    }
-    else
-    {
-      dt_film_t film;
-      int filmid = 0;
-
-      gchar *directory = g_path_get_dirname(input);
-      filmid = dt_film_new(&film, directory);
-      const int32_t id = dt_image_import(filmid, input, TRUE, TRUE);
-      g_free(directory);
-      if(!id)
-      {
-        fprintf(stderr, _("error: can't open file %s"), input);
-        fprintf(stderr, "\n");
-        continue;
-      }
-      id_list = g_list_append(id_list, GINT_TO_POINTER(id));
-    }
-  }
+  GList *id_list = _import_inputs(inputs);
 
   //we no longer need inputs
   if(inputs)
@@ -572,194 +1565,41 @@ int main(int argc, char *arg[])
   }
 
   // attach xmp, if requested:
-  if(xmp_filename)
-  {
-    for(GList *iter = id_list; iter; iter = g_list_next(iter))
-    {
-      int id = GPOINTER_TO_INT(iter->data);
-      dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
-      if(dt_exif_xmp_read(image, xmp_filename, 1) != 0)
-      {
-        fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
-        fprintf(stderr, "\n");
-        free(m_arg);
-        g_free(output_filename);
-        if(output_ext)
-          g_free(output_ext);
-        exit(1);
-      }
-      // don't write new xmp:
-      dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
-    }
-  }
-
-  // print the history stack. only look at the first image and assume all got the same processing applied
-  if(verbose)
-  {
-    int id = GPOINTER_TO_INT(id_list->data);
-    gchar *history = dt_history_get_items_as_string(id);
-    if(history)
-      printf("%s\n", history);
-    else
-      printf("[%s]\n", _("empty history stack"));
-  }
-
-  if(!output_ext)
-  {
-    // by this point we're sure output is not dir, there's no output ext specified
-    // so only place to look for it is in filename
-    // try to find out the export format from the output_filename
-    char *ext = strrchr(output_filename, '.');
-    if(ext && strlen(ext) > DT_MAX_OUTPUT_EXT_LENGTH)
-    {
-      // too long ext, no point in wasting time
-      fprintf(stderr, _("too long output file extension: %s\n"), ext);
-      usage(arg[0]);
-      g_free(output_filename);
-      exit(1);
-    }
-    else if(!ext || strlen(ext) <= 1)
-    {
-      // no ext or empty ext, no point in wasting time
-      fprintf(stderr, _("no output file extension given\n"));
-      usage(arg[0]);
-      g_free(output_filename);
-      exit(1);
-    }
-    *ext = '\0';
-    ext++;
-    output_ext = g_strdup(ext);
-  } else {
-    // check and remove redundant file ext
-    char *ext = strrchr(output_filename, '.');
-    if(ext && !strcmp(output_ext, ext+1))
-    {
-      *ext = '\0';
-    }
-  }
-
-  if(!strcmp(output_ext, "jpg"))
-  {
-    g_free(output_ext);
-    output_ext = g_strdup("jpeg");
-  }
-
-  if(!strcmp(output_ext, "tif"))
-  {
-    g_free(output_ext);
-    output_ext = g_strdup("tiff");
-  }
-
-  // init the export data structures
-  dt_imageio_module_format_t *format;
-  dt_imageio_module_storage_t *storage;
-  dt_imageio_module_data_t *sdata, *fdata;
-
-  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
-  if(storage == NULL)
-  {
-    fprintf(
-        stderr, "%s\n",
-        _("cannot find disk storage module. please check your installation, something seems to be broken."));
-    free(m_arg);
-    g_free(output_filename);
-    g_free(output_ext);
-    exit(1);
-  }
-
-  sdata = storage->get_params(storage);
-  if(sdata == NULL)
+  if(xmp_filename && _attach_xmp(id_list, xmp_filename))
   {
-    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
     free(m_arg);
     g_free(output_filename);
     g_free(output_ext);
     exit(1);
   }
 
-  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
-  // any longer ...
-  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
-  // all is good now, the last line didn't happen.
-  g_free(output_filename);
-
-  format = dt_imageio_get_format_by_name(output_ext);
-  if(format == NULL)
-  {
-    fprintf(stderr, _("unknown extension '.%s'"), output_ext);
-    fprintf(stderr, "\n");
-    free(m_arg);
-    g_free(output_ext);
-    exit(1);
-  }
-
-  fdata = format->get_params(format);
-  if(fdata == NULL)
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
-    free(m_arg);
-    g_free(output_ext);
-    exit(1);
-  }
-
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  storage->dimension(storage, sdata, &sw, &sh);
-  format->dimension(format, fdata, &fw, &fh);
-
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
-
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
-  else
-    h = sh < fh ? sh : fh;
-
-  fdata->max_width = width;
-  fdata->max_height = height;
-  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
-  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
-  fdata->style[0] = '\0';
-  fdata->style_append = 1; // make append the default and override with --style-overwrite
-
-  if(style)
-  {
-    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
-    fdata->style[127] = '\0';
-    if(style_overwrite)
-      fdata->style_append = 0;
-  }
-
-  if(storage->initialize_store)
-  {
-    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, high_quality, upscale);
+  if(verbose) _print_history(id_list);
 
-    format->set_params(format, fdata, format->params_size(format));
-    storage->set_params(storage, sdata, storage->params_size(storage));
-  }
+  GArray *bench_load = g_array_new(FALSE, FALSE, sizeof(double));
+  GArray *bench_pipe = g_array_new(FALSE, FALSE, sizeof(double));
+  GArray *bench_encode = g_array_new(FALSE, FALSE, sizeof(double));
+  GArray *bench_total = g_array_new(FALSE, FALSE, sizeof(double));
 
-  // TODO: add a callback to set the bpp without going through the config
+  GArray *bench_times[4] = { bench_load, bench_pipe, bench_encode, bench_total };
+  const int res = _export_images(id_list, output_filename, output_ext, &options, bench, bench_times);
+  g_free(output_filename);
 
-  int num = 1, res = 0;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  if(bench)
   {
-    const int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    if(storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, export_masks,
-                      icc_type, icc_filename, icc_intent, &metadata) != 0)
-      res = 1;
+    _bench_print_config(bench, total);
+    _bench_print_stage("load", bench_load);
+    _bench_print_stage("pipe", bench_pipe);
+    _bench_print_stage("encode", bench_encode);
+    _bench_print_stage("total", bench_total);
   }
+  g_array_free(bench_load, TRUE);
+  g_array_free(bench_pipe, TRUE);
+  g_array_free(bench_encode, TRUE);
+  g_array_free(bench_total, TRUE);
 
   // cleanup time
-  if(storage->finalize_store) storage->finalize_store(storage, sdata);
-  storage->free_params(storage, sdata);
-  format->free_params(format, fdata);
   g_list_free(id_list);
+  g_free(output_ext);
 
   if(icc_filename)
     g_free(icc_filename);
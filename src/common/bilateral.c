@@ -109,30 +109,42 @@ size_t dt_bilateral_singlebuffer_size2(const int width,
 }
 #endif /* !HAVE_OPENCL */
 
-static size_t image_to_grid(const dt_bilateral_t *const b, const int i, const int j, const float L,
-                            float *xf, float *yf, float *zf)
+// the part of the grid lookup which only depends on the image row, so that it is done once per row
+typedef struct dt_bilateral_row_t
 {
-  float x = CLAMPS(i / b->sigma_s, 0, b->size_x - 1);
-  float y = CLAMPS(j / b->sigma_s, 0, b->size_y - 1);
-  float z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
-  const int xi = MIN((int)x, b->size_x - 2);
+  size_t base; // grid index of the row
+  float yf;
+  float inv_sigma_s, inv_sigma_r;
+  float max_x, max_z;
+  int max_xi, max_zi;
+} dt_bilateral_row_t;
+
+static inline dt_bilateral_row_t row_to_grid(const dt_bilateral_t *const b, const int j)
+{
+  dt_bilateral_row_t r;
+  const float y = CLAMPS(j / b->sigma_s, 0, b->size_y - 1);
   const int yi = MIN((int)y, b->size_y - 2);
-  const int zi = MIN((int)z, b->size_z - 2);
-  *xf = x - xi;
-  *yf = y - yi;
-  *zf = z - zi;
-  return ((xi + yi * b->size_x) * b->size_z) + zi;
+  r.yf = y - yi;
+  r.base = (size_t)yi * b->size_x * b->size_z;
+  r.inv_sigma_s = 1.0f / b->sigma_s;
+  r.inv_sigma_r = 1.0f / b->sigma_r;
+  r.max_x = b->size_x - 1;
+  r.max_z = b->size_z - 1;
+  r.max_xi = b->size_x - 2;
+  r.max_zi = b->size_z - 2;
+  return r;
 }
 
-static size_t image_to_relgrid(const dt_bilateral_t *const b, const int i, const float L, float *xf, float *zf)
+static inline size_t row_image_to_grid(const dt_bilateral_t *const b, const dt_bilateral_row_t *const r,
+                                       const int i, const float L, float *xf, float *zf)
 {
-  float x = CLAMPS(i / b->sigma_s, 0, b->size_x - 1);
-  float z = CLAMPS(L / b->sigma_r, 0, b->size_z - 1);
-  const int xi = MIN((int)x, b->size_x - 2);
-  const int zi = MIN((int)z, b->size_z - 2);
+  const float x = CLAMPS(i * r->inv_sigma_s, 0, r->max_x);
+  const float z = CLAMPS(L * r->inv_sigma_r, 0, r->max_z);
+  const int xi = MIN((int)x, r->max_xi);
+  const int zi = MIN((int)z, r->max_zi);
   *xf = x - xi;
   *zf = z - zi;
-  return (xi * b->size_z) + zi;
+  return (size_t)xi * b->size_z + zi;
 }
 
 dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
@@ -163,6 +175,7 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
 #ifdef _OPENMP
 #pragma omp declare simd aligned(in:64)
 #endif
+__DT_CLONE_TARGETS__
 void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
 {
   const int ox = b->size_z;
@@ -185,10 +198,12 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
     oz + oy,
     oz + oy + ox
   };
+  const float norm = 100.0f / sigma_s;
+  const int width = b->width;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, oy, oz, ox, sigma_s, buf, offsets) \
+  dt_omp_firstprivate(in, oy, oz, ox, norm, width, buf, offsets) \
   shared(b)
 #endif
   for(int slice = 0; slice < b->numslices; slice++)
@@ -201,28 +216,25 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
     // now iterate over the rows of the current horizontal slice
     for(int j = firstrow; j < lastrow; j++)
     {
-      float y = CLAMPS(j / b->sigma_s, 0, b->size_y - 1);
-      const int yi = MIN((int)y, b->size_y - 2);
-      const float yf = y - yi;
-      const size_t base = (size_t)(yi + slice_offset) * oy;
-      for(int i = 0; i < b->width; i++)
+      const dt_bilateral_row_t r = row_to_grid(b, j);
+      const size_t base = r.base + (ptrdiff_t)slice_offset * oy;
+      // precompute the contributions along the y dimension
+      const float wy[2] = { (1.0f - r.yf) * norm, r.yf * norm };
+      const float *const row = in + (size_t)4 * j * width;
+      for(int i = 0; i < width; i++)
       {
-        size_t index = 4 * (j * b->width + i);
         float xf, zf;
-        const float L = in[index];
+        const float L = row[4 * i];
         // nearest neighbour splatting:
-        const size_t grid_index = base + image_to_relgrid(b, i, L, &xf, &zf);
+        const size_t grid_index = base + row_image_to_grid(b, &r, i, L, &xf, &zf);
         // sum up payload here
         const dt_aligned_pixel_t contrib =
         {
-          (1.0f - xf) * (1.0f - yf) * 100.0f / sigma_s,	// precompute the contributions along the first two dimensions
-          xf * (1.0f - yf) * 100.0f / sigma_s,
-          (1.0f - xf) * yf * 100.0f / sigma_s,
-          xf * yf * 100.0f / sigma_s
+          (1.0f - xf) * wy[0],	// the contributions along the first two dimensions
+          xf * wy[0],
+          (1.0f - xf) * wy[1],
+          xf * wy[1]
         };
-#ifdef _OPENMP
-#pragma omp simd aligned(buf:64)
-#endif
         for(int k = 0; k < 4; k++)
         {
           buf[grid_index + offsets[k]] += (contrib[k] * (1.0f - zf));
@@ -232,25 +244,33 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
     }
   }
 
-  // merge the per-thread results into the final result
+  // merge the per-thread results into the final result. the slices have to be added in order, as the
+  // final result overwrites the partial results in the buffer, but each grid row is merged in parallel.
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(buf, nthreads, oy) \
+  shared(b)
+#endif
   for (int slice = 1 ; slice < nthreads; slice++)
   {
     // compute the first row of the final grid which this slice splats
     const int destrow = (int)(slice * b->sliceheight / b->sigma_s);
-    float *dest = buf + destrow * oy;
     // now iterate over the grid rows splatted for this slice
     for(int j = slice * b->slicerows; j < (slice+1)*b->slicerows; j++)
     {
-      float *src = buf + j * oy;
+      float *const dest = buf + (size_t)(destrow + j - slice * b->slicerows) * oy;
+      float *const src = buf + (size_t)j * oy;
+      // clear elements in the part of the buffer which holds the final result now that we've read the partial
+      // result, since we'll be adding to those locations later
+      const int clear = j < b->size_y;
+#ifdef _OPENMP
+#pragma omp for simd aligned(buf:64) schedule(static)
+#endif
       for(int i = 0; i < oy; i++)
       {
         dest[i] += src[i];
+        if(clear) src[i] = 0.0f;
       }
-      dest += oy;
-      // clear elements in the part of the buffer which holds the final result now that we've read the partial result,
-      // since we'll be adding to those locations later
-      if (j < b->size_y)
-        memset(buf + j*oy, '\0', sizeof(float) * oy);
     }
   }
 }
@@ -258,6 +278,7 @@ void dt_bilateral_splat(const dt_bilateral_t *b, const float *const in)
 #ifdef _OPENMP
 #pragma omp declare simd aligned(buf:64)
 #endif
+__DT_CLONE_TARGETS__
 static void blur_line_z(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
                         const int size2, const int size3)
 {
@@ -297,47 +318,58 @@ static void blur_line_z(float *buf, const int offset1, const int offset2, const
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(buf:64)
-#endif
-static void blur_line(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
-                      const int size2, const int size3)
+// blurs along the lines of stride offset3. all size1 lines starting next to each other (offset1 == 1) are
+// handled at once, so the inner loop runs over contiguous memory.
+__DT_CLONE_TARGETS__
+static void blur_line(float *buf, const int offset2, const int offset3, const int size1, const int size2,
+                      const int size3)
 {
   const float w0 = 6.f / 16.f;
   const float w1 = 4.f / 16.f;
   const float w2 = 1.f / 16.f;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(size1, size2, size3, offset1, offset2, offset3, w0, w1, w2) \
+  dt_omp_firstprivate(size1, size2, size3, offset2, offset3, w0, w1, w2) \
     shared(buf)
 #endif
-  for(int k = 0; k < size1; k++)
+  for(int j = 0; j < size2; j++)
   {
-    size_t index = (size_t)k * offset1;
-    for(int j = 0; j < size2; j++)
+    // the original values one and two steps back along the line
+    float tmp1[DT_COMMON_BILATERAL_MAX_RES_R + 2];
+    float tmp2[DT_COMMON_BILATERAL_MAX_RES_R + 2];
+    float *line = buf + (size_t)j * offset2;
+    for(int k = 0; k < size1; k++)
     {
-      float tmp1 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * buf[index + offset3] + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      float tmp2 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp1) + w2 * buf[index + 2 * offset3];
-      index += offset3;
-      for(int i = 2; i < size3 - 2; i++)
+      tmp1[k] = line[k];
+      line[k] = line[k] * w0 + w1 * line[k + offset3] + w2 * line[k + 2 * offset3];
+    }
+    line += offset3;
+    for(int k = 0; k < size1; k++)
+    {
+      tmp2[k] = line[k];
+      line[k] = line[k] * w0 + w1 * (line[k + offset3] + tmp1[k]) + w2 * line[k + 2 * offset3];
+    }
+    line += offset3;
+    for(int i = 2; i < size3 - 2; i++)
+    {
+      for(int k = 0; k < size1; k++)
       {
-        const float tmp3 = buf[index];
-        buf[index]
-            = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * (buf[index + 2 * offset3] + tmp1);
-        index += offset3;
-        tmp1 = tmp2;
-        tmp2 = tmp3;
+        const float tmp3 = line[k];
+        line[k] = line[k] * w0 + w1 * (line[k + offset3] + tmp2[k]) + w2 * (line[k + 2 * offset3] + tmp1[k]);
+        tmp1[k] = tmp2[k];
+        tmp2[k] = tmp3;
       }
-      const float tmp3 = buf[index];
-      buf[index] = buf[index] * w0 + w1 * (buf[index + offset3] + tmp2) + w2 * tmp1;
-      index += offset3;
-      buf[index] = buf[index] * w0 + w1 * tmp3 + w2 * tmp2;
-      index += offset3;
-      index += offset2 - offset3 * size3;
+      line += offset3;
+    }
+    for(int k = 0; k < size1; k++)
+    {
+      const float tmp3 = line[k];
+      line[k] = line[k] * w0 + w1 * (line[k + offset3] + tmp2[k]) + w2 * tmp1[k];
+      tmp1[k] = tmp2[k];
+      tmp2[k] = tmp3;
     }
+    line += offset3;
+    for(int k = 0; k < size1; k++) line[k] = line[k] * w0 + w1 * tmp2[k] + w2 * tmp1[k];
   }
 }
 
@@ -350,9 +382,9 @@ void dt_bilateral_blur(const dt_bilateral_t *b)
   const int oy = b->size_x * b->size_z;
   const int oz = 1;
   // gaussian up to 3 sigma
-  blur_line(b->buf, oz, oy, ox, b->size_z, b->size_y, b->size_x);
+  blur_line(b->buf, oy, ox, b->size_z, b->size_y, b->size_x);
   // gaussian up to 3 sigma
-  blur_line(b->buf, oz, ox, oy, b->size_z, b->size_x, b->size_y);
+  blur_line(b->buf, ox, oy, b->size_z, b->size_x, b->size_y);
   // -2 derivative of the gaussian up to 3 sigma: x*exp(-x*x)
   blur_line_z(b->buf, ox, oy, oz, b->size_x, b->size_y, b->size_z);
 }
@@ -361,6 +393,7 @@ void dt_bilateral_blur(const dt_bilateral_t *b)
 #ifdef _OPENMP
 #pragma omp declare simd aligned(out, in :64)
 #endif
+__DT_CLONE_TARGETS__
 void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, float *out, const float detail)
 {
   // detail: 0 is leave as is, -1 is bilateral filtered, +1 is contrast boost
@@ -376,17 +409,22 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(b, in, norm, ox, oy, oz, height, width, buf) \
-    shared(out) collapse(2)
+    shared(out) schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
+    const dt_bilateral_row_t r = row_to_grid(b, j);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float xf, yf, zf;
+      size_t index = 4 * ((size_t)j * width + i);
+      float xf, zf;
       const float L = in[index];
+      const float yf = r.yf;
       // trilinear lookup:
-      const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
+      const size_t gi = r.base + row_image_to_grid(b, &r, i, L, &xf, &zf);
       const float Lout = fmaxf( 0.0f, L
                          + norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
                                    + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
@@ -408,6 +446,7 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
 #ifdef _OPENMP
 #pragma omp declare simd aligned(out, in :64)
 #endif
+__DT_CLONE_TARGETS__
 void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *const in, float *out,
                                   const float detail)
 {
@@ -424,17 +463,22 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(b, in, norm, oy, oz, ox, buf, width, height) \
-  shared(out) collapse(2)
+  shared(out) schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
+    const dt_bilateral_row_t r = row_to_grid(b, j);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float xf, yf, zf;
+      size_t index = 4 * ((size_t)j * width + i);
+      float xf, zf;
       const float L = in[index];
+      const float yf = r.yf;
       // trilinear lookup:
-      const size_t gi = image_to_grid(b, i, j, L, &xf, &yf, &zf);
+      const size_t gi = r.base + row_image_to_grid(b, &r, i, L, &xf, &zf);
       const float Lout = norm * (buf[gi] * (1.0f - xf) * (1.0f - yf) * (1.0f - zf)
                                  + buf[gi + ox] * (xf) * (1.0f - yf) * (1.0f - zf)
                                  + buf[gi + oy] * (1.0f - xf) * (yf) * (1.0f - zf)
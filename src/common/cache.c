@@ -21,13 +21,78 @@
 #include "common/cache.h"
 #include "common/darktable.h"
 #include "common/dtpthread.h"
+#include "common/trace.h"
 
 #include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache. entries are spread over a fixed number of shards
+// by key, each with its own lock, hash table and intrusive lru list, so threads working on
+// different images rarely wait for each other. only the total cost is shared.
+
+static inline dt_cache_shard_t *_cache_shard(dt_cache_t *cache, const uint32_t key)
+{
+  // keys are often image ids or mip levels in the upper bits, mix them up a bit
+  return &cache->shard[((key * 2654435761u) >> 16) % DT_CACHE_SHARDS];
+}
+
+// append as most recently used, shard lock held
+static inline void _lru_append(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  entry->lru_next = NULL;
+  entry->lru_prev = shard->mru;
+  if(shard->mru) shard->mru->lru_next = entry;
+  else shard->lru = entry;
+  shard->mru = entry;
+}
+
+// shard lock held
+static inline void _lru_unlink(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  if(entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+  else shard->lru = entry->lru_next;
+  if(entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+  else shard->mru = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+// bubble up in lru list, shard lock held
+static inline void _lru_touch(dt_cache_shard_t *shard, dt_cache_entry_t *entry)
+{
+  if(shard->mru == entry) return;
+  _lru_unlink(shard, entry);
+  _lru_append(shard, entry);
+}
+
+static inline void _cost_add(dt_cache_t *cache, const size_t cost)
+{
+  g_atomic_pointer_add(&cache->cost, (gssize)cost);
+}
+
+static inline void _cost_sub(dt_cache_t *cache, const size_t cost)
+{
+  g_atomic_pointer_add(&cache->cost, -(gssize)cost);
+}
+
+static inline size_t _cost_get(dt_cache_t *cache)
+{
+  return (size_t)g_atomic_pointer_get(&cache->cost);
+}
+
+static void _free_entry(dt_cache_t *cache, dt_cache_entry_t *entry)
+{
+  if(cache->cleanup)
+  {
+    assert(entry->data_size);
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+    cache->cleanup(cache->cleanup_data, entry);
+  }
+  else
+    dt_free_align(entry->data);
+}
 
 void dt_cache_init(
     dt_cache_t *cache,
@@ -35,46 +100,48 @@ void dt_cache_init(
     size_t cost_quota)
 {
   cache->cost = 0;
-  cache->lru = 0;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
+  cache->gc_shard = 0;
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
+  {
+    dt_cache_shard_t *shard = &cache->shard[k];
+    dt_pthread_mutex_init(&shard->lock, 0);
+    shard->hashtable = g_hash_table_new(0, 0);
+    shard->lru = shard->mru = NULL;
+  }
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  for(GList *l = cache->lru; l; l = g_list_next(l))
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-
-    if(cache->cleanup)
+    dt_cache_shard_t *shard = &cache->shard[k];
+    g_hash_table_destroy(shard->hashtable);
+    dt_cache_entry_t *entry = shard->lru;
+    while(entry)
     {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
+      dt_cache_entry_t *next = entry->lru_next;
+      _free_entry(cache, entry);
+      dt_pthread_rwlock_destroy(&entry->lock);
+      g_slice_free1(sizeof(*entry), entry);
+      entry = next;
     }
-    else
-      dt_free_align(entry->data);
-
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+    shard->lru = shard->mru = NULL;
+    dt_pthread_mutex_destroy(&shard->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
+  int32_t result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
@@ -83,22 +150,26 @@ int dt_cache_for_all(
     int (*process)(const uint32_t key, const void *data, void *user_data),
     void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_shard_t *shard = &cache->shard[k];
+    dt_pthread_mutex_lock(&shard->lock);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, shard->hashtable);
+    while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&shard->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
@@ -108,10 +179,11 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 {
   gpointer orig_key, value;
   gboolean res;
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
   double start = dt_get_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -121,13 +193,11 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       return 0;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
     double end = dt_get_wtime();
     if(end - start > 0.1)
       fprintf(stderr, "try+ wait time %.06fs mode %c \n", end - start, mode);
@@ -142,13 +212,66 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "try- wait time %.06fs\n", end - start);
   return 0;
 }
 
+// frees unlocked entries of one shard from the tip of its lru list, shard lock held.
+static void _cache_gc_shard(dt_cache_t *cache, dt_cache_shard_t *shard, const float fill_ratio)
+{
+  dt_cache_entry_t *entry = shard->lru;
+  while(entry)
+  {
+    dt_cache_entry_t *next = entry->lru_next; // we might remove this element, so remember the next one
+    if(_cost_get(cache) < cache->cost_quota * fill_ratio) break;
+
+    // if still locked by anyone else give up:
+    if(dt_pthread_rwlock_trywrlock(&entry->lock))
+    {
+      entry = next;
+      continue;
+    }
+
+    if(entry->_lock_demoting)
+    {
+      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
+      dt_pthread_rwlock_unlock(&entry->lock);
+      entry = next;
+      continue;
+    }
+
+    // delete!
+    g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+    _lru_unlink(shard, entry);
+    _cost_sub(cache, entry->cost);
+
+    _free_entry(cache, entry);
+
+    dt_pthread_rwlock_unlock(&entry->lock);
+    dt_pthread_rwlock_destroy(&entry->lock);
+    g_slice_free1(sizeof(*entry), entry);
+    entry = next;
+  }
+}
+
+// garbage collection on behalf of a thread holding the lock of the given shard: that one is
+// cleaned first, the others only if their lock is free, so this can't deadlock.
+static void _cache_gc_from(dt_cache_t *cache, dt_cache_shard_t *held, const float fill_ratio)
+{
+  _cache_gc_shard(cache, held, fill_ratio);
+  const int first = g_atomic_int_add(&cache->gc_shard, 1);
+  for(int k = 0; k < DT_CACHE_SHARDS && _cost_get(cache) >= cache->cost_quota * fill_ratio; k++)
+  {
+    dt_cache_shard_t *shard = &cache->shard[(unsigned)(first + k) % DT_CACHE_SHARDS];
+    if(shard == held || dt_pthread_mutex_trylock(&shard->lock)) continue;
+    _cache_gc_shard(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
+  }
+}
+
 // if found, the data void* is returned. if not, it is set to be
 // the given *data and a new hash table entry is created, which can be
 // found using the given key later on.
@@ -157,11 +280,13 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key
   gpointer orig_key, value;
   gboolean res;
   int result;
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
   double start = dt_get_wtime();
+  const double trace_begin = dt_trace_begin();
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   { // yay, found. read lock and pass on.
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -170,14 +295,16 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
+
+    // hits are too many to trace them all, only those which had to wait for the entry
+    if(trace_begin > 0.0 && dt_get_wtime() - trace_begin > 1e-4)
+      dt_trace_complete("cache", "hit", trace_begin, "\"key\":%u,\"mode\":\"%c\"", key, mode);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -206,10 +333,10 @@ restart:
 
   // first try to clean up.
   // also wait if we can't free more than the requested fill ratio.
-  if(cache->cost > 0.8f * cache->cost_quota)
+  if(_cost_get(cache) > 0.8f * cache->cost_quota)
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _cache_gc_from(cache, shard, 0.8f);
   }
 
   // here dies your 32-bit system:
@@ -219,11 +346,11 @@ restart:
   entry->data = 0;
   entry->data_size = cache->entry_size;
   entry->cost = 1;
-  entry->link = g_list_append(0, entry);
+  entry->lru_prev = entry->lru_next = NULL;
   entry->key = key;
   entry->_lock_demoting = 0;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -242,43 +369,66 @@ restart:
   if(write) dt_pthread_rwlock_wrlock_with_caller(&entry->lock, file, line);
   else      dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  _cost_add(cache, entry->cost);
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  _lru_append(shard, entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "wait time %.06fs\n", end - start);
+  dt_trace_complete("cache", "miss", trace_begin, "\"key\":%u,\"mode\":\"%c\"", key, mode);
 
   // WARNING: do *NOT* unpoison here. it must be done by the caller!
 
   return entry;
 }
 
-int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
+// shard lock and write lock on the entry held, both are gone on return
+static void _cache_remove_locked(dt_cache_t *cache, dt_cache_shard_t *shard, dt_cache_entry_t *entry,
+                                 dt_cache_allocate_t prepare, void *prepare_data)
+{
+  if(prepare) prepare(prepare_data, entry);
+
+  gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+  (void)removed; // make non-assert compile happy
+  assert(removed);
+  _lru_unlink(shard, entry);
+
+  _free_entry(cache, entry);
+
+  dt_pthread_rwlock_unlock(&entry->lock);
+  dt_pthread_rwlock_destroy(&entry->lock);
+  _cost_sub(cache, entry->cost);
+  g_slice_free1(sizeof(*entry), entry);
+}
+
+static int _cache_remove(dt_cache_t *cache, const uint32_t key, dt_cache_allocate_t prepare, void *prepare_data,
+                         const gboolean wait)
 {
   gpointer orig_key, value;
   gboolean res;
   int result;
   dt_cache_entry_t *entry;
+  dt_cache_shard_t *shard = _cache_shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
 
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return 1;
   }
   // need write lock to be able to delete:
   result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
+    if(!wait) return 1;
     g_usleep(5);
     goto restart;
   }
@@ -287,76 +437,86 @@ restart:
   {
     // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
+    if(!wait) return 1;
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
-  (void)removed; // make non-assert compile happy
-  assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
-
-  if(cache->cleanup)
-  {
-    assert(entry->data_size);
-    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-    cache->cleanup(cache->cleanup_data, entry);
-  }
-  else
-    dt_free_align(entry->data);
-
-  dt_pthread_rwlock_unlock(&entry->lock);
-  dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
-  g_slice_free1(sizeof(*entry), entry);
+  _cache_remove_locked(cache, shard, entry, prepare, prepare_data);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   return 0;
 }
 
-// best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
-void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
 {
-  GList *l = cache->lru;
-  int cnt = 0;
-  while(l)
-  {
-    cnt++;
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio) break;
+  return _cache_remove(cache, key, NULL, NULL, TRUE);
+}
 
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
+int32_t dt_cache_try_remove(dt_cache_t *cache, const uint32_t key)
+{
+  return _cache_remove(cache, key, NULL, NULL, FALSE);
+}
 
-    if(entry->_lock_demoting)
+int dt_cache_remove_list(dt_cache_t *cache, const uint32_t *keys, const int count,
+                         dt_cache_allocate_t prepare, void *prepare_data)
+{
+  if(count <= 0) return 0;
+  int removed = 0;
+  uint8_t *shard_of = g_malloc(count);
+  for(int k = 0; k < count; k++) shard_of[k] = _cache_shard(cache, keys[k]) - cache->shard;
+
+  // entries busy in some other thread are left for the slow path below
+  GArray *busy = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+  for(int s = 0; s < DT_CACHE_SHARDS; s++)
+  {
+    dt_cache_shard_t *shard = &cache->shard[s];
+    gboolean locked = FALSE;
+    for(int k = 0; k < count; k++)
     {
-      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
-      continue;
+      if(shard_of[k] != s) continue;
+      if(!locked)
+      {
+        dt_pthread_mutex_lock(&shard->lock);
+        locked = TRUE;
+      }
+      dt_cache_entry_t *entry = g_hash_table_lookup(shard->hashtable, GINT_TO_POINTER(keys[k]));
+      if(!entry) continue;
+      if(dt_pthread_rwlock_trywrlock(&entry->lock))
+      {
+        g_array_append_val(busy, keys[k]);
+        continue;
+      }
+      if(entry->_lock_demoting)
+      {
+        dt_pthread_rwlock_unlock(&entry->lock);
+        g_array_append_val(busy, keys[k]);
+        continue;
+      }
+      _cache_remove_locked(cache, shard, entry, prepare, prepare_data);
+      removed++;
     }
+    if(locked) dt_pthread_mutex_unlock(&shard->lock);
+  }
 
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+  for(guint k = 0; k < busy->len; k++)
+    if(!_cache_remove(cache, g_array_index(busy, uint32_t, k), prepare, prepare_data, TRUE)) removed++;
 
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
+  g_array_free(busy, TRUE);
+  g_free(shard_of);
+  return removed;
+}
 
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+// best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
+void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
+{
+  for(int k = 0; k < DT_CACHE_SHARDS && _cost_get(cache) >= cache->cost_quota * fill_ratio; k++)
+  {
+    dt_cache_shard_t *shard = &cache->shard[k];
+    if(dt_pthread_mutex_trylock(&shard->lock)) continue;
+    _cache_gc_shard(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
   }
 }
 
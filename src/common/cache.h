@@ -23,12 +23,15 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+// number of independently locked parts of a cache, entries are spread over them by key
+#define DT_CACHE_SHARDS 16
+
 typedef struct dt_cache_entry_t
 {
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  struct dt_cache_entry_t *lru_prev, *lru_next; // neighbours in the lru list of the shard
   dt_pthread_rwlock_t lock;
   int _lock_demoting;
   uint32_t key;
@@ -38,16 +41,24 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
+typedef struct dt_cache_shard_t
+{
+  dt_pthread_mutex_t lock; // protects the hashtable and lru list of this shard only
+
+  GHashTable *hashtable;  // stores (key, entry) pairs
+  dt_cache_entry_t *lru;  // first element, about to be kicked from cache
+  dt_cache_entry_t *mru;  // last element, most recently used
+}
+dt_cache_shard_t;
+
 typedef struct dt_cache_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_cache_shard_t shard[DT_CACHE_SHARDS];
 
   size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
+  size_t cost;       // user supplied cost per cache line (bytes?), summed over all shards. updated atomically.
   size_t cost_quota; // quota to try and meet. but don't use as hard limit.
-
-  GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+  int gc_shard;      // where the next garbage collection starts, so all shards take their turn
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -87,6 +98,13 @@ void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, co
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 // returns 0 on success, 1 if the key was not found.
 int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
+// the same without waiting, also returns 1 if the entry is in use.
+int32_t dt_cache_try_remove(dt_cache_t *cache, const uint32_t key);
+// removes all the given keys that are in the cache, taking each shard lock once.
+// prepare, if not NULL, is called on each entry under its write lock before it is freed.
+// returns the number of entries removed.
+int dt_cache_remove_list(dt_cache_t *cache, const uint32_t *keys, const int count,
+                         dt_cache_allocate_t prepare, void *prepare_data);
 // removes from the tip of the lru list, until the fill ratio of the hashtable
 // goes below the given parameter, in terms of the user defined cost measure.
 // will never lock and never fail, but sometimes not free memory (in case all
@@ -309,43 +309,23 @@ static void _camera_process_job(const dt_camctl_t *c, const dt_camera_t *camera,
       }
       else
       {
-        // everything worked
-        dt_imageio_jpeg_t jpg;
-        if(dt_imageio_jpeg_decompress_header(data, data_size, &jpg))
+        // everything worked, hand the frame over to the decoding thread. a frame it didn't get to yet is
+        // simply replaced, the buffer is reused as long as it is large enough.
+        dt_pthread_mutex_lock(&cam->live_view_jpeg_mutex);
+        if(cam->live_view_jpeg_size < data_size)
         {
-          dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to decompress jpeg header\n");
-        }
-        else
-        {
-          // FIXME: is the live view ever tagged with a profile? testing so far (limited to Canon EOS 5D Mark III) hasn't found one
-          // dt_colorspaces_color_profile_type_t color_space = dt_imageio_jpeg_read_color_space(&jpg);
-          //if(color_space == DT_COLORSPACE_DISPLAY)
-          //  color_space = DT_COLORSPACE_SRGB;            // no embedded colorspace, assume is sRGB
-          uint8_t *const buffer = (uint8_t *)dt_alloc_align(64, sizeof(uint8_t) * 4 * jpg.width * jpg.height);
-          if(!buffer)
-          {
-            dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view could not allocate image buffer\n");
-          }
-          else if(dt_imageio_jpeg_decompress(&jpg, buffer))
-          {
-            dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to decompress jpeg\n");
-          }
-          else
-          {
-            dt_pthread_mutex_lock(&cam->live_view_buffer_mutex);
-            // FIXME: don't need to alloc/dealloc if the image dimensions haven't changed
-            if(cam->live_view_buffer) dt_free_align(cam->live_view_buffer);
-            cam->live_view_buffer = buffer;
-            cam->live_view_width = jpg.width;
-            cam->live_view_height = jpg.height;
-            //cam->live_view_color_space = color_space;
-            dt_pthread_mutex_unlock(&cam->live_view_buffer_mutex);
-          }
+          g_free(cam->live_view_jpeg);
+          cam->live_view_jpeg = g_malloc(data_size);
+          cam->live_view_jpeg_size = data_size;
         }
+        memcpy(cam->live_view_jpeg, data, data_size);
+        cam->live_view_jpeg_length = data_size;
+        cam->live_view_jpeg_pending = TRUE;
+        pthread_cond_signal(&cam->live_view_jpeg_cond);
+        dt_pthread_mutex_unlock(&cam->live_view_jpeg_mutex);
       }
       if(fp) gp_file_free(fp);
       dt_pthread_mutex_BAD_unlock(&cam->live_view_synch);
-      dt_control_queue_redraw_center();
     }
     break;
 
@@ -504,6 +484,88 @@ static void _camera_process_job(const dt_camctl_t *c, const dt_camera_t *camera,
 /*************/
 /* LIVE VIEW */
 /*************/
+static void *_camctl_camera_decode_live_view(void *data)
+{
+  dt_camera_t *cam = (dt_camera_t *)data;
+
+  dt_pthread_setname("live view dec");
+
+  // the compressed frame being decoded, swapped with the one the gphoto2 job filled
+  uint8_t *jpeg = NULL;
+  size_t jpeg_size = 0;
+
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&cam->live_view_jpeg_mutex);
+    while(!cam->live_view_jpeg_pending && cam->is_live_viewing)
+      dt_pthread_cond_wait(&cam->live_view_jpeg_cond, &cam->live_view_jpeg_mutex);
+    if(!cam->is_live_viewing)
+    {
+      dt_pthread_mutex_unlock(&cam->live_view_jpeg_mutex);
+      break;
+    }
+    uint8_t *const tmp = jpeg;
+    const size_t tmp_size = jpeg_size;
+    jpeg = cam->live_view_jpeg;
+    jpeg_size = cam->live_view_jpeg_size;
+    const size_t length = cam->live_view_jpeg_length;
+    cam->live_view_jpeg = tmp;
+    cam->live_view_jpeg_size = tmp_size;
+    cam->live_view_jpeg_pending = FALSE;
+    dt_pthread_mutex_unlock(&cam->live_view_jpeg_mutex);
+
+    dt_imageio_jpeg_t jpg;
+    if(dt_imageio_jpeg_decompress_header(jpeg, length, &jpg))
+    {
+      dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to decompress jpeg header\n");
+      continue;
+    }
+    // FIXME: is the live view ever tagged with a profile? testing so far (limited to Canon EOS 5D Mark III) hasn't found one
+    // dt_colorspaces_color_profile_type_t color_space = dt_imageio_jpeg_read_color_space(&jpg);
+    //if(color_space == DT_COLORSPACE_DISPLAY)
+    //  color_space = DT_COLORSPACE_SRGB;            // no embedded colorspace, assume is sRGB
+
+    // a preview on screen doesn't need the accurate idct and upsampling
+    jpg.dinfo.dct_method = JDCT_IFAST;
+    jpg.dinfo.do_fancy_upsampling = FALSE;
+    dt_imageio_jpeg_set_target_size(&jpg, cam->live_view_target_width, cam->live_view_target_height);
+
+    const size_t size = sizeof(uint8_t) * 4 * jpg.width * jpg.height;
+    if(cam->live_view_back_buffer_size < size)
+    {
+      dt_free_align(cam->live_view_back_buffer);
+      cam->live_view_back_buffer = (uint8_t *)dt_alloc_align(64, size);
+      cam->live_view_back_buffer_size = cam->live_view_back_buffer ? size : 0;
+    }
+    if(!cam->live_view_back_buffer)
+    {
+      dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view could not allocate image buffer\n");
+      jpeg_destroy_decompress(&jpg.dinfo);
+    }
+    else if(dt_imageio_jpeg_decompress(&jpg, cam->live_view_back_buffer))
+    {
+      dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to decompress jpeg\n");
+    }
+    else
+    {
+      dt_pthread_mutex_lock(&cam->live_view_buffer_mutex);
+      uint8_t *const front = cam->live_view_buffer;
+      const size_t front_size = cam->live_view_buffer_size;
+      cam->live_view_buffer = cam->live_view_back_buffer;
+      cam->live_view_buffer_size = cam->live_view_back_buffer_size;
+      cam->live_view_width = jpg.width;
+      cam->live_view_height = jpg.height;
+      //cam->live_view_color_space = color_space;
+      dt_pthread_mutex_unlock(&cam->live_view_buffer_mutex);
+      cam->live_view_back_buffer = front;
+      cam->live_view_back_buffer_size = front_size;
+      dt_control_queue_redraw_center();
+    }
+  }
+  g_free(jpeg);
+  return NULL;
+}
+
 static void *dt_camctl_camera_get_live_view(void *data)
 {
   dt_camctl_t *camctl = (dt_camctl_t *)data;
@@ -513,6 +575,10 @@ static void *dt_camctl_camera_get_live_view(void *data)
 
   dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view thread started\n");
 
+  // decoding runs on a thread of its own, the next frame is fetched from the camera meanwhile
+  cam->live_view_jpeg_pending = FALSE;
+  dt_pthread_create(&cam->live_view_decode_thread, &_camctl_camera_decode_live_view, (void *)cam);
+
   int frames = 0;
   double capture_time = dt_get_wtime();
   const int fps = dt_conf_get_int("plugins/capture/camera/live_view_fps");
@@ -543,6 +609,11 @@ static void *dt_camctl_camera_get_live_view(void *data)
     g_usleep((1.0 / fps) * G_USEC_PER_SEC); // going too fast will result in
                                             // too many redraws without a real benefit
   }
+
+  dt_pthread_mutex_lock(&cam->live_view_jpeg_mutex);
+  pthread_cond_signal(&cam->live_view_jpeg_cond);
+  dt_pthread_mutex_unlock(&cam->live_view_jpeg_mutex);
+  pthread_join(cam->live_view_decode_thread, NULL);
   dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view thread stopped\n");
   return NULL;
 }
@@ -643,12 +714,16 @@ static void dt_camctl_camera_destroy_struct(dt_camera_t *cam)
     dt_free_align(cam->live_view_buffer);
     cam->live_view_buffer = NULL; // just in case someone else is using this
   }
+  dt_free_align(cam->live_view_back_buffer);
+  g_free(cam->live_view_jpeg);
   g_free(cam->model);
   g_free(cam->port);
   dt_pthread_mutex_destroy(&cam->jobqueue_lock);
   dt_pthread_mutex_destroy(&cam->config_lock);
   dt_pthread_mutex_destroy(&cam->live_view_buffer_mutex);
   dt_pthread_mutex_destroy(&cam->live_view_synch);
+  dt_pthread_mutex_destroy(&cam->live_view_jpeg_mutex);
+  pthread_cond_destroy(&cam->live_view_jpeg_cond);
   // TODO: cam->jobqueue
   g_free(cam);
 }
@@ -1074,6 +1149,8 @@ static gboolean _camera_initialize(const dt_camctl_t *c, dt_camera_t *cam)
     dt_pthread_mutex_init(&cam->config_lock, NULL);
     dt_pthread_mutex_init(&cam->live_view_buffer_mutex, NULL);
     dt_pthread_mutex_init(&cam->live_view_synch, NULL);
+    dt_pthread_mutex_init(&cam->live_view_jpeg_mutex, NULL);
+    pthread_cond_init(&cam->live_view_jpeg_cond, NULL);
 
     dt_print(DT_DEBUG_CAMCTL, "[camera_control] %s on port %s initialized\n", cam->model, cam->port);
   }
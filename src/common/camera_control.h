@@ -98,6 +98,12 @@ typedef struct dt_camera_t
   /** The last preview image from the camera */
   uint8_t *live_view_buffer;
   int live_view_width, live_view_height;
+  size_t live_view_buffer_size;
+  /** The buffer the next preview image is decoded to, swapped with live_view_buffer once done */
+  uint8_t *live_view_back_buffer;
+  size_t live_view_back_buffer_size;
+  /** The size live view is shown at, frames are decoded no larger than needed. 0 for full size */
+  int live_view_target_width, live_view_target_height;
   //dt_colorspaces_color_profile_type_t live_view_color_space;
   /** Rotation of live view, multiples of 90° */
   int32_t live_view_rotation;
@@ -115,6 +121,14 @@ typedef struct dt_camera_t
   dt_pthread_mutex_t live_view_buffer_mutex;
   /** A flag to tell the live view thread that the last job was completed */
   dt_pthread_mutex_t live_view_synch;
+  /** The thread decoding the live view frames, apart from the gphoto2 jobs */
+  pthread_t live_view_decode_thread;
+  /** The latest compressed frame, waiting for the decoding thread. stale ones are dropped */
+  dt_pthread_mutex_t live_view_jpeg_mutex;
+  pthread_cond_t live_view_jpeg_cond;
+  uint8_t *live_view_jpeg;
+  size_t live_view_jpeg_length, live_view_jpeg_size;
+  gboolean live_view_jpeg_pending;
 } dt_camera_t;
 
 /** A dummy camera object used for unused cameras */
@@ -21,6 +21,7 @@
 #include "common/image.h"
 #include "common/imageio_rawspeed.h"
 #include "common/metadata.h"
+#include "common/selection.h"
 #include "common/utility.h"
 #include "common/map_locations.h"
 #include "common/datetime.h"
@@ -115,6 +116,8 @@ void dt_collection_free(const dt_collection_t *collection)
 
   g_free(collection->query);
   g_free(collection->query_no_group);
+  g_free(collection->query_patch);
+  g_free(collection->query_patch_no_group);
   g_strfreev(collection->where_ext);
   g_free((dt_collection_t *)collection);
 }
@@ -182,6 +185,76 @@ void dt_collection_memory_update()
 
 #define DATETIME "(CASE WHEN LENGTH(datetime_taken) = 19 THEN datetime_taken || '.000' ELSE datetime_taken END) AS datetime_taken"
 
+// refill the text index rows of the images given by the sql expression imgids
+static gchar *_text_index_refill(const char *imgids)
+{
+  return g_strdup_printf
+    ("DELETE FROM text_index WHERE rowid IN (%s);"
+     "INSERT INTO text_index (rowid, search)"
+     "  SELECT i.id, i.filename || char(10) || fr.folder"
+     "    || IFNULL(char(10) || (SELECT group_concat(value, char(10)) FROM meta_data WHERE id = i.id), '')"
+     "    || IFNULL(char(10) || (SELECT group_concat(t.name || IFNULL(char(10) || t.synonyms, ''), char(10))"
+     "                           FROM tagged_images AS ti JOIN tags AS t ON t.id = ti.tagid"
+     "                           WHERE ti.imgid = i.id), '')"
+     "  FROM images AS i JOIN film_rolls AS fr ON fr.id = i.film_id"
+     "  WHERE i.id IN (%s);", imgids, imgids);
+}
+
+// a trigram index over everything the text filter looks at, so the filter's LIKE gets an index to narrow the
+// images down with. it's built the first time the filter is used and kept up to date by triggers from then on.
+// FALSE if sqlite comes without the fts5 trigram tokenizer.
+static gboolean _text_index_ensure()
+{
+  static int state = 0; // 1: built, -1: not available
+  if(state) return state > 0;
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  if(sqlite3_exec(db, "CREATE VIRTUAL TABLE memory.text_index USING fts5(search, tokenize='trigram')",
+                  NULL, NULL, NULL) != SQLITE_OK)
+  {
+    dt_print(DT_DEBUG_SQL, "[collection] no text index: %s\n", sqlite3_errmsg(db));
+    state = -1;
+    return FALSE;
+  }
+
+  const double start = dt_get_wtime();
+  gchar *fill = _text_index_refill("SELECT id FROM images");
+  DT_DEBUG_SQLITE3_EXEC(db, fill, NULL, NULL, NULL);
+  g_free(fill);
+
+  static const struct
+  {
+    const char *name, *event, *imgids;
+  } triggers[] = {
+    { "images_insert", "AFTER INSERT ON main.images", "new.id" },
+    { "images_update", "AFTER UPDATE OF filename, film_id ON main.images", "new.id" },
+    { "images_delete", "AFTER DELETE ON main.images", "old.id" },
+    { "film_rolls_update", "AFTER UPDATE OF folder ON main.film_rolls",
+      "SELECT id FROM images WHERE film_id = new.id" },
+    { "meta_data_insert", "AFTER INSERT ON main.meta_data", "new.id" },
+    { "meta_data_update", "AFTER UPDATE ON main.meta_data", "new.id" },
+    { "meta_data_delete", "AFTER DELETE ON main.meta_data", "old.id" },
+    { "tagged_images_insert", "AFTER INSERT ON main.tagged_images", "new.imgid" },
+    { "tagged_images_update", "AFTER UPDATE OF tagid ON main.tagged_images", "new.imgid" },
+    { "tagged_images_delete", "AFTER DELETE ON main.tagged_images", "old.imgid" },
+    { "tags_update", "AFTER UPDATE OF name, synonyms ON data.tags",
+      "SELECT imgid FROM tagged_images WHERE tagid = new.id" },
+  };
+  for(size_t k = 0; k < sizeof(triggers) / sizeof(triggers[0]); k++)
+  {
+    gchar *body = _text_index_refill(triggers[k].imgids);
+    gchar *query = g_strdup_printf("CREATE TEMP TRIGGER text_index_%s %s BEGIN %s END",
+                                   triggers[k].name, triggers[k].event, body);
+    DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+    g_free(query);
+    g_free(body);
+  }
+
+  dt_print(DT_DEBUG_SQL, "[collection] text index built in %f seconds\n", dt_get_wtime() - start);
+  state = 1;
+  return TRUE;
+}
+
 static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection, char **selq_pre)
 {
   const uint32_t tagid = collection->tagid;
@@ -202,7 +275,7 @@ static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection,
                               tagid ? tag : "");
 }
 
-int dt_collection_update(const dt_collection_t *collection)
+static int _collection_build_query(const dt_collection_t *collection)
 {
   uint32_t result;
   gchar *wq, *wq_no_group, *sq, *selq_pre, *selq_post, *query, *query_no_group;
@@ -260,6 +333,11 @@ int dt_collection_update(const dt_collection_t *collection)
     /* add text filter if any */
     if(collection->params.text_filter && collection->params.text_filter[0])
     {
+      // a field matching the filter means the index text matches it once unanchored, the index gives the
+      // candidates and the exact check below only runs on them
+      if(_text_index_ensure())
+        wq = dt_util_dstrcat(wq, " %s id IN (SELECT rowid FROM memory.text_index WHERE search LIKE '%%%s%%')",
+                             and_operator(&and_term), collection->params.text_filter);
       wq = dt_util_dstrcat(wq, " %s id IN (SELECT id FROM main.meta_data WHERE id=mi.id AND value LIKE '%s'"
                                           " UNION SELECT imgid AS id FROM main.tagged_images AS ti, data.tags AS t"
                                           "   WHERE imgid=mi.id AND t.id=ti.tagid AND"
@@ -514,6 +592,20 @@ int dt_collection_update(const dt_collection_t *collection)
                         (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT) ? " " LIMIT_QUERY : "");
   result = _dt_collection_store(collection, query, query_no_group);
 
+  /* the same selection restricted to the images in memory.collection_patch, to test changed images against */
+  g_free(collection->query_patch);
+  g_free(collection->query_patch_no_group);
+  ((dt_collection_t *)collection)->query_patch = ((dt_collection_t *)collection)->query_patch_no_group = NULL;
+  if(!(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  {
+    ((dt_collection_t *)collection)->query_patch
+        = g_strdup_printf("%s(%s) AND mi.id IN (SELECT imgid FROM memory.collection_patch)%s", selq_pre, wq,
+                          selq_post ? selq_post : "");
+    ((dt_collection_t *)collection)->query_patch_no_group
+        = g_strdup_printf("%s(%s) AND mi.id IN (SELECT imgid FROM memory.collection_patch)%s", selq_pre,
+                          wq_no_group, selq_post ? selq_post : "");
+  }
+
 #ifdef _DEBUG
   printf("SQL Collection for 1st:%d and 2nd:%d: %s\n\n",collection->params.sort,collection->params.sort_second_order,query);/*only for debugging*/
 #endif
@@ -528,6 +620,12 @@ int dt_collection_update(const dt_collection_t *collection)
   g_free(query);
   g_free(query_no_group);
 
+  return result;
+}
+#undef DATETIME
+
+static void _collection_update_counts(const dt_collection_t *collection)
+{
   /* update the cached count. collection isn't a real const anyway, we are writing to it in
    * _dt_collection_store, too. */
   ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection, FALSE);
@@ -535,10 +633,14 @@ int dt_collection_update(const dt_collection_t *collection)
   dt_collection_hint_message(collection);
 
   _collection_update_aspect_ratio(collection);
+}
 
+int dt_collection_update(const dt_collection_t *collection)
+{
+  const int result = _collection_build_query(collection);
+  _collection_update_counts(collection);
   return result;
 }
-#undef DATETIME
 
 void dt_collection_reset(const dt_collection_t *collection)
 {
@@ -1121,6 +1223,9 @@ uint32_t dt_collection_get_count_no_group(const dt_collection_t *collection)
 
 uint32_t dt_collection_get_selected_count(const dt_collection_t *collection)
 {
+  // the selection keeps the count of main.selected_images once it exists
+  if(darktable.selection) return dt_selection_count(darktable.selection);
+
   sqlite3_stmt *stmt = NULL;
   uint32_t count = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
@@ -2092,6 +2197,115 @@ void dt_collection_deserialize(const char *buf)
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_NEW_QUERY, DT_COLLECTION_PROP_UNDEF, NULL);
 }
 
+// whether the order of the collection sorted by sort can change with property
+static gboolean _collection_sort_depends_on(const dt_collection_sort_t sort,
+                                            const dt_collection_properties_t property)
+{
+  switch(sort)
+  {
+    case DT_COLLECTION_SORT_RATING:
+      return property == DT_COLLECTION_PROP_RATING;
+    case DT_COLLECTION_SORT_COLOR:
+      return property == DT_COLLECTION_PROP_COLORLABEL;
+    case DT_COLLECTION_SORT_TITLE:
+    case DT_COLLECTION_SORT_DESCRIPTION:
+      return property >= DT_COLLECTION_PROP_METADATA
+             && property < DT_COLLECTION_PROP_METADATA + DT_METADATA_NUMBER;
+    case DT_COLLECTION_SORT_CUSTOM_ORDER:
+      return property == DT_COLLECTION_PROP_TAG;
+    case DT_COLLECTION_SORT_ASPECT_RATIO:
+      return property == DT_COLLECTION_PROP_ASPECT_RATIO;
+    case DT_COLLECTION_SORT_DATETIME:
+      return property == DT_COLLECTION_PROP_GEOTAGGING;
+    case DT_COLLECTION_SORT_CHANGE_TIMESTAMP:
+    case DT_COLLECTION_SORT_SHUFFLE:
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+// update memory.collected_images in place after a change of property for the images in list, instead of
+// collecting all images again. images leaving the collection are dropped, those entering it would have to
+// be sorted in, which is left to the full update. returns FALSE if that is needed.
+static gboolean _collection_patch(const dt_collection_t *collection, const dt_collection_properties_t property,
+                                  GList *list)
+{
+  if(!collection->query_patch) return FALSE;
+
+  // only properties of the images themselves, grouping or unknown changes can affect other images
+  if(property != DT_COLLECTION_PROP_RATING && property != DT_COLLECTION_PROP_COLORLABEL
+     && property != DT_COLLECTION_PROP_TAG && property != DT_COLLECTION_PROP_GEOTAGGING
+     && property != DT_COLLECTION_PROP_ASPECT_RATIO
+     && !(property >= DT_COLLECTION_PROP_METADATA
+          && property < DT_COLLECTION_PROP_METADATA + DT_METADATA_NUMBER))
+    return FALSE;
+
+  if((collection->params.query_flags & COLLECTION_QUERY_USE_SORT)
+     && (_collection_sort_depends_on(collection->params.sort, property)
+         || _collection_sort_depends_on(collection->params.sort_second_order, property)))
+    return FALSE;
+
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_stmt *stmt = NULL;
+
+  // the changed images and, as another one may now represent their group, the rest of their groups
+  DT_DEBUG_SQLITE3_EXEC(db, "DELETE FROM memory.collection_patch", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                              "INSERT OR IGNORE INTO memory.collection_patch (imgid)"
+                              " SELECT id FROM main.images"
+                              " WHERE group_id = (SELECT group_id FROM main.images WHERE id = ?1)",
+                              -1, &stmt, NULL);
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(l->data));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+  sqlite3_finalize(stmt);
+
+  // any image entering the collection?
+  int entering = 1;
+  gchar *query = g_strdup_printf("SELECT COUNT(*) FROM (%s)"
+                                 " WHERE id NOT IN (SELECT imgid FROM memory.collected_images)",
+                                 collection->query_patch);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, query, -1, &stmt, NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW) entering = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  g_free(query);
+  if(entering) return FALSE;
+
+  // drop the ones leaving it, the order of the others is kept
+  query = g_strdup_printf("DELETE FROM memory.collected_images"
+                          " WHERE imgid IN (SELECT imgid FROM memory.collection_patch)"
+                          "   AND imgid NOT IN (%s)",
+                          collection->query_patch);
+  DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+  g_free(query);
+  const int leaving = sqlite3_changes(db);
+
+  // and from the selection the ones not in the collection including the images hidden in groups
+  query = g_strdup_printf("DELETE FROM main.selected_images"
+                          " WHERE imgid IN (SELECT imgid FROM memory.collection_patch)"
+                          "   AND imgid NOT IN (%s)",
+                          collection->query_patch_no_group);
+  DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+  g_free(query);
+  if(sqlite3_changes(db) > 0)
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_SELECTION_CHANGED);
+
+  ((dt_collection_t *)collection)->count = collection->count - MIN(collection->count, (unsigned int)leaving);
+  ((dt_collection_t *)collection)->count_no_group
+      = (darktable.gui && darktable.gui->grouping) ? _dt_collection_compute_count(collection, TRUE)
+                                                   : collection->count;
+  dt_collection_hint_message(collection);
+
+  dt_print(DT_DEBUG_SQL, "[collection] patched %d changed images, %d left the collection\n",
+           g_list_length(list), leaving);
+  return TRUE;
+}
+
 void dt_collection_update_query(const dt_collection_t *collection, dt_collection_change_t query_change,
                                 dt_collection_properties_t changed_property, GList *list)
 {
@@ -2212,12 +2426,22 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
                                  (dt_collection_get_filter_flags(collection) & ~COLLECTION_FILTER_FILM_ID));
 
   /* update query and at last the visual */
-  dt_collection_update(collection);
+  gchar *old_query = g_strdup(collection->query);
+  _collection_build_query(collection);
+
+  // images changed for an unchanged query are patched into the collection if possible
+  const gboolean patched = !collection->clone && collection == darktable.collection
+                           && query_change == DT_COLLECTION_CHANGE_RELOAD && list
+                           && !g_strcmp0(old_query, collection->query)
+                           && _collection_patch(collection, changed_property, list);
+  g_free(old_query);
+
+  if(!patched) _collection_update_counts(collection);
 
   // remove from selected images where not in this query.
   sqlite3_stmt *stmt = NULL;
   const gchar *cquery = dt_collection_get_query_no_group(collection);
-  if(cquery && cquery[0] != '\0')
+  if(!patched && cquery && cquery[0] != '\0')
   {
     gchar *complete_query = g_strdup_printf("DELETE FROM main.selected_images WHERE imgid NOT IN (%s)", cquery);
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), complete_query, -1, &stmt, NULL);
@@ -2238,7 +2462,7 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
   /* raise signal of collection change, only if this is an original */
   if(!collection->clone)
   {
-    dt_collection_memory_update();
+    if(!patched) dt_collection_memory_update();
     DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED, query_change, changed_property,
                                   list, next);
   }
@@ -172,6 +172,7 @@ typedef struct dt_collection_t
 {
   int clone;
   gchar *query, *query_no_group;
+  gchar *query_patch, *query_patch_no_group; // unsorted queries limited to memory.collection_patch
   gchar **where_ext;
   unsigned int count, count_no_group;
   unsigned int tagid;
@@ -43,14 +43,13 @@ typedef struct dt_undo_colorlabels_t
 
 int dt_colorlabels_get_labels(const int imgid)
 {
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT color FROM main.color_labels WHERE imgid = ?1", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "SELECT color FROM main.color_labels WHERE imgid = ?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   int colors = 0;
   while(sqlite3_step(stmt) == SQLITE_ROW)
     colors |= (1<<sqlite3_column_int(stmt, 0));
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
   return colors;
 }
 
@@ -72,6 +71,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 {
   if(type == DT_UNDO_COLORLABELS)
   {
+    dt_database_batch_begin(darktable.db);
     for(GList *list = (GList *)data; list; list = g_list_next(list))
     {
       dt_undo_colorlabels_t *undocolorlabels = (dt_undo_colorlabels_t *)list->data;
@@ -81,6 +81,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
       _pop_undo_execute(undocolorlabels->imgid, before, after);
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undocolorlabels->imgid));
     }
+    dt_database_batch_commit(darktable.db);
     dt_collection_hint_message(darktable.collection);
   }
 }
@@ -99,28 +100,29 @@ void dt_colorlabels_remove_labels(const int imgid)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_image_cache_set_hot_colorlabels(darktable.image_cache, imgid, 0);
 }
 
 void dt_colorlabels_set_label(const int imgid, const int color)
 {
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO main.color_labels (imgid, color) VALUES (?1, ?2)", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "INSERT INTO main.color_labels (imgid, color) VALUES (?1, ?2)");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
+  dt_image_cache_set_hot_colorlabels(darktable.image_cache, imgid, dt_colorlabels_get_labels(imgid));
 }
 
 void dt_colorlabels_remove_label(const int imgid, const int color)
 {
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "DELETE FROM main.color_labels WHERE imgid=?1 AND color=?2", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "DELETE FROM main.color_labels WHERE imgid=?1 AND color=?2");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, color);
   sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
+  dt_image_cache_set_hot_colorlabels(darktable.image_cache, imgid, dt_colorlabels_get_labels(imgid));
 }
 
 typedef enum dt_colorlabels_actions_t
@@ -133,6 +135,7 @@ typedef enum dt_colorlabels_actions_t
 
 static void _colorlabels_execute(const GList *imgs, const int labels, GList **undo, const gboolean undo_on, int action)
 {
+  dt_database_batch_begin(darktable.db);
   if(action == DT_CA_TOGGLE)
   {
     // if we are supposed to toggle color labels, first check if all images have that label
@@ -178,11 +181,13 @@ static void _colorlabels_execute(const GList *imgs, const int labels, GList **un
       undocolorlabels->imgid = image_id;
       undocolorlabels->before = before;
       undocolorlabels->after = after;
-      *undo = g_list_append(*undo, undocolorlabels);
+      *undo = g_list_prepend(*undo, undocolorlabels);
     }
 
     _pop_undo_execute(image_id, before, after);
   }
+  dt_database_batch_commit(darktable.db);
+  if(undo_on) *undo = g_list_reverse(*undo);
 }
 
 void dt_colorlabels_set_labels(const GList *img, const int labels, const gboolean clear_on,
@@ -211,6 +216,8 @@ void dt_colorlabels_toggle_label_on_list(const GList *list, const int color, con
   GList *undo = NULL;
   if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_COLORLABELS);
 
+  // the sidecars are written in the background once the labels are committed
+  dt_database_batch_begin(darktable.db);
   if(color == 5)
   {
     _colorlabels_execute(list, 0, &undo, undo_on, DT_CA_SET);
@@ -225,6 +232,7 @@ void dt_colorlabels_toggle_label_on_list(const GList *list, const int color, con
   {
     dt_image_synch_xmp(GPOINTER_TO_INT(l->data));
   }
+  dt_database_batch_commit(darktable.db);
 
   if(undo_on)
   {
@@ -27,6 +27,9 @@
 #ifdef __APPLE__
 #include <sys/malloc.h>
 #endif
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 #include "common/collection.h"
 #include "common/colorspaces.h"
@@ -40,20 +43,26 @@
 #endif
 #include "bauhaus/bauhaus.h"
 #include "common/action.h"
+#include "common/atomic.h"
 #include "common/cpuid.h"
 #include "common/file_location.h"
 #include "common/film.h"
+#include "common/focus_peaking.h"
 #include "common/grealpath.h"
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
+#include "common/imageio_rawspeed.h"
 #include "common/iop_order.h"
+#include "common/iop_profile.h"
 #include "common/l10n.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
 #include "common/points.h"
+#include "common/presets.h"
 #include "common/resource_limits.h"
+#include "common/trace.h"
 #include "common/undo.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -126,7 +135,7 @@ static int usage(const char *argv0)
   printf("  --configdir <user config directory>\n");
   printf("  -d {all,cache,camctl,camsupport,control,dev,fswatch,imageio,input,\n");
   printf("      ioporder,lighttable,lua,masks,memory,nan,opencl,params,perf,demosaic\n");
-  printf("      pwstorage,print,signal,sql,undo,act_on}\n");
+  printf("      pwstorage,print,signal,sql,trace,undo,act_on}\n");
   printf("  --d-signal <signal> \n");
   printf("  --d-signal-act <all,raise,connect,disconnect");
 #ifdef DT_HAVE_SIGNAL_TRACE
@@ -306,15 +315,23 @@ static void dt_codepaths_init()
   {
 #ifdef HAVE_BUILTIN_CPU_SUPPORTS
     darktable.codepath.SSE2 = (__builtin_cpu_supports("sse") && __builtin_cpu_supports("sse2"));
+    darktable.codepath.AVX2 = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+    darktable.codepath.AVX2 = ((flags & (CPU_FLAG_AVX2)) && (flags & (CPU_FLAG_FMA)));
 #endif
   }
 
+  // the plain kernels only run avx2 code if they are cloned for it or built for it
+#if !defined(DT_HAVE_AVX2_CLONES) && !defined(__AVX2__)
+  darktable.codepath.AVX2 = 0;
+#endif
+
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2")) darktable.codepath.AVX2 = 0;
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -337,6 +354,9 @@ static void dt_codepaths_init()
     fprintf(stderr, "[dt_codepaths_init] SSE2-optimized codepath is disabled or unavailable.\n");
   }
 #endif
+
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] sse2 %d, avx2 %d, openmp simd %d\n",
+           darktable.codepath.SSE2, darktable.codepath.AVX2, darktable.codepath.OPENMP_SIMD);
 }
 
 static inline size_t _get_total_memory()
@@ -468,6 +488,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_pthread_mutex_init(&(darktable.capabilities_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.exiv2_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.readFile_mutex), NULL);
+  pthread_cond_init(&darktable.readFile_cond, NULL);
+  darktable.readFile_active = 0;
   darktable.control = (dt_control_t *)calloc(1, sizeof(dt_control_t));
 
   // database
@@ -683,6 +705,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
           darktable.unmuted |= DT_DEBUG_DEMOSAIC;
         else if(!strcmp(argv[k + 1], "act_on"))
           darktable.unmuted |= DT_DEBUG_ACT_ON;
+        else if(!strcmp(argv[k + 1], "trace"))
+          darktable.unmuted |= DT_DEBUG_TRACE; // chrome/perfetto trace events written to debug/trace_file
         else
           return usage(argv[0]);
         k++;
@@ -951,6 +975,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_conf_init(darktable.conf, darktablerc, config_override);
   g_slist_free_full(config_override, g_free);
 
+  // with -d trace, before the first jobs are started
+  dt_trace_init();
+
   // set the interface language and prepare selection for prefs
   darktable.l10n = dt_l10n_init(init_gui);
 
@@ -1052,15 +1079,6 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // Initialize the signal system
   darktable.signals = dt_control_signal_init();
 
-  // Make sure that the database and xmp files are in sync
-  // We need conf and db to be up and running for that which is the case here.
-  // FIXME: is this also useful in non-gui mode?
-  GList *changed_xmp_files = NULL;
-  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
-  {
-    changed_xmp_files = dt_control_crawler_run();
-  }
-
   if(init_gui)
   {
     dt_control_init(darktable.control);
@@ -1130,6 +1148,9 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   MagickWandGenesis();
 #endif
 
+  // runs alongside the opencl initialization, which takes a while on its own
+  dt_rawspeed_preload_meta();
+
   darktable.opencl = (dt_opencl_t *)calloc(1, sizeof(dt_opencl_t));
 #ifdef HAVE_OPENCL
   dt_opencl_init(darktable.opencl, exclude_opencl, print_statistics);
@@ -1138,7 +1159,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
 
-  darktable.noiseprofile_parser = dt_noiseprofile_init(noiseprofiles_from_command);
+  dt_noiseprofile_init(noiseprofiles_from_command);
 
   // must come before mipmap_cache, because that one will need to access
   // image dimensions stored in here:
@@ -1147,6 +1168,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
+  dt_memory_pressure_start();
+  if(init_gui) dt_image_sidecar_writer_start();
 
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
@@ -1282,11 +1305,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #endif
   }
 
-  // last but not least construct the popup that asks the user about images whose xmp files are newer than the
-  // db entry
-  if(init_gui && changed_xmp_files)
+  // last but not least make sure that the database and xmp files are in sync. this runs in the background,
+  // the popup asking the user about images whose xmp files are newer than the db entry comes once it's done.
+  // FIXME: is this also useful in non-gui mode?
+  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
   {
-    dt_control_crawler_show_image_list(changed_xmp_files);
+    dt_control_crawler_start();
   }
 
   dt_print(DT_DEBUG_CONTROL, "[init] startup took %f seconds\n", dt_get_wtime() - start_wtime);
@@ -1298,6 +1322,9 @@ void dt_get_sysresource_level()
 {
   static int oldlevel = -2;
   darktable.dtresources.tunecl = dt_conf_get_bool("tuneopencl");
+  const char *hugepages = dt_conf_get_string_const("memory_hugepages");
+  darktable.dtresources.hugepages = !g_strcmp0(hugepages, "explicit") ? 2 : !g_strcmp0(hugepages, "transparent") ? 1 : 0;
+  darktable.dtresources.hugepages_pool = (size_t)MAX(0, dt_conf_get_int("memory_hugepages_pool")) << 20;
   darktable.dtresources.level = 2;
   const char *config = dt_conf_get_string_const("resourcelevel");
   /** These levels must correspond with preferences in xml.in **and** fractions
@@ -1329,6 +1356,9 @@ void dt_get_sysresource_level()
     fprintf(stderr,"  mipmap cache:  %luMB\n", _get_mipmap_size() / 1024lu / 1024lu);
     fprintf(stderr,"  available mem: %luMB\n", dt_get_available_mem() / 1024lu / 1024lu);
     fprintf(stderr,"  singlebuff:    %luMB\n", dt_get_singlebuffer_mem() / 1024lu / 1024lu);
+    fprintf(stderr,"  huge pages:    %s, pool %luMB\n",
+            darktable.dtresources.hugepages == 2 ? "explicit" : darktable.dtresources.hugepages ? "transparent" : "off",
+            darktable.dtresources.hugepages_pool / 1024lu / 1024lu);
     darktable.dtresources.group = oldgrp;
   }
 }
@@ -1382,6 +1412,10 @@ void dt_cleanup()
     free(darktable.gui);
   }
 
+  dt_memory_pressure_stop();
+  dt_focuspeaking_cleanup();
+  dt_trace_cleanup();
+  dt_image_sidecar_writer_stop();
   dt_image_cache_cleanup(darktable.image_cache);
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
@@ -1392,6 +1426,8 @@ void dt_cleanup()
     free(darktable.control);
     dt_undo_cleanup(darktable.undo);
   }
+  dt_ioppr_cleanup_profile_cache();
+  dt_presets_autoapply_cleanup();
   dt_colorspaces_cleanup(darktable.color_profiles);
   dt_conf_cleanup(darktable.conf);
   free(darktable.conf);
@@ -1404,6 +1440,7 @@ void dt_cleanup()
   darktable.iop_order_rules = NULL;
   dt_opencl_cleanup(darktable.opencl);
   free(darktable.opencl);
+  dt_free_align_flush();
 #ifdef HAVE_GPHOTO2
   dt_camctl_destroy((dt_camctl_t *)darktable.camctl);
   darktable.camctl = NULL;
@@ -1452,11 +1489,7 @@ void dt_cleanup()
     dt_bauhaus_cleanup();
   }
 
-  if (darktable.noiseprofile_parser)
-  {
-    g_object_unref(darktable.noiseprofile_parser);
-    darktable.noiseprofile_parser = NULL;
-  }
+  dt_noiseprofile_cleanup();
 
   dt_capabilities_cleanup();
 
@@ -1469,6 +1502,7 @@ void dt_cleanup()
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.readFile_mutex));
+  pthread_cond_destroy(&darktable.readFile_cond);
 
   dt_exif_cleanup();
 }
@@ -1486,9 +1520,154 @@ void dt_print(dt_debug_thread_t thread, const char *msg, ...)
   }
 }
 
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+#define HAVE_HUGEPAGES
+
+/* full resolution buffers of the pixelpipes are mapped on their own and backed by huge pages, which saves
+   most of the page faults and tlb misses of memory bound modules. freed ones are kept mapped for the next
+   allocations of about their size, up to dtresources.hugepages_pool bytes, so that the faults are paid once
+   and not for every module and image. */
+#define DT_HUGEPAGE_SIZE ((size_t)2 << 20)
+#define DT_HUGEPAGE_MIN_ALLOC ((size_t)16 << 20)
+#define DT_HUGEPAGE_IDLE 16
+
+typedef struct _huge_buffer_t
+{
+  void *mem;
+  size_t size;
+} _huge_buffer_t;
+
+static GHashTable *_huge_buffers = NULL; // mapping -> its size, while in use
+static _huge_buffer_t _huge_idle[DT_HUGEPAGE_IDLE];
+static size_t _huge_idle_size = 0;
+static gint _huge_used = 0;
+static GMutex _huge_lock;
+
+static void *_huge_map(const size_t size)
+{
+  if(darktable.dtresources.hugepages == 2)
+  {
+    // explicit huge pages have to be reserved by the admin, fall back to transparent ones otherwise
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(mem != MAP_FAILED) return mem;
+  }
+
+  // over-allocate to get a mapping aligned to the huge page size, the kernel doesn't always do that
+  char *mem = mmap(NULL, size + DT_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(mem == MAP_FAILED) return NULL;
+  char *aligned = (char *)(((uintptr_t)mem + DT_HUGEPAGE_SIZE - 1) & ~(DT_HUGEPAGE_SIZE - 1));
+  if(aligned > mem) munmap(mem, aligned - mem);
+  if(aligned + size < mem + size + DT_HUGEPAGE_SIZE)
+    munmap(aligned + size, mem + size + DT_HUGEPAGE_SIZE - (aligned + size));
+  madvise(aligned, size, MADV_HUGEPAGE);
+  return aligned;
+}
+
+// call with _huge_lock held
+static void _huge_unmap_largest_idle(void)
+{
+  int largest = -1;
+  for(int k = 0; k < DT_HUGEPAGE_IDLE; k++)
+    if(_huge_idle[k].mem && (largest < 0 || _huge_idle[k].size > _huge_idle[largest].size)) largest = k;
+  if(largest < 0) return;
+  munmap(_huge_idle[largest].mem, _huge_idle[largest].size);
+  _huge_idle_size -= _huge_idle[largest].size;
+  _huge_idle[largest].mem = NULL;
+  _huge_idle[largest].size = 0;
+}
+
+static void *_huge_alloc(const size_t size)
+{
+  size_t mapped = dt_round_size(size, DT_HUGEPAGE_SIZE);
+  void *mem = NULL;
+
+  g_mutex_lock(&_huge_lock);
+  // the smallest idle buffer large enough, not wasting more than a quarter of it
+  int best = -1;
+  for(int k = 0; k < DT_HUGEPAGE_IDLE; k++)
+    if(_huge_idle[k].mem && _huge_idle[k].size >= mapped && _huge_idle[k].size <= mapped + mapped / 4
+       && (best < 0 || _huge_idle[k].size < _huge_idle[best].size))
+      best = k;
+  if(best >= 0)
+  {
+    mem = _huge_idle[best].mem;
+    mapped = _huge_idle[best].size;
+    _huge_idle_size -= mapped;
+    _huge_idle[best].mem = NULL;
+    _huge_idle[best].size = 0;
+  }
+  g_mutex_unlock(&_huge_lock);
+
+  if(!mem) mem = _huge_map(mapped);
+  if(!mem) return NULL;
+
+  g_mutex_lock(&_huge_lock);
+  if(!_huge_buffers) _huge_buffers = g_hash_table_new(NULL, NULL);
+  g_hash_table_insert(_huge_buffers, mem, GSIZE_TO_POINTER(mapped));
+  g_atomic_int_set(&_huge_used, 1);
+  g_mutex_unlock(&_huge_lock);
+  return mem;
+}
+
+// FALSE if mem isn't a huge page buffer
+static gboolean _huge_free(void *mem)
+{
+  g_mutex_lock(&_huge_lock);
+  gpointer value = NULL;
+  if(!_huge_buffers || !g_hash_table_lookup_extended(_huge_buffers, mem, NULL, &value))
+  {
+    g_mutex_unlock(&_huge_lock);
+    return FALSE;
+  }
+  g_hash_table_remove(_huge_buffers, mem);
+  const size_t size = GPOINTER_TO_SIZE(value);
+
+  int slot = -1;
+  if(size <= darktable.dtresources.hugepages_pool)
+  {
+    // make room by dropping the largest idle buffers
+    while(_huge_idle_size + size > darktable.dtresources.hugepages_pool) _huge_unmap_largest_idle();
+    for(int k = 0; k < DT_HUGEPAGE_IDLE && slot < 0; k++)
+      if(!_huge_idle[k].mem) slot = k;
+    if(slot < 0)
+    {
+      _huge_unmap_largest_idle();
+      for(int k = 0; k < DT_HUGEPAGE_IDLE && slot < 0; k++)
+        if(!_huge_idle[k].mem) slot = k;
+    }
+  }
+  if(slot >= 0)
+  {
+    _huge_idle[slot].mem = mem;
+    _huge_idle[slot].size = size;
+    _huge_idle_size += size;
+  }
+  else
+    munmap(mem, size);
+  g_mutex_unlock(&_huge_lock);
+  return TRUE;
+}
+#endif
+
+void dt_free_align_flush(void)
+{
+#ifdef HAVE_HUGEPAGES
+  g_mutex_lock(&_huge_lock);
+  while(_huge_idle_size) _huge_unmap_largest_idle();
+  g_mutex_unlock(&_huge_lock);
+#endif
+}
+
 void *dt_alloc_align(size_t alignment, size_t size)
 {
   const size_t aligned_size = dt_round_size(size, alignment);
+#ifdef HAVE_HUGEPAGES
+  if(darktable.dtresources.hugepages && aligned_size >= DT_HUGEPAGE_MIN_ALLOC && alignment <= DT_HUGEPAGE_SIZE)
+  {
+    void *mem = _huge_alloc(aligned_size);
+    if(mem) return mem;
+  }
+#endif
 #if defined(__FreeBSD_version) && __FreeBSD_version < 700013
   return malloc(aligned_size);
 #elif defined(_WIN32)
@@ -1526,15 +1705,22 @@ void dt_free_align(void *mem)
 {
   _aligned_free(mem);
 }
-#elif defined(_DEBUG)
+#else
 void dt_free_align(void *mem)
 {
+#ifdef HAVE_HUGEPAGES
+  if(mem && g_atomic_int_get(&_huge_used) && _huge_free(mem)) return;
+#endif
+#ifdef _DEBUG
   // on a debug build, we deliberately offset the returned pointer from dt_alloc_align, so eliminate the offset
   if (mem)
   {
     short offset = ((short*)mem)[-1];
     free(((char*)mem)-offset);
   }
+#else
+  free(mem);
+#endif
 }
 #endif
 
@@ -1680,6 +1866,39 @@ size_t dt_get_singlebuffer_mem()
   return MAX(2lu * 1024lu * 1024lu, total_mem / 1024lu * fraction);
 }
 
+static dt_atomic_int _omp_share_users;
+static __thread int _omp_share_depth = 0;
+static __thread int _omp_share_cap = 0;
+
+void dt_omp_share_begin()
+{
+#ifdef _OPENMP
+  if(_omp_share_depth++ > 0) return;
+  _omp_share_cap = omp_get_max_threads();
+  dt_atomic_add_int(&_omp_share_users, 1);
+  dt_omp_share_update();
+#endif
+}
+
+void dt_omp_share_update()
+{
+#ifdef _OPENMP
+  if(_omp_share_depth == 0) return;
+  const int users = MAX(1, dt_atomic_get_int(&_omp_share_users));
+  const int share = MAX(1, (darktable.num_openmp_threads + users / 2) / users);
+  omp_set_num_threads(MIN(_omp_share_cap, share));
+#endif
+}
+
+void dt_omp_share_end()
+{
+#ifdef _OPENMP
+  if(_omp_share_depth == 0 || --_omp_share_depth > 0) return;
+  dt_atomic_sub_int(&_omp_share_users, 1);
+  omp_set_num_threads(_omp_share_cap);
+#endif
+}
+
 void dt_configure_performance()
 {
   const int atom_cores = _get_num_atom_cores();
@@ -129,6 +129,8 @@ typedef unsigned int u_int;
 #if __has_attribute(target_clones) && !defined(_WIN32) && !defined(NATIVE_ARCH)
 # if defined(__amd64__) || defined(__amd64) || defined(__x86_64__) || defined(__x86_64)
 #define __DT_CLONE_TARGETS__ __attribute__((target_clones("default", "sse2", "sse3", "sse4.1", "sse4.2", "popcnt", "avx", "avx2", "avx512f", "fma4")))
+/* the plain kernels carry an avx2 clone, see darktable.codepath.AVX2 */
+#define DT_HAVE_AVX2_CLONES 1
 # elif defined(__PPC64__)
 /* __PPC64__ is the only macro tested for in is_supported_platform.h, other macros would fail there anyway. */
 #define __DT_CLONE_TARGETS__ __attribute__((target_clones("default","cpu=power9")))
@@ -268,12 +270,14 @@ typedef enum dt_debug_thread_t
   DT_DEBUG_SIGNAL         = 1 << 20,
   DT_DEBUG_PARAMS         = 1 << 21,
   DT_DEBUG_DEMOSAIC       = 1 << 22,
-  DT_DEBUG_ACT_ON         = 1 << 23
+  DT_DEBUG_ACT_ON         = 1 << 23,
+  DT_DEBUG_TRACE          = 1 << 24
 } dt_debug_thread_t;
 
 typedef struct dt_codepath_t
 {
   unsigned int SSE2 : 1;
+  unsigned int AVX2 : 1; // runtime selection of the multiversioned plain kernels over the 4-wide sse2 ones
   unsigned int _no_intrinsics : 1;
   unsigned int OPENMP_SIMD : 1; // always stays the last one
 } dt_codepath_t;
@@ -286,6 +290,8 @@ typedef struct dt_sys_resources_t
   int group;
   int level;
   int tunecl;
+  int hugepages;         // large buffers backed by huge pages: 0 off, 1 transparent, 2 explicit (hugetlbfs)
+  size_t hugepages_pool; // bytes of freed huge page buffers kept mapped for the next allocations
 } dt_sys_resources_t;
 
 typedef struct darktable_t
@@ -326,7 +332,10 @@ typedef struct darktable_t
   dt_pthread_mutex_t plugin_threadsafe;
   dt_pthread_mutex_t capabilities_threadsafe;
   dt_pthread_mutex_t exiv2_threadsafe;
+  // raw files being read right now, at most raw_read_concurrency at a time, see imageio_rawspeed.cc
   dt_pthread_mutex_t readFile_mutex;
+  pthread_cond_t readFile_cond;
+  int readFile_active;
   char *progname;
   char *datadir;
   char *sharedir;
@@ -361,6 +370,14 @@ int dt_worker_threads();
 size_t dt_get_available_mem();
 size_t dt_get_singlebuffer_mem();
 
+/** share the openmp threads among all threads running heavy processing (pixelpipes) at the same time.
+    between begin and end the calling thread opens parallel regions with its fair part of
+    darktable.num_openmp_threads, never more than it was set up with. calls nest, update re-balances
+    after other threads started or finished. */
+void dt_omp_share_begin();
+void dt_omp_share_update();
+void dt_omp_share_end();
+
 void *dt_alloc_align(size_t alignment, size_t size);
 static inline void* dt_calloc_align(size_t alignment, size_t size)
 {
@@ -381,16 +398,12 @@ static inline float *dt_calloc_align_float(size_t pixels)
 size_t dt_round_size(const size_t size, const size_t alignment);
 size_t dt_round_size_sse(const size_t size);
 
-#ifdef _WIN32
-void dt_free_align(void *mem);
-#define dt_free_align_ptr dt_free_align
-#elif _DEBUG // debug build makes sure that we get a crash on using plain free() on an aligned allocation
+// buffers from dt_alloc_align() may be huge page mappings given back to their pool, and a debug build makes
+// sure that we get a crash on using plain free() on an aligned allocation
 void dt_free_align(void *mem);
 #define dt_free_align_ptr dt_free_align
-#else
-#define dt_free_align(A) free(A)
-#define dt_free_align_ptr free
-#endif
+/** unmaps the idle huge page buffers kept for the next allocations. */
+void dt_free_align_flush(void);
 
 static inline void dt_lock_image(int32_t imgid) ACQUIRE(darktable.db_image[imgid & (DT_IMAGE_DBLOCKS-1)])
 {
@@ -28,6 +28,7 @@
 #include "common/iop_order.h"
 #include "common/styles.h"
 #include "common/history.h"
+#include "common/image.h"
 #ifdef HAVE_ICU
 #include "common/sqliteicu.h"
 #endif
@@ -48,11 +49,15 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 34
+#define CURRENT_DATABASE_VERSION_LIBRARY 36
 #define CURRENT_DATABASE_VERSION_DATA     9
 
 // #define USE_NESTED_TRANSACTIONS
 #define MAX_NESTED_TRANSACTIONS 0
+// read-only connections kept open for the worker threads
+#define DT_DATABASE_READERS 4
+// idle copies of each cached statement kept per connection
+#define DT_DATABASE_CACHED_STMTS 4
 /* transaction id */
 static dt_atomic_int _trxid;
 
@@ -69,10 +74,40 @@ typedef struct dt_database_t
   /* ondisk DB */
   sqlite3 *handle;
 
+  /* read-only connections to the library for worker threads, with the library in WAL mode */
+  gboolean wal;
+  dt_pthread_mutex_t readers_lock;
+  sqlite3 *readers[DT_DATABASE_READERS];
+  gboolean reader_used[DT_DATABASE_READERS];
+
+  /* bulk writes of one thread grouped into a transaction, see dt_database_batch_begin() */
+  dt_pthread_mutex_t batch_lock;
+  GThread *batch_thread;
+  int batch_depth;
+  gboolean batch_trx;
+  GHashTable *batch_sidecars; // images whose xmp sidecar is written once committed
+
+  /* idle prepared statements for reuse, see dt_database_prepare_cached() */
+  dt_pthread_mutex_t stmts_lock;
+  GHashTable *stmts;          // connection -> (sql -> list of reset statements)
+
   gchar *error_message, *error_dbfilename;
   int error_other_pid;
 } dt_database_t;
 
+static inline gboolean _is_mem_db(const struct dt_database_t *db);
+
+
+// a write-ahead log left next to a database which is deleted or replaced must not be applied to the new one
+static void _database_unlink_journal(const char *filename)
+{
+  gchar *wal = g_strconcat(filename, "-wal", NULL);
+  gchar *shm = g_strconcat(filename, "-shm", NULL);
+  g_unlink(wal);
+  g_unlink(shm);
+  g_free(wal);
+  g_free(shm);
+}
 
 /* migrates database from old place to new */
 static void _database_migrate_to_xdg_structure();
@@ -1974,6 +2009,28 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 34;
   }
+  else if(version == 34)
+  {
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    TRY_EXEC("ALTER TABLE main.images ADD COLUMN loader INTEGER DEFAULT 0",
+             "[init] can't add `loader' column to images table in database\n");
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 35;
+  }
+  else if(version == 35)
+  {
+    sqlite3_exec(db->handle, "BEGIN TRANSACTION", NULL, NULL, NULL);
+
+    TRY_EXEC("CREATE TABLE main.export_hash (imgid INTEGER, target VARCHAR, fingerprint VARCHAR, "
+             "PRIMARY KEY (imgid, target), "
+             "FOREIGN KEY(imgid) REFERENCES images(id) ON UPDATE CASCADE ON DELETE CASCADE)",
+             "[init] can't create table export_hash\n");
+
+    sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
+    new_version = 36;
+  }
   else
     new_version = version; // should be the fallback so that calling code sees that we are in an infinite loop
 
@@ -2263,7 +2320,7 @@ static void _create_library_schema(dt_database_t *db)
       "max_version INTEGER, write_timestamp INTEGER, history_end INTEGER, position INTEGER, "
       "aspect_ratio REAL, exposure_bias REAL, "
       "import_timestamp INTEGER DEFAULT -1, change_timestamp INTEGER DEFAULT -1, "
-      "export_timestamp INTEGER DEFAULT -1, print_timestamp INTEGER DEFAULT -1, "
+      "export_timestamp INTEGER DEFAULT -1, print_timestamp INTEGER DEFAULT -1, loader INTEGER DEFAULT 0, "
       "FOREIGN KEY(film_id) REFERENCES film_rolls(id) ON DELETE CASCADE ON UPDATE CASCADE, "
       "FOREIGN KEY(group_id) REFERENCES images(id) ON DELETE RESTRICT ON UPDATE CASCADE)",
       NULL, NULL, NULL);
@@ -2324,6 +2381,12 @@ static void _create_library_schema(dt_database_t *db)
                NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE INDEX main.metadata_index_key ON meta_data (key)", NULL, NULL, NULL);
 
+  // v36
+  sqlite3_exec(db->handle, "CREATE TABLE main.export_hash (imgid INTEGER, target VARCHAR, fingerprint VARCHAR, "
+               "PRIMARY KEY (imgid, target), "
+               "FOREIGN KEY(imgid) REFERENCES images(id) ON UPDATE CASCADE ON DELETE CASCADE)",
+               NULL, NULL, NULL);
+
 }
 
 /* create the current database schema and set the version in db_info accordingly */
@@ -2386,11 +2449,45 @@ static void _create_memory_schema(dt_database_t *db)
       "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)", NULL,
       NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.tmp_selection (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE memory.collection_patch (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  // images being duplicated in bulk and their duplicates
+  sqlite3_exec(db->handle, "CREATE TABLE memory.duplicates (src INTEGER, dst INTEGER PRIMARY KEY)",
+               NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.taglist "
                            "(tmpid INTEGER PRIMARY KEY, id INTEGER UNIQUE ON CONFLICT IGNORE, "
                            "count INTEGER DEFAULT 0, count2 INTEGER DEFAULT 0)",
                NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.similar_tags (tagid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  // images per tag for the tag trees, counted once and maintained by triggers in the transaction of each change
+  sqlite3_exec(db->handle, "CREATE TABLE memory.tag_counts (tagid INTEGER PRIMARY KEY, count INTEGER)",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "INSERT INTO memory.tag_counts (tagid, count)"
+                           "  SELECT tagid, COUNT(*) FROM main.tagged_images GROUP BY tagid",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle,
+      "CREATE TEMP TRIGGER tag_counts_insert AFTER INSERT ON main.tagged_images"
+      " BEGIN"
+      "  INSERT OR IGNORE INTO tag_counts (tagid, count) VALUES (new.tagid, 0);"
+      "  UPDATE tag_counts SET count = count + 1 WHERE tagid = new.tagid;"
+      " END",
+      NULL, NULL, NULL);
+  sqlite3_exec(db->handle,
+      "CREATE TEMP TRIGGER tag_counts_delete AFTER DELETE ON main.tagged_images"
+      " BEGIN"
+      "  UPDATE tag_counts SET count = count - 1 WHERE tagid = old.tagid;"
+      "  DELETE FROM tag_counts WHERE tagid = old.tagid AND count <= 0;"
+      " END",
+      NULL, NULL, NULL);
+  sqlite3_exec(db->handle,
+      "CREATE TEMP TRIGGER tag_counts_update AFTER UPDATE OF tagid ON main.tagged_images"
+      " WHEN new.tagid <> old.tagid"
+      " BEGIN"
+      "  UPDATE tag_counts SET count = count - 1 WHERE tagid = old.tagid;"
+      "  DELETE FROM tag_counts WHERE tagid = old.tagid AND count <= 0;"
+      "  INSERT OR IGNORE INTO tag_counts (tagid, count) VALUES (new.tagid, 0);"
+      "  UPDATE tag_counts SET count = count + 1 WHERE tagid = new.tagid;"
+      " END",
+      NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.darktable_tags (tagid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
   sqlite3_exec(
       db->handle,
@@ -2897,6 +2994,10 @@ start:
   dt_database_t *db = (dt_database_t *)g_malloc0(sizeof(dt_database_t));
   db->dbfilename_data = g_strdup(dbfilename_data);
   db->dbfilename_library = g_strdup(dbfilename_library);
+  dt_pthread_mutex_init(&db->readers_lock, NULL);
+  dt_pthread_mutex_init(&db->batch_lock, NULL);
+  dt_pthread_mutex_init(&db->stmts_lock, NULL);
+  db->stmts = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_hash_table_destroy);
 
   dt_atomic_set_int(&_trxid, 0);
 
@@ -2973,9 +3074,22 @@ start:
   sqlite3_finalize(stmt);
 
   // some sqlite3 config
-  sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
+  if(!_is_mem_db(db) && dt_conf_get_bool("database/wal"))
+  {
+    // readers on other connections don't wait for writers, and a crash can't leave the library half written
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+    gchar *mode = _get_pragma_string_val(db->handle, "main.journal_mode");
+    db->wal = !g_strcmp0(mode, "wal");
+    g_free(mode);
+    if(!db->wal) fprintf(stderr, "[init] couldn't switch `%s' to WAL mode\n", dbfilename_library);
+  }
+  if(!db->wal)
+  {
+    sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  }
 
   // WARNING: the foreign_keys pragma must not be used, the integrity of the
   // database rely on it.
@@ -3132,6 +3246,7 @@ start:
         fprintf(stderr, " ... ok\n");
       else
         fprintf(stderr, " ... failed\n");
+      _database_unlink_journal(dbfilename_data);
 
       if(resp == GTK_RESPONSE_ACCEPT && data_snap)
       {
@@ -3310,6 +3425,7 @@ start:
       fprintf(stderr, " ... ok\n");
     else
       fprintf(stderr, " ... failed\n");
+    _database_unlink_journal(dbfilename_library);
 
     if(resp == GTK_RESPONSE_ACCEPT && data_snap)
     {
@@ -3415,8 +3531,21 @@ error:
   return db;
 }
 
+static void _stmts_free(gpointer data)
+{
+  g_queue_free_full((GQueue *)data, (GDestroyNotify)sqlite3_finalize);
+}
+
 void dt_database_destroy(const dt_database_t *db)
 {
+  // no connection closes with statements left
+  g_hash_table_destroy(db->stmts);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->stmts_lock);
+  // the last connection to close checkpoints the write-ahead log
+  for(int k = 0; k < DT_DATABASE_READERS; k++)
+    if(db->readers[k]) sqlite3_close(db->readers[k]);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->readers_lock);
+  dt_pthread_mutex_destroy(&((dt_database_t *)db)->batch_lock);
   sqlite3_close(db->handle);
   if (db->lockfile_data)
   {
@@ -3440,6 +3569,76 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+static sqlite3 *_database_open_reader(const dt_database_t *db)
+{
+  sqlite3 *handle = NULL;
+  if(sqlite3_open_v2(db->dbfilename_library, &handle, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL)
+     != SQLITE_OK)
+  {
+    sqlite3_close(handle);
+    return NULL;
+  }
+  // only checkpoints can make a reader wait
+  sqlite3_busy_timeout(handle, 1000);
+
+  sqlite3_stmt *stmt;
+  int rc = sqlite3_prepare_v2(handle, "ATTACH DATABASE ?1 AS data", -1, &stmt, NULL);
+  if(rc == SQLITE_OK)
+  {
+    sqlite3_bind_text(stmt, 1, db->dbfilename_data, -1, SQLITE_TRANSIENT);
+    if(sqlite3_step(stmt) != SQLITE_DONE) rc = SQLITE_ERROR;
+  }
+  sqlite3_finalize(stmt);
+  if(rc != SQLITE_OK)
+  {
+    sqlite3_close(handle);
+    return NULL;
+  }
+  return handle;
+}
+
+sqlite3 *dt_database_get_reader(const dt_database_t *db)
+{
+  if(!db) return NULL;
+  // changes of a transaction still open are only seen on the shared handle
+  if(!db->wal || !sqlite3_get_autocommit(db->handle)) return db->handle;
+
+  dt_database_t *d = (dt_database_t *)db;
+  sqlite3 *handle = NULL;
+  dt_pthread_mutex_lock(&d->readers_lock);
+  for(int k = 0; k < DT_DATABASE_READERS && !handle; k++)
+  {
+    if(d->reader_used[k]) continue;
+    if(!d->readers[k])
+    {
+      d->readers[k] = _database_open_reader(d);
+      if(!d->readers[k])
+      {
+        fprintf(stderr, "[dt_database_get_reader] couldn't open a read connection to `%s'\n",
+                d->dbfilename_library);
+        d->wal = FALSE;
+        break;
+      }
+    }
+    d->reader_used[k] = TRUE;
+    handle = d->readers[k];
+  }
+  dt_pthread_mutex_unlock(&d->readers_lock);
+
+  // all of them busy: share the handle as before
+  return handle ? handle : db->handle;
+}
+
+void dt_database_release_reader(const dt_database_t *db, sqlite3 *handle)
+{
+  if(!db || handle == db->handle) return;
+  dt_database_t *d = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&d->readers_lock);
+  for(int k = 0; k < DT_DATABASE_READERS; k++)
+    if(d->readers[k] == handle) d->reader_used[k] = FALSE;
+  dt_pthread_mutex_unlock(&d->readers_lock);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
@@ -4480,6 +4679,113 @@ void dt_database_rollback_transaction(const struct dt_database_t *db)
 #endif
 }
 
+static inline gboolean _batch_owned(const dt_database_t *db)
+{
+  return g_atomic_pointer_get(&db->batch_thread) == (gpointer)g_thread_self();
+}
+
+void dt_database_batch_begin(const struct dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(_batch_owned(d))
+  {
+    d->batch_depth++;
+    return;
+  }
+
+  // one batch at a time, the one of another thread waits for the commit
+  dt_pthread_mutex_lock(&d->batch_lock);
+  d->batch_depth = 1;
+  d->batch_sidecars = g_hash_table_new(NULL, NULL);
+  g_atomic_pointer_set(&d->batch_thread, g_thread_self());
+
+  // inside a transaction opened by the caller the writes are already grouped
+  d->batch_trx = sqlite3_get_autocommit(d->handle);
+  if(d->batch_trx) dt_database_start_transaction(db);
+}
+
+void dt_database_batch_commit(const struct dt_database_t *db)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  if(!_batch_owned(d))
+  {
+    fprintf(stderr, "[dt_database_batch_commit] no batch open in this thread\n");
+    return;
+  }
+  if(--d->batch_depth > 0) return;
+
+  if(d->batch_trx) dt_database_release_transaction(db);
+
+  GList *sidecars = g_hash_table_get_keys(d->batch_sidecars);
+  g_hash_table_destroy(d->batch_sidecars);
+  d->batch_sidecars = NULL;
+
+  g_atomic_pointer_set(&d->batch_thread, NULL);
+  dt_pthread_mutex_unlock(&d->batch_lock);
+
+  // written in the background from the committed state
+  for(GList *l = sidecars; l; l = g_list_next(l)) dt_image_sidecar_mark_dirty(GPOINTER_TO_INT(l->data));
+  g_list_free(sidecars);
+}
+
+gboolean dt_database_batch_defer_sidecar(const struct dt_database_t *db, const int imgid)
+{
+  if(!_batch_owned(db)) return FALSE;
+  g_hash_table_add(db->batch_sidecars, GINT_TO_POINTER(imgid));
+  return TRUE;
+}
+
+sqlite3_stmt *dt_database_prepare_cached(const struct dt_database_t *db, sqlite3 *handle, const char *sql)
+{
+  dt_database_t *d = (dt_database_t *)db;
+  sqlite3_stmt *stmt = NULL;
+
+  dt_pthread_mutex_lock(&d->stmts_lock);
+  GHashTable *stmts = g_hash_table_lookup(d->stmts, handle);
+  GQueue *idle = stmts ? g_hash_table_lookup(stmts, sql) : NULL;
+  if(idle) stmt = (sqlite3_stmt *)g_queue_pop_head(idle);
+  dt_pthread_mutex_unlock(&d->stmts_lock);
+
+  // none idle, the caller gets a new one which is kept once released
+  if(!stmt) DT_DEBUG_SQLITE3_PREPARE_V2(handle, sql, -1, &stmt, NULL);
+  return stmt;
+}
+
+void dt_database_release_cached(const struct dt_database_t *db, sqlite3_stmt *stmt)
+{
+  if(!stmt) return;
+  dt_database_t *d = (dt_database_t *)db;
+
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  sqlite3 *handle = sqlite3_db_handle(stmt);
+  const char *sql = sqlite3_sql(stmt);
+
+  dt_pthread_mutex_lock(&d->stmts_lock);
+  GHashTable *stmts = g_hash_table_lookup(d->stmts, handle);
+  if(!stmts)
+  {
+    stmts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _stmts_free);
+    g_hash_table_insert(d->stmts, handle, stmts);
+  }
+  GQueue *idle = g_hash_table_lookup(stmts, sql);
+  if(!idle)
+  {
+    idle = g_queue_new();
+    g_hash_table_insert(stmts, g_strdup(sql), idle);
+  }
+  if(g_queue_get_length(idle) < DT_DATABASE_CACHED_STMTS)
+  {
+    g_queue_push_head(idle, stmt);
+    stmt = NULL;
+  }
+  dt_pthread_mutex_unlock(&d->stmts_lock);
+
+  // as many copies idle as are ever used at once
+  if(stmt) sqlite3_finalize(stmt);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -28,6 +28,11 @@ struct dt_database_t *dt_database_init(const char *alternative, const gboolean l
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** get a read-only connection to main and data for worker threads, to be given back with
+    dt_database_release_reader(). the memory tables are not attached to it. with the library not in WAL mode,
+    all readers busy or a transaction open, this is the shared handle. */
+struct sqlite3 *dt_database_get_reader(const struct dt_database_t *db);
+void dt_database_release_reader(const struct dt_database_t *db, struct sqlite3 *handle);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
@@ -57,6 +62,26 @@ void dt_database_start_transaction(const struct dt_database_t *db);
 void dt_database_release_transaction(const struct dt_database_t *db);
 void dt_database_rollback_transaction(const struct dt_database_t *db);
 
+// batched writes
+
+/** group the writes of a bulk operation of the calling thread into one transaction. batches nest, the
+    outermost commit ends it. another thread beginning a batch waits for the commit. */
+void dt_database_batch_begin(const struct dt_database_t *db);
+void dt_database_batch_commit(const struct dt_database_t *db);
+/** inside a batch of the calling thread, have the xmp sidecar of imgid written by the background writer after
+    the commit. returns FALSE outside of a batch. */
+gboolean dt_database_batch_defer_sidecar(const struct dt_database_t *db, const int imgid);
+
+// prepared statement cache
+
+/** prepare sql on handle, a connection of db, or take an idle statement prepared before for the same sql. the
+    caller owns the statement until giving it back with dt_database_release_cached() instead of finalizing it.
+    for fixed sql of lookups done often, bind the values rather than printing them into the sql. */
+struct sqlite3_stmt *dt_database_prepare_cached(const struct dt_database_t *db, struct sqlite3 *handle,
+                                                const char *sql);
+/** reset the statement and keep it for the next dt_database_prepare_cached() of its sql. */
+void dt_database_release_cached(const struct dt_database_t *db, struct sqlite3_stmt *stmt);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
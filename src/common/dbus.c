@@ -21,6 +21,9 @@
 #include "control/conf.h"
 #include "control/control.h"
 #include "common/file_location.h"
+#include "common/imageio_module.h"
+#include "common/metadata_export.h"
+#include "control/jobs/control_jobs.h"
 
 #ifdef USE_LUA
 #include "lua/call.h"
@@ -44,8 +47,227 @@ static const gchar introspection_xml[] = "<node>"
                                          "    <property type='s' name='ConfigDir' access='read'/>"
                                          "    <property type='b' name='LuaEnabled' access='read'/>"
                                          "  </interface>"
+                                         "  <interface name='org.darktable.service.Jobs'>"
+                                         "    <method name='Export'>"
+                                         "      <arg type='au' name='Images' direction='in'/>"
+                                         "      <arg type='s' name='Storage' direction='in'/>"
+                                         "      <arg type='s' name='Format' direction='in'/>"
+                                         "      <arg type='a{sv}' name='Options' direction='in'/>"
+                                         "      <arg type='u' name='Job' direction='out' />"
+                                         "    </method>"
+                                         "    <method name='Progress'>"
+                                         "      <arg type='u' name='Job' direction='in'/>"
+                                         "      <arg type='s' name='State' direction='out' />"
+                                         "      <arg type='d' name='Progress' direction='out' />"
+                                         "    </method>"
+                                         "    <method name='Cancel'>"
+                                         "      <arg type='u' name='Job' direction='in'/>"
+                                         "      <arg type='b' name='Cancelled' direction='out' />"
+                                         "    </method>"
+                                         "  </interface>"
                                          "</node>";
 
+/*
+ * jobs enqueued through org.darktable.service.Jobs, looked up by the id handed out to the client. the
+ * method calls are dispatched in the jobs thread and only touch the job queues, so they are answered
+ * while the gui is busy (or not there at all). a job's record outlives the job until its final state
+ * got reported once.
+ */
+typedef struct _dbus_job_t
+{
+  guint id;
+  dt_job_t *job;          // NULL once disposed
+  dt_job_state_t state;   // the last state seen
+  gboolean cancelled;
+} _dbus_job_t;
+
+static GMutex _jobs_lock;
+static GHashTable *_jobs = NULL;        // id -> _dbus_job_t
+static GHashTable *_jobs_by_job = NULL; // dt_job_t -> _dbus_job_t, while the job exists
+static guint _jobs_next_id = 0;
+
+static void _jobs_state_changed(dt_job_t *job, dt_job_state_t state)
+{
+  g_mutex_lock(&_jobs_lock);
+  _dbus_job_t *j = _jobs_by_job ? g_hash_table_lookup(_jobs_by_job, job) : NULL;
+  if(j)
+  {
+    if(state == DT_JOB_STATE_DISPOSED)
+    {
+      g_hash_table_remove(_jobs_by_job, job);
+      j->job = NULL;
+    }
+    else if(!j->cancelled)
+    {
+      // a cancelled job still finishes or gets discarded, it stays cancelled for the client
+      j->cancelled = state == DT_JOB_STATE_CANCELLED;
+      j->state = state;
+    }
+  }
+  g_mutex_unlock(&_jobs_lock);
+}
+
+static const char *_jobs_state_name(const dt_job_state_t state)
+{
+  switch(state)
+  {
+    case DT_JOB_STATE_INITIALIZED:
+    case DT_JOB_STATE_QUEUED:
+      return "queued";
+    case DT_JOB_STATE_RUNNING:
+      return "running";
+    case DT_JOB_STATE_CANCELLED:
+      return "cancelled";
+    case DT_JOB_STATE_DISCARDED:
+      return "discarded";
+    default:
+      return "finished";
+  }
+}
+
+static void _jobs_export(GVariant *parameters, GDBusMethodInvocation *invocation)
+{
+  GVariant *images, *options;
+  const gchar *storage_name, *format_name;
+  g_variant_get(parameters, "(@au&s&s@a{sv})", &images, &storage_name, &format_name, &options);
+
+  dt_imageio_module_storage_t *storage = dt_imageio_get_storage_by_name(storage_name);
+  dt_imageio_module_format_t *format = dt_imageio_get_format_by_name(format_name);
+  GList *imgs = NULL;
+  GVariantIter iter;
+  guint32 imgid;
+  g_variant_iter_init(&iter, images);
+  while(g_variant_iter_next(&iter, "u", &imgid))
+    if(imgid > 0) imgs = g_list_prepend(imgs, GINT_TO_POINTER(imgid));
+  imgs = g_list_reverse(imgs);
+
+  if(!dt_control_running())
+    g_dbus_method_invocation_return_dbus_error(invocation, "org.darktable.Error.NotRunning",
+                                               "darktable is not running jobs");
+  else if(!storage || !format)
+    g_dbus_method_invocation_return_dbus_error(invocation, "org.darktable.Error.UnknownModule",
+                                               storage ? "unknown format" : "unknown storage");
+  else if(!storage->supported(storage, format))
+    g_dbus_method_invocation_return_dbus_error(invocation, "org.darktable.Error.Unsupported",
+                                               "the storage doesn't support the format");
+  else if(!imgs)
+    g_dbus_method_invocation_return_dbus_error(invocation, "org.darktable.Error.NoImages", "no images given");
+  else
+  {
+    guint32 width = 0, height = 0;
+    gboolean high_quality = FALSE, upscale = FALSE, export_masks = FALSE, style_append = FALSE;
+    const gchar *style = "";
+    g_variant_lookup(options, "width", "u", &width);
+    g_variant_lookup(options, "height", "u", &height);
+    g_variant_lookup(options, "high-quality", "b", &high_quality);
+    g_variant_lookup(options, "upscale", "b", &upscale);
+    g_variant_lookup(options, "export-masks", "b", &export_masks);
+    g_variant_lookup(options, "style", "&s", &style);
+    g_variant_lookup(options, "style-append", "b", &style_append);
+    char *metadata = dt_lib_export_metadata_get_conf();
+
+    // the image's own output profile and intent, like the export module's defaults
+    dt_job_t *job = dt_control_export_job_create(imgs, width, height, dt_imageio_get_index_of_format(format),
+                                                 dt_imageio_get_index_of_storage(storage), high_quality, upscale,
+                                                 export_masks, style, style_append, DT_COLORSPACE_NONE, NULL,
+                                                 (dt_iop_color_intent_t)-1, metadata);
+    g_free(metadata);
+    imgs = NULL; // owned by the job now
+
+    if(!job)
+      g_dbus_method_invocation_return_dbus_error(invocation, "org.darktable.Error.Failed",
+                                                 "the export couldn't be set up");
+    else
+    {
+      _dbus_job_t *j = g_malloc0(sizeof(_dbus_job_t));
+      j->job = job;
+      j->state = DT_JOB_STATE_QUEUED;
+      dt_control_job_set_state_callback(job, _jobs_state_changed);
+
+      g_mutex_lock(&_jobs_lock);
+      j->id = ++_jobs_next_id;
+      g_hash_table_insert(_jobs, GUINT_TO_POINTER(j->id), j);
+      g_hash_table_insert(_jobs_by_job, job, j);
+      g_mutex_unlock(&_jobs_lock);
+
+      dt_control_export_job_dispatch(job);
+      g_dbus_method_invocation_return_value(invocation, g_variant_new("(u)", j->id));
+    }
+  }
+
+  g_list_free(imgs);
+  g_variant_unref(images);
+  g_variant_unref(options);
+}
+
+static void _handle_jobs_method_call(GDBusConnection *connection, const gchar *sender, const gchar *object_path,
+                                     const gchar *interface_name, const gchar *method_name, GVariant *parameters,
+                                     GDBusMethodInvocation *invocation, gpointer user_data)
+{
+  if(!g_strcmp0(method_name, "Export"))
+  {
+    _jobs_export(parameters, invocation);
+    return;
+  }
+
+  guint32 id;
+  g_variant_get(parameters, "(u)", &id);
+  g_mutex_lock(&_jobs_lock);
+  _dbus_job_t *j = g_hash_table_lookup(_jobs, GUINT_TO_POINTER(id));
+  if(!j)
+  {
+    g_mutex_unlock(&_jobs_lock);
+    g_dbus_method_invocation_return_dbus_error(invocation, "org.darktable.Error.UnknownJob", "unknown job");
+    return;
+  }
+
+  // the job can't be disposed while we hold the lock
+  if(!g_strcmp0(method_name, "Progress"))
+  {
+    const gchar *state = _jobs_state_name(j->state);
+    double progress = j->state == DT_JOB_STATE_FINISHED ? 1.0 : 0.0;
+    if(j->job && j->state == DT_JOB_STATE_RUNNING)
+      progress = MAX(dt_control_job_get_progress(j->job), 0.0);
+    if(!j->job) g_hash_table_remove(_jobs, GUINT_TO_POINTER(id));
+    g_mutex_unlock(&_jobs_lock);
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(sd)", state, progress));
+  }
+  else if(!g_strcmp0(method_name, "Cancel"))
+  {
+    const gboolean cancel = j->job && !j->cancelled
+                            && (j->state == DT_JOB_STATE_QUEUED || j->state == DT_JOB_STATE_RUNNING);
+    if(cancel) dt_control_job_cancel(j->job);
+    g_mutex_unlock(&_jobs_lock);
+    g_dbus_method_invocation_return_value(invocation, g_variant_new("(b)", cancel));
+  }
+  else
+    g_mutex_unlock(&_jobs_lock);
+}
+
+static const GDBusInterfaceVTable jobs_interface_vtable = { _handle_jobs_method_call, NULL, NULL };
+
+static gboolean _jobs_quit(gpointer user_data)
+{
+  g_main_loop_quit((GMainLoop *)user_data);
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer _jobs_thread(gpointer user_data)
+{
+  dt_dbus_t *dbus = (dt_dbus_t *)user_data;
+  // method calls of an object are dispatched in the context it got registered from
+  g_main_context_push_thread_default(dbus->jobs_context);
+  dbus->jobs_registration_id = g_dbus_connection_register_object(
+      dbus->dbus_connection, "/darktable/jobs",
+      g_dbus_node_info_lookup_interface(dbus->introspection_data, "org.darktable.service.Jobs"),
+      &jobs_interface_vtable, dbus, NULL, NULL);
+  g_main_loop_run(dbus->jobs_loop);
+  if(dbus->jobs_registration_id)
+    g_dbus_connection_unregister_object(dbus->dbus_connection, dbus->jobs_registration_id);
+  g_main_context_pop_thread_default(dbus->jobs_context);
+  return NULL;
+}
+
 
 #ifdef USE_LUA
 static void dbus_lua_call_finished(lua_State* L,int result,void* data)
@@ -190,13 +412,41 @@ struct dt_dbus_t *dt_dbus_init()
                                   _on_name_lost, dbus, NULL);
 
   dbus->dbus_connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+  if(!dbus->dbus_connection) return dbus;
   g_object_set(G_OBJECT(dbus->dbus_connection), "exit-on-close", FALSE, (gchar *)0);
 
+  g_mutex_lock(&_jobs_lock);
+  if(!_jobs)
+  {
+    _jobs = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    _jobs_by_job = g_hash_table_new(NULL, NULL);
+  }
+  g_mutex_unlock(&_jobs_lock);
+  dbus->jobs_context = g_main_context_new();
+  dbus->jobs_loop = g_main_loop_new(dbus->jobs_context, FALSE);
+  dbus->jobs_thread = g_thread_new("dbus jobs", _jobs_thread, dbus);
+
   return dbus;
 }
 
 void dt_dbus_destroy(const dt_dbus_t *dbus)
 {
+  if(dbus->jobs_thread)
+  {
+    // through the loop itself, it might not be running yet
+    GSource *source = g_idle_source_new();
+    g_source_set_callback(source, _jobs_quit, dbus->jobs_loop, NULL);
+    g_source_attach(source, dbus->jobs_context);
+    g_source_unref(source);
+    g_thread_join(dbus->jobs_thread);
+    g_main_loop_unref(dbus->jobs_loop);
+    g_main_context_unref(dbus->jobs_context);
+  }
+  // jobs still queued report to nobody
+  g_mutex_lock(&_jobs_lock);
+  if(_jobs_by_job) g_hash_table_remove_all(_jobs_by_job);
+  g_mutex_unlock(&_jobs_lock);
+
   g_bus_unown_name(dbus->owner_id);
   g_dbus_node_info_unref(dbus->introspection_data);
   if(dbus->dbus_connection)
@@ -31,6 +31,12 @@ typedef struct dt_dbus_t
 
   // used for client actions on the bus
   GDBusConnection *dbus_connection;
+
+  // the jobs interface is served by its own thread, away from the gui main loop
+  GThread *jobs_thread;
+  GMainContext *jobs_context;
+  GMainLoop *jobs_loop;
+  guint jobs_registration_id;
 } dt_dbus_t;
 
 /** allocates and initializes dbus */
@@ -27,6 +27,8 @@
 #include <stdio.h>
 #include <inttypes.h>
 
+#include "common/trace.h"
+
 #ifdef _WIN32
 #include "win/dtwin.h"
 #endif // _WIN32
@@ -76,6 +78,7 @@ int dt_pthread_create(pthread_t *thread, void *(*start_routine)(void *), void *a
 
 void dt_pthread_setname(const char *name)
 {
+  dt_trace_thread_name(name);
 #if defined __linux__
   pthread_setname_np(pthread_self(), name);
 #elif defined __FreeBSD__ || defined __DragonFly__
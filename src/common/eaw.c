@@ -105,14 +105,18 @@ static inline __m128 weight_sse2(const __m128 *c1, const __m128 *c2, const float
   __m128 wgt = _mm_setzero_ps();
 #endif
 
+// with an accumulation buffer, the thresholded and boosted detail is added to it instead of being stored
 #define SUM_PIXEL_EPILOGUE                                                                                   \
-  for_each_channel(c)      										     \
-  {													     \
-    sum[c] /= wgt[c];                                                   				     \
+  for_each_channel(c)                                                                                        \
+  {                                                                                                          \
+    sum[c] /= wgt[c];                                                                                        \
     pcoarse[c] = sum[c];                                                                                     \
-    const float det = (px[c] - sum[c]);									     \
-    pdetail[c] = det;    		                                              			     \
-  }                                                                       				     \
+    const float det = (px[c] - sum[c]);                                                                      \
+    if(accum)                                                                                                \
+      pdetail[c] += boost[c] * (MAX(det - threshold[c], 0.0f) + MIN(det + threshold[c], 0.0f));              \
+    else                                                                                                     \
+      pdetail[c] = det;                                                                                      \
+  }                                                                                                          \
   px += 4;                                                                                                   \
   pdetail += 4;                                                                                              \
   pcoarse += 4;
@@ -128,8 +132,11 @@ static inline __m128 weight_sse2(const __m128 *c1, const __m128 *c2, const float
   pcoarse += 4;
 #endif
 
-void eaw_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
-                   const int scale, const float sharpen, const int32_t width, const int32_t height)
+// either stores the detail scale in detail, or synthesizes it right away into accum
+static inline void _eaw_decompose(float *const restrict out, const float *const restrict in,
+                                  float *const restrict detail, float *const restrict accum,
+                                  const float *const restrict threshold, const float *const restrict boost,
+                                  const int scale, const float sharpen, const int32_t width, const int32_t height)
 {
   const int mult = 1 << scale;
   static const float filter[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
@@ -137,7 +144,7 @@ void eaw_decompose(float *const restrict out, const float *const restrict in, fl
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(detail, filter, height, in, sharpen, mult, boundary, out, width) \
+  dt_omp_firstprivate(detail, accum, threshold, boost, filter, height, in, sharpen, mult, boundary, out, width) \
   schedule(static)
 #endif
   for(int rowid = 0; rowid < height; rowid++)
@@ -145,7 +152,7 @@ void eaw_decompose(float *const restrict out, const float *const restrict in, fl
     const size_t j = dwt_interleave_rows(rowid, height, mult);
     const float *px = ((float *)in) + (size_t)4 * j * width;
     const float *px2;
-    float *pdetail = detail + (size_t)4 * j * width;
+    float *pdetail = (accum ? accum : detail) + (size_t)4 * j * width;
     float *pcoarse = out + (size_t)4 * j * width;
 
     // for the first and last 'boundary' rows, we have to perform boundary tests for the entire row;
@@ -211,6 +218,22 @@ void eaw_decompose(float *const restrict out, const float *const restrict in, fl
   }
 }
 
+__DT_CLONE_TARGETS__
+void eaw_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
+                   const int scale, const float sharpen, const int32_t width, const int32_t height)
+{
+  _eaw_decompose(out, in, detail, NULL, NULL, NULL, scale, sharpen, width, height);
+}
+
+__DT_CLONE_TARGETS__
+void eaw_decompose_and_synthesize(float *const restrict out, const float *const restrict in,
+                                  float *const restrict accum, const float *const restrict threshold,
+                                  const float *const restrict boost, const int scale, const float sharpen,
+                                  const int32_t width, const int32_t height)
+{
+  _eaw_decompose(out, in, NULL, accum, threshold, boost, scale, sharpen, width, height);
+}
+
 #if defined(__SSE2__)
 void eaw_decompose_sse2(float *const restrict out, const float *const restrict in, float *const restrict detail,
                         const int scale, const float sharpen, const int32_t width, const int32_t height)
@@ -297,6 +320,7 @@ void eaw_decompose_sse2(float *const restrict out, const float *const restrict i
 }
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_synthesize(float *const out, const float *const in, const float *const restrict detail,
                     const float *const restrict threshold, const float *const restrict boost,
                     const int32_t width, const int32_t height)
@@ -460,6 +484,7 @@ static inline _aligned_pixel add_float4(_aligned_pixel acc, _aligned_pixel newva
   pcoarse += 4;
 #endif
 
+__DT_CLONE_TARGETS__
 void eaw_dn_decompose(float *const restrict out, const float *const restrict in, float *const restrict detail,
                       dt_aligned_pixel_t sum_squared, const int scale, const float inv_sigma2,
                       const int32_t width, const int32_t height)
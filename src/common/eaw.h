@@ -35,6 +35,12 @@ void eaw_synthesize(float *const restrict out, const float *const restrict in, c
                     const float *const restrict thrsf, const float *const restrict boostf,
                     const int32_t width, const int32_t height);
 
+// decompose one scale and add its thresholded and boosted detail to accum, without storing the detail
+void eaw_decompose_and_synthesize(float *const restrict out, const float *const restrict in,
+                                  float *const restrict accum, const float *const restrict threshold,
+                                  const float *const restrict boost, const int scale, const float sharpen,
+                                  const int32_t width, const int32_t height);
+
 void eaw_decompose_sse2(float *const restrict out, const float *const restrict in, float *const restrict detail,
                         const int scale, const float sharpen, const int32_t width, const int32_t height);
 void eaw_synthesize_sse2(float *const restrict out, const float *const restrict in, const float *const restrict detail,
@@ -318,12 +318,17 @@ static const char *_exif_get_exiv2_tag_type(const char *tagname)
 
 // exiv2's readMetadata is not thread safe in 0.26. so we lock it. since readMetadata might throw an exception we
 // wrap it into some c++ magic to make sure we unlock in all cases. well, actually not magic but basic raii.
-// FIXME: check again once we rely on 0.27
+// from 0.27 on images can be read concurrently, the lock would only serialize dt_exif_read_list().
 class Lock
 {
 public:
+#if EXIV2_TEST_VERSION(0,27,0)
+  Lock() {}
+  ~Lock() {}
+#else
   Lock() { dt_pthread_mutex_lock(&darktable.exiv2_threadsafe); }
   ~Lock() { dt_pthread_mutex_unlock(&darktable.exiv2_threadsafe); }
+#endif
 };
 
 #define read_metadata_threadsafe(image)                       \
@@ -1623,6 +1628,21 @@ int dt_exif_read(dt_image_t *img, const char *path)
   }
 }
 
+void dt_exif_read_list(dt_image_t *imgs, const char *const *paths, int *results, const int count)
+{
+  // exiv2 only reads the parts of a file holding metadata, so this is mostly waiting for the disk. keep enough
+  // requests in flight, one per thread.
+  const int threads = MAX(1, MIN(dt_get_num_threads(), count));
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(threads) default(none) \
+  dt_omp_firstprivate(imgs, paths, results, count)
+#endif
+  for(int k = 0; k < count; k++)
+    results[k] = paths[k] ? dt_exif_read(&imgs[k], paths[k]) : 1;
+
+  dt_print(DT_DEBUG_IMAGEIO, "[exif] read metadata of %d images on %d threads\n", count, threads);
+}
+
 int dt_exif_write_blob(uint8_t *blob, uint32_t size, const char *path, const int compressed)
 {
   try
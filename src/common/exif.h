@@ -63,6 +63,9 @@ const GList* dt_exif_get_exiv2_taglist();
 /** read metadata from file with full path name, XMP data trumps IPTC data trumps EXIF data, store to image
  * struct. returns 0 on success. */
 int dt_exif_read(dt_image_t *img, const char *path);
+/** dt_exif_read() for count images at once, spread over the worker threads. results[k] is its return value for
+ * imgs[k], a NULL path counts as failed. */
+void dt_exif_read_list(dt_image_t *imgs, const char *const *paths, int *results, const int count);
 
 /** read exif data to image struct from given data blob, wherever you got it from. */
 int dt_exif_read_from_blob(dt_image_t *img, uint8_t *blob, const int size);
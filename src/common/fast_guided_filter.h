@@ -168,6 +168,7 @@ __DT_CLONE_TARGETS__
 static inline void variance_analyse(const float *const restrict guide, // I
                                     const float *const restrict mask, //p
                                     float *const restrict ab,
+                                    float *const restrict input, // scratch of 4 floats per pixel
                                     const size_t width, const size_t height,
                                     const int radius, const float feathering)
 {
@@ -177,12 +178,10 @@ static inline void variance_analyse(const float *const restrict guide, // I
   // p, the mask is the quantised guide I
 
   const size_t Ndim = width * height;
-  const size_t Ndimch = Ndim * 4;
 
   /*
   * input is array of struct : { { guide , mask, guide * guide, guide * mask } }
   */
-  float *const restrict input = dt_alloc_align_float(Ndimch);
 
   // Pre-multiply guide and mask and pack all inputs into an array of 4×1 SIMD struct
 #ifdef _OPENMP
@@ -216,8 +215,6 @@ static inline void variance_analyse(const float *const restrict guide, // I
     ab[2*idx] = a;
     ab[2*idx+1] = b;
   }
-
-  if(input != NULL) dt_free_align(input);
 }
 
 
@@ -257,6 +254,60 @@ schedule(simd:static) aligned(image, ab:64)
 }
 
 
+__DT_CLONE_TARGETS__
+static inline void apply_upsampled_blending(float *const restrict image, const float *const restrict ds_ab,
+                                            const size_t width, const size_t height,
+                                            const size_t ds_width, const size_t ds_height,
+                                            const dt_iop_guided_filter_blending_t filter)
+{
+  // Upsample a and b like interpolate_bilinear() does, and blend the full-resolution image with them right
+  // away instead of going through a full-resolution buffer of a and b
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(image, ds_ab, width, height, ds_width, ds_height, filter) \
+  schedule(static)
+#endif
+  for(size_t i = 0; i < height; i++)
+  {
+    const float y_in = ((float)i / (float)height) * (float)ds_height;
+    size_t y_prev = (size_t)floorf(y_in);
+    size_t y_next = y_prev + 1;
+    y_prev = (y_prev < ds_height) ? y_prev : ds_height - 1;
+    y_next = (y_next < ds_height) ? y_next : ds_height - 1;
+    const float Dy_next = (float)y_next - y_in;
+    const float Dy_prev = 1.f - Dy_next;
+    const float *const row_prev = ds_ab + y_prev * ds_width * 2;
+    const float *const row_next = ds_ab + y_next * ds_width * 2;
+    float *const restrict row = image + i * width;
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t j = 0; j < width; j++)
+    {
+      const float x_in = ((float)j / (float)width) * (float)ds_width;
+      size_t x_prev = (size_t)floorf(x_in);
+      size_t x_next = x_prev + 1;
+      x_prev = (x_prev < ds_width) ? x_prev : ds_width - 1;
+      x_next = (x_next < ds_width) ? x_next : ds_width - 1;
+      const float Dx_next = (float)x_next - x_in;
+      const float Dx_prev = 1.f - Dx_next;
+
+      float ab[2];
+      for(size_t c = 0; c < 2; c++)
+      {
+        ab[c] = Dy_prev * (row_next[2 * x_prev + c] * Dx_next + row_next[2 * x_next + c] * Dx_prev) +
+                Dy_next * (row_prev[2 * x_prev + c] * Dx_next + row_prev[2 * x_next + c] * Dx_prev);
+      }
+
+      // Note : image is positive at the outside of the luminance mask
+      const float blended = fmaxf(row[j] * ab[0] + ab[1], MIN_FLOAT);
+      row[j] = (filter == DT_GF_BLENDING_GEOMEAN) ? sqrtf(row[j] * blended) : blended;
+    }
+  }
+}
+
+
 __DT_CLONE_TARGETS__
 static inline void quantize(const float *const restrict image,
                             float *const restrict out,
@@ -314,14 +365,14 @@ static inline void fast_surface_blur(float *const restrict image,
   const size_t ds_width = width / scaling;
 
   const size_t num_elem_ds = ds_width * ds_height;
-  const size_t num_elem = width * height;
 
   float *const restrict ds_image = dt_alloc_sse_ps(dt_round_size_sse(num_elem_ds));
   float *const restrict ds_mask = dt_alloc_sse_ps(dt_round_size_sse(num_elem_ds));
   float *const restrict ds_ab = dt_alloc_sse_ps(dt_round_size_sse(num_elem_ds * 2));
-  float *const restrict ab = dt_alloc_sse_ps(dt_round_size_sse(num_elem * 2));
+  // shared by the variance analyses of all iterations
+  float *const restrict ds_variance = dt_alloc_sse_ps(dt_round_size_sse(num_elem_ds * 4));
 
-  if(!ds_image || !ds_mask || !ds_ab || !ab)
+  if(!ds_image || !ds_mask || !ds_ab || !ds_variance)
   {
     dt_control_log(_("fast guided filter failed to allocate memory, check your RAM settings"));
     goto clean;
@@ -338,7 +389,7 @@ static inline void fast_surface_blur(float *const restrict image,
 
     // Perform the patch-wise variance analyse to get
     // the a and b parameters for the linear blending s.t. mask = a * I + b
-    variance_analyse(ds_mask, ds_image, ds_ab, ds_width, ds_height, ds_radius, feathering);
+    variance_analyse(ds_mask, ds_image, ds_ab, ds_variance, ds_width, ds_height, ds_radius, feathering);
 
     // Compute the patch-wise average of parameters a and b
     dt_box_mean(ds_ab, ds_height, ds_width, 2, ds_radius, 1);
@@ -350,17 +401,11 @@ static inline void fast_surface_blur(float *const restrict image,
     }
   }
 
-  // Upsample the blending parameters a and b
-  interpolate_bilinear(ds_ab, ds_width, ds_height, ab, width, height, 2);
-
-  // Finally, blend the guided image
-  if(filter == DT_GF_BLENDING_LINEAR)
-    apply_linear_blending(image, ab, num_elem);
-  else if(filter == DT_GF_BLENDING_GEOMEAN)
-    apply_linear_blending_w_geomean(image, ab, num_elem);
+  // Finally, upsample the blending parameters a and b and blend the guided image
+  apply_upsampled_blending(image, ds_ab, width, height, ds_width, ds_height, filter);
 
 clean:
-  if(ab) dt_free_align(ab);
+  if(ds_variance) dt_free_align(ds_variance);
   if(ds_ab) dt_free_align(ds_ab);
   if(ds_mask) dt_free_align(ds_mask);
   if(ds_image) dt_free_align(ds_image);
@@ -443,14 +443,17 @@ void dt_film_remove(const int id)
                               "SELECT id FROM main.images WHERE film_id = ?1", -1,
                               &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  GList *imgs = NULL;
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     const int32_t imgid = sqlite3_column_int(stmt, 0);
     dt_image_local_copy_reset(imgid);
-    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
     dt_image_cache_remove(darktable.image_cache, imgid);
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(imgid));
   }
   sqlite3_finalize(stmt);
+  dt_mipmap_cache_remove_list(darktable.mipmap_cache, imgs);
+  g_list_free(imgs);
 
   // due to foreign keys, all images with references to the film roll are deleted,
   // and likewise all entries with references to those images
@@ -0,0 +1,332 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2019-2021 darktable developers.
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/focus_peaking.h"
+#include "common/box_filters.h"
+#include "common/darktable.h"
+#include "common/fast_guided_filter.h"
+#include "develop/openmp_maths.h"
+#include "gui/gtk.h"
+
+// the sharpness maps of the last images drawn. culling and the preview draw the same few images again and
+// again (toggling, zooming, scrolling back), each map is one byte per pixel.
+#define DT_FOCUSPEAKING_CACHE_SIZE 8
+
+typedef enum dt_focuspeaking_class_t
+{
+  DT_FOCUSPEAKING_NONE = 0,
+  DT_FOCUSPEAKING_LOW = 1,    // little sharp, painted blue
+  DT_FOCUSPEAKING_MEDIUM = 2, // medium sharp, painted green
+  DT_FOCUSPEAKING_HIGH = 3    // very sharp, painted yellow
+} dt_focuspeaking_class_t;
+
+typedef struct dt_focuspeaking_entry_t
+{
+  uint64_t hash;
+  int width;
+  int height;
+  uint8_t *map;  // dt_focuspeaking_class_t per pixel
+  uint64_t used; // for the replacement of the least recently used entry
+} dt_focuspeaking_entry_t;
+
+static dt_focuspeaking_entry_t _cache[DT_FOCUSPEAKING_CACHE_SIZE];
+static uint64_t _cache_clock = 0;
+static GMutex _cache_lock;
+
+// luma is computed from 8 bits channels, so the powers are tabulated
+static float _luma_lut[256];
+static gsize _luma_lut_ready = 0;
+
+#ifdef _OPENMP
+#pragma omp declare simd aligned(image, index:64) uniform(image)
+#endif
+static inline float laplacian(const float *const image, const size_t index[8])
+{
+  // Compute the magnitude of the gradient over the principal directions,
+  // then again over the diagonal directions, and average both.
+  const float l1 = dt_fast_hypotf(image[index[4]] - image[index[3]], image[index[6]] - image[index[1]]);
+  const float l2 = dt_fast_hypotf(image[index[7]] - image[index[0]], image[index[5]] - image[index[2]]);
+  //const float div = fabsf(image[index[3]] + image[index[4]] + image[index[1]] + image[index[6]] - 4.0f * image[index[3] + 1]) + 1.0f;
+
+  // we assume the gradients follow an hyper-laplacian distributions in natural images,
+  // which is baked by some examples the literature, but is still very hacky
+  // https://www.sciencedirect.com/science/article/pii/S0165168415004168
+  // http://citeseerx.ist.psu.edu/viewdoc/download?doi=10.1.1.154.539&rep=rep1&type=pdf
+  return (l1 + l2) / 2.0f;
+}
+
+#ifdef _OPENMP
+#pragma omp declare simd
+#endif
+static inline void get_indices(const size_t i, const size_t j, const size_t width, const size_t height, const size_t delta, size_t index[8])
+{
+  const size_t upper_line = (i - delta) * width;
+  const size_t center_line = i * width;
+  const size_t lower_line = (i + delta) * width;
+  const size_t left_row = j - delta;
+  const size_t right_row = j + delta;
+
+  index[0] = upper_line + left_row;       // north west
+  index[1] = upper_line + j;              // north
+  index[2] = upper_line + right_row;      // north east
+  index[3] = center_line + left_row;      // west
+  index[4] = center_line + right_row;     // east
+  index[5] = lower_line + left_row;       // south west
+  index[6] = lower_line + j;              // south
+  index[7] = lower_line + right_row;      // south east
+}
+
+static uint64_t _image_hash(const uint8_t *const image, const size_t size)
+{
+  // 64 bits at a time, a full pass over the buffer is much cheaper than the map itself
+  uint64_t hash = 14695981039346656037ull;
+  const size_t words = size / sizeof(uint64_t);
+  for(size_t k = 0; k < words; k++)
+  {
+    uint64_t w;
+    memcpy(&w, image + k * sizeof(uint64_t), sizeof(uint64_t));
+    hash = (hash ^ w) * 1099511628211ull;
+  }
+  for(size_t k = words * sizeof(uint64_t); k < size; k++) hash = (hash ^ image[k]) * 1099511628211ull;
+  return hash;
+}
+
+static void _compute_map(const uint8_t *const restrict image, uint8_t *const restrict map,
+                         const int buf_width, const int buf_height)
+{
+  if(g_once_init_enter(&_luma_lut_ready))
+  {
+    // remove gamma 2.2 and take the square is equivalent to this:
+    const float exponent = 2.0f * 2.2f;
+    for(int k = 0; k < 256; k++) _luma_lut[k] = powf(k / 255.0f, exponent);
+    g_once_init_leave(&_luma_lut_ready, 1);
+  }
+  const float *const restrict lut = _luma_lut;
+
+  float *const restrict luma = dt_alloc_align_float((size_t)buf_width * buf_height);
+
+  const size_t npixels = (size_t)buf_height * buf_width;
+  // Create a luma buffer as the euclidian norm of RGB channels
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none)             \
+  dt_omp_firstprivate(image, luma, npixels, lut)        \
+  schedule(static) aligned(image, luma:64)
+#endif
+  for(size_t index = 0; index < npixels; index++)
+  {
+    const size_t index_RGB = index * 4;
+    luma[index] = sqrtf(lut[image[index_RGB]] + lut[image[index_RGB + 1]] + lut[image[index_RGB + 2]]);
+  }
+
+  // Prefilter noise
+  fast_surface_blur(luma, buf_width, buf_height, 12, 0.00001f, 4, DT_GF_BLENDING_LINEAR, 1, 0.0f, exp2f(-8.0f), 1.0f);
+
+  // Compute the gradients magnitudes
+  float *const restrict luma_ds =  dt_alloc_align_float((size_t)buf_width * buf_height);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+dt_omp_firstprivate(luma, luma_ds, buf_height, buf_width) \
+schedule(static) collapse(2)
+#endif
+  for(size_t i = 0; i < buf_height; ++i)
+    for(size_t j = 0; j < buf_width; ++j)
+    {
+      size_t index = i * buf_width + j;
+      if (i < 2 || i >= buf_height - 2 || j < 2 || j > buf_width -2)
+        // ensure defined value for borders
+        luma_ds[index] = 0.0f;
+      else
+      {
+        size_t DT_ALIGNED_ARRAY index_close[8];
+        get_indices(i, j, buf_width, buf_height, 1, index_close);
+
+        size_t DT_ALIGNED_ARRAY index_far[8];
+        get_indices(i, j, buf_width, buf_height, 2, index_far);
+
+        // Computing the gradient on the closest neighbours gives us the rate of variation, but doesn't say if we are
+        // looking at local contrast or optical sharpness.
+        // so we compute again the gradient on neighbours a bit further.
+        // if both gradients have the same magnitude, it means we have no sharpness but just a big step in intensity,
+        // aka local contrast. If the closest is higher than the farthest, is means we have indeed a sharp something,
+        // either noise or edge. To mitigate that, we just subtract half the farthest gradient but add a noise threshold
+        luma_ds[index] = laplacian(luma, index_close) - 0.67f * (laplacian(luma, index_far) - 0.00390625f);
+      }
+    }
+
+  // Anti-aliasing
+  dt_box_mean(luma_ds, buf_height, buf_width, 1, 2, 1);
+
+  // Compute the gradient mean over the picture
+  float TV_sum = 0.0f;
+
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+dt_omp_firstprivate(luma_ds, buf_height, buf_width) \
+schedule(static) collapse(2) aligned(luma_ds:64) reduction(+:TV_sum)
+#endif
+  for(size_t i = 2; i < buf_height - 2; ++i)
+    for(size_t j = 2; j < buf_width - 2; ++j)
+      TV_sum += luma_ds[i * buf_width + j];
+
+  TV_sum /= (float)(buf_height - 4) * (float)(buf_width - 4);
+
+  // Compute the predicator of the hyper-laplacian distribution
+  // (similar to the standard deviation if we had a gaussian distribution)
+  float sigma = 0.0f;
+
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+dt_omp_firstprivate(luma_ds, buf_height, buf_width, TV_sum) \
+schedule(static) collapse(2) aligned(luma_ds:64) reduction(+:sigma)
+#endif
+  for(size_t i = 2; i < buf_height - 2; ++i)
+    for(size_t j = 2; j < buf_width - 2; ++j)
+       sigma += fabsf(luma_ds[i * buf_width + j] - TV_sum);
+
+  sigma /= (float)(buf_height - 4) * (float)(buf_width - 4);
+
+  // Set the sharpness thresholds
+  const float six_sigma = TV_sum + 10.0f * sigma;
+  const float four_sigma = TV_sum + 5.0f * sigma;
+  const float two_sigma = TV_sum + 2.5f * sigma;
+
+  // Postfilter to connect isolated dots and draw lines
+  fast_surface_blur(luma_ds, buf_width, buf_height, 12, 0.00001f, 4, DT_GF_BLENDING_LINEAR, 1, 0.0f, exp2f(-8.0f), 1.0f);
+
+  // Classify the sharpness
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(map, luma_ds, npixels, six_sigma, four_sigma, two_sigma) \
+  schedule(static) aligned(luma_ds:64)
+#endif
+  for(size_t index = 0; index < npixels; index++)
+  {
+    const float TV = luma_ds[index];
+    map[index] = (TV > six_sigma) ? DT_FOCUSPEAKING_HIGH
+               : (TV > four_sigma) ? DT_FOCUSPEAKING_MEDIUM
+               : (TV > two_sigma) ? DT_FOCUSPEAKING_LOW
+               : DT_FOCUSPEAKING_NONE;
+  }
+
+  dt_free_align(luma);
+  dt_free_align(luma_ds);
+}
+
+// copy the map of the image into map, computing it if it isn't cached
+static void _get_map(const uint8_t *const restrict image, uint8_t *const restrict map,
+                     const int buf_width, const int buf_height)
+{
+  const size_t npixels = (size_t)buf_height * buf_width;
+  const uint64_t hash = _image_hash(image, npixels * 4);
+
+  g_mutex_lock(&_cache_lock);
+  for(int k = 0; k < DT_FOCUSPEAKING_CACHE_SIZE; k++)
+  {
+    dt_focuspeaking_entry_t *e = _cache + k;
+    if(e->map && e->hash == hash && e->width == buf_width && e->height == buf_height)
+    {
+      memcpy(map, e->map, npixels);
+      e->used = ++_cache_clock;
+      g_mutex_unlock(&_cache_lock);
+      return;
+    }
+  }
+  g_mutex_unlock(&_cache_lock);
+
+  // computed outside of the lock, a concurrent caller for the same image just computes it too
+  _compute_map(image, map, buf_width, buf_height);
+
+  uint8_t *copy = dt_alloc_align(64, npixels);
+  if(!copy) return;
+  memcpy(copy, map, npixels);
+
+  g_mutex_lock(&_cache_lock);
+  dt_focuspeaking_entry_t *slot = _cache;
+  for(int k = 1; k < DT_FOCUSPEAKING_CACHE_SIZE; k++)
+    if(_cache[k].used < slot->used) slot = _cache + k;
+  dt_free_align(slot->map);
+  slot->map = copy;
+  slot->hash = hash;
+  slot->width = buf_width;
+  slot->height = buf_height;
+  slot->used = ++_cache_clock;
+  g_mutex_unlock(&_cache_lock);
+}
+
+void dt_focuspeaking(cairo_t *cr, int width, int height, uint8_t *const restrict image, const int buf_width,
+                     const int buf_height)
+{
+  const size_t npixels = (size_t)buf_height * buf_width;
+  uint8_t *const restrict map = dt_alloc_align(64, npixels);
+  uint8_t *const restrict focus_peaking = dt_alloc_align(64, sizeof(uint8_t) * npixels * 4);
+  if(!map || !focus_peaking)
+  {
+    dt_free_align(map);
+    dt_free_align(focus_peaking);
+    return;
+  }
+
+  _get_map(image, map, buf_width, buf_height);
+
+  // Prepare the focus-peaking image overlay
+  const uint8_t colors[4][4] DT_ALIGNED_ARRAY = {
+    { 0, 0, 0, 0 },           // not sharp enough : paint 0
+    { 255, 0, 0, 255 },       // little sharp : paint blue, BGR = (255, 0, 0)
+    { 0, 255, 0, 255 },       // medium sharp : paint green, BGR = (0, 255, 0)
+    { 0/*B*/, 255/*G*/, 255/*R*/, 255/*alpha*/ } // very sharp : paint yellow, BGR = (0, 255, 255)
+  };
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(focus_peaking, map, npixels, colors) \
+  schedule(static)
+#endif
+  for(size_t index = 0; index < npixels; index++)
+    memcpy(focus_peaking + index * 4, colors[map[index]], 4);
+
+  // draw the focus peaking overlay
+  cairo_save(cr);
+  cairo_rectangle(cr, 0, 0, buf_width, buf_height);
+  cairo_surface_t *surface = cairo_image_surface_create_for_data((unsigned char *)focus_peaking,
+                                                                 CAIRO_FORMAT_ARGB32,
+                                                                 buf_width, buf_height,
+                                                                 cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, buf_width));
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+  cairo_set_source_surface(cr, surface, 0.0, 0.0);
+  cairo_pattern_set_filter(cairo_get_source (cr), darktable.gui->filter_image);
+  cairo_fill(cr);
+  cairo_restore(cr);
+
+  // cleanup
+  cairo_surface_destroy(surface);
+  dt_free_align(map);
+  dt_free_align(focus_peaking);
+}
+
+void dt_focuspeaking_cleanup(void)
+{
+  g_mutex_lock(&_cache_lock);
+  for(int k = 0; k < DT_FOCUSPEAKING_CACHE_SIZE; k++)
+  {
+    dt_free_align(_cache[k].map);
+    _cache[k].map = NULL;
+  }
+  g_mutex_unlock(&_cache_lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
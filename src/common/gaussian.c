@@ -19,14 +19,12 @@
 
 #include <assert.h>
 #include <math.h>
-#if defined(__SSE__)
-#include <xmmintrin.h>
-#endif
 #include "common/gaussian.h"
 #include "common/math.h"
 #include "common/opencl.h"
 
 #define BLOCKSIZE (1 << 6)
+#define GAUSS_STRIP 8 // columns blurred together in the vertical pass
 
 static void compute_gauss_params(const float sigma, dt_gaussian_order_t order, float *a0, float *a1,
                                  float *a2, float *a3, float *b1, float *b2, float *coefp, float *coefn)
@@ -139,7 +137,8 @@ dt_gaussian_t *dt_gaussian_init(const int width,    // width of input image
     g->min[k] = min[k];
   }
 
-  g->buf = dt_alloc_align_float((size_t)channels * width * height);
+  // per-thread scratch for one strip of columns or one row
+  g->buf = dt_alloc_perthread_float((size_t)channels * MAX((size_t)height * GAUSS_STRIP, width), &g->bufsize);
   if(!g->buf) goto error;
 
   return g;
@@ -153,345 +152,185 @@ error:
 }
 
 
-void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
+// vertical blur of a strip of GAUSS_STRIP columns, whose n values are next to each other in each row. the
+// forward pass goes to temp, the backward pass adds it and writes out row by row. as the input of a row is
+// read before its output is written, in and out may be the same.
+__DT_CLONE_TARGETS__
+static void blur_strip_vertical(const float *const in, float *const out, float *const restrict temp,
+                                const int width, const int height, const int ch, const int n,
+                                const float *const min, const float *const max, const float a0,
+                                const float a1, const float a2, const float a3, const float b1,
+                                const float b2, const float coefp, const float coefn)
 {
+  const size_t stride = (size_t)width * ch;
+  float xp[4 * GAUSS_STRIP], yb[4 * GAUSS_STRIP], yp[4 * GAUSS_STRIP];
 
-  const int width = g->width;
-  const int height = g->height;
-  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
-
-  float a0, a1, a2, a3, b1, b2, coefp, coefn;
-
-  compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
-
-  float *temp = g->buf;
-
-  float *Labmax = g->max;
-  float *Labmin = g->min;
-
-// vertical blur column by column
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, width, height, ch) \
-  shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn) \
-  schedule(static)
-#endif
-  for(int i = 0; i < width; i++)
+  // forward filter
+  for(int c = 0; c < 4 * GAUSS_STRIP; c++)
   {
-    dt_aligned_pixel_t xp = {0.0f};
-    dt_aligned_pixel_t yb = {0.0f};
-    dt_aligned_pixel_t yp = {0.0f};
-
-    // forward filter
-    for(int k = 0; k < ch; k++)
-    {
-      xp[k] = CLAMPF(in[(size_t)i * ch + k], Labmin[k], Labmax[k]);
-      yb[k] = xp[k] * coefp;
-      yp[k] = yb[k];
-    }
-
-    dt_aligned_pixel_t xc = {0.0f};
-    dt_aligned_pixel_t yc = {0.0f};
-    dt_aligned_pixel_t xn = {0.0f};
-    dt_aligned_pixel_t xa = {0.0f};
-    dt_aligned_pixel_t yn = {0.0f};
-    dt_aligned_pixel_t ya = {0.0f};
-    for(int j = 0; j < height; j++)
+    xp[c] = c < n ? CLAMPF(in[c], min[c], max[c]) : 0.0f;
+    yb[c] = xp[c] * coefp;
+    yp[c] = yb[c];
+  }
+  for(int j = 0; j < height; j++)
+  {
+    const float *const row = in + (size_t)j * stride;
+    float *const t = temp + (size_t)j * n;
+    for(int c = 0; c < n; c++)
     {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
-
-        temp[offset + k] = yc[k];
-
-        xp[k] = xc[k];
-        yb[k] = yp[k];
-        yp[k] = yc[k];
-      }
+      const float xc = CLAMPF(row[c], min[c], max[c]);
+      const float yc = (a0 * xc) + (a1 * xp[c]) - (b1 * yp[c]) - (b2 * yb[c]);
+      t[c] = yc;
+      xp[c] = xc;
+      yb[c] = yp[c];
+      yp[c] = yc;
     }
+  }
 
-    // backward filter
-    for(int k = 0; k < ch; k++)
+  // backward filter
+  float xn[4 * GAUSS_STRIP], xa[4 * GAUSS_STRIP], yn[4 * GAUSS_STRIP], ya[4 * GAUSS_STRIP];
+  for(int c = 0; c < 4 * GAUSS_STRIP; c++)
+  {
+    xn[c] = c < n ? CLAMPF(in[(size_t)(height - 1) * stride + c], min[c], max[c]) : 0.0f;
+    xa[c] = xn[c];
+    yn[c] = xn[c] * coefn;
+    ya[c] = yn[c];
+  }
+  for(int j = height - 1; j > -1; j--)
+  {
+    const float *const row = in + (size_t)j * stride;
+    float *const orow = out + (size_t)j * stride;
+    const float *const t = temp + (size_t)j * n;
+    for(int c = 0; c < n; c++)
     {
-      xn[k] = CLAMPF(in[((size_t)(height - 1) * width + i) * ch + k], Labmin[k], Labmax[k]);
-      xa[k] = xn[k];
-      yn[k] = xn[k] * coefn;
-      ya[k] = yn[k];
+      const float xc = CLAMPF(row[c], min[c], max[c]);
+      const float yc = (a2 * xn[c]) + (a3 * xa[c]) - (b1 * yn[c]) - (b2 * ya[c]);
+      xa[c] = xn[c];
+      xn[c] = xc;
+      ya[c] = yn[c];
+      yn[c] = yc;
+      orow[c] = t[c] + yc;
     }
+  }
+}
 
-    for(int j = height - 1; j > -1; j--)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(in[offset + k], Labmin[k], Labmax[k]);
-
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
-
-        xa[k] = xn[k];
-        xn[k] = xc[k];
-        ya[k] = yn[k];
-        yn[k] = yc[k];
+// horizontal blur of a row in place, the forward pass goes to temp
+__DT_CLONE_TARGETS__
+static void blur_row_horizontal(float *const row, float *const restrict temp, const int width, const int ch,
+                                const float *const min, const float *const max, const float a0,
+                                const float a1, const float a2, const float a3, const float b1,
+                                const float b2, const float coefp, const float coefn)
+{
+  dt_aligned_pixel_t xp = { 0.0f };
+  dt_aligned_pixel_t yb = { 0.0f };
+  dt_aligned_pixel_t yp = { 0.0f };
 
-        temp[offset + k] += yc[k];
-      }
-    }
+  // forward filter
+  for(int k = 0; k < ch; k++)
+  {
+    xp[k] = CLAMPF(row[k], min[k], max[k]);
+    yb[k] = xp[k] * coefp;
+    yp[k] = yb[k];
   }
-
-// horizontal blur line by line
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(out, ch, width, height) \
-  shared(temp, Labmin, Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn) \
-  schedule(static)
-#endif
-  for(int j = 0; j < height; j++)
+  for(int i = 0; i < width; i++)
   {
-    dt_aligned_pixel_t xp = {0.0f};
-    dt_aligned_pixel_t yb = {0.0f};
-    dt_aligned_pixel_t yp = {0.0f};
-
-    // forward filter
+    const size_t offset = (size_t)i * ch;
     for(int k = 0; k < ch; k++)
     {
-      xp[k] = CLAMPF(temp[(size_t)j * width * ch + k], Labmin[k], Labmax[k]);
-      yb[k] = xp[k] * coefp;
-      yp[k] = yb[k];
-    }
-
-    dt_aligned_pixel_t xc = {0.0f};
-    dt_aligned_pixel_t yc = {0.0f};
-    dt_aligned_pixel_t xn = {0.0f};
-    dt_aligned_pixel_t xa = {0.0f};
-    dt_aligned_pixel_t yn = {0.0f};
-    dt_aligned_pixel_t ya = {0.0f};
-
-    for(int i = 0; i < width; i++)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(temp[offset + k], Labmin[k], Labmax[k]);
-        yc[k] = (a0 * xc[k]) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
-
-        out[offset + k] = yc[k];
-
-        xp[k] = xc[k];
-        yb[k] = yp[k];
-        yp[k] = yc[k];
-      }
+      const float xc = CLAMPF(row[offset + k], min[k], max[k]);
+      const float yc = (a0 * xc) + (a1 * xp[k]) - (b1 * yp[k]) - (b2 * yb[k]);
+      temp[offset + k] = yc;
+      xp[k] = xc;
+      yb[k] = yp[k];
+      yp[k] = yc;
     }
+  }
 
-    // backward filter
+  // backward filter
+  dt_aligned_pixel_t xn = { 0.0f };
+  dt_aligned_pixel_t xa = { 0.0f };
+  dt_aligned_pixel_t yn = { 0.0f };
+  dt_aligned_pixel_t ya = { 0.0f };
+  for(int k = 0; k < ch; k++)
+  {
+    xn[k] = CLAMPF(row[(size_t)(width - 1) * ch + k], min[k], max[k]);
+    xa[k] = xn[k];
+    yn[k] = xn[k] * coefn;
+    ya[k] = yn[k];
+  }
+  for(int i = width - 1; i > -1; i--)
+  {
+    const size_t offset = (size_t)i * ch;
     for(int k = 0; k < ch; k++)
     {
-      xn[k] = CLAMPF(temp[((size_t)(j + 1) * width - 1) * ch + k], Labmin[k], Labmax[k]);
+      const float xc = CLAMPF(row[offset + k], min[k], max[k]);
+      const float yc = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
       xa[k] = xn[k];
-      yn[k] = xn[k] * coefn;
+      xn[k] = xc;
       ya[k] = yn[k];
-    }
-
-    for(int i = width - 1; i > -1; i--)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      for(int k = 0; k < ch; k++)
-      {
-        xc[k] = CLAMPF(temp[offset + k], Labmin[k], Labmax[k]);
-
-        yc[k] = (a2 * xn[k]) + (a3 * xa[k]) - (b1 * yn[k]) - (b2 * ya[k]);
-
-        xa[k] = xn[k];
-        xn[k] = xc[k];
-        ya[k] = yn[k];
-        yn[k] = yc[k];
-
-        out[offset + k] += yc[k];
-      }
+      yn[k] = yc;
+      row[offset + k] = temp[offset + k] + yc;
     }
   }
 }
 
-
-
-#if defined(__SSE__)
-static void dt_gaussian_blur_4c_sse(dt_gaussian_t *g, const float *const in, float *const out)
+void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
 {
-
   const int width = g->width;
   const int height = g->height;
-  const int ch = 4;
-
-  assert(g->channels == 4);
+  const int ch = MIN(4, g->channels); // just to appease zealous compiler warnings about stack usage
 
   float a0, a1, a2, a3, b1, b2, coefp, coefn;
 
   compute_gauss_params(g->sigma, g->order, &a0, &a1, &a2, &a3, &b1, &b2, &coefp, &coefn);
 
-  const __m128 Labmax = _mm_set_ps(g->max[3], g->max[2], g->max[1], g->max[0]);
-  const __m128 Labmin = _mm_set_ps(g->min[3], g->min[2], g->min[1], g->min[0]);
-
-  float *temp = g->buf;
+  float *const buf = g->buf;
+  const size_t bufsize = g->bufsize;
 
+  // clamping bounds for the values of a strip
+  float Labmin[4 * GAUSS_STRIP], Labmax[4 * GAUSS_STRIP];
+  for(int c = 0; c < ch * GAUSS_STRIP; c++)
+  {
+    Labmin[c] = g->min[c % ch];
+    Labmax[c] = g->max[c % ch];
+  }
 
-// vertical blur column by column
+  // vertical blur, a strip of adjacent columns at a time so that rows are read contiguously
+  const int strips = (width + GAUSS_STRIP - 1) / GAUSS_STRIP;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, Labmin, Labmax, width, height, ch) \
-  shared(temp, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  dt_omp_firstprivate(in, out, width, height, ch, buf, bufsize, strips, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  shared(Labmin, Labmax) \
   schedule(static)
 #endif
-  for(int i = 0; i < width; i++)
+  for(int s = 0; s < strips; s++)
   {
-    __m128 xp = _mm_setzero_ps();
-    __m128 yb = _mm_setzero_ps();
-    __m128 yp = _mm_setzero_ps();
-    __m128 xc = _mm_setzero_ps();
-    __m128 yc = _mm_setzero_ps();
-    __m128 xn = _mm_setzero_ps();
-    __m128 xa = _mm_setzero_ps();
-    __m128 yn = _mm_setzero_ps();
-    __m128 ya = _mm_setzero_ps();
-
-    // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(in + i * ch), Labmin, Labmax);
-    yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
-    yp = yb;
-
-
-    for(int j = 0; j < height; j++)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
-
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xc, _mm_set_ps1(a0)),
-          _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
-                     _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
-
-      _mm_store_ps(temp + offset, yc);
-
-      xp = xc;
-      yb = yp;
-      yp = yc;
-    }
-
-    // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(in + ((size_t)(height - 1) * width + i) * ch), Labmin, Labmax);
-    xa = xn;
-    yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
-    ya = yn;
-
-    for(int j = height - 1; j > -1; j--)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(in + offset), Labmin, Labmax);
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xn, _mm_set_ps1(a2)),
-          _mm_sub_ps(_mm_mul_ps(xa, _mm_set_ps1(a3)),
-                     _mm_add_ps(_mm_mul_ps(yn, _mm_set_ps1(b1)), _mm_mul_ps(ya, _mm_set_ps1(b2)))));
-
-
-      xa = xn;
-      xn = xc;
-      ya = yn;
-      yn = yc;
-
-      _mm_store_ps(temp + offset, _mm_add_ps(_mm_load_ps(temp + offset), yc));
-    }
+    const int x0 = s * GAUSS_STRIP;
+    const int n = MIN(GAUSS_STRIP, width - x0) * ch;
+    float *const temp = dt_get_perthread(buf, bufsize);
+    blur_strip_vertical(in + (size_t)x0 * ch, out + (size_t)x0 * ch, temp, width, height, ch, n, Labmin,
+                        Labmax, a0, a1, a2, a3, b1, b2, coefp, coefn);
   }
 
-// horizontal blur line by line
+  // horizontal blur line by line
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(out, Labmin, Labmax, width, height, ch) \
-  shared(temp, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  dt_omp_firstprivate(out, width, height, ch, buf, bufsize, a0, a1, a2, a3, b1, b2, coefp, coefn) \
+  shared(Labmin, Labmax) \
   schedule(static)
 #endif
-  for(size_t j = 0; j < height; j++)
+  for(int j = 0; j < height; j++)
   {
-    __m128 xp = _mm_setzero_ps();
-    __m128 yb = _mm_setzero_ps();
-    __m128 yp = _mm_setzero_ps();
-    __m128 xc = _mm_setzero_ps();
-    __m128 yc = _mm_setzero_ps();
-    __m128 xn = _mm_setzero_ps();
-    __m128 xa = _mm_setzero_ps();
-    __m128 yn = _mm_setzero_ps();
-    __m128 ya = _mm_setzero_ps();
-
-    // forward filter
-    xp = MMCLAMPPS(_mm_load_ps(temp + j * width * ch), Labmin, Labmax);
-    yb = _mm_mul_ps(_mm_set_ps1(coefp), xp);
-    yp = yb;
-
-
-    for(int i = 0; i < width; i++)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(temp + offset), Labmin, Labmax);
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xc, _mm_set_ps1(a0)),
-          _mm_sub_ps(_mm_mul_ps(xp, _mm_set_ps1(a1)),
-                     _mm_add_ps(_mm_mul_ps(yp, _mm_set_ps1(b1)), _mm_mul_ps(yb, _mm_set_ps1(b2)))));
-
-      _mm_store_ps(out + offset, yc);
-
-      xp = xc;
-      yb = yp;
-      yp = yc;
-    }
-
-    // backward filter
-    xn = MMCLAMPPS(_mm_load_ps(temp + ((size_t)(j + 1) * width - 1) * ch), Labmin, Labmax);
-    xa = xn;
-    yn = _mm_mul_ps(_mm_set_ps1(coefn), xn);
-    ya = yn;
-
-
-    for(int i = width - 1; i > -1; i--)
-    {
-      size_t offset = ((size_t)j * width + i) * ch;
-
-      xc = MMCLAMPPS(_mm_load_ps(temp + offset), Labmin, Labmax);
-
-      yc = _mm_add_ps(
-          _mm_mul_ps(xn, _mm_set_ps1(a2)),
-          _mm_sub_ps(_mm_mul_ps(xa, _mm_set_ps1(a3)),
-                     _mm_add_ps(_mm_mul_ps(yn, _mm_set_ps1(b1)), _mm_mul_ps(ya, _mm_set_ps1(b2)))));
-
-
-      xa = xn;
-      xn = xc;
-      ya = yn;
-      yn = yc;
-
-      _mm_store_ps(out + offset, _mm_add_ps(_mm_load_ps(out + offset), yc));
-    }
+    float *const temp = dt_get_perthread(buf, bufsize);
+    blur_row_horizontal(out + (size_t)j * width * ch, temp, width, ch, Labmin, Labmax, a0, a1, a2, a3, b1, b2,
+                        coefp, coefn);
   }
 }
-#endif
 
 void dt_gaussian_blur_4c(dt_gaussian_t *g, const float *const in, float *const out)
 {
-  if(darktable.codepath.OPENMP_SIMD) return dt_gaussian_blur(g, in, out);
-#if defined(__SSE__)
-  else if(darktable.codepath.SSE2)
-    return dt_gaussian_blur_4c_sse(g, in, out);
-#endif
-  else
-    dt_unreachable_codepath();
+  assert(g->channels == 4);
+  dt_gaussian_blur(g, in, out);
 }
 
 void dt_gaussian_free(dt_gaussian_t *g)
@@ -38,6 +38,7 @@ typedef struct dt_gaussian_t
   float *max;
   float *min;
   float *buf;
+  size_t bufsize; // floats per thread in buf
 } dt_gaussian_t;
 
 dt_gaussian_t *dt_gaussian_init(const int width, const int height, const int channels, const float *max,
@@ -70,19 +70,6 @@ typedef struct color_image
   int width, height, stride;
 } color_image;
 
-// allocate space for n-component image of size width x height
-static inline color_image new_color_image(int width, int height, int ch)
-{
-  return (color_image){ dt_alloc_align_float((size_t)width * height * ch), width, height, ch };
-}
-
-// free space for n-component image
-static inline void free_color_image(color_image *img_p)
-{
-  dt_free_align(img_p->data);
-  img_p->data = NULL;
-}
-
 // get a pointer to pixel number 'i' within the image
 static inline float *get_color_pixel(color_image img, size_t i)
 {
@@ -98,8 +85,12 @@ static inline float *get_color_pixel(color_image img, size_t i)
 //    6 variance (R-R, R-G, R-B, G-G, G-B, B-B)
 // for computational efficiency, we'll pack them into a four-channel image and a 9-channel image
 // image instead of running 13 separate box filters: guide+input, R/G/B/R-R/R-G/R-B/G-G/G-B/B-B.
+// mean_buf and variance_buf hold the 4 and 9 channels of the largest tile, scratch 9 floats per pixel of a
+// tile row for each thread
 static void guided_filter_tiling(color_image imgg, gray_image img, gray_image img_out, tile target, const int w,
-                                 const float eps, const float guide_weight, const float min, const float max)
+                                 const float eps, const float guide_weight, const float min, const float max,
+                                 float *const mean_buf, float *const variance_buf, float *const img_bak,
+                                 const size_t img_bak_sz)
 {
   const tile source = { max_i(target.left - 2 * w, 0), min_i(target.right + 2 * w, imgg.width),
                         max_i(target.lower - 2 * w, 0), min_i(target.upper + 2 * w, imgg.height) };
@@ -121,14 +112,11 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
 #define VAR_GG 6
 #define VAR_BB 8
 #define VAR_GB 7
-  color_image mean = new_color_image(width, height, 4);
-  color_image variance = new_color_image(width, height, 9);
-  const size_t img_dimen = mean.width;
-  size_t img_bak_sz;
-  float *img_bak = dt_alloc_perthread_float(9*img_dimen, &img_bak_sz);
+  color_image mean = (color_image){ mean_buf, width, height, 4 };
+  color_image variance = (color_image){ variance_buf, width, height, 9 };
 #ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) shared(img, imgg, mean, variance, img_bak) \
-  dt_omp_firstprivate(img_bak_sz, img_dimen, w, guide_weight) dt_omp_sharedconst(source)
+#pragma omp parallel for schedule(static) default(none) shared(img, imgg, mean, variance) \
+  dt_omp_firstprivate(img_bak, img_bak_sz, w, guide_weight) dt_omp_sharedconst(source)
 #endif
   for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
   {
@@ -161,7 +149,6 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
     dt_box_mean_horizontal(meanpx, mean.width, 4|BOXFILTER_KAHAN_SUM, w, scratch);
     dt_box_mean_horizontal(varpx, variance.width, 9|BOXFILTER_KAHAN_SUM, w, scratch);
   }
-  dt_free_align(img_bak);
   dt_box_mean_vertical(mean.data, mean.height, mean.width, 4|BOXFILTER_KAHAN_SUM, w);
   dt_box_mean_vertical(variance.data, variance.height, variance.width, 9|BOXFILTER_KAHAN_SUM, w);
   // we will recycle memory of 'mean' for the new coefficient arrays a_? and b to reduce memory foot print
@@ -227,7 +214,6 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
     a_b.data[4*i+A_BLUE] = a_b_;
     a_b.data[4*i+B] = b_;
   }
-  free_color_image(&variance);
 
   dt_box_mean(a_b.data, a_b.height, a_b.width, a_b.stride|BOXFILTER_KAHAN_SUM, w, 1);
 
@@ -252,7 +238,6 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
       img_out.data[i_imgg + (size_t)j_imgg * imgg.width] = CLAMP(res, min, max);
     }
   }
-  free_color_image(&mean);
 }
 
 static int compute_tile_height(const int height, const int w)
@@ -322,14 +307,33 @@ void guided_filter(const float *const guide, const float *const in, float *const
   const int tile_height = compute_tile_height(height,w);
   const float eps = sqrt_eps * sqrt_eps; // this is the regularization parameter of the original papers
 
+  // the buffers of the largest tile, including its borders, are shared by all tiles
+  const size_t max_width = min_i(tile_width + 4 * w, width);
+  const size_t max_height = min_i(tile_height + 4 * w, height);
+  float *const mean_buf = dt_alloc_align_float(max_width * max_height * 4);
+  float *const variance_buf = dt_alloc_align_float(max_width * max_height * 9);
+  size_t img_bak_sz;
+  float *const img_bak = dt_alloc_perthread_float(9 * max_width, &img_bak_sz);
+  if(!mean_buf || !variance_buf || !img_bak)
+  {
+    fprintf(stderr, "[guided_filter] unable to allocate memory\n");
+    goto cleanup;
+  }
+
   for(int j = 0; j < height; j += tile_height)
   {
     for(int i = 0; i < width; i += tile_width)
     {
       tile target = { i, min_i(i + tile_width, width), j, min_i(j + tile_height, height) };
-      guided_filter_tiling(img_guide, img_in, img_out, target, w, eps, guide_weight, min, max);
+      guided_filter_tiling(img_guide, img_in, img_out, target, w, eps, guide_weight, min, max, mean_buf,
+                           variance_buf, img_bak, img_bak_sz);
     }
   }
+
+cleanup:
+  dt_free_align(img_bak);
+  dt_free_align(variance_buf);
+  dt_free_align(mean_buf);
 }
 
 #ifdef HAVE_OPENCL
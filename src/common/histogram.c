@@ -48,8 +48,9 @@ inline static void histogram_helper_cs_RAW(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->sampling, 1);
   const float *input = (float *)pixel + roi->width * j + roi->crop_x;
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, input++)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, input += step)
   {
     histogram_helper_cs_RAW_helper_process_pixel_float(histogram_params, input, histogram);
   }
@@ -70,10 +71,11 @@ inline void dt_histogram_helper_cs_RAW_uint16(const dt_dev_histogram_collection_
                                               const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->sampling, 1);
   uint16_t *in = (uint16_t *)pixel + roi->width * j + roi->crop_x;
 
   // process pixels
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in++)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += step)
     histogram_helper_cs_RAW_helper_process_pixel_uint16(histogram_params, in, histogram);
 }
 
@@ -164,20 +166,25 @@ inline static void histogram_helper_cs_rgb(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
+  const int step = MAX(histogram_params->sampling, 1);
+  const int width = roi->width - roi->crop_width - roi->crop_x;
+  const float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
-  // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  // the code path is picked once for the whole row
+  if(darktable.codepath.OPENMP_SIMD)
   {
-    if(darktable.codepath.OPENMP_SIMD)
+    for(int i = 0; i < width; i += step, in += 4 * step)
       histogram_helper_cs_rgb_helper_process_pixel_float(histogram_params, in, histogram);
+  }
 #if defined(__SSE2__)
-    else if(darktable.codepath.SSE2)
+  else if(darktable.codepath.SSE2)
+  {
+    for(int i = 0; i < width; i += step, in += 4 * step)
       histogram_helper_cs_rgb_helper_process_pixel_m128(histogram_params, in, histogram);
-#endif
-    else
-      dt_unreachable_codepath();
   }
+#endif
+  else
+    dt_unreachable_codepath();
 }
 
 inline static void histogram_helper_cs_rgb_compensated(const dt_dev_histogram_collection_params_t *const histogram_params,
@@ -185,20 +192,25 @@ inline static void histogram_helper_cs_rgb_compensated(const dt_dev_histogram_co
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
+  const int step = MAX(histogram_params->sampling, 1);
+  const int width = roi->width - roi->crop_width - roi->crop_x;
+  const float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
-  // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  // the code path is picked once for the whole row
+  if(darktable.codepath.OPENMP_SIMD)
   {
-    if(darktable.codepath.OPENMP_SIMD)
+    for(int i = 0; i < width; i += step, in += 4 * step)
       histogram_helper_cs_rgb_helper_process_pixel_float_compensated(histogram_params, in, histogram, profile_info);
+  }
 #if defined(__SSE2__)
-    else if(darktable.codepath.SSE2)
+  else if(darktable.codepath.SSE2)
+  {
+    for(int i = 0; i < width; i += step, in += 4 * step)
       histogram_helper_cs_rgb_helper_process_pixel_m128_compensated(histogram_params, in, histogram, profile_info);
-#endif
-    else
-      dt_unreachable_codepath();
   }
+#endif
+  else
+    dt_unreachable_codepath();
 }
 
 //------------------------------------------------------------------------------
@@ -253,20 +265,25 @@ inline static void histogram_helper_cs_Lab(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
-  float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
+  const int step = MAX(histogram_params->sampling, 1);
+  const int width = roi->width - roi->crop_width - roi->crop_x;
+  const float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
-  // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  // the code path is picked once for the whole row
+  if(darktable.codepath.OPENMP_SIMD)
   {
-    if(darktable.codepath.OPENMP_SIMD)
+    for(int i = 0; i < width; i += step, in += 4 * step)
       histogram_helper_cs_Lab_helper_process_pixel_float(histogram_params, in, histogram);
+  }
 #if defined(__SSE2__)
-    else if(darktable.codepath.SSE2)
+  else if(darktable.codepath.SSE2)
+  {
+    for(int i = 0; i < width; i += step, in += 4 * step)
       histogram_helper_cs_Lab_helper_process_pixel_m128(histogram_params, in, histogram);
-#endif
-    else
-      dt_unreachable_codepath();
   }
+#endif
+  else
+    dt_unreachable_codepath();
 }
 
 inline static void __attribute__((__unused__)) histogram_helper_cs_Lab_LCh_helper_process_pixel_float(
@@ -287,10 +304,11 @@ inline static void histogram_helper_cs_Lab_LCh(const dt_dev_histogram_collection
                                                const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = MAX(histogram_params->sampling, 1);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
   // TODO: process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += 4 * step)
   {
     //    if(darktable.codepath.OPENMP_SIMD)
     histogram_helper_cs_Lab_LCh_helper_process_pixel_float(histogram_params, in, histogram);
@@ -305,59 +323,100 @@ inline static void histogram_helper_cs_Lab_LCh(const dt_dev_histogram_collection
 
 //==============================================================================
 
-void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_params,
-                         dt_dev_histogram_stats_t *histogram_stats, const void *const pixel,
-                         uint32_t **histogram, const dt_worker Worker,
-                         const dt_iop_order_iccprofile_info_t *const profile_info)
+// the row processing of the colorspaces known here, which get inlined in the loop over rows instead of being
+// called through a dt_worker pointer
+typedef enum _histogram_rows_t
+{
+  _HISTOGRAM_ROWS_WORKER = 0,
+  _HISTOGRAM_ROWS_RAW,
+  _HISTOGRAM_ROWS_RGB,
+  _HISTOGRAM_ROWS_RGB_COMPENSATED,
+  _HISTOGRAM_ROWS_LAB,
+  _HISTOGRAM_ROWS_LAB_LCH
+} _histogram_rows_t;
+
+static void _histogram_worker(dt_dev_histogram_collection_params_t *const histogram_params,
+                              dt_dev_histogram_stats_t *histogram_stats, const void *const pixel,
+                              uint32_t **histogram, const _histogram_rows_t rows, const dt_worker Worker,
+                              const dt_iop_order_iccprofile_info_t *const profile_info)
 {
-  const int nthreads = omp_get_max_threads();
+  const int nthreads = dt_get_num_threads();
 
   const size_t bins_total = (size_t)4 * histogram_params->bins_count;
   const size_t buf_size = bins_total * sizeof(uint32_t);
-  void *partial_hists = calloc(nthreads, buf_size);
+
+  // one set of bins per thread, each starting on its own cache line
+  size_t padded_size;
+  uint32_t *const partial_hists = dt_calloc_perthread(bins_total, sizeof(uint32_t), &padded_size);
 
   if(histogram_params->mul == 0) histogram_params->mul = (double)(histogram_params->bins_count - 1);
 
   const dt_histogram_roi_t *const roi = histogram_params->roi;
+  const int step = MAX(histogram_params->sampling, 1);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(histogram_params, pixel, Worker, profile_info, bins_total, roi) \
+  dt_omp_firstprivate(histogram_params, pixel, rows, Worker, profile_info, roi, step, padded_size) \
   shared(partial_hists) \
   schedule(static)
 #endif
-  for(int j = roi->crop_y; j < roi->height - roi->crop_height; j++)
+  for(int j = roi->crop_y; j < roi->height - roi->crop_height; j += step)
   {
-    uint32_t *thread_hist = (uint32_t *)partial_hists + bins_total * omp_get_thread_num();
-    Worker(histogram_params, pixel, thread_hist, j, profile_info);
+    uint32_t *const thread_hist = dt_get_perthread(partial_hists, padded_size);
+    switch(rows)
+    {
+      case _HISTOGRAM_ROWS_RAW:
+        histogram_helper_cs_RAW(histogram_params, pixel, thread_hist, j, profile_info);
+        break;
+      case _HISTOGRAM_ROWS_RGB:
+        histogram_helper_cs_rgb(histogram_params, pixel, thread_hist, j, profile_info);
+        break;
+      case _HISTOGRAM_ROWS_RGB_COMPENSATED:
+        histogram_helper_cs_rgb_compensated(histogram_params, pixel, thread_hist, j, profile_info);
+        break;
+      case _HISTOGRAM_ROWS_LAB:
+        histogram_helper_cs_Lab(histogram_params, pixel, thread_hist, j, profile_info);
+        break;
+      case _HISTOGRAM_ROWS_LAB_LCH:
+        histogram_helper_cs_Lab_LCh(histogram_params, pixel, thread_hist, j, profile_info);
+        break;
+      default:
+        Worker(histogram_params, pixel, thread_hist, j, profile_info);
+        break;
+    }
   }
 
-#ifdef _OPENMP
   *histogram = realloc(*histogram, buf_size);
-  memset(*histogram, 0, buf_size);
-  uint32_t *hist = *histogram;
+  uint32_t *const hist = *histogram;
 
+#ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(nthreads, bins_total) \
-  shared(hist, partial_hists) \
+  dt_omp_firstprivate(nthreads, bins_total, padded_size, hist) \
+  shared(partial_hists) \
   schedule(static)
+#endif
   for(size_t k = 0; k < bins_total; k++)
   {
+    uint32_t sum = 0;
     for(size_t n = 0; n < nthreads; n++)
-    {
-      const uint32_t *thread_hist = (uint32_t *)partial_hists + bins_total * n;
-      hist[k] += thread_hist[k];
-    }
+      sum += dt_get_bythread(partial_hists, padded_size, n)[k];
+    hist[k] = sum;
   }
-#else
-  *histogram = realloc(*histogram, buf_size);
-  memmove(*histogram, partial_hists, buf_size);
-#endif
-  free(partial_hists);
+  dt_free_align(partial_hists);
 
+  const int width = roi->width - roi->crop_width - roi->crop_x;
+  const int height = roi->height - roi->crop_height - roi->crop_y;
   histogram_stats->bins_count = histogram_params->bins_count;
-  histogram_stats->pixels = (roi->width - roi->crop_width - roi->crop_x)
-                            * (roi->height - roi->crop_height - roi->crop_y);
+  histogram_stats->pixels = ((width + step - 1) / step) * ((height + step - 1) / step);
+}
+
+void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_params,
+                         dt_dev_histogram_stats_t *histogram_stats, const void *const pixel,
+                         uint32_t **histogram, const dt_worker Worker,
+                         const dt_iop_order_iccprofile_info_t *const profile_info)
+{
+  _histogram_worker(histogram_params, histogram_stats, pixel, histogram, _HISTOGRAM_ROWS_WORKER, Worker,
+                    profile_info);
 }
 
 //------------------------------------------------------------------------------
@@ -370,24 +429,29 @@ void dt_histogram_helper(dt_dev_histogram_collection_params_t *histogram_params,
   switch(cst)
   {
     case IOP_CS_RAW:
-      dt_histogram_worker(histogram_params, histogram_stats, pixel, histogram, histogram_helper_cs_RAW, profile_info);
+      _histogram_worker(histogram_params, histogram_stats, pixel, histogram, _HISTOGRAM_ROWS_RAW, NULL,
+                        profile_info);
       histogram_stats->ch = 1u;
       break;
 
     case IOP_CS_RGB:
       if(compensate_middle_grey && profile_info)
-        dt_histogram_worker(histogram_params, histogram_stats, pixel, histogram, histogram_helper_cs_rgb_compensated, profile_info);
+        _histogram_worker(histogram_params, histogram_stats, pixel, histogram, _HISTOGRAM_ROWS_RGB_COMPENSATED, NULL,
+                          profile_info);
       else
-        dt_histogram_worker(histogram_params, histogram_stats, pixel, histogram, histogram_helper_cs_rgb, profile_info);
+        _histogram_worker(histogram_params, histogram_stats, pixel, histogram, _HISTOGRAM_ROWS_RGB, NULL,
+                          profile_info);
       histogram_stats->ch = 3u;
       break;
 
     case IOP_CS_LAB:
     default:
       if(cst_to != IOP_CS_LCH)
-        dt_histogram_worker(histogram_params, histogram_stats, pixel, histogram, histogram_helper_cs_Lab, profile_info);
+        _histogram_worker(histogram_params, histogram_stats, pixel, histogram, _HISTOGRAM_ROWS_LAB, NULL,
+                          profile_info);
       else
-        dt_histogram_worker(histogram_params, histogram_stats, pixel, histogram, histogram_helper_cs_Lab_LCh, profile_info);
+        _histogram_worker(histogram_params, histogram_stats, pixel, histogram, _HISTOGRAM_ROWS_LAB_LCH, NULL,
+                          profile_info);
       histogram_stats->ch = 3u;
       break;
   }
@@ -57,7 +57,8 @@ static void _remove_preset_flag(const int imgid)
   dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_SAFE);
 }
 
-void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
+// with bulk, the caller takes care of the thumbnails of all its images at once
+static void _history_delete_on_image(int32_t imgid, gboolean undo, const gboolean bulk)
 {
   dt_undo_lt_history_t *hist = undo?dt_history_snapshot_item_init():NULL;
 
@@ -114,7 +115,7 @@ void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
   if(dt_dev_is_current_image(darktable.develop, imgid)) dt_dev_reload_history_items(darktable.develop);
 
   /* make sure mipmaps are recomputed */
-  dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+  if(!bulk) dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
   dt_image_update_final_size(imgid);
 
   /* remove darktable|style|* tags */
@@ -125,7 +126,7 @@ void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
   dt_image_cache_unset_change_timestamp(darktable.image_cache, imgid);
 
   // signal that the mipmap need to be updated
-  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
+  if(!bulk) DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
 
   dt_unlock_image(imgid);
 
@@ -143,6 +144,11 @@ void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
   }
 }
 
+void dt_history_delete_on_image_ext(int32_t imgid, gboolean undo)
+{
+  _history_delete_on_image(imgid, undo, FALSE);
+}
+
 void dt_history_delete_on_image(int32_t imgid)
 {
   dt_history_delete_on_image_ext(imgid, TRUE);
@@ -474,36 +480,29 @@ int dt_history_merge_module_into_history(dt_develop_t *dev_dest, dt_develop_t *d
   return module_added;
 }
 
-static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops, const gboolean copy_full)
+// the source side of a merge, read once for all the images of a paste
+typedef struct dt_history_merge_source_t
 {
-  GList *modules_used = NULL;
-
-  dt_develop_t _dev_src = { 0 };
-  dt_develop_t _dev_dest = { 0 };
+  int32_t imgid;
+  dt_develop_t dev;
+  GList *mod_list; // modules of dev to merge, in order
+} dt_history_merge_source_t;
 
-  dt_develop_t *dev_src = &_dev_src;
-  dt_develop_t *dev_dest = &_dev_dest;
+static dt_history_merge_source_t *_history_merge_source_new(const int32_t imgid, GList *ops,
+                                                            const gboolean copy_full)
+{
+  dt_history_merge_source_t *src = g_malloc0(sizeof(dt_history_merge_source_t));
+  dt_develop_t *dev_src = &src->dev;
+  src->imgid = imgid;
 
   // we will do the copy/paste on memory so we can deal with masks
   dt_dev_init(dev_src, FALSE);
-  dt_dev_init(dev_dest, FALSE);
-
   dev_src->iop = dt_iop_load_modules_ext(dev_src, TRUE);
-  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
 
   dt_dev_read_history_ext(dev_src, imgid, TRUE);
-
-  // This prepends the default modules and converts just in case it's an empty history
-  dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
-
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge ");
-  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge ");
-
+  dt_ioppr_check_iop_order(dev_src, imgid, "_history_merge_source_new ");
   dt_dev_pop_history_items_ext(dev_src, dev_src->history_end);
-  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
-
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge 1");
-  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 1");
+  dt_ioppr_check_iop_order(dev_src, imgid, "_history_merge_source_new 1");
 
   GList *mod_list = NULL;
 
@@ -551,26 +550,55 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   }
   if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv\n");
 
-  mod_list = g_list_reverse(mod_list);   // list was built in reverse order, so un-reverse it
+  src->mod_list = g_list_reverse(mod_list);   // list was built in reverse order, so un-reverse it
+
+  return src;
+}
+
+static void _history_merge_source_free(dt_history_merge_source_t *src)
+{
+  if(!src) return;
+  g_list_free(src->mod_list);
+  dt_dev_cleanup(&src->dev);
+  g_free(src);
+}
+
+static int _history_merge_into_image(dt_history_merge_source_t *src, const int32_t dest_imgid)
+{
+  GList *modules_used = NULL;
+
+  dt_develop_t _dev_dest = { 0 };
+  dt_develop_t *dev_dest = &_dev_dest;
+
+  dt_dev_init(dev_dest, FALSE);
+  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+
+  // This prepends the default modules and converts just in case it's an empty history
+  dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
+
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_merge_into_image ");
+
+  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_merge_into_image 1");
 
   // update iop-order list to have entries for the new modules
-  dt_ioppr_update_for_modules(dev_dest, mod_list, FALSE);
+  dt_ioppr_update_for_modules(dev_dest, src->mod_list, FALSE);
 
-  for(GList *l = mod_list; l; l = g_list_next(l))
+  for(GList *l = src->mod_list; l; l = g_list_next(l))
   {
     dt_iop_module_t *mod = (dt_iop_module_t *)l->data;
-    dt_history_merge_module_into_history(dev_dest, dev_src, mod, &modules_used, FALSE);
+    dt_history_merge_module_into_history(dev_dest, &src->dev, mod, &modules_used, FALSE);
   }
 
   // update iop-order list to have entries for the new modules
-  dt_ioppr_update_for_modules(dev_dest, mod_list, FALSE);
+  dt_ioppr_update_for_modules(dev_dest, src->mod_list, FALSE);
 
-  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 2");
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_merge_into_image 2");
 
   // write history and forms to db
   dt_dev_write_history_ext(dev_dest, dest_imgid);
 
-  dt_dev_cleanup(dev_src);
   dt_dev_cleanup(dev_dest);
 
   g_list_free(modules_used);
@@ -578,7 +606,20 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   return 0;
 }
 
-static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const int32_t dest_imgid, GList *ops, const gboolean copy_full)
+static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops,
+                                                  const gboolean copy_full, dt_history_merge_source_t *src)
+{
+  // a paste onto several images reads the source once
+  if(src) return _history_merge_into_image(src, dest_imgid);
+
+  src = _history_merge_source_new(imgid, ops, copy_full);
+  const int ret_val = _history_merge_into_image(src, dest_imgid);
+  _history_merge_source_free(src);
+  return ret_val;
+}
+
+static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const int32_t dest_imgid, GList *ops,
+                                                      const gboolean copy_full, dt_history_merge_source_t *src)
 {
   int ret_val = 0;
   sqlite3_stmt *stmt;
@@ -726,15 +767,16 @@ static int _history_copy_and_paste_on_image_overwrite(const int32_t imgid, const
   else
   {
     // since the history and masks where deleted we can do a merge
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops, copy_full);
+    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops, copy_full, src);
   }
 
   return ret_val;
 }
 
-int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_imgid,
-                                       const gboolean merge, GList *ops,
-                                       const gboolean copy_iop_order, const gboolean copy_full)
+static int _history_copy_and_paste_on_image_ext(const int32_t imgid, const int32_t dest_imgid,
+                                                const gboolean merge, GList *ops,
+                                                const gboolean copy_iop_order, const gboolean copy_full,
+                                                dt_history_merge_source_t *src)
 {
   if(imgid == dest_imgid) return 1;
 
@@ -746,9 +788,10 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
 
   dt_lock_image_pair(imgid, dest_imgid);
 
-  // be sure the current history is written before pasting some other history data
+  // be sure the current history is written before pasting some other history data,
+  // with a source given that was done before reading it
   const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+  if(!src && cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
 
   dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
   hist->imgid = dest_imgid;
@@ -763,9 +806,9 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
 
   int ret_val = 0;
   if(merge)
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops, copy_full);
+    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops, copy_full, src);
   else
-    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops, copy_full);
+    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops, copy_full, src);
 
   dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
@@ -807,6 +850,43 @@ int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_i
   return ret_val;
 }
 
+int dt_history_copy_and_paste_on_image(const int32_t imgid, const int32_t dest_imgid,
+                                       const gboolean merge, GList *ops,
+                                       const gboolean copy_iop_order, const gboolean copy_full)
+{
+  return _history_copy_and_paste_on_image_ext(imgid, dest_imgid, merge, ops, copy_iop_order, copy_full, NULL);
+}
+
+// paste the copied history onto each image of list, reading the source of a merge only once
+static void _history_paste_on_list(const GList *list, const gboolean merge)
+{
+  const int32_t imgid = darktable.view_manager->copy_paste.copied_imageid;
+  GList *ops = darktable.view_manager->copy_paste.selops;
+  const gboolean copy_full = darktable.view_manager->copy_paste.full_copy;
+
+  // be sure the current history is written before reading the source
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  // an overwrite without selected ops copies in sql and needs no source
+  dt_history_merge_source_t *src = NULL;
+  if(merge || ops)
+  {
+    dt_lock_image(imgid);
+    src = _history_merge_source_new(imgid, ops, copy_full);
+    dt_unlock_image(imgid);
+  }
+
+  for(const GList *l = list; l; l = g_list_next(l))
+  {
+    const int dest = GPOINTER_TO_INT(l->data);
+    _history_copy_and_paste_on_image_ext(imgid, dest, merge, ops,
+                                         darktable.view_manager->copy_paste.copy_iop_order, copy_full, src);
+  }
+
+  _history_merge_source_free(src);
+}
+
 char *dt_history_item_as_string(const char *name, gboolean enabled)
 {
   return g_strconcat(enabled ? "●" : "○", "  ", name, NULL);
@@ -1510,12 +1590,10 @@ void dt_history_hash_read(const int32_t imgid, dt_history_hash_values_t *hash)
 {
   hash->basic = hash->auto_apply = hash->current = NULL;
   hash->basic_len = hash->auto_apply_len = hash->current_len = 0;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT basic_hash, auto_hash, current_hash"
-                              " FROM main.history_hash"
-                              " WHERE imgid = ?1",
-                              -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "SELECT basic_hash, auto_hash, current_hash"
+                                                  " FROM main.history_hash"
+                                                  " WHERE imgid = ?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -1541,7 +1619,7 @@ void dt_history_hash_read(const int32_t imgid, dt_history_hash_values_t *hash)
       memcpy(hash->current, buf, hash->current_len);
     }
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
 }
 
 gboolean dt_history_hash_is_mipmap_synced(const int32_t imgid)
@@ -1657,15 +1735,7 @@ gboolean dt_history_paste_on_list(const GList *list, gboolean undo)
   if(mode == 0) merge = TRUE;
 
   if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  for(GList *l = (GList *)list; l; l = g_list_next(l))
-  {
-    const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid,
-                                       dest, merge,
-                                       darktable.view_manager->copy_paste.selops,
-                                       darktable.view_manager->copy_paste.copy_iop_order,
-                                       darktable.view_manager->copy_paste.full_copy);
-  }
+  _history_paste_on_list(list, merge);
   if(undo) dt_undo_end_group(darktable.undo);
 
   // In darkroom and if there is a copy of the iop-order we need to rebuild the pipe
@@ -1708,15 +1778,7 @@ gboolean dt_history_paste_parts_on_list(const GList *list, gboolean undo)
   }
 
   if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  for (const GList *l = l_copy; l; l = g_list_next(l))
-  {
-    const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid,
-                                       dest, merge,
-                                       darktable.view_manager->copy_paste.selops,
-                                       darktable.view_manager->copy_paste.copy_iop_order,
-                                       darktable.view_manager->copy_paste.full_copy);
-  }
+  _history_paste_on_list(l_copy, merge);
   if(undo) dt_undo_end_group(darktable.undo);
 
   g_list_free(l_copy);
@@ -1750,7 +1812,7 @@ gboolean dt_history_delete_on_list(const GList *list, gboolean undo)
     hist->imgid = imgid;
     dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
-    dt_history_delete_on_image_ext(imgid, FALSE);
+    _history_delete_on_image(imgid, FALSE, TRUE);
 
     dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
     dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist, dt_history_snapshot_undo_pop,
@@ -1762,6 +1824,11 @@ gboolean dt_history_delete_on_list(const GList *list, gboolean undo)
       dt_image_set_aspect_ratio(imgid, FALSE);
   }
 
+  /* make sure mipmaps are recomputed, all at once */
+  dt_mipmap_cache_remove_list(darktable.mipmap_cache, list);
+  for(const GList *l = list; l; l = g_list_next(l))
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, GPOINTER_TO_INT(l->data));
+
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
 
   if(undo) dt_undo_end_group(darktable.undo);
@@ -119,8 +119,8 @@ end:
   }
 }
 
-dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, const char *id,
-                                        const dt_http_server_callback callback, gpointer user_data)
+// create a server listening on localhost on the first free one of the ports
+static SoupServer *_server_new(const int *ports, const int n_ports, int *bound_port)
 {
   SoupServer *httpserver = NULL;
   int port = 0;
@@ -181,11 +181,23 @@ dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, con
   if(port == 0)
   {
     fprintf(stderr, "error: can't bind to any port from our pool\n");
+    g_object_unref(httpserver);
     return NULL;
   }
 
 #endif
 
+  *bound_port = port;
+  return httpserver;
+}
+
+dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, const char *id,
+                                        const dt_http_server_callback callback, gpointer user_data)
+{
+  int port = 0;
+  SoupServer *httpserver = _server_new(ports, n_ports, &port);
+  if(httpserver == NULL) return NULL;
+
   dt_http_server_t *server = (dt_http_server_t *)malloc(sizeof(dt_http_server_t));
   server->server = httpserver;
 
@@ -211,6 +223,29 @@ dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, con
   return server;
 }
 
+dt_http_server_t *dt_http_server_create_service(const int port, const SoupServerCallback handler,
+                                                gpointer user_data)
+{
+  int bound_port = 0;
+  SoupServer *httpserver = _server_new(&port, 1, &bound_port);
+  if(httpserver == NULL) return NULL;
+
+  dt_http_server_t *server = (dt_http_server_t *)malloc(sizeof(dt_http_server_t));
+  server->server = httpserver;
+  server->url = g_strdup_printf("http://localhost:%d/", bound_port);
+
+  // the handler stays until the server is killed
+  soup_server_add_handler(httpserver, NULL, handler, user_data, NULL);
+
+#ifdef OLD_API
+  soup_server_run_async(httpserver);
+#endif
+
+  dt_print(DT_DEBUG_CONTROL, "[http server] service listening on %s\n", server->url);
+
+  return server;
+}
+
 void dt_http_server_kill(dt_http_server_t *server)
 {
   if(server->server)
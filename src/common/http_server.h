@@ -35,6 +35,12 @@ typedef struct dt_http_server_t
 dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, const char *id,
                                         const dt_http_server_callback callback, gpointer user_data);
 
+/** create a long running http service listening on localhost:port. the handler is called in the main
+ *  context for every request, it stays installed until the server is killed with dt_http_server_kill().
+ */
+dt_http_server_t *dt_http_server_create_service(const int port, const SoupServerCallback handler,
+                                                gpointer user_data);
+
 /** call this to kill a server manually. don't call this if the request was received.
  *  this also frees server.
  */
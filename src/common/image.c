@@ -25,6 +25,7 @@
 #include "common/grouping.h"
 #include "common/history.h"
 #include "common/history_snapshot.h"
+#include "common/colorlabels.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_rawspeed.h"
@@ -596,6 +597,7 @@ static void _geotag_undo_data_free(gpointer data)
 
 static void _image_set_location(GList *imgs, const dt_image_geoloc_t *geoloc, GList **undo, const gboolean undo_on)
 {
+  dt_database_batch_begin(darktable.db);
   for(GList *images = imgs; images; images = g_list_next(images))
   {
     const int32_t imgid = GPOINTER_TO_INT(images->data);
@@ -608,11 +610,12 @@ static void _image_set_location(GList *imgs, const dt_image_geoloc_t *geoloc, GL
 
       memcpy(&undogeotag->after, geoloc, sizeof(dt_image_geoloc_t));
 
-      *undo = g_list_append(*undo, undogeotag);
+      *undo = g_list_prepend(*undo, undogeotag);
     }
 
     _set_location(imgid, geoloc);
   }
+  dt_database_batch_commit(darktable.db);
 }
 
 void dt_image_set_locations(const GList *imgs, const dt_image_geoloc_t *geoloc, const gboolean undo_on)
@@ -650,6 +653,8 @@ static void _image_set_images_locations(const GList *img, const GArray *gloc,
                                         GList **undo, const gboolean undo_on)
 {
   int i = 0;
+  // one transaction for all, sidecars written once at the end
+  dt_database_batch_begin(darktable.db);
   for(GList *imgs = (GList *)img; imgs; imgs = g_list_next(imgs))
   {
     const int32_t imgid = GPOINTER_TO_INT(imgs->data);
@@ -668,6 +673,7 @@ static void _image_set_images_locations(const GList *img, const GArray *gloc,
     _set_location(imgid, geoloc);
     i++;
   }
+  dt_database_batch_commit(darktable.db);
 }
 
 void dt_image_set_images_locations(const GList *imgs, const GArray *gloc, const gboolean undo_on)
@@ -996,7 +1002,73 @@ int32_t dt_image_duplicate(const int32_t imgid)
   return dt_image_duplicate_with_version(imgid, -1);
 }
 
-static int32_t _image_duplicate_with_version_ext(const int32_t imgid, const int32_t newversion)
+// copies the color labels, metadata, tags and module order of the images listed in memory.duplicates onto
+// their duplicates, for all of them at once
+static void _image_duplicate_attached(void)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  DT_DEBUG_SQLITE3_EXEC(db,
+                        "INSERT INTO main.color_labels (imgid, color)"
+                        "  SELECT d.dst, c.color"
+                        "  FROM memory.duplicates AS d"
+                        "  JOIN main.color_labels AS c ON c.imgid = d.src",
+                        NULL, NULL, NULL);
+
+  DT_DEBUG_SQLITE3_EXEC(db,
+                        "INSERT INTO main.meta_data (id, key, value)"
+                        "  SELECT d.dst, m.key, m.value"
+                        "  FROM memory.duplicates AS d"
+                        "  JOIN main.meta_data AS m ON m.id = d.src",
+                        NULL, NULL, NULL);
+
+#ifdef HAVE_SQLITE_324_OR_NEWER
+  DT_DEBUG_SQLITE3_EXEC(db,
+                        "INSERT INTO main.tagged_images (imgid, tagid, position)"
+                        "  SELECT d.dst, ti.tagid, "
+                        "        (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)"
+                        "         FROM main.tagged_images)"
+                        "         + (ROW_NUMBER() OVER (ORDER BY d.dst) << 32)"
+                        "  FROM memory.duplicates AS d"
+                        "  JOIN main.tagged_images AS ti ON ti.imgid = d.src",
+                        NULL, NULL, NULL);
+#else // break down the tagged_images insert per image and tag
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT src, dst FROM memory.duplicates", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int32_t imgid = sqlite3_column_int(stmt, 0);
+    const int32_t newid = sqlite3_column_int(stmt, 1);
+    GList *tags = dt_tag_get_tags(imgid, FALSE);
+    for(GList *tag = tags; tag; tag = g_list_next(tag))
+    {
+      sqlite3_stmt *ins;
+      DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                                  "INSERT INTO main.tagged_images (imgid, tagid, position)"
+                                  "  VALUES (?1, ?2, "
+                                  "   (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)"
+                                  "     + (1 << 32)"
+                                  "   FROM main.tagged_images))",
+                                  -1, &ins, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(ins, 1, newid);
+      DT_DEBUG_SQLITE3_BIND_INT(ins, 2, GPOINTER_TO_INT(tag->data));
+      sqlite3_step(ins);
+      sqlite3_finalize(ins);
+    }
+    g_list_free(tags);
+  }
+  sqlite3_finalize(stmt);
+#endif
+
+  DT_DEBUG_SQLITE3_EXEC(db,
+                        "INSERT INTO main.module_order (imgid, iop_list, version)"
+                        "  SELECT d.dst, m.iop_list, m.version"
+                        "  FROM memory.duplicates AS d"
+                        "  JOIN main.module_order AS m ON m.imgid = d.src",
+                        NULL, NULL, NULL);
+}
+
+static int32_t _image_duplicate_with_version_ext(const int32_t imgid, const int32_t newversion,
+                                                 const gboolean attached)
 {
   sqlite3_stmt *stmt;
   int32_t newid = -1;
@@ -1068,57 +1140,6 @@ static int32_t _image_duplicate_with_version_ext(const int32_t imgid, const int3
 
   if(newid != -1)
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT INTO main.color_labels (imgid, color)"
-                                "  SELECT ?1, color FROM main.color_labels WHERE imgid = ?2",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newid);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT INTO main.meta_data (id, key, value)"
-                                "  SELECT ?1, key, value FROM main.meta_data WHERE id = ?2",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newid);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-
-#ifdef HAVE_SQLITE_324_OR_NEWER
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT INTO main.tagged_images (imgid, tagid, position)"
-                                "  SELECT ?1, tagid, "
-                                "        (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)"
-                                "         FROM main.tagged_images)"
-                                "         + (ROW_NUMBER() OVER (ORDER BY imgid) << 32)"
-                                " FROM main.tagged_images AS ti"
-                                " WHERE imgid = ?2",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newid);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-#else // break down the tagged_images insert per tag
-    GList *tags = dt_tag_get_tags(imgid, FALSE);
-    for(GList *tag = tags; tag; tag = g_list_next(tag))
-    {
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                  "INSERT INTO main.tagged_images (imgid, tagid, position)"
-                                  "  VALUES (?1, ?2, "
-                                  "   (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)"
-                                  "     + (1 << 32)"
-                                  "   FROM main.tagged_images))",
-                                  -1, &stmt, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newid);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(tag->data));
-      sqlite3_step(stmt);
-      sqlite3_finalize(stmt);
-    }
-    g_list_free(tags);
-#endif
-
     if(darktable.develop->image_storage.id == imgid)
     {
       // make sure the current iop-order list is written as this will be duplicated from the db
@@ -1126,14 +1147,20 @@ static int32_t _image_duplicate_with_version_ext(const int32_t imgid, const int3
       dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
     }
 
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "INSERT INTO main.module_order (imgid, iop_list, version)"
-                                "  SELECT ?1, iop_list, version FROM main.module_order WHERE imgid = ?2",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, newid);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
+    if(attached)
+    {
+      sqlite3_stmt *dup;
+      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                  "INSERT INTO memory.duplicates (src, dst) VALUES (?1, ?2)",
+                                  -1, &dup, NULL);
+      DT_DEBUG_SQLITE3_BIND_INT(dup, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(dup, 2, newid);
+      sqlite3_step(dup);
+      sqlite3_finalize(dup);
+      _image_duplicate_attached();
+      DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.duplicates", NULL, NULL, NULL);
+      dt_image_cache_set_hot_colorlabels(darktable.image_cache, newid, dt_colorlabels_get_labels(newid));
+    }
 
     // set version of new entry and max_version of all involved duplicates (with same film_id and filename)
     // this needs to happen before we do anything with the image cache, as version isn't updated through the cache
@@ -1163,7 +1190,7 @@ static int32_t _image_duplicate_with_version_ext(const int32_t imgid, const int3
 
 static int32_t _image_duplicate_with_version(const int32_t imgid, const int32_t newversion, const gboolean undo)
 {
-  const int32_t newid = _image_duplicate_with_version_ext(imgid, newversion);
+  const int32_t newid = _image_duplicate_with_version_ext(imgid, newversion, TRUE);
 
   if(newid != -1)
   {
@@ -1203,6 +1230,142 @@ int32_t dt_image_duplicate_with_version(const int32_t imgid, const int32_t newve
   return _image_duplicate_with_version(imgid, newversion, TRUE);
 }
 
+GList *dt_image_duplicate_images(const GList *imgs, const gboolean virgin)
+{
+  GList *dups = NULL;
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_stmt *stmt;
+
+  // be sure the current history is written before it is copied
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(!virgin && cv && cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  dt_database_batch_begin(darktable.db);
+
+  // the image rows one by one as they need positions and versions, all the rest at once afterwards
+  DT_DEBUG_SQLITE3_EXEC(db, "DELETE FROM memory.duplicates", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "INSERT INTO memory.duplicates (src, dst) VALUES (?1, ?2)", -1, &stmt, NULL);
+  int32_t last = -1;
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+    const int32_t newid = _image_duplicate_with_version_ext(imgid, -1, FALSE);
+    if(newid == -1) continue;
+
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, newid);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    dups = g_list_prepend(dups, GINT_TO_POINTER(newid));
+    last = imgid;
+
+    dt_undo_duplicate_t *dupundo = (dt_undo_duplicate_t *)malloc(sizeof(dt_undo_duplicate_t));
+    dupundo->orig_imgid = imgid;
+    dupundo->version = -1;
+    dupundo->new_imgid = newid;
+    dt_undo_record(darktable.undo, NULL, DT_UNDO_DUPLICATE, dupundo, _pop_undo, NULL);
+  }
+  sqlite3_finalize(stmt);
+  dups = g_list_reverse(dups);
+
+  _image_duplicate_attached();
+
+  // make sure that the duplicates don't have some magic darktable| tags
+  DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                              "DELETE FROM main.tagged_images"
+                              " WHERE imgid IN (SELECT dst FROM memory.duplicates)"
+                              "   AND tagid IN (SELECT id FROM data.tags"
+                              "                 WHERE name IN ('darktable|changed', 'darktable|exported')"
+                              "                    OR (?1 AND name LIKE 'darktable|style|%'))",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, virgin);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+
+  if(virgin)
+  {
+    // as after discarding the history, the auto-presets are applied again when opened
+    DT_DEBUG_SQLITE3_PREPARE_V2(db,
+                                "UPDATE main.images"
+                                " SET aspect_ratio = 0.0, flags = flags & ~?1"
+                                " WHERE id IN (SELECT dst FROM memory.duplicates)",
+                                -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, DT_IMAGE_AUTO_PRESETS_APPLIED);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    DT_DEBUG_SQLITE3_EXEC(db,
+                          "DELETE FROM main.module_order WHERE imgid IN (SELECT dst FROM memory.duplicates)",
+                          NULL, NULL, NULL);
+  }
+  else
+  {
+    // an exact copy of the history stacks
+    DT_DEBUG_SQLITE3_EXEC(db,
+                          "INSERT INTO main.history"
+                          "  (imgid, num, module, operation, op_params, enabled, blendop_params,"
+                          "   blendop_version, multi_priority, multi_name)"
+                          "  SELECT d.dst, h.num, h.module, h.operation, h.op_params, h.enabled, h.blendop_params,"
+                          "         h.blendop_version, h.multi_priority, h.multi_name"
+                          "  FROM memory.duplicates AS d"
+                          "  JOIN main.history AS h ON h.imgid = d.src",
+                          NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(db,
+                          "INSERT INTO main.masks_history"
+                          "  (imgid, num, formid, form, name, version, points, points_count, source)"
+                          "  SELECT d.dst, m.num, m.formid, m.form, m.name, m.version, m.points, m.points_count,"
+                          "         m.source"
+                          "  FROM memory.duplicates AS d"
+                          "  JOIN main.masks_history AS m ON m.imgid = d.src",
+                          NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(db,
+                          "UPDATE main.images"
+                          " SET history_end = (SELECT s.history_end"
+                          "                    FROM memory.duplicates AS d"
+                          "                    JOIN main.images AS s ON s.id = d.src"
+                          "                    WHERE d.dst = main.images.id)"
+                          " WHERE id IN (SELECT dst FROM memory.duplicates)",
+                          NULL, NULL, NULL);
+    DT_DEBUG_SQLITE3_EXEC(db,
+                          "INSERT INTO main.history_hash (imgid, basic_hash, auto_hash, current_hash)"
+                          "  SELECT d.dst, h.basic_hash, h.auto_hash, h.current_hash"
+                          "  FROM memory.duplicates AS d"
+                          "  JOIN main.history_hash AS h ON h.imgid = d.src",
+                          NULL, NULL, NULL);
+    guint tagid = 0;
+    dt_tag_new("darktable|changed", &tagid);
+    dt_tag_attach_images(tagid, dups, FALSE);
+  }
+
+  // the image cache only gets to see the duplicates now that their rows are complete
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT src, dst FROM memory.duplicates", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int32_t imgid = sqlite3_column_int(stmt, 0);
+    const int32_t newid = sqlite3_column_int(stmt, 1);
+    dt_image_cache_set_hot_colorlabels(darktable.image_cache, newid, dt_colorlabels_get_labels(newid));
+    // a duplicate should keep the change time stamp of the original
+    dt_image_cache_set_change_timestamp_from_image(darktable.image_cache, newid, imgid);
+    // same history, same thumbnails
+    if(!virgin) dt_mipmap_cache_copy_thumbnails(darktable.mipmap_cache, newid, imgid);
+    dt_image_synch_xmp(newid);
+  }
+  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_EXEC(db, "DELETE FROM memory.duplicates", NULL, NULL, NULL);
+
+  dt_database_batch_commit(darktable.db);
+
+  if(last != -1 && darktable.gui && darktable.gui->grouping)
+  {
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, last, 'r');
+    darktable.gui->expanded_group_id = img->group_id;
+    dt_image_cache_read_release(darktable.image_cache, img);
+  }
+  dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, NULL);
+  return dups;
+}
+
+static void _sidecar_forget(const int32_t imgid);
+
 void dt_image_remove(const int32_t imgid)
 {
   // if a local copy exists, remove it
@@ -1216,6 +1379,7 @@ void dt_image_remove(const int32_t imgid)
 
   // make sure we remove from the cache first, or else the cache will look for imgid in sql
   dt_image_cache_remove(darktable.image_cache, imgid);
+  _sidecar_forget(imgid);
 
   const int new_group_id = dt_grouping_remove_from_group(imgid);
   if(darktable.gui && darktable.gui->expanded_group_id == old_group_id)
@@ -1384,7 +1548,7 @@ static int _image_read_duplicates(const uint32_t id, const char *filename, const
       // dt_image_duplicate_with_version() as this version also set the group which
       // is using DT_IMAGE_CACHE_SAFE and so will write the .XMP. But we must avoid
       // this has the xmp for the duplicate is read just below.
-      newid = _image_duplicate_with_version_ext(id, version);
+      newid = _image_duplicate_with_version_ext(id, version, TRUE);
       const dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'r');
       grpid = img->group_id;
       dt_image_cache_read_release(darktable.image_cache, img);
@@ -2133,6 +2297,7 @@ int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gc
         DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, imgid);
         sqlite3_step(stmt);
         sqlite3_finalize(stmt);
+        dt_image_cache_set_hot_colorlabels(darktable.image_cache, newid, dt_colorlabels_get_labels(newid));
         DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                                     "INSERT INTO main.meta_data (id, key, value)"
                                     " SELECT ?1, key, value"
@@ -2428,12 +2593,143 @@ int dt_image_local_copy_reset(const int32_t imgid)
 // xmp stuff
 // *******************************************************
 
+// a sidecar is written once its image had no changes for that long
+#define DT_SIDECAR_DEBOUNCE (500 * G_TIME_SPAN_MILLISECOND)
+// sidecars written at the same time, a network share is mostly latency
+#define DT_SIDECAR_WRITERS 4
+
+static struct
+{
+  GMutex lock;
+  GCond cond;
+  GThread *thread;
+  GThreadPool *writers;
+  gboolean running;
+  GHashTable *dirty;   // imgid -> time of the last change
+  GHashTable *writing; // imgids with a writer on their sidecar
+} _sidecars;
+
+static void _sidecar_write(gpointer data, gpointer user_data)
+{
+  const int32_t imgid = GPOINTER_TO_INT(data);
+  dt_image_write_sidecar_file(imgid);
+
+  g_mutex_lock(&_sidecars.lock);
+  g_hash_table_remove(_sidecars.writing, data);
+  // changed again meanwhile: it's due once more
+  if(g_hash_table_contains(_sidecars.dirty, data)) g_cond_signal(&_sidecars.cond);
+  g_mutex_unlock(&_sidecars.lock);
+}
+
+static gpointer _sidecar_thread(gpointer data)
+{
+  g_mutex_lock(&_sidecars.lock);
+  while(_sidecars.running)
+  {
+    const gint64 now = g_get_monotonic_time();
+    gint64 next = G_MAXINT64;
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, _sidecars.dirty);
+    while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      // one writer per sidecar, the change is picked up when it's done
+      if(g_hash_table_contains(_sidecars.writing, key)) continue;
+      const gint64 due = *(gint64 *)value + DT_SIDECAR_DEBOUNCE;
+      if(due <= now)
+      {
+        g_hash_table_iter_remove(&iter);
+        g_hash_table_add(_sidecars.writing, key);
+        g_thread_pool_push(_sidecars.writers, key, NULL);
+      }
+      else
+        next = MIN(next, due);
+    }
+
+    if(next == G_MAXINT64)
+      g_cond_wait(&_sidecars.cond, &_sidecars.lock);
+    else
+      g_cond_wait_until(&_sidecars.cond, &_sidecars.lock, next);
+  }
+  g_mutex_unlock(&_sidecars.lock);
+  return NULL;
+}
+
+void dt_image_sidecar_writer_start()
+{
+  if(_sidecars.thread) return;
+
+  g_mutex_init(&_sidecars.lock);
+  g_cond_init(&_sidecars.cond);
+  _sidecars.dirty = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  _sidecars.writing = g_hash_table_new(NULL, NULL);
+  _sidecars.writers = g_thread_pool_new(_sidecar_write, NULL, DT_SIDECAR_WRITERS, FALSE, NULL);
+  _sidecars.running = TRUE;
+  _sidecars.thread = g_thread_new("sidecar-writer", _sidecar_thread, NULL);
+}
+
+void dt_image_sidecar_writer_stop()
+{
+  if(!_sidecars.thread) return;
+
+  g_mutex_lock(&_sidecars.lock);
+  _sidecars.running = FALSE;
+  g_cond_signal(&_sidecars.cond);
+  g_mutex_unlock(&_sidecars.lock);
+  g_thread_join(_sidecars.thread);
+  _sidecars.thread = NULL;
+
+  // let the writers finish, then write what is still waiting for its debounce
+  g_thread_pool_free(_sidecars.writers, FALSE, TRUE);
+  _sidecars.writers = NULL;
+  GList *pending = g_hash_table_get_keys(_sidecars.dirty);
+  for(GList *l = pending; l; l = g_list_next(l)) dt_image_write_sidecar_file(GPOINTER_TO_INT(l->data));
+  g_list_free(pending);
+
+  g_hash_table_destroy(_sidecars.dirty);
+  g_hash_table_destroy(_sidecars.writing);
+  g_cond_clear(&_sidecars.cond);
+  g_mutex_clear(&_sidecars.lock);
+}
+
+void dt_image_sidecar_mark_dirty(const int32_t imgid)
+{
+  if(imgid <= 0 || dt_image_get_xmp_mode() == DT_WRITE_XMP_NEVER) return;
+
+  // without the writer (no gui) the sidecar is written right away
+  if(!_sidecars.thread)
+  {
+    dt_image_write_sidecar_file(imgid);
+    return;
+  }
+
+  gint64 *changed = g_new(gint64, 1);
+  *changed = g_get_monotonic_time();
+  g_mutex_lock(&_sidecars.lock);
+  // a change of an image already waiting only pushes its time on
+  g_hash_table_insert(_sidecars.dirty, GINT_TO_POINTER(imgid), changed);
+  g_cond_signal(&_sidecars.cond);
+  g_mutex_unlock(&_sidecars.lock);
+}
+
+static void _sidecar_forget(const int32_t imgid)
+{
+  if(!_sidecars.thread) return;
+  g_mutex_lock(&_sidecars.lock);
+  g_hash_table_remove(_sidecars.dirty, GINT_TO_POINTER(imgid));
+  g_mutex_unlock(&_sidecars.lock);
+}
+
 int dt_image_write_sidecar_file(const int32_t imgid)
 {
   // TODO: compute hash and don't write if not needed!
   // write .xmp file
   if((imgid > 0) && (dt_image_get_xmp_mode() != DT_WRITE_XMP_NEVER))
   {
+    // bulk changes get their sidecars written once committed
+    if(dt_database_batch_defer_sidecar(darktable.db, imgid)) return 0;
+
     char filename[PATH_MAX] = { 0 };
 
     // FIRST: check if the original file is present
@@ -2479,7 +2775,7 @@ void dt_image_synch_xmps(const GList *img)
   {
     for(const GList *imgs = img; imgs; imgs = g_list_next(imgs))
     {
-      dt_image_write_sidecar_file(GPOINTER_TO_INT(imgs->data));
+      dt_image_sidecar_mark_dirty(GPOINTER_TO_INT(imgs->data));
     }
   }
 }
@@ -2488,7 +2784,7 @@ void dt_image_synch_xmp(const int selected)
 {
   if(selected > 0)
   {
-    dt_image_write_sidecar_file(selected);
+    dt_image_sidecar_mark_dirty(selected);
   }
   else
   {
@@ -2505,7 +2801,7 @@ void dt_image_synch_all_xmp(const gchar *pathname)
     const int imgid = dt_image_get_id_full_path(pathname);
     if(imgid != -1)
     {
-      dt_image_write_sidecar_file(imgid);
+      dt_image_sidecar_mark_dirty(imgid);
     }
   }
 }
@@ -94,6 +94,8 @@ typedef enum
   DT_IMAGE_MONOCHROME_BAYER = 1 << 19,
   // image has a flag set to use the monochrome workflow in the modules supporting it
   DT_IMAGE_MONOCHROME_WORKFLOW = 1 << 20,
+  // the cached thumbnails come from the embedded preview and are still to be replaced by processed ones
+  DT_IMAGE_THUMBNAIL_EMBEDDED = 1 << 21,
 } dt_image_flags_t;
 
 typedef enum dt_image_colorspace_t
@@ -329,6 +331,9 @@ void dt_image_remove(const int32_t imgid);
 int32_t dt_image_duplicate_with_version(const int32_t imgid, const int32_t newversion);
 /** duplicates the given image in the database. */
 int32_t dt_image_duplicate(const int32_t imgid);
+/** duplicates all images of the list in one go, with a copy of their history or none when virgin. returns
+ * the new images. */
+GList *dt_image_duplicate_images(const GList *imgs, const gboolean virgin);
 /** flips the image, clock wise, if given flag. */
 void dt_image_flip(const int32_t imgid, const int32_t cw);
 void dt_image_set_flip(const int32_t imgid, const dt_image_orientation_t user_flip);
@@ -416,6 +421,12 @@ gboolean dt_image_safe_remove(const int32_t imgid);
 void dt_image_local_copy_synch(void);
 // xmp functions:
 int dt_image_write_sidecar_file(const int32_t imgid);
+/** have the sidecar written by the background writer once the image had no changes for a moment. changes in
+    quick succession get a single write. dt_image_synch_xmp() and friends go through it. */
+void dt_image_sidecar_mark_dirty(const int32_t imgid);
+/** start and stop the background writer, stopping writes all sidecars still pending */
+void dt_image_sidecar_writer_start();
+void dt_image_sidecar_writer_stop();
 void dt_image_synch_xmp(const int selected);
 void dt_image_synch_xmps(const GList *img);
 void dt_image_synch_all_xmp(const gchar *pathname);
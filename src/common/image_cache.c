@@ -28,6 +28,178 @@
 #include <sqlite3.h>
 #include <inttypes.h>
 
+// the page holding imgid, allocated if needed. with the write lock held
+static dt_image_hot_page_t *_hot_page(dt_image_hot_table_t *hot, const int32_t imgid)
+{
+  const int32_t p = imgid / DT_IMAGE_HOT_PAGE_SIZE;
+  if(p >= DT_IMAGE_HOT_PAGES) return NULL;
+  dt_image_hot_page_t *page = hot->page[p];
+  if(!page)
+  {
+    page = (dt_image_hot_page_t *)g_malloc0(sizeof(dt_image_hot_page_t));
+    // zeroed before readers can see it
+    g_atomic_pointer_set(&hot->page[p], page);
+  }
+  return page;
+}
+
+// a full barrier between the data and the sequence counter. the atomic
+// ops on the counter alone wouldn't keep the plain reads of the data in place.
+static inline void _hot_fence()
+{
+#if defined(__GNUC__)
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline void _hot_write_begin(dt_image_hot_page_t *page, const int i)
+{
+  dt_atomic_add_int(&page->seq[i], 1);
+  _hot_fence();
+}
+
+static inline void _hot_write_end(dt_image_hot_page_t *page, const int i)
+{
+  _hot_fence();
+  dt_atomic_add_int(&page->seq[i], 1);
+}
+
+// with the write lock held
+static void _hot_store(dt_image_hot_table_t *hot, const dt_image_t *img)
+{
+  dt_image_hot_page_t *page = _hot_page(hot, img->id);
+  if(!page) return;
+  const int i = img->id % DT_IMAGE_HOT_PAGE_SIZE;
+  _hot_write_begin(page, i);
+  page->valid[i] = 1;
+  page->film_id[i] = img->film_id;
+  page->group_id[i] = img->group_id;
+  page->flags[i] = img->flags;
+  page->width[i] = img->width;
+  page->height[i] = img->height;
+  page->final_width[i] = img->final_width;
+  page->final_height[i] = img->final_height;
+  page->aspect_ratio[i] = img->aspect_ratio;
+  page->import_timestamp[i] = img->import_timestamp;
+  page->change_timestamp[i] = img->change_timestamp;
+  page->export_timestamp[i] = img->export_timestamp;
+  page->print_timestamp[i] = img->print_timestamp;
+  _hot_write_end(page, i);
+}
+
+static void _hot_update(dt_image_cache_t *cache, const dt_image_t *img)
+{
+  if(img->id <= 0) return;
+  dt_pthread_mutex_lock(&cache->hot.lock);
+  _hot_store(&cache->hot, img);
+  dt_pthread_mutex_unlock(&cache->hot.lock);
+}
+
+// one pass over the library, much cheaper than what it saves on the first lighttable redraw
+static void _hot_init(dt_image_cache_t *cache)
+{
+  dt_image_hot_table_t *hot = &cache->hot;
+  memset(hot, 0, sizeof(dt_image_hot_table_t));
+  dt_pthread_mutex_init(&hot->lock, NULL);
+
+  dt_image_t img;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT id, film_id, group_id, flags, width, height, output_width, output_height,"
+                              "       aspect_ratio, import_timestamp, change_timestamp, export_timestamp,"
+                              "       print_timestamp"
+                              " FROM main.images",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    img.id = sqlite3_column_int(stmt, 0);
+    img.film_id = sqlite3_column_int(stmt, 1);
+    img.group_id = sqlite3_column_int(stmt, 2);
+    img.flags = sqlite3_column_int(stmt, 3);
+    img.width = sqlite3_column_int(stmt, 4);
+    img.height = sqlite3_column_int(stmt, 5);
+    img.final_width = sqlite3_column_int(stmt, 6);
+    img.final_height = sqlite3_column_int(stmt, 7);
+    img.aspect_ratio = sqlite3_column_type(stmt, 8) == SQLITE_FLOAT ? sqlite3_column_double(stmt, 8) : 0.0;
+    img.import_timestamp = sqlite3_column_int(stmt, 9);
+    img.change_timestamp = sqlite3_column_int(stmt, 10);
+    img.export_timestamp = sqlite3_column_int(stmt, 11);
+    img.print_timestamp = sqlite3_column_int(stmt, 12);
+    if(img.id > 0) _hot_store(hot, &img);
+  }
+  sqlite3_finalize(stmt);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT imgid, color FROM main.color_labels", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int32_t id = sqlite3_column_int(stmt, 0);
+    dt_image_hot_page_t *page = id > 0 && id / DT_IMAGE_HOT_PAGE_SIZE < DT_IMAGE_HOT_PAGES
+                                    ? hot->page[id / DT_IMAGE_HOT_PAGE_SIZE]
+                                    : NULL;
+    if(page) page->colorlabels[id % DT_IMAGE_HOT_PAGE_SIZE] |= 1 << sqlite3_column_int(stmt, 1);
+  }
+  sqlite3_finalize(stmt);
+}
+
+static void _hot_cleanup(dt_image_cache_t *cache)
+{
+  dt_image_hot_table_t *hot = &cache->hot;
+  for(int p = 0; p < DT_IMAGE_HOT_PAGES; p++) g_free(hot->page[p]);
+  dt_pthread_mutex_destroy(&hot->lock);
+}
+
+gboolean dt_image_cache_get_hot(dt_image_cache_t *cache, const int32_t imgid, dt_image_hot_t *out)
+{
+  if(imgid <= 0 || imgid / DT_IMAGE_HOT_PAGE_SIZE >= DT_IMAGE_HOT_PAGES) return FALSE;
+  dt_image_hot_page_t *page = g_atomic_pointer_get(&cache->hot.page[imgid / DT_IMAGE_HOT_PAGE_SIZE]);
+  if(!page) return FALSE;
+  const int i = imgid % DT_IMAGE_HOT_PAGE_SIZE;
+
+  gboolean found;
+  int seq;
+  do
+  {
+    // writers only hold a slot for a few stores, spinning is cheaper than anything else
+    while((seq = dt_atomic_get_int(&page->seq[i])) & 1)
+      ;
+    _hot_fence();
+    found = page->valid[i];
+    out->id = imgid;
+    out->film_id = page->film_id[i];
+    out->group_id = page->group_id[i];
+    out->flags = page->flags[i];
+    out->width = page->width[i];
+    out->height = page->height[i];
+    out->final_width = page->final_width[i];
+    out->final_height = page->final_height[i];
+    out->aspect_ratio = page->aspect_ratio[i];
+    out->colorlabels = page->colorlabels[i];
+    out->import_timestamp = page->import_timestamp[i];
+    out->change_timestamp = page->change_timestamp[i];
+    out->export_timestamp = page->export_timestamp[i];
+    out->print_timestamp = page->print_timestamp[i];
+    _hot_fence();
+  } while(dt_atomic_get_int(&page->seq[i]) != seq);
+
+  return found;
+}
+
+void dt_image_cache_set_hot_colorlabels(dt_image_cache_t *cache, const int32_t imgid, const uint8_t labels)
+{
+  if(imgid <= 0) return;
+  dt_pthread_mutex_lock(&cache->hot.lock);
+  dt_image_hot_page_t *page = _hot_page(&cache->hot, imgid);
+  if(page)
+  {
+    const int i = imgid % DT_IMAGE_HOT_PAGE_SIZE;
+    _hot_write_begin(page, i);
+    page->colorlabels[i] = labels;
+    _hot_write_end(page, i);
+  }
+  dt_pthread_mutex_unlock(&cache->hot.lock);
+}
+
 void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
 {
   entry->cost = sizeof(dt_image_t);
@@ -35,18 +207,18 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   dt_image_t *img = (dt_image_t *)g_malloc(sizeof(dt_image_t));
   dt_image_init(img);
   entry->data = img;
-  // load stuff from db and store in cache:
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
+  // load stuff from db and store in cache, this is done from the worker threads too:
+  sqlite3 *db = dt_database_get_reader(darktable.db);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(
+      darktable.db, db,
       "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure,"
       "       aperture, iso, focal_length, datetime_taken, flags, crop, orientation,"
       "       focus_distance, raw_parameters, longitude, latitude, altitude, color_matrix,"
       "       colorspace, version, raw_black, raw_maximum, aspect_ratio, exposure_bias,"
-      "       import_timestamp, change_timestamp, export_timestamp, print_timestamp, output_width, output_height"
+      "       import_timestamp, change_timestamp, export_timestamp, print_timestamp, output_width, output_height,"
+      "       loader"
       "  FROM main.images"
-      "  WHERE id = ?1",
-      -1, &stmt, NULL);
+      "  WHERE id = ?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, entry->key);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -75,7 +247,6 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
     if(str)
       dt_datetime_exif_to_img(img, str);
     img->flags = sqlite3_column_int(stmt, 14);
-    img->loader = LOADER_UNKNOWN;
     img->exif_crop = sqlite3_column_double(stmt, 15);
     img->orientation = sqlite3_column_int(stmt, 16);
     img->exif_focus_distance = sqlite3_column_double(stmt, 17);
@@ -121,6 +292,9 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
     img->print_timestamp = sqlite3_column_int(stmt, 32);
     img->final_width = sqlite3_column_int(stmt, 33);
     img->final_height = sqlite3_column_int(stmt, 34);
+    // the loader that last opened the file, dt_imageio_open() tries it first
+    const int loader = sqlite3_column_int(stmt, 35);
+    img->loader = loader > LOADER_UNKNOWN && loader < LOADER_COUNT ? (dt_image_loader_t)loader : LOADER_UNKNOWN;
 
     // buffer size? colorspace?
     if(img->flags & DT_IMAGE_LDR)
@@ -156,9 +330,11 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   {
     img->id = -1;
     fprintf(stderr, "[image_cache_allocate] failed to open image %" PRIu32 " from database: %s\n", entry->key,
-            sqlite3_errmsg(dt_database_get(darktable.db)));
+            sqlite3_errmsg(db));
   }
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
+  dt_database_release_reader(darktable.db, db);
+  _hot_update((dt_image_cache_t *)data, img);
   img->cache_entry = entry; // init backref
   // could downgrade lock write->read on entry->lock if we were using concurrencykit..
   dt_image_refresh_makermodel(img);
@@ -184,6 +360,7 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
+  _hot_init(cache);
 
   dt_print(DT_DEBUG_CACHE, "[image_cache] has %d entries\n", num);
 }
@@ -191,6 +368,7 @@ void dt_image_cache_init(dt_image_cache_t *cache)
 void dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
   dt_cache_cleanup(&cache->cache);
+  _hot_cleanup(cache);
 }
 
 void dt_image_cache_print(dt_image_cache_t *cache)
@@ -247,8 +425,8 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   }
   if(img->id <= 0) return;
 
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+  // kept prepared for the next image
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
                               "UPDATE main.images"
                               " SET width = ?1, height = ?2, filename = ?3, maker = ?4, model = ?5,"
                               "     lens = ?6, exposure = ?7, aperture = ?8, iso = ?9, focal_length = ?10,"
@@ -258,9 +436,8 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
                               "     colorspace = ?23, raw_black = ?24, raw_maximum = ?25,"
                               "     aspect_ratio = ROUND(?26,1), exposure_bias = ?27,"
                               "     import_timestamp = ?28, change_timestamp = ?29, export_timestamp = ?30,"
-                              "     print_timestamp = ?31, output_width = ?32, output_height = ?33"
-                              " WHERE id = ?34",
-                              -1, &stmt, NULL);
+                              "     print_timestamp = ?31, output_width = ?32, output_height = ?33, loader = ?35"
+                              " WHERE id = ?34");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->filename, -1, SQLITE_STATIC);
@@ -298,9 +475,11 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 32, img->final_width);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 33, img->final_height);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 34, img->id);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 35, img->loader);
   const int rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
+  _hot_update(cache, img);
 
   // TODO: make this work in relaxed mode, too.
   if(mode == DT_IMAGE_CACHE_SAFE)
@@ -317,6 +496,19 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
 void dt_image_cache_remove(dt_image_cache_t *cache, const int32_t imgid)
 {
   dt_cache_remove(&cache->cache, imgid);
+
+  if(imgid <= 0 || imgid / DT_IMAGE_HOT_PAGE_SIZE >= DT_IMAGE_HOT_PAGES) return;
+  dt_pthread_mutex_lock(&cache->hot.lock);
+  dt_image_hot_page_t *page = cache->hot.page[imgid / DT_IMAGE_HOT_PAGE_SIZE];
+  if(page)
+  {
+    const int i = imgid % DT_IMAGE_HOT_PAGE_SIZE;
+    _hot_write_begin(page, i);
+    page->valid[i] = 0;
+    page->colorlabels[i] = 0;
+    _hot_write_end(page, i);
+  }
+  dt_pthread_mutex_unlock(&cache->hot.lock);
 }
 
 /* set timestamps */
@@ -18,12 +18,54 @@
 
 #pragma once
 
+#include "common/atomic.h"
 #include "common/cache.h"
 #include "common/image.h"
 
+// the few fields the lighttable and collection code look at for every image,
+// small enough to walk a whole library without touching the full dt_image_t.
+typedef struct dt_image_hot_t
+{
+  int32_t id, film_id, group_id, flags;
+  int32_t width, height, final_width, final_height;
+  float aspect_ratio;
+  uint8_t colorlabels; // one bit per color, as from dt_colorlabels_get_labels()
+  time_t import_timestamp, change_timestamp, export_timestamp, print_timestamp;
+}
+dt_image_hot_t;
+
+// the same as a table of arrays indexed by image id, filled from the database at
+// init and kept up to date by dt_image_cache_write_release() and the color labels code.
+// ids are split in pages which are never moved or freed while running, and each slot
+// has a sequence counter: readers never lock, they retry if a writer got in between.
+#define DT_IMAGE_HOT_PAGE_SIZE 4096
+#define DT_IMAGE_HOT_PAGES 4096
+
+typedef struct dt_image_hot_page_t
+{
+  dt_atomic_int seq[DT_IMAGE_HOT_PAGE_SIZE]; // odd while a writer is busy with the slot
+  uint8_t valid[DT_IMAGE_HOT_PAGE_SIZE];
+  int32_t film_id[DT_IMAGE_HOT_PAGE_SIZE], group_id[DT_IMAGE_HOT_PAGE_SIZE], flags[DT_IMAGE_HOT_PAGE_SIZE];
+  int32_t width[DT_IMAGE_HOT_PAGE_SIZE], height[DT_IMAGE_HOT_PAGE_SIZE];
+  int32_t final_width[DT_IMAGE_HOT_PAGE_SIZE], final_height[DT_IMAGE_HOT_PAGE_SIZE];
+  float aspect_ratio[DT_IMAGE_HOT_PAGE_SIZE];
+  uint8_t colorlabels[DT_IMAGE_HOT_PAGE_SIZE];
+  time_t import_timestamp[DT_IMAGE_HOT_PAGE_SIZE], change_timestamp[DT_IMAGE_HOT_PAGE_SIZE];
+  time_t export_timestamp[DT_IMAGE_HOT_PAGE_SIZE], print_timestamp[DT_IMAGE_HOT_PAGE_SIZE];
+}
+dt_image_hot_page_t;
+
+typedef struct dt_image_hot_table_t
+{
+  dt_pthread_mutex_t lock; // serializes writers only
+  dt_image_hot_page_t *page[DT_IMAGE_HOT_PAGES];
+}
+dt_image_hot_table_t;
+
 typedef struct dt_image_cache_t
 {
   dt_cache_t cache;
+  dt_image_hot_table_t hot;
 }
 dt_image_cache_t;
 
@@ -66,6 +108,13 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
 // remove the image from the cache
 void dt_image_cache_remove(dt_image_cache_t *cache, const int32_t imgid);
 
+// copies the hot fields of an image without locking it or touching the database.
+// returns FALSE if the image is unknown, in which case dt_image_cache_get() is the way.
+gboolean dt_image_cache_get_hot(dt_image_cache_t *cache, const int32_t imgid, dt_image_hot_t *hot);
+
+// to be called whenever main.color_labels is changed for an image
+void dt_image_cache_set_hot_colorlabels(dt_image_cache_t *cache, const int32_t imgid, const uint8_t labels);
+
 // register timestamps in cache
 void dt_image_cache_set_change_timestamp(dt_image_cache_t *cache, const int32_t imgid);
 void dt_image_cache_set_change_timestamp_from_image(dt_image_cache_t *cache, const int32_t imgid, const int32_t sourceid);
@@ -152,6 +152,190 @@ void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const
   }
 }
 
+// rows coded together, small enough that there are plenty of bands for all threads
+#define DT_RAW_BAND_ROWS 32
+#define DT_RAW_BLOCK 32
+
+static inline size_t _raw_pack_block(const uint16_t *z, const int n, uint8_t *out)
+{
+  uint32_t all = 0;
+  for(int i = 0; i < n; i++) all |= z[i];
+  const int bits = all ? 32 - __builtin_clz(all) : 0;
+  out[0] = bits;
+  size_t pos = 1;
+  uint64_t acc = 0;
+  int filled = 0;
+  for(int i = 0; i < n; i++)
+  {
+    acc |= (uint64_t)z[i] << filled;
+    filled += bits;
+    while(filled >= 8)
+    {
+      out[pos++] = acc & 0xff;
+      acc >>= 8;
+      filled -= 8;
+    }
+  }
+  if(filled > 0) out[pos++] = acc & 0xff;
+  return pos;
+}
+
+static inline size_t _raw_unpack_block(const uint8_t *in, const int n, uint16_t *z)
+{
+  const int bits = in[0];
+  const uint32_t mask = (1u << bits) - 1;
+  size_t pos = 1;
+  uint64_t acc = 0;
+  int filled = 0;
+  for(int i = 0; i < n; i++)
+  {
+    while(filled < bits)
+    {
+      acc |= (uint64_t)in[pos++] << filled;
+      filled += 8;
+    }
+    z[i] = acc & mask;
+    acc >>= bits;
+    filled -= bits;
+  }
+  return pos;
+}
+
+static inline uint16_t _raw_predict(const uint16_t *band, const int32_t width, const int x, const int y)
+{
+  if(x >= 2) return band[(size_t)y * width + x - 2];
+  return y >= 2 ? band[(size_t)(y - 2) * width + x] : 0;
+}
+
+// worst case: every block at 16 bits plus its header
+static inline size_t _raw_band_bound(const int32_t width, const int rows)
+{
+  return (size_t)rows * ((size_t)width * sizeof(uint16_t) + (width + DT_RAW_BLOCK - 1) / DT_RAW_BLOCK);
+}
+
+static size_t _raw_compress_band(const uint16_t *band, const int32_t width, const int rows, uint8_t *out,
+                                 uint16_t *z)
+{
+  size_t pos = 0;
+  for(int y = 0; y < rows; y++)
+  {
+    const uint16_t *row = band + (size_t)y * width;
+    for(int x = 0; x < width; x++)
+    {
+      const uint16_t d = row[x] - _raw_predict(band, width, x, y);
+      z[x] = (uint16_t)(d << 1) ^ (uint16_t)((int16_t)d >> 15);
+    }
+    for(int x = 0; x < width; x += DT_RAW_BLOCK)
+      pos += _raw_pack_block(z + x, MIN(DT_RAW_BLOCK, width - x), out + pos);
+  }
+  return pos;
+}
+
+static void _raw_uncompress_band(const uint8_t *in, const int32_t width, const int rows, uint16_t *band,
+                                 uint16_t *z)
+{
+  size_t pos = 0;
+  for(int y = 0; y < rows; y++)
+  {
+    for(int x = 0; x < width; x += DT_RAW_BLOCK)
+      pos += _raw_unpack_block(in + pos, MIN(DT_RAW_BLOCK, width - x), z + x);
+    uint16_t *row = band + (size_t)y * width;
+    for(int x = 0; x < width; x++)
+    {
+      const uint16_t d = (z[x] >> 1) ^ (uint16_t)-(z[x] & 1);
+      row[x] = _raw_predict(band, width, x, y) + d;
+    }
+  }
+}
+
+dt_image_raw_compressed_t *dt_image_raw_compress(const uint16_t *in, const int32_t width, const int32_t height)
+{
+  const int bands = (height + DT_RAW_BAND_ROWS - 1) / DT_RAW_BAND_ROWS;
+  const size_t bound = _raw_band_bound(width, DT_RAW_BAND_ROWS);
+  // code into worst case sized bands first, then pack them tightly
+  uint8_t *tmp = dt_alloc_align(64, bound * bands);
+  size_t *sizes = calloc(bands, sizeof(size_t));
+  uint16_t *z = dt_alloc_align(64, sizeof(uint16_t) * width * dt_get_num_threads());
+  if(!tmp || !sizes || !z)
+  {
+    dt_free_align(tmp);
+    free(sizes);
+    dt_free_align(z);
+    return NULL;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, width, height, bands, bound, tmp, sizes, z) \
+  schedule(dynamic)
+#endif
+  for(int b = 0; b < bands; b++)
+  {
+    const int rows = MIN(DT_RAW_BAND_ROWS, height - b * DT_RAW_BAND_ROWS);
+    sizes[b] = _raw_compress_band(in + (size_t)b * DT_RAW_BAND_ROWS * width, width, rows, tmp + b * bound,
+                                  z + (size_t)dt_get_thread_num() * width);
+  }
+
+  size_t total = 0;
+  for(int b = 0; b < bands; b++) total += sizes[b];
+
+  dt_image_raw_compressed_t *raw = calloc(1, sizeof(dt_image_raw_compressed_t));
+  if(raw)
+  {
+    raw->offset = malloc(sizeof(size_t) * (bands + 1));
+    raw->data = malloc(MAX(total, 1));
+  }
+  if(!raw || !raw->offset || !raw->data)
+  {
+    dt_image_raw_compressed_free(raw);
+    raw = NULL;
+  }
+  else
+  {
+    raw->offset[0] = 0;
+    for(int b = 0; b < bands; b++) raw->offset[b + 1] = raw->offset[b] + sizes[b];
+    for(int b = 0; b < bands; b++) memcpy(raw->data + raw->offset[b], tmp + b * bound, sizes[b]);
+    raw->width = width;
+    raw->height = height;
+    raw->bands = bands;
+    raw->size = total + sizeof(size_t) * (bands + 1);
+  }
+  dt_free_align(tmp);
+  free(sizes);
+  dt_free_align(z);
+  return raw;
+}
+
+void dt_image_raw_uncompress(const dt_image_raw_compressed_t *raw, uint16_t *out)
+{
+  const int32_t width = raw->width;
+  const int32_t height = raw->height;
+  const int bands = raw->bands;
+  uint16_t *z = dt_alloc_align(64, sizeof(uint16_t) * width * dt_get_num_threads());
+  if(!z) return;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(raw, out, width, height, bands, z) \
+  schedule(dynamic)
+#endif
+  for(int b = 0; b < bands; b++)
+  {
+    const int rows = MIN(DT_RAW_BAND_ROWS, height - b * DT_RAW_BAND_ROWS);
+    _raw_uncompress_band(raw->data + raw->offset[b], width, rows, out + (size_t)b * DT_RAW_BAND_ROWS * width,
+                         z + (size_t)dt_get_thread_num() * width);
+  }
+  dt_free_align(z);
+}
+
+void dt_image_raw_compressed_free(dt_image_raw_compressed_t *raw)
+{
+  if(!raw) return;
+  free(raw->offset);
+  free(raw->data);
+  free(raw);
+}
+
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
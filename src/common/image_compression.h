@@ -18,13 +18,33 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
+#include <stddef.h>
 
 /** K. Roimela, T. Aarnio and J. Itäranta. High Dynamic Range Texture Compression. Proceedings of SIGGRAPH
  * 2006. */
 void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height);
 void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height);
 
+/** lossless compression of 16 bit single channel (mosaic) data. every pixel is predicted from the one two
+ * columns to the left, or two rows up at the start of a row, which has the same color in bayer patterns. the
+ * zigzag coded residuals are bit packed in blocks of 32. bands of rows are coded independently and in
+ * parallel. */
+typedef struct dt_image_raw_compressed_t
+{
+  int32_t width, height;
+  int32_t bands;   // number of independently coded bands of rows
+  size_t *offset;  // start of every band in data, bands + 1 entries
+  uint8_t *data;
+  size_t size;     // bytes in data and offset together
+} dt_image_raw_compressed_t;
+
+/** returns NULL if out of memory. */
+dt_image_raw_compressed_t *dt_image_raw_compress(const uint16_t *in, const int32_t width, const int32_t height);
+void dt_image_raw_uncompress(const dt_image_raw_compressed_t *raw, uint16_t *out);
+void dt_image_raw_compressed_free(dt_image_raw_compressed_t *raw);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
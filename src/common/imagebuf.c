@@ -18,10 +18,35 @@
 
 #include <stdarg.h>
 #include "common/imagebuf.h"
+#include "develop/pixelpipe_hb.h"
 
 static size_t parallel_imgop_minimum = 500000;
 static size_t parallel_imgop_maxthreads = 4;
 
+// take the buffer from the scratch arena of the running pipe if there is one
+static float *_alloc_image_buffer(const size_t nfloats, const gboolean keep)
+{
+  dt_dev_pixelpipe_t *const pipe = keep ? NULL : dt_dev_pixelpipe_current();
+  if(pipe)
+    return (float*)__builtin_assume_aligned(dt_dev_pixelpipe_scratch_alloc(pipe, nfloats * sizeof(float)), 64);
+  return dt_alloc_align_float(nfloats);
+}
+
+float *__restrict__ dt_iop_image_alloc_scratch(const size_t width, const size_t height, const size_t ch)
+{
+  return _alloc_image_buffer(width * height * ch, FALSE);
+}
+
+void dt_iop_image_free(float *const buf)
+{
+  if(!buf) return;
+  dt_dev_pixelpipe_t *const pipe = dt_dev_pixelpipe_current();
+  if(pipe)
+    dt_dev_pixelpipe_scratch_free(pipe, buf);
+  else
+    dt_free_align(buf);
+}
+
 // Allocate one or more buffers as detailed in the given parameters.  If any allocation fails, free all of them,
 // set the module's trouble flag, and return FALSE.
 gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
@@ -87,13 +112,15 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
     }
     if (size & DT_IMGSZ_PERTHREAD)
     {
-      *bufptr = dt_alloc_perthread_float(nfloats,paddedsize);
+      // same layout as dt_alloc_perthread_float()
+      *paddedsize = dt_round_size(nfloats, 16);
+      *bufptr = _alloc_image_buffer(*paddedsize * dt_get_num_threads(), size & DT_IMGSZ_KEEP);
       if ((size & DT_IMGSZ_CLEARBUF) && *bufptr)
         memset(*bufptr, 0, *paddedsize * dt_get_num_threads() * sizeof(float));
     }
     else
     {
-      *bufptr = dt_alloc_align_float(nfloats);
+      *bufptr = _alloc_image_buffer(nfloats, size & DT_IMGSZ_KEEP);
       if ((size & DT_IMGSZ_CLEARBUF) && *bufptr)
         memset(*bufptr, 0, nfloats * sizeof(float));
     }
@@ -122,7 +149,7 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
         (void)va_arg(args,size_t*);  // skip the extra pointer for per-thread allocations
       if (size == 0 || !bufptr || !*bufptr)
         break;  // end of arg list or this attempted allocation failed
-      dt_free_align(*bufptr);
+      dt_iop_image_free(*bufptr);
       *bufptr = NULL;
     }
     va_end(args);
@@ -30,14 +30,22 @@ static inline float *__restrict__ dt_iop_image_alloc(const size_t width, const s
   return dt_alloc_align_float(width * height * ch);
 }
 
+// Same for a temporary of process(), taken from the scratch arena of the running pipe. The return value must be
+// freed with dt_iop_image_free().
+float *__restrict__ dt_iop_image_alloc_scratch(const size_t width, const size_t height, const size_t ch);
+
 // Allocate one or more buffers as detailed in the given parameters.  If any allocation fails, free all of them,
 // set the module's trouble flag, and return FALSE.
+//  Within process() the buffers come from the scratch arena of the running pipe, which recycles them across
+//  modules and runs, so they must be released with dt_iop_image_free() before process() returns.
 //  The variable arguments take the form  SIZE, PTR-to-floatPTR, SIZE, PTR-to-floatPTR, etc. except that if the SIZE
 //  indicates a per-thread allocation, a second pointer is passed: SIZE, PTR-to-floatPTR, PTR-to-size_t, SIZE, etc.
 //  SIZE is the number of floats per pixel, ORed with appropriate flags from the list following below
 gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
                                     const struct dt_iop_roi_t *const roi_in,
                                     const struct dt_iop_roi_t *const roi_out, ...);
+// Release a buffer from dt_iop_alloc_image_buffers(), NULL is fine.
+void dt_iop_image_free(float *const buf);
 // Optional flags to add to size request.  Default is to allocate N channels per pixel according to
 // the dimensions of roi_out
 #define DT_IMGSZ_CH_MASK    0x000FFFF  // isolate just the number of floats per pixel
@@ -48,6 +56,7 @@ gboolean dt_iop_alloc_image_buffers(struct dt_iop_module_t *const module,
 
 #define DT_IMGSZ_PERTHREAD  0x0200000  // allocate a separate buffer for each thread
 #define DT_IMGSZ_CLEARBUF   0x0400000  // zero the allocated buffer
+#define DT_IMGSZ_KEEP       0x0800000  // buffer outlives process(): not from the scratch arena, free with dt_free_align()
 
 #define DT_IMGSZ_DIM_MASK   0x00F0000  // isolate the requested image dimension(s)
 #define DT_IMGSZ_FULL       0x0000000  // full height times width
@@ -23,6 +23,7 @@
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
+#include "common/history.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
@@ -52,11 +53,14 @@
 #include "common/imageio_libraw.h"
 #include "common/mipmap_cache.h"
 #include "common/styles.h"
+#include "common/trace.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
+#include "develop/tiling.h"
 
 #ifdef HAVE_GRAPHICSMAGICK
 #include <magick/api.h>
@@ -73,6 +77,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #ifdef USE_LUA
 #include "lua/image.h"
@@ -81,6 +88,13 @@
 // load a full-res thumbnail:
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space)
+{
+  return dt_imageio_large_thumbnail_scaled(filename, buffer, width, height, color_space, 0, 0);
+}
+
+int dt_imageio_large_thumbnail_scaled(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                                      dt_colorspaces_color_profile_type_t *color_space, const int max_width,
+                                      const int max_height)
 {
   int res = 1;
 
@@ -96,6 +110,7 @@ int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *
     // Decompress the JPG into our own memory format
     dt_imageio_jpeg_t jpg;
     if(dt_imageio_jpeg_decompress_header(buf, bufsize, &jpg)) goto error;
+    dt_imageio_jpeg_set_target_size(&jpg, max_width, max_height);
     *buffer = (uint8_t *)dt_alloc_align(64, sizeof(uint8_t) * 4 * jpg.width * jpg.height);
     if(!*buffer) goto error;
 
@@ -386,41 +401,42 @@ size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
   return (size_t)jj * w + ii;
 }
 
-dt_imageio_retval_t dt_imageio_open_hdr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf)
+// open with a single hdr loader, LOADER_UNKNOWN if it isn't one of them
+static dt_imageio_retval_t _open_hdr_with(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf,
+                                          const dt_image_loader_t loader)
 {
-  // if buf is NULL, don't proceed
-  if(!buf) return DT_IMAGEIO_OK;
   // needed to alloc correct buffer size:
   img->buf_dsc.channels = 4;
   img->buf_dsc.datatype = TYPE_FLOAT;
   img->buf_dsc.cst = IOP_CS_RGB;
   dt_imageio_retval_t ret;
-  dt_image_loader_t loader;
+  switch(loader)
+  {
 #ifdef HAVE_OPENEXR
-  loader = LOADER_EXR;
-  ret = dt_imageio_open_exr(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL) goto return_label;
+    case LOADER_EXR:
+      ret = dt_imageio_open_exr(img, filename, buf);
+      break;
 #endif
-  loader = LOADER_RGBE;
-  ret = dt_imageio_open_rgbe(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL) goto return_label;
-  loader = LOADER_PFM;
-  ret = dt_imageio_open_pfm(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL) goto return_label;
-
+    case LOADER_RGBE:
+      ret = dt_imageio_open_rgbe(img, filename, buf);
+      break;
+    case LOADER_PFM:
+      ret = dt_imageio_open_pfm(img, filename, buf);
+      break;
 #ifdef HAVE_LIBAVIF
-  ret = dt_imageio_open_avif(img, filename, buf);
-  loader = LOADER_AVIF;
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL) goto return_label;
+    case LOADER_AVIF:
+      ret = dt_imageio_open_avif(img, filename, buf);
+      break;
 #endif
-
 #ifdef HAVE_LIBHEIF
-  ret = dt_imageio_open_heif(img, filename, buf);
-  loader = LOADER_HEIF;
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL) goto return_label;
+    case LOADER_HEIF:
+      ret = dt_imageio_open_heif(img, filename, buf);
+      break;
 #endif
+    default:
+      return DT_IMAGEIO_FILE_CORRUPTED;
+  }
 
-return_label:
   if(ret == DT_IMAGEIO_OK)
   {
     img->buf_dsc.filters = 0u;
@@ -433,6 +449,33 @@ return_label:
   return ret;
 }
 
+static const dt_image_loader_t _imageio_hdr_loaders[] = {
+#ifdef HAVE_OPENEXR
+  LOADER_EXR,
+#endif
+  LOADER_RGBE,
+  LOADER_PFM,
+#ifdef HAVE_LIBAVIF
+  LOADER_AVIF,
+#endif
+#ifdef HAVE_LIBHEIF
+  LOADER_HEIF,
+#endif
+};
+
+dt_imageio_retval_t dt_imageio_open_hdr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf)
+{
+  // if buf is NULL, don't proceed
+  if(!buf) return DT_IMAGEIO_OK;
+  dt_imageio_retval_t ret = DT_IMAGEIO_FILE_CORRUPTED;
+  for(size_t k = 0; k < sizeof(_imageio_hdr_loaders) / sizeof(_imageio_hdr_loaders[0]); k++)
+  {
+    ret = _open_hdr_with(img, filename, buf, _imageio_hdr_loaders[k]);
+    if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL) break;
+  }
+  return ret;
+}
+
 /* magic data: exclusion,offset,length, xx, yy, ...
     just add magic bytes to match to this struct
     to extend mathc on ldr formats.
@@ -495,39 +538,38 @@ static const uint8_t _imageio_ldr_magic[] = {
   0x00, 0x00, 0x02, 0x50, 0x36
 };
 
+// 1 for an ldr magic, 0 for an excluded one (raw files looking like tiff), -1 for no match at all
+static int _ldr_magic_match(const uint8_t *block)
+{
+  size_t offset = 0;
+  while(offset < sizeof(_imageio_ldr_magic))
+  {
+    if(_imageio_ldr_magic[offset + 2] > 32
+      || offset + 3 + _imageio_ldr_magic[offset + 2] > sizeof(_imageio_ldr_magic))
+    {
+      fprintf(stderr, "error: buffer in %s is too small!\n", __FUNCTION__);
+      return -1;
+    }
+    if(memcmp(_imageio_ldr_magic + offset + 3, block + _imageio_ldr_magic[offset + 1],
+              _imageio_ldr_magic[offset + 2]) == 0)
+      return _imageio_ldr_magic[offset] == 0x01 ? 0 : 1;
+    offset += 3 + (_imageio_ldr_magic + offset)[2];
+  }
+  return -1;
+}
+
 gboolean dt_imageio_is_ldr(const char *filename)
 {
   FILE *fin = g_fopen(filename, "rb");
   if(fin)
   {
-    size_t offset = 0;
     uint8_t block[32] = { 0 }; // keep this big enough for whatever magic size we want to compare to!
     /* read block from file */
-    size_t s = fread(block, sizeof(block), 1, fin);
+    const size_t s = fread(block, sizeof(block), 1, fin);
     fclose(fin);
 
     /* compare magic's */
-    while(s)
-    {
-      if(_imageio_ldr_magic[offset + 2] > sizeof(block)
-        || offset + 3 + _imageio_ldr_magic[offset + 2] > sizeof(_imageio_ldr_magic))
-      {
-        fprintf(stderr, "error: buffer in %s is too small!\n", __FUNCTION__);
-        return FALSE;
-      }
-      if(memcmp(_imageio_ldr_magic + offset + 3, block + _imageio_ldr_magic[offset + 1],
-                _imageio_ldr_magic[offset + 2]) == 0)
-      {
-        if(_imageio_ldr_magic[offset] == 0x01)
-          return FALSE;
-        else
-          return TRUE;
-      }
-      offset += 3 + (_imageio_ldr_magic + offset)[2];
-
-      /* check if finished */
-      if(offset >= sizeof(_imageio_ldr_magic)) break;
-    }
+    if(s) return _ldr_magic_match(block) == 1;
   }
   return FALSE;
 }
@@ -557,77 +599,123 @@ int dt_imageio_is_hdr(const char *filename)
   return 0;
 }
 
-// transparent read method to load ldr image to dt_raw_image_t with exif and so on.
-dt_imageio_retval_t dt_imageio_open_ldr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf)
+// open with a single ldr loader, fails for anything that isn't one of them
+static dt_imageio_retval_t _open_ldr_with(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf,
+                                          const dt_image_loader_t loader)
 {
-  // if buf is NULL, don't proceed
-  if(!buf) return DT_IMAGEIO_OK;
   dt_imageio_retval_t ret;
-
-  ret = dt_imageio_open_jpeg(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL)
-  {
-    img->buf_dsc.cst = IOP_CS_RGB; // jpeg is always RGB
-    img->buf_dsc.filters = 0u;
-    img->flags &= ~DT_IMAGE_RAW;
-    img->flags &= ~DT_IMAGE_S_RAW;
-    img->flags &= ~DT_IMAGE_HDR;
-    img->flags |= DT_IMAGE_LDR;
-    img->loader = LOADER_JPEG;
-    return ret;
-  }
-
-  ret = dt_imageio_open_tiff(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL)
+  switch(loader)
   {
-    // cst is set by dt_imageio_open_tiff()
-    img->buf_dsc.filters = 0u;
-    // TIFF can be HDR or LDR. corresponding flags are set in dt_imageio_open_tiff()
-    img->flags &= ~DT_IMAGE_RAW;
-    img->flags &= ~DT_IMAGE_S_RAW;
-    img->loader = LOADER_TIFF;
-    return ret;
+    case LOADER_JPEG:
+      ret = dt_imageio_open_jpeg(img, filename, buf);
+      break;
+    case LOADER_TIFF:
+      ret = dt_imageio_open_tiff(img, filename, buf);
+      break;
+    case LOADER_PNG:
+      ret = dt_imageio_open_png(img, filename, buf);
+      break;
+#ifdef HAVE_OPENJPEG
+    case LOADER_J2K:
+      ret = dt_imageio_open_j2k(img, filename, buf);
+      break;
+#endif
+    case LOADER_PNM:
+      ret = dt_imageio_open_pnm(img, filename, buf);
+      break;
+    default:
+      return DT_IMAGEIO_FILE_CORRUPTED;
   }
+  if(ret != DT_IMAGEIO_OK && ret != DT_IMAGEIO_CACHE_FULL) return ret;
 
-  ret = dt_imageio_open_png(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL)
+  // TIFF can be HDR or LDR, cst and the corresponding flags are set in dt_imageio_open_tiff().
+  // all the others are always RGB
+  if(loader != LOADER_TIFF)
   {
-    img->buf_dsc.cst = IOP_CS_RGB; // png is always RGB
-    img->buf_dsc.filters = 0u;
-    img->flags &= ~DT_IMAGE_RAW;
-    img->flags &= ~DT_IMAGE_S_RAW;
+    img->buf_dsc.cst = IOP_CS_RGB;
     img->flags &= ~DT_IMAGE_HDR;
     img->flags |= DT_IMAGE_LDR;
-    img->loader = LOADER_PNG;
-    return ret;
   }
+  img->buf_dsc.filters = 0u;
+  img->flags &= ~DT_IMAGE_RAW;
+  img->flags &= ~DT_IMAGE_S_RAW;
+  img->loader = loader;
+  return ret;
+}
 
+static const dt_image_loader_t _imageio_ldr_loaders[] = {
+  LOADER_JPEG,
+  LOADER_TIFF,
+  LOADER_PNG,
 #ifdef HAVE_OPENJPEG
-  ret = dt_imageio_open_j2k(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL)
+  LOADER_J2K,
+#endif
+  LOADER_PNM,
+};
+
+static gboolean _has_tiff_extension(const char *filename)
+{
+  const char *c = filename + strlen(filename);
+  while(c > filename && *c != '.') c--;
+  return !strcasecmp(c, ".tif") || !strcasecmp(c, ".tiff");
+}
+
+dt_image_loader_t dt_imageio_sniff_loader(const char *filename)
+{
+  uint8_t block[32] = { 0 };
+  FILE *fin = g_fopen(filename, "rb");
+  if(!fin) return LOADER_UNKNOWN;
+  const size_t len = fread(block, 1, sizeof(block), fin);
+  fclose(fin);
+  if(len < 12) return LOADER_UNKNOWN;
+
+  if(block[0] == 0xff && block[1] == 0xd8) return LOADER_JPEG;
+  if(!memcmp(block, "\x89PNG", 4)) return LOADER_PNG;
+#ifdef HAVE_OPENJPEG
+  if(!memcmp(block, "\x00\x00\x00\x0cjP  \x0d\x0a\x87\x0a", 12) || !memcmp(block, "\xff\x4f\xff\x51", 4))
+    return LOADER_J2K;
+#endif
+  if(block[0] == 'P' && block[1] >= '4' && block[1] <= '6') return LOADER_PNM;
+  if(block[0] == 'P' && (block[1] == 'F' || block[1] == 'f') && g_ascii_isspace(block[2])) return LOADER_PFM;
+  if(block[0] == '#' && block[1] == '?') return LOADER_RGBE;
+#ifdef HAVE_OPENEXR
+  if(!memcmp(block, "\x76\x2f\x31\x01", 4)) return LOADER_EXR;
+#endif
+
+  // iso media: heif, avif and canon cr3 all look the same up to their brand
+  if(!memcmp(block + 4, "ftyp", 4))
   {
-    img->buf_dsc.cst = IOP_CS_RGB; // j2k is always RGB
-    img->buf_dsc.filters = 0u;
-    img->flags &= ~DT_IMAGE_RAW;
-    img->flags &= ~DT_IMAGE_HDR;
-    img->flags &= ~DT_IMAGE_S_RAW;
-    img->flags |= DT_IMAGE_LDR;
-    img->loader = LOADER_J2K;
-    return ret;
-  }
+    const uint8_t *brand = block + 8;
+    if(!memcmp(brand, "crx ", 4)) return LOADER_LIBRAW;
+#ifdef HAVE_LIBAVIF
+    if(!memcmp(brand, "avif", 4) || !memcmp(brand, "avis", 4)) return LOADER_AVIF;
 #endif
+#ifdef HAVE_LIBHEIF
+    if(!memcmp(brand, "heic", 4) || !memcmp(brand, "heix", 4) || !memcmp(brand, "hevc", 4)
+       || !memcmp(brand, "heim", 4) || !memcmp(brand, "heis", 4) || !memcmp(brand, "mif1", 4)
+       || !memcmp(brand, "msf1", 4) || !memcmp(brand, "avif", 4))
+      return LOADER_HEIF;
+#endif
+    return LOADER_UNKNOWN;
+  }
 
-  ret = dt_imageio_open_pnm(img, filename, buf);
-  if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL)
+  // most raw formats are tiff inside, only trust the plain tiff loader with the files it accepts anyway
+  if(!memcmp(block, "II\x2a\x00", 4) || !memcmp(block, "MM\x00\x2a", 4))
+    return _has_tiff_extension(filename) && _ldr_magic_match(block) == 1 ? LOADER_TIFF : LOADER_RAWSPEED;
+
+  return LOADER_UNKNOWN;
+}
+
+// transparent read method to load ldr image to dt_raw_image_t with exif and so on.
+dt_imageio_retval_t dt_imageio_open_ldr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf)
+{
+  // if buf is NULL, don't proceed
+  if(!buf) return DT_IMAGEIO_OK;
+
+  for(size_t k = 0; k < sizeof(_imageio_ldr_loaders) / sizeof(_imageio_ldr_loaders[0]); k++)
   {
-    img->buf_dsc.cst = IOP_CS_RGB; // pnm is always RGB
-    img->buf_dsc.filters = 0u;
-    img->flags &= ~DT_IMAGE_RAW;
-    img->flags &= ~DT_IMAGE_S_RAW;
-    img->flags &= ~DT_IMAGE_HDR;
-    img->flags |= DT_IMAGE_LDR;
-    img->loader = LOADER_PNM;
-    return ret;
+    const dt_imageio_retval_t ret = _open_ldr_with(img, filename, buf, _imageio_ldr_loaders[k]);
+    if(ret == DT_IMAGEIO_OK || ret == DT_IMAGEIO_CACHE_FULL) return ret;
   }
 
   return DT_IMAGEIO_FILE_CORRUPTED;
@@ -671,7 +759,404 @@ int dt_imageio_export(const int32_t imgid, const char *filename, dt_imageio_modu
   }
 }
 
+gchar *dt_imageio_export_fingerprint(const int32_t imgid, dt_imageio_module_format_t *format,
+                                     dt_imageio_module_data_t *format_params, dt_imageio_module_storage_t *storage,
+                                     dt_imageio_module_data_t *storage_params, const gboolean high_quality,
+                                     const gboolean upscale, dt_colorspaces_color_profile_type_t icc_type,
+                                     const gchar *icc_filename, dt_iop_color_intent_t icc_intent,
+                                     dt_export_metadata_t *metadata)
+{
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA1);
+
+  dt_history_hash_values_t hash;
+  dt_history_hash_read(imgid, &hash);
+  if(hash.current)
+    g_checksum_update(checksum, hash.current, hash.current_len);
+  else if(hash.basic)
+    g_checksum_update(checksum, hash.basic, hash.basic_len);
+  free(hash.basic);
+  free(hash.auto_apply);
+  free(hash.current);
+
+  // the common part of the format params also holds the size of the last export, only take the settings
+  g_checksum_update(checksum, (const guchar *)format->plugin_name, -1);
+  g_checksum_update(checksum, (const guchar *)&format_params->max_width, sizeof(format_params->max_width));
+  g_checksum_update(checksum, (const guchar *)&format_params->max_height, sizeof(format_params->max_height));
+  g_checksum_update(checksum, (const guchar *)format_params->style, -1);
+  g_checksum_update(checksum, (const guchar *)&format_params->style_append, sizeof(format_params->style_append));
+  const size_t fsize = format->params_size(format);
+  if(fsize > sizeof(dt_imageio_module_data_t))
+    g_checksum_update(checksum, (const guchar *)format_params + sizeof(dt_imageio_module_data_t),
+                      fsize - sizeof(dt_imageio_module_data_t));
+
+  if(storage)
+  {
+    g_checksum_update(checksum, (const guchar *)storage->plugin_name, -1);
+    if(storage_params)
+      g_checksum_update(checksum, (const guchar *)storage_params, storage->params_size(storage));
+    if(storage->extra_sizes)
+    {
+      const char *sizes = storage->extra_sizes(storage, storage_params);
+      if(sizes) g_checksum_update(checksum, (const guchar *)sizes, -1);
+    }
+  }
+
+  const int settings[] = { high_quality, upscale, icc_type, icc_intent, metadata ? metadata->flags : 0 };
+  g_checksum_update(checksum, (const guchar *)settings, sizeof(settings));
+  if(icc_filename) g_checksum_update(checksum, (const guchar *)icc_filename, -1);
+  for(const GList *l = metadata ? metadata->list : NULL; l; l = g_list_next(l))
+    g_checksum_update(checksum, (const guchar *)l->data, -1);
+
+  gchar *fingerprint = g_strdup(g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  return fingerprint;
+}
+
+gboolean dt_imageio_export_is_up_to_date(const int32_t imgid, const char *target, const char *fingerprint)
+{
+  if(!g_file_test(target, G_FILE_TEST_IS_REGULAR)) return FALSE;
+
+  gboolean up_to_date = FALSE;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT fingerprint FROM main.export_hash WHERE imgid = ?1 AND target = ?2",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, target, -1, SQLITE_TRANSIENT);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const char *stored = (const char *)sqlite3_column_text(stmt, 0);
+    up_to_date = stored && !strcmp(stored, fingerprint);
+  }
+  sqlite3_finalize(stmt);
+  return up_to_date;
+}
+
+void dt_imageio_export_set_fingerprint(const int32_t imgid, const char *target, const char *fingerprint)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.export_hash (imgid, target, fingerprint)"
+                              " VALUES (?1, ?2, ?3)",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, target, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, fingerprint, -1, SQLITE_TRANSIENT);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+// converts the float RGBA pipe output to 8 or 16 bits per channel in place, optionally swapping red and blue.
+// an output pixel is smaller than an input pixel, so pixels [a, grow * a) write below everything they read and
+// no pixel at or after grow * a. each such block can thus be converted in parallel, one block after the other.
+static void _export_quantize(void *buf, const int bpp, const size_t npixels, const gboolean swap_rb)
+{
+  const float *const in = (const float *)buf;
+  uint8_t *const out8 = (uint8_t *)buf;
+  uint16_t *const out16 = (uint16_t *)buf;
+  const size_t grow = bpp == 8 ? 4 : 2;
+  const float max = bpp == 8 ? 0xff : 0xffff;
+  const int r = swap_rb ? 2 : 0;
+  const int b = swap_rb ? 0 : 2;
+
+  for(size_t start = 0, end = 1; start < npixels; start = end, end = MIN(npixels, end * grow))
+  {
+#ifdef _OPENMP
+#pragma omp parallel for if(end - start > 4096) default(none) \
+  dt_omp_firstprivate(in, out8, out16, start, end, bpp, max, r, b) \
+  schedule(static)
+#endif
+    for(size_t k = start; k < end; k++)
+    {
+      // read the whole pixel first, pixel 0 overlaps itself
+      const float pr = roundf(CLAMP(in[4 * k + r] * max, 0.0f, max));
+      const float pg = roundf(CLAMP(in[4 * k + 1] * max, 0.0f, max));
+      const float pb = roundf(CLAMP(in[4 * k + b] * max, 0.0f, max));
+      if(bpp == 8)
+      {
+        out8[4 * k + 0] = pr;
+        out8[4 * k + 1] = pg;
+        out8[4 * k + 2] = pb;
+      }
+      else
+      {
+        out16[4 * k + 0] = pr;
+        out16[4 * k + 1] = pg;
+        out16[4 * k + 2] = pb;
+      }
+    }
+  }
+}
+
+static __thread dt_imageio_export_times_t _export_times = { 0 };
+
+void dt_imageio_export_get_times(dt_imageio_export_times_t *times)
+{
+  *times = _export_times;
+}
+
+// rows handed to a streaming format at a time, small enough for the band to stay in cache
+#define DT_EXPORT_STREAM_ROWS 64
+
+// write through the format's streaming hooks when it has them, in bands of rows so that a cancelled job stops
+// the encoder half way instead of after the whole file is written
+static int _export_write_image(dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
+                               const char *filename, const void *outbuf, const int bpp,
+                               dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                               void *exif, int exif_len, const int32_t imgid, int num, int total,
+                               struct dt_dev_pixelpipe_t *pipe, const gboolean export_masks, dt_job_t *job)
+{
+  if(export_masks || !format->write_image_begin || !format->write_image_rows || !format->write_image_finish)
+    return format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif, exif_len, imgid,
+                               num, total, pipe, export_masks);
+
+  const int begun = format->write_image_begin(format_params, filename, icc_type, icc_filename, exif, exif_len,
+                                              imgid, num, total, pipe);
+  if(begun < 0)
+    return format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif, exif_len, imgid,
+                               num, total, pipe, export_masks);
+  if(begun) return 1;
+
+  const int height = format_params->height;
+  const size_t stride = (size_t)format_params->width * 4 * (bpp / 8);
+  for(int y = 0; y < height; y += DT_EXPORT_STREAM_ROWS)
+  {
+    const int rows = MIN(DT_EXPORT_STREAM_ROWS, height - y);
+    if((job && dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED)
+       || format->write_image_rows(format_params, (const uint8_t *)outbuf + stride * y, y, rows))
+    {
+      format->write_image_finish(format_params, TRUE);
+      return 1;
+    }
+  }
+  return format->write_image_finish(format_params, FALSE);
+}
+
+// write the smaller copies the storage asks for next to the main output, downscaled from the final buffer
+// instead of running the pipe again for each of them
+static int _export_extra_sizes(const char *list, const int32_t imgid, const char *filename,
+                               dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
+                               const void *outbuf, const int bpp, const int width, const int height, const int sRGB,
+                               const gboolean ignore_exif, dt_colorspaces_color_profile_type_t icc_type,
+                               const gchar *icc_filename, struct dt_dev_pixelpipe_t *pipe, int num, int total,
+                               GList **written)
+{
+  if(!list || !*list) return 0;
+
+  const int longest = MAX(width, height);
+  const size_t npixels = (size_t)width * height;
+  gchar **sizes = g_strsplit(list, ",", -1);
+  float *in = NULL;
+  int res = 0;
+
+  for(gchar **s = sizes; *s && !res; s++)
+  {
+    const int size = atoi(g_strstrip(*s));
+    if(size <= 0 || size >= longest) continue;
+
+    if(!in)
+    {
+      if(bpp == 32)
+        in = (float *)outbuf;
+      else
+      {
+        in = dt_alloc_align_float(4 * npixels);
+        if(!in) break;
+        const uint8_t *const buf8 = (const uint8_t *)outbuf;
+        const uint16_t *const buf16 = (const uint16_t *)outbuf;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(npixels, bpp, buf8, buf16, in) \
+  schedule(static)
+#endif
+        for(size_t k = 0; k < 4 * npixels; k++)
+          in[k] = bpp == 8 ? buf8[k] / 255.0f : buf16[k] / 65535.0f;
+      }
+    }
+
+    const float scale = (float)size / longest;
+    const int ow = MAX(1, (int)roundf(width * scale));
+    const int oh = MAX(1, (int)roundf(height * scale));
+    float *out = dt_alloc_align_float((size_t)4 * ow * oh);
+    if(!out) break;
+
+    const dt_iop_roi_t roi_in = { 0, 0, width, height, 1.0f };
+    const dt_iop_roi_t roi_out = { 0, 0, ow, oh, scale };
+    dt_iop_clip_and_zoom(out, in, &roi_out, &roi_in, ow, width);
+
+    // back to the pixel type the format was handed for the main output, in place
+    const size_t nout = (size_t)4 * ow * oh;
+    if(bpp == 8)
+    {
+      uint8_t *const buf8 = (uint8_t *)out;
+      for(size_t k = 0; k < nout; k++) buf8[k] = roundf(CLAMP(out[k] * 0xff, 0, 0xff));
+    }
+    else if(bpp == 16)
+    {
+      uint16_t *const buf16 = (uint16_t *)out;
+      for(size_t k = 0; k < nout; k++) buf16[k] = roundf(CLAMP(out[k] * 0xffff, 0, 0xffff));
+    }
+
+    // name.jpg -> name_1080.jpg
+    const char *dot = strrchr(filename, '.');
+    const char *slash = strrchr(filename, G_DIR_SEPARATOR);
+    if(!dot || (slash && dot < slash)) dot = filename + strlen(filename);
+    gchar *name = g_strdup_printf("%.*s_%d%s", (int)(dot - filename), filename, size, dot);
+
+    format_params->width = ow;
+    format_params->height = oh;
+
+    uint8_t *exif_profile = NULL;
+    int length = 0;
+    if(!ignore_exif)
+    {
+      char pathname[PATH_MAX] = { 0 };
+      gboolean from_cache = TRUE;
+      dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+      length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, ow, oh, 0);
+    }
+
+    res = format->write_image(format_params, name, out, icc_type, icc_filename, exif_profile, length, imgid, num,
+                              total, pipe, FALSE);
+    free(exif_profile);
+    dt_free_align(out);
+
+    if(res)
+    {
+      dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export] failed to write scaled copy `%s'\n", name);
+      g_free(name);
+    }
+    else
+      *written = g_list_prepend(*written, name);
+  }
+
+  if(in != outbuf) dt_free_align(in);
+  g_strfreev(sizes);
+
+  format_params->width = width;
+  format_params->height = height;
+  return res;
+}
+
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
+// modules processing each pixel on its own don't need to see the whole image, even without tiling support
+static gboolean _export_pointwise_module(const dt_iop_module_t *module)
+{
+  static const char *ops[] = { "gamma", "dither", "invert", "colorbalance", "lut3d", NULL };
+  for(const char **op = ops; *op; op++)
+    if(!strcmp(module->op, *op)) return TRUE;
+  return FALSE;
+}
+
+// runs the whole pipe on output tiles instead of the full image at once, so that no module ever holds more
+// than tile sized buffers. every tile is processed with a margin wide enough for the neighbourhoods of all
+// modules, summed up from their tiling requirements along the modify_roi_in() chain, and only its inner part
+// is kept. modules which need to see the whole image (the ones not allowing tiling) keep the pipe in one
+// piece. returns the assembled output or NULL if the pipe has to run at once.
+static uint8_t *_export_pipe_tiled(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const gboolean process_8bit,
+                                   const int width, const int height, const double scale)
+{
+  if(!dt_conf_get_bool("plugins/lighttable/export/tiled_pipe")) return NULL;
+
+  dt_iop_roi_t roi_out = { 0, 0, width, height, scale };
+  float margin = 0.0f;
+  float factor = 1.0f;
+  for(const GList *nodes = g_list_last(pipe->nodes); nodes; nodes = g_list_previous(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    if(!piece->enabled) continue;
+    if(!(module->flags() & IOP_FLAGS_ALLOW_TILING) && !_export_pointwise_module(module))
+    {
+      dt_print(DT_DEBUG_IMAGEIO, "[export_pipe_tiled] module '%s' needs the whole image, no tiling\n",
+               module->op);
+      return NULL;
+    }
+    dt_iop_roi_t roi_in = roi_out;
+    module->modify_roi_in(module, piece, &roi_out, &roi_in);
+    dt_develop_tiling_t tiling = { 0 };
+    module->tiling_callback(module, piece, &roi_in, &roi_out, &tiling);
+    // the overlap is in the module's input pixels
+    margin += tiling.overlap * scale / MAX(roi_in.scale, 1e-6f);
+    factor = MAX(factor, tiling.factor);
+    roi_out = roi_in;
+  }
+
+  // a module's buffers plus the input and output of the pipe on top
+  const size_t px_size = process_8bit ? 4 * sizeof(uint8_t) : 4 * sizeof(float);
+  const float cost = 4 * sizeof(float) * (factor + 2.0f);
+  const float budget = dt_get_available_mem();
+  if((float)width * height * cost <= budget) return NULL;
+
+  const int pad = ceilf(margin) + 8; // some slack for the rounding along the modify_roi_in() chain
+  const int tile = sqrtf(budget / cost);
+  const int good = tile - 2 * pad;
+  if(good < MAX(64, 2 * pad))
+  {
+    dt_print(DT_DEBUG_IMAGEIO, "[export_pipe_tiled] margin of %d is too wide for tiles of %d, no tiling\n",
+             pad, tile);
+    return NULL;
+  }
+
+  uint8_t *out = dt_alloc_align(64, (size_t)width * height * px_size);
+  if(!out) return NULL;
+
+  const int tiles_x = (width + good - 1) / good;
+  const int tiles_y = (height + good - 1) / good;
+  dt_print(DT_DEBUG_IMAGEIO, "[export_pipe_tiled] %d x %d tiles of %d with a margin of %d for %d x %d\n",
+           tiles_x, tiles_y, good, pad, width, height);
+
+  for(int ty = 0; ty < tiles_y; ty++)
+    for(int tx = 0; tx < tiles_x; tx++)
+    {
+      if(dt_atomic_get_int(&pipe->shutdown))
+      {
+        dt_free_align(out);
+        return NULL;
+      }
+
+      // the good part of the tile and the region actually processed around it
+      const int gx = tx * good, gy = ty * good;
+      const int gw = MIN(good, width - gx), gh = MIN(good, height - gy);
+      const int x = MAX(gx - pad, 0), y = MAX(gy - pad, 0);
+      const int w = MIN(gx + gw + pad, width) - x, h = MIN(gy + gh + pad, height) - y;
+
+      const int failed = process_8bit ? dt_dev_pixelpipe_process(pipe, dev, x, y, w, h, scale)
+                                      : dt_dev_pixelpipe_process_no_gamma(pipe, dev, x, y, w, h, scale);
+      if(failed || !pipe->backbuf)
+      {
+        dt_free_align(out);
+        return NULL;
+      }
+
+      const uint8_t *const in = pipe->backbuf;
+      const size_t offs = ((size_t)(gy - y) * w + (gx - x)) * px_size;
+#ifdef _OPENMP
+#pragma omp parallel for default(none)   dt_omp_firstprivate(in, out, offs, gx, gy, gw, gh, w, width, px_size)   schedule(static)
+#endif
+      for(int j = 0; j < gh; j++)
+        memcpy(out + ((size_t)(gy + j) * width + gx) * px_size, in + offs + (size_t)j * w * px_size,
+               (size_t)gw * px_size);
+    }
+  return out;
+}
+
+// small thumbnails which don't ask for high quality start from the downscaled input of the preview pipe, binned
+// right from the mosaic, so that the modules before demosaic don't run at sensor size for a few hundred pixels
+static gboolean _thumbnail_from_downscaled(const dt_imageio_module_data_t *format_params)
+{
+  if(!dt_conf_get_bool("plugins/lighttable/thumbnail_downscaled_input")) return FALSE;
+  const dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  if(format_params->max_width <= 0 || format_params->max_height <= 0
+     || format_params->max_width > cache->max_width[DT_MIPMAP_F]
+     || format_params->max_height > cache->max_height[DT_MIPMAP_F])
+    return FALSE;
+  const dt_mipmap_size_t level
+      = dt_mipmap_cache_get_matching_size(cache, format_params->max_width, format_params->max_height);
+  const char *min = dt_conf_get_string_const("plugins/lighttable/thumbnail_hq_min_level");
+  return level < dt_mipmap_cache_get_min_mip_from_pref(min);
+}
+
 int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  dt_imageio_module_format_t *format, dt_imageio_module_data_t *format_params,
                                  const gboolean ignore_exif, const gboolean display_byteorder,
@@ -682,11 +1167,33 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  dt_imageio_module_data_t *storage_params, int num, int total,
                                  dt_export_metadata_t *metadata)
 {
+  // the job we are run from, if any, so that cancelling it gets through to the pipe
+  dt_job_t *job = dt_control_job_get_current();
+  _export_times = (dt_imageio_export_times_t){ 0 };
+  double stage_start = dt_get_wtime();
+
+  // whether the full buffer is in memory already, or only gets loaded for this export
+  gboolean full_resident = TRUE;
+  if(!thumbnail_export)
+  {
+    dt_mipmap_buffer_t probe;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &probe, imgid, DT_MIPMAP_FULL, DT_MIPMAP_TESTLOCK, 'r');
+    full_resident = probe.buf != NULL;
+    dt_mipmap_cache_release(darktable.mipmap_cache, &probe);
+  }
+
   dt_develop_t dev;
   dt_dev_init(&dev, 0);
   dt_dev_load_image(&dev, imgid);
 
-  const gboolean buf_is_downscaled = (thumbnail_export && dt_conf_get_bool("ui/performance"));
+  if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED)
+  {
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+
+  const gboolean buf_is_downscaled
+      = thumbnail_export && (dt_conf_get_bool("ui/performance") || _thumbnail_from_downscaled(format_params));
   dt_mipmap_buffer_t buf;
   if(buf_is_downscaled)
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
@@ -705,12 +1212,15 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   const int wd = img->width;
   const int ht = img->height;
 
+  _export_times.load = dt_get_wtime() - stage_start;
+  stage_start = dt_get_wtime();
 
   int res = 0;
 
   dt_times_t start;
   dt_get_times(&start);
   dt_dev_pixelpipe_t pipe;
+  uint8_t *tiled_buf = NULL;
   res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
                          : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params), export_masks);
   if(!res)
@@ -754,6 +1264,8 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
   dt_dev_pixelpipe_create_nodes(&pipe, &dev);
   dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  // cancelling the job stops the pipe right in the module it is running
+  dt_control_job_add_cancel_flag(job, &pipe.shutdown);
   if(darktable.unmuted & DT_DEBUG_IMAGEIO)
   {
     fprintf(stderr,"[dt_imageio_export_with_flags] ");
@@ -944,7 +1456,10 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
      * if high quality processing was requested, downsampling will be done
      * at the very end of the pipe (just before border and watermark)
      */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    if(!thumbnail_export && !export_masks)
+      tiled_buf = _export_pipe_tiled(&pipe, &dev, FALSE, processed_width, processed_height, scale);
+    if(!tiled_buf && !dt_atomic_get_int(&pipe.shutdown))
+      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
   }
   else
   {
@@ -968,98 +1483,82 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
 
     if(finalscale) finalscale->enabled = 0;
 
+    // masks are written from the pipe's own buffers, they need it in one piece
+    if(!thumbnail_export && !export_masks)
+      tiled_buf = _export_pipe_tiled(&pipe, &dev, bpp == 8, processed_width, processed_height, scale);
+
     // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-    else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    if(!tiled_buf && !dt_atomic_get_int(&pipe.shutdown))
+    {
+      if(bpp == 8)
+        dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+      else
+        dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    }
 
     if(finalscale) finalscale->enabled = 1;
   }
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
                                          : "[dev_process_export] pixel pipeline processing");
 
-  uint8_t *outbuf = pipe.backbuf;
+  // cancelled while processing, free everything right away
+  if(dt_atomic_get_int(&pipe.shutdown))
+  {
+    dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export_with_flags] cancelled export of image %d\n", imgid);
+    goto error;
+  }
+
+  uint8_t *outbuf = tiled_buf ? tiled_buf : pipe.backbuf;
   if(outbuf == NULL)
   {
     dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export_with_flags] no valid output buffer\n");
     goto error;
   }
 
+  // the pipe doesn't read its input anymore. a full buffer that was only loaded for this export (batch exports,
+  // mostly) goes right away, instead of staying next to the encoder's buffers and those of the images that
+  // follow until the cache fills up. the one open in darkroom stays.
+  if(!full_resident && !buf_is_downscaled
+     && !(darktable.develop && darktable.develop->image_storage.id == imgid))
+  {
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    if(dt_mipmap_cache_try_evict_at_size(darktable.mipmap_cache, imgid, DT_MIPMAP_FULL))
+      dt_print(DT_DEBUG_MEMORY, "[dt_imageio_export_with_flags] dropped full buffer of image %d before encoding\n",
+               imgid);
+  }
+
   // downconversion to low-precision formats:
   if(bpp == 8)
   {
-    if(display_byteorder)
+    if(high_quality_processing)
+      _export_quantize(outbuf, 8, (size_t)processed_width * processed_height, display_byteorder);
+    else if(!display_byteorder)
     {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
-    }
-    else // need to flip
-    {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = roundf(CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff));
-          const uint8_t g = roundf(CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff));
-          const uint8_t b = roundf(CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff));
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
+      // processing output was 8-bit already, just flip byte order
+      uint8_t *const buf8 = outbuf;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(processed_width, processed_height, buf8) \
   schedule(static)
 #endif
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
+      for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
+      {
+        uint8_t tmp = buf8[4 * k + 0];
+        buf8[4 * k + 0] = buf8[4 * k + 2];
+        buf8[4 * k + 2] = tmp;
       }
     }
   }
   else if(bpp == 16)
-  {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++) buf16[4 * k + i] = roundf(CLAMP(buff[4 * k + i] * 0xffff, 0, 0xffff));
-      }
-  }
+    _export_quantize(outbuf, 16, (size_t)processed_width * processed_height, FALSE);
   // else output float, no further harm done to the pixels :)
 
   format_params->width = processed_width;
   format_params->height = processed_height;
 
+  _export_times.pipe = dt_get_wtime() - stage_start;
+  stage_start = dt_get_wtime();
+
   if(!ignore_exif)
   {
     int length;
@@ -1072,30 +1571,42 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
     // last param is dng mode, it's false here
     length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
 
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe, export_masks);
+    res = _export_write_image(format, format_params, filename, outbuf, bpp, icc_type, icc_filename, exif_profile,
+                              length, imgid, num, total, &pipe, export_masks, job);
 
     free(exif_profile);
   }
   else
   {
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num, total,
-                              &pipe, export_masks);
+    res = _export_write_image(format, format_params, filename, outbuf, bpp, icc_type, icc_filename, NULL, 0,
+                              imgid, num, total, &pipe, export_masks, job);
   }
 
   if(res)
     goto error;
 
+  GList *extra_files = NULL;
+  if(!thumbnail_export && storage && storage->extra_sizes)
+    _export_extra_sizes(storage->extra_sizes(storage, storage_params), imgid, filename, format, format_params,
+                        outbuf, bpp, processed_width, processed_height, sRGB, ignore_exif, icc_type, icc_filename,
+                        &pipe, num, total, &extra_files);
+
+  dt_control_job_remove_cancel_flag(job, &pipe.shutdown);
   dt_dev_pixelpipe_cleanup(&pipe);
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  if(tiled_buf) dt_free_align(tiled_buf);
 
   /* now write xmp into that container, if possible */
   if(copy_metadata && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
   {
     dt_exif_xmp_attach_export(imgid, filename, metadata);
     // no need to cancel the export if this fail
+    for(GList *f = extra_files; f; f = g_list_next(f))
+      dt_exif_xmp_attach_export(imgid, (const char *)f->data, metadata);
   }
+  g_list_free_full(extra_files, g_free);
+  _export_times.encode = dt_get_wtime() - stage_start;
 
   if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
     && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
@@ -1129,7 +1640,9 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
   return 0; // success
 
 error:
+  dt_control_job_remove_cancel_flag(job, &pipe.shutdown);
   dt_dev_pixelpipe_cleanup(&pipe);
+  if(tiled_buf) dt_free_align(tiled_buf);
 error_early:
   dt_dev_cleanup(&dev);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
@@ -1204,20 +1717,66 @@ void dt_imageio_set_hdr_tag(dt_image_t *img)
 //   combined reading
 // =================================================
 
+// go straight to the one loader we expect to open the file
+static dt_imageio_retval_t _open_with(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf,
+                                      const dt_image_loader_t loader)
+{
+  switch(loader)
+  {
+    case LOADER_JPEG:
+    case LOADER_TIFF:
+    case LOADER_PNG:
+    case LOADER_J2K:
+    case LOADER_PNM:
+      if(!buf) return DT_IMAGEIO_OK;
+      return _open_ldr_with(img, filename, buf, loader);
+    case LOADER_EXR:
+    case LOADER_RGBE:
+    case LOADER_PFM:
+    case LOADER_AVIF:
+    case LOADER_HEIF:
+      if(!buf) return DT_IMAGEIO_OK;
+      return _open_hdr_with(img, filename, buf, loader);
+    case LOADER_RAWSPEED:
+      return dt_imageio_open_rawspeed(img, filename, buf);
+    case LOADER_LIBRAW:
+      return dt_imageio_open_libraw(img, filename, buf);
+    case LOADER_GM:
+    case LOADER_IM:
+      return dt_imageio_open_exotic(img, filename, buf);
+    default:
+      return DT_IMAGEIO_FILE_CORRUPTED;
+  }
+}
+
 dt_imageio_retval_t dt_imageio_open(dt_image_t *img,               // non-const * means you hold a write lock!
                                     const char *filename,          // full path
                                     dt_mipmap_buffer_t *buf)
 {
   /* first of all, check if file exists, don't bother to test loading if not exists */
   if(!g_file_test(filename, G_FILE_TEST_IS_REGULAR)) return !DT_IMAGEIO_OK;
+  const double trace_begin = dt_trace_begin();
   const int32_t was_hdr = (img->flags & DT_IMAGE_HDR);
   const int32_t was_bw = dt_image_monochrome_flags(img);
 
   dt_imageio_retval_t ret = DT_IMAGEIO_FILE_CORRUPTED;
+
+  /* the loader that opened the file last time (kept in the library), or a guess from its first bytes. saves
+   * misnamed or unusual files from going through all the loaders below, each opening and parsing them first. */
+  const dt_image_loader_t cached = img->loader;
+  const dt_image_loader_t hint = cached != LOADER_UNKNOWN ? cached : dt_imageio_sniff_loader(filename);
   img->loader = LOADER_UNKNOWN;
+  if(hint != LOADER_UNKNOWN)
+  {
+    ret = _open_with(img, filename, buf, hint);
+    dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_open] %s loader %s for `%s': %s\n",
+             cached != LOADER_UNKNOWN ? "cached" : "sniffed", loaders_info[hint].tooltip, filename,
+             ret == DT_IMAGEIO_OK ? "ok" : "failed, trying all");
+  }
 
   /* check if file is ldr using magic's */
-  if(dt_imageio_is_ldr(filename)) ret = dt_imageio_open_ldr(img, filename, buf);
+  if(ret != DT_IMAGEIO_OK && ret != DT_IMAGEIO_CACHE_FULL && dt_imageio_is_ldr(filename))
+    ret = dt_imageio_open_ldr(img, filename, buf);
 
   /* silly check using file extensions: */
   if(ret != DT_IMAGEIO_OK && ret != DT_IMAGEIO_CACHE_FULL && dt_imageio_is_hdr(filename))
@@ -1237,6 +1796,9 @@ dt_imageio_retval_t dt_imageio_open(dt_image_t *img,               // non-const
   if(ret != DT_IMAGEIO_OK && ret != DT_IMAGEIO_CACHE_FULL)
     ret = dt_imageio_open_exotic(img, filename, buf);
 
+  // nothing was actually read without a buffer, don't forget what we knew
+  if(ret == DT_IMAGEIO_OK && img->loader == LOADER_UNKNOWN) img->loader = cached;
+
   if((ret == DT_IMAGEIO_OK) && !was_hdr && (img->flags & DT_IMAGE_HDR))
     dt_imageio_set_hdr_tag(img);
 
@@ -1246,6 +1808,9 @@ dt_imageio_retval_t dt_imageio_open(dt_image_t *img,               // non-const
   img->p_width = img->width - img->crop_x - img->crop_width;
   img->p_height = img->height - img->crop_y - img->crop_height;
 
+  dt_trace_complete("imageio", loaders_info[img->loader].tooltip, trace_begin,
+                    "\"image\":%d,\"width\":%d,\"height\":%d,\"ok\":%s", img->id, img->width, img->height,
+                    ret == DT_IMAGEIO_OK ? "true" : "false");
   return ret;
 }
 
@@ -1269,6 +1834,63 @@ gboolean dt_imageio_lookup_makermodel(const char *maker, const char *model,
   return found;
 }
 
+// one reader at a time is what spinning disks cope with best, ssds and network storage only reach their
+// throughput with several requests in flight
+void dt_imageio_read_slot_acquire(void)
+{
+  const int limit = dt_conf_get_int("raw_read_concurrency");
+  dt_pthread_mutex_lock(&darktable.readFile_mutex);
+  while(limit > 0 && darktable.readFile_active >= limit)
+    dt_pthread_cond_wait(&darktable.readFile_cond, &darktable.readFile_mutex);
+  darktable.readFile_active++;
+  dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+}
+
+void dt_imageio_read_slot_release(void)
+{
+  dt_pthread_mutex_lock(&darktable.readFile_mutex);
+  darktable.readFile_active--;
+  pthread_cond_signal(&darktable.readFile_cond);
+  dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+}
+
+GMappedFile *dt_imageio_map_file(const char *filename)
+{
+  if(!dt_conf_get_bool("raw_read_mmap")) return NULL;
+
+  GError *error = NULL;
+  GMappedFile *mapped = g_mapped_file_new(filename, FALSE, &error);
+  if(!mapped)
+  {
+    dt_print(DT_DEBUG_IMAGEIO, "[imageio] can't map `%s': %s\n", filename, error ? error->message : "?");
+    if(error) g_error_free(error);
+    return NULL;
+  }
+
+  const gsize size = g_mapped_file_get_length(mapped);
+  const char *data = g_mapped_file_get_contents(mapped);
+  if(size == 0 || !data)
+  {
+    g_mapped_file_unref(mapped);
+    return NULL;
+  }
+
+#ifndef _WIN32
+  // decoders run through the file front to back, let the kernel read ahead accordingly
+  posix_madvise((void *)data, size, POSIX_MADV_SEQUENTIAL);
+  posix_madvise((void *)data, size, POSIX_MADV_WILLNEED);
+#endif
+
+  // touch every page once, so that the disk is read while the caller holds its read slot and not
+  // later on while decoding
+  const volatile char *pages = data;
+  char sum = 0;
+  for(gsize k = 0; k < size; k += 4096) sum ^= pages[k];
+  (void)sum;
+
+  return mapped;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -56,6 +56,8 @@ typedef enum dt_imageio_levels_t
 
 // Checks that the image is indeed an ldr image
 gboolean dt_imageio_is_ldr(const char *filename);
+// guess the loader from the first bytes of the file, LOADER_UNKNOWN if they don't tell
+dt_image_loader_t dt_imageio_sniff_loader(const char *filename);
 // checks that the image has a monochrome preview attached
 gboolean dt_imageio_has_mono_preview(const char *filename);
 // Set the darktable/mode/hdr tag
@@ -72,6 +74,17 @@ dt_imageio_retval_t dt_imageio_open(dt_image_t *img, const char *filename, dt_mi
 dt_imageio_retval_t dt_imageio_open_exotic(dt_image_t *img, const char *filename,
                                            dt_mipmap_buffer_t *buf);
 
+// wall time in seconds spent in the stages of an export
+typedef struct dt_imageio_export_times_t
+{
+  double load;   // history and raw into the full mipmap cache
+  double pipe;   // pixelpipe and conversion to the output bit depth
+  double encode; // format writer and xmp
+} dt_imageio_export_times_t;
+
+// the stage times of the last export run by the calling thread
+void dt_imageio_export_get_times(dt_imageio_export_times_t *times);
+
 struct dt_imageio_module_format_t;
 struct dt_imageio_module_data_t;
 int dt_imageio_export(const int32_t imgid, const char *filename, struct dt_imageio_module_format_t *format,
@@ -91,6 +104,19 @@ int dt_imageio_export_with_flags(const int32_t imgid, const char *filename,
                                  dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
                                  int num, int total, dt_export_metadata_t *metadata);
 
+// fingerprint of everything an export of imgid depends on: its history and the export settings.
+// the result is to be freed with g_free().
+gchar *dt_imageio_export_fingerprint(const int32_t imgid, struct dt_imageio_module_format_t *format,
+                                     struct dt_imageio_module_data_t *format_params,
+                                     dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
+                                     const gboolean high_quality, const gboolean upscale,
+                                     dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                                     dt_iop_color_intent_t icc_intent, dt_export_metadata_t *metadata);
+// whether target exists and was exported from imgid with this fingerprint
+gboolean dt_imageio_export_is_up_to_date(const int32_t imgid, const char *target, const char *fingerprint);
+// remember the fingerprint target was exported with
+void dt_imageio_export_set_fingerprint(const int32_t imgid, const char *target, const char *fingerprint);
+
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
 
@@ -108,12 +134,23 @@ void dt_imageio_flip_buffers_ui8_to_float(float *out, const uint8_t *in, const f
 // allocate buffer and return 0 on success along with largest jpg thumbnail from raw.
 int dt_imageio_large_thumbnail(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
                                dt_colorspaces_color_profile_type_t *color_space);
+// same, but jpegs are decoded at a reduced scale as long as the result still covers max_width x max_height
+int dt_imageio_large_thumbnail_scaled(const char *filename, uint8_t **buffer, int32_t *width, int32_t *height,
+                                      dt_colorspaces_color_profile_type_t *color_space, const int max_width,
+                                      const int max_height);
 
 // lookup maker and model, dispatch lookup to rawspeed or libraw
 gboolean dt_imageio_lookup_makermodel(const char *maker, const char *model,
                                       char *mk, int mk_len, char *md, int md_len,
                                       char *al, int al_len);
 
+// wait for one of the raw_read_concurrency slots to read a raw file, and give it back when done
+void dt_imageio_read_slot_acquire(void);
+void dt_imageio_read_slot_release(void);
+// the file mapped read only and paged in, for decoders reading from memory. NULL if raw_read_mmap is off
+// or the file can't be mapped, callers then read it as before.
+GMappedFile *dt_imageio_map_file(const char *filename);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -25,6 +25,7 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <memory>
+#include <mutex>
 #include <stdio.h>
 #include <string.h>
 
@@ -47,11 +48,24 @@ extern "C" {
 }
 #include "common/imageio_exr.hh"
 
+void dt_imageio_exr_set_threads(void)
+{
+  // setting the count tears down and rebuilds the whole pool, even when it doesn't change. only do that when
+  // it has to, and not from several loaders at once.
+  static std::mutex lock;
+  const int budget = dt_get_num_threads();
+  const int conf = dt_conf_get_int("exr_io_threads");
+  const int threads = conf > 0 ? MIN(conf, budget) : budget;
+
+  std::lock_guard<std::mutex> guard(lock);
+  if(Imf::globalThreadCount() != threads) Imf::setGlobalThreadCount(threads);
+}
+
 dt_imageio_retval_t dt_imageio_open_exr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *mbuf)
 {
   bool isTiled = false;
 
-  Imf::setGlobalThreadCount(dt_get_num_threads());
+  dt_imageio_exr_set_threads();
 
   std::unique_ptr<Imf::TiledInputFile> fileTiled;
   std::unique_ptr<Imf::InputFile> file;
@@ -128,16 +142,20 @@ dt_imageio_retval_t dt_imageio_open_exr(dt_image_t *img, const char *filename, d
     return DT_IMAGEIO_CACHE_FULL;
   }
 
-  // FIXME: is this really needed?
-  memset(buf, 0, sizeof(float) * 4 * img->width * img->height);
+  /* only the data window is stored in the file, the rest of the display window has to be blank. the common case
+   * of both being the same is decoded straight into the cache buffer without clearing it first. */
+  const Imath::Box2i &data = header.dataWindow();
+  if(data.min.x > dw.min.x || data.min.y > dw.min.y || data.max.x < dw.max.x || data.max.y < dw.max.y)
+    memset(buf, 0, sizeof(float) * 4 * img->width * img->height);
 
-  /* setup framebuffer */
+  /* setup framebuffer. the slices are addressed in file coordinates, so move the base to the display origin */
   xstride = sizeof(float) * 4;
   ystride = sizeof(float) * img->width * 4;
-  frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, (char *)(buf + 0), xstride, ystride, 1, 1, 0.0));
-  frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, (char *)(buf + 1), xstride, ystride, 1, 1, 0.0));
-  frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, (char *)(buf + 2), xstride, ystride, 1, 1, 0.0));
-  frameBuffer.insert("A", Imf::Slice(Imf::FLOAT, (char *)(buf + 3), xstride, ystride, 1, 1, 0.0));
+  char *base = (char *)buf - (ptrdiff_t)dw.min.x * xstride - (ptrdiff_t)dw.min.y * ystride;
+  frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, base + 0 * sizeof(float), xstride, ystride, 1, 1, 0.0));
+  frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, base + 1 * sizeof(float), xstride, ystride, 1, 1, 0.0));
+  frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, base + 2 * sizeof(float), xstride, ystride, 1, 1, 0.0));
+  frameBuffer.insert("A", Imf::Slice(Imf::FLOAT, base + 3 * sizeof(float), xstride, ystride, 1, 1, 0.0));
 
   if(isTiled)
   {
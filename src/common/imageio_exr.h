@@ -27,6 +27,9 @@ extern "C" {
 
 dt_imageio_retval_t dt_imageio_open_exr(dt_image_t *img, const char *filename, dt_mipmap_buffer_t *buf);
 
+/** size the global openexr thread pool for the next read or write, see exr_io_threads */
+void dt_imageio_exr_set_threads(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,7 @@
 #endif
 
 #include <inttypes.h>
+#include <limits.h>
 #include <memory.h>
 #include <stdio.h>
 #include <strings.h>
@@ -196,6 +197,100 @@ dt_imageio_retval_t dt_imageio_open_heif(dt_image_t *img,
 }
 
 
+int dt_imageio_heif_thumbnail(const char *filename,
+                              const int max_width,
+                              const int max_height,
+                              uint8_t **buffer,
+                              int32_t *width,
+                              int32_t *height,
+                              dt_colorspaces_color_profile_type_t *color_space)
+{
+  int res = 1;
+  *buffer = NULL;
+  struct heif_image_handle *handle = NULL;
+  struct heif_image_handle *thumb = NULL;
+  struct heif_image *heif_img = NULL;
+  struct heif_color_profile_nclx *nclx = NULL;
+
+  struct heif_context *ctx = heif_context_alloc();
+  if(!ctx) return 1;
+
+  struct heif_error err = heif_context_read_from_file(ctx, filename, NULL);
+  if(err.code != 0) goto out;
+  err = heif_context_get_primary_image_handle(ctx, &handle);
+  if(err.code != 0) goto out;
+
+  /* the thumbnail goes straight to the screen, only take it when the image is sRGB (or doesn't say). anything
+   * else needs the full decode and its profile. */
+  switch(heif_image_handle_get_color_profile_type(handle))
+  {
+    case heif_color_profile_type_not_present:
+      break;
+    case heif_color_profile_type_nclx:
+      err = heif_image_handle_get_nclx_color_profile(handle, &nclx);
+      if(err.code != 0) goto out;
+      if((nclx->color_primaries != heif_color_primaries_ITU_R_BT_709_5
+          && nclx->color_primaries != heif_color_primaries_unspecified)
+         || (nclx->transfer_characteristics != heif_transfer_characteristic_IEC_61966_2_1
+             && nclx->transfer_characteristics != heif_transfer_characteristic_unspecified))
+        goto out;
+      break;
+    default:
+      goto out;
+  }
+
+  // the smallest of the embedded thumbnails still covering the requested size
+  const int num = heif_image_handle_get_number_of_thumbnails(handle);
+  if(num <= 0) goto out;
+  heif_item_id *ids = g_malloc_n(num, sizeof(heif_item_id));
+  heif_image_handle_get_list_of_thumbnail_IDs(handle, ids, num);
+  int best_size = INT_MAX;
+  for(int k = 0; k < num; k++)
+  {
+    struct heif_image_handle *candidate = NULL;
+    if(heif_image_handle_get_thumbnail(handle, ids[k], &candidate).code != 0) continue;
+    const int w = heif_image_handle_get_width(candidate);
+    const int h = heif_image_handle_get_height(candidate);
+    if((w >= max_width || h >= max_height) && w * h < best_size)
+    {
+      if(thumb) heif_image_handle_release(thumb);
+      thumb = candidate;
+      best_size = w * h;
+    }
+    else
+      heif_image_handle_release(candidate);
+  }
+  g_free(ids);
+  if(!thumb) goto out;
+
+  err = heif_decode_image(thumb, &heif_img, heif_colorspace_RGB, heif_chroma_interleaved_RGBA, NULL);
+  if(err.code != 0) goto out;
+
+  int rowbytes = 0;
+  const uint8_t *data = heif_image_get_plane_readonly(heif_img, heif_channel_interleaved, &rowbytes);
+  const int wd = heif_image_get_width(heif_img, heif_channel_interleaved);
+  const int ht = heif_image_get_height(heif_img, heif_channel_interleaved);
+  if(!data || wd <= 0 || ht <= 0) goto out;
+
+  *buffer = (uint8_t *)dt_alloc_align(64, sizeof(uint8_t) * 4 * wd * ht);
+  if(!*buffer) goto out;
+  for(int y = 0; y < ht; y++) memcpy(*buffer + (size_t)4 * y * wd, data + (size_t)y * rowbytes, (size_t)4 * wd);
+
+  dt_print(DT_DEBUG_IMAGEIO, "[imageio_heif] using %dx%d thumbnail of HEIF image [%s]\n", wd, ht, filename);
+  *width = wd;
+  *height = ht;
+  *color_space = DT_COLORSPACE_SRGB;
+  res = 0;
+
+out:
+  if(heif_img) heif_image_release(heif_img);
+  if(nclx) heif_nclx_color_profile_free(nclx);
+  if(thumb) heif_image_handle_release(thumb);
+  if(handle) heif_image_handle_release(handle);
+  heif_context_free(ctx);
+  return res;
+}
+
 int dt_imageio_heif_read_profile(const char *filename,
                                 uint8_t **out,
                                 dt_colorspaces_cicp_t *cicp)
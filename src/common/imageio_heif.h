@@ -25,6 +25,14 @@
 dt_imageio_retval_t dt_imageio_open_heif(dt_image_t *img,
                                          const char *filename,
                                          dt_mipmap_buffer_t *buf);
+/** smallest embedded sRGB thumbnail covering max_width x max_height as 8-bit rgba, 0 on success */
+int dt_imageio_heif_thumbnail(const char *filename,
+                              const int max_width,
+                              const int max_height,
+                              uint8_t **buffer,
+                              int32_t *width,
+                              int32_t *height,
+                              dt_colorspaces_color_profile_type_t *color_space);
 int dt_imageio_heif_read_profile(const char *filename,
                                  uint8_t **out,
                                  dt_colorspaces_cicp_t *cicp);
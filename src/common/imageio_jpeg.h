@@ -60,6 +60,9 @@ int dt_imageio_jpeg_write_with_icc_profile(const char *filename, const uint8_t *
                                            int imgid);
 /** read jpeg header from file, leave file descriptor open until jpeg_read is called. */
 int dt_imageio_jpeg_read_header(const char *filename, dt_imageio_jpeg_t *jpg);
+/** after reading the header: decode at the smallest of 1/2, 1/4 or 1/8 scale still covering width x height.
+ * updates width/height in the jpg struct, does nothing for a target of 0. */
+void dt_imageio_jpeg_set_target_size(dt_imageio_jpeg_t *jpg, const int width, const int height);
 /** reads the jpeg to the (sufficiently allocated) buffer, closes file. */
 int dt_imageio_jpeg_read(dt_imageio_jpeg_t *jpg, uint8_t *out);
 /** reads the color profile attached to the jpeg, closes file. */
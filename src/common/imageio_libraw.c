@@ -221,13 +221,23 @@ dt_imageio_retval_t dt_imageio_open_libraw(dt_image_t *img, const char *filename
   libraw_data_t *raw = libraw_init(0);
   if(!raw) return DT_IMAGEIO_FILE_CORRUPTED;
 
+  // libraw decodes straight from the mapping, it has to stay until libraw_close()
+  dt_imageio_read_slot_acquire();
+  GMappedFile *mapped = dt_imageio_map_file(filename);
+  dt_imageio_read_slot_release();
+
+  if(mapped)
+    libraw_err = libraw_open_buffer(raw, g_mapped_file_get_contents(mapped), g_mapped_file_get_length(mapped));
+  else
+  {
 #if defined(_WIN32) && (defined(UNICODE) || defined(_UNICODE))
-  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
-  libraw_err = libraw_open_wfile(raw, wfilename);
-  g_free(wfilename);
+    wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+    libraw_err = libraw_open_wfile(raw, wfilename);
+    g_free(wfilename);
 #else
-  libraw_err = libraw_open_file(raw, filename);
+    libraw_err = libraw_open_file(raw, filename);
 #endif
+  }
   if(libraw_err != LIBRAW_SUCCESS) goto error;
 
   libraw_err = libraw_unpack(raw);
@@ -353,6 +363,7 @@ error:
   if(libraw_err != LIBRAW_SUCCESS)
     fprintf(stderr, "[libraw_open] `%s': %s\n", img->filename, libraw_strerror(libraw_err));
   libraw_close(raw);
+  if(mapped) g_mapped_file_unref(mapped);
   return err;
 }
 #endif
@@ -25,7 +25,9 @@
 #define TYPE_FLOAT32 RawImageType::F32
 #define TYPE_USHORT16 RawImageType::UINT16
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 
 #define __STDC_LIMIT_MACROS
 
@@ -54,26 +56,50 @@ int rawspeed_get_number_of_processor_cores()
 using namespace rawspeed;
 
 static dt_imageio_retval_t dt_imageio_open_rawspeed_sraw (dt_image_t *img, RawImage r, dt_mipmap_buffer_t *buf);
-static CameraMetaData *meta = NULL;
+static std::atomic<CameraMetaData *> meta(nullptr);
+// only guards parsing cameras.xml, so that the preload does not hold up anything else
+static std::mutex meta_lock;
 
 static void dt_rawspeed_load_meta()
 {
   /* Load rawspeed cameras.xml meta file once */
   if(meta == NULL)
   {
-    dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+    std::lock_guard<std::mutex> lock(meta_lock);
     if(meta == NULL)
     {
       char datadir[PATH_MAX] = { 0 }, camfile[PATH_MAX] = { 0 };
       dt_loc_get_datadir(datadir, sizeof(datadir));
       snprintf(camfile, sizeof(camfile), "%s/rawspeed/cameras.xml", datadir);
+      const double start = dt_get_wtime();
       // never cleaned up (only when dt closes)
       meta = new CameraMetaData(camfile);
+      dt_print(DT_DEBUG_PERF, "[rawspeed] loaded camera meta data in %.3f secs\n", dt_get_wtime() - start);
     }
-    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
   }
 }
 
+static gpointer _preload_meta(gpointer data)
+{
+  try
+  {
+    dt_rawspeed_load_meta();
+  }
+  catch(const std::exception &exc)
+  {
+    // the first raw to be opened will try again and report it
+    fprintf(stderr, "[rawspeed] preloading camera meta data: %s\n", exc.what());
+  }
+  return NULL;
+}
+
+void dt_rawspeed_preload_meta()
+{
+  if(meta != NULL) return;
+  GThread *thread = g_thread_try_new("rawspeed meta", _preload_meta, NULL, NULL);
+  if(thread) g_thread_unref(thread);
+}
+
 gboolean dt_rawspeed_lookup_makermodel(const char *maker, const char *model,
                                    char *mk, int mk_len, char *md, int md_len,
                                    char *al, int al_len)
@@ -81,10 +107,10 @@ gboolean dt_rawspeed_lookup_makermodel(const char *maker, const char *model,
   gboolean got_it_done = FALSE;
   try {
     dt_rawspeed_load_meta();
-    const Camera *cam = meta->getCamera(maker, model, "");
+    const Camera *cam = meta.load()->getCamera(maker, model, "");
     // Also look for dng cameras
     if(!cam)
-      cam = meta->getCamera(maker, model, "dng");
+      cam = meta.load()->getCamera(maker, model, "dng");
     if(cam)
     {
       g_strlcpy(mk, cam->canonical_make.c_str(), mk_len);
@@ -116,6 +142,18 @@ uint32_t dt_rawspeed_crop_dcraw_filters(uint32_t filters, uint32_t crop_x, uint3
   return ColorFilterArray::shiftDcrawFilter(filters, crop_x, crop_y);
 }
 
+// holds one of the raw_read_concurrency slots while the file is read
+class ReadSlot
+{
+public:
+  ReadSlot() { dt_imageio_read_slot_acquire(); }
+  ~ReadSlot() { dt_imageio_read_slot_release(); }
+  ReadSlot(const ReadSlot &) = delete;
+  ReadSlot &operator=(const ReadSlot &) = delete;
+};
+
+typedef std::unique_ptr<GMappedFile, decltype(&g_mapped_file_unref)> MappedFile;
+
 // CR3 files are for now handled by LibRAW, we do not want rawspeed to try to open them
 // as this issues lot of error message on the console.
 static gboolean _ignore_image(const gchar *filename)
@@ -143,6 +181,8 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   snprintf(filen, sizeof(filen), "%s", filename);
   FileReader f(filen);
 
+  // declared first, the decoder and the buffer have to go before the mapping does
+  MappedFile mapped(nullptr, &g_mapped_file_unref);
   std::unique_ptr<RawDecoder> d;
   std::unique_ptr<const Buffer> m;
 
@@ -150,9 +190,18 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   {
     dt_rawspeed_load_meta();
 
-    dt_pthread_mutex_lock(&darktable.readFile_mutex);
-    m = f.readFile();
-    dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+    {
+      ReadSlot slot;
+      mapped.reset(dt_imageio_map_file(filen));
+      // rawspeed buffers are limited to 32 bit sizes
+      if(mapped && g_mapped_file_get_length(mapped.get()) > UINT32_MAX) mapped.reset();
+      if(mapped)
+        m = std::make_unique<const Buffer>(
+            reinterpret_cast<const uint8_t *>(g_mapped_file_get_contents(mapped.get())),
+            (Buffer::size_type)g_mapped_file_get_length(mapped.get()));
+      else
+        m = f.readFile();
+    }
 
     RawParser t(*m.get());
     d = t.getDecoder(meta);
@@ -252,6 +301,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     /* free auto pointers on spot */
     d.reset();
     m.reset();
+    mapped.reset();
 
     // Grab the WB
     for(int i = 0; i < 4; i++)
@@ -401,7 +451,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     }
 
     //  Check if the camera is missing samples
-    const Camera *cam = meta->getCamera(r->metadata.make.c_str(),
+    const Camera *cam = meta.load()->getCamera(r->metadata.make.c_str(),
                                         r->metadata.model.c_str(),
                                         r->metadata.mode.c_str());
 
@@ -557,7 +607,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed_sraw(dt_image_t *img, RawImage r, d
   img->loader = LOADER_RAWSPEED;
 
   //  Check if the camera is missing samples
-  const Camera *cam = meta->getCamera(r->metadata.make.c_str(),
+  const Camera *cam = meta.load()->getCamera(r->metadata.make.c_str(),
                                       r->metadata.model.c_str(),
                                       r->metadata.mode.c_str());
 
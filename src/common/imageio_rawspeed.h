@@ -29,6 +29,9 @@ gboolean dt_rawspeed_lookup_makermodel(const char *maker, const char *model,
                                        char *mk, int mk_len, char *md, int md_len,
                                        char *al, int al_len);
 
+// parse the rawspeed camera data in the background, so that opening the first raw does not wait for it
+void dt_rawspeed_preload_meta(void);
+
 uint32_t dt_rawspeed_crop_dcraw_filters(uint32_t filters, uint32_t crop_x, uint32_t crop_y);
 
 dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filename,
@@ -205,6 +205,215 @@ static inline int _read_chunky_f(tiff_t *t)
   return 1;
 }
 
+/* the pixel conversions of the parallel reader, one run of n pixels at a time. the loops for a single
+   sample and for rgb(a) are kept apart so that the compiler can vectorize them. */
+static inline void _convert_8(const uint8_t *const in, float *const out, const size_t n, const size_t spp)
+{
+  if(spp == 1)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      const float v = ((float)in[i]) * (1.0f / 255.0f);
+      out[4 * i + 0] = out[4 * i + 1] = out[4 * i + 2] = v;
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+  else
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      out[4 * i + 0] = ((float)in[spp * i + 0]) * (1.0f / 255.0f);
+      out[4 * i + 1] = ((float)in[spp * i + 1]) * (1.0f / 255.0f);
+      out[4 * i + 2] = ((float)in[spp * i + 2]) * (1.0f / 255.0f);
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+}
+
+static inline void _convert_16(const uint16_t *const in, float *const out, const size_t n, const size_t spp)
+{
+  if(spp == 1)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      const float v = ((float)in[i]) * (1.0f / 65535.0f);
+      out[4 * i + 0] = out[4 * i + 1] = out[4 * i + 2] = v;
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+  else
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      out[4 * i + 0] = ((float)in[spp * i + 0]) * (1.0f / 65535.0f);
+      out[4 * i + 1] = ((float)in[spp * i + 1]) * (1.0f / 65535.0f);
+      out[4 * i + 2] = ((float)in[spp * i + 2]) * (1.0f / 65535.0f);
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+}
+
+static inline void _convert_h(const uint16_t *const in, float *const out, const size_t n, const size_t spp)
+{
+  if(spp == 1)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      const float v = _half_to_float(in[i]);
+      out[4 * i + 0] = out[4 * i + 1] = out[4 * i + 2] = v;
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+  else
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      out[4 * i + 0] = _half_to_float(in[spp * i + 0]);
+      out[4 * i + 1] = _half_to_float(in[spp * i + 1]);
+      out[4 * i + 2] = _half_to_float(in[spp * i + 2]);
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+}
+
+static inline void _convert_f(const float *const in, float *const out, const size_t n, const size_t spp)
+{
+  if(spp == 1)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      out[4 * i + 0] = out[4 * i + 1] = out[4 * i + 2] = in[i];
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+  else
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      out[4 * i + 0] = in[spp * i + 0];
+      out[4 * i + 1] = in[spp * i + 1];
+      out[4 * i + 2] = in[spp * i + 2];
+      out[4 * i + 3] = 0.0f;
+    }
+  }
+}
+
+static inline void _convert_pixels(const tiff_t *const t, const void *const in, float *const out, const size_t n)
+{
+  if(t->bpp == 8)
+    _convert_8((const uint8_t *)in, out, n, t->spp);
+  else if(t->bpp == 16 && t->sampleformat == SAMPLEFORMAT_UINT)
+    _convert_16((const uint16_t *)in, out, n, t->spp);
+  else if(t->bpp == 16)
+    _convert_h((const uint16_t *)in, out, n, t->spp);
+  else
+    _convert_f((const float *)in, out, n, t->spp);
+}
+
+static TIFF *_open_tiff(const char *filename)
+{
+#ifdef _WIN32
+  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+  TIFF *tiff = TIFFOpenW(wfilename, "rb");
+  g_free(wfilename);
+  return tiff;
+#else
+  return TIFFOpen(filename, "rb");
+#endif
+}
+
+/* strips and tiles are compressed independently of each other, so they can be decoded in parallel. libtiff
+   handles aren't thread safe, every thread reads its share through a handle of its own, straight into the
+   mipmap buffer. the only way to read tiled images at all. */
+static int _read_parallel(tiff_t *t, const char *filename)
+{
+  const int tiled = TIFFIsTiled(t->tiff);
+  const uint32_t chunks = tiled ? TIFFNumberOfTiles(t->tiff) : TIFFNumberOfStrips(t->tiff);
+  uint32_t cw = t->width, ch = 0;
+  if(tiled)
+  {
+    TIFFGetField(t->tiff, TIFFTAG_TILEWIDTH, &cw);
+    TIFFGetField(t->tiff, TIFFTAG_TILELENGTH, &ch);
+  }
+  else
+    TIFFGetFieldDefaulted(t->tiff, TIFFTAG_ROWSPERSTRIP, &ch);
+  if(cw == 0 || ch == 0 || chunks == 0) return -1;
+  ch = MIN(ch, t->height);
+
+  const tmsize_t chunksize = tiled ? TIFFTileSize(t->tiff) : TIFFStripSize(t->tiff);
+  // chunks per row of the image, 1 for strips
+  const uint32_t across = (t->width + cw - 1) / cw;
+  const size_t pitch = (size_t)cw * t->spp * (t->bpp / 8);
+  const int threads = MAX(1, MIN(darktable.num_openmp_threads, (int)chunks));
+
+  dt_print(DT_DEBUG_IMAGEIO, "[tiff_open] reading %u %s of %ux%u on %d threads\n", chunks,
+           tiled ? "tiles" : "strips", cw, ch, threads);
+
+  int failed = 0;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads) default(none) \
+  dt_omp_firstprivate(t, filename, tiled, chunks, cw, ch, chunksize, across, pitch) \
+  reduction(| : failed)
+#endif
+  {
+    TIFF *tiff = _open_tiff(filename);
+    tdata_t buf = tiff ? _TIFFmalloc(chunksize) : NULL;
+    if(!buf) failed = 1;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for(uint32_t c = 0; c < chunks; c++)
+    {
+      if(!buf) continue;
+      const tmsize_t got = tiled ? TIFFReadEncodedTile(tiff, c, buf, chunksize)
+                                 : TIFFReadEncodedStrip(tiff, c, buf, chunksize);
+      if(got < 0)
+      {
+        failed = 1;
+        continue;
+      }
+      const uint32_t x = (c % across) * cw;
+      const uint32_t y = (c / across) * ch;
+      if(x >= t->width || y >= t->height) continue;
+      const uint32_t cols = MIN(cw, t->width - x);
+      const uint32_t rows = MIN(ch, t->height - y);
+      for(uint32_t row = 0; row < rows; row++)
+        _convert_pixels(t, (uint8_t *)buf + row * pitch, t->mipbuf + (size_t)4 * ((size_t)(y + row) * t->width + x),
+                        cols);
+    }
+
+    if(buf) _TIFFfree(buf);
+    if(tiff) TIFFClose(tiff);
+  }
+
+  return failed ? -1 : 1;
+}
+
 static inline int _read_chunky_8_Lab(tiff_t *t, uint16_t photometric)
 {
   const cmsHPROFILE Lab = dt_colorspaces_get_profile(DT_COLORSPACE_LAB, "", DT_PROFILE_DIRECTION_ANY)->profile;
@@ -353,13 +562,7 @@ dt_imageio_retval_t dt_imageio_open_tiff(dt_image_t *img, const char *filename,
 
   t.image = img;
 
-#ifdef _WIN32
-  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
-  t.tiff = TIFFOpenW(wfilename, "rb");
-  g_free(wfilename);
-#else
-  t.tiff = TIFFOpen(filename, "rb");
-#endif
+  t.tiff = _open_tiff(filename);
 
   if(t.tiff == NULL) return DT_IMAGEIO_FILE_CORRUPTED;
 
@@ -444,13 +647,21 @@ dt_imageio_retval_t dt_imageio_open_tiff(dt_image_t *img, const char *filename,
   }
 
   int ok = 1;
-
-  if((photometric == PHOTOMETRIC_CIELAB || photometric == PHOTOMETRIC_ICCLAB) && t.bpp == 8 && t.sampleformat == SAMPLEFORMAT_UINT)
+  const gboolean lab = photometric == PHOTOMETRIC_CIELAB || photometric == PHOTOMETRIC_ICCLAB;
+  const gboolean supported = (t.bpp == 8 && t.sampleformat == SAMPLEFORMAT_UINT)
+                             || (t.bpp == 16 && t.sampleformat == SAMPLEFORMAT_UINT)
+                             || (t.bpp == 16 && t.sampleformat == SAMPLEFORMAT_IEEEFP)
+                             || (t.bpp == 32 && t.sampleformat == SAMPLEFORMAT_IEEEFP);
+  const uint32_t chunks = TIFFIsTiled(t.tiff) ? TIFFNumberOfTiles(t.tiff) : TIFFNumberOfStrips(t.tiff);
+
+  if(!lab && supported && (chunks > 1 || TIFFIsTiled(t.tiff)))
+    ok = _read_parallel(&t, filename);
+  else if(lab && t.bpp == 8 && t.sampleformat == SAMPLEFORMAT_UINT)
   {
     ok = _read_chunky_8_Lab(&t, photometric);
     t.image->buf_dsc.cst = IOP_CS_LAB;
   }
-  else if((photometric == PHOTOMETRIC_CIELAB || photometric == PHOTOMETRIC_ICCLAB) && t.bpp == 16 && t.sampleformat == SAMPLEFORMAT_UINT)
+  else if(lab && t.bpp == 16 && t.sampleformat == SAMPLEFORMAT_UINT)
   {
     ok = _read_chunky_16_Lab(&t, photometric);
     t.image->buf_dsc.cst = IOP_CS_LAB;
@@ -1378,6 +1378,70 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
+__DT_CLONE_TARGETS__
+static void _resample_separable(float *out, const dt_iop_roi_t *const roi_out, const int32_t out_stride_floats,
+                                const float *const in, const int32_t in_stride_floats, float *const tmp,
+                                const int ymin, const int rows, const int *const hindex, const int *const hlength,
+                                const float *const hkernel, const int *const vindex, const int *const vlength,
+                                const float *const vkernel, const int *const vmeta)
+{
+  const size_t out_width = roi_out->width;
+
+  // Horizontal pass on all the input lines the vertical pass will use
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, in_stride_floats, tmp, ymin, rows, out_width, hindex, hlength, hkernel) \
+  schedule(static)
+#endif
+  for(int iy = 0; iy < rows; iy++)
+  {
+    const float *const restrict row = in + (size_t)(ymin + iy) * in_stride_floats;
+    float *const restrict trow = tmp + (size_t)iy * out_width * 4;
+    int hidx = 0; // H(orizontal) I(n)d(e)x, both in the kernel and the index lists
+    for(size_t ox = 0; ox < out_width; ox++)
+    {
+      const int hl = hlength[ox];
+      dt_aligned_pixel_t vhs = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for(int ix = 0; ix < hl; ix++)
+      {
+        const float *const restrict pixel = row + (size_t)hindex[hidx + ix] * 4;
+        const float htap = hkernel[hidx + ix];
+        for_each_channel(c, aligned(vhs:16)) vhs[c] += pixel[c] * htap;
+      }
+      hidx += hl;
+      copy_pixel(trow + 4 * ox, vhs);
+    }
+  }
+
+  // Vertical pass, whole lines at a time
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, out_stride_floats, tmp, ymin, out_width, vindex, vlength, vkernel, vmeta, roi_out) \
+  schedule(static)
+#endif
+  for(int oy = 0; oy < roi_out->height; oy++)
+  {
+    const int vl = vlength[vmeta[3 * oy + 0]];
+    const int vidx = vmeta[3 * oy + 1]; // kernel and index lists are laid out the same
+    float *const restrict orow = out + (size_t)oy * out_stride_floats;
+
+    for(size_t k = 0; k < 4 * out_width; k++) orow[k] = 0.0f;
+    for(int iy = 0; iy < vl; iy++)
+    {
+      const float *const restrict trow = tmp + (size_t)(vindex[vidx + iy] - ymin) * out_width * 4;
+      const float vtap = vkernel[vidx + iy];
+#ifdef _OPENMP
+#pragma omp simd aligned(trow:64)
+#endif
+      for(size_t k = 0; k < 4 * out_width; k++) orow[k] += trow[k] * vtap;
+    }
+
+    // Clip negative RGB that may be produced by Lanczos undershooting
+    // Negative RGB are invalid values no matter the RGB space (light is positive)
+    for(size_t k = 0; k < 4 * out_width; k++) orow[k] = fmaxf(orow[k], 0.f);
+  }
+}
+
 static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
                                             const dt_iop_roi_t *const roi_out, const int32_t out_stride,
                                             const float *const in, const dt_iop_roi_t *const roi_in,
@@ -1453,6 +1517,34 @@ static void dt_interpolation_resample_plain(const struct dt_interpolation *itor,
   int64_t ts_resampling = getts();
 #endif
 
+  // The kernels are separable: filter the needed input lines horizontally once, instead of again for each
+  // output line they contribute to, then the result vertically
+  if(roi_out->width > 0 && roi_out->height > 0)
+  {
+    int ymin = vindex[0];
+    int ymax = vindex[0];
+    const int vtaps = vmeta[3 * (roi_out->height - 1) + 1] + vlength[vmeta[3 * (roi_out->height - 1)]];
+    for(int k = 0; k < vtaps; k++)
+    {
+      ymin = MIN(ymin, vindex[k]);
+      ymax = MAX(ymax, vindex[k]);
+    }
+    const int rows = ymax - ymin + 1;
+    float *const tmp = dt_alloc_align_float((size_t)rows * roi_out->width * 4);
+    if(tmp)
+    {
+      _resample_separable(out, roi_out, out_stride_floats, in, in_stride_floats, tmp, ymin, rows, hindex,
+                          hlength, hkernel, vindex, vlength, vkernel, vmeta);
+      dt_free_align(tmp);
+#if DEBUG_RESAMPLING_TIMING
+      ts_resampling = getts() - ts_resampling;
+      fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
+#endif
+      goto exit;
+    }
+    // not enough memory for the intermediate lines, filter in both directions for each output pixel
+  }
+
 // Process each output line
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
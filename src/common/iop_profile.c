@@ -50,6 +50,123 @@
 #endif
 
 
+/* profile infos and lcms2 transforms are shared by all develop instances and pipes of the process, so
+ * thumbnail and export pipes don't rebuild them for every image. the display profiles can change at any
+ * time and are never shared.
+ */
+#define DT_IOPPR_CACHED_TRANSFORMS 8
+#define DT_IOPPR_CACHED_PROFILES 16
+
+typedef struct dt_ioppr_cached_transform_t
+{
+  dt_colorspaces_color_profile_type_t type_from, type_to;
+  char filename_from[DT_IOP_COLOR_ICC_LEN];
+  char filename_to[DT_IOP_COLOR_ICC_LEN];
+  int intent;
+  int direction;
+  cmsHTRANSFORM xform;
+  int users;
+  uint64_t stamp;
+} dt_ioppr_cached_transform_t;
+
+typedef struct dt_ioppr_cached_profile_t
+{
+  dt_iop_order_iccprofile_info_t *info;
+  int users;
+  uint64_t stamp;
+} dt_ioppr_cached_profile_t;
+
+static GMutex _profile_cache_lock;
+static dt_ioppr_cached_transform_t _transforms[DT_IOPPR_CACHED_TRANSFORMS] = { { 0 } };
+static GList *_profiles = NULL;
+static uint64_t _profile_cache_stamp = 0;
+
+static inline gboolean _is_display_profile(const dt_colorspaces_color_profile_type_t type)
+{
+  return type == DT_COLORSPACE_DISPLAY || type == DT_COLORSPACE_DISPLAY2;
+}
+
+static inline gboolean _transform_matches(const dt_ioppr_cached_transform_t *t,
+                                          const dt_colorspaces_color_profile_type_t type_from,
+                                          const char *filename_from,
+                                          const dt_colorspaces_color_profile_type_t type_to,
+                                          const char *filename_to, const int intent, const int direction)
+{
+  return t->xform && t->type_from == type_from && t->type_to == type_to && t->intent == intent
+         && t->direction == direction && !strcmp(t->filename_from, filename_from)
+         && !strcmp(t->filename_to, filename_to);
+}
+
+// returns a shared transform and its slot for _transform_cache_release(), NULL if there is none
+static cmsHTRANSFORM _transform_cache_get(const dt_colorspaces_color_profile_type_t type_from,
+                                          const char *filename_from,
+                                          const dt_colorspaces_color_profile_type_t type_to,
+                                          const char *filename_to, const int intent, const int direction,
+                                          int *slot)
+{
+  *slot = -1;
+  if(_is_display_profile(type_from) || _is_display_profile(type_to)) return NULL;
+
+  cmsHTRANSFORM xform = NULL;
+  g_mutex_lock(&_profile_cache_lock);
+  for(int k = 0; k < DT_IOPPR_CACHED_TRANSFORMS; k++)
+  {
+    dt_ioppr_cached_transform_t *t = &_transforms[k];
+    if(_transform_matches(t, type_from, filename_from, type_to, filename_to, intent, direction))
+    {
+      t->users++;
+      t->stamp = ++_profile_cache_stamp;
+      xform = t->xform;
+      *slot = k;
+      break;
+    }
+  }
+  g_mutex_unlock(&_profile_cache_lock);
+  return xform;
+}
+
+// hands a new transform over to the cache, replacing the least recently used one nobody is using.
+// returns its slot, -1 if it could not be shared and the caller keeps it.
+static int _transform_cache_put(const dt_colorspaces_color_profile_type_t type_from, const char *filename_from,
+                                const dt_colorspaces_color_profile_type_t type_to, const char *filename_to,
+                                const int intent, const int direction, cmsHTRANSFORM xform)
+{
+  if(_is_display_profile(type_from) || _is_display_profile(type_to)) return -1;
+
+  int slot = -1;
+  g_mutex_lock(&_profile_cache_lock);
+  for(int k = 0; k < DT_IOPPR_CACHED_TRANSFORMS; k++)
+  {
+    const dt_ioppr_cached_transform_t *t = &_transforms[k];
+    if(t->users) continue;
+    if(slot < 0 || !t->xform || (_transforms[slot].xform && t->stamp < _transforms[slot].stamp)) slot = k;
+  }
+  if(slot >= 0)
+  {
+    dt_ioppr_cached_transform_t *t = &_transforms[slot];
+    if(t->xform) cmsDeleteTransform(t->xform);
+    t->type_from = type_from;
+    t->type_to = type_to;
+    g_strlcpy(t->filename_from, filename_from ? filename_from : "", sizeof(t->filename_from));
+    g_strlcpy(t->filename_to, filename_to ? filename_to : "", sizeof(t->filename_to));
+    t->intent = intent;
+    t->direction = direction;
+    t->xform = xform;
+    t->users = 1;
+    t->stamp = ++_profile_cache_stamp;
+  }
+  g_mutex_unlock(&_profile_cache_lock);
+  return slot;
+}
+
+static void _transform_cache_release(const int slot)
+{
+  g_mutex_lock(&_profile_cache_lock);
+  _transforms[slot].users--;
+  g_mutex_unlock(&_profile_cache_lock);
+}
+
+
 static void _mark_as_nonmatrix_profile(dt_iop_order_iccprofile_info_t *const profile_info)
 {
   profile_info->matrix_in[0][0] = NAN;
@@ -67,11 +184,9 @@ static void _clear_lut_curves(dt_iop_order_iccprofile_info_t *const profile_info
   }
 }
 
-static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float *const image_out, const int width,
-                                             const int height, const dt_colorspaces_color_profile_type_t type,
-                                             const char *filename, const int intent, const int direction)
+static cmsHTRANSFORM _create_rgb_lab_transform(const dt_colorspaces_color_profile_type_t type,
+                                               const char *filename, const int intent, const int direction)
 {
-  const int ch = 4;
   cmsHTRANSFORM *xform = NULL;
   cmsHPROFILE *rgb_profile = NULL;
   cmsHPROFILE *lab_profile = NULL;
@@ -132,6 +247,22 @@ static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float
   if(type == DT_COLORSPACE_DISPLAY || type == DT_COLORSPACE_DISPLAY2)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
+  return xform;
+}
+
+static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float *const image_out, const int width,
+                                             const int height, const dt_colorspaces_color_profile_type_t type,
+                                             const char *filename, const int intent, const int direction)
+{
+  const int ch = 4;
+  int slot = -1;
+  cmsHTRANSFORM *xform = _transform_cache_get(type, filename, DT_COLORSPACE_LAB, "", intent, direction, &slot);
+  if(!xform)
+  {
+    xform = _create_rgb_lab_transform(type, filename, intent, direction);
+    if(xform) slot = _transform_cache_put(type, filename, DT_COLORSPACE_LAB, "", intent, direction, xform);
+  }
+
   if(xform)
   {
 #ifdef _OPENMP
@@ -151,16 +282,17 @@ static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float
   else
     fprintf(stderr, "[_transform_from_to_rgb_lab_lcms2] cannot create transform\n");
 
-  if(xform) cmsDeleteTransform(xform);
+  if(slot >= 0)
+    _transform_cache_release(slot);
+  else if(xform)
+    cmsDeleteTransform(xform);
 }
 
-static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *const image_out, const int width,
-                                        const int height, const dt_colorspaces_color_profile_type_t type_from,
-                                        const char *filename_from,
-                                        const dt_colorspaces_color_profile_type_t type_to, const char *filename_to,
-                                        const int intent)
+static cmsHTRANSFORM _create_rgb_rgb_transform(const dt_colorspaces_color_profile_type_t type_from,
+                                               const char *filename_from,
+                                               const dt_colorspaces_color_profile_type_t type_to,
+                                               const char *filename_to, const int intent)
 {
-  const int ch = 4;
   cmsHTRANSFORM *xform = NULL;
   cmsHPROFILE *from_rgb_profile = NULL;
   cmsHPROFILE *to_rgb_profile = NULL;
@@ -231,6 +363,24 @@ static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *cons
      || type_to == DT_COLORSPACE_DISPLAY2)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
+  return xform;
+}
+
+static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *const image_out, const int width,
+                                        const int height, const dt_colorspaces_color_profile_type_t type_from,
+                                        const char *filename_from,
+                                        const dt_colorspaces_color_profile_type_t type_to, const char *filename_to,
+                                        const int intent)
+{
+  const int ch = 4;
+  int slot = -1;
+  cmsHTRANSFORM *xform = _transform_cache_get(type_from, filename_from, type_to, filename_to, intent, 0, &slot);
+  if(!xform)
+  {
+    xform = _create_rgb_rgb_transform(type_from, filename_from, type_to, filename_to, intent);
+    if(xform) slot = _transform_cache_put(type_from, filename_from, type_to, filename_to, intent, 0, xform);
+  }
+
   if(xform)
   {
 #ifdef _OPENMP
@@ -250,7 +400,10 @@ static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *cons
   else
     fprintf(stderr, "[_transform_rgb_to_rgb_lcms2] cannot create transform\n");
 
-  if(xform) cmsDeleteTransform(xform);
+  if(slot >= 0)
+    _transform_cache_release(slot);
+  else if(xform)
+    cmsDeleteTransform(xform);
 }
 
 static void _transform_lcms2(struct dt_iop_module_t *self, const float *const image_in, float *const image_out,
@@ -326,60 +479,18 @@ static inline int _init_unbounded_coeffs(float *const lutr, float *const lutg, f
 }
 
 
-static inline void _apply_tonecurves(const float *const image_in, float *const image_out,
-                                     const int width, const int height,
-                                     const float *const restrict lutr,
-                                     const float *const restrict lutg,
-                                     const float *const restrict lutb,
-                                     const float *const restrict unbounded_coeffsr,
-                                     const float *const restrict unbounded_coeffsg,
-                                     const float *const restrict unbounded_coeffsb,
-                                     const int lutsize)
+// the tone curves of one pixel, channels without a curve are passed through
+static inline void _apply_trc(const float *const restrict in, float *const restrict out,
+                              float *const lut[3], const float unbounded_coeffs[3][3], const int lutsize)
 {
-  const int ch = 4;
-  const float *const lut[3] = { lutr, lutg, lutb };
-  const float *const unbounded_coeffs[3] = { unbounded_coeffsr, unbounded_coeffsg, unbounded_coeffsb };
-  const size_t stride = (size_t)ch * width * height;
-
-  // do we have any lut to apply, or is this a linear profile?
-  if((lut[0][0] >= 0.0f) && (lut[1][0] >= 0.0f) && (lut[2][0] >= 0.0f))
-  {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(stride, image_in, image_out, lut, lutsize, unbounded_coeffs, ch) \
-    schedule(static) collapse(2)
-#endif
-    for(size_t k = 0; k < stride; k += ch)
-    {
-      for(int c = 0; c < 3; c++) // for_each_channel doesn't vectorize, and some code needs image_out[3] preserved
-      {
-        image_out[k + c] = (image_in[k + c] < 1.0f) ? extrapolate_lut(lut[c], image_in[k + c], lutsize)
-                                                    : eval_exp(unbounded_coeffs[c], image_in[k + c]);
-      }
-    }
-  }
-  else if((lut[0][0] >= 0.0f) || (lut[1][0] >= 0.0f) || (lut[2][0] >= 0.0f))
+  for(int c = 0; c < 3; c++)
   {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(stride, image_in, image_out, lut, lutsize, unbounded_coeffs, ch) \
-    schedule(static) collapse(2)
-#endif
-    for(size_t k = 0; k < stride; k += ch)
-    {
-      for(int c = 0; c < 3; c++) // for_each_channel doesn't vectorize, and some code needs image_out[3] preserved
-      {
-        if(lut[c][0] >= 0.0f)
-        {
-          image_out[k + c] = (image_in[k + c] < 1.0f) ? extrapolate_lut(lut[c], image_in[k + c], lutsize)
-                                                      : eval_exp(unbounded_coeffs[c], image_in[k + c]);
-        }
-      }
-    }
+    out[c] = (lut[c][0] >= 0.0f) ? ((in[c] < 1.0f) ? extrapolate_lut(lut[c], in[c], lutsize)
+                                                   : eval_exp(unbounded_coeffs[c], in[c]))
+                                 : in[c];
   }
 }
 
-
 static inline void _transform_rgb_to_lab_matrix(const float *const restrict image_in, float *const restrict image_out,
                                                 const int width, const int height,
                                                 const dt_iop_order_iccprofile_info_t *const profile_info)
@@ -390,23 +501,21 @@ static inline void _transform_rgb_to_lab_matrix(const float *const restrict imag
 
   if(profile_info->nonlinearlut)
   {
-    // TODO : maybe optimize that path like _transform_matrix_rgb
-    _apply_tonecurves(image_in, image_out, width, height, profile_info->lut_in[0], profile_info->lut_in[1],
-                      profile_info->lut_in[2], profile_info->unbounded_coeffs_in[0],
-                      profile_info->unbounded_coeffs_in[1], profile_info->unbounded_coeffs_in[2],
-                      profile_info->lutsize);
-
+    // linearize, convert and go to Lab in one pass over the image
 #ifdef _OPENMP
-#pragma omp parallel for simd default(none) \
-    dt_omp_firstprivate(image_out, profile_info, stride, ch, matrix_ptr) \
-    schedule(static) aligned(image_out:64)
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(image_in, image_out, profile_info, stride, ch, matrix_ptr) \
+    schedule(static)
 #endif
     for(size_t y = 0; y < stride; y += ch)
     {
-      float *const restrict in = __builtin_assume_aligned(image_out + y, 16);
-      dt_aligned_pixel_t xyz; // inited in _ioppr_linear_rgb_matrix_to_xyz()
-      dt_apply_transposed_color_matrix(in, *matrix_ptr, xyz);
-      dt_XYZ_to_Lab(xyz, in);
+      const float *const restrict in = __builtin_assume_aligned(image_in + y, 16);
+      float *const restrict out = __builtin_assume_aligned(image_out + y, 16);
+      dt_aligned_pixel_t rgb;
+      _apply_trc(in, rgb, profile_info->lut_in, profile_info->unbounded_coeffs_in, profile_info->lutsize);
+      dt_aligned_pixel_t xyz;
+      dt_apply_transposed_color_matrix(rgb, *matrix_ptr, xyz);
+      dt_XYZ_to_Lab(xyz, out);
     }
   }
   else
@@ -437,30 +546,46 @@ static inline void _transform_lab_to_rgb_matrix(const float *const image_in, flo
   const size_t stride = (size_t)width * height * ch;
   const dt_colormatrix_t *matrix_ptr = &profile_info->matrix_out_transposed;
 
+  if(profile_info->nonlinearlut)
+  {
+    // back from Lab, convert and de-linearize in one pass over the image
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(image_in, image_out, stride, profile_info, ch, matrix_ptr)   \
-  schedule(static)
+    dt_omp_firstprivate(image_in, image_out, stride, profile_info, ch, matrix_ptr)   \
+    schedule(static)
 #endif
-  for(size_t y = 0; y < stride; y += ch)
-  {
-    const float *const restrict in = __builtin_assume_aligned(image_in + y, 16);
-    float *const restrict out = __builtin_assume_aligned(image_out + y, 16);
+    for(size_t y = 0; y < stride; y += ch)
+    {
+      const float *const restrict in = __builtin_assume_aligned(image_in + y, 16);
+      float *const restrict out = __builtin_assume_aligned(image_out + y, 16);
 
-    dt_aligned_pixel_t xyz;
-    const float alpha = in[3]; // some code does in-place conversions and relies on alpha being preserved
-    dt_Lab_to_XYZ(in, xyz);
-    dt_apply_transposed_color_matrix(xyz, *matrix_ptr, out);
-    out[3] = alpha;
+      dt_aligned_pixel_t xyz;
+      dt_aligned_pixel_t rgb;
+      const float alpha = in[3]; // some code does in-place conversions and relies on alpha being preserved
+      dt_Lab_to_XYZ(in, xyz);
+      dt_apply_transposed_color_matrix(xyz, *matrix_ptr, rgb);
+      _apply_trc(rgb, out, profile_info->lut_out, profile_info->unbounded_coeffs_out, profile_info->lutsize);
+      out[3] = alpha;
+    }
   }
-
-  if(profile_info->nonlinearlut)
+  else
   {
-    // TODO : maybe optimize that path like _transform_matrix_rgb
-    _apply_tonecurves(image_out, image_out, width, height, profile_info->lut_out[0], profile_info->lut_out[1],
-                      profile_info->lut_out[2], profile_info->unbounded_coeffs_out[0],
-                      profile_info->unbounded_coeffs_out[1], profile_info->unbounded_coeffs_out[2],
-                      profile_info->lutsize);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(image_in, image_out, stride, profile_info, ch, matrix_ptr)   \
+    schedule(static)
+#endif
+    for(size_t y = 0; y < stride; y += ch)
+    {
+      const float *const restrict in = __builtin_assume_aligned(image_in + y, 16);
+      float *const restrict out = __builtin_assume_aligned(image_out + y, 16);
+
+      dt_aligned_pixel_t xyz;
+      const float alpha = in[3]; // some code does in-place conversions and relies on alpha being preserved
+      dt_Lab_to_XYZ(in, xyz);
+      dt_apply_transposed_color_matrix(xyz, *matrix_ptr, out);
+      out[3] = alpha;
+    }
   }
 }
 
@@ -739,6 +864,114 @@ dt_ioppr_get_profile_info_from_list(struct dt_develop_t *dev,
   return profile_info;
 }
 
+static dt_iop_order_iccprofile_info_t *_new_profile_info(const dt_colorspaces_color_profile_type_t profile_type,
+                                                         const char *profile_filename, const int intent)
+{
+  dt_iop_order_iccprofile_info_t *profile_info = dt_alloc_align(64, sizeof(dt_iop_order_iccprofile_info_t));
+  dt_ioppr_init_profile_info(profile_info, 0);
+  if(dt_ioppr_generate_profile_info(profile_info, profile_type, profile_filename, intent))
+  {
+    dt_ioppr_cleanup_profile_info(profile_info);
+    dt_free_align(profile_info);
+    return NULL;
+  }
+  return profile_info;
+}
+
+static void _free_cached_profile(dt_ioppr_cached_profile_t *p)
+{
+  dt_ioppr_cleanup_profile_info(p->info);
+  dt_free_align(p->info);
+  free(p);
+}
+
+// call with _profile_cache_lock held. drops the least recently used profiles nobody holds.
+static void _profile_cache_trim(void)
+{
+  while(g_list_length(_profiles) > DT_IOPPR_CACHED_PROFILES)
+  {
+    GList *oldest = NULL;
+    for(GList *l = _profiles; l; l = g_list_next(l))
+    {
+      const dt_ioppr_cached_profile_t *p = (dt_ioppr_cached_profile_t *)l->data;
+      if(!p->users && (!oldest || p->stamp < ((dt_ioppr_cached_profile_t *)oldest->data)->stamp)) oldest = l;
+    }
+    if(!oldest) break;
+    _free_cached_profile((dt_ioppr_cached_profile_t *)oldest->data);
+    _profiles = g_list_delete_link(_profiles, oldest);
+  }
+}
+
+// returns the shared profile info, to be given back with dt_ioppr_release_profile_info()
+static dt_iop_order_iccprofile_info_t *_acquire_profile_info(const dt_colorspaces_color_profile_type_t profile_type,
+                                                             const char *profile_filename, const int intent)
+{
+  if(_is_display_profile(profile_type)) return _new_profile_info(profile_type, profile_filename, intent);
+
+  g_mutex_lock(&_profile_cache_lock);
+  for(GList *l = _profiles; l; l = g_list_next(l))
+  {
+    dt_ioppr_cached_profile_t *p = (dt_ioppr_cached_profile_t *)l->data;
+    if(p->info->type == profile_type && p->info->intent == intent && !strcmp(p->info->filename, profile_filename))
+    {
+      p->users++;
+      p->stamp = ++_profile_cache_stamp;
+      g_mutex_unlock(&_profile_cache_lock);
+      return p->info;
+    }
+  }
+  // generated under the lock, so concurrent pipes asking for the same profile do it once
+  dt_iop_order_iccprofile_info_t *profile_info = _new_profile_info(profile_type, profile_filename, intent);
+  if(profile_info)
+  {
+    dt_ioppr_cached_profile_t *p = malloc(sizeof(dt_ioppr_cached_profile_t));
+    p->info = profile_info;
+    p->users = 1;
+    p->stamp = ++_profile_cache_stamp;
+    _profiles = g_list_prepend(_profiles, p);
+    _profile_cache_trim();
+  }
+  g_mutex_unlock(&_profile_cache_lock);
+  return profile_info;
+}
+
+void dt_ioppr_release_profile_info(dt_iop_order_iccprofile_info_t *profile_info)
+{
+  if(!profile_info) return;
+  g_mutex_lock(&_profile_cache_lock);
+  for(GList *l = _profiles; l; l = g_list_next(l))
+  {
+    dt_ioppr_cached_profile_t *p = (dt_ioppr_cached_profile_t *)l->data;
+    if(p->info == profile_info)
+    {
+      // unused profiles stay around for the next pipe
+      p->users--;
+      _profile_cache_trim();
+      g_mutex_unlock(&_profile_cache_lock);
+      return;
+    }
+  }
+  g_mutex_unlock(&_profile_cache_lock);
+  // a private one
+  dt_ioppr_cleanup_profile_info(profile_info);
+  dt_free_align(profile_info);
+}
+
+void dt_ioppr_cleanup_profile_cache(void)
+{
+  g_mutex_lock(&_profile_cache_lock);
+  for(GList *l = _profiles; l; l = g_list_next(l)) _free_cached_profile((dt_ioppr_cached_profile_t *)l->data);
+  g_list_free(_profiles);
+  _profiles = NULL;
+  for(int k = 0; k < DT_IOPPR_CACHED_TRANSFORMS; k++)
+  {
+    if(_transforms[k].xform) cmsDeleteTransform(_transforms[k].xform);
+    _transforms[k].xform = NULL;
+    _transforms[k].users = 0;
+  }
+  g_mutex_unlock(&_profile_cache_lock);
+}
+
 dt_iop_order_iccprofile_info_t *
 dt_ioppr_add_profile_info_to_list(struct dt_develop_t *dev,
                                   const dt_colorspaces_color_profile_type_t profile_type,
@@ -748,18 +981,8 @@ dt_ioppr_add_profile_info_to_list(struct dt_develop_t *dev,
   dt_iop_order_iccprofile_info_t *profile_info = dt_ioppr_get_profile_info_from_list(dev, profile_type, profile_filename);
   if(profile_info == NULL)
   {
-    profile_info = dt_alloc_align(64, sizeof(dt_iop_order_iccprofile_info_t));
-    dt_ioppr_init_profile_info(profile_info, 0);
-    const int err = dt_ioppr_generate_profile_info(profile_info, profile_type, profile_filename, intent);
-    if(err == 0)
-    {
-      dev->allprofile_info = g_list_append(dev->allprofile_info, profile_info);
-    }
-    else
-    {
-      dt_free_align(profile_info);
-      profile_info = NULL;
-    }
+    profile_info = _acquire_profile_info(profile_type, profile_filename, intent);
+    if(profile_info) dev->allprofile_info = g_list_append(dev->allprofile_info, profile_info);
   }
   return profile_info;
 }
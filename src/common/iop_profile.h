@@ -59,6 +59,11 @@ void dt_ioppr_init_profile_info(dt_iop_order_iccprofile_info_t *profile_info, co
 /** must be called when done with profile_info */
 void dt_ioppr_cleanup_profile_info(dt_iop_order_iccprofile_info_t *profile_info);
 
+/** gives back a profile info of a dev profiles info list, to be called for each of them when the dev goes */
+void dt_ioppr_release_profile_info(dt_iop_order_iccprofile_info_t *profile_info);
+/** frees the profile infos and transforms shared by all pipes */
+void dt_ioppr_cleanup_profile_cache(void);
+
 /** returns the profile info from dev profiles info list that matches (profile_type, profile_filename)
  * NULL if not found
  */
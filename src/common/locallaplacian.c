@@ -530,6 +530,7 @@ void apply_curve_sse2(
 #endif
 
 // scalar version
+__DT_CLONE_TARGETS__
 void apply_curve(
     float *const out,
     const float *const in,
@@ -560,6 +561,7 @@ void apply_curve(
   pad_by_replication(out, w, h, padding);
 }
 
+__DT_CLONE_TARGETS__
 void local_laplacian_internal(
     const float *const input,   // input buffer in some Labx or yuvx format
     float *const out,           // output buffer with colour
@@ -617,10 +619,14 @@ void local_laplacian_internal(
   for(int k=0;k<num_gamma;k++) gamma[k] = (k+.5f)/(float)num_gamma;
   // for(int k=0;k<num_gamma;k++) gamma[k] = k/(num_gamma-1.0f);
 
-  // allocate memory for intermediate laplacian pyramids
-  float *buf[num_gamma][max_levels] = {{0}};
-  for(int k=0;k<num_gamma;k++) for(int l=0;l<=last_level;l++)
-    buf[k][l] = dt_alloc_align_float((size_t)dl(w,l)*dl(h,l));
+  // the details of the output pyramid are a blend of those of the pyramids of all gamma samples, weighted
+  // by the padded input. accumulate them one gamma sample at a time so that only one intermediate
+  // pyramid is ever needed. output[l] holds the details of level l for now, the coarse level stays as is.
+  for(int l=0;l<last_level;l++)
+    memset(output[l], 0, sizeof(float) * dl(w,l) * dl(h,l));
+  float *buf[max_levels] = {0};
+  for(int l=0;l<=last_level;l++)
+    buf[l] = dt_alloc_align_float((size_t)dl(w,l)*dl(h,l));
 
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
@@ -629,19 +635,51 @@ void local_laplacian_internal(
   { // process images
 #if defined(__SSE2__)
     if(use_sse2)
-      apply_curve_sse2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
+      apply_curve_sse2(buf[0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
     else // brackets in next line needed for silly gcc warning:
 #endif
-    {apply_curve(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);}
+    {apply_curve(buf[0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);}
 
     // create gaussian pyramids
     for(int l=1;l<=last_level;l++)
 #if defined(__SSE2__)
       if(use_sse2)
-        gauss_reduce_sse2(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
+        gauss_reduce_sse2(buf[l-1], buf[l], dl(w,l-1), dl(h,l-1));
       else
 #endif
-        gauss_reduce(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
+        gauss_reduce(buf[l-1], buf[l], dl(w,l-1), dl(h,l-1));
+
+    // add this sample's share of the laplacians, all levels at once
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+    dt_omp_firstprivate(k, last_level, w, h) \
+    shared(buf, output, gamma, padded)
+#endif
+    for(int l=0;l<last_level;l++)
+    {
+      const int pw = dl(w,l), ph = dl(h,l);
+#ifdef _OPENMP
+#pragma omp for schedule(static) collapse(2) nowait
+#endif
+      for(int j=0;j<ph;j++) for(int i=0;i<pw;i++)
+      {
+        const float v = padded[l][j*pw+i];
+        // cheap test for the pixels this sample doesn't contribute to
+        if((k > 1 && v < gamma[k-1]) || (k < num_gamma-2 && v >= gamma[k+1])) continue;
+        int hi = 1;
+        for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
+        const int lo = hi-1;
+        if(k != lo && k != hi) continue;
+        const float a = CLAMPS((v - gamma[lo])/(gamma[hi]-gamma[lo]), 0.0f, 1.0f);
+        const float lk = ll_laplacian(buf[l+1], buf[l], i, j, pw, ph);
+        output[l][j*pw+i] += lk * (k == lo ? 1.0f-a : a);
+        // we could do this to save on memory (no need for finest buf[][]).
+        // unfortunately it results in a quite noticeable loss of sharpness, i think
+        // the extra level is worth it.
+        // else if(l == 0) // use finest scale from input to not amplify noise (and use less memory)
+        //   output[l][j*pw+i] += ll_laplacian(padded[l+1], padded[l], i, j, pw, ph);
+      }
+    }
   }
 
   // resample output[last_level] from preview
@@ -702,36 +740,22 @@ void local_laplacian_internal(
     debug_dump_PFM("/tmp/newcoarse.pfm", output[last_level], pw, ph);
   }
 
-  // assemble output pyramid coarse to fine
+  // assemble output pyramid coarse to fine, the intermediate pyramid is free again to hold the expansion
   for(int l=last_level-1;l >= 0; l--)
   {
     const int pw = dl(w,l), ph = dl(h,l);
+    float *const expanded = buf[0];
 
-    gauss_expand(output[l+1], output[l], pw, ph);
-    // go through all coefficients in the upsampled gauss buffer:
+    gauss_expand(output[l+1], expanded, pw, ph);
+    // add the upsampled gauss buffer to the accumulated details:
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(ph, pw) \
-    shared(w,h,buf,output,l,gamma,padded) \
-    schedule(static) \
-    collapse(2)
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(ph, pw, expanded) \
+    shared(output, l) \
+    schedule(static) aligned(expanded:64)
 #endif
-    for(int j=0;j<ph;j++) for(int i=0;i<pw;i++)
-    {
-      const float v = padded[l][j*pw+i];
-      int hi = 1;
-      for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
-      int lo = hi-1;
-      const float a = CLAMPS((v - gamma[lo])/(gamma[hi]-gamma[lo]), 0.0f, 1.0f);
-      const float l0 = ll_laplacian(buf[lo][l+1], buf[lo][l], i, j, pw, ph);
-      const float l1 = ll_laplacian(buf[hi][l+1], buf[hi][l], i, j, pw, ph);
-      output[l][j*pw+i] += l0 * (1.0f-a) + l1 * a;
-      // we could do this to save on memory (no need for finest buf[][]).
-      // unfortunately it results in a quite noticeable loss of sharpness, i think
-      // the extra level is worth it.
-      // else if(l == 0) // use finest scale from input to not amplify noise (and use less memory)
-      //   output[l][j*pw+i] += ll_laplacian(padded[l+1], padded[l], i, j, pw, ph);
-    }
+    for(size_t k=0;k<(size_t)pw*ph;k++)
+      output[l][k] = expanded[k] + output[l][k];
   }
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
@@ -761,7 +785,7 @@ void local_laplacian_internal(
   {
     if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
     if(!b || b->mode != 1)        dt_free_align(output[l]);
-    for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
+    dt_free_align(buf[l]);
   }
 }
 
@@ -777,7 +801,7 @@ size_t local_laplacian_memory_use(const int width,     // width of input image
   size_t memory_use = 0;
 
   for(int l=0;l<num_levels;l++)
-    memory_use += sizeof(float) * (2 + num_gamma) * dl(paddwd, l) * dl(paddht, l);
+    memory_use += sizeof(float) * 3 * dl(paddwd, l) * dl(paddht, l); // padded input, output, one gamma sample
 
   return memory_use;
 }
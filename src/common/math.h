@@ -431,6 +431,54 @@ static inline __m128 sinf_fast_sse(__m128 t)
 #endif
 
 
+/** ieee 754 half floats, for buffers which don't need the precision of floats. rounds to nearest even,
+ *  keeps infinities, nans and denormals. */
+static inline uint16_t dt_float_to_half(const float f)
+{
+  union { float f; uint32_t i; } u = { .f = f };
+  const uint32_t sign = (u.i >> 16) & 0x8000;
+  const uint32_t bits = u.i & 0x7fffffff;
+  if(bits >= 0x7f800000) // inf or nan
+    return sign | 0x7c00 | (bits > 0x7f800000 ? 0x200 : 0);
+  if(bits >= 0x477ff000) // rounds to more than the largest half
+    return sign | 0x7c00;
+  if(bits < 0x38800000)
+  {
+    // denormal half or zero
+    if(bits < 0x33000000) return sign;
+    const uint32_t mant = (bits & 0x7fffff) | 0x800000;
+    const int shift = 126 - (int)(bits >> 23);
+    const uint32_t half = mant >> shift;
+    const uint32_t rem = mant & ((1u << shift) - 1);
+    const uint32_t mid = 1u << (shift - 1);
+    return sign | (half + (rem > mid || (rem == mid && (half & 1))));
+  }
+  // rebias the exponent, a carry out of the mantissa goes into it
+  const uint32_t rebiased = bits - 0x38000000;
+  const uint32_t half = rebiased >> 13;
+  const uint32_t rem = rebiased & 0x1fff;
+  return sign | (half + (rem > 0x1000 || (rem == 0x1000 && (half & 1))));
+}
+
+static inline float dt_half_to_float(const uint16_t h)
+{
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  const uint32_t exponent = (h >> 10) & 0x1f;
+  const uint32_t mant = h & 0x3ff;
+  union { float f; uint32_t i; } u;
+  if(exponent == 0x1f)
+    u.i = sign | 0x7f800000 | (mant << 13);
+  else if(exponent)
+    u.i = sign | ((exponent + 112) << 23) | (mant << 13);
+  else
+  {
+    u.f = mant * 0x1p-24f;
+    u.i |= sign;
+  }
+  return u.f;
+}
+
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
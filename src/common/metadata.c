@@ -214,106 +214,51 @@ static GList *_list_find_custom(GList *list, gpointer data)
   return NULL;
 }
 
-static gchar *_get_tb_removed_metadata_string_values(GList *before, GList *after)
+static void _pop_undo_execute(const int imgid, GList *before, GList *after)
 {
-  GList *b = before;
-  GList *a = after;
-  gchar *metadata_list = NULL;
-
-  while(b)
+  // one row at a time, with the statements kept prepared across the images of a batch
+  for(GList *b = before; b && imgid > 0; b = g_list_next(g_list_next(b)))
   {
-    GList *same_key = _list_find_custom(a, b->data);
+    GList *same_key = _list_find_custom(after, b->data);
     GList *b2 = g_list_next(b);
-    gboolean different_value = FALSE;
     const char *value = (char *)b2->data; // if empty we can remove it
-    if(same_key)
-    {
-      GList *same2 = g_list_next(same_key);
-      different_value = g_strcmp0(same2->data, b2->data);
-    }
+    const gboolean different_value = same_key && g_strcmp0(g_list_next(same_key)->data, b2->data);
     if(!same_key || different_value || !value[0])
     {
-      metadata_list = dt_util_dstrcat(metadata_list, "%d,", atoi(b->data));
+      sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                      "DELETE FROM main.meta_data WHERE id = ?1 AND key = ?2");
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, atoi(b->data));
+      sqlite3_step(stmt);
+      dt_database_release_cached(darktable.db, stmt);
     }
-    b = g_list_next(b);
-    b = g_list_next(b);
   }
-  if(metadata_list) metadata_list[strlen(metadata_list) - 1] = '\0';
-  return metadata_list;
-}
 
-static gchar *_get_tb_added_metadata_string_values(const int img, GList *before, GList *after)
-{
-  GList *b = before;
-  GList *a = after;
-  gchar *metadata_list = NULL;
-
-  while(a)
+  for(GList *a = after; a; a = g_list_next(g_list_next(a)))
   {
-    GList *same_key = _list_find_custom(b, a->data);
+    GList *same_key = _list_find_custom(before, a->data);
     GList *a2 = g_list_next(a);
-    gboolean different_value = FALSE;
     const char *value = (char *)a2->data; // if empty we don't add it to database
-    if(same_key)
-    {
-      GList *same2 = g_list_next(same_key);
-      different_value = g_strcmp0(same2->data, a2->data);
-    }
+    const gboolean different_value = same_key && g_strcmp0(g_list_next(same_key)->data, a2->data);
     if((!same_key || different_value) && value[0])
     {
-      char *escaped_text = sqlite3_mprintf("%q", value);
-      metadata_list = dt_util_dstrcat(metadata_list, "(%d,%d,'%s'),", GPOINTER_TO_INT(img), atoi(a->data), escaped_text);
-      sqlite3_free(escaped_text);
+      sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                      "INSERT INTO main.meta_data (id, key, value)"
+                                                      " VALUES (?1, ?2, ?3)");
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, atoi(a->data));
+      DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, value, -1, SQLITE_STATIC);
+      sqlite3_step(stmt);
+      dt_database_release_cached(darktable.db, stmt);
     }
-    a = g_list_next(a);
-    a = g_list_next(a);
-  }
-  if(metadata_list) metadata_list[strlen(metadata_list) - 1] = '\0';
-  return metadata_list;
-}
-
-static void _bulk_remove_metadata(const int img, const gchar *metadata_list)
-{
-  if(img > 0 && metadata_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("DELETE FROM main.meta_data WHERE id = %d AND key IN (%s)", img, metadata_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
   }
 }
 
-static void _bulk_add_metadata(gchar *metadata_list)
-{
-  if(metadata_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("INSERT INTO main.meta_data (id, key, value) VALUES %s", metadata_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
-  }
-}
-
-static void _pop_undo_execute(const int imgid, GList *before, GList *after)
-{
-  gchar *tobe_removed_list = _get_tb_removed_metadata_string_values(before, after);
-  gchar *tobe_added_list = _get_tb_added_metadata_string_values(imgid, before, after);
-
-  _bulk_remove_metadata(imgid, tobe_removed_list);
-  _bulk_add_metadata(tobe_added_list);
-
-  g_free(tobe_removed_list);
-  g_free(tobe_added_list);
-}
-
 static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_data_t data, const dt_undo_action_t action, GList **imgs)
 {
   if(type == DT_UNDO_METADATA)
   {
+    dt_database_batch_begin(darktable.db);
     for(GList *list = (GList *)data; list; list = g_list_next(list))
     {
       dt_undo_metadata_t *undometadata = (dt_undo_metadata_t *)list->data;
@@ -323,6 +268,7 @@ static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_dat
       _pop_undo_execute(undometadata->imgid, before, after);
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undometadata->imgid));
     }
+    dt_database_batch_commit(darktable.db);
 
     DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE);
   }
@@ -331,20 +277,20 @@ static void _pop_undo(gpointer user_data, const dt_undo_type_t type, dt_undo_dat
 GList *dt_metadata_get_list_id(const int id)
 {
   GList *metadata = NULL;
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT key, value FROM main.meta_data WHERE id=?1", -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "SELECT key, value FROM main.meta_data WHERE id=?1");
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     const gchar *value = (const char *)sqlite3_column_text(stmt, 1);
     gchar *ckey = g_strdup_printf("%d", sqlite3_column_int(stmt, 0));
     gchar *cvalue = g_strdup(value ? value : ""); // to avoid NULL value
-    metadata = g_list_append(metadata, (gpointer)ckey);
-    metadata = g_list_append(metadata, (gpointer)cvalue);
+    // key then value, the pairs are in order again once reversed
+    metadata = g_list_prepend(metadata, (gpointer)ckey);
+    metadata = g_list_prepend(metadata, (gpointer)cvalue);
   }
-  sqlite3_finalize(stmt);
-  return metadata;
+  dt_database_release_cached(darktable.db, stmt);
+  return g_list_reverse(metadata);
 }
 
 static void _undo_metadata_free(gpointer data)
@@ -548,6 +494,7 @@ typedef enum dt_tag_actions_t
 static void _metadata_execute(const GList *imgs, const GList *metadata, GList **undo,
                               const gboolean undo_on, const gint action)
 {
+  dt_database_batch_begin(darktable.db);
   for(const GList *images = imgs; images; images = g_list_next(images))
   {
     const int image_id = GPOINTER_TO_INT(images->data);
@@ -576,10 +523,12 @@ static void _metadata_execute(const GList *imgs, const GList *metadata, GList **
     _pop_undo_execute(image_id, undometadata->before, undometadata->after);
 
     if(undo_on)
-      *undo = g_list_append(*undo, undometadata);
+      *undo = g_list_prepend(*undo, undometadata);
     else
       _undo_metadata_free(undometadata);
   }
+  dt_database_batch_commit(darktable.db);
+  if(undo_on) *undo = g_list_reverse(*undo);
 }
 
 void dt_metadata_set(const int imgid, const char *key, const char *value, const gboolean undo_on)
@@ -22,10 +22,18 @@
 #include "common/exif.h"
 #include "common/file_location.h"
 #include "common/grealpath.h"
+#include "common/history.h"
 #include "common/image_cache.h"
+#include "common/image_compression.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
+#ifdef HAVE_LIBHEIF
+#include "common/imageio_heif.h"
+#endif
 #include "common/imageio_module.h"
+#include "common/mipmap_pack.h"
+#include "common/resource_limits.h"
+#include "common/utility.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
@@ -61,7 +69,13 @@ typedef enum dt_mipmap_buffer_dsc_flags
 {
   DT_MIPMAP_BUFFER_DSC_FLAG_NONE = 0,
   DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE = 1 << 0,
-  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1
+  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1,
+  // dropped without writing it to disk, the copy there is taken care of elsewhere
+  DT_MIPMAP_BUFFER_DSC_FLAG_DISCARD = 1 << 2,
+  // full buffer holding a 16 bit mosaic, kept compressed in memory when evicted
+  DT_MIPMAP_BUFFER_DSC_FLAG_RAW16 = 1 << 3,
+  // restored from the compressed store which still has it
+  DT_MIPMAP_BUFFER_DSC_FLAG_STORED = 1 << 4
 } dt_mipmap_buffer_dsc_flags;
 
 // the embedded Exif data to tag thumbnails as sRGB or AdobeRGB
@@ -307,7 +321,270 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+// uncompressed disk thumbnails: this header followed by the 8-bit pixels exactly as in the
+// buffer, so they are read straight into the cache without any decoding.
+#define DT_MIPMAP_RAW_MAGIC 0x384d5444u // "DTM8"
+
+typedef struct dt_mipmap_raw_header_t
+{
+  uint32_t magic;
+  uint32_t width, height;
+  int32_t color_space;
+} dt_mipmap_raw_header_t;
+
+static inline gboolean _disk_uncompressed(void)
+{
+  return dt_conf_is_equal("cache_disk_codec", "uncompressed");
+}
+
+static inline void _get_thumbnail_filename(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                           const dt_mipmap_size_t mip, const gboolean uncompressed,
+                                           char *filename, const size_t size)
+{
+  snprintf(filename, size, "%s.d/%d/%" PRIu32 ".%s", cache->cachedir, (int)mip, imgid,
+           uncompressed ? "rgba" : "jpg");
+}
+
+static inline gboolean _raw_header_valid(const dt_mipmap_cache_t *cache, const dt_mipmap_raw_header_t *header,
+                                         const dt_mipmap_size_t mip)
+{
+  return header->magic == DT_MIPMAP_RAW_MAGIC && header->width <= cache->max_width[mip]
+         && header->height <= cache->max_height[mip];
+}
+
+static inline dt_mipmap_pack_t *_get_pack(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  return mip < DT_MIPMAP_F ? cache->pack[mip] : NULL;
+}
+
+// digest of the current history of the image, kept with packed thumbnails to tell stale ones
+static uint64_t _history_hash(const uint32_t imgid)
+{
+  dt_history_hash_values_t hash;
+  dt_history_hash_read(imgid, &hash);
+  uint64_t h = 5381;
+  for(int k = 0; k < hash.current_len; k++) h = ((h << 5) + h) ^ hash.current[k];
+  free(hash.basic);
+  free(hash.auto_apply);
+  free(hash.current);
+  return h;
+}
+
+static int _read_from_pack(dt_mipmap_cache_t *cache, dt_mipmap_pack_t *pack, dt_cache_entry_t *entry,
+                           const dt_mipmap_size_t mip)
+{
+  struct dt_mipmap_buffer_dsc *dsc = entry->data;
+  const uint32_t imgid = get_imgid(entry->key);
+  size_t len = 0;
+  int color_space = DT_COLORSPACE_NONE;
+  uint8_t *blob = dt_mipmap_pack_read(pack, imgid, _history_hash(imgid), &len, &color_space);
+  if(!blob) return 0;
+
+  dt_mipmap_raw_header_t header = { 0 };
+  if(len >= sizeof(header)) memcpy(&header, blob, sizeof(header));
+  int err = 0;
+  uint32_t width = 0, height = 0;
+  if(header.magic == DT_MIPMAP_RAW_MAGIC)
+  {
+    err = !_raw_header_valid(cache, &header, mip)
+          || len != sizeof(header) + (size_t)header.width * header.height * 4;
+    if(!err) memcpy(entry->data + sizeof(*dsc), blob + sizeof(header), len - sizeof(header));
+    width = header.width;
+    height = header.height;
+  }
+  else
+  {
+    dt_imageio_jpeg_t jpg;
+    err = dt_imageio_jpeg_decompress_header(blob, len, &jpg)
+          || jpg.width > cache->max_width[mip] || jpg.height > cache->max_height[mip]
+          || dt_imageio_jpeg_decompress(&jpg, entry->data + sizeof(*dsc));
+    width = jpg.width;
+    height = jpg.height;
+  }
+  dt_free_align(blob);
+  if(err)
+  {
+    fprintf(stderr, "[mipmap_cache] failed to decompress packed thumbnail for image %" PRIu32 "!\n", imgid);
+    dt_mipmap_pack_remove(pack, imgid);
+    return 0;
+  }
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk pack\n", mip, imgid);
+  dsc->width = width;
+  dsc->height = height;
+  dsc->iscale = 1.0f;
+  dsc->color_space = color_space;
+  return 1;
+}
+
+static void _write_to_pack(dt_mipmap_cache_t *cache, dt_mipmap_pack_t *pack, dt_cache_entry_t *entry)
+{
+  struct dt_mipmap_buffer_dsc *dsc = entry->data;
+  const uint32_t imgid = get_imgid(entry->key);
+  const uint64_t hash = _history_hash(imgid);
+  // don't recompress what is there already, as both performance and quality (lossy jpg) suffer
+  if(dt_mipmap_pack_contains(pack, imgid, hash)) return;
+
+  // first check the disk isn't full
+  char dirname[PATH_MAX] = { 0 };
+  snprintf(dirname, sizeof(dirname), "%s.d", cache->cachedir);
+  struct statvfs vfsbuf;
+  if(statvfs(dirname, &vfsbuf) || ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20) < 100)
+  {
+    fprintf(stderr, "Aborting thumbnail write as less than 100 MB are free to write %s\n", dirname);
+    return;
+  }
+
+  const size_t npixels = (size_t)dsc->width * dsc->height;
+  if(_disk_uncompressed())
+  {
+    const dt_mipmap_raw_header_t header
+        = { DT_MIPMAP_RAW_MAGIC, dsc->width, dsc->height, dsc->color_space };
+    uint8_t *blob = dt_alloc_align(64, sizeof(header) + 4 * npixels);
+    if(!blob) return;
+    memcpy(blob, &header, sizeof(header));
+    memcpy(blob + sizeof(header), entry->data + sizeof(*dsc), 4 * npixels);
+    dt_mipmap_pack_write(pack, imgid, hash, dsc->color_space, blob, sizeof(header) + 4 * npixels);
+    dt_free_align(blob);
+    return;
+  }
+
+  uint8_t *blob = dt_alloc_align(64, sizeof(uint8_t) * 4 * npixels);
+  if(!blob) return;
+  const int cache_quality = dt_conf_get_int("database_cache_quality");
+  const int len = dt_imageio_jpeg_compress(entry->data + sizeof(*dsc), blob, dsc->width, dsc->height,
+                                           MIN(100, MAX(10, cache_quality)));
+  // the color space goes to the index instead of exif data
+  if(len > 1) dt_mipmap_pack_write(pack, imgid, hash, dsc->color_space, blob, len);
+  dt_free_align(blob);
+}
+
+static gboolean _unlink_pending(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&cache->unlink_lock);
+  const gboolean pending = g_hash_table_contains(cache->unlink_pending, GUINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&cache->unlink_lock);
+  return pending;
+}
+
 // callback for the cache backend to initialize payload pointers
+typedef struct dt_mipmap_raw_entry_t
+{
+  dt_image_raw_compressed_t *raw;
+  uint64_t stamp;
+} dt_mipmap_raw_entry_t;
+
+static void _raw_entry_free(gpointer data)
+{
+  dt_mipmap_raw_entry_t *e = (dt_mipmap_raw_entry_t *)data;
+  dt_image_raw_compressed_free(e->raw);
+  free(e);
+}
+
+static inline size_t _raw_store_budget(void)
+{
+  return (size_t)MAX(0, dt_conf_get_int("cache_raw_compressed_memory")) << 20;
+}
+
+// call with raw_lock held. drops the least recently used raws until the store fits into its budget.
+static void _raw_store_trim(dt_mipmap_cache_t *cache, const size_t budget)
+{
+  while(cache->raw_mem > budget)
+  {
+    gpointer oldest = NULL;
+    uint64_t stamp = UINT64_MAX;
+    GHashTableIter it;
+    gpointer key, value;
+    g_hash_table_iter_init(&it, cache->raw_store);
+    while(g_hash_table_iter_next(&it, &key, &value))
+    {
+      const dt_mipmap_raw_entry_t *e = (dt_mipmap_raw_entry_t *)value;
+      if(e->stamp < stamp)
+      {
+        stamp = e->stamp;
+        oldest = key;
+      }
+    }
+    if(!oldest) break;
+    const dt_mipmap_raw_entry_t *e = g_hash_table_lookup(cache->raw_store, oldest);
+    cache->raw_mem -= e->raw->size;
+    g_hash_table_remove(cache->raw_store, oldest);
+  }
+  dt_memory_budget_claim(cache->raw_store, "compressed raws", cache->raw_mem);
+}
+
+static void _raw_store_put(dt_mipmap_cache_t *cache, const uint32_t imgid, const struct dt_mipmap_buffer_dsc *dsc)
+{
+  const size_t budget = _raw_store_budget();
+  if(!budget) return;
+  const double start = dt_get_wtime();
+  dt_image_raw_compressed_t *raw
+      = dt_image_raw_compress((const uint16_t *)(dsc + 1), dsc->width, dsc->height);
+  if(!raw) return;
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] compressed raw of image %" PRIu32 " to %.1f%% in %.3f secs\n", imgid,
+           100.0 * raw->size / ((size_t)dsc->width * dsc->height * sizeof(uint16_t)), dt_get_wtime() - start);
+  if(raw->size > budget)
+  {
+    dt_image_raw_compressed_free(raw);
+    return;
+  }
+
+  dt_mipmap_raw_entry_t *e = malloc(sizeof(dt_mipmap_raw_entry_t));
+  if(!e)
+  {
+    dt_image_raw_compressed_free(raw);
+    return;
+  }
+  e->raw = raw;
+  dt_pthread_mutex_lock(&cache->raw_lock);
+  e->stamp = ++cache->raw_stamp;
+  const dt_mipmap_raw_entry_t *old = g_hash_table_lookup(cache->raw_store, GUINT_TO_POINTER(imgid));
+  if(old) cache->raw_mem -= old->raw->size;
+  g_hash_table_insert(cache->raw_store, GUINT_TO_POINTER(imgid), e);
+  cache->raw_mem += raw->size;
+  _raw_store_trim(cache, budget);
+  dt_pthread_mutex_unlock(&cache->raw_lock);
+}
+
+static void _raw_store_drop(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&cache->raw_lock);
+  const dt_mipmap_raw_entry_t *e = g_hash_table_lookup(cache->raw_store, GUINT_TO_POINTER(imgid));
+  if(e)
+  {
+    cache->raw_mem -= e->raw->size;
+    g_hash_table_remove(cache->raw_store, GUINT_TO_POINTER(imgid));
+    dt_memory_budget_claim(cache->raw_store, "compressed raws", cache->raw_mem);
+  }
+  dt_pthread_mutex_unlock(&cache->raw_lock);
+}
+
+// decodes the raw of the image into the write locked full buffer if the store has it, the image
+// was loaded before so its dimensions and buffer description are known already.
+static gboolean _raw_store_get(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const dt_image_t *img)
+{
+  if(img->buf_dsc.channels != 1 || img->buf_dsc.datatype != TYPE_UINT16) return FALSE;
+
+  dt_pthread_mutex_lock(&cache->raw_lock);
+  dt_mipmap_raw_entry_t *e = g_hash_table_lookup(cache->raw_store, GUINT_TO_POINTER(img->id));
+  if(!e || e->raw->width != img->width || e->raw->height != img->height)
+  {
+    dt_pthread_mutex_unlock(&cache->raw_lock);
+    return FALSE;
+  }
+  e->stamp = ++cache->raw_stamp;
+  // the lock keeps the entry alive while decoding, restores are rare compared to the time they save
+  uint16_t *out = (uint16_t *)dt_mipmap_cache_alloc(buf, img);
+  if(out)
+  {
+    const double start = dt_get_wtime();
+    dt_image_raw_uncompress(e->raw, out);
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] restored compressed raw of image %" PRIu32 " in %.3f secs\n",
+             img->id, dt_get_wtime() - start);
+  }
+  dt_pthread_mutex_unlock(&cache->raw_lock);
+  return out != NULL;
+}
+
 void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
   dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)data;
@@ -370,14 +647,44 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   if(mip < DT_MIPMAP_F)
   {
     if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8))
+       && _get_pack(cache, mip))
+    {
+      loaded_from_disk = _read_from_pack(cache, _get_pack(cache, mip), entry, mip);
+    }
+    else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                   || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8))
+            && !_unlink_pending(cache, get_imgid(entry->key)))
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-               get_imgid(entry->key));
+      const gboolean uncompressed = _disk_uncompressed();
+      _get_thumbnail_filename(cache, get_imgid(entry->key), mip, uncompressed, filename, sizeof(filename));
       FILE *f = g_fopen(filename, "rb");
-      if(f)
+      if(f && uncompressed)
+      {
+        dt_mipmap_raw_header_t header;
+        if(fread(&header, sizeof(header), 1, f) == 1 && _raw_header_valid(cache, &header, mip)
+           && fread(entry->data + sizeof(*dsc), 4 * sizeof(uint8_t), (size_t)header.width * header.height, f)
+                  == (size_t)header.width * header.height)
+        {
+          dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk cache\n", mip,
+                   get_imgid(entry->key));
+          dsc->width = header.width;
+          dsc->height = header.height;
+          dsc->iscale = 1.0f;
+          dsc->color_space = header.color_space;
+          loaded_from_disk = 1;
+        }
+        else
+        {
+          fprintf(stderr, "[mipmap_cache] failed to read thumbnail for image %" PRIu32 " from `%s'!\n",
+                  get_imgid(entry->key), filename);
+          g_unlink(filename);
+        }
+        fclose(f);
+      }
+      else if(f)
       {
         uint8_t *blob = 0;
         fseek(f, 0, SEEK_END);
@@ -441,27 +748,46 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
   if(cache->cachedir[0])
   {
     char filename[PATH_MAX] = { 0 };
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
+    _get_thumbnail_filename(cache, imgid, mip, FALSE, filename, sizeof(filename));
+    g_unlink(filename);
+    _get_thumbnail_filename(cache, imgid, mip, TRUE, filename, sizeof(filename));
     g_unlink(filename);
   }
+  if(_get_pack(cache, mip)) dt_mipmap_pack_remove(_get_pack(cache, mip), imgid);
 }
 
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
   dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)data;
   const dt_mipmap_size_t mip = get_size(entry->key);
-  if(mip < DT_MIPMAP_F)
+  if(mip == DT_MIPMAP_FULL && (void *)entry->data != (void *)dt_mipmap_cache_static_dead_image)
+  {
+    const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    if(dsc->flags & (DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE | DT_MIPMAP_BUFFER_DSC_FLAG_DISCARD))
+      _raw_store_drop(cache, get_imgid(entry->key));
+    else if((dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_RAW16) && !(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_STORED)
+            && dsc->width > 8 && dsc->height > 8)
+      _raw_store_put(cache, get_imgid(entry->key), dsc);
+  }
+  else if(mip < DT_MIPMAP_F)
   {
     struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
     // don't write skulls:
-    if(dsc->width > 8 && dsc->height > 8)
+    if(dsc->width > 8 && dsc->height > 8 && !(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_DISCARD))
     {
       if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
       else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8))
+              && _get_pack(cache, mip))
+      {
+        _write_to_pack(cache, _get_pack(cache, mip), entry);
+      }
+      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8))
+              && !_unlink_pending(cache, get_imgid(entry->key)))
       {
         // serialize to disk
         char filename[PATH_MAX] = {0};
@@ -469,8 +795,8 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
         const int mkd = g_mkdir_with_parents(filename, 0750);
         if(!mkd)
         {
-          snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-                   get_imgid(entry->key));
+          const gboolean uncompressed = _disk_uncompressed();
+          _get_thumbnail_filename(cache, get_imgid(entry->key), mip, uncompressed, filename, sizeof(filename));
           // Don't write existing files as both performance and quality (lossy jpg) suffer
           FILE *f = NULL;
           if (!g_file_test(filename, G_FILE_TEST_EXISTS) && (f = g_fopen(filename, "wb")))
@@ -492,6 +818,19 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
               goto write_error;
             }
 
+            if(uncompressed)
+            {
+              const dt_mipmap_raw_header_t header
+                  = { DT_MIPMAP_RAW_MAGIC, dsc->width, dsc->height, dsc->color_space };
+              const size_t npixels = (size_t)dsc->width * dsc->height;
+              if(fwrite(&header, sizeof(header), 1, f) != 1
+                 || fwrite(entry->data + sizeof(*dsc), 4 * sizeof(uint8_t), npixels, f) != npixels)
+                goto write_error;
+              fclose(f);
+              f = NULL;
+              goto write_done;
+            }
+
             const int cache_quality = dt_conf_get_int("database_cache_quality");
             const uint8_t *exif = NULL;
             int exif_len = 0;
@@ -511,6 +850,7 @@ write_error:
               g_unlink(filename);
             }
           }
+write_done:
           if(f) fclose(f);
         }
       }
@@ -529,6 +869,31 @@ static uint32_t nearest_power_of_two(const uint32_t value)
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+  dt_pthread_mutex_init(&cache->unlink_lock, NULL);
+  cache->unlink_pending = g_hash_table_new(NULL, NULL);
+  dt_pthread_mutex_init(&cache->replace_lock, NULL);
+  cache->replace_pending = g_hash_table_new(NULL, NULL);
+  cache->replacing = g_hash_table_new(NULL, NULL);
+  cache->replace_queued = FALSE;
+  cache->preview_only = g_hash_table_new(NULL, NULL);
+  dt_pthread_mutex_init(&cache->raw_lock, NULL);
+  cache->raw_store = g_hash_table_new_full(NULL, NULL, NULL, _raw_entry_free);
+  cache->raw_mem = 0;
+  cache->raw_stamp = 0;
+
+  // the packed disk backend is picked at startup, one pack file per level
+  for(int k = 0; k < DT_MIPMAP_F; k++) cache->pack[k] = NULL;
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend_packed"))
+  {
+    char prefix[PATH_MAX] = { 0 };
+    snprintf(prefix, sizeof(prefix), "%s.d", cache->cachedir);
+    if(!g_mkdir_with_parents(prefix, 0750))
+      for(int k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
+      {
+        snprintf(prefix, sizeof(prefix), "%s.d/%d", cache->cachedir, k);
+        cache->pack[k] = dt_mipmap_pack_open(prefix);
+      }
+  }
   // make sure static memory is initialized
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -603,11 +968,37 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
                                           * cache->max_height[DT_MIPMAP_F];
 }
 
+static void _unlink_thumbnails(dt_mipmap_cache_t *cache, const uint32_t *imgs, const int count);
+
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+  // deletions not done in the background yet
+  GList *pending = g_hash_table_get_keys(cache->unlink_pending);
+  for(const GList *l = pending; l; l = g_list_next(l))
+  {
+    const uint32_t imgid = GPOINTER_TO_UINT(l->data);
+    _unlink_thumbnails(cache, &imgid, 1);
+  }
+  g_list_free(pending);
+
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  // after the caches, evicting the last thumbnails still writes to them
+  for(int k = 0; k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_pack_close(cache->pack[k]);
+    cache->pack[k] = NULL;
+  }
+  g_hash_table_destroy(cache->unlink_pending);
+  dt_pthread_mutex_destroy(&cache->unlink_lock);
+  g_hash_table_destroy(cache->replace_pending);
+  g_hash_table_destroy(cache->replacing);
+  g_hash_table_destroy(cache->preview_only);
+  dt_pthread_mutex_destroy(&cache->replace_lock);
+  dt_memory_budget_claim(cache->raw_store, "compressed raws", 0);
+  g_hash_table_destroy(cache->raw_store);
+  dt_pthread_mutex_destroy(&cache->raw_lock);
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -732,10 +1123,8 @@ void dt_mipmap_cache_get_with_caller(
     if(!cache->cachedir[0]) return;
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_cache_on_disk(cache, imgid, mip)) return;
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -778,6 +1167,13 @@ void dt_mipmap_cache_get_with_caller(
         buf->width = buf->height = 0;
         buf->iscale = 0.0f;
         buf->color_space = DT_COLORSPACE_NONE; // TODO: does the full buffer need to know this?
+        if(_raw_store_get(cache, buf, &buffered_image))
+        {
+          ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+          dsc = (struct dt_mipmap_buffer_dsc *)buf->cache_entry->data;
+          dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_RAW16 | DT_MIPMAP_BUFFER_DSC_FLAG_STORED;
+          goto full_done;
+        }
         dt_imageio_retval_t ret = dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
         // might have been reallocated:
         ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
@@ -805,7 +1201,10 @@ void dt_mipmap_cache_get_with_caller(
           // imgid, data[0], data[1], img->width, img->height, data);
           // don't write xmp for this (we only changed db stuff):
           dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
+          if(buffered_image.buf_dsc.channels == 1 && buffered_image.buf_dsc.datatype == TYPE_UINT16)
+            dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_RAW16;
         }
+full_done:;
       }
       else if(mip == DT_MIPMAP_F)
       {
@@ -915,13 +1314,8 @@ void dt_mipmap_cache_get_with_caller(
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(dt_mipmap_cache_on_disk(cache, imgid, mip))
+      dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = 0;
@@ -1010,6 +1404,8 @@ void dt_mipmap_cache_remove(dt_mipmap_cache_t *cache, const uint32_t imgid)
   {
     dt_mipmap_cache_remove_at_size(cache, imgid, k);
   }
+  // the raw might be loaded differently next time
+  _raw_store_drop(cache, imgid);
 }
 void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
 {
@@ -1018,6 +1414,12 @@ void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgi
   dt_cache_remove(&_get_cache(cache, mip)->cache, key);
 }
 
+gboolean dt_mipmap_cache_try_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                           const dt_mipmap_size_t mip)
+{
+  return !dt_cache_try_remove(&_get_cache(cache, mip)->cache, get_key(imgid, mip));
+}
+
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
 {
   for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
@@ -1029,6 +1431,107 @@ void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
   }
 }
 
+// deletes the thumbnails on disk of the images still marked pending, unmarking them. whoever
+// unmarks an image does its deletion, so the background job and cleanup never do it twice.
+static void _unlink_thumbnails(dt_mipmap_cache_t *cache, const uint32_t *imgs, const int count)
+{
+  for(int k = 0; k < count; k++)
+  {
+    dt_pthread_mutex_lock(&cache->unlink_lock);
+    const gboolean pending = g_hash_table_remove(cache->unlink_pending, GUINT_TO_POINTER(imgs[k]));
+    dt_pthread_mutex_unlock(&cache->unlink_lock);
+    if(!pending) continue;
+    for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+      dt_mipmap_cache_unlink_ondisk_thumbnail(cache, imgs[k], mip);
+  }
+}
+
+typedef struct _unlink_job_t
+{
+  dt_mipmap_cache_t *cache;
+  uint32_t *imgs;
+  int count;
+} _unlink_job_t;
+
+static int32_t _unlink_job_run(dt_job_t *job)
+{
+  _unlink_job_t *params = dt_control_job_get_params(job);
+  _unlink_thumbnails(params->cache, params->imgs, params->count);
+  return 0;
+}
+
+static void _unlink_job_cleanup(void *data)
+{
+  _unlink_job_t *params = (_unlink_job_t *)data;
+  // the job didn't run, we can't leave stale thumbnails behind
+  _unlink_thumbnails(params->cache, params->imgs, params->count);
+  g_free(params->imgs);
+  free(params);
+}
+
+static void _mark_discard(void *data, dt_cache_entry_t *entry)
+{
+  ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+  struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_DISCARD;
+}
+
+// keys of all ldr levels of the given images, they all live in the thumbnail cache
+static int _list_keys(const GList *imgs, uint32_t **imgids, uint32_t **keys)
+{
+  const int count = g_list_length((GList *)imgs);
+  *imgids = g_new(uint32_t, count);
+  *keys = g_new(uint32_t, (size_t)count * DT_MIPMAP_F);
+  int k = 0;
+  for(const GList *l = imgs; l; l = g_list_next(l), k++)
+  {
+    const uint32_t imgid = GPOINTER_TO_INT(l->data);
+    (*imgids)[k] = imgid;
+    for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+      (*keys)[(size_t)k * DT_MIPMAP_F + mip] = get_key(imgid, mip);
+  }
+  return count;
+}
+
+void dt_mipmap_cache_remove_list(dt_mipmap_cache_t *cache, const GList *imgs)
+{
+  uint32_t *imgids, *keys;
+  const int count = _list_keys(imgs, &imgids, &keys);
+
+  // mark first: from now on nothing is read back from disk for these
+  dt_pthread_mutex_lock(&cache->unlink_lock);
+  for(int k = 0; k < count; k++) g_hash_table_add(cache->unlink_pending, GUINT_TO_POINTER(imgids[k]));
+  dt_pthread_mutex_unlock(&cache->unlink_lock);
+
+  dt_cache_remove_list(&cache->mip_thumbs.cache, keys, count * DT_MIPMAP_F, _mark_discard, cache);
+  g_free(keys);
+
+  _unlink_job_t *params = count ? (_unlink_job_t *)calloc(1, sizeof(_unlink_job_t)) : NULL;
+  dt_job_t *job = params && darktable.gui ? dt_control_job_create(&_unlink_job_run, "remove thumbnails") : NULL;
+  if(!job)
+  {
+    _unlink_thumbnails(cache, imgids, count);
+    g_free(imgids);
+    free(params);
+    return;
+  }
+  params->cache = cache;
+  params->imgs = imgids;
+  params->count = count;
+  dt_control_job_set_params(job, params, _unlink_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+void dt_mipmap_cache_evict_list(dt_mipmap_cache_t *cache, const GList *imgs)
+{
+  uint32_t *imgids, *keys;
+  const int count = _list_keys(imgs, &imgids, &keys);
+  // write thumbnails to disc if not existing there
+  dt_cache_remove_list(&cache->mip_thumbs.cache, keys, count * DT_MIPMAP_F, NULL, NULL);
+  g_free(imgids);
+  g_free(keys);
+}
+
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *out, uint32_t *width, uint32_t *height, float *iscale,
                     const uint32_t imgid)
 {
@@ -1152,6 +1655,88 @@ static int _write_image(dt_imageio_module_data_t *data, const char *filename, co
   return 0;
 }
 
+static gboolean _replacing(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&cache->replace_lock);
+  const gboolean replacing = g_hash_table_contains(cache->replacing, GUINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&cache->replace_lock);
+  return replacing;
+}
+
+static gboolean _preview_only(dt_mipmap_cache_t *cache, const uint32_t imgid)
+{
+  dt_pthread_mutex_lock(&cache->replace_lock);
+  const gboolean preview_only = g_hash_table_contains(cache->preview_only, GUINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&cache->replace_lock);
+  return preview_only;
+}
+
+// records which kind of thumbnails the image has, the embedded ones get replaced in the background
+static void _set_thumbnail_embedded(dt_mipmap_cache_t *cache, const uint32_t imgid, const gboolean embedded)
+{
+  const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!cimg) return;
+  const gboolean changed = ((cimg->flags & DT_IMAGE_THUMBNAIL_EMBEDDED) != 0) != embedded;
+  dt_image_cache_read_release(darktable.image_cache, cimg);
+
+  if(changed)
+  {
+    dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
+    if(embedded)
+      img->flags |= DT_IMAGE_THUMBNAIL_EMBEDDED;
+    else
+      img->flags &= ~DT_IMAGE_THUMBNAIL_EMBEDDED;
+    dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
+  }
+  if(!embedded) return;
+
+  dt_pthread_mutex_lock(&cache->replace_lock);
+  // the one who asked for the preview only replaces it
+  if(g_hash_table_contains(cache->preview_only, GUINT_TO_POINTER(imgid)))
+  {
+    dt_pthread_mutex_unlock(&cache->replace_lock);
+    return;
+  }
+  g_hash_table_add(cache->replace_pending, GUINT_TO_POINTER(imgid));
+  const gboolean queue = !cache->replace_queued && darktable.gui;
+  if(queue) cache->replace_queued = TRUE;
+  dt_pthread_mutex_unlock(&cache->replace_lock);
+
+  if(queue)
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, dt_image_replace_thumbnails_job_create());
+}
+
+GList *dt_mipmap_cache_take_replace_pending(dt_mipmap_cache_t *cache)
+{
+  dt_pthread_mutex_lock(&cache->replace_lock);
+  GList *imgs = g_hash_table_get_keys(cache->replace_pending);
+  g_hash_table_steal_all(cache->replace_pending);
+  // whatever gets marked from now on needs a job of its own
+  cache->replace_queued = FALSE;
+  dt_pthread_mutex_unlock(&cache->replace_lock);
+  return imgs;
+}
+
+void dt_mipmap_cache_set_replacing(dt_mipmap_cache_t *cache, const uint32_t imgid, const gboolean replacing)
+{
+  dt_pthread_mutex_lock(&cache->replace_lock);
+  if(replacing)
+    g_hash_table_add(cache->replacing, GUINT_TO_POINTER(imgid));
+  else
+    g_hash_table_remove(cache->replacing, GUINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&cache->replace_lock);
+}
+
+void dt_mipmap_cache_set_preview_only(dt_mipmap_cache_t *cache, const uint32_t imgid, const gboolean preview_only)
+{
+  dt_pthread_mutex_lock(&cache->replace_lock);
+  if(preview_only)
+    g_hash_table_add(cache->preview_only, GUINT_TO_POINTER(imgid));
+  else
+    g_hash_table_remove(cache->preview_only, GUINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&cache->replace_lock);
+}
+
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
                     const dt_mipmap_size_t size)
@@ -1171,9 +1756,28 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     return;
   }
 
-  const gboolean altered = dt_image_altered(imgid);
   int res = 1;
 
+  // a larger level already in memory is the cheapest source by far: it's in sync with the history
+  // (all levels are dropped when it changes) and needs no decoding. take the closest one.
+  for(dt_mipmap_size_t k = size + 1; k < DT_MIPMAP_F && res; k++)
+  {
+    dt_mipmap_buffer_t tmp;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &tmp, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
+    if(tmp.buf == NULL) continue;
+    if(tmp.width && tmp.height)
+    {
+      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from level %d\n", size, imgid, k);
+      *color_space = tmp.color_space;
+      dt_iop_downsample_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, width, height);
+      res = 0;
+    }
+    dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
+  }
+  if(!res) return;
+
+  const gboolean altered = dt_image_altered(imgid);
+
   const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
   // the orientation for this camera is not read correctly from exiv2, so we need
   // to go the full path (as the thumbnail will be flipped the wrong way round)
@@ -1182,7 +1786,12 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
 
   const char *min = dt_conf_get_string_const("plugins/lighttable/thumbnail_raw_min_level");
   const dt_mipmap_size_t min_s = dt_mipmap_cache_get_min_mip_from_pref(min);
-  const gboolean use_embedded = (size <= min_s);
+  // two phase thumbnails take the embedded preview first whatever the size, processed ones follow later
+  const gboolean preview_only = _preview_only(darktable.mipmap_cache, imgid);
+  const gboolean first_phase = size > min_s && dt_conf_get_bool("plugins/lighttable/thumbnail_two_phase")
+                               && !_replacing(darktable.mipmap_cache, imgid);
+  const gboolean use_embedded = (size <= min_s) || first_phase || preview_only;
+  gboolean embedded = FALSE;
 
   if(!altered && use_embedded && !incompatible)
   {
@@ -1193,14 +1802,20 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     memset(filename, 0, sizeof(filename));
     dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
 
+    // the sources are oriented afterwards, so is the size they have to cover
+    const gboolean swap = (orientation & ORIENTATION_SWAP_XY) != 0;
+    const int cover_wd = swap ? ht : wd;
+    const int cover_ht = swap ? wd : ht;
+
     const char *c = filename + strlen(filename);
     while(*c != '.' && c > filename) c--;
-    if(!strcasecmp(c, ".jpg"))
+    if(!strcasecmp(c, ".jpg") || !strcasecmp(c, ".jpeg"))
     {
-      // try to load jpg
+      // try to load jpg, decoded no larger than needed
       dt_imageio_jpeg_t jpg;
       if(!dt_imageio_jpeg_read_header(filename, &jpg))
       {
+        dt_imageio_jpeg_set_target_size(&jpg, cover_wd, cover_ht);
         uint8_t *tmp = (uint8_t *)malloc(sizeof(uint8_t) * jpg.width * jpg.height * 4);
         *color_space = dt_imageio_jpeg_read_color_space(&jpg);
         if(!dt_imageio_jpeg_read(&jpg, tmp))
@@ -1213,11 +1828,28 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
         free(tmp);
       }
     }
+#ifdef HAVE_LIBHEIF
+    else if(!strcasecmp(c, ".heic") || !strcasecmp(c, ".heif") || !strcasecmp(c, ".hif"))
+    {
+      // heif files usually carry a thumbnail of their own, otherwise it's the full decode below
+      uint8_t *tmp = NULL;
+      int32_t thumb_width, thumb_height;
+      if(!dt_imageio_heif_thumbnail(filename, cover_wd, cover_ht, &tmp, &thumb_width, &thumb_height, color_space))
+      {
+        dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from heif thumbnail\n", size, imgid);
+        dt_iop_flip_and_zoom_8(tmp, thumb_width, thumb_height, buf, wd, ht, orientation, width, height);
+        embedded = TRUE;
+        res = 0;
+      }
+      dt_free_align(tmp);
+    }
+#endif
     else
     {
       uint8_t *tmp = 0;
       int32_t thumb_width, thumb_height;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+      res = dt_imageio_large_thumbnail_scaled(filename, &tmp, &thumb_width, &thumb_height, color_space, cover_wd,
+                                              cover_ht);
       if(!res)
       {
         // if the thumbnail is not large enough, we compute one
@@ -1225,7 +1857,8 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
         const int imgwd = img2->width;
         const int imght = img2->height;
         dt_image_cache_read_release(darktable.image_cache, img2);
-        if(thumb_width < wd && thumb_height < ht && thumb_width < imgwd - 4 && thumb_height < imght - 4)
+        if(!preview_only && thumb_width < wd && thumb_height < ht && thumb_width < imgwd - 4
+           && thumb_height < imght - 4)
         {
           res = 1;
         }
@@ -1234,36 +1867,17 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
           // scale to fit
           dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from embedded jpeg\n", size, imgid);
           dt_iop_flip_and_zoom_8(tmp, thumb_width, thumb_height, buf, wd, ht, orientation, width, height);
+          embedded = TRUE;
         }
         dt_free_align(tmp);
       }
     }
   }
 
-  if(res)
-  {
-    //try to generate mip from larger mip
-    for(dt_mipmap_size_t k = size + 1; k < DT_MIPMAP_F; k++)
-    {
-      dt_mipmap_buffer_t tmp;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &tmp, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
-      if(tmp.buf == NULL)
-        continue;
-      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from level %d\n", size, imgid, k);
-      *color_space = tmp.color_space;
-      // downsample
-      dt_iop_flip_and_zoom_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, ORIENTATION_NONE, width, height);
-
-      dt_mipmap_cache_release(darktable.mipmap_cache, &tmp);
-      res = 0;
-      break;
-    }
-  }
-
   if(res)
   {
     // try the real thing: rawspeed + pixelpipe
-    dt_imageio_module_format_t format;
+    dt_imageio_module_format_t format = { 0 };
     _dummy_data_t dat;
     format.bpp = _bpp;
     format.write_image = _write_image;
@@ -1279,6 +1893,7 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     if(!res)
     {
       dt_print(DT_DEBUG_CACHE, "[mipmap_cache] generate mip %d for image %d from scratch\n", size, imgid);
+      _set_thumbnail_embedded(darktable.mipmap_cache, imgid, FALSE);
       // might be smaller, or have a different aspect than what we got as input.
       *width = dat.head.width;
       *height = dat.head.height;
@@ -1300,6 +1915,9 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     return;
   }
 
+  // the preview only stands in for the processed thumbnail, which is rendered in the background
+  if(embedded && (first_phase || preview_only)) _set_thumbnail_embedded(darktable.mipmap_cache, imgid, TRUE);
+
   // TODO: various speed optimizations:
   // TODO: also init all smaller mips!
   // TODO: use mipf, but:
@@ -1313,17 +1931,44 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace()
   return DT_COLORSPACE_DISPLAY;
 }
 
+gboolean dt_mipmap_cache_on_disk(const dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F) return FALSE;
+  dt_mipmap_pack_t *pack = _get_pack(cache, mip);
+  if(pack) return dt_mipmap_pack_contains(pack, imgid, _history_hash(imgid));
+  if(_unlink_pending((dt_mipmap_cache_t *)cache, imgid)) return FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _get_thumbnail_filename(cache, imgid, mip, _disk_uncompressed(), filename, sizeof(filename));
+  return dt_util_test_image_file(filename);
+}
+
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
 {
-  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
+  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend") && _get_pack(cache, DT_MIPMAP_0))
+  {
+    const uint64_t src_hash = _history_hash(src_imgid);
+    const uint64_t dst_hash = _history_hash(dst_imgid);
+    for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
+    {
+      dt_mipmap_pack_t *pack = _get_pack(cache, mip);
+      size_t len = 0;
+      int color_space = DT_COLORSPACE_NONE;
+      uint8_t *blob = pack ? dt_mipmap_pack_read(pack, src_imgid, src_hash, &len, &color_space) : NULL;
+      if(!blob) continue;
+      dt_mipmap_pack_write(pack, dst_imgid, dst_hash, color_space, blob, len);
+      dt_free_align(blob);
+    }
+  }
+  else if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
-      snprintf(srcpath, sizeof(srcpath), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, src_imgid);
-      snprintf(dstpath, sizeof(dstpath), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, dst_imgid);
+      _get_thumbnail_filename(cache, src_imgid, mip, _disk_uncompressed(), srcpath, sizeof(srcpath));
+      _get_thumbnail_filename(cache, dst_imgid, mip, _disk_uncompressed(), dstpath, sizeof(dstpath));
       GFile *src = g_file_new_for_path(srcpath);
       GFile *dst = g_file_new_for_path(dstpath);
       GError *gerror = NULL;
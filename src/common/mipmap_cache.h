@@ -99,6 +99,25 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // packed disk backend per thumbnail level, all NULL if thumbnails are kept as one jpeg file each
+  struct dt_mipmap_pack_t *pack[DT_MIPMAP_F];
+  // images whose thumbnails on disk are stale and about to be deleted in the background.
+  // they must not be read back meanwhile.
+  dt_pthread_mutex_t unlink_lock;
+  GHashTable *unlink_pending;
+  // two phase thumbnails: images shown with their embedded preview waiting for the background job
+  // to replace it, and those being replaced right now which must get processed thumbnails.
+  dt_pthread_mutex_t replace_lock;
+  GHashTable *replace_pending;
+  GHashTable *replacing;
+  gboolean replace_queued;
+  // tethered shots shown with whatever embedded preview they carry until their processed one is rendered
+  GHashTable *preview_only;
+  // losslessly compressed raw full buffers evicted from mip_full, decoded instead of loading the file again
+  dt_pthread_mutex_t raw_lock;
+  GHashTable *raw_store;
+  size_t raw_mem;
+  uint64_t raw_stamp;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -145,7 +164,14 @@ void dt_mipmap_cache_remove_at_size(dt_mipmap_cache_t *cache, const uint32_t img
 
 // evict thumbnails from cache. They will be written to disc if not existing
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid);
+// the same for a list of image ids, with one pass over the cache for all of them.
+// removing deletes the thumbnails on disk in the background.
+void dt_mipmap_cache_remove_list(dt_mipmap_cache_t *cache, const GList *imgs);
+void dt_mipmap_cache_evict_list(dt_mipmap_cache_t *cache, const GList *imgs);
 void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+// evicts only if nobody holds the buffer right now, TRUE if it was dropped
+gboolean dt_mipmap_cache_try_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                           const dt_mipmap_size_t mip);
 
 // return the closest mipmap size
 // for the given window you wish to draw.
@@ -163,10 +189,24 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
 // only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
+// is there a thumbnail of the image at this size in the disk backend?
+gboolean dt_mipmap_cache_on_disk(const dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip);
+
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
 
 // return the mipmap corresponding to text value saved in prefs
 dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(const char *value);
+
+// two phase thumbnails (plugins/lighttable/thumbnail_two_phase): the images whose embedded previews wait
+// for replacement, handed over to the caller who replaces them. marking an image as being replaced makes
+// its thumbnails come from the pixelpipe until it is unmarked again.
+GList *dt_mipmap_cache_take_replace_pending(dt_mipmap_cache_t *cache);
+void dt_mipmap_cache_set_replacing(dt_mipmap_cache_t *cache, const uint32_t imgid, const gboolean replacing);
+// marking an image as preview only makes its thumbnails come from the embedded preview whatever the size
+// and its quality, and keeps it out of the two phase replacement. whoever marks it renders the processed
+// thumbnails once it is unmarked again.
+void dt_mipmap_cache_set_preview_only(dt_mipmap_cache_t *cache, const uint32_t imgid, const gboolean preview_only);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
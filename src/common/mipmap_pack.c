@@ -0,0 +1,326 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define _pack_seek _fseeki64
+#define _pack_tell _ftelli64
+#else
+#define _pack_seek fseeko
+#define _pack_tell ftello
+#endif
+
+#define DT_MIPMAP_PACK_MAGIC 0x504d5444u // "DTMP"
+#define DT_MIPMAP_PACK_VERSION 1
+// rewrite the data file when more than half of it, and at least this much, is dead
+#define DT_MIPMAP_PACK_COMPACT_MIN ((uint64_t)32 << 20)
+
+typedef struct dt_mipmap_pack_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+} dt_mipmap_pack_header_t;
+
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t imgid;
+  int32_t color_space;
+  uint64_t offset;
+  uint64_t length; // 0 marks a removed thumbnail
+  uint64_t hash;   // history hash the thumbnail was made for
+} dt_mipmap_pack_record_t;
+
+struct dt_mipmap_pack_t
+{
+  GMutex lock;
+  gchar *datafile, *indexfile;
+  FILE *data;          // concatenated blobs
+  FILE *index;         // header followed by records
+  GHashTable *records; // imgid -> live dt_mipmap_pack_record_t
+  uint64_t end;        // size of the data file
+  uint64_t garbage;    // bytes of the data file no record points to anymore
+};
+
+static dt_mipmap_pack_record_t *_pack_record_dup(const dt_mipmap_pack_record_t *rec)
+{
+  dt_mipmap_pack_record_t *copy = g_malloc(sizeof(dt_mipmap_pack_record_t));
+  *copy = *rec;
+  return copy;
+}
+
+static int _pack_append_record(dt_mipmap_pack_t *pack, const dt_mipmap_pack_record_t *rec)
+{
+  if(_pack_seek(pack->index, 0, SEEK_END)) return 1;
+  if(fwrite(rec, sizeof(*rec), 1, pack->index) != 1) return 1;
+  return fflush(pack->index) != 0;
+}
+
+static FILE *_pack_create_index(const char *filename)
+{
+  FILE *f = g_fopen(filename, "w+b");
+  if(!f) return NULL;
+  const dt_mipmap_pack_header_t header = { DT_MIPMAP_PACK_MAGIC, DT_MIPMAP_PACK_VERSION };
+  if(fwrite(&header, sizeof(header), 1, f) != 1 || fflush(f))
+  {
+    fclose(f);
+    return NULL;
+  }
+  return f;
+}
+
+// replays the index log into the table of live records
+static void _pack_load_index(dt_mipmap_pack_t *pack)
+{
+  GMappedFile *map = g_mapped_file_new(pack->indexfile, FALSE, NULL);
+  if(!map) return;
+
+  const char *contents = g_mapped_file_get_contents(map);
+  const size_t len = g_mapped_file_get_length(map);
+  dt_mipmap_pack_header_t header;
+  if(len >= sizeof(header))
+  {
+    memcpy(&header, contents, sizeof(header));
+    if(header.magic == DT_MIPMAP_PACK_MAGIC && header.version == DT_MIPMAP_PACK_VERSION)
+    {
+      // a torn record at the end, from a crash while writing, is ignored
+      for(size_t pos = sizeof(header); pos + sizeof(dt_mipmap_pack_record_t) <= len;
+          pos += sizeof(dt_mipmap_pack_record_t))
+      {
+        dt_mipmap_pack_record_t rec;
+        memcpy(&rec, contents + pos, sizeof(rec));
+        // the blob didn't make it to disk
+        if(rec.offset + rec.length > pack->end) continue;
+
+        dt_mipmap_pack_record_t *old = g_hash_table_lookup(pack->records, GUINT_TO_POINTER(rec.imgid));
+        if(old) pack->garbage += old->length;
+        if(rec.length)
+          g_hash_table_insert(pack->records, GUINT_TO_POINTER(rec.imgid), _pack_record_dup(&rec));
+        else
+          g_hash_table_remove(pack->records, GUINT_TO_POINTER(rec.imgid));
+      }
+    }
+  }
+  g_mapped_file_unref(map);
+}
+
+// copies all live blobs to fresh files and swaps them in. keeps the old files on failure.
+static void _pack_compact(dt_mipmap_pack_t *pack)
+{
+  gchar *datatmp = g_strconcat(pack->datafile, ".tmp", NULL);
+  gchar *indextmp = g_strconcat(pack->indexfile, ".tmp", NULL);
+  FILE *data = g_fopen(datatmp, "w+b");
+  FILE *index = _pack_create_index(indextmp);
+  GHashTable *records = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  gboolean ok = data && index;
+  uint64_t end = 0;
+  void *buf = NULL;
+  size_t bufsize = 0;
+
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, pack->records);
+  while(ok && g_hash_table_iter_next(&iter, &key, &value))
+  {
+    dt_mipmap_pack_record_t rec = *(dt_mipmap_pack_record_t *)value;
+    if(rec.length > bufsize)
+    {
+      g_free(buf);
+      bufsize = rec.length;
+      buf = g_malloc(bufsize);
+    }
+    ok = !_pack_seek(pack->data, rec.offset, SEEK_SET) && fread(buf, 1, rec.length, pack->data) == rec.length
+         && fwrite(buf, 1, rec.length, data) == rec.length;
+    rec.offset = end;
+    end += rec.length;
+    ok = ok && fwrite(&rec, sizeof(rec), 1, index) == 1;
+    if(ok) g_hash_table_insert(records, key, _pack_record_dup(&rec));
+  }
+  g_free(buf);
+  ok = ok && !fflush(data) && !fflush(index);
+
+  if(data) fclose(data);
+  if(index) fclose(index);
+  if(ok)
+  {
+    fclose(pack->data);
+    fclose(pack->index);
+    // windows can't rename over existing files
+    g_unlink(pack->datafile);
+    g_unlink(pack->indexfile);
+    ok = !g_rename(datatmp, pack->datafile) && !g_rename(indextmp, pack->indexfile);
+    pack->data = g_fopen(pack->datafile, ok ? "r+b" : "w+b");
+    pack->index = ok ? g_fopen(pack->indexfile, "r+b") : _pack_create_index(pack->indexfile);
+  }
+  if(ok && pack->data && pack->index)
+  {
+    dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compacted `%s' from %" PRIu64 " to %" PRIu64 " bytes\n",
+             pack->datafile, pack->end, end);
+    g_hash_table_destroy(pack->records);
+    pack->records = records;
+    pack->end = end;
+    pack->garbage = 0;
+  }
+  else
+  {
+    g_unlink(datatmp);
+    g_unlink(indextmp);
+    g_hash_table_destroy(records);
+    if(ok) // swapped in but can't reopen, start over empty
+    {
+      g_hash_table_remove_all(pack->records);
+      pack->end = pack->garbage = 0;
+    }
+  }
+  g_free(datatmp);
+  g_free(indextmp);
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *prefix)
+{
+  dt_mipmap_pack_t *pack = g_malloc0(sizeof(dt_mipmap_pack_t));
+  g_mutex_init(&pack->lock);
+  pack->datafile = g_strconcat(prefix, ".pack", NULL);
+  pack->indexfile = g_strconcat(prefix, ".idx", NULL);
+  pack->records = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+  pack->data = g_fopen(pack->datafile, "r+b");
+  if(!pack->data) pack->data = g_fopen(pack->datafile, "w+b");
+  if(pack->data && !_pack_seek(pack->data, 0, SEEK_END)) pack->end = _pack_tell(pack->data);
+
+  if(pack->data)
+  {
+    _pack_load_index(pack);
+    pack->index = g_fopen(pack->indexfile, "r+b");
+    if(!pack->index || g_hash_table_size(pack->records) == 0)
+    {
+      // index lost or unreadable: the data is of no use either
+      if(pack->index) fclose(pack->index);
+      pack->index = _pack_create_index(pack->indexfile);
+      if(pack->end)
+      {
+        fclose(pack->data);
+        pack->data = g_fopen(pack->datafile, "w+b");
+        pack->end = 0;
+      }
+    }
+  }
+
+  if(!pack->data || !pack->index)
+  {
+    fprintf(stderr, "[mipmap_pack] can't open `%s'\n", pack->datafile);
+    dt_mipmap_pack_close(pack);
+    return NULL;
+  }
+
+  if(pack->garbage > DT_MIPMAP_PACK_COMPACT_MIN && pack->garbage > pack->end / 2) _pack_compact(pack);
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] opened `%s' with %u thumbnails\n", pack->datafile,
+           g_hash_table_size(pack->records));
+  return pack;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+  if(pack->data) fclose(pack->data);
+  if(pack->index) fclose(pack->index);
+  g_hash_table_destroy(pack->records);
+  g_free(pack->datafile);
+  g_free(pack->indexfile);
+  g_mutex_clear(&pack->lock);
+  g_free(pack);
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint64_t hash)
+{
+  g_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_record_t *rec = g_hash_table_lookup(pack->records, GUINT_TO_POINTER(imgid));
+  const gboolean found = rec && rec->hash == hash;
+  g_mutex_unlock(&pack->lock);
+  return found;
+}
+
+uint8_t *dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint64_t hash, size_t *length,
+                             int *color_space)
+{
+  uint8_t *blob = NULL;
+  g_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_record_t *rec = g_hash_table_lookup(pack->records, GUINT_TO_POINTER(imgid));
+  if(rec && rec->hash == hash && (blob = dt_alloc_align(64, rec->length)))
+  {
+    if(_pack_seek(pack->data, rec->offset, SEEK_SET)
+       || fread(blob, 1, rec->length, pack->data) != rec->length)
+    {
+      dt_free_align(blob);
+      blob = NULL;
+    }
+    else
+    {
+      *length = rec->length;
+      *color_space = rec->color_space;
+    }
+  }
+  g_mutex_unlock(&pack->lock);
+  return blob;
+}
+
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint64_t hash,
+                         const int color_space, const uint8_t *blob, const size_t length)
+{
+  if(!length) return 1;
+  int err = 1;
+  g_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_record_t rec
+      = { .imgid = imgid, .color_space = color_space, .offset = pack->end, .length = length, .hash = hash };
+  // the blob has to be on disk before the record pointing to it
+  if(!_pack_seek(pack->data, pack->end, SEEK_SET) && fwrite(blob, 1, length, pack->data) == length
+     && !fflush(pack->data) && !_pack_append_record(pack, &rec))
+  {
+    const dt_mipmap_pack_record_t *old = g_hash_table_lookup(pack->records, GUINT_TO_POINTER(imgid));
+    if(old) pack->garbage += old->length;
+    g_hash_table_insert(pack->records, GUINT_TO_POINTER(imgid), _pack_record_dup(&rec));
+    pack->end += length;
+    err = 0;
+  }
+  g_mutex_unlock(&pack->lock);
+  return err;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  g_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_record_t *old = g_hash_table_lookup(pack->records, GUINT_TO_POINTER(imgid));
+  if(old)
+  {
+    const dt_mipmap_pack_record_t rec = { .imgid = imgid, .offset = 0, .length = 0 };
+    pack->garbage += old->length;
+    g_hash_table_remove(pack->records, GUINT_TO_POINTER(imgid));
+    _pack_append_record(pack, &rec);
+  }
+  g_mutex_unlock(&pack->lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,48 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2026 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+// packed disk backend of the mipmap cache: all compressed thumbnails of one mip level live in a
+// single append-only data file. an index file logs (imgid, offset, length, history hash) records,
+// the last one for an image wins. the index is mapped and read once when the pack is opened, so
+// looking up a thumbnail never touches the file system.
+typedef struct dt_mipmap_pack_t dt_mipmap_pack_t;
+
+// opens or creates the pack `<prefix>.pack' with its index `<prefix>.idx'. returns NULL on failure.
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *prefix);
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+// is there a thumbnail of the image made for the given history hash?
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint64_t hash);
+// returns a copy of the stored blob, to be freed with dt_free_align(), or NULL if there is none for
+// this history hash.
+uint8_t *dt_mipmap_pack_read(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint64_t hash, size_t *length,
+                             int *color_space);
+// appends the blob, replacing an older one of the same image. returns 0 on success.
+int dt_mipmap_pack_write(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint64_t hash,
+                         const int color_space, const uint8_t *blob, const size_t length);
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
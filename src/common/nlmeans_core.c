@@ -23,6 +23,7 @@
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_hb.h"
 #include "develop/tiling.h"
 #include "iop/iop_api.h"
 #include "common/nlmeans_core.h"
@@ -71,11 +72,6 @@ struct patch_t
 };
 typedef struct patch_t patch_t;
 
-// avoid cluttering the scalar codepath with #ifdefs by hiding the dependency on SSE2
-#ifndef __SSE2__
-# define _mm_prefetch(where,hint)
-#endif
-
 static inline float gh(const float f)
 {
   return dt_fast_mexp2f(f) ;
@@ -146,10 +142,11 @@ static float compute_center_pixel_norm(const float center_weight, const int radi
 }
 
 // compute the channel-normed squared difference between two pixels
+// (no SIMD hint on the channel loop here, so that the callers' loops over columns can be vectorized instead)
 static inline float pixel_difference(const float* const pix1, const float* pix2, const dt_aligned_pixel_t norm)
 {
-  dt_aligned_pixel_t sum = { 0.f, 0.f, 0.f, 0.f };
-  for_each_channel(i, aligned(sum:16))
+  dt_aligned_pixel_t sum;
+  for(int i = 0; i < 3; i++)
   {
     const float diff = pix1[i] - pix2[i];
     sum[i] = diff * diff * norm[i];
@@ -162,8 +159,8 @@ static inline float diff_of_pixels_diff(const float* const pix1, const float* pi
                                         const float* const pix3, const float* pix4,
                                         const dt_aligned_pixel_t norm)
 {
-  dt_aligned_pixel_t sum = { 0.f, 0.f, 0.f, 0.f };
-  for_each_channel(i, aligned(sum:16))
+  dt_aligned_pixel_t sum;
+  for(int i = 0; i < 3; i++)
   {
     const float diff1 = pix1[i] - pix2[i];
     const float diff2 = pix3[i] - pix4[i];
@@ -407,10 +404,12 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
   struct patch_t* patches = define_patches(params,stride,&num_patches,&max_shift);
   // allocate scratch space, including an overrun area on each end so we don't need a boundary check on every access
   const int radius = params->patch_radius;
+  // the first SLICE_WIDTH floats of each thread's scratch space hold the per-column weight arguments for
+  // the row currently being processed
 #if defined(CACHE_PIXDIFFS)
-  const size_t scratch_size = (2*radius+3)*(SLICE_WIDTH + 2*radius + 1);
+  const size_t scratch_size = SLICE_WIDTH + (2*radius+3)*(SLICE_WIDTH + 2*radius + 1);
 #else
-  const size_t scratch_size = SLICE_WIDTH + 2*radius + 1 + 48; // getting false sharing without the +48....
+  const size_t scratch_size = SLICE_WIDTH + SLICE_WIDTH + 2*radius + 1 + 48; // getting false sharing without the +48....
 #endif /* CACHE_PIXDIFFS */
   size_t padded_scratch_size;
   float *const restrict scratch_buf = dt_alloc_perthread_float(scratch_size, &padded_scratch_size);
@@ -427,10 +426,13 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
   {
     for (int chunk_left = 0; chunk_left < roi_out->width; chunk_left += chk_width)
     {
+      // skip the remaining slices if the result isn't wanted anymore
+      if(params->pipe && dt_dev_pixelpipe_cancelled(params->pipe)) continue;
       // locate our scratch space within the big buffer allocated above
       // we'll offset by chunk_left so that we don't have to subtract on every access
       float *const restrict tmpbuf = dt_get_perthread(scratch_buf, padded_scratch_size);
-      float *const col_sums =  tmpbuf + (radius+1) - chunk_left;
+      float *const restrict wt_args = tmpbuf - chunk_left;
+      float *const col_sums =  tmpbuf + SLICE_WIDTH + (radius+1) - chunk_left;
       // determine which horizontal slice of the image to process
       const int chunk_bot = MIN(chunk_top + chk_height, roi_out->height);
       // determine which vertical slice of the image to process
@@ -474,20 +476,16 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
           float *const out = outbuf + (size_t)4 * width * row;
           const int offset = patch->offset;
           const float sharpness = params->sharpness;
+          // the sliding window of patch distortion is an inherently serial running sum, so collect the
+          // arguments of the weight function for the entire row first; the weighting and accumulation of the
+          // shifted pixels below are then independent for each column and can use the full vector width
           if (params->center_weight < 0)
           {
             // computation as used by denoise(non-local) iop
             for (int col = col_min; col < col_max; col++)
             {
               distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
-              const float wt = gh(distortion * sharpness);
-              const float *const inpx = in+4*col;
-              const dt_aligned_pixel_t pixel = { inpx[offset],  inpx[offset+1], inpx[offset+2], 1.0f };
-              for_four_channels(c,aligned(pixel,out:16))
-              {
-                out[4*col+c] += pixel[c] * wt;
-              }
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
+              wt_args[col] = distortion * sharpness;
             }
           }
           else
@@ -498,32 +496,38 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
               distortion += (col_sums[col+radius] - col_sums[col-radius-1]);
               const float dissimilarity = (distortion + pixel_difference(in+4*col,in+4*col+offset,center_norm))
                                            / (1.0f + params->center_weight);
-              const float wt = gh(fmaxf(0.0f, dissimilarity * sharpness - 2.0f));
-              const float *const inpx = in + 4*col;
-              const dt_aligned_pixel_t pixel = { inpx[offset],  inpx[offset+1], inpx[offset+2], 1.0f };
-              for_four_channels(c,aligned(pixel,out:16))
-              {
-                out[4*col+c] += pixel[c] * wt;
-              }
-              _mm_prefetch(in+4*col+offset+stride,_MM_HINT_T0);	// try to ensure next row is ready in time
+              wt_args[col] = fmaxf(0.0f, dissimilarity * sharpness - 2.0f);
             }
           }
+#ifdef _OPENMP
+#pragma omp simd aligned(out:16)
+#endif
+          for (int col = col_min; col < col_max; col++)
+          {
+            const float wt = gh(wt_args[col]);
+            const float *const inpx = in + 4*col + offset;
+            out[4*col]   += inpx[0] * wt;
+            out[4*col+1] += inpx[1] * wt;
+            out[4*col+2] += inpx[2] * wt;
+            out[4*col+3] += wt;
+          }
           const int pcol_min = chunk_left - MIN(radius,MIN(chunk_left,chunk_left+scol));
           const int pcol_max = chunk_right + MIN(radius,MIN(width-chunk_right,width-(chunk_right+scol)));
           if (row < MIN(row_top, row_bot))
           {
             // top edge of patch was above top of RoI, so it had a value of zero; just add in the new row
             const float *bot_row = inbuf + (row+1+radius)*stride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
             for (int col = pcol_min; col < pcol_max; col++)
             {
               const float *const bot_px = bot_row + 4*col;
               const float diff = pixel_difference(bot_px,bot_px+offset,params->norm);
-              _mm_prefetch(bot_px+stride, _MM_HINT_T0);
 #ifdef CACHE_PIXDIFFS
               set_pixdiff(col_sums,radius,row+radius+1,col,diff);
 #endif
               col_sums[col] += diff;
-              _mm_prefetch(bot_px+offset+stride, _MM_HINT_T0);
             }
           }
           else if (row < row_bot)
@@ -533,22 +537,22 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
 #endif /* !CACHE_PIXDIFFS */
             const float *const bot_row = inbuf + (row+1+radius)*stride ;
             // both prior and new positions are entirely within the RoI, so subtract the old row and add the new one
+#ifdef _OPENMP
+#pragma omp simd
+#endif
             for (int col = pcol_min; col < pcol_max; col++)
             {
 #ifdef CACHE_PIXDIFFS
               const float *const bot_px = bot_row + 4*col;
               const float diff = pixel_difference(bot_px,bot_px+offset,params->norm);
               col_sums[col] += diff - get_pixdiff(col_sums,radius,row-radius,col);
-              _mm_prefetch(bot_px+stride, _MM_HINT_T0);
               set_pixdiff(col_sums,radius,row+1+radius,col,diff);
 #else
               const float *const top_px = top_row + 4*col;
               const float *const bot_px = bot_row + 4*col;
               const float diff = diff_of_pixels_diff(bot_px,bot_px+offset,top_px,top_px+offset,params->norm);
-              _mm_prefetch(bot_px+stride, _MM_HINT_T0);
               col_sums[col] += diff;
 #endif /* CACHE_PIXDIFFS */
-              _mm_prefetch(bot_px+offset+stride, _MM_HINT_T0);
             }
           }
           else if (row >= row_top && row + 1 < row_max) // don't bother updating if last iteration
@@ -557,6 +561,9 @@ void nlmeans_denoise(const float *const inbuf, float *const outbuf,
 #ifndef CACHE_PIXDIFFS
             const float *top_row = inbuf + (row-radius)*stride;
 #endif /* !CACHE_PIXDIFFS */
+#ifdef _OPENMP
+#pragma omp simd
+#endif
             for (int col = pcol_min; col < pcol_max; col++)
             {
 #ifdef CACHE_PIXDIFFS
@@ -651,6 +658,8 @@ void nlmeans_denoise_sse2(const float *const inbuf, float *const outbuf,
   {
     for (int chunk_left = 0; chunk_left < roi_out->width; chunk_left += chk_width)
     {
+      // skip the remaining slices if the result isn't wanted anymore
+      if(params->pipe && dt_dev_pixelpipe_cancelled(params->pipe)) continue;
       // locate our scratch space within the big buffer allocated above
       // we'll offset by chunk_left so that we don't have to subtract on every access
       float *const restrict tmpbuf = dt_get_perthread(scratch_buf, padded_scratch_size);
@@ -27,7 +27,12 @@ const dt_noiseprofile_t dt_noiseprofile_generic = {N_("generic poissonian"), "",
 
 static gboolean dt_noiseprofile_verify(JsonParser *parser);
 
-JsonParser *dt_noiseprofile_init(const char *alternative)
+// the file is only parsed when the first image asks for its profiles, most exports never do
+static gchar *_noiseprofile_alternative = NULL;
+static gboolean _noiseprofile_loaded = FALSE;
+static GMutex _noiseprofile_lock;
+
+static JsonParser *_noiseprofile_load(const char *alternative)
 {
   GError *error = NULL;
   char filename[PATH_MAX] = { 0 };
@@ -67,6 +72,37 @@ JsonParser *dt_noiseprofile_init(const char *alternative)
   return parser;
 }
 
+void dt_noiseprofile_init(const char *alternative)
+{
+  g_free(_noiseprofile_alternative);
+  _noiseprofile_alternative = g_strdup(alternative);
+  _noiseprofile_loaded = FALSE;
+}
+
+void dt_noiseprofile_cleanup(void)
+{
+  if(darktable.noiseprofile_parser)
+  {
+    g_object_unref(darktable.noiseprofile_parser);
+    darktable.noiseprofile_parser = NULL;
+  }
+  g_free(_noiseprofile_alternative);
+  _noiseprofile_alternative = NULL;
+  _noiseprofile_loaded = FALSE;
+}
+
+static JsonParser *_noiseprofile_parser(void)
+{
+  g_mutex_lock(&_noiseprofile_lock);
+  if(!_noiseprofile_loaded)
+  {
+    darktable.noiseprofile_parser = _noiseprofile_load(_noiseprofile_alternative);
+    _noiseprofile_loaded = TRUE;
+  }
+  g_mutex_unlock(&_noiseprofile_lock);
+  return darktable.noiseprofile_parser;
+}
+
 int is_member(gchar** names, char* name)
 {
   while(*names)
@@ -225,7 +261,7 @@ end:
 
 GList *dt_noiseprofile_get_matching(const dt_image_t *cimg)
 {
-  JsonParser *parser = darktable.noiseprofile_parser;
+  JsonParser *parser = _noiseprofile_parser();
   JsonReader *reader = NULL;
   GList *result = NULL;
 
@@ -35,8 +35,11 @@ dt_noiseprofile_t;
 
 extern const dt_noiseprofile_t dt_noiseprofile_generic;
 
-/** read the noiseprofile file once on startup (kind of)*/
-JsonParser *dt_noiseprofile_init(const char *alternative);
+/** remember the noiseprofile file, it is read once when profiles are first looked up */
+void dt_noiseprofile_init(const char *alternative);
+
+/** free the parsed noiseprofile file */
+void dt_noiseprofile_cleanup(void);
 
 /*
  * returns the noiseprofiles matching the image's exif data.
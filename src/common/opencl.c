@@ -32,6 +32,7 @@
 #include "common/nvidia_gpus.h"
 #include "common/opencl_drivers_blacklist.h"
 #include "common/tea.h"
+#include "common/trace.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -47,6 +48,7 @@
 #include <errno.h>
 #include <libgen.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <zlib.h>
 
 static const char *dt_opencl_get_vendor_by_id(unsigned int id);
@@ -68,6 +70,10 @@ static void dt_opencl_apply_scheduling_profile(dt_opencl_scheduling_profile_t pr
 /** set opencl specific synchronization timeout */
 static void dt_opencl_set_synchronization_timeout(int value);
 
+static void _memory_failure(const int devid, const char *kind, const size_t width, const size_t height,
+                            const int bpp, const size_t bytes, const cl_int err);
+static void _memory_budget_update(const int devid);
+
 
 int dt_opencl_get_device_info(dt_opencl_t *cl, cl_device_id device, cl_device_info param_name, void **param_value,
                               size_t *param_value_size)
@@ -130,6 +136,108 @@ error:
   return err;
 }
 
+static void _release_programs(dt_opencl_t *cl, const int dev)
+{
+  for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
+  {
+    if(cl->dev[dev].kernel_used[k] && cl->dev[dev].kernel[k])
+      (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[dev].kernel[k]);
+    g_free(cl->dev[dev].kernel_name[k]);
+    cl->dev[dev].kernel_name[k] = NULL;
+  }
+  for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
+  {
+    if(cl->dev[dev].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[dev].program[k]);
+    g_free(cl->dev[dev].program_binname[k]);
+    cl->dev[dev].program_binname[k] = NULL;
+  }
+  g_free(cl->dev[dev].cachedir);
+  cl->dev[dev].cachedir = NULL;
+  if(cl->dev[dev].tuned) g_hash_table_destroy(cl->dev[dev].tuned);
+  cl->dev[dev].tuned = NULL;
+}
+
+// work group sizes found by earlier sessions, one "program kernel width height" line per kernel
+static void _tune_load(const int dev)
+{
+  dt_opencl_device_t *device = &darktable.opencl->dev[dev];
+  device->tuned = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  gchar *filename = g_build_filename(device->cachedir, "work_group_sizes", NULL);
+  FILE *f = g_fopen(filename, "rb");
+  g_free(filename);
+  if(!f) return;
+
+  int prog;
+  char name[256];
+  size_t local[2];
+  while(fscanf(f, "%d %255s %zu %zu\n", &prog, name, &local[0], &local[1]) == 4)
+  {
+    size_t *value = g_malloc(sizeof(local));
+    memcpy(value, local, sizeof(local));
+    g_hash_table_insert(device->tuned, g_strdup_printf("%d %s", prog, name), value);
+  }
+  fclose(f);
+}
+
+// builds a program whose build was deferred at init time. caller holds program_lock.
+// returns 0 if the program is ready for kernel creation.
+static int _build_deferred_program(const int dev, const int prog)
+{
+  dt_opencl_device_t *device = &darktable.opencl->dev[dev];
+  if(device->program_state[prog] == DT_OPENCL_PROGRAM_PENDING)
+  {
+    const double tstart = dt_get_wtime();
+    const cl_int err = dt_opencl_build_program(dev, prog, device->program_binname[prog], device->cachedir,
+                                               device->program_md5[prog], 0);
+    device->program_state[prog] = (err == CL_SUCCESS) ? DT_OPENCL_PROGRAM_BUILT : DT_OPENCL_PROGRAM_FAILED;
+    dt_print(DT_DEBUG_OPENCL, "[opencl_build_program] %s deferred program `%s' for device %d in %.3f secs\n",
+             err == CL_SUCCESS ? "built" : "failed to build", device->program_binname[prog], dev,
+             dt_get_wtime() - tstart);
+  }
+  return device->program_state[prog] == DT_OPENCL_PROGRAM_BUILT ? 0 : -1;
+}
+
+// kernels of deferred programs are created on their first use
+static cl_kernel _kernel(const int dev, const int kernel)
+{
+  dt_opencl_device_t *device = &darktable.opencl->dev[dev];
+  if(device->kernel[kernel] || !device->kernel_used[kernel]) return device->kernel[kernel];
+
+  dt_pthread_mutex_lock(&device->program_lock);
+  if(!device->kernel[kernel] && _build_deferred_program(dev, device->kernel_program[kernel]) == 0)
+  {
+    cl_int err;
+    const cl_kernel k = (darktable.opencl->dlocl->symbols->dt_clCreateKernel)(
+        device->program[device->kernel_program[kernel]], device->kernel_name[kernel], &err);
+    if(err != CL_SUCCESS)
+      dt_print(DT_DEBUG_OPENCL, "[opencl_create_kernel] could not create kernel `%s'! (%d)\n",
+               device->kernel_name[kernel], err);
+    else
+      device->kernel[kernel] = k;
+  }
+  dt_pthread_mutex_unlock(&device->program_lock);
+  return device->kernel[kernel];
+}
+
+static void *_build_thread(void *arg)
+{
+  dt_opencl_t *cl = (dt_opencl_t *)arg;
+  dt_pthread_setname("clbuild");
+  const double tstart = dt_get_wtime();
+  for(int dev = 0; dev < cl->num_devs; dev++)
+    for(int prog = 0; prog < DT_OPENCL_MAX_PROGRAMS; prog++)
+    {
+      if(dt_atomic_get_int(&cl->build_quit)) return NULL;
+      dt_pthread_mutex_lock(&cl->dev[dev].program_lock);
+      if(cl->dev[dev].program_used[prog]) _build_deferred_program(dev, prog);
+      dt_pthread_mutex_unlock(&cl->dev[dev].program_lock);
+    }
+  dt_print(DT_DEBUG_OPENCL, "[opencl_build_thread] all deferred programs built in %.3f secs\n",
+           dt_get_wtime() - tstart);
+  return NULL;
+}
+
 // returns 0 if all ok
 // returns -1 if we failed to init this device
 static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *devices, const int k,
@@ -142,6 +250,13 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   memset(cl->dev[dev].program_used, 0x0, sizeof(int) * DT_OPENCL_MAX_PROGRAMS);
   memset(cl->dev[dev].kernel, 0x0, sizeof(cl_kernel) * DT_OPENCL_MAX_KERNELS);
   memset(cl->dev[dev].kernel_used, 0x0, sizeof(int) * DT_OPENCL_MAX_KERNELS);
+  memset(cl->dev[dev].program_state, 0x0, sizeof(cl->dev[dev].program_state));
+  memset(cl->dev[dev].program_binname, 0x0, sizeof(cl->dev[dev].program_binname));
+  memset(cl->dev[dev].kernel_program, 0x0, sizeof(cl->dev[dev].kernel_program));
+  memset(cl->dev[dev].kernel_name, 0x0, sizeof(cl->dev[dev].kernel_name));
+  cl->dev[dev].cachedir = NULL;
+  memset(cl->dev[dev].tuning, 0x0, sizeof(cl->dev[dev].tuning));
+  cl->dev[dev].tuned = NULL;
   cl->dev[dev].eventlist = NULL;
   cl->dev[dev].eventtags = NULL;
   cl->dev[dev].numevents = 0;
@@ -161,6 +276,12 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   cl->dev[dev].memory_in_use = 0;
   cl->dev[dev].peak_memory = 0;
   cl->dev[dev].tuned_available = 0;
+  cl->dev[dev].budget = 0;
+  cl->dev[dev].budget_base = 0;
+  cl->dev[dev].budget_ceiling = 0;
+  cl->dev[dev].run_peak = 0;
+  cl->dev[dev].run_failures = 0;
+  cl->dev[dev].alloc_failures = 0;
   cl_device_id devid = cl->dev[dev].devid = devices[k];
 
   char *infostr = NULL;
@@ -237,6 +358,16 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
 
   (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL);
   (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &image_support, NULL);
+  cl_bool unified_memory = CL_FALSE;
+  (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(cl_bool),
+                                           &unified_memory, NULL);
+  cl->dev[dev].unified_memory = (unified_memory == CL_TRUE);
+  cl->dev[dev].compute_units = 0;
+  (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint),
+                                           &(cl->dev[dev].compute_units), NULL);
+  cl->dev[dev].profile_pipe = NULL;
+  cl->dev[dev].profile_module[0] = '\0';
+  cl->dev[dev].profile_instance = 0;
   (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t),
                                            &(cl->dev[dev].max_image_height), NULL);
   (cl->dlocl->symbols->dt_clGetDeviceInfo)(devid, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t),
@@ -353,6 +484,12 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   }
 
   dt_pthread_mutex_init(&cl->dev[dev].lock, NULL);
+  memset(cl->dev[dev].waiting, 0, sizeof(cl->dev[dev].waiting));
+  dt_pthread_mutex_init(&cl->dev[dev].program_lock, NULL);
+  dt_pthread_mutex_init(&cl->dev[dev].pool_lock, NULL);
+  memset(cl->dev[dev].pool, 0, sizeof(cl->dev[dev].pool));
+  cl->dev[dev].pool_size = 0;
+  cl->dev[dev].pool_stamp = cl->dev[dev].pool_hits = cl->dev[dev].pool_misses = 0;
 
   cl->dev[dev].context = (cl->dlocl->symbols->dt_clCreateContext)(0, 1, &devid, NULL, NULL, &err);
   if(err != CL_SUCCESS)
@@ -370,6 +507,16 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
     res = -1;
     goto end;
   }
+  cl->dev[dev].transfer_queue = NULL;
+  if(dt_conf_get_bool("opencl_transfer_queue"))
+  {
+    cl->dev[dev].transfer_queue = (cl->dlocl->symbols->dt_clCreateCommandQueue)(cl->dev[dev].context, devid, 0, &err);
+    if(err != CL_SUCCESS)
+    {
+      dt_print(DT_DEBUG_OPENCL, "[opencl_init] could not create transfer queue for device %d: %d\n", k, err);
+      cl->dev[dev].transfer_queue = NULL;
+    }
+  }
 
   double tstart, tend, tdiff;
   dt_loc_get_user_cache_dir(dtcache, PATH_MAX * sizeof(char));
@@ -393,6 +540,8 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
     res = -1;
     goto end;
   }
+  cl->dev[dev].cachedir = g_strdup(cachedir);
+  _tune_load(dev);
 
   dt_loc_get_kerneldir(kerneldir, sizeof(kerneldir));
   dt_print(DT_DEBUG_DEV, "kernel directory: %s\n", kerneldir);
@@ -444,8 +593,10 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   char *includemd5[DT_OPENCL_MAX_INCLUDES] = { NULL };
   dt_opencl_md5sum(clincludes, includemd5);
 
-  // now load all darktable cl kernels.
-  // TODO: compile as a job?
+  // now load all darktable cl kernels. programs with a valid cached binary are built right away,
+  // the others are compiled from source on first use or by the background build thread.
+  const gboolean defer_build = dt_conf_get_bool("opencl_background_kernel_build");
+  int deferred = 0;
   tstart = dt_get_wtime();
   FILE *f = g_fopen(filename, "rb");
   if(f)
@@ -497,8 +648,20 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
       dt_print(DT_DEBUG_OPENCL, "[opencl_init] compiling program `%s' ..\n", programname);
       int loaded_cached;
       char md5sum[33];
-      if(dt_opencl_load_program(dev, prog, filename, binname, cachedir, md5sum, includemd5, &loaded_cached)
-         && dt_opencl_build_program(dev, prog, binname, cachedir, md5sum, loaded_cached) != CL_SUCCESS)
+      if(!dt_opencl_load_program(dev, prog, filename, binname, cachedir, md5sum, includemd5, &loaded_cached))
+      {
+        g_strfreev(tokens);
+        continue;
+      }
+
+      if(defer_build && !loaded_cached)
+      {
+        cl->dev[dev].program_state[prog] = DT_OPENCL_PROGRAM_PENDING;
+        cl->dev[dev].program_binname[prog] = g_strdup(binname);
+        g_strlcpy(cl->dev[dev].program_md5[prog], md5sum, sizeof(cl->dev[dev].program_md5[prog]));
+        deferred++;
+      }
+      else if(dt_opencl_build_program(dev, prog, binname, cachedir, md5sum, loaded_cached) != CL_SUCCESS)
       {
         dt_print(DT_DEBUG_OPENCL, "[opencl_init] failed to compile program `%s'!\n", programname);
         fclose(f);
@@ -513,7 +676,8 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
     fclose(f);
     tend = dt_get_wtime();
     tdiff = tend - tstart;
-    dt_print(DT_DEBUG_OPENCL, "[opencl_init] kernel loading time: %2.4lf \n", tdiff);
+    dt_print(DT_DEBUG_OPENCL, "[opencl_init] kernel loading time: %2.4lf, %d programs not in the binary cache "
+                              "deferred\n", tdiff, deferred);
   }
   else
   {
@@ -527,6 +691,19 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
 
 end:
 
+  if(res != 0)
+  {
+    for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
+    {
+      g_free(cl->dev[dev].program_binname[k]);
+      cl->dev[dev].program_binname[k] = NULL;
+    }
+    g_free(cl->dev[dev].cachedir);
+    cl->dev[dev].cachedir = NULL;
+    if(cl->dev[dev].tuned) g_hash_table_destroy(cl->dev[dev].tuned);
+    cl->dev[dev].tuned = NULL;
+  }
+
   free(infostr);
   free(cname);
   free(options);
@@ -549,6 +726,8 @@ end:
 void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboolean print_statistics)
 {
   dt_pthread_mutex_init(&cl->lock, NULL);
+  dt_pthread_mutex_init(&cl->dev_wait_lock, NULL);
+  pthread_cond_init(&cl->dev_wait_cond, NULL);
   cl->inited = 0;
   cl->enabled = 0;
   cl->stopped = 0;
@@ -569,6 +748,15 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
 
   cl->avoid_atomics = dt_conf_get_bool("opencl_avoid_atomics");
   cl->async_pixelpipe = dt_conf_get_bool("opencl_async_pixelpipe");
+  cl->mem_pool = dt_conf_get_bool("opencl_memory_pool");
+  cl->tune_work_groups = dt_conf_get_bool("opencl_tune_work_groups");
+  cl->adaptive_memory = dt_conf_get_bool("opencl_adaptive_memory");
+  cl->adaptive_scheduling = dt_conf_get_bool("opencl_adaptive_scheduling");
+  dt_pthread_mutex_init(&cl->throughput_lock, NULL);
+  cl->throughput = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  cl->throughput_explore = 0;
+  cl->build_thread_running = 0;
+  dt_atomic_set_int(&cl->build_quit, 0);
   cl->sync_cache = dt_opencl_get_sync_cache();
   cl->micro_nap = dt_conf_get_int("opencl_micro_nap");
   cl->crc = 5781;
@@ -840,17 +1028,21 @@ finally:
     // apply config settings for scheduling profile: sets device priorities and pixelpipe synchronization timeout
     dt_opencl_scheduling_profile_t profile = dt_opencl_get_scheduling_profile();
     dt_opencl_apply_scheduling_profile(profile);
+
+    // compile what was not found in the binary cache while the user already works
+    if(dt_conf_get_bool("opencl_background_kernel_build"))
+      cl->build_thread_running = (dt_pthread_create(&cl->build_thread, _build_thread, cl) == 0);
   }
   else // initialization failed
   {
     for(int i = 0; cl->dev && i < cl->num_devs; i++)
     {
       dt_pthread_mutex_destroy(&cl->dev[i].lock);
-      for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
-        if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
-      for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
-        if(cl->dev[i].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[i].program[k]);
+      dt_pthread_mutex_destroy(&cl->dev[i].pool_lock);
+      dt_pthread_mutex_destroy(&cl->dev[i].program_lock);
+      _release_programs(cl, i);
       (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].cmd_queue);
+      if(cl->dev[i].transfer_queue) (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].transfer_queue);
       (cl->dlocl->symbols->dt_clReleaseContext)(cl->dev[i].context);
       if(cl->use_events)
       {
@@ -881,6 +1073,13 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
 {
   if(cl->inited)
   {
+    if(cl->build_thread_running)
+    {
+      dt_atomic_set_int(&cl->build_quit, 1);
+      pthread_join(cl->build_thread, NULL);
+      cl->build_thread_running = 0;
+    }
+
     dt_develop_blend_free_cl_global(cl->blendop);
     dt_bilateral_free_cl_global(cl->bilateral);
     dt_gaussian_free_cl_global(cl->gaussian);
@@ -892,12 +1091,13 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
 
     for(int i = 0; i < cl->num_devs; i++)
     {
+      dt_opencl_flush_pool(i);
+      dt_pthread_mutex_destroy(&cl->dev[i].pool_lock);
       dt_pthread_mutex_destroy(&cl->dev[i].lock);
-      for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
-        if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
-      for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
-        if(cl->dev[i].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[i].program[k]);
+      dt_pthread_mutex_destroy(&cl->dev[i].program_lock);
+      _release_programs(cl, i);
       (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].cmd_queue);
+      if(cl->dev[i].transfer_queue) (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].transfer_queue);
       (cl->dlocl->symbols->dt_clReleaseContext)(cl->dev[i].context);
 
       if(cl->print_statistics && (darktable.unmuted & DT_DEBUG_MEMORY))
@@ -906,6 +1106,21 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
                    cl->dev[i].name, i, cl->dev[i].peak_memory, (float)cl->dev[i].peak_memory/(1024*1024));
       }
 
+      if(cl->print_statistics && cl->adaptive_memory && cl->dev[i].budget)
+      {
+        dt_print(DT_DEBUG_OPENCL, "[opencl_summary_statistics] device '%s' (%d): memory budget %zuMB, started "
+                                  "from %zuMB, %d failed allocations\n",
+                 cl->dev[i].name, i, cl->dev[i].budget / 1024lu / 1024lu, cl->dev[i].budget_base / 1024lu / 1024lu,
+                 cl->dev[i].alloc_failures);
+      }
+
+      if(cl->print_statistics && cl->mem_pool)
+      {
+        dt_print(DT_DEBUG_OPENCL, "[opencl_summary_statistics] device '%s' (%d): %" PRIu64 " allocations served from "
+                                  "the memory pool, %" PRIu64 " from the driver\n",
+                 cl->dev[i].name, i, cl->dev[i].pool_hits, cl->dev[i].pool_misses);
+      }
+
       if(cl->print_statistics && cl->use_events)
       {
         if(cl->dev[i].totalevents)
@@ -949,6 +1164,10 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
   }
 
   free(cl->dev);
+  g_hash_table_destroy(cl->throughput);
+  dt_pthread_mutex_destroy(&cl->throughput_lock);
+  pthread_cond_destroy(&cl->dev_wait_cond);
+  dt_pthread_mutex_destroy(&cl->dev_wait_lock);
   dt_pthread_mutex_destroy(&cl->lock);
 }
 
@@ -1135,6 +1354,53 @@ int dt_opencl_enqueue_barrier(const int devid)
   return (cl->dlocl->symbols->dt_clEnqueueBarrier)(cl->dev[devid].cmd_queue);
 }
 
+gboolean dt_opencl_has_transfer_queue(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  return cl->inited && devid >= 0 && cl->dev[devid].transfer_queue != NULL;
+}
+
+int dt_opencl_write_host_to_device_async(const int devid, void *host, void *device, const size_t *origin,
+                                         const size_t *region, const int rowpitch, cl_event *event)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  *event = NULL;
+  if(!cl->inited || devid < 0) return -1;
+  if(!cl->dev[devid].transfer_queue)
+    return dt_opencl_write_host_to_device_raw(devid, host, device, origin, region, rowpitch, CL_TRUE);
+
+  const cl_int err = (cl->dlocl->symbols->dt_clEnqueueWriteImage)(cl->dev[devid].transfer_queue, device, CL_FALSE,
+                                                                  origin, region, rowpitch, 0, host, 0, NULL, event);
+  if(err != CL_SUCCESS)
+  {
+    dt_print(DT_DEBUG_OPENCL, "[opencl write_host_to_device_async] could not enqueue upload: %d\n", err);
+    *event = NULL;
+    return err;
+  }
+  // get it going now, the kernels on the other queue are what it should overlap with
+  (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].transfer_queue);
+  return CL_SUCCESS;
+}
+
+int dt_opencl_wait_for_transfer(const int devid, cl_event *event)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return -1;
+  if(!*event) return CL_SUCCESS;
+
+  const cl_int err = (cl->dlocl->symbols->dt_clEnqueueWaitForEvents)(cl->dev[devid].cmd_queue, 1, event);
+  (cl->dlocl->symbols->dt_clReleaseEvent)(*event);
+  *event = NULL;
+  return err;
+}
+
+void dt_opencl_finish_transfers(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || !cl->dev[devid].transfer_queue) return;
+  (cl->dlocl->symbols->dt_clFinish)(cl->dev[devid].transfer_queue);
+}
+
 static int _take_from_list(int *list, int value)
 {
   int result = -1;
@@ -1387,6 +1653,36 @@ static void dt_opencl_update_priorities(const char *configstr)
              cl->mandatory[1], cl->mandatory[2], cl->mandatory[3], cl->mandatory[4]);
 }
 
+// pipes the user looks at come first, thumbnails last
+static int _lock_device_class(const int pipetype)
+{
+  switch(pipetype & DT_DEV_PIXELPIPE_ANY)
+  {
+    case DT_DEV_PIXELPIPE_FULL:
+    case DT_DEV_PIXELPIPE_PREVIEW:
+      return 0;
+    case DT_DEV_PIXELPIPE_PREVIEW2:
+      return 1;
+    case DT_DEV_PIXELPIPE_EXPORT:
+      return 2;
+    default:
+      return 3;
+  }
+}
+
+// take the first free device of the priority list that no pipe of a higher class is waiting for.
+// called with dev_wait_lock held
+static int _trylock_device(dt_opencl_t *cl, const int *priority, const int class)
+{
+  for(const int *prio = priority; *prio != -1; prio++)
+  {
+    gboolean wanted = FALSE;
+    for(int c = 0; c < class; c++) wanted |= cl->dev[*prio].waiting[c] > 0;
+    if(!wanted && !dt_pthread_mutex_BAD_trylock(&cl->dev[*prio].lock)) return *prio;
+  }
+  return -1;
+}
+
 int dt_opencl_lock_device(const int pipetype)
 {
   dt_opencl_t *cl = darktable.opencl;
@@ -1431,34 +1727,40 @@ int dt_opencl_lock_device(const int pipetype)
 
   if(priority)
   {
-    const int usec = 5000;
+    const int class = _lock_device_class(pipetype);
+    // the timeout is still given in steps of the 5ms the lock used to be polled with
     const int nloop = MAX(0, dt_conf_get_int("opencl_mandatory_timeout"));
-
-    // check for free opencl device repeatedly if mandatory is TRUE, else give up after first try
-    for(int n = 0; n < nloop; n++)
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    const int64_t nsec = deadline.tv_nsec + (int64_t)nloop * 5000000;
+    deadline.tv_sec += nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+
+    dt_pthread_mutex_lock(&cl->dev_wait_lock);
+    int devid = _trylock_device(cl, priority, class);
+    if(devid < 0 && mandatory)
     {
-      const int *prio = priority;
+      // queue up on all devices we could use, so that pipes of lower priority leave them to us
+      for(const int *prio = priority; *prio != -1; prio++) cl->dev[*prio].waiting[class]++;
 
-      while(*prio != -1)
+      int err = 0;
+      while(devid < 0 && err != ETIMEDOUT)
       {
-        if(!dt_pthread_mutex_BAD_trylock(&cl->dev[*prio].lock))
-        {
-          int devid = *prio;
-          free(priority);
-          return devid;
-        }
-        prio++;
+        err = pthread_cond_timedwait(&cl->dev_wait_cond, &cl->dev_wait_lock.mutex, &deadline);
+        devid = _trylock_device(cl, priority, class);
       }
 
-      if(!mandatory)
-      {
-        free(priority);
-        return -1;
-      }
+      for(const int *prio = priority; *prio != -1; prio++) cl->dev[*prio].waiting[class]--;
+      // pipes of lower priority might have waited for us to take a device or to give up
+      pthread_cond_broadcast(&cl->dev_wait_cond);
 
-      dt_iop_nap(usec);
+      if(devid < 0)
+        dt_print(DT_DEBUG_OPENCL, "[opencl_lock_device] reached opencl_mandatory_timeout trying to lock mandatory device, fallback to CPU\n");
     }
-    dt_print(DT_DEBUG_OPENCL, "[opencl_lock_device] reached opencl_mandatory_timeout trying to lock mandatory device, fallback to CPU");
+    dt_pthread_mutex_unlock(&cl->dev_wait_lock);
+
+    free(priority);
+    return devid;
   }
   else
   {
@@ -1477,12 +1779,165 @@ int dt_opencl_lock_device(const int pipetype)
   return -1;
 }
 
+int dt_opencl_trylock_device(const int devid, const int pipetype)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || devid >= cl->num_devs) return FALSE;
+  const int priority[] = { devid, -1 };
+  dt_pthread_mutex_lock(&cl->dev_wait_lock);
+  const int locked = _trylock_device(cl, priority, _lock_device_class(pipetype));
+  dt_pthread_mutex_unlock(&cl->dev_wait_lock);
+  return locked == devid;
+}
+
 void dt_opencl_unlock_device(const int dev)
 {
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited) return;
   if(dev < 0 || dev >= cl->num_devs) return;
+  _memory_budget_update(dev);
   dt_pthread_mutex_BAD_unlock(&cl->dev[dev].lock);
+
+  // wake the pipes waiting for a device, the dev_wait_lock makes sure none of them misses this
+  dt_pthread_mutex_lock(&cl->dev_wait_lock);
+  pthread_cond_broadcast(&cl->dev_wait_cond);
+  dt_pthread_mutex_unlock(&cl->dev_wait_lock);
+}
+
+// weight of the latest run in the running estimate, recent runs count most so that
+// thermal throttling or a changed module mix shows up after a few pipe runs
+#define DT_OPENCL_THROUGHPUT_WEIGHT 0.25f
+// another device or the cpu is only chosen when it is that much faster
+#define DT_OPENCL_THROUGHPUT_MARGIN 0.8f
+// every that many runs the cpu would be preferred, the device keeps its run to refresh its estimate
+#define DT_OPENCL_THROUGHPUT_EXPLORE 16
+
+typedef struct _throughput_t
+{
+  float spm; // seconds per megapixel
+  int samples;
+} _throughput_t;
+
+void dt_opencl_throughput_record(const int devid, const char *op, const size_t pixels, const double seconds)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || !cl->adaptive_scheduling || !op || pixels == 0) return;
+
+  const float spm = seconds / (pixels * 1e-6);
+  gchar *key = g_strdup_printf("%d %s", devid < 0 ? -1 : devid, op);
+  dt_pthread_mutex_lock(&cl->throughput_lock);
+  _throughput_t *t = g_hash_table_lookup(cl->throughput, key);
+  if(!t)
+  {
+    t = g_malloc0(sizeof(_throughput_t));
+    t->spm = spm;
+    g_hash_table_insert(cl->throughput, key, t);
+  }
+  else
+  {
+    t->spm += DT_OPENCL_THROUGHPUT_WEIGHT * (spm - t->spm);
+    g_free(key);
+  }
+  t->samples++;
+  dt_pthread_mutex_unlock(&cl->throughput_lock);
+}
+
+float dt_opencl_throughput_estimate(const int devid, const char *op)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || !op) return 0.0f;
+
+  gchar *key = g_strdup_printf("%d %s", devid < 0 ? -1 : devid, op);
+  dt_pthread_mutex_lock(&cl->throughput_lock);
+  const _throughput_t *t = g_hash_table_lookup(cl->throughput, key);
+  const float spm = t ? t->spm : 0.0f;
+  dt_pthread_mutex_unlock(&cl->throughput_lock);
+  g_free(key);
+  return spm;
+}
+
+// estimated seconds per megapixel of the whole module list, 0 if too few of them ran on devid yet
+static float _throughput_estimate_pipe(const int devid, const char **ops, const int count)
+{
+  float total = 0.0f;
+  int known = 0;
+  for(int k = 0; k < count; k++)
+  {
+    const float spm = dt_opencl_throughput_estimate(devid, ops[k]);
+    total += spm;
+    known += spm > 0.0f;
+  }
+  // scale up for the unknown ones, but only with most of them known
+  return (count > 0 && known * 4 >= count * 3) ? total * count / known : 0.0f;
+}
+
+static int _pipetype_mandatory(const dt_opencl_t *cl, const int pipetype)
+{
+  switch(pipetype & DT_DEV_PIXELPIPE_ANY)
+  {
+    case DT_DEV_PIXELPIPE_FULL:
+      return cl->mandatory[0];
+    case DT_DEV_PIXELPIPE_PREVIEW:
+      return cl->mandatory[1];
+    case DT_DEV_PIXELPIPE_EXPORT:
+      return cl->mandatory[2];
+    case DT_DEV_PIXELPIPE_THUMBNAIL:
+      return cl->mandatory[3];
+    case DT_DEV_PIXELPIPE_PREVIEW2:
+      return cl->mandatory[4];
+    default:
+      return 0;
+  }
+}
+
+int dt_opencl_rebalance_device(const int devid, const int pipetype, const char **ops, const int count)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || !cl->adaptive_scheduling || devid < 0) return devid;
+
+  const float current = _throughput_estimate_pipe(devid, ops, count);
+  if(current <= 0.0f) return devid; // let it learn first
+
+  // the fastest other device, as far as we know yet
+  int best = -1;
+  float best_time = current * DT_OPENCL_THROUGHPUT_MARGIN;
+  for(int dev = 0; dev < cl->num_devs; dev++)
+  {
+    if(dev == devid) continue;
+    const float t = _throughput_estimate_pipe(dev, ops, count);
+    if(t > 0.0f && t < best_time)
+    {
+      best = dev;
+      best_time = t;
+    }
+  }
+
+  int result = devid;
+  if(best >= 0 && dt_opencl_trylock_device(best, pipetype))
+  {
+    dt_opencl_unlock_device(devid);
+    result = best;
+    dt_print(DT_DEBUG_OPENCL, "[opencl_rebalance_device] device %d is expected to take %.3f instead of %.3f "
+                              "secs/MP of device %d, switching\n", best, best_time, current, devid);
+  }
+
+  // a device set as mandatory for this pipe is the user's explicit wish, don't fall back to the cpu then
+  const float cpu = _throughput_estimate_pipe(-1, ops, count);
+  if(!_pipetype_mandatory(cl, pipetype) && cpu > 0.0f
+     && cpu < DT_OPENCL_THROUGHPUT_MARGIN * (result == devid ? current : best_time))
+  {
+    dt_pthread_mutex_lock(&cl->throughput_lock);
+    const gboolean explore = (++cl->throughput_explore % DT_OPENCL_THROUGHPUT_EXPLORE) == 0;
+    dt_pthread_mutex_unlock(&cl->throughput_lock);
+    if(!explore)
+    {
+      dt_print(DT_DEBUG_OPENCL, "[opencl_rebalance_device] cpu is expected to take %.3f secs/MP, faster than "
+                                "device %d, processing on cpu\n", cpu, result);
+      dt_opencl_unlock_device(result);
+      result = -1;
+    }
+  }
+  return result;
 }
 
 static FILE *fopen_stat(const char *filename, struct stat *st)
@@ -1830,23 +2285,20 @@ int dt_opencl_build_program(const int dev, const int prog, const char *binname,
           if(bytes_written != binary_sizes[i]) goto ret;
           fclose(f);
 
-          // create link (e.g. basic.cl.bin -> f1430102c53867c162bb60af6c163328)
-          char cwd[PATH_MAX] = { 0 };
-          if(!getcwd(cwd, sizeof(cwd))) goto ret;
-          if(chdir(cachedir) != 0) goto ret;
+          // create link (e.g. basic.cl.bin -> f1430102c53867c162bb60af6c163328). the relative target
+          // resolves inside cachedir, no chdir() as deferred programs are built next to running threads.
+#if defined(_WIN32)
           char dup[PATH_MAX] = { 0 };
           g_strlcpy(dup, binname, sizeof(dup));
           char *bname = basename(dup);
-#if defined(_WIN32)
           //CreateSymbolicLink in Windows requires admin privileges, which we don't want/need
           //store has using a simple filerename
           char finalfilename[PATH_MAX] = { 0 };
           snprintf(finalfilename, sizeof(finalfilename), "%s" G_DIR_SEPARATOR_S "%s.%s", cachedir, bname, md5sum);
           rename(link_dest, finalfilename);
 #else
-          if(symlink(md5sum, bname) != 0) goto ret;
+          if(symlink(md5sum, binname) != 0) goto ret;
 #endif //!defined(_WIN32)
-          if(chdir(cwd) != 0) goto ret;
         }
 
     ret:
@@ -1868,21 +2320,26 @@ int dt_opencl_create_kernel(const int prog, const char *name)
   int k = 0;
   for(int dev = 0; dev < cl->num_devs; dev++)
   {
-    cl_int err;
+    cl_int err = CL_SUCCESS;
     for(; k < DT_OPENCL_MAX_KERNELS; k++)
       if(!cl->dev[dev].kernel_used[k])
       {
-        cl->dev[dev].kernel_used[k] = 1;
-        cl->dev[dev].kernel[k]
-            = (cl->dlocl->symbols->dt_clCreateKernel)(cl->dev[dev].program[prog], name, &err);
-        if(err != CL_SUCCESS)
+        // kernels of programs still waiting for their build are created by _kernel() on first use
+        dt_pthread_mutex_lock(&cl->dev[dev].program_lock);
+        const gboolean built = cl->dev[dev].program_state[prog] == DT_OPENCL_PROGRAM_BUILT;
+        cl->dev[dev].kernel[k] = built ? (cl->dlocl->symbols->dt_clCreateKernel)(cl->dev[dev].program[prog], name, &err)
+                                       : NULL;
+        dt_pthread_mutex_unlock(&cl->dev[dev].program_lock);
+        if(built && err != CL_SUCCESS)
         {
           dt_print(DT_DEBUG_OPENCL, "[opencl_create_kernel] could not create kernel `%s'! (%d)\n", name, err);
-          cl->dev[dev].kernel_used[k] = 0;
           goto error;
         }
-        else
-          break;
+        cl->dev[dev].kernel_used[k] = 1;
+        memset(&cl->dev[dev].tuning[k], 0, sizeof(dt_opencl_tuning_t));
+        cl->dev[dev].kernel_program[k] = prog;
+        cl->dev[dev].kernel_name[k] = g_strdup(name);
+        break;
       }
     if(k < DT_OPENCL_MAX_KERNELS)
     {
@@ -1910,8 +2367,13 @@ void dt_opencl_free_kernel(const int kernel)
   dt_pthread_mutex_lock(&cl->lock);
   for(int dev = 0; dev < cl->num_devs; dev++)
   {
+    dt_pthread_mutex_lock(&cl->dev[dev].program_lock);
     cl->dev[dev].kernel_used[kernel] = 0;
-    (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[dev].kernel[kernel]);
+    if(cl->dev[dev].kernel[kernel]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[dev].kernel[kernel]);
+    cl->dev[dev].kernel[kernel] = NULL;
+    g_free(cl->dev[dev].kernel_name[kernel]);
+    cl->dev[dev].kernel_name[kernel] = NULL;
+    dt_pthread_mutex_unlock(&cl->dev[dev].program_lock);
   }
   dt_pthread_mutex_unlock(&cl->lock);
 }
@@ -1952,7 +2414,10 @@ int dt_opencl_get_kernel_work_group_size(const int dev, const int kernel, size_t
   if(!cl->inited || dev < 0) return -1;
   if(kernel < 0 || kernel >= DT_OPENCL_MAX_KERNELS) return -1;
 
-  return (cl->dlocl->symbols->dt_clGetKernelWorkGroupInfo)(cl->dev[dev].kernel[kernel], cl->dev[dev].devid,
+  const cl_kernel k = _kernel(dev, kernel);
+  if(!k) return CL_INVALID_KERNEL;
+
+  return (cl->dlocl->symbols->dt_clGetKernelWorkGroupInfo)(k, cl->dev[dev].devid,
                                                            CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t),
                                                            kernelworkgroupsize, NULL);
 }
@@ -1964,12 +2429,133 @@ int dt_opencl_set_kernel_arg(const int dev, const int kernel, const int num, con
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited || dev < 0) return -1;
   if(kernel < 0 || kernel >= DT_OPENCL_MAX_KERNELS) return -1;
-  return (cl->dlocl->symbols->dt_clSetKernelArg)(cl->dev[dev].kernel[kernel], num, size, arg);
+  const cl_kernel k = _kernel(dev, kernel);
+  if(!k) return CL_INVALID_KERNEL;
+  return (cl->dlocl->symbols->dt_clSetKernelArg)(k, num, size, arg);
+}
+
+// local work sizes tried by the autotuner, { 0, 0 } is the driver's choice
+static const size_t _tune_candidates[DT_OPENCL_TUNE_CANDIDATES][2]
+    = { { 0, 0 }, { 8, 8 }, { 16, 8 }, { 16, 16 }, { 32, 4 }, { 32, 8 }, { 64, 4 } };
+// every candidate is measured this often, the best run counts
+#define DT_OPENCL_TUNE_ROUNDS 2
+
+static void _tune_finish(const int dev, const int kernel)
+{
+  dt_opencl_device_t *device = &darktable.opencl->dev[dev];
+  dt_opencl_tuning_t *tuning = &device->tuning[kernel];
+
+  int best = 0;
+  for(int c = 1; c < DT_OPENCL_TUNE_CANDIDATES; c++)
+    if(tuning->time[c] > 0.0f && (tuning->time[best] <= 0.0f || tuning->time[c] < tuning->time[best])) best = c;
+  tuning->local[0] = _tune_candidates[best][0];
+  tuning->local[1] = _tune_candidates[best][1];
+  tuning->state = DT_OPENCL_TUNING_DONE;
+
+  dt_print(DT_DEBUG_OPENCL, "[opencl_tune] kernel `%s' on device %d: local size %zu x %zu%s\n",
+           device->kernel_name[kernel], dev, tuning->local[0], tuning->local[1],
+           best == 0 ? " (driver's choice)" : "");
+
+  if(!device->cachedir || !device->kernel_name[kernel]) return;
+  gchar *filename = g_build_filename(device->cachedir, "work_group_sizes", NULL);
+  FILE *f = g_fopen(filename, "ab");
+  g_free(filename);
+  if(!f) return;
+  fprintf(f, "%d %s %zu %zu\n", device->kernel_program[kernel], device->kernel_name[kernel], tuning->local[0],
+          tuning->local[1]);
+  fclose(f);
+
+  size_t *value = g_malloc(sizeof(tuning->local));
+  memcpy(value, tuning->local, sizeof(tuning->local));
+  g_hash_table_insert(device->tuned,
+                      g_strdup_printf("%d %s", device->kernel_program[kernel], device->kernel_name[kernel]), value);
+}
+
+static void _tune_start(const int dev, const int kernel)
+{
+  dt_opencl_device_t *device = &darktable.opencl->dev[dev];
+  dt_opencl_tuning_t *tuning = &device->tuning[kernel];
+
+  gchar *key = g_strdup_printf("%d %s", device->kernel_program[kernel], device->kernel_name[kernel]);
+  const size_t *known = device->tuned ? g_hash_table_lookup(device->tuned, key) : NULL;
+  g_free(key);
+  if(known)
+  {
+    tuning->local[0] = known[0];
+    tuning->local[1] = known[1];
+    tuning->state = DT_OPENCL_TUNING_DONE;
+    return;
+  }
+
+  // rule out what the kernel or device can't take at all
+  size_t max_local = 0;
+  size_t max_sizes[3] = { 0 };
+  const cl_kernel k = _kernel(dev, kernel);
+  if(!k
+     || (darktable.opencl->dlocl->symbols->dt_clGetKernelWorkGroupInfo)(
+            k, device->devid, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &max_local, NULL) != CL_SUCCESS
+     || dt_opencl_get_max_work_item_sizes(dev, max_sizes) != CL_SUCCESS)
+  {
+    tuning->state = DT_OPENCL_TUNING_DONE;
+    return;
+  }
+
+  for(int c = 1; c < DT_OPENCL_TUNE_CANDIDATES; c++)
+    if(_tune_candidates[c][0] * _tune_candidates[c][1] > max_local || _tune_candidates[c][0] > max_sizes[0]
+       || _tune_candidates[c][1] > max_sizes[1])
+      tuning->time[c] = -1.0f;
+  tuning->step = 0;
+  tuning->state = DT_OPENCL_TUNING_RUNNING;
 }
 
 int dt_opencl_enqueue_kernel_2d(const int dev, const int kernel, const size_t *sizes)
 {
-  return dt_opencl_enqueue_kernel_2d_with_local(dev, kernel, sizes, NULL);
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || dev < 0) return -1;
+  if(kernel < 0 || kernel >= DT_OPENCL_MAX_KERNELS) return -1;
+
+  dt_opencl_tuning_t *tuning = &cl->dev[dev].tuning[kernel];
+  if(cl->tune_work_groups && tuning->state == DT_OPENCL_TUNING_NONE) _tune_start(dev, kernel);
+
+  // tiny runs don't tell much about the fastest work group size
+  if(!cl->tune_work_groups || tuning->state == DT_OPENCL_TUNING_DONE || sizes[0] * sizes[1] < 256 * 256)
+  {
+    const gboolean tuned = tuning->local[0] && !(sizes[0] % tuning->local[0]) && !(sizes[1] % tuning->local[1]);
+    const int err = dt_opencl_enqueue_kernel_2d_with_local(dev, kernel, sizes, tuned ? tuning->local : NULL);
+    if(err == CL_SUCCESS || !tuned) return err;
+    // a size stored by an older kernel the current one can't take
+    tuning->local[0] = tuning->local[1] = 0;
+    return dt_opencl_enqueue_kernel_2d_with_local(dev, kernel, sizes, NULL);
+  }
+
+  // each tuning step runs the real work with the next candidate, so nothing is computed twice
+  const int c = tuning->step % DT_OPENCL_TUNE_CANDIDATES;
+  const size_t *local = _tune_candidates[c][0] ? _tune_candidates[c] : NULL;
+  int err;
+
+  if(tuning->time[c] < 0.0f || (local && (sizes[0] % local[0] || sizes[1] % local[1])))
+    err = dt_opencl_enqueue_kernel_2d_with_local(dev, kernel, sizes, NULL);
+  else
+  {
+    (cl->dlocl->symbols->dt_clFinish)(cl->dev[dev].cmd_queue);
+    const double start = dt_get_wtime();
+    err = dt_opencl_enqueue_kernel_2d_with_local(dev, kernel, sizes, local);
+    if(err == CL_SUCCESS)
+    {
+      (cl->dlocl->symbols->dt_clFinish)(cl->dev[dev].cmd_queue);
+      const float time = (dt_get_wtime() - start) / (sizes[0] * sizes[1]);
+      if(tuning->time[c] == 0.0f || time < tuning->time[c]) tuning->time[c] = time;
+    }
+    else if(local)
+    {
+      // the driver rejected this candidate after all, do the work with its own choice
+      tuning->time[c] = -1.0f;
+      err = dt_opencl_enqueue_kernel_2d_with_local(dev, kernel, sizes, NULL);
+    }
+  }
+
+  if(++tuning->step >= DT_OPENCL_TUNE_CANDIDATES * DT_OPENCL_TUNE_ROUNDS) _tune_finish(dev, kernel);
+  return err;
 }
 
 
@@ -1979,22 +2565,65 @@ int dt_opencl_enqueue_kernel_2d_with_local(const int dev, const int kernel, cons
   dt_opencl_t *cl = darktable.opencl;
   if(!cl->inited || dev < 0) return -1;
   if(kernel < 0 || kernel >= DT_OPENCL_MAX_KERNELS) return -1;
+  const cl_kernel k = _kernel(dev, kernel);
+  if(!k) return CL_INVALID_KERNEL;
   int err;
   char buf[256];
   buf[0] = '\0';
-  if(darktable.unmuted & DT_DEBUG_OPENCL)
-    (cl->dlocl->symbols->dt_clGetKernelInfo)(cl->dev[dev].kernel[kernel], CL_KERNEL_FUNCTION_NAME, 256, buf,
-                                            NULL);
+  const double trace_begin = dt_trace_begin();
+  if(darktable.unmuted & (DT_DEBUG_OPENCL | DT_DEBUG_PERF | DT_DEBUG_TRACE))
+    (cl->dlocl->symbols->dt_clGetKernelInfo)(k, CL_KERNEL_FUNCTION_NAME, 256, buf, NULL);
   cl_event *eventp = dt_opencl_events_get_slot(dev, buf);
-  err = (cl->dlocl->symbols->dt_clEnqueueNDRangeKernel)(cl->dev[dev].cmd_queue, cl->dev[dev].kernel[kernel],
+  if(eventp && (darktable.unmuted & DT_DEBUG_PERF))
+  {
+    // launch geometry for the occupancy figures of the profiling report
+    dt_opencl_eventtag_t *eventtag = cl->dev[dev].eventtags + (eventp - cl->dev[dev].eventlist);
+    eventtag->global[0] = sizes[0];
+    eventtag->global[1] = sizes[1];
+    eventtag->local[0] = local ? local[0] : 0;
+    eventtag->local[1] = local ? local[1] : 0;
+    (cl->dlocl->symbols->dt_clGetKernelWorkGroupInfo)(k, cl->dev[dev].devid, CL_KERNEL_WORK_GROUP_SIZE,
+                                                      sizeof(size_t), &eventtag->max_local, NULL);
+  }
+  err = (cl->dlocl->symbols->dt_clEnqueueNDRangeKernel)(cl->dev[dev].cmd_queue, k,
                                                         2, NULL, sizes, local, 0, NULL, eventp);
+  // the enqueue itself, the kernel runs asynchronously on the device
+  dt_trace_complete("opencl", buf, trace_begin, "\"device\":%d,\"width\":%zu,\"height\":%zu,\"error\":%d", dev,
+                    sizes[0], sizes[1], err);
+  // images are often only backed by real memory once the first kernel touches them
+  if(err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES)
+    _memory_failure(dev, "kernel", sizes[0], sizes[1], 0, 0, err);
   // if (err == CL_SUCCESS) err = dt_opencl_finish(dev);
   return err;
 }
 
+// an image created with CL_MEM_USE_HOST_PTR on this very host buffer
+static gboolean _wraps_host_buffer(void *device, void *host)
+{
+  void *ptr = NULL;
+  return host && device
+         && (darktable.opencl->dlocl->symbols->dt_clGetMemObjectInfo)(device, CL_MEM_HOST_PTR, sizeof(ptr), &ptr,
+                                                                      NULL) == CL_SUCCESS
+         && ptr == host;
+}
+
 int dt_opencl_copy_device_to_host(const int devid, void *host, void *device, const int width,
                                   const int height, const int bpp)
 {
+  if(!darktable.opencl->inited || devid < 0) return -1;
+  if(_wraps_host_buffer(device, host))
+  {
+    // the data is there already, mapping just makes sure the device is done and the host sees it
+    const size_t origin[] = { 0, 0, 0 };
+    const size_t region[] = { width, height, 1 };
+    size_t rowpitch = 0;
+    cl_int err = CL_SUCCESS;
+    void *mapped = (darktable.opencl->dlocl->symbols->dt_clEnqueueMapImage)(
+        darktable.opencl->dev[devid].cmd_queue, device, CL_TRUE, CL_MAP_READ, origin, region, &rowpitch, NULL, 0,
+        NULL, NULL, &err);
+    if(err != CL_SUCCESS) return err;
+    return dt_opencl_unmap_mem_object(devid, device, mapped);
+  }
   return dt_opencl_read_host_from_device(devid, host, device, width, height, bpp);
 }
 
@@ -2172,8 +2801,11 @@ void *dt_opencl_copy_host_to_device_constant(const int devid, const size_t size,
   cl_mem dev = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(
       darktable.opencl->dev[devid].context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, host, &err);
   if(err != CL_SUCCESS)
+  {
     dt_print(DT_DEBUG_OPENCL,
              "[opencl copy_host_to_device_constant] could not alloc buffer on device %d: %d\n", devid, err);
+    _memory_failure(devid, "constant", 0, 0, 0, size, err);
+  }
 
   dt_opencl_memory_statistics(devid, dev, OPENCL_MEMORY_ADD);
 
@@ -2207,14 +2839,167 @@ void *dt_opencl_copy_host_to_device_rowpitch(const int devid, void *host, const
       darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, &fmt, width, height,
       rowpitch, host, &err);
   if(err != CL_SUCCESS)
+  {
     dt_print(DT_DEBUG_OPENCL,
              "[opencl copy_host_to_device] could not alloc/copy img buffer on device %d: %d\n", devid, err);
+    _memory_failure(devid, "image", width, height, bpp, (size_t)width * height * bpp, err);
+  }
 
   dt_opencl_memory_statistics(devid, dev, OPENCL_MEMORY_ADD);
 
   return dev;
 }
 
+// guess pixel format from bytes per pixel
+static gboolean _image_format(const int bpp, cl_image_format *fmt)
+{
+  if(bpp == 4 * sizeof(float))
+    *fmt = (cl_image_format){ CL_RGBA, CL_FLOAT };
+  else if(bpp == sizeof(float))
+    *fmt = (cl_image_format){ CL_R, CL_FLOAT };
+  else if(bpp == sizeof(uint16_t))
+    *fmt = (cl_image_format){ CL_R, CL_UNSIGNED_INT16 };
+  else if(bpp == sizeof(uint8_t))
+    *fmt = (cl_image_format){ CL_R, CL_UNSIGNED_INT8 };
+  else
+    return FALSE;
+  return TRUE;
+}
+
+// buffer sizes are rounded up to a sixteenth to an eighth of their power of two,
+// so that temporaries of about the same size find each other in the pool
+static size_t _pool_bucket(const size_t size)
+{
+  size_t step = 1;
+  while(step * 16 <= size) step <<= 1;
+  return (size + step - 1) / step * step;
+}
+
+// an image (width > 0) or buffer released earlier with exactly these dimensions
+static cl_mem _pool_take(const int devid, const int width, const int height, const int bpp, const size_t size)
+{
+  if(!darktable.opencl->mem_pool) return NULL;
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  cl_mem mem = NULL;
+
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  for(int k = 0; k < DT_OPENCL_POOL_SLOTS && !mem; k++)
+  {
+    dt_opencl_pool_entry_t *e = &dev->pool[k];
+    if(!e->mem || e->width != width) continue;
+    if(width ? (e->height == height && e->bpp == bpp) : (e->size == size))
+    {
+      mem = e->mem;
+      dev->pool_size -= e->size;
+      e->mem = NULL;
+    }
+  }
+  if(mem)
+    dev->pool_hits++;
+  else
+    dev->pool_misses++;
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+
+  return mem;
+}
+
+// keep a released object if it is plain device memory we handed out and nobody else holds on to it.
+// the command queue is in order, so whoever gets it next only touches it after the last user is done.
+static gboolean _pool_put(cl_mem mem)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->mem_pool) return FALSE;
+
+  const int devid = dt_opencl_get_mem_context_id(mem);
+  if(devid < 0) return FALSE;
+
+  cl_mem_flags flags = 0;
+  cl_uint refs = 0;
+  cl_mem_object_type type = 0;
+  if((cl->dlocl->symbols->dt_clGetMemObjectInfo)(mem, CL_MEM_FLAGS, sizeof(flags), &flags, NULL) != CL_SUCCESS
+     || (cl->dlocl->symbols->dt_clGetMemObjectInfo)(mem, CL_MEM_REFERENCE_COUNT, sizeof(refs), &refs, NULL)
+            != CL_SUCCESS
+     || (cl->dlocl->symbols->dt_clGetMemObjectInfo)(mem, CL_MEM_TYPE, sizeof(type), &type, NULL) != CL_SUCCESS)
+    return FALSE;
+  if(flags != CL_MEM_READ_WRITE || refs != 1) return FALSE;
+
+  const size_t size = dt_opencl_get_mem_object_size(mem);
+  int width = 0, height = 0, bpp = 0;
+  if(type == CL_MEM_OBJECT_IMAGE2D)
+  {
+    cl_image_format fmt, ours;
+    bpp = dt_opencl_get_image_element_size(mem);
+    if((cl->dlocl->symbols->dt_clGetImageInfo)(mem, CL_IMAGE_FORMAT, sizeof(fmt), &fmt, NULL) != CL_SUCCESS
+       || !_image_format(bpp, &ours) || fmt.image_channel_order != ours.image_channel_order
+       || fmt.image_channel_data_type != ours.image_channel_data_type)
+      return FALSE;
+    width = dt_opencl_get_image_width(mem);
+    height = dt_opencl_get_image_height(mem);
+    if(width == 0 || height == 0) return FALSE;
+  }
+  else if(type != CL_MEM_OBJECT_BUFFER || size != _pool_bucket(size))
+    return FALSE;
+
+  // the pool must not eat into what tiling thinks the modules can use
+  const size_t limit = dt_opencl_get_device_available(devid) / 8;
+  if(size == 0 || size > limit) return FALSE;
+
+  dt_opencl_device_t *dev = &cl->dev[devid];
+  int slot = -1;
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  while(slot < 0)
+  {
+    int free_slot = -1, oldest = -1;
+    for(int k = 0; k < DT_OPENCL_POOL_SLOTS; k++)
+    {
+      if(!dev->pool[k].mem)
+        free_slot = k;
+      else if(oldest < 0 || dev->pool[k].stamp < dev->pool[oldest].stamp)
+        oldest = k;
+    }
+    if(free_slot >= 0 && dev->pool_size + size <= limit)
+      slot = free_slot;
+    else if(oldest >= 0)
+    {
+      // make room by giving the least recently released entry back to the driver
+      (cl->dlocl->symbols->dt_clReleaseMemObject)(dev->pool[oldest].mem);
+      dev->pool_size -= dev->pool[oldest].size;
+      dev->pool[oldest].mem = NULL;
+    }
+    else
+      break;
+  }
+  if(slot >= 0)
+  {
+    dev->pool[slot] = (dt_opencl_pool_entry_t){ mem, size, width, height, bpp, ++dev->pool_stamp };
+    dev->pool_size += size;
+  }
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+
+  return slot >= 0;
+}
+
+void dt_opencl_flush_pool(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || devid >= cl->num_devs) return;
+  dt_opencl_device_t *dev = &cl->dev[devid];
+
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  for(int k = 0; k < DT_OPENCL_POOL_SLOTS; k++)
+  {
+    if(dev->pool[k].mem) (cl->dlocl->symbols->dt_clReleaseMemObject)(dev->pool[k].mem);
+    dev->pool[k].mem = NULL;
+  }
+  dev->pool_size = 0;
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+}
+
+int dt_opencl_unified_memory(const int devid)
+{
+  if(!darktable.opencl->inited || devid < 0) return FALSE;
+  return darktable.opencl->dev[devid].unified_memory;
+}
 
 void dt_opencl_release_mem_object(cl_mem mem)
 {
@@ -2226,6 +3011,8 @@ void dt_opencl_release_mem_object(cl_mem mem)
 
   dt_opencl_memory_statistics(-1, mem, OPENCL_MEMORY_SUB);
 
+  if(_pool_put(mem)) return;
+
   (darktable.opencl->dlocl->symbols->dt_clReleaseMemObject)(mem);
 }
 
@@ -2257,25 +3044,27 @@ int dt_opencl_unmap_mem_object(const int devid, cl_mem mem_object, void *mapped_
 void *dt_opencl_alloc_device(const int devid, const int width, const int height, const int bpp)
 {
   if(!darktable.opencl->inited || devid < 0) return NULL;
-  cl_int err;
+  cl_int err = CL_SUCCESS;
   cl_image_format fmt;
-  // guess pixel format from bytes per pixel
-  if(bpp == 4 * sizeof(float))
-    fmt = (cl_image_format){ CL_RGBA, CL_FLOAT };
-  else if(bpp == sizeof(float))
-    fmt = (cl_image_format){ CL_R, CL_FLOAT };
-  else if(bpp == sizeof(uint16_t))
-    fmt = (cl_image_format){ CL_R, CL_UNSIGNED_INT16 };
-  else if(bpp == sizeof(uint8_t))
-    fmt = (cl_image_format){ CL_R, CL_UNSIGNED_INT8 };
-  else
-    return NULL;
+  if(!_image_format(bpp, &fmt)) return NULL;
 
-  cl_mem dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
-      darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+  cl_mem dev = _pool_take(devid, width, height, bpp, 0);
+  if(!dev)
+    dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+        darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+  if(err != CL_SUCCESS && darktable.opencl->dev[devid].pool_size)
+  {
+    // the memory might just be sitting in the pool
+    dt_opencl_flush_pool(devid);
+    dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+        darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+  }
   if(err != CL_SUCCESS)
+  {
     dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device] could not alloc img buffer on device %d: %d\n", devid,
              err);
+    _memory_failure(devid, "image", width, height, bpp, (size_t)width * height * bpp, err);
+  }
 
   dt_opencl_memory_statistics(devid, dev, OPENCL_MEMORY_ADD);
 
@@ -2304,9 +3093,12 @@ void *dt_opencl_alloc_device_use_host_pointer(const int devid, const int width,
       CL_MEM_READ_WRITE | ((host == NULL) ? CL_MEM_ALLOC_HOST_PTR : CL_MEM_USE_HOST_PTR), &fmt, width, height,
       rowpitch, host, &err);
   if(err != CL_SUCCESS)
+  {
     dt_print(DT_DEBUG_OPENCL,
              "[opencl alloc_device_use_host_pointer] could not alloc img buffer on device %d: %d\n", devid,
              err);
+    _memory_failure(devid, "host image", width, height, bpp, (size_t)width * height * bpp, err);
+  }
 
   dt_opencl_memory_statistics(devid, dev, OPENCL_MEMORY_ADD);
 
@@ -2317,13 +3109,26 @@ void *dt_opencl_alloc_device_use_host_pointer(const int devid, const int width,
 void *dt_opencl_alloc_device_buffer(const int devid, const size_t size)
 {
   if(!darktable.opencl->inited) return NULL;
-  cl_int err;
+  cl_int err = CL_SUCCESS;
+  const size_t bucket = darktable.opencl->mem_pool ? _pool_bucket(size) : size;
 
-  cl_mem buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
-                                                                     CL_MEM_READ_WRITE, size, NULL, &err);
+  cl_mem buf = _pool_take(devid, 0, 0, 0, bucket);
+  if(!buf)
+    buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                               CL_MEM_READ_WRITE, bucket, NULL, &err);
+  if(err != CL_SUCCESS && darktable.opencl->dev[devid].pool_size)
+  {
+    // the memory might just be sitting in the pool
+    dt_opencl_flush_pool(devid);
+    buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                               CL_MEM_READ_WRITE, bucket, NULL, &err);
+  }
   if(err != CL_SUCCESS)
+  {
     dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device_buffer] could not alloc buffer on device %d: %d\n", devid,
              err);
+    _memory_failure(devid, "buffer", 0, 0, 0, bucket, err);
+  }
 
   dt_opencl_memory_statistics(devid, buf, OPENCL_MEMORY_ADD);
 
@@ -2338,8 +3143,11 @@ void *dt_opencl_alloc_device_buffer_with_flags(const int devid, const size_t siz
   cl_mem buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
                                                                      flags, size, NULL, &err);
   if(err != CL_SUCCESS)
+  {
     dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device_buffer] could not alloc buffer on device %d: %d\n", devid,
              err);
+    _memory_failure(devid, "buffer", 0, 0, 0, size, err);
+  }
 
   dt_opencl_memory_statistics(devid, buf, OPENCL_MEMORY_ADD);
 
@@ -2415,7 +3223,12 @@ int dt_opencl_get_image_element_size(cl_mem mem)
 
 void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t action)
 {
-  if(!((darktable.unmuted & DT_DEBUG_MEMORY) && (darktable.unmuted & DT_DEBUG_OPENCL)))
+  // the adaptive memory budget needs the numbers all the time, not only for debugging
+  if(!((darktable.unmuted & DT_DEBUG_MEMORY) && (darktable.unmuted & DT_DEBUG_OPENCL))
+     && !darktable.opencl->adaptive_memory)
+    return;
+
+  if(mem == NULL)
     return;
 
   if(devid < 0)
@@ -2424,18 +3237,26 @@ void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t actio
   if(devid < 0)
     return;
 
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  const size_t size = dt_opencl_get_mem_object_size(mem);
   if(action == OPENCL_MEMORY_ADD)
-    darktable.opencl->dev[devid].memory_in_use += dt_opencl_get_mem_object_size(mem);
+    dev->memory_in_use += size;
   else
-    darktable.opencl->dev[devid].memory_in_use -= dt_opencl_get_mem_object_size(mem);
+    dev->memory_in_use -= MIN(size, dev->memory_in_use);
 
-  darktable.opencl->dev[devid].peak_memory = MAX(darktable.opencl->dev[devid].peak_memory,
-                                                 darktable.opencl->dev[devid].memory_in_use);
+  dev->peak_memory = MAX(dev->peak_memory, dev->memory_in_use);
+  dev->run_peak = MAX(dev->run_peak, dev->memory_in_use);
+  dev->module_peak = MAX(dev->module_peak, dev->memory_in_use);
+
+  if(!(darktable.unmuted & DT_DEBUG_OPENCL))
+    return;
 
   if(darktable.unmuted & DT_DEBUG_MEMORY)
     dt_print(DT_DEBUG_OPENCL,
-              "[opencl memory] device %d: %zu bytes (%.1f MB) in use\n", devid, darktable.opencl->dev[devid].memory_in_use,
-                                      (float)darktable.opencl->dev[devid].memory_in_use/(1024*1024));
+              "[opencl memory] device %d: %zu bytes (%.1f MB) in use, %.1f MB pooled for reuse\n", devid,
+              darktable.opencl->dev[devid].memory_in_use,
+              (float)darktable.opencl->dev[devid].memory_in_use/(1024*1024),
+              (float)darktable.opencl->dev[devid].pool_size/(1024*1024));
 }
 
 /* As there is no portable way to get the unused memory of a cl device we check for memory by testing.
@@ -2524,6 +3345,8 @@ size_t dt_opencl_get_unused_device_mem(const int devid)
    - a headroom of 400MB in all cases not using tuned cl
    - 256MB to simulate a minimum system
    - 2GB to simalate a reference system 
+   with opencl_adaptive_memory this is only the starting point of a budget that follows the real usage
+   and allocation failures on the device, see _memory_failure() and _memory_budget_update().
 */
 cl_ulong dt_opencl_get_device_available(const int devid)
 {
@@ -2555,9 +3378,85 @@ cl_ulong dt_opencl_get_device_available(const int devid)
   if(mod)
     dt_print(DT_DEBUG_OPENCL | DT_DEBUG_MEMORY, "[dt_opencl_get_device_available] use %luMB (tune=%s) as available on device %i\n",
        available / 1024lu / 1024lu, (tuned) ? "ON" : "OFF", devid);
+
+  if(darktable.opencl->adaptive_memory)
+  {
+    dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+    // the configured amount is where we start from, a changed resource level starts over
+    if(dev->budget_base != available)
+    {
+      dev->budget_base = available;
+      dev->budget = dev->budget_ceiling ? MIN(available, dev->budget_ceiling) : available;
+    }
+    return dev->budget;
+  }
   return available;
 }
 
+// the budget never goes below what we guarantee as a minimum system
+#define DT_OPENCL_BUDGET_MIN (256lu * 1024lu * 1024lu)
+// margin left below the device memory or a failed allocation
+#define DT_OPENCL_BUDGET_MARGIN (128lu * 1024lu * 1024lu)
+
+/* an allocation or a kernel failed for lack of device memory. whatever was in use plus the request is more
+   than the device gives us, so the budget goes below that and never grows back beyond it. */
+static void _memory_failure(const int devid, const char *kind, const size_t width, const size_t height,
+                            const int bpp, const size_t bytes, const cl_int err)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(devid < 0 || devid >= cl->num_devs) return;
+  dt_opencl_device_t *dev = &cl->dev[devid];
+  dev->alloc_failures++;
+  dev->run_failures++;
+
+  const gboolean memory = err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES
+                          || err == CL_OUT_OF_HOST_MEMORY || err == CL_INVALID_BUFFER_SIZE;
+  if(cl->adaptive_memory && memory && dev->budget)
+  {
+    const size_t failed = dev->memory_in_use + dev->pool_size + bytes;
+    const size_t ceiling = failed > DT_OPENCL_BUDGET_MIN + DT_OPENCL_BUDGET_MARGIN
+                               ? failed - DT_OPENCL_BUDGET_MARGIN
+                               : DT_OPENCL_BUDGET_MIN;
+    dev->budget_ceiling = dev->budget_ceiling ? MIN(dev->budget_ceiling, ceiling) : ceiling;
+    dev->budget = MAX(DT_OPENCL_BUDGET_MIN, MIN(dev->budget, dev->budget_ceiling / 8 * 7));
+    dt_print(DT_DEBUG_OPENCL | DT_DEBUG_MEMORY,
+             "[opencl memory budget] device %d: %s failed with %zuMB in use, budget now %zuMB\n", devid, kind,
+             dev->memory_in_use / 1024lu / 1024lu, dev->budget / 1024lu / 1024lu);
+  }
+
+  gchar *line = g_strdup_printf(
+      "{\"opencl_alloc_failure\":true,\"pipe\":\"%s\",\"module\":\"%s\",\"instance\":%d,\"device\":\"%s\","
+      "\"devid\":%d,\"kind\":\"%s\",\"width\":%zu,\"height\":%zu,\"bpp\":%d,\"bytes\":%zu,\"in_use\":%zu,"
+      "\"pooled\":%zu,\"budget\":%zu,\"error\":%d}",
+      dev->profile_pipe ? dev->profile_pipe : "unknown", dev->profile_module, dev->profile_instance, dev->name,
+      devid, kind, width, height, bpp, bytes, dev->memory_in_use, dev->pool_size, dev->budget, err);
+  dt_dev_pixelpipe_report_write(line);
+  g_free(line);
+}
+
+/* called when a pipe gives its device back. a run that came close to the budget without any failure
+   was held back by it, so the budget moves a quarter of the way up to what the device can give. */
+static void _memory_budget_update(const int devid)
+{
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  if(darktable.opencl->adaptive_memory && dev->budget && !dev->run_failures
+     && dev->run_peak > dev->budget / 8 * 7)
+  {
+    const size_t allmem = dev->max_global_mem > DT_OPENCL_BUDGET_MARGIN ? dev->max_global_mem - DT_OPENCL_BUDGET_MARGIN
+                                                                       : dev->max_global_mem;
+    const size_t ceiling = dev->budget_ceiling ? MIN(dev->budget_ceiling, allmem) : allmem;
+    if(ceiling > dev->budget)
+    {
+      dev->budget += (ceiling - dev->budget) / 4;
+      dt_print(DT_DEBUG_OPENCL | DT_DEBUG_MEMORY,
+               "[opencl memory budget] device %d: peak %zuMB, budget now %zuMB\n", devid,
+               dev->run_peak / 1024lu / 1024lu, dev->budget / 1024lu / 1024lu);
+    }
+  }
+  dev->run_peak = dev->memory_in_use;
+  dev->run_failures = 0;
+}
+
 cl_ulong dt_opencl_get_device_memalloc(const int devid)
 {
   if(!darktable.opencl->inited || devid < 0) return 0;
@@ -2596,6 +3495,24 @@ static gboolean _cl_test_available(const int devid, const size_t required)
   return success;
 }
 
+gboolean dt_opencl_memory_measure_begin(const int devid, size_t *base)
+{
+  if(!darktable.opencl->inited || devid < 0) return FALSE;
+  if(!((darktable.unmuted & DT_DEBUG_MEMORY) && (darktable.unmuted & DT_DEBUG_OPENCL))
+     && !darktable.opencl->adaptive_memory)
+    return FALSE;
+
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  dev->module_peak = *base = dev->memory_in_use;
+  return TRUE;
+}
+
+size_t dt_opencl_memory_measure_end(const int devid, const size_t base)
+{
+  const dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  return dev->module_peak - MIN(base, dev->module_peak);
+}
+
 gboolean dt_opencl_image_fits_device(const int devid, const size_t width, const size_t height, const unsigned bpp,
                                 const float factor, const size_t overhead)
 {
@@ -2769,6 +3686,32 @@ static void dt_opencl_apply_scheduling_profile(dt_opencl_scheduling_profile_t pr
 
 /** the following eventlist functions assume that affected structures are locked upstream */
 
+static void _events_tag(const dt_opencl_device_t *device, dt_opencl_eventtag_t *eventtag, const char *tag)
+{
+  if(tag != NULL)
+    g_strlcpy(eventtag->tag, tag, DT_OPENCL_EVENTNAMELENGTH);
+  else
+    eventtag->tag[0] = '\0';
+
+  eventtag->pipe = device->profile_pipe;
+  g_strlcpy(eventtag->module, device->profile_module, DT_OPENCL_EVENTNAMELENGTH);
+  eventtag->instance = device->profile_instance;
+  eventtag->global[0] = eventtag->global[1] = 0;
+  eventtag->local[0] = eventtag->local[1] = 0;
+  eventtag->max_local = 0;
+  eventtag->queued = eventtag->submit = eventtag->start = eventtag->end = 0;
+}
+
+void dt_opencl_events_set_module(const int devid, const char *pipe, const char *module, const int instance)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0) return;
+
+  cl->dev[devid].profile_pipe = pipe;
+  g_strlcpy(cl->dev[devid].profile_module, module ? module : "", DT_OPENCL_EVENTNAMELENGTH);
+  cl->dev[devid].profile_instance = instance;
+}
+
 /** get next free slot in eventlist (and manage size of eventlist) */
 cl_event *dt_opencl_events_get_slot(const int devid, const char *tag)
 {
@@ -2808,14 +3751,7 @@ cl_event *dt_opencl_events_get_slot(const int devid, const char *tag)
   {
     (*lostevents)++;
     (*totallost)++;
-    if(tag != NULL)
-    {
-      g_strlcpy((*eventtags)[*numevents - 1].tag, tag, DT_OPENCL_EVENTNAMELENGTH);
-    }
-    else
-    {
-      (*eventtags)[*numevents - 1].tag[0] = '\0';
-    }
+    _events_tag(&cl->dev[devid], (*eventtags) + *numevents - 1, tag);
 
     (*totalevents)++;
     return (*eventlist) + *numevents - 1;
@@ -2850,14 +3786,7 @@ cl_event *dt_opencl_events_get_slot(const int devid, const char *tag)
   // init next event slot and return it
   (*numevents)++;
   memcpy((*eventlist) + *numevents - 1, zeroevent, sizeof(cl_event));
-  if(tag != NULL)
-  {
-    g_strlcpy((*eventtags)[*numevents - 1].tag, tag, DT_OPENCL_EVENTNAMELENGTH);
-  }
-  else
-  {
-    (*eventtags)[*numevents - 1].tag[0] = '\0';
-  }
+  _events_tag(&cl->dev[devid], (*eventtags) + *numevents - 1, tag);
 
   (*totalevents)++;
   return (*eventlist) + *numevents - 1;
@@ -2935,6 +3864,113 @@ void dt_opencl_events_wait_for(const int devid)
 }
 
 
+// per module totals of the profiling report
+typedef struct _events_report_total_t
+{
+  const char *module;
+  int instance;
+  int kernels;
+  double kernel, transfer, copy, wait;
+} _events_report_total_t;
+
+/** -d perf: one json line per profiled command to the pixelpipe report and a per module breakdown of
+    kernel time, host<->device transfers, copies on the device and time spent waiting in the queue */
+static void _events_report(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  const dt_opencl_device_t *device = &cl->dev[devid];
+  const int count = device->eventsconsolidated;
+  if(device->eventtags == NULL || count == 0) return;
+
+  _events_report_total_t *totals = calloc(count, sizeof(_events_report_total_t));
+  if(!totals) return;
+  int items = 0;
+
+  for(int k = 0; k < count; k++)
+  {
+    const dt_opencl_eventtag_t *ev = device->eventtags + k;
+    if(ev->end == 0) continue; // no profiling info
+
+    const gboolean kernel = ev->global[0] > 0;
+    const gboolean copy = !kernel && strstr(ev->tag, "on device") != NULL;
+    const double time = (ev->end - ev->start) * 1e-9;
+    const double wait = (ev->queued > 0 && ev->start > ev->queued) ? (ev->start - ev->queued) * 1e-9 : 0.0;
+
+    // the launch geometry relative to what the kernel and device could take
+    double fill = 0.0, groups_per_cu = 0.0;
+    if(kernel && ev->local[0] > 0 && ev->local[1] > 0)
+    {
+      if(ev->max_local > 0) fill = (double)(ev->local[0] * ev->local[1]) / ev->max_local;
+      const size_t groups = ((ev->global[0] + ev->local[0] - 1) / ev->local[0])
+                            * ((ev->global[1] + ev->local[1] - 1) / ev->local[1]);
+      if(device->compute_units > 0) groups_per_cu = (double)groups / device->compute_units;
+    }
+
+    // linear search as in dt_opencl_events_profiling(), there are few modules per run
+    int t = 0;
+    for(; t < items; t++)
+      if(totals[t].instance == ev->instance && !strcmp(totals[t].module, ev->module)) break;
+    if(t == items)
+    {
+      totals[t].module = ev->module;
+      totals[t].instance = ev->instance;
+      items++;
+    }
+    if(kernel)
+    {
+      totals[t].kernel += time;
+      totals[t].kernels++;
+    }
+    else if(copy)
+      totals[t].copy += time;
+    else
+      totals[t].transfer += time;
+    totals[t].wait += wait;
+
+    char stime[G_ASCII_DTOSTR_BUF_SIZE], swait[G_ASCII_DTOSTR_BUF_SIZE];
+    char sfill[G_ASCII_DTOSTR_BUF_SIZE], sgroups[G_ASCII_DTOSTR_BUF_SIZE];
+    g_ascii_formatd(stime, sizeof(stime), "%.6f", time);
+    g_ascii_formatd(swait, sizeof(swait), "%.6f", wait);
+    g_ascii_formatd(sfill, sizeof(sfill), "%.3f", fill);
+    g_ascii_formatd(sgroups, sizeof(sgroups), "%.3f", groups_per_cu);
+    gchar *line = g_strdup_printf(
+        "{\"opencl\":true,\"pipe\":\"%s\",\"module\":\"%s\",\"instance\":%d,\"device\":\"%s\",\"devid\":%d,"
+        "\"command\":\"%s\",\"kind\":\"%s\",\"global\":[%zu,%zu],\"local\":[%zu,%zu],\"max_local\":%zu,"
+        "\"workgroup_fill\":%s,\"groups_per_cu\":%s,\"queued\":%" PRIu64 ",\"submit\":%" PRIu64
+        ",\"start\":%" PRIu64 ",\"end\":%" PRIu64 ",\"time\":%s,\"wait\":%s}",
+        ev->pipe ? ev->pipe : "unknown", ev->module, ev->instance, device->name, devid,
+        ev->tag[0] == '\0' ? "<?>" : ev->tag, kernel ? "kernel" : (copy ? "copy" : "transfer"), ev->global[0],
+        ev->global[1], ev->local[0], ev->local[1], ev->max_local, sfill, sgroups, (uint64_t)ev->queued,
+        (uint64_t)ev->submit, (uint64_t)ev->start, (uint64_t)ev->end, stime, swait);
+    dt_dev_pixelpipe_report_write(line);
+    g_free(line);
+  }
+
+  for(int t = 0; t < items; t++)
+  {
+    const _events_report_total_t *total = totals + t;
+    dt_print(DT_DEBUG_PERF, "[opencl_profiling] `%s %d' on device %d: %d kernels %.4f, transfers %.4f, "
+                            "copies on device %.4f, waiting %.4f secs\n",
+             total->module[0] ? total->module : "<?>", total->instance, devid, total->kernels, total->kernel,
+             total->transfer, total->copy, total->wait);
+
+    char skernel[G_ASCII_DTOSTR_BUF_SIZE], stransfer[G_ASCII_DTOSTR_BUF_SIZE];
+    char scopy[G_ASCII_DTOSTR_BUF_SIZE], swait[G_ASCII_DTOSTR_BUF_SIZE];
+    g_ascii_formatd(skernel, sizeof(skernel), "%.6f", total->kernel);
+    g_ascii_formatd(stransfer, sizeof(stransfer), "%.6f", total->transfer);
+    g_ascii_formatd(scopy, sizeof(scopy), "%.6f", total->copy);
+    g_ascii_formatd(swait, sizeof(swait), "%.6f", total->wait);
+    gchar *line = g_strdup_printf(
+        "{\"opencl_summary\":true,\"module\":\"%s\",\"instance\":%d,\"device\":\"%s\",\"devid\":%d,"
+        "\"kernels\":%d,\"kernel_time\":%s,\"transfer_time\":%s,\"copy_time\":%s,\"wait_time\":%s}",
+        total->module, total->instance, device->name, devid, total->kernels, skernel, stransfer, scopy, swait);
+    dt_dev_pixelpipe_report_write(line);
+    g_free(line);
+  }
+
+  free(totals);
+}
+
 /** Wait for events in eventlist to terminate, check for return status and profiling
 info of events.
 If "reset" is TRUE report summary info (would be CL_COMPLETE or last error code) and
@@ -2997,6 +4033,13 @@ cl_int dt_opencl_events_flush(const int devid, const int reset)
       if(errs == CL_SUCCESS && erre == CL_SUCCESS)
       {
         (*eventtags)[k].timelapsed = end - start;
+        (*eventtags)[k].start = start;
+        (*eventtags)[k].end = end;
+        // queued and submitted are only needed for the waiting times, they may stay 0
+        (cl->dlocl->symbols->dt_clGetEventProfilingInfo)((*eventlist)[k], CL_PROFILING_COMMAND_QUEUED,
+                                                         sizeof(cl_ulong), &(*eventtags)[k].queued, NULL);
+        (cl->dlocl->symbols->dt_clGetEventProfilingInfo)((*eventlist)[k], CL_PROFILING_COMMAND_SUBMIT,
+                                                         sizeof(cl_ulong), &(*eventtags)[k].submit, NULL);
       }
       else
       {
@@ -3018,7 +4061,11 @@ cl_int dt_opencl_events_flush(const int devid, const int reset)
   if(reset)
   {
     // output profiling info if wanted
-    if(darktable.unmuted & DT_DEBUG_PERF) dt_opencl_events_profiling(devid, 1);
+    if(darktable.unmuted & DT_DEBUG_PERF)
+    {
+      dt_opencl_events_profiling(devid, 1);
+      _events_report(devid);
+    }
 
     // reset eventlist structures to empty state
     dt_opencl_events_reset(devid);
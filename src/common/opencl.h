@@ -30,6 +30,8 @@
 #define DT_OPENCL_MAX_EVENTS 256
 #define DT_OPENCL_MAX_ERRORS 5
 #define DT_OPENCL_MAX_INCLUDES 7
+#define DT_OPENCL_LOCK_CLASSES 4
+#define DT_OPENCL_POOL_SLOTS 16
 #define DT_OPENCL_VENDOR_AMD 4098
 #define DT_OPENCL_VENDOR_NVIDIA 4318
 #define DT_OPENCL_VENDOR_INTEL 0x8086u
@@ -38,6 +40,7 @@
 
 #ifdef HAVE_OPENCL
 
+#include "common/atomic.h"
 #include "common/dlopencl.h"
 #include "common/dtpthread.h"
 #include "common/iop_profile.h"
@@ -80,9 +83,66 @@ typedef struct dt_opencl_eventtag_t
   cl_int retval;
   cl_ulong timelapsed;
   char tag[DT_OPENCL_EVENTNAMELENGTH];
+  // profiling details with -d perf: the module the command was issued for, the launch
+  // geometry of kernels (global[0] == 0 for copies) and the timestamps of the event
+  const char *pipe;
+  char module[DT_OPENCL_EVENTNAMELENGTH];
+  int instance;
+  size_t global[2];
+  size_t local[2];
+  size_t max_local;
+  cl_ulong queued, submit, start, end;
 } dt_opencl_eventtag_t;
 
 
+/**
+ * a released image or buffer kept for reuse, see dt_opencl_release_mem_object().
+ * width is 0 for buffers.
+ */
+typedef struct dt_opencl_pool_entry_t
+{
+  cl_mem mem;
+  size_t size;
+  int width;
+  int height;
+  int bpp;
+  uint64_t stamp;
+} dt_opencl_pool_entry_t;
+
+/**
+ * programs not found in the binary cache are only built when one of their kernels
+ * is used for the first time, or by the background thread started in dt_opencl_init().
+ */
+typedef enum dt_opencl_program_state_t
+{
+  DT_OPENCL_PROGRAM_BUILT = 0,
+  DT_OPENCL_PROGRAM_PENDING,
+  DT_OPENCL_PROGRAM_FAILED
+} dt_opencl_program_state_t;
+
+#define DT_OPENCL_TUNE_CANDIDATES 7
+
+typedef enum dt_opencl_tuning_state_t
+{
+  DT_OPENCL_TUNING_NONE = 0,
+  DT_OPENCL_TUNING_RUNNING,
+  DT_OPENCL_TUNING_DONE
+} dt_opencl_tuning_state_t;
+
+/**
+ * local work sizes of a kernel enqueued without explicit ones. the first runs try a few
+ * candidates, the fastest is kept and stored in the kernel cache directory of the device.
+ */
+typedef struct dt_opencl_tuning_t
+{
+  dt_opencl_tuning_state_t state;
+  int step;
+  // best time per work item of every candidate, 0 if not measured, < 0 if not possible
+  float time[DT_OPENCL_TUNE_CANDIDATES];
+  // the result, 0 lets the driver choose
+  size_t local[2];
+} dt_opencl_tuning_t;
+
 /**
  * to support multi-gpu and mixed systems with cpu support,
  * we encapsulate devices and use separate command queues.
@@ -90,9 +150,13 @@ typedef struct dt_opencl_eventtag_t
 typedef struct dt_opencl_device_t
 {
   dt_pthread_mutex_t lock;
+  // pipes waiting for this device, per priority class. protected by dt_opencl_t.dev_wait_lock
+  int waiting[DT_OPENCL_LOCK_CLASSES];
   cl_device_id devid;
   cl_context context;
   cl_command_queue cmd_queue;
+  // second queue for uploads overlapping the kernels of cmd_queue, NULL if there is none
+  cl_command_queue transfer_queue;
   size_t max_image_width;
   size_t max_image_height;
   cl_ulong max_mem_alloc;
@@ -102,6 +166,17 @@ typedef struct dt_opencl_device_t
   cl_kernel kernel[DT_OPENCL_MAX_KERNELS];
   int program_used[DT_OPENCL_MAX_PROGRAMS];
   int kernel_used[DT_OPENCL_MAX_KERNELS];
+  // deferred program builds and the kernels waiting for them, protected by program_lock
+  dt_pthread_mutex_t program_lock;
+  dt_opencl_program_state_t program_state[DT_OPENCL_MAX_PROGRAMS];
+  char *program_binname[DT_OPENCL_MAX_PROGRAMS];
+  char program_md5[DT_OPENCL_MAX_PROGRAMS][33];
+  int kernel_program[DT_OPENCL_MAX_KERNELS];
+  char *kernel_name[DT_OPENCL_MAX_KERNELS];
+  char *cachedir;
+  // work group sizes per kernel, and the results of earlier sessions read from the cache directory
+  dt_opencl_tuning_t tuning[DT_OPENCL_MAX_KERNELS];
+  GHashTable *tuned;
   cl_event *eventlist;
   dt_opencl_eventtag_t *eventtags;
   int numevents;
@@ -121,6 +196,30 @@ typedef struct dt_opencl_device_t
   size_t memory_in_use;
   size_t peak_memory;
   size_t tuned_available;
+  // memory budget learned from how much the pipes really used and where allocations failed,
+  // see dt_opencl_get_device_available(). budget_base is the configured amount it started from.
+  size_t budget;
+  size_t budget_base;
+  size_t budget_ceiling;
+  size_t run_peak;
+  // highest use since dt_opencl_memory_measure_begin()
+  size_t module_peak;
+  int run_failures;
+  int alloc_failures;
+  // the device works on host memory (integrated gpus), images wrapping host buffers need no copies
+  int unified_memory;
+  cl_uint compute_units;
+  // module the next commands in the queue belong to, see dt_opencl_events_set_module()
+  const char *profile_pipe;
+  char profile_module[DT_OPENCL_EVENTNAMELENGTH];
+  int profile_instance;
+  // images and buffers released by one module and handed out again to the next one
+  dt_pthread_mutex_t pool_lock;
+  dt_opencl_pool_entry_t pool[DT_OPENCL_POOL_SLOTS];
+  size_t pool_size;
+  uint64_t pool_stamp;
+  uint64_t pool_hits;
+  uint64_t pool_misses;
 } dt_opencl_device_t;
 
 struct dt_bilateral_cl_global_t;
@@ -137,10 +236,25 @@ struct dt_guided_filter_cl_global_t;
 typedef struct dt_opencl_t
 {
   dt_pthread_mutex_t lock;
+  // pipes waiting for a device sleep here until dt_opencl_unlock_device() wakes them
+  dt_pthread_mutex_t dev_wait_lock;
+  pthread_cond_t dev_wait_cond;
   int inited;
   int avoid_atomics;
   int use_events;
   int async_pixelpipe;
+  int mem_pool;
+  int tune_work_groups;
+  int adaptive_memory;
+  // running seconds per megapixel of every module on every device (and the cpu, -1) from real pipe runs
+  int adaptive_scheduling;
+  dt_pthread_mutex_t throughput_lock;
+  GHashTable *throughput;
+  int throughput_explore;
+  // builds programs missing from the binary cache while darktable is already usable
+  pthread_t build_thread;
+  int build_thread_running;
+  dt_atomic_int build_quit;
   int number_event_handles;
   int print_statistics;
   dt_opencl_sync_cache_t sync_cache;
@@ -222,12 +336,39 @@ int dt_opencl_finish(const int devid);
 /** enqueues a synchronization point. */
 int dt_opencl_enqueue_barrier(const int devid);
 
+/** does the device have a second queue for uploads running next to the kernels? */
+gboolean dt_opencl_has_transfer_queue(const int devid);
+
+/** non-blocking upload on the transfer queue. host must stay untouched until the transfer completed.
+    event is to be passed to dt_opencl_wait_for_transfer() before the kernels using device. */
+int dt_opencl_write_host_to_device_async(const int devid, void *host, void *device, const size_t *origin,
+                                         const size_t *region, const int rowpitch, cl_event *event);
+
+/** let the commands enqueued next on the device's queue wait for an upload, releases event */
+int dt_opencl_wait_for_transfer(const int devid, cl_event *event);
+
+/** block until all uploads on the transfer queue are done */
+void dt_opencl_finish_transfers(const int devid);
+
 /** locks a device for your thread's exclusive use */
 int dt_opencl_lock_device(const int pipetype);
 
+/** try to get one specific device for additional work of a pipe, without waiting */
+int dt_opencl_trylock_device(const int devid, const int pipetype);
+
 /** done with your command queue. */
 void dt_opencl_unlock_device(const int dev);
 
+/** feed the per device (-1: cpu) and module throughput estimate with the time of a real run */
+void dt_opencl_throughput_record(const int devid, const char *op, const size_t pixels, const double seconds);
+
+/** estimated seconds per megapixel of op on devid (-1: cpu), 0 if not known yet */
+float dt_opencl_throughput_estimate(const int devid, const char *op);
+
+/** given the device locked for a pipe and the modules that could run on opencl, switch to a free
+    device, or to the cpu by returning -1, that ran them notably faster lately */
+int dt_opencl_rebalance_device(const int devid, const int pipetype, const char **ops, const int count);
+
 /** calculates md5sums for a list of CL include files. */
 void dt_opencl_md5sum(const char **files, char **md5sums);
 
@@ -368,6 +509,17 @@ int dt_opencl_get_mem_context_id(cl_mem mem);
 
 void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t action);
 
+/** measure the device memory allocated between begin and end on top of what was in use at begin. FALSE if the
+ * memory statistics aren't kept (neither adaptive memory nor -d opencl -d memory) */
+gboolean dt_opencl_memory_measure_begin(const int devid, size_t *base);
+size_t dt_opencl_memory_measure_end(const int devid, const size_t base);
+
+/** give the images and buffers kept for reuse on a device back to the driver */
+void dt_opencl_flush_pool(const int devid);
+
+/** check if the device shares its memory with the host */
+int dt_opencl_unified_memory(const int devid);
+
 /** check if image size fit into limits given by OpenCL runtime */
 gboolean dt_opencl_image_fits_device(const int devid, const size_t width, const size_t height, const unsigned bpp,
                                 const float factor, const size_t overhead);
@@ -400,6 +552,9 @@ cl_int dt_opencl_events_flush(const int devid, const int reset);
 /** display OpenCL profiling information. If summary is not 0, try to generate summarized info for kernels */
 void dt_opencl_events_profiling(const int devid, const int aggregated);
 
+/** attribute the commands enqueued next on the device to a module, for the -d perf report */
+void dt_opencl_events_set_module(const int devid, const char *pipe, const char *module, const int instance);
+
 /** utility function to calculate optimal work group dimensions for a given kernel */
 int dt_opencl_local_buffer_opt(const int devid, const int kernel, dt_opencl_local_buffer_t *factors);
 
@@ -437,9 +592,26 @@ static inline int dt_opencl_lock_device(const int dev)
 {
   return -1;
 }
+static inline int dt_opencl_trylock_device(const int devid, const int pipetype)
+{
+  return 0;
+}
 static inline void dt_opencl_unlock_device(const int dev)
 {
 }
+static inline void dt_opencl_throughput_record(const int devid, const char *op, const size_t pixels,
+                                               const double seconds)
+{
+}
+static inline float dt_opencl_throughput_estimate(const int devid, const char *op)
+{
+  return 0.0f;
+}
+static inline int dt_opencl_rebalance_device(const int devid, const int pipetype, const char **ops,
+                                             const int count)
+{
+  return devid;
+}
 static inline int dt_opencl_load_program(const int dev, const char *filename)
 {
   return -1;
@@ -514,6 +686,13 @@ static inline size_t dt_opencl_get_device_memalloc(const int devid)
 {
   return 0;
 }
+static inline void dt_opencl_flush_pool(const int devid)
+{
+}
+static inline int dt_opencl_unified_memory(const int devid)
+{
+  return 0;
+}
 static inline void dt_opencl_release_mem_object(void *mem)
 {
 }
@@ -534,6 +713,10 @@ static inline int dt_opencl_events_flush(const int devid, const int reset)
 static inline void dt_opencl_events_profiling(const int devid, const int aggregated)
 {
 }
+static inline void dt_opencl_events_set_module(const int devid, const char *pipe, const char *module,
+                                               const int instance)
+{
+}
 #endif
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -31,6 +31,7 @@
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
+#include <float.h>
 #include <glib.h>
 #include <inttypes.h>
 #include <sqlite3.h>
@@ -313,6 +314,302 @@ gboolean dt_presets_module_can_autoapply(const gchar *operation)
   }
   return TRUE;
 }
+
+/* auto-apply presets, read into memory so they can be matched against each image without scanning the presets
+ * table. temporary triggers bump _autoapply_stamp on any change to the tables, whichever code writes them, and the
+ * rules are read again the next time they are needed. */
+
+typedef struct _autoapply_rule_t
+{
+  dt_presets_autoapply_t preset;
+  // the filter, case folded patterns are NULL if the preset can't be matched by them
+  gboolean filter;
+  gchar *model, *maker, *lens;
+  double iso_min, iso_max;
+  double exposure_min, exposure_max;
+  double aperture_min, aperture_max;
+  double focal_length_min, focal_length_max;
+  int format;
+} _autoapply_rule_t;
+
+static GMutex _autoapply_lock;
+static GPtrArray *_autoapply_rules[2] = { NULL, NULL }; // data.presets and main.legacy_presets
+static gint _autoapply_stamp = 1;
+static gint _autoapply_loaded = 0;
+static gboolean _autoapply_triggers = FALSE;
+
+static void _autoapply_changed_sql(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+  g_atomic_int_inc(&_autoapply_stamp);
+  sqlite3_result_null(context);
+}
+
+static void _autoapply_preset_clear(dt_presets_autoapply_t *preset)
+{
+  g_free(preset->name);
+  g_free(preset->operation);
+  g_free(preset->op_params);
+  g_free(preset->blendop_params);
+  g_free(preset->multi_name);
+}
+
+static void _autoapply_rule_free(gpointer data)
+{
+  _autoapply_rule_t *rule = (_autoapply_rule_t *)data;
+  _autoapply_preset_clear(&rule->preset);
+  g_free(rule->model);
+  g_free(rule->maker);
+  g_free(rule->lens);
+  g_free(rule);
+}
+
+static void _autoapply_free(gpointer data)
+{
+  dt_presets_autoapply_t *preset = (dt_presets_autoapply_t *)data;
+  _autoapply_preset_clear(preset);
+  g_free(preset);
+}
+
+static gchar *_column_casefold(sqlite3_stmt *stmt, const int col)
+{
+  const char *text = (const char *)sqlite3_column_text(stmt, col);
+  return text ? g_utf8_casefold(text, -1) : NULL;
+}
+
+static double _column_double(sqlite3_stmt *stmt, const int col)
+{
+  // a NULL bound never matches
+  return sqlite3_column_type(stmt, col) == SQLITE_NULL ? NAN : sqlite3_column_double(stmt, col);
+}
+
+static void *_autoapply_memdup(const void *data, const int size)
+{
+  if(!data || size <= 0) return NULL;
+  void *copy = g_malloc(size);
+  memcpy(copy, data, size);
+  return copy;
+}
+
+static void *_column_blob(sqlite3_stmt *stmt, const int col, int *size)
+{
+  const void *blob = sqlite3_column_blob(stmt, col);
+  *size = blob ? sqlite3_column_bytes(stmt, col) : 0;
+  return _autoapply_memdup(blob, *size);
+}
+
+static GPtrArray *_autoapply_read(const char *table)
+{
+  GPtrArray *rules = g_ptr_array_new_with_free_func(_autoapply_rule_free);
+
+  // same order the presets are applied in, later ones replace the earlier ones of the same operation.
+  // the names are the workflow presets of _dev_auto_apply_presets() which are applied whatever their filter.
+  gchar *query = g_strdup_printf("SELECT name, operation, op_version, op_params, enabled, blendop_params,"
+                                 "       blendop_version, multi_priority, multi_name, autoapply, model, maker,"
+                                 "       lens, iso_min, iso_max, exposure_min, exposure_max, aperture_min,"
+                                 "       aperture_max, focal_length_min, focal_length_max, format"
+                                 " FROM %s"
+                                 " WHERE autoapply = 1 OR name IN (?1, ?2)"
+                                 " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens), rowid",
+                                 table);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, _("display-referred default"), -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, _("scene-referred default"), -1, SQLITE_TRANSIENT);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    _autoapply_rule_t *rule = g_new0(_autoapply_rule_t, 1);
+    dt_presets_autoapply_t *preset = &rule->preset;
+
+    preset->name = g_strdup((const char *)sqlite3_column_text(stmt, 0));
+    preset->operation = g_strdup((const char *)sqlite3_column_text(stmt, 1));
+    preset->op_version = sqlite3_column_int(stmt, 2);
+    preset->op_params = _column_blob(stmt, 3, &preset->op_params_size);
+    preset->enabled = sqlite3_column_int(stmt, 4);
+    preset->blendop_params = _column_blob(stmt, 5, &preset->blendop_params_size);
+    preset->blendop_version = sqlite3_column_int(stmt, 6);
+    preset->multi_priority = sqlite3_column_int(stmt, 7);
+    preset->multi_name = g_strdup((const char *)sqlite3_column_text(stmt, 8));
+
+    rule->filter = sqlite3_column_int(stmt, 9) == 1 && sqlite3_column_type(stmt, 21) != SQLITE_NULL;
+    rule->model = _column_casefold(stmt, 10);
+    rule->maker = _column_casefold(stmt, 11);
+    rule->lens = _column_casefold(stmt, 12);
+    rule->iso_min = _column_double(stmt, 13);
+    rule->iso_max = _column_double(stmt, 14);
+    rule->exposure_min = _column_double(stmt, 15);
+    rule->exposure_max = _column_double(stmt, 16);
+    rule->aperture_min = _column_double(stmt, 17);
+    rule->aperture_max = _column_double(stmt, 18);
+    rule->focal_length_min = _column_double(stmt, 19);
+    rule->focal_length_max = _column_double(stmt, 20);
+    rule->format = sqlite3_column_int(stmt, 21);
+
+    g_ptr_array_add(rules, rule);
+  }
+  sqlite3_finalize(stmt);
+  g_free(query);
+
+  return rules;
+}
+
+// call with _autoapply_lock held
+static void _autoapply_refresh(void)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+
+  if(!_autoapply_triggers)
+  {
+    sqlite3_create_function(db, "dt_presets_autoapply_changed", 0, SQLITE_UTF8, NULL, _autoapply_changed_sql,
+                            NULL, NULL);
+    const char *tables[2] = { "data.presets", "main.legacy_presets" };
+    const char *events[3] = { "INSERT", "UPDATE", "DELETE" };
+    for(int t = 0; t < 2; t++)
+      for(int e = 0; e < 3; e++)
+      {
+        gchar *query = g_strdup_printf("CREATE TEMP TRIGGER IF NOT EXISTS presets_autoapply_%s_%s"
+                                       " AFTER %s ON %s"
+                                       " BEGIN SELECT dt_presets_autoapply_changed(); END",
+                                       t ? "legacy" : "data", events[e], events[e], tables[t]);
+        sqlite3_exec(db, query, NULL, NULL, NULL);
+        g_free(query);
+      }
+    _autoapply_triggers = TRUE;
+  }
+
+  const gint stamp = g_atomic_int_get(&_autoapply_stamp);
+  if(stamp == _autoapply_loaded) return;
+
+  for(int t = 0; t < 2; t++)
+    if(_autoapply_rules[t]) g_ptr_array_unref(_autoapply_rules[t]);
+  _autoapply_rules[0] = _autoapply_read("data.presets");
+  _autoapply_rules[1] = _autoapply_read("main.legacy_presets");
+  _autoapply_loaded = stamp;
+
+  dt_print(DT_DEBUG_SQL, "[presets] read %u auto-apply presets and %u legacy ones\n",
+           _autoapply_rules[0]->len, _autoapply_rules[1]->len);
+}
+
+// str LIKE pattern, both case folded: % matches any sequence of characters and _ any character
+static gboolean _autoapply_like(const char *str, const char *pattern)
+{
+  if(!pattern) return FALSE;
+
+  while(*pattern)
+  {
+    if(*pattern == '%')
+    {
+      while(*pattern == '%' || *pattern == '_')
+      {
+        if(*pattern == '_')
+        {
+          if(!*str) return FALSE;
+          str = g_utf8_next_char(str);
+        }
+        pattern++;
+      }
+      if(!*pattern) return TRUE;
+
+      for(; *str; str = g_utf8_next_char(str))
+        if(_autoapply_like(str, pattern)) return TRUE;
+      return FALSE;
+    }
+
+    if(!*str) return FALSE;
+
+    const char *next_str = g_utf8_next_char(str);
+    const char *next_pattern = g_utf8_next_char(pattern);
+    if(*pattern != '_'
+       && (next_str - str != next_pattern - pattern || memcmp(str, pattern, next_str - str)))
+      return FALSE;
+
+    str = next_str;
+    pattern = next_pattern;
+  }
+
+  return *str == '\0';
+}
+
+static gboolean _autoapply_between(const double value, const double min, const double max)
+{
+  return value >= min && value <= max;
+}
+
+GList *dt_presets_autoapply_get(const dt_image_t *image, const gboolean legacy, const char *workflow_preset,
+                                const int iformat, const int excluded)
+{
+  gchar *model = g_utf8_casefold(image->exif_model, -1);
+  gchar *maker = g_utf8_casefold(image->exif_maker, -1);
+  gchar *alias = g_utf8_casefold(image->camera_alias, -1);
+  gchar *camera_maker = g_utf8_casefold(image->camera_maker, -1);
+  gchar *lens = g_utf8_casefold(image->exif_lens, -1);
+  const double iso = fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso));
+  const double exposure = fmaxf(0.0f, fminf(1000000, image->exif_exposure));
+  const double aperture = fmaxf(0.0f, fminf(1000000, image->exif_aperture));
+  const double focal_length = fmaxf(0.0f, fminf(1000000, image->exif_focal_length));
+
+  GList *presets = NULL;
+
+  g_mutex_lock(&_autoapply_lock);
+  _autoapply_refresh();
+
+  const GPtrArray *rules = _autoapply_rules[legacy ? 1 : 0];
+  for(guint i = 0; i < rules->len; i++)
+  {
+    const _autoapply_rule_t *rule = (_autoapply_rule_t *)g_ptr_array_index(rules, i);
+
+    const gboolean by_name = workflow_preset && rule->preset.name && !strcmp(rule->preset.name, workflow_preset);
+    const gboolean by_filter
+        = rule->filter
+          && ((_autoapply_like(model, rule->model) && _autoapply_like(maker, rule->maker))
+              || (_autoapply_like(alias, rule->model) && _autoapply_like(camera_maker, rule->maker)))
+          && _autoapply_like(lens, rule->lens)
+          && _autoapply_between(iso, rule->iso_min, rule->iso_max)
+          && _autoapply_between(exposure, rule->exposure_min, rule->exposure_max)
+          && _autoapply_between(aperture, rule->aperture_min, rule->aperture_max)
+          && _autoapply_between(focal_length, rule->focal_length_min, rule->focal_length_max)
+          && (rule->format == 0 || ((rule->format & iformat) != 0 && (~rule->format & excluded) != 0));
+
+    if(!by_name && !by_filter) continue;
+
+    const dt_presets_autoapply_t *src = &rule->preset;
+    dt_presets_autoapply_t *preset = g_new0(dt_presets_autoapply_t, 1);
+    *preset = *src;
+    preset->name = g_strdup(src->name);
+    preset->operation = g_strdup(src->operation);
+    preset->op_params = _autoapply_memdup(src->op_params, src->op_params_size);
+    preset->blendop_params = _autoapply_memdup(src->blendop_params, src->blendop_params_size);
+    preset->multi_name = g_strdup(src->multi_name);
+    presets = g_list_prepend(presets, preset);
+  }
+
+  g_mutex_unlock(&_autoapply_lock);
+
+  g_free(model);
+  g_free(maker);
+  g_free(alias);
+  g_free(camera_maker);
+  g_free(lens);
+
+  return g_list_reverse(presets);
+}
+
+void dt_presets_autoapply_free(GList *presets)
+{
+  g_list_free_full(presets, _autoapply_free);
+}
+
+void dt_presets_autoapply_cleanup(void)
+{
+  g_mutex_lock(&_autoapply_lock);
+  for(int t = 0; t < 2; t++)
+  {
+    if(_autoapply_rules[t]) g_ptr_array_unref(_autoapply_rules[t]);
+    _autoapply_rules[t] = NULL;
+  }
+  _autoapply_loaded = 0;
+  g_mutex_unlock(&_autoapply_lock);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
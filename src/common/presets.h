@@ -19,6 +19,7 @@
 #pragma once
 
 #include "common/darktable.h"
+#include "common/image.h"
 
 /** save preset to file */
 void dt_presets_save_to_file(const int rowid, const char *preset_name, const char *filedir);
@@ -28,6 +29,33 @@ int dt_presets_import_from_file(const char *preset_path);
 
 // does the module support autoapplying presets ?
 gboolean dt_presets_module_can_autoapply(const gchar *operation);
+
+/** a preset auto-applied to an image */
+typedef struct dt_presets_autoapply_t
+{
+  gchar *name;
+  gchar *operation;
+  int op_version;
+  void *op_params;
+  int op_params_size;
+  int enabled;
+  void *blendop_params;
+  int blendop_params_size;
+  int blendop_version;
+  int multi_priority;
+  gchar *multi_name;
+} dt_presets_autoapply_t;
+
+/** the presets auto-applied to image, in the order they have to be applied. they are matched in memory against
+ * the auto-apply presets of data.presets, or main.legacy_presets if legacy is set, which are read once and again
+ * each time the table changes. presets named workflow_preset are included whatever their filter. iformat and
+ * excluded are the FOR_* flags of the image. free the list with dt_presets_autoapply_free(). */
+GList *dt_presets_autoapply_get(const dt_image_t *image, const gboolean legacy, const char *workflow_preset,
+                                const int iformat, const int excluded);
+void dt_presets_autoapply_free(GList *presets);
+/** frees the auto-apply presets read by dt_presets_autoapply_get() */
+void dt_presets_autoapply_cleanup(void);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
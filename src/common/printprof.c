@@ -38,6 +38,46 @@ static cmsUInt32Number ComputeFormatDescriptor (int OutColorSpace, int bps)
   return (FLOAT_SH(IsFlt)|COLORSPACE_SH(OutColorSpace)|PLANAR_SH(IsPlanar)|CHANNELS_SH(Channels)|BYTES_SH(bps));
 }
 
+// building the transform bakes the profiles into a lut, which costs more than applying it to a print.
+// the one of the last print is kept for the next with the same profiles. prints run one at a time in the
+// export queue, so it isn't replaced while in use.
+static struct
+{
+  GMutex lock;
+  cmsHPROFILE in, out;
+  cmsUInt32Number input, output;
+  int intent;
+  gboolean black_point_compensation;
+  cmsHTRANSFORM transform;
+} _transform_cache = { 0 };
+
+static cmsHTRANSFORM _get_transform(cmsHPROFILE hInProfile, cmsUInt32Number wInput, cmsHPROFILE hOutProfile,
+                                    cmsUInt32Number wOutput, int intent, gboolean black_point_compensation)
+{
+  g_mutex_lock(&_transform_cache.lock);
+  if(!_transform_cache.transform || _transform_cache.in != hInProfile || _transform_cache.out != hOutProfile
+     || _transform_cache.input != wInput || _transform_cache.output != wOutput
+     || _transform_cache.intent != intent
+     || _transform_cache.black_point_compensation != black_point_compensation)
+  {
+    if(_transform_cache.transform) cmsDeleteTransform(_transform_cache.transform);
+    _transform_cache.transform = cmsCreateTransform
+      (hInProfile,  wInput,
+       hOutProfile, wOutput,
+       intent,
+       black_point_compensation ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0);
+    _transform_cache.in = hInProfile;
+    _transform_cache.out = hOutProfile;
+    _transform_cache.input = wInput;
+    _transform_cache.output = wOutput;
+    _transform_cache.intent = intent;
+    _transform_cache.black_point_compensation = black_point_compensation;
+  }
+  cmsHTRANSFORM hTransform = _transform_cache.transform;
+  g_mutex_unlock(&_transform_cache.lock);
+  return hTransform;
+}
+
 int dt_apply_printer_profile(void **in, uint32_t width, uint32_t height, int bpp, cmsHPROFILE hInProfile,
                              cmsHPROFILE hOutProfile, int intent, gboolean black_point_compensation)
 {
@@ -53,11 +93,7 @@ int dt_apply_printer_profile(void **in, uint32_t width, uint32_t height, int bpp
   OutputColorSpace = _cmsLCMScolorSpace(cmsGetColorSpace(hOutProfile));
   wOutput = ComputeOutputFormatDescriptor(wInput, OutputColorSpace, 1);
 
-  hTransform = cmsCreateTransform
-    (hInProfile,  wInput,
-     hOutProfile, wOutput,
-     intent,
-     black_point_compensation ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0);
+  hTransform = _get_transform(hInProfile, wInput, hOutProfile, wOutput, intent, black_point_compensation);
 
   if (!hTransform)
   {
@@ -90,8 +126,6 @@ int dt_apply_printer_profile(void **in, uint32_t width, uint32_t height, int bpp
       cmsDoTransform(hTransform, (const void *)&ptr_in[k*width*3], (void *)&ptr_out[k*width*3], width);
   }
 
-  cmsDeleteTransform(hTransform);
-
   free(*in);
   *in = out;
 
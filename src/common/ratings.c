@@ -93,12 +93,14 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 {
   if(type == DT_UNDO_RATINGS)
   {
+    dt_database_batch_begin(darktable.db);
     for(GList *list = (GList *)data; list; list = g_list_next(list))
     {
       dt_undo_ratings_t *ratings = (dt_undo_ratings_t *)list->data;
       _ratings_apply_to_image(ratings->imgid, (action == DT_ACTION_UNDO) ? ratings->before : ratings->after);
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(ratings->imgid));
     }
+    dt_database_batch_commit(darktable.db);
     dt_collection_hint_message(darktable.collection);
   }
 }
@@ -111,6 +113,8 @@ static void _ratings_undo_data_free(gpointer data)
 
 static void _ratings_apply(const GList *imgs, const int rating, GList **undo, const gboolean undo_on)
 {
+  // one transaction for all, the sidecars follow in the background
+  dt_database_batch_begin(darktable.db);
   for(const GList *images = imgs; images; images = g_list_next(images))
   {
     const int image_id = GPOINTER_TO_INT(images->data);
@@ -121,7 +125,7 @@ static void _ratings_apply(const GList *imgs, const int rating, GList **undo, co
       undoratings->imgid = image_id;
       undoratings->before = old_rating;
       undoratings->after = rating;
-      *undo = g_list_append(*undo, undoratings);
+      *undo = g_list_prepend(*undo, undoratings);
     }
 
     int new_rating = rating;
@@ -134,6 +138,8 @@ static void _ratings_apply(const GList *imgs, const int rating, GList **undo, co
 
     _ratings_apply_to_image(image_id, new_rating);
   }
+  dt_database_batch_commit(darktable.db);
+  if(undo_on) *undo = g_list_reverse(*undo);
 }
 
 void dt_ratings_apply_on_list(const GList *img, const int rating, const gboolean undo_on)
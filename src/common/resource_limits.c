@@ -16,17 +16,28 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // for sched_setaffinity() and the CPU_* macros
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 #include "common/resource_limits.h"
+#include "common/darktable.h"
+#include "common/image_cache.h"
+#include "common/mipmap_cache.h"
+#include "common/opencl.h"
+#include "control/conf.h"
 #include <assert.h>       // for assert
 #include <errno.h>        // for errno
 #include <stdint.h>       // for uintmax_t
 #include <stdio.h>        // for fprintf, stderr
 #include <string.h>       // for strerror
 #include <inttypes.h>
+#include <math.h>
+#include <glib/gstdio.h>
 
 #ifdef _WIN32
 #include "win/rlimit.h"
@@ -34,6 +45,14 @@
 #include <sys/resource.h> // for rlimit, RLIMIT_STACK, getrlimit, setrlimit
 #endif //_WIN32
 
+#ifdef __APPLE__
+#include <sys/sysctl.h>   // for sysctlbyname
+#endif
+
+#ifdef __linux__
+#include <sched.h>        // for sched_setaffinity
+#endif
+
 static void dt_set_rlimits_stack()
 {
   // make sure that stack/frame limits are good (musl)
@@ -77,6 +96,372 @@ void dt_set_rlimits()
   dt_set_rlimits_stack();
 }
 
+// seconds between two looks at the memory pressure
+#define DT_MEMORY_PRESSURE_INTERVAL 2
+// under full pressure caches are cut down to that fraction of their configured size
+#define DT_MEMORY_PRESSURE_MIN_FACTOR 0.25
+// and grow back by that much per interval once the pressure is gone
+#define DT_MEMORY_PRESSURE_GROW 0.05
+
+typedef struct dt_memory_pressure_t
+{
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  gboolean running;
+
+  // quotas as configured at init, the ones in use are scaled from these
+  size_t image_quota;
+  size_t thumbs_quota;
+  size_t full_quota;
+  size_t f_quota;
+  double factor;
+} dt_memory_pressure_t;
+
+static dt_memory_pressure_t _pressure = { 0 };
+
+#ifdef __linux__
+// share of time some task was stalled on memory over the last 10s, from a PSI file
+static double _psi_some_avg10(const char *path)
+{
+  FILE *f = g_fopen(path, "r");
+  if(!f) return -1.0;
+  double avg10 = -1.0;
+  char line[256];
+  while(fgets(line, sizeof(line), f))
+  {
+    if(!strncmp(line, "some ", 5))
+    {
+      const char *p = strstr(line, "avg10=");
+      if(p) avg10 = g_ascii_strtod(p + 6, NULL);
+      break;
+    }
+  }
+  fclose(f);
+  return avg10;
+}
+
+static gboolean _read_uint64(const char *path, uint64_t *value)
+{
+  gchar *content = NULL;
+  if(!g_file_get_contents(path, &content, NULL, NULL)) return FALSE;
+  // memory.high is "max" when not set
+  const gboolean ok = g_ascii_isdigit(content[0]);
+  if(ok) *value = g_ascii_strtoull(content, NULL, 10);
+  g_free(content);
+  return ok;
+}
+
+// directory of our cgroup v2, NULL if not on the unified hierarchy
+static gchar *_cgroup_dir()
+{
+  gchar *content = NULL;
+  if(!g_file_get_contents("/proc/self/cgroup", &content, NULL, NULL)) return NULL;
+  gchar *dir = NULL;
+  gchar **lines = g_strsplit(content, "\n", -1);
+  for(gchar **l = lines; *l; l++)
+  {
+    if(g_str_has_prefix(*l, "0::"))
+    {
+      dir = g_build_filename("/sys/fs/cgroup", *l + 3, NULL);
+      break;
+    }
+  }
+  g_strfreev(lines);
+  g_free(content);
+  return dir;
+}
+#endif
+
+// current memory pressure, from 0 (none) to 1 (caches should be as small as possible)
+static double _memory_pressure(const char *cgroup)
+{
+  double pressure = 0.0;
+#ifdef __linux__
+  // stall time: 10% of the time waiting for memory is already bad, 20% is as bad as it gets
+  double avg10 = -1.0;
+  if(cgroup)
+  {
+    gchar *path = g_build_filename(cgroup, "memory.pressure", NULL);
+    avg10 = _psi_some_avg10(path);
+    g_free(path);
+  }
+  if(avg10 < 0.0) avg10 = _psi_some_avg10("/proc/pressure/memory");
+  if(avg10 > 0.0) pressure = MAX(pressure, CLAMP((avg10 - 2.0) / 18.0, 0.0, 1.0));
+
+  // getting close to memory.high means the kernel will soon throttle and reclaim from us
+  if(cgroup)
+  {
+    uint64_t current = 0, high = 0;
+    gchar *path_current = g_build_filename(cgroup, "memory.current", NULL);
+    gchar *path_high = g_build_filename(cgroup, "memory.high", NULL);
+    if(_read_uint64(path_current, &current) && _read_uint64(path_high, &high) && high > 0)
+      pressure = MAX(pressure, CLAMP(((double)current / high - 0.85) / 0.15, 0.0, 1.0));
+    g_free(path_current);
+    g_free(path_high);
+  }
+#elif defined(__APPLE__)
+  // 1: normal, 2: warning, 4: critical
+  int level = 0;
+  size_t len = sizeof(level);
+  if(!sysctlbyname("kern.memorystatus_vm_pressure_level", &level, &len, NULL, 0))
+    pressure = level >= 4 ? 1.0 : level >= 2 ? 0.5 : 0.0;
+#else
+  (void)cgroup;
+#endif
+  return pressure;
+}
+
+static void _memory_pressure_apply(const double factor)
+{
+  dt_mipmap_cache_t *mipmap = darktable.mipmap_cache;
+  dt_image_cache_t *image = darktable.image_cache;
+  const gboolean shrink = factor < _pressure.factor;
+  _pressure.factor = factor;
+
+  image->cache.cost_quota = _pressure.image_quota * factor;
+  mipmap->mip_thumbs.cache.cost_quota = _pressure.thumbs_quota * factor;
+  // these two count buffers, keep enough for the darkroom pipes
+  mipmap->mip_full.cache.cost_quota = MAX(2, _pressure.full_quota * factor);
+  mipmap->mip_f.cache.cost_quota = MAX(2, _pressure.f_quota * factor);
+
+  if(shrink)
+  {
+    dt_cache_gc(&image->cache, 1.0f);
+    dt_cache_gc(&mipmap->mip_thumbs.cache, 1.0f);
+    dt_cache_gc(&mipmap->mip_full.cache, 1.0f);
+    dt_cache_gc(&mipmap->mip_f.cache, 1.0f);
+  }
+
+  dt_print(DT_DEBUG_MEMORY, "[memory pressure] caches at %.0f%% of their size, thumbnails %.0fMB\n",
+           100.0 * factor, mipmap->mip_thumbs.cache.cost_quota / (1024.0 * 1024.0));
+}
+
+static gpointer _memory_pressure_thread(gpointer data)
+{
+  gchar *cgroup = NULL;
+#ifdef __linux__
+  cgroup = _cgroup_dir();
+#endif
+  g_mutex_lock(&_pressure.lock);
+  while(_pressure.running)
+  {
+    const gint64 until = g_get_monotonic_time() + DT_MEMORY_PRESSURE_INTERVAL * G_TIME_SPAN_SECOND;
+    if(g_cond_wait_until(&_pressure.cond, &_pressure.lock, until) || !_pressure.running) continue;
+
+    // shrink right away, grow back slowly so we don't bounce
+    const double target = 1.0 - (1.0 - DT_MEMORY_PRESSURE_MIN_FACTOR) * _memory_pressure(cgroup);
+    const double factor = target < _pressure.factor
+                              ? target
+                              : MIN(target, _pressure.factor + DT_MEMORY_PRESSURE_GROW);
+    if(fabs(factor - _pressure.factor) >= 0.02 || (factor == 1.0 && _pressure.factor != 1.0))
+      _memory_pressure_apply(factor);
+  }
+  g_mutex_unlock(&_pressure.lock);
+  g_free(cgroup);
+  return NULL;
+}
+
+void dt_memory_pressure_start()
+{
+  if(_pressure.thread || !dt_conf_get_bool("memory_pressure_monitor")) return;
+
+  _pressure.image_quota = darktable.image_cache->cache.cost_quota;
+  _pressure.thumbs_quota = darktable.mipmap_cache->mip_thumbs.cache.cost_quota;
+  _pressure.full_quota = darktable.mipmap_cache->mip_full.cache.cost_quota;
+  _pressure.f_quota = darktable.mipmap_cache->mip_f.cache.cost_quota;
+  _pressure.factor = 1.0;
+  _pressure.running = TRUE;
+  g_mutex_init(&_pressure.lock);
+  g_cond_init(&_pressure.cond);
+  _pressure.thread = g_thread_new("memory-pressure", _memory_pressure_thread, NULL);
+}
+
+void dt_memory_pressure_stop()
+{
+  if(!_pressure.thread) return;
+
+  g_mutex_lock(&_pressure.lock);
+  _pressure.running = FALSE;
+  g_cond_signal(&_pressure.cond);
+  g_mutex_unlock(&_pressure.lock);
+  g_thread_join(_pressure.thread);
+  _pressure.thread = NULL;
+  g_cond_clear(&_pressure.cond);
+  g_mutex_clear(&_pressure.lock);
+}
+
+size_t dt_jobs_memory_budget()
+{
+  // the factor is only written by the monitor thread, a stale read is harmless here
+  const double factor = _pressure.thread ? _pressure.factor : 1.0;
+  return dt_get_available_mem() * factor;
+}
+
+size_t dt_jobs_gpu_budget()
+{
+  size_t budget = 0;
+#ifdef HAVE_OPENCL
+  if(darktable.opencl && darktable.opencl->inited && darktable.opencl->enabled)
+    for(int k = 0; k < darktable.opencl->num_devs; k++) budget += dt_opencl_get_device_available(k);
+#endif
+  return budget;
+}
+
+#define DT_MEMORY_BUDGET_FLOOR (512lu * 1024lu * 1024lu)
+
+typedef struct _memory_claim_t
+{
+  char name[64];
+  size_t bytes;
+} _memory_claim_t;
+
+static struct
+{
+  GMutex lock;
+  GCond released;
+  GHashTable *claims; // owner -> _memory_claim_t
+  size_t held;        // sum of all claims
+} _governor;
+
+void dt_memory_budget_claim(const void *owner, const char *name, const size_t bytes)
+{
+  g_mutex_lock(&_governor.lock);
+  if(!_governor.claims) _governor.claims = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  _memory_claim_t *claim = g_hash_table_lookup(_governor.claims, owner);
+  const size_t before = claim ? claim->bytes : 0;
+  if(!bytes)
+    g_hash_table_remove(_governor.claims, owner);
+  else
+  {
+    if(!claim)
+    {
+      claim = g_new0(_memory_claim_t, 1);
+      g_hash_table_insert(_governor.claims, (gpointer)owner, claim);
+    }
+    g_strlcpy(claim->name, name ? name : "", sizeof(claim->name));
+    claim->bytes = bytes;
+  }
+  _governor.held = _governor.held - before + bytes;
+  if(bytes < before) g_cond_broadcast(&_governor.released);
+  g_mutex_unlock(&_governor.lock);
+}
+
+// call with the lock held
+static size_t _memory_budget_others(const void *owner)
+{
+  const _memory_claim_t *claim = _governor.claims ? g_hash_table_lookup(_governor.claims, owner) : NULL;
+  return _governor.held - (claim ? claim->bytes : 0);
+}
+
+size_t dt_memory_budget_available(const void *owner)
+{
+  const size_t budget = dt_jobs_memory_budget();
+  g_mutex_lock(&_governor.lock);
+  const size_t others = _memory_budget_others(owner);
+  g_mutex_unlock(&_governor.lock);
+  return MAX(DT_MEMORY_BUDGET_FLOOR, budget > others ? budget - others : 0);
+}
+
+gboolean dt_memory_budget_wait(const void *owner, const size_t bytes, const double timeout)
+{
+  const gint64 until = g_get_monotonic_time() + timeout * G_TIME_SPAN_SECOND;
+  g_mutex_lock(&_governor.lock);
+  gboolean fits = FALSE;
+  while(!(fits = _memory_budget_others(owner) + bytes <= dt_jobs_memory_budget()))
+    if(!g_cond_wait_until(&_governor.released, &_governor.lock, until)) break;
+  // the budget may have grown meanwhile
+  fits = fits || _memory_budget_others(owner) + bytes <= dt_jobs_memory_budget();
+  g_mutex_unlock(&_governor.lock);
+  return fits;
+}
+
+void dt_memory_budget_report()
+{
+  if(!(darktable.unmuted & DT_DEBUG_MEMORY)) return;
+
+  g_mutex_lock(&_governor.lock);
+  fprintf(stderr, "[memory budget] %luMB of %luMB held\n", _governor.held / 1024lu / 1024lu,
+          dt_jobs_memory_budget() / 1024lu / 1024lu);
+  if(_governor.claims)
+  {
+    GHashTableIter iter;
+    gpointer owner, value;
+    g_hash_table_iter_init(&iter, _governor.claims);
+    while(g_hash_table_iter_next(&iter, &owner, &value))
+    {
+      const _memory_claim_t *claim = (const _memory_claim_t *)value;
+      fprintf(stderr, "  %-24s %p %8luMB\n", claim->name, owner, claim->bytes / 1024lu / 1024lu);
+    }
+  }
+  g_mutex_unlock(&_governor.lock);
+
+  // the caches have budgets of their own
+  const dt_mipmap_cache_t *mipmap = darktable.mipmap_cache;
+  if(mipmap)
+  {
+    fprintf(stderr, "  %-24s %8luMB of %luMB\n", "thumbnail cache", mipmap->mip_thumbs.cache.cost / 1024lu / 1024lu,
+            mipmap->mip_thumbs.cache.cost_quota / 1024lu / 1024lu);
+    fprintf(stderr, "  %-24s %8lu of %lu buffers\n", "full buffers", mipmap->mip_full.cache.cost,
+            mipmap->mip_full.cache.cost_quota);
+    fprintf(stderr, "  %-24s %8lu of %lu buffers\n", "downscaled buffers", mipmap->mip_f.cache.cost,
+            mipmap->mip_f.cache.cost_quota);
+  }
+}
+
+int dt_numa_nodes()
+{
+  int nodes = 0;
+#ifdef __linux__
+  while(TRUE)
+  {
+    gchar *path = g_strdup_printf("/sys/devices/system/node/node%d", nodes);
+    const gboolean exists = g_file_test(path, G_FILE_TEST_IS_DIR);
+    g_free(path);
+    if(!exists) break;
+    nodes++;
+  }
+#endif
+  return MAX(1, nodes);
+}
+
+int dt_numa_bind_thread(const int node)
+{
+#ifdef __linux__
+  gchar *path = g_strdup_printf("/sys/devices/system/node/node%d/cpulist", node);
+  gchar *cpulist = NULL;
+  const gboolean read = g_file_get_contents(path, &cpulist, NULL, NULL);
+  g_free(path);
+  if(!read) return 0;
+
+  // the list looks like "0-7,16-23"
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  gchar **ranges = g_strsplit(g_strstrip(cpulist), ",", -1);
+  for(gchar **range = ranges; *range; range++)
+  {
+    int first, last;
+    const int n = sscanf(*range, "%d-%d", &first, &last);
+    if(n < 1) continue;
+    if(n == 1) last = first;
+    for(int cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &cpus);
+  }
+  g_strfreev(ranges);
+  g_free(cpulist);
+
+  // stay within what we were allowed to run on in the first place (taskset, cgroups)
+  cpu_set_t allowed;
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0) CPU_AND(&cpus, &cpus, &allowed);
+
+  const int count = CPU_COUNT(&cpus);
+  if(count == 0 || sched_setaffinity(0, sizeof(cpus), &cpus) != 0) return 0;
+
+  dt_print(DT_DEBUG_PERF, "[numa] bound thread to node %d with %d cpus\n", node, count);
+  return count;
+#else
+  return 0;
+#endif
+}
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -20,6 +20,37 @@
 
 void dt_set_rlimits();
 
+// watch the memory pressure of the system (or of our cgroup) and shrink the
+// image and mipmap caches while it is high, growing them back once it is gone.
+// start after the caches are initialized, stop before they are cleaned up.
+void dt_memory_pressure_start();
+void dt_memory_pressure_stop();
+
+// memory the jobs running side by side may take in total, as declared with
+// dt_control_job_set_resources(). shrinks with the memory pressure.
+size_t dt_jobs_memory_budget();
+// same for the memory of all opencl devices, 0 if there is no opencl
+size_t dt_jobs_gpu_budget();
+
+// the host memory governor: pixelpipes (and whoever holds large buffers beyond them) tell how much they
+// hold, keyed by any pointer identifying them, and size their caches and working buffers from what the
+// others leave of dt_jobs_memory_budget(). it never refuses, but shrinks what everybody plans with.
+// sets what owner holds right now, replacing the previous claim. 0 drops it.
+void dt_memory_budget_claim(const void *owner, const char *name, const size_t bytes);
+// the budget left by all holders but owner, never less than 512MB (what the tiling code assumes)
+size_t dt_memory_budget_available(const void *owner);
+// blocks until bytes fit next to the others' claims or timeout seconds passed, TRUE if they fit
+gboolean dt_memory_budget_wait(const void *owner, const size_t bytes, const double timeout);
+// with -d memory: who holds what
+void dt_memory_budget_report();
+
+// NUMA nodes of the machine, 1 if there is only one or the topology is unknown
+int dt_numa_nodes();
+// bind the calling thread, and the openmp team it starts from now on, to the cpus of one node
+// so that the buffers it allocates and touches first end up in that node's memory.
+// returns the number of cpus it may run on, 0 if binding is not possible.
+int dt_numa_bind_thread(const int node);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
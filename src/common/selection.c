@@ -32,13 +32,128 @@ typedef struct dt_selection_t
   /* this stores the last single clicked image id indicating
      the start of a selection range */
   uint32_t last_single_id;
+
+  /* in memory mirror of main.selected_images: one bitmap per block of
+     DT_SELECTION_CHUNK_SIZE ids, allocated while the block has a selected image */
+  GMutex bits_lock;
+  GHashTable *chunks;
+  uint32_t count;
 } dt_selection_t;
 
+#define DT_SELECTION_CHUNK_SIZE (1 << 16)
+
+typedef struct dt_selection_chunk_t
+{
+  uint32_t count;
+  uint64_t bits[DT_SELECTION_CHUNK_SIZE / 64];
+} dt_selection_chunk_t;
+
 const dt_collection_t *dt_selection_get_collection(struct dt_selection_t *selection)
 {
   return selection->collection;
 }
 
+static void _selection_bits_set(dt_selection_t *selection, const int imgid, const gboolean on)
+{
+  if(imgid < 0) return;
+
+  const guint key = imgid / DT_SELECTION_CHUNK_SIZE;
+  const int pos = imgid % DT_SELECTION_CHUNK_SIZE;
+  const uint64_t mask = (uint64_t)1 << (pos % 64);
+
+  g_mutex_lock(&selection->bits_lock);
+  dt_selection_chunk_t *chunk = g_hash_table_lookup(selection->chunks, GUINT_TO_POINTER(key));
+  if(on)
+  {
+    if(!chunk)
+    {
+      chunk = g_malloc0(sizeof(dt_selection_chunk_t));
+      g_hash_table_insert(selection->chunks, GUINT_TO_POINTER(key), chunk);
+    }
+    if(!(chunk->bits[pos / 64] & mask))
+    {
+      chunk->bits[pos / 64] |= mask;
+      chunk->count++;
+      selection->count++;
+    }
+  }
+  else if(chunk && (chunk->bits[pos / 64] & mask))
+  {
+    chunk->bits[pos / 64] &= ~mask;
+    selection->count--;
+    if(--chunk->count == 0) g_hash_table_remove(selection->chunks, GUINT_TO_POINTER(key));
+  }
+  g_mutex_unlock(&selection->bits_lock);
+}
+
+/* called by the triggers on main.selected_images for each row added or removed */
+static void _selection_mark_sql(sqlite3_context *context, int argc, sqlite3_value **argv)
+{
+  dt_selection_t *selection = (dt_selection_t *)sqlite3_user_data(context);
+  _selection_bits_set(selection, sqlite3_value_int(argv[0]), sqlite3_value_int(argv[1]));
+  sqlite3_result_null(context);
+}
+
+gboolean dt_selection_is_selected(const dt_selection_t *selection, const int imgid)
+{
+  if(imgid < 0) return FALSE;
+
+  dt_selection_t *s = (dt_selection_t *)selection;
+  const int pos = imgid % DT_SELECTION_CHUNK_SIZE;
+
+  g_mutex_lock(&s->bits_lock);
+  const dt_selection_chunk_t *chunk
+      = g_hash_table_lookup(s->chunks, GUINT_TO_POINTER((guint)(imgid / DT_SELECTION_CHUNK_SIZE)));
+  const gboolean selected = chunk && (chunk->bits[pos / 64] & ((uint64_t)1 << (pos % 64)));
+  g_mutex_unlock(&s->bits_lock);
+
+  return selected;
+}
+
+uint32_t dt_selection_count(const dt_selection_t *selection)
+{
+  dt_selection_t *s = (dt_selection_t *)selection;
+  g_mutex_lock(&s->bits_lock);
+  const uint32_t count = s->count;
+  g_mutex_unlock(&s->bits_lock);
+  return count;
+}
+
+static void _selection_bits_init(dt_selection_t *selection)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+
+  g_mutex_init(&selection->bits_lock);
+  selection->chunks = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  selection->count = 0;
+
+  sqlite3_create_function(db, "dt_selection_mark", 2, SQLITE_UTF8, selection, _selection_mark_sql, NULL, NULL);
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "SELECT imgid FROM main.selected_images", -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW) _selection_bits_set(selection, sqlite3_column_int(stmt, 0), TRUE);
+  sqlite3_finalize(stmt);
+
+  // every change of the table goes through these, whichever module writes it. the mirror doesn't
+  // follow a rollback, which is fine as nothing rolls back changes of the selection.
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER selection_insert AFTER INSERT ON main.selected_images"
+                            " BEGIN"
+                            "  SELECT dt_selection_mark(new.imgid, 1);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER selection_delete AFTER DELETE ON main.selected_images"
+                            " BEGIN"
+                            "  SELECT dt_selection_mark(old.imgid, 0);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER selection_update AFTER UPDATE OF imgid ON main.selected_images"
+                            " BEGIN"
+                            "  SELECT dt_selection_mark(old.imgid, 0);"
+                            "  SELECT dt_selection_mark(new.imgid, 1);"
+                            " END",
+                        NULL, NULL, NULL);
+}
+
 static void _selection_raise_signal()
 {
   // discard cached images_to_act_on list
@@ -111,13 +226,15 @@ const dt_selection_t *dt_selection_new()
 {
   dt_selection_t *s = g_malloc0(sizeof(dt_selection_t));
 
+  _selection_bits_init(s);
+
   /* initialize the collection copy */
   _selection_update_collection(NULL, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, NULL, -1, (gpointer)s);
 
   /* initialize last_single_id based on current database */
   s->last_single_id = -1;
 
-  if(dt_collection_get_selected_count(darktable.collection) >= 1)
+  if(dt_selection_count(s) >= 1)
   {
     GList *selected_image = dt_collection_get_selected(darktable.collection, 1);
     if(selected_image)
@@ -137,6 +254,12 @@ const dt_selection_t *dt_selection_new()
 
 void dt_selection_free(dt_selection_t *selection)
 {
+  sqlite3 *db = dt_database_get(darktable.db);
+  DT_DEBUG_SQLITE3_EXEC(db, "DROP TRIGGER IF EXISTS temp.selection_insert", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "DROP TRIGGER IF EXISTS temp.selection_delete", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "DROP TRIGGER IF EXISTS temp.selection_update", NULL, NULL, NULL);
+  g_hash_table_destroy(selection->chunks);
+  g_mutex_clear(&selection->bits_lock);
   g_free(selection);
 }
 
@@ -226,20 +349,9 @@ void dt_selection_select_single(dt_selection_t *selection, uint32_t imgid)
 
 void dt_selection_toggle(dt_selection_t *selection, uint32_t imgid)
 {
-  sqlite3_stmt *stmt;
-  gboolean exists = FALSE;
-
   if(imgid == -1) return;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT imgid FROM main.selected_images WHERE imgid=?1", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-
-  if(sqlite3_step(stmt) == SQLITE_ROW) exists = TRUE;
-
-  sqlite3_finalize(stmt);
-
-  if(exists)
+  if(dt_selection_is_selected(selection, imgid))
   {
     dt_selection_deselect(selection, imgid);
   }
@@ -280,7 +392,7 @@ void dt_selection_select_range(dt_selection_t *selection, uint32_t imgid)
   if(!selection->collection) return;
 
   // selecting a range requires at least one image to be selected already
-  if(!dt_collection_get_selected_count(darktable.collection)) return;
+  if(!dt_selection_count(selection)) return;
 
   /* get start and end rows for range selection */
   sqlite3_stmt *stmt;
@@ -50,6 +50,10 @@ void dt_selection_select_unaltered(struct dt_selection_t *selection);
 void dt_selection_select_list(struct dt_selection_t *selection, GList *list);
 /** selects a set of images from a list. the list is unaltered */
 const struct dt_collection_t *dt_selection_get_collection(struct dt_selection_t *selection);
+/** tells whether imgid is selected, without going to the database */
+gboolean dt_selection_is_selected(const struct dt_selection_t *selection, const int imgid);
+/** number of selected images */
+uint32_t dt_selection_count(const struct dt_selection_t *selection);
 /** get the list of selected images */
 GList *dt_selection_get_list(struct dt_selection_t *selection, const gboolean only_visible,
                              const gboolean ordering);
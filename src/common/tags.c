@@ -36,84 +36,43 @@ typedef struct dt_undo_tags_t
   GList *after; // list of tagid after
 } dt_undo_tags_t;
 
-static gchar *_get_tb_removed_tag_string_values(GList *before, GList *after)
+static void _pop_undo_execute(const int imgid, GList *before, GList *after)
 {
-  GList *a = after;
-  gchar *tag_list = NULL;
+  if(imgid <= 0) return;
+
+  // one row at a time, with the statements kept prepared across the images of a batch
   for(GList *b = before; b; b = g_list_next(b))
   {
-    if(!g_list_find(a, b->data))
-    {
-      tag_list = dt_util_dstrcat(tag_list, "%d,", GPOINTER_TO_INT(b->data));
-    }
+    if(g_list_find(after, b->data)) continue;
+    sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                    "DELETE FROM main.tagged_images WHERE imgid = ?1 AND tagid = ?2");
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(b->data));
+    sqlite3_step(stmt);
+    dt_database_release_cached(darktable.db, stmt);
   }
-  if(tag_list) tag_list[strlen(tag_list) - 1] = '\0';
-  return tag_list;
-}
 
-static gchar *_get_tb_added_tag_string_values(const int img, GList *before, GList *after)
-{
-  GList *b = before;
-  gchar *tag_list = NULL;
   for(GList *a = after; a; a = g_list_next(a))
   {
-    if(!g_list_find(b, a->data))
-    {
-      tag_list = dt_util_dstrcat(tag_list,
-                                 "(%d,%d,"
-                                 "  (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000) + (1 << 32)"
-                                 "    FROM main.tagged_images)"
-                                 "),",
-                                 GPOINTER_TO_INT(img),
-                                 GPOINTER_TO_INT(a->data));
-    }
-  }
-  if(tag_list) tag_list[strlen(tag_list) - 1] = '\0';
-  return tag_list;
-}
-
-static void _bulk_remove_tags(const int img, const gchar *tag_list)
-{
-  if(img > 0 && tag_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("DELETE FROM main.tagged_images WHERE imgid = %d AND tagid IN (%s)", img, tag_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    if(g_list_find(before, a->data)) continue;
+    sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                    "INSERT INTO main.tagged_images (imgid, tagid, position)"
+                                                    "  VALUES (?1, ?2,"
+                                                    "   (SELECT (IFNULL(MAX(position),0) & 0xFFFFFFFF00000000)"
+                                                    "           + (1 << 32)"
+                                                    "     FROM main.tagged_images))");
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(a->data));
     sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
+    dt_database_release_cached(darktable.db, stmt);
   }
 }
 
-static void _bulk_add_tags(const gchar *tag_list)
-{
-  if(tag_list)
-  {
-    sqlite3_stmt *stmt;
-    gchar *query = g_strdup_printf("INSERT INTO main.tagged_images (imgid, tagid, position) VALUES %s", tag_list);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    g_free(query);
-  }
-}
-
-static void _pop_undo_execute(const int imgid, GList *before, GList *after)
-{
-  gchar *tobe_removed_list = _get_tb_removed_tag_string_values(before, after);
-  gchar *tobe_added_list = _get_tb_added_tag_string_values(imgid, before, after);
-
-  _bulk_remove_tags(imgid, tobe_removed_list);
-  _bulk_add_tags(tobe_added_list);
-
-  g_free(tobe_removed_list);
-  g_free(tobe_added_list);
-}
-
 static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action, GList **imgs)
 {
   if(type == DT_UNDO_TAGS)
   {
+    dt_database_batch_begin(darktable.db);
     for(GList *list = (GList *)data; list; list = g_list_next(list))
     {
       dt_undo_tags_t *undotags = (dt_undo_tags_t *)list->data;
@@ -123,6 +82,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
       _pop_undo_execute(undotags->imgid, before, after);
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undotags->imgid));
     }
+    dt_database_batch_commit(darktable.db);
 
     DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
   }
@@ -386,6 +346,7 @@ static gboolean _tag_execute(const GList *tags, const GList *imgs, GList **undo,
                              const gint action)
 {
   gboolean res = FALSE;
+  dt_database_batch_begin(darktable.db);
   for(const GList *images = imgs; images; images = g_list_next(images))
   {
     const int image_id = GPOINTER_TO_INT(images->data);
@@ -420,10 +381,12 @@ static gboolean _tag_execute(const GList *tags, const GList *imgs, GList **undo,
     }
     _pop_undo_execute(image_id, undotags->before, undotags->after);
     if(undo_on)
-      *undo = g_list_append(*undo, undotags);
+      *undo = g_list_prepend(*undo, undotags);
     else
       _undo_tags_free(undotags);
   }
+  dt_database_batch_commit(darktable.db);
+  if(undo_on) *undo = g_list_reverse(*undo);
   return res;
 }
 
@@ -593,26 +556,20 @@ void dt_set_darktable_tags()
 
 uint32_t dt_tag_get_attached(const gint imgid, GList **result, const gboolean ignore_dt_tags)
 {
-  sqlite3_stmt *stmt;
   uint32_t nb_selected = 0;
   char *images = NULL;
   if(imgid > 0)
   {
-    images = g_strdup_printf("%d", imgid);
+    // bound, so that the same statement serves every image
+    images = g_strdup("?1");
     nb_selected = 1;
   }
   else
   {
     // we get the query used to retrieve the list of select images
     images = dt_selection_get_list_query(darktable.selection, FALSE, FALSE);
-    // and we retrieve the number of image in the selection
-    gchar *query = g_strdup_printf("SELECT COUNT(*)"
-                                   " FROM (%s)",
-                                   images);
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    if(sqlite3_step(stmt) == SQLITE_ROW) nb_selected = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-    g_free(query);
+    // and the number of images in the selection
+    nb_selected = dt_selection_count(darktable.selection);
   }
   uint32_t count = 0;
   if(images)
@@ -626,7 +583,8 @@ uint32_t dt_tag_get_attached(const gint imgid, GList **result, const gboolean ig
                             " GROUP BY I.tagid "
                             " ORDER by T.name",
                             images, ignore_dt_tags ? " AND T.id NOT IN memory.darktable_tags" : "");
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db), query);
+    if(imgid > 0) DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
     g_free(images);
 
     // Create result
@@ -645,10 +603,11 @@ uint32_t dt_tag_get_attached(const gint imgid, GList **result, const gboolean ig
       t->select = (nb_selected == 0) ? DT_TS_NO_IMAGE :
                   (imgnb == nb_selected) ? DT_TS_ALL_IMAGES :
                   (imgnb == 0) ? DT_TS_NO_IMAGE : DT_TS_SOME_IMAGES;
-      *result = g_list_append(*result, t);
+      *result = g_list_prepend(*result, t);
       count++;
     }
-    sqlite3_finalize(stmt);
+    *result = g_list_reverse(*result);
+    dt_database_release_cached(darktable.db, stmt);
     g_free(query);
   }
   return count;
@@ -814,14 +773,13 @@ static GList *_tag_get_tags(const gint imgid, const dt_tag_type_t type)
   GList *tags = NULL;
   char *images = NULL;
   if(imgid > 0)
-    images = g_strdup_printf("%d", imgid);
+    images = g_strdup("?1"); // bound below, the statement is reused within a batch
   else
   {
     // we get the query used to retrieve the list of select images
     images = dt_selection_get_list_query(darktable.selection, FALSE, FALSE);
   }
 
-  sqlite3_stmt *stmt;
   char query[256] = { 0 };
   snprintf(query, sizeof(query), "SELECT DISTINCT T.id"
                                  "  FROM main.tagged_images AS I"
@@ -830,14 +788,15 @@ static GList *_tag_get_tags(const gint imgid, const dt_tag_type_t type)
            images, type == DT_TAG_TYPE_ALL ? "" :
                    type == DT_TAG_TYPE_DT ? "AND T.id IN memory.darktable_tags" :
                                             "AND NOT T.id IN memory.darktable_tags");
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db), query);
+  if(imgid > 0) DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     tags = g_list_prepend(tags, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
   }
 
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
   g_free(images);
   return tags;
 }
@@ -1250,13 +1209,10 @@ uint32_t dt_tag_images_count(gint tagid)
   sqlite3_stmt *stmt;
 
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(DISTINCT imgid) AS imgnb"
-                              " FROM main.tagged_images"
-                              " WHERE tagid = ?1",
+                              "SELECT count FROM memory.tag_counts WHERE tagid = ?1",
                               -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
-  sqlite3_step(stmt);
-  const uint32_t nb_images = sqlite3_column_int(stmt, 0);
+  const uint32_t nb_images = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
   sqlite3_finalize(stmt);
   return nb_images;
 }
@@ -1265,23 +1221,13 @@ uint32_t dt_tag_get_with_usage(GList **result)
 {
   sqlite3_stmt *stmt;
 
-  /* Select tags that are similar to the keyword and are actually used to tag images*/
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO memory.taglist (id, count)"
-                              "  SELECT tagid, COUNT(*)"
-                              "  FROM main.tagged_images"
-                              "  GROUP BY tagid",
-                              -1, &stmt, NULL);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
   const uint32_t nb_selected = dt_selected_images_count();
 
   /* Now put all the bits together */
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT T.name, T.id, MT.count, CT.imgnb, T.flags, T.synonyms"
                               "  FROM data.tags T "
-                              "  LEFT JOIN memory.taglist MT ON MT.id = T.id "
+                              "  LEFT JOIN memory.tag_counts MT ON MT.tagid = T.id "
                               "  LEFT JOIN (SELECT tagid, COUNT(DISTINCT imgid) AS imgnb"
                               "             FROM main.tagged_images "
                               "             WHERE imgid IN (SELECT imgid FROM main.selected_images) GROUP BY tagid) AS CT "
@@ -1306,12 +1252,12 @@ uint32_t dt_tag_get_with_usage(GList **result)
                 (imgnb == 0) ? DT_TS_NO_IMAGE : DT_TS_SOME_IMAGES;
     t->flags = sqlite3_column_int(stmt, 4);
     t->synonym = g_strdup((char *)sqlite3_column_text(stmt, 5));
-    *result = g_list_append(*result, t);
+    *result = g_list_prepend(*result, t);
     count++;
   }
 
   sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.taglist", NULL, NULL, NULL);
+  *result = g_list_reverse(*result); // list was built in reverse order, so un-reverse it
 
   return count;
 }
@@ -0,0 +1,171 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2022 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/trace.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+static FILE *_trace_file = NULL;
+static gchar *_trace_path = NULL;
+static GMutex _trace_lock;
+static double _trace_start = 0.0;
+static size_t _trace_events = 0;
+static gint _trace_threads = 0;
+
+// the track of the calling thread, assigned with its first event
+static __thread int _trace_tid = 0;
+static __thread char _trace_name[64] = { 0 };
+
+static void _append_escaped(GString *s, const char *str)
+{
+  for(const char *c = str ? str : ""; *c; c++)
+  {
+    if(*c == '"' || *c == '\\')
+      g_string_append_printf(s, "\\%c", *c);
+    else if((unsigned char)*c < 0x20)
+      g_string_append_printf(s, "\\u%04x", (unsigned char)*c);
+    else
+      g_string_append_c(s, *c);
+  }
+}
+
+static void _append_time(GString *s, const char *key, const double seconds)
+{
+  char buf[G_ASCII_DTOSTR_BUF_SIZE];
+  // microseconds, locale independent since json wants a decimal point
+  g_ascii_formatd(buf, sizeof(buf), "%.3f", MAX(seconds, 0.0) * 1e6);
+  g_string_append_printf(s, ",\"%s\":%s", key, buf);
+}
+
+// call with _trace_lock held
+static void _write_event(const GString *event)
+{
+  fputs(_trace_events++ ? ",\n" : "\n", _trace_file);
+  fputs(event->str, _trace_file);
+}
+
+void dt_trace_complete_event(const char *category, const char *name, const double begin, const char *args, ...)
+{
+  if(!_trace_file) return;
+  const double end = dt_get_wtime();
+
+  GString *meta = NULL;
+  if(!_trace_tid)
+  {
+    _trace_tid = g_atomic_int_add(&_trace_threads, 1) + 1;
+    meta = g_string_new(NULL);
+    g_string_append_printf(meta, "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",
+                           _trace_tid);
+    if(_trace_name[0])
+      _append_escaped(meta, _trace_name);
+    else
+      g_string_append_printf(meta, "thread %d", _trace_tid);
+    g_string_append(meta, "\"}}");
+  }
+
+  GString *event = g_string_new("{\"ph\":\"X\",\"cat\":\"");
+  _append_escaped(event, category);
+  g_string_append(event, "\",\"name\":\"");
+  _append_escaped(event, name);
+  g_string_append_printf(event, "\",\"pid\":1,\"tid\":%d", _trace_tid);
+  _append_time(event, "ts", begin - _trace_start);
+  _append_time(event, "dur", end - MAX(begin, _trace_start));
+  if(args)
+  {
+    va_list ap;
+    va_start(ap, args);
+    gchar *members = g_strdup_vprintf(args, ap);
+    va_end(ap);
+    g_string_append_printf(event, ",\"args\":{%s}", members);
+    g_free(members);
+  }
+  g_string_append_c(event, '}');
+
+  g_mutex_lock(&_trace_lock);
+  if(_trace_file)
+  {
+    if(meta) _write_event(meta);
+    _write_event(event);
+  }
+  g_mutex_unlock(&_trace_lock);
+
+  if(meta) g_string_free(meta, TRUE);
+  g_string_free(event, TRUE);
+}
+
+void dt_trace_thread_name(const char *name)
+{
+  g_strlcpy(_trace_name, name ? name : "", sizeof(_trace_name));
+}
+
+void dt_trace_init(void)
+{
+  if(!(darktable.unmuted & DT_DEBUG_TRACE)) return;
+
+  gchar *path = dt_conf_get_string("debug/trace_file");
+  if(!path || !*path)
+  {
+    g_free(path);
+    GDateTime *now = g_date_time_new_now_local();
+    gchar *stamp = g_date_time_format(now, "%Y%m%d-%H%M%S");
+    gchar *filename = g_strdup_printf("darktable-trace-%s.json", stamp);
+    path = g_build_filename(g_get_tmp_dir(), filename, NULL);
+    g_free(filename);
+    g_free(stamp);
+    g_date_time_unref(now);
+  }
+
+  _trace_file = g_fopen(path, "w");
+  if(!_trace_file)
+  {
+    fprintf(stderr, "[trace] can't open trace file `%s'\n", path);
+    g_free(path);
+    return;
+  }
+  _trace_path = path;
+  _trace_start = dt_get_wtime();
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", _trace_file);
+  _trace_events = 0;
+  fputs("\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"args\":{\"name\":\"darktable\"}}", _trace_file);
+  _trace_events++;
+  // dt_init() runs on the main thread
+  if(!_trace_name[0]) dt_trace_thread_name("main");
+  fprintf(stderr, "[trace] writing trace events to `%s'\n", _trace_path);
+}
+
+void dt_trace_cleanup(void)
+{
+  g_mutex_lock(&_trace_lock);
+  if(_trace_file)
+  {
+    fputs("\n]}\n", _trace_file);
+    fclose(_trace_file);
+    _trace_file = NULL;
+    fprintf(stderr, "[trace] %zu events written to `%s'\n", _trace_events, _trace_path);
+  }
+  g_free(_trace_path);
+  _trace_path = NULL;
+  g_mutex_unlock(&_trace_lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,64 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2022 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+
+/*
+ * with -d trace the scopes of jobs, pixelpipe nodes, opencl enqueues, image loaders and cache lookups are
+ * written as chrome trace events (the json format read by chrome://tracing and ui.perfetto.dev), one track
+ * per thread. a scope is recorded once it is complete:
+ *
+ *   const double begin = dt_trace_begin();
+ *   ...
+ *   dt_trace_complete("pixelpipe", module->op, begin, "\"pipe\":\"%s\"", pipe_name);
+ *
+ * the optional format gives the members of the event's args object, strings passed through it have to be
+ * escaped by the caller. scopes which are left early are simply not recorded.
+ */
+
+/** returns the start time of a scope, 0 when not tracing. */
+static inline double dt_trace_begin(void)
+{
+  return (darktable.unmuted & DT_DEBUG_TRACE) ? dt_get_wtime() : 0.0;
+}
+
+/** records a scope started with dt_trace_begin(), args is a printf format for the members of the args
+ * object or NULL. */
+void dt_trace_complete_event(const char *category, const char *name, const double begin, const char *args, ...)
+    __attribute__((format(printf, 4, 5)));
+
+#define dt_trace_complete(category, name, begin, ...)                                                       \
+  do                                                                                                         \
+  {                                                                                                          \
+    if((begin) > 0.0) dt_trace_complete_event(category, name, begin, __VA_ARGS__);                           \
+  } while(0)
+
+/** remembers the name of the calling thread for its track, see dt_pthread_setname(). */
+void dt_trace_thread_name(const char *name);
+
+/** opens the trace file when -d trace is given. */
+void dt_trace_init(void);
+
+/** finishes and closes the trace file. */
+void dt_trace_cleanup(void);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -92,21 +92,341 @@ typedef struct dt_variables_data_t
 
   int flags;
 
+  // the image the fields above have been gathered for, 0 if they are not valid
+  uint32_t cached_imgid;
+
+  // text metadata of metadata_imgid, by key
+  GHashTable *metadata;
+  uint32_t metadata_imgid;
+
 } dt_variables_data_t;
 
+// what an expansion has to gather before the variables can be evaluated
+typedef enum dt_variables_source_t
+{
+  SOURCE_NONE = 0,
+  SOURCE_IMAGE = 1 << 0,   // the fields of the image cache entry, or the exif time without an image
+  SOURCE_FOLDERS = 1 << 1, // the home and pictures folders
+} dt_variables_source_t;
+
+typedef enum dt_variables_var_t
+{
+  VAR_NONE = 0,
+  VAR_YEAR_SHORT,
+  VAR_YEAR,
+  VAR_MONTH_SHORT,
+  VAR_MONTH_LONG,
+  VAR_MONTH,
+  VAR_DAY,
+  VAR_HOUR_AMPM,
+  VAR_HOUR,
+  VAR_MINUTE,
+  VAR_SECOND,
+  VAR_MSEC,
+  VAR_DATE,
+  VAR_EXIF_YEAR_SHORT,
+  VAR_EXIF_YEAR,
+  VAR_EXIF_MONTH_SHORT,
+  VAR_EXIF_MONTH_LONG,
+  VAR_EXIF_MONTH,
+  VAR_EXIF_DAY,
+  VAR_EXIF_HOUR_AMPM,
+  VAR_EXIF_HOUR,
+  VAR_EXIF_MINUTE,
+  VAR_EXIF_SECOND,
+  VAR_EXIF_MSEC,
+  VAR_EXIF_DATE,
+  VAR_EXIF_ISO,
+  VAR_NL,
+  VAR_EXIF_EXPOSURE_BIAS,
+  VAR_EXIF_EXPOSURE,
+  VAR_EXIF_APERTURE,
+  VAR_EXIF_FOCAL_LENGTH,
+  VAR_EXIF_FOCUS_DISTANCE,
+  VAR_LONGITUDE,
+  VAR_LATITUDE,
+  VAR_ELEVATION,
+  VAR_GPS_LOCATION,
+  VAR_EXIF_MAKER,
+  VAR_EXIF_MODEL,
+  VAR_EXIF_LENS,
+  VAR_ID,
+  VAR_IMAGE_EXIF,
+  VAR_VERSION_NAME,
+  VAR_VERSION_IF_MULTI,
+  VAR_VERSION,
+  VAR_JOBCODE,
+  VAR_ROLL_NAME,
+  VAR_FILE_DIRECTORY,
+  VAR_FILE_FOLDER,
+  VAR_IMAGE_FILENAME,
+  VAR_FILE_NAME,
+  VAR_FILE_EXTENSION,
+  VAR_SEQUENCE,
+  VAR_USERNAME,
+  VAR_FOLDER_HOME,
+  VAR_FOLDER_PICTURES,
+  VAR_FOLDER_DESKTOP,
+  VAR_DESKTOP,
+  VAR_STARS,
+  VAR_RATING_ICONS,
+  VAR_LABELS_ICONS,
+  VAR_LABELS,
+  VAR_TITLE,
+  VAR_DESCRIPTION,
+  VAR_CREATOR,
+  VAR_PUBLISHER,
+  VAR_RIGHTS,
+  VAR_OPENCL_ACTIVATED,
+  VAR_WIDTH_MAX,
+  VAR_WIDTH_SENSOR,
+  VAR_WIDTH_RAW,
+  VAR_WIDTH_CROP,
+  VAR_WIDTH_EXPORT,
+  VAR_HEIGHT_MAX,
+  VAR_HEIGHT_SENSOR,
+  VAR_HEIGHT_RAW,
+  VAR_HEIGHT_CROP,
+  VAR_HEIGHT_EXPORT,
+  VAR_CATEGORY,
+  VAR_TAGS,
+  VAR_SIDECAR_TXT,
+  VAR_DARKTABLE_VERSION,
+  VAR_DARKTABLE_NAME,
+} dt_variables_var_t;
+
+// the names are tested in this order, a name has to come before the names it is a prefix of
+static const struct
+{
+  const char *name;
+  dt_variables_var_t var;
+  dt_variables_source_t sources;
+} _variable_names[] = {
+  { "YEAR.SHORT",            VAR_YEAR_SHORT,                SOURCE_NONE },
+  { "SHORT_YEAR",            VAR_YEAR_SHORT,                SOURCE_NONE },
+  { "DATE.SHORT_YEAR",       VAR_YEAR_SHORT,                SOURCE_NONE },
+  { "YEAR",                  VAR_YEAR,                      SOURCE_NONE },
+  { "DATE.LONG_YEAR",        VAR_YEAR,                      SOURCE_NONE },
+  { "MONTH.SHORT",           VAR_MONTH_SHORT,               SOURCE_NONE },
+  { "DATE.SHORT_MONTH",      VAR_MONTH_SHORT,               SOURCE_NONE },
+  { "MONTH.LONG",            VAR_MONTH_LONG,                SOURCE_NONE },
+  { "DATE.LONG_MONTH",       VAR_MONTH_LONG,                SOURCE_NONE },
+  { "MONTH",                 VAR_MONTH,                     SOURCE_NONE },
+  { "DATE.MONTH",            VAR_MONTH,                     SOURCE_NONE },
+  { "DAY",                   VAR_DAY,                       SOURCE_NONE },
+  { "DATE.DAY",              VAR_DAY,                       SOURCE_NONE },
+  { "HOUR.AMPM",             VAR_HOUR_AMPM,                 SOURCE_NONE },
+  { "DATE.HOUR_AMPM",        VAR_HOUR_AMPM,                 SOURCE_NONE },
+  { "HOUR",                  VAR_HOUR,                      SOURCE_NONE },
+  { "DATE.HOUR",             VAR_HOUR,                      SOURCE_NONE },
+  { "MINUTE",                VAR_MINUTE,                    SOURCE_NONE },
+  { "DATE.MINUTE",           VAR_MINUTE,                    SOURCE_NONE },
+  { "SECOND",                VAR_SECOND,                    SOURCE_NONE },
+  { "DATE.SECOND",           VAR_SECOND,                    SOURCE_NONE },
+  { "MSEC",                  VAR_MSEC,                      SOURCE_NONE },
+  { "DATE",                  VAR_DATE,                      SOURCE_NONE },
+  { "EXIF.YEAR.SHORT",       VAR_EXIF_YEAR_SHORT,           SOURCE_IMAGE },
+  { "EXIF.DATE.SHORT_YEAR",  VAR_EXIF_YEAR_SHORT,           SOURCE_IMAGE },
+  { "EXIF.YEAR",             VAR_EXIF_YEAR,                 SOURCE_IMAGE },
+  { "EXIF_YEAR",             VAR_EXIF_YEAR,                 SOURCE_IMAGE },
+  { "EXIF.DATE.LONG_YEAR",   VAR_EXIF_YEAR,                 SOURCE_IMAGE },
+  { "EXIF.MONTH.SHORT",      VAR_EXIF_MONTH_SHORT,          SOURCE_IMAGE },
+  { "EXIF.DATE.SHORT_MONTH", VAR_EXIF_MONTH_SHORT,          SOURCE_IMAGE },
+  { "EXIF.MONTH.LONG",       VAR_EXIF_MONTH_LONG,           SOURCE_IMAGE },
+  { "EXIF.DATE.LONG_MONTH",  VAR_EXIF_MONTH_LONG,           SOURCE_IMAGE },
+  { "EXIF.MONTH",            VAR_EXIF_MONTH,                SOURCE_IMAGE },
+  { "EXIF_MONTH",            VAR_EXIF_MONTH,                SOURCE_IMAGE },
+  { "EXIF.DATE.MONTH",       VAR_EXIF_MONTH,                SOURCE_IMAGE },
+  { "EXIF.DAY",              VAR_EXIF_DAY,                  SOURCE_IMAGE },
+  { "EXIF_DAY",              VAR_EXIF_DAY,                  SOURCE_IMAGE },
+  { "EXIF.DATE.DAY",         VAR_EXIF_DAY,                  SOURCE_IMAGE },
+  { "EXIF.HOUR.AMPM",        VAR_EXIF_HOUR_AMPM,            SOURCE_IMAGE },
+  { "EXIF.DATE.HOUR_AMPM",   VAR_EXIF_HOUR_AMPM,            SOURCE_IMAGE },
+  { "EXIF.HOUR",             VAR_EXIF_HOUR,                 SOURCE_IMAGE },
+  { "EXIF_HOUR",             VAR_EXIF_HOUR,                 SOURCE_IMAGE },
+  { "EXIF.DATE.HOUR",        VAR_EXIF_HOUR,                 SOURCE_IMAGE },
+  { "EXIF.MINUTE",           VAR_EXIF_MINUTE,               SOURCE_IMAGE },
+  { "EXIF_MINUTE",           VAR_EXIF_MINUTE,               SOURCE_IMAGE },
+  { "EXIF.DATE.MINUTE",      VAR_EXIF_MINUTE,               SOURCE_IMAGE },
+  { "EXIF.SECOND",           VAR_EXIF_SECOND,               SOURCE_IMAGE },
+  { "EXIF_SECOND",           VAR_EXIF_SECOND,               SOURCE_IMAGE },
+  { "EXIF.DATE.SECOND",      VAR_EXIF_SECOND,               SOURCE_IMAGE },
+  { "EXIF.MSEC",             VAR_EXIF_MSEC,                 SOURCE_IMAGE },
+  { "EXIF_MSEC",             VAR_EXIF_MSEC,                 SOURCE_IMAGE },
+  { "EXIF.DATE",             VAR_EXIF_DATE,                 SOURCE_IMAGE },
+  { "EXIF.ISO",              VAR_EXIF_ISO,                  SOURCE_IMAGE },
+  { "EXIF_ISO",              VAR_EXIF_ISO,                  SOURCE_IMAGE },
+  { "NL",                    VAR_NL,                        SOURCE_NONE },
+  { "EXIF.EXPOSURE.BIAS",    VAR_EXIF_EXPOSURE_BIAS,        SOURCE_IMAGE },
+  { "EXIF_EXPOSURE_BIAS",    VAR_EXIF_EXPOSURE_BIAS,        SOURCE_IMAGE },
+  { "EXIF.EXPOSURE",         VAR_EXIF_EXPOSURE,             SOURCE_IMAGE },
+  { "EXIF_EXPOSURE",         VAR_EXIF_EXPOSURE,             SOURCE_IMAGE },
+  { "EXIF.APERTURE",         VAR_EXIF_APERTURE,             SOURCE_IMAGE },
+  { "EXIF_APERTURE",         VAR_EXIF_APERTURE,             SOURCE_IMAGE },
+  { "EXIF.FOCAL.LENGTH",     VAR_EXIF_FOCAL_LENGTH,         SOURCE_IMAGE },
+  { "EXIF_FOCAL_LENGTH",     VAR_EXIF_FOCAL_LENGTH,         SOURCE_IMAGE },
+  { "EXIF.FOCUS.DISTANCE",   VAR_EXIF_FOCUS_DISTANCE,       SOURCE_IMAGE },
+  { "EXIF_FOCUS_DISTANCE",   VAR_EXIF_FOCUS_DISTANCE,       SOURCE_IMAGE },
+  { "LONGITUDE",             VAR_LONGITUDE,                 SOURCE_IMAGE },
+  { "GPS.LONGITUDE",         VAR_LONGITUDE,                 SOURCE_IMAGE },
+  { "LATITUDE",              VAR_LATITUDE,                  SOURCE_IMAGE },
+  { "GPS.LATITUDE",          VAR_LATITUDE,                  SOURCE_IMAGE },
+  { "ELEVATION",             VAR_ELEVATION,                 SOURCE_IMAGE },
+  { "GPS.ELEVATION",         VAR_ELEVATION,                 SOURCE_IMAGE },
+  { "GPS.LOCATION",          VAR_GPS_LOCATION,              SOURCE_IMAGE },
+  { "EXIF.MAKER",            VAR_EXIF_MAKER,                SOURCE_IMAGE },
+  { "MAKER",                 VAR_EXIF_MAKER,                SOURCE_IMAGE },
+  { "EXIF.MODEL",            VAR_EXIF_MODEL,                SOURCE_IMAGE },
+  { "MODEL",                 VAR_EXIF_MODEL,                SOURCE_IMAGE },
+  { "EXIF.LENS",             VAR_EXIF_LENS,                 SOURCE_IMAGE },
+  { "LENS",                  VAR_EXIF_LENS,                 SOURCE_IMAGE },
+  { "ID",                    VAR_ID,                        SOURCE_NONE },
+  { "IMAGE.ID",              VAR_ID,                        SOURCE_NONE },
+  { "IMAGE.EXIF",            VAR_IMAGE_EXIF,                SOURCE_NONE },
+  { "VERSION.NAME",          VAR_VERSION_NAME,              SOURCE_NONE },
+  { "VERSION_NAME",          VAR_VERSION_NAME,              SOURCE_NONE },
+  { "VERSION.IF_MULTI",      VAR_VERSION_IF_MULTI,          SOURCE_IMAGE },
+  { "VERSION_IF_MULTI",      VAR_VERSION_IF_MULTI,          SOURCE_IMAGE },
+  { "VERSION",               VAR_VERSION,                   SOURCE_IMAGE },
+  { "JOBCODE",               VAR_JOBCODE,                   SOURCE_NONE },
+  { "ROLL.NAME",             VAR_ROLL_NAME,                 SOURCE_NONE },
+  { "ROLL_NAME",             VAR_ROLL_NAME,                 SOURCE_NONE },
+  { "FILE.DIRECTORY",        VAR_FILE_DIRECTORY,            SOURCE_NONE },
+  { "FILE_DIRECTORY",        VAR_FILE_DIRECTORY,            SOURCE_NONE },
+  { "FILE.FOLDER",           VAR_FILE_FOLDER,               SOURCE_NONE },
+  { "FILE_FOLDER",           VAR_FILE_FOLDER,               SOURCE_NONE },
+  { "IMAGE.FILENAME",        VAR_IMAGE_FILENAME,            SOURCE_NONE },
+  { "FILE.NAME",             VAR_FILE_NAME,                 SOURCE_NONE },
+  { "FILE_NAME",             VAR_FILE_NAME,                 SOURCE_NONE },
+  { "IMAGE.BASENAME",        VAR_FILE_NAME,                 SOURCE_NONE },
+  { "FILE.EXTENSION",        VAR_FILE_EXTENSION,            SOURCE_NONE },
+  { "FILE_EXTENSION",        VAR_FILE_EXTENSION,            SOURCE_NONE },
+  { "SEQUENCE",              VAR_SEQUENCE,                  SOURCE_NONE },
+  { "USERNAME",              VAR_USERNAME,                  SOURCE_NONE },
+  { "FOLDER.HOME",           VAR_FOLDER_HOME,               SOURCE_FOLDERS },
+  { "HOME_FOLDER",           VAR_FOLDER_HOME,               SOURCE_FOLDERS },
+  { "HOME",                  VAR_FOLDER_HOME,               SOURCE_FOLDERS },
+  { "FOLDER.PICTURES",       VAR_FOLDER_PICTURES,           SOURCE_FOLDERS },
+  { "PICTURES_FOLDER",       VAR_FOLDER_PICTURES,           SOURCE_FOLDERS },
+  { "FOLDER.DESKTOP",        VAR_FOLDER_DESKTOP,            SOURCE_NONE },
+  { "DESKTOP_FOLDER",        VAR_FOLDER_DESKTOP,            SOURCE_NONE },
+  { "DESKTOP",               VAR_DESKTOP,                   SOURCE_NONE },
+  { "STARS",                 VAR_STARS,                     SOURCE_IMAGE },
+  { "RATING.ICONS",          VAR_RATING_ICONS,              SOURCE_IMAGE },
+  { "RATING_ICONS",          VAR_RATING_ICONS,              SOURCE_IMAGE },
+  { "Xmp.xmp.Rating",        VAR_RATING_ICONS,              SOURCE_IMAGE },
+  { "LABELS.ICONS",          VAR_LABELS_ICONS,              SOURCE_NONE },
+  { "LABELS_ICONS",          VAR_LABELS_ICONS,              SOURCE_NONE },
+  { "LABELS.COLORICONS",     VAR_LABELS_ICONS,              SOURCE_NONE },
+  { "LABELS_COLORICONS",     VAR_LABELS_ICONS,              SOURCE_NONE },
+  { "LABELS",                VAR_LABELS,                    SOURCE_NONE },
+  { "TITLE",                 VAR_TITLE,                     SOURCE_NONE },
+  { "Xmp.dc.title",          VAR_TITLE,                     SOURCE_NONE },
+  { "DESCRIPTION",           VAR_DESCRIPTION,               SOURCE_NONE },
+  { "Xmp.dc.description",    VAR_DESCRIPTION,               SOURCE_NONE },
+  { "CREATOR",               VAR_CREATOR,                   SOURCE_NONE },
+  { "Xmp.dc.creator",        VAR_CREATOR,                   SOURCE_NONE },
+  { "PUBLISHER",             VAR_PUBLISHER,                 SOURCE_NONE },
+  { "Xmp.dc.publisher",      VAR_PUBLISHER,                 SOURCE_NONE },
+  { "RIGHTS",                VAR_RIGHTS,                    SOURCE_NONE },
+  { "Xmp.dc.rights",         VAR_RIGHTS,                    SOURCE_NONE },
+  { "OPENCL.ACTIVATED",      VAR_OPENCL_ACTIVATED,          SOURCE_NONE },
+  { "OPENCL_ACTIVATED",      VAR_OPENCL_ACTIVATED,          SOURCE_NONE },
+  { "WIDTH.MAX",             VAR_WIDTH_MAX,                 SOURCE_NONE },
+  { "MAX_WIDTH",             VAR_WIDTH_MAX,                 SOURCE_NONE },
+  { "WIDTH.SENSOR",          VAR_WIDTH_SENSOR,              SOURCE_IMAGE },
+  { "SENSOR_WIDTH",          VAR_WIDTH_SENSOR,              SOURCE_IMAGE },
+  { "WIDTH.RAW",             VAR_WIDTH_RAW,                 SOURCE_IMAGE },
+  { "RAW_WIDTH",             VAR_WIDTH_RAW,                 SOURCE_IMAGE },
+  { "WIDTH.CROP",            VAR_WIDTH_CROP,                SOURCE_IMAGE },
+  { "CROP_WIDTH",            VAR_WIDTH_CROP,                SOURCE_IMAGE },
+  { "WIDTH.EXPORT",          VAR_WIDTH_EXPORT,              SOURCE_IMAGE },
+  { "EXPORT_WIDTH",          VAR_WIDTH_EXPORT,              SOURCE_IMAGE },
+  { "HEIGHT.MAX",            VAR_HEIGHT_MAX,                SOURCE_NONE },
+  { "MAX_HEIGHT",            VAR_HEIGHT_MAX,                SOURCE_NONE },
+  { "HEIGHT.SENSOR",         VAR_HEIGHT_SENSOR,             SOURCE_IMAGE },
+  { "SENSOR_HEIGHT",         VAR_HEIGHT_SENSOR,             SOURCE_IMAGE },
+  { "HEIGHT.RAW",            VAR_HEIGHT_RAW,                SOURCE_IMAGE },
+  { "RAW_HEIGHT",            VAR_HEIGHT_RAW,                SOURCE_IMAGE },
+  { "HEIGHT.CROP",           VAR_HEIGHT_CROP,               SOURCE_IMAGE },
+  { "CROP_HEIGHT",           VAR_HEIGHT_CROP,               SOURCE_IMAGE },
+  { "HEIGHT.EXPORT",         VAR_HEIGHT_EXPORT,             SOURCE_IMAGE },
+  { "EXPORT_HEIGHT",         VAR_HEIGHT_EXPORT,             SOURCE_IMAGE },
+  { "CATEGORY",              VAR_CATEGORY,                  SOURCE_NONE },
+  { "TAGS",                  VAR_TAGS,                      SOURCE_NONE },
+  { "IMAGE.TAGS",            VAR_TAGS,                      SOURCE_NONE },
+  { "SIDECAR_TXT",           VAR_SIDECAR_TXT,               SOURCE_IMAGE },
+  { "DARKTABLE.VERSION",     VAR_DARKTABLE_VERSION,         SOURCE_NONE },
+  { "DARKTABLE_VERSION",     VAR_DARKTABLE_VERSION,         SOURCE_NONE },
+  { "DARKTABLE.NAME",        VAR_DARKTABLE_NAME,            SOURCE_NONE },
+  { "DARKTABLE_NAME",        VAR_DARKTABLE_NAME,            SOURCE_NONE },
+};
+
+typedef struct dt_variables_token_t
+{
+  // literal text with its escapes resolved, NULL for a variable
+  gchar *text;
+  // the variable and where its arguments and operation start in the source of the template
+  dt_variables_var_t var;
+  char *args;
+} dt_variables_token_t;
+
+struct dt_variables_template_t
+{
+  gchar *source;
+  GList *tokens;
+  dt_variables_source_t sources;
+};
+
 static char *_expand_source(dt_variables_params_t *params, char **source, char extra_stop);
 
-// gather some data that might be used for variable expansion
-static void _init_expansion(dt_variables_params_t *params, gboolean iterate)
+static void _reset_image_data(dt_variables_data_t *data)
+{
+  if(data->datetime)
+    g_date_time_unref(data->datetime);
+  data->datetime = NULL;
+  g_free(data->camera_maker);
+  g_free(data->camera_alias);
+  g_free(data->exif_lens);
+  data->camera_maker = NULL;
+  data->camera_alias = NULL;
+  data->exif_lens = NULL;
+
+  data->have_exif_dt = FALSE;
+  data->exif_iso = 100;
+  data->version = 0;
+  data->stars = 0;
+  data->exif_exposure = 0.0f;
+  data->exif_exposure_bias = NAN;
+  data->exif_aperture = 0.0f;
+  data->exif_focal_length = 0.0f;
+  data->exif_focus_distance = 0.0f;
+  data->longitude = NAN;
+  data->latitude = NAN;
+  data->elevation = NAN;
+  data->flags = 0;
+  data->sensor_width = data->sensor_height = 0;
+  data->raw_width = data->raw_height = 0;
+  data->crop_width = data->crop_height = 0;
+  data->export_width = data->export_height = 0;
+  data->cached_imgid = 0;
+}
+
+// gather the data used by the variables of an expansion. the image data is kept for the following
+// expansions of the same image.
+static void _init_expansion(dt_variables_params_t *params, gboolean iterate, const dt_variables_source_t sources)
 {
   if(iterate) params->data->sequence++;
 
-  params->data->homedir = dt_loc_get_home_dir(NULL);
+  if((sources & SOURCE_FOLDERS) && !params->data->homedir)
+  {
+    params->data->homedir = dt_loc_get_home_dir(NULL);
 
-  if(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES) == NULL)
-    params->data->pictures_folder = g_build_path(G_DIR_SEPARATOR_S, params->data->homedir, "Pictures", (char *)NULL);
-  else
-    params->data->pictures_folder = g_strdup(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES));
+    if(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES) == NULL)
+      params->data->pictures_folder = g_build_path(G_DIR_SEPARATOR_S, params->data->homedir, "Pictures", (char *)NULL);
+    else
+      params->data->pictures_folder = g_strdup(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES));
+  }
 
   if(params->filename)
   {
@@ -116,23 +436,10 @@ static void _init_expansion(dt_variables_params_t *params, gboolean iterate)
   else
     params->data->file_ext = NULL;
 
+  if(!(sources & SOURCE_IMAGE) || (params->imgid && params->imgid == params->data->cached_imgid)) return;
+
   /* image exif time */
-  params->data->have_exif_dt = FALSE;
-  params->data->exif_iso = 100;
-  params->data->camera_maker = NULL;
-  params->data->camera_alias = NULL;
-  params->data->exif_lens = NULL;
-  params->data->version = 0;
-  params->data->stars = 0;
-  params->data->exif_exposure = 0.0f;
-  params->data->exif_exposure_bias = NAN;
-  params->data->exif_aperture = 0.0f;
-  params->data->exif_focal_length = 0.0f;
-  params->data->exif_focus_distance = 0.0f;
-  params->data->longitude = NAN;
-  params->data->latitude = NAN;
-  params->data->elevation = NAN;
-  params->data->show_msec = dt_conf_get_bool("lighttable/ui/milliseconds");
+  _reset_image_data(params->data);
   if(params->imgid)
   {
     const dt_image_t *img = params->img ? (dt_image_t *)params->img
@@ -187,6 +494,7 @@ static void _init_expansion(dt_variables_params_t *params, gboolean iterate)
     }
 
     if(params->img == NULL) dt_image_cache_read_release(darktable.image_cache, img);
+    params->data->cached_imgid = params->imgid;
   }
   else if(params->data->exif_time[0])
   {
@@ -196,18 +504,6 @@ static void _init_expansion(dt_variables_params_t *params, gboolean iterate)
   }
 }
 
-static void _cleanup_expansion(dt_variables_params_t *params)
-{
-  if(params->data->time)
-    g_date_time_unref(params->data->time);
-  if(params->data->datetime)
-    g_date_time_unref(params->data->datetime);
-  g_free(params->data->homedir);
-  g_free(params->data->pictures_folder);
-  g_free(params->data->camera_maker);
-  g_free(params->data->camera_alias);
-}
-
 static inline gboolean _has_prefix(char **str, const char *prefix)
 {
   gboolean res = g_str_has_prefix(*str, prefix);
@@ -215,6 +511,23 @@ static inline gboolean _has_prefix(char **str, const char *prefix)
   return res;
 }
 
+// resolves the name at the start of variable and goes past it, adding the data it needs to sources
+static dt_variables_var_t _variable_lookup(char **variable, dt_variables_source_t *sources)
+{
+  for(size_t i = 0; i < G_N_ELEMENTS(_variable_names); i++)
+  {
+    if(_has_prefix(variable, _variable_names[i].name))
+    {
+      if(sources) *sources |= _variable_names[i].sources;
+      return _variable_names[i].var;
+    }
+  }
+
+  // go past what looks like an invalid variable. we only expect to see [a-zA-Z]* in a variable name.
+  while(g_ascii_isalpha(**variable)) (*variable)++;
+  return VAR_NONE;
+}
+
 static char *_variables_get_longitude(dt_variables_params_t *params)
 {
   if(isnan(params->data->longitude))
@@ -247,7 +560,27 @@ static char *_variables_get_latitude(dt_variables_params_t *params)
   }
 }
 
-static char *_get_base_value(dt_variables_params_t *params, char **variable)
+// text metadata of the image, looked up once for all the variables and expansions of the same image
+static char *_variables_get_metadata(dt_variables_params_t *params, const char *key)
+{
+  if(params->data->metadata_imgid != params->imgid)
+  {
+    g_hash_table_remove_all(params->data->metadata);
+    params->data->metadata_imgid = params->imgid;
+  }
+
+  gpointer value = NULL;
+  if(!g_hash_table_lookup_extended(params->data->metadata, key, NULL, &value))
+  {
+    GList *res = dt_metadata_get(params->imgid, key, NULL);
+    value = res ? g_strdup((char *)res->data) : NULL;
+    g_list_free_full(res, &g_free);
+    g_hash_table_insert(params->data->metadata, (gpointer)key, value);
+  }
+  return g_strdup((char *)value);
+}
+
+static char *_get_base_value(dt_variables_params_t *params, const dt_variables_var_t var, char **variable)
 {
   char *result = NULL;
   gboolean escape = TRUE;
@@ -255,79 +588,79 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
   char exif_datetime[DT_DATETIME_LENGTH];
   GDateTime *datetime = params->data->have_exif_dt ? params->data->datetime : params->data->time;
 
-  if(_has_prefix(variable, "YEAR.SHORT") || _has_prefix(variable, "SHORT_YEAR") || _has_prefix(variable, "DATE.SHORT_YEAR"))
+  if(var == VAR_YEAR_SHORT)
     result = g_date_time_format(params->data->time, "%y");
-  else if(_has_prefix(variable, "YEAR") || _has_prefix(variable, "DATE.LONG_YEAR"))
+  else if(var == VAR_YEAR)
     result = g_date_time_format(params->data->time, "%Y");
-  else if(_has_prefix(variable, "MONTH.SHORT") || _has_prefix(variable, "DATE.SHORT_MONTH"))
+  else if(var == VAR_MONTH_SHORT)
     result = g_date_time_format(params->data->time, "%b");
-  else if(_has_prefix(variable, "MONTH.LONG") || _has_prefix(variable, "DATE.LONG_MONTH"))
+  else if(var == VAR_MONTH_LONG)
     result = g_date_time_format(params->data->time, "%B");
-  else if(_has_prefix(variable, "MONTH") || _has_prefix(variable, "DATE.MONTH"))
+  else if(var == VAR_MONTH)
     result = g_date_time_format(params->data->time, "%m");
-  else if(_has_prefix(variable, "DAY") || _has_prefix(variable, "DATE.DAY"))
+  else if(var == VAR_DAY)
     result = g_date_time_format(params->data->time, "%d");
-  else if(_has_prefix(variable, "HOUR.AMPM") || _has_prefix(variable, "DATE.HOUR_AMPM"))
+  else if(var == VAR_HOUR_AMPM)
     result = g_date_time_format(params->data->time, "%I %p");
-  else if(_has_prefix(variable, "HOUR") || _has_prefix(variable, "DATE.HOUR"))
+  else if(var == VAR_HOUR)
     result = g_date_time_format(params->data->time, "%H");
-  else if(_has_prefix(variable, "MINUTE") || _has_prefix(variable, "DATE.MINUTE"))
+  else if(var == VAR_MINUTE)
     result = g_date_time_format(params->data->time, "%M");
-  else if(_has_prefix(variable, "SECOND") || _has_prefix(variable, "DATE.SECOND"))
+  else if(var == VAR_SECOND)
     result = g_date_time_format(params->data->time, "%S");
-  else if(_has_prefix(variable, "MSEC"))
+  else if(var == VAR_MSEC)
   {
     result = g_date_time_format(params->data->time, "%f");
     result[3] = '\0';
   }
   // for watermark backward compatibility
-  else if(_has_prefix(variable, "DATE"))
+  else if(var == VAR_DATE)
   {
     dt_datetime_gdatetime_to_exif(exif_datetime, params->data->show_msec ? DT_DATETIME_LENGTH : DT_DATETIME_EXIF_LENGTH, params->data->time);
     result = g_strdup(exif_datetime);
   }
 
-  else if(_has_prefix(variable, "EXIF.YEAR.SHORT") || _has_prefix(variable, "EXIF.DATE.SHORT_YEAR"))
+  else if(var == VAR_EXIF_YEAR_SHORT)
     result = g_date_time_format(datetime, "%y");
-  else if(_has_prefix(variable, "EXIF.YEAR") || _has_prefix(variable, "EXIF_YEAR") || _has_prefix(variable, "EXIF.DATE.LONG_YEAR"))
+  else if(var == VAR_EXIF_YEAR)
     result = g_date_time_format(datetime, "%Y");
-  else if(_has_prefix(variable, "EXIF.MONTH.SHORT") || _has_prefix(variable, "EXIF.DATE.SHORT_MONTH"))
+  else if(var == VAR_EXIF_MONTH_SHORT)
     result = g_date_time_format(datetime, "%b");
-  else if(_has_prefix(variable, "EXIF.MONTH.LONG") || _has_prefix(variable, "EXIF.DATE.LONG_MONTH"))
+  else if(var == VAR_EXIF_MONTH_LONG)
     result = g_date_time_format(datetime, "%B");
-  else if(_has_prefix(variable, "EXIF.MONTH") || _has_prefix(variable, "EXIF_MONTH") || _has_prefix(variable, "EXIF.DATE.MONTH"))
+  else if(var == VAR_EXIF_MONTH)
     result = g_date_time_format(datetime, "%m");
-  else if(_has_prefix(variable, "EXIF.DAY") || _has_prefix(variable, "EXIF_DAY") || _has_prefix(variable, "EXIF.DATE.DAY"))
+  else if(var == VAR_EXIF_DAY)
     result = g_date_time_format(datetime, "%d");
-  else if(_has_prefix(variable, "EXIF.HOUR.AMPM") || _has_prefix(variable, "EXIF.DATE.HOUR_AMPM"))
+  else if(var == VAR_EXIF_HOUR_AMPM)
     result = g_date_time_format(datetime, "%I %p");
-  else if(_has_prefix(variable, "EXIF.HOUR") || _has_prefix(variable, "EXIF_HOUR") || _has_prefix(variable, "EXIF.DATE.HOUR"))
+  else if(var == VAR_EXIF_HOUR)
     result = g_date_time_format(datetime, "%H");
-  else if(_has_prefix(variable, "EXIF.MINUTE") || _has_prefix(variable, "EXIF_MINUTE") || _has_prefix(variable, "EXIF.DATE.MINUTE"))
+  else if(var == VAR_EXIF_MINUTE)
     result = g_date_time_format(datetime, "%M");
-  else if(_has_prefix(variable, "EXIF.SECOND") || _has_prefix(variable, "EXIF_SECOND") || _has_prefix(variable, "EXIF.DATE.SECOND"))
+  else if(var == VAR_EXIF_SECOND)
     result = g_date_time_format(datetime, "%S");
-  else if(_has_prefix(variable, "EXIF.MSEC") || _has_prefix(variable, "EXIF_MSEC"))
+  else if(var == VAR_EXIF_MSEC)
   {
     result = g_date_time_format(datetime, "%f");
     result[3] = '\0';
   }
   // for watermark backward compatibility
-  else if(_has_prefix(variable, "EXIF.DATE"))
+  else if(var == VAR_EXIF_DATE)
   {
     dt_datetime_gdatetime_to_exif(exif_datetime, params->data->show_msec ? DT_DATETIME_LENGTH : DT_DATETIME_EXIF_LENGTH, datetime);
     result = g_strdup(exif_datetime);
   }
-  else if(_has_prefix(variable, "EXIF.ISO") || _has_prefix(variable, "EXIF_ISO"))
+  else if(var == VAR_EXIF_ISO)
     result = g_strdup_printf("%d", params->data->exif_iso);
-  else if(_has_prefix(variable, "NL") && g_strcmp0(params->jobcode, "infos") == 0)
+  else if(var == VAR_NL && g_strcmp0(params->jobcode, "infos") == 0)
     result = g_strdup_printf("\n");
-  else if(_has_prefix(variable, "EXIF.EXPOSURE.BIAS") || _has_prefix(variable, "EXIF_EXPOSURE_BIAS"))
+  else if(var == VAR_EXIF_EXPOSURE_BIAS)
   {
     if(!isnan(params->data->exif_exposure_bias))
       result = g_strdup_printf("%+.2f", params->data->exif_exposure_bias);
   }
-  else if(_has_prefix(variable, "EXIF.EXPOSURE") || _has_prefix(variable, "EXIF_EXPOSURE"))
+  else if(var == VAR_EXIF_EXPOSURE)
   {
     result = dt_util_format_exposure(params->data->exif_exposure);
     // for job other than info (export) we strip the slash char
@@ -338,20 +671,20 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
       result = res;
     }
   }
-  else if(_has_prefix(variable, "EXIF.APERTURE") || _has_prefix(variable, "EXIF_APERTURE"))
+  else if(var == VAR_EXIF_APERTURE)
     result = g_strdup_printf("%.1f", params->data->exif_aperture);
-  else if(_has_prefix(variable, "EXIF.FOCAL.LENGTH") || _has_prefix(variable, "EXIF_FOCAL_LENGTH"))
+  else if(var == VAR_EXIF_FOCAL_LENGTH)
     result = g_strdup_printf("%d", (int)params->data->exif_focal_length);
-  else if(_has_prefix(variable, "EXIF.FOCUS.DISTANCE") || _has_prefix(variable, "EXIF_FOCUS_DISTANCE"))
+  else if(var == VAR_EXIF_FOCUS_DISTANCE)
     result = g_strdup_printf("%.2f", params->data->exif_focus_distance);
-  else if(_has_prefix(variable, "LONGITUDE") || _has_prefix(variable, "GPS.LONGITUDE"))
+  else if(var == VAR_LONGITUDE)
     result = _variables_get_longitude(params);
-  else if(_has_prefix(variable, "LATITUDE") || _has_prefix(variable, "GPS.LATITUDE"))
+  else if(var == VAR_LATITUDE)
     result = _variables_get_latitude(params);
-  else if(_has_prefix(variable, "ELEVATION") || _has_prefix(variable, "GPS.ELEVATION"))
+  else if(var == VAR_ELEVATION)
     result = g_strdup_printf("%.2f", params->data->elevation);
   // for watermark backward compatibility
-  else if(_has_prefix(variable, "GPS.LOCATION"))
+  else if(var == VAR_GPS_LOCATION)
   {
     gchar *parts[4] = { 0 };
     int i = 0;
@@ -362,15 +695,15 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
     for(int j = 0; j < i; j++)
       g_free(parts[j]);
   }
-  else if(_has_prefix(variable, "EXIF.MAKER") || _has_prefix(variable, "MAKER"))
+  else if(var == VAR_EXIF_MAKER)
     result = g_strdup(params->data->camera_maker);
-  else if(_has_prefix(variable, "EXIF.MODEL") || _has_prefix(variable, "MODEL"))
+  else if(var == VAR_EXIF_MODEL)
     result = g_strdup(params->data->camera_alias);
-  else if(_has_prefix(variable, "EXIF.LENS") || _has_prefix(variable, "LENS"))
+  else if(var == VAR_EXIF_LENS)
     result = g_strdup(params->data->exif_lens);
-  else if(_has_prefix(variable, "ID") || _has_prefix(variable, "IMAGE.ID"))
+  else if(var == VAR_ID)
     result = g_strdup_printf("%d", params->imgid);
-  else if(_has_prefix(variable, "IMAGE.EXIF"))
+  else if(var == VAR_IMAGE_EXIF)
   {
     gchar buffer[1024];
     const dt_image_t *img = params->img ? (dt_image_t *)params->img
@@ -379,16 +712,9 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
     if(params->img == NULL) dt_image_cache_read_release(darktable.image_cache, img);
     result = g_strdup(buffer);
   }
-  else if(_has_prefix(variable, "VERSION.NAME") || _has_prefix(variable, "VERSION_NAME"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.darktable.version_name", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
-  else if(_has_prefix(variable, "VERSION.IF_MULTI") || _has_prefix(variable, "VERSION_IF_MULTI"))
+  else if(var == VAR_VERSION_NAME)
+    result = _variables_get_metadata(params, "Xmp.darktable.version_name");
+  else if(var == VAR_VERSION_IF_MULTI)
   {
     sqlite3_stmt *stmt;
 
@@ -412,11 +738,11 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
     }
     sqlite3_finalize (stmt);
   }
-  else if(_has_prefix(variable, "VERSION"))
+  else if(var == VAR_VERSION)
     result = g_strdup_printf("%d", params->data->version);
-  else if(_has_prefix(variable, "JOBCODE"))
+  else if(var == VAR_JOBCODE)
     result = g_strdup(params->jobcode);
-  else if(_has_prefix(variable, "ROLL.NAME") || _has_prefix(variable, "ROLL_NAME"))
+  else if(var == VAR_ROLL_NAME)
   {
     if(params->filename)
     {
@@ -425,24 +751,24 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
       g_free(dirname);
     }
   }
-  else if(_has_prefix(variable, "FILE.DIRECTORY") || _has_prefix(variable, "FILE_DIRECTORY"))
+  else if(var == VAR_FILE_DIRECTORY)
   {
     // undocumented : backward compatibility
     if(params->filename)
       result = g_path_get_dirname(params->filename);
   }
-  else if(_has_prefix(variable, "FILE.FOLDER") || _has_prefix(variable, "FILE_FOLDER"))
+  else if(var == VAR_FILE_FOLDER)
   {
     if(params->filename)
       result = g_path_get_dirname(params->filename);
   }
   // for watermark backward compatibility
-  else if(_has_prefix(variable, "IMAGE.FILENAME"))
+  else if(var == VAR_IMAGE_FILENAME)
   {
     if(params->filename)
       result = g_strdup(params->filename);
   }
-  else if(_has_prefix(variable, "FILE.NAME") || _has_prefix(variable, "FILE_NAME") || _has_prefix(variable, "IMAGE.BASENAME"))
+  else if(var == VAR_FILE_NAME)
   {
     if(params->filename)
     {
@@ -451,9 +777,9 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
       if(dot) *dot = '\0';
     }
   }
-  else if(_has_prefix(variable, "FILE.EXTENSION") || _has_prefix(variable, "FILE_EXTENSION"))
+  else if(var == VAR_FILE_EXTENSION)
     result = g_strdup(params->data->file_ext);
-  else if(_has_prefix(variable, "SEQUENCE"))
+  else if(var == VAR_SEQUENCE)
   {
     uint8_t nb_digit = 4;
     if(g_ascii_isdigit(*variable[0]))
@@ -463,19 +789,19 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
     }
     result = g_strdup_printf("%.*d", nb_digit, params->sequence >= 0 ? params->sequence : params->data->sequence);
   }
-  else if(_has_prefix(variable, "USERNAME"))
+  else if(var == VAR_USERNAME)
     result = g_strdup(g_get_user_name());
-  else if(_has_prefix(variable, "FOLDER.HOME") || _has_prefix(variable, "HOME_FOLDER") || _has_prefix(variable, "HOME"))
+  else if(var == VAR_FOLDER_HOME)
     result = g_strdup(params->data->homedir);
-  else if(_has_prefix(variable, "FOLDER.PICTURES") || _has_prefix(variable, "PICTURES_FOLDER"))
+  else if(var == VAR_FOLDER_PICTURES)
     result = g_strdup(params->data->pictures_folder);
-  else if(_has_prefix(variable, "FOLDER.DESKTOP") || _has_prefix(variable, "DESKTOP_FOLDER"))
+  else if(var == VAR_FOLDER_DESKTOP)
     result = g_strdup(g_get_user_special_dir(G_USER_DIRECTORY_DESKTOP)); // undocumented : backward compatibility
-  else if(_has_prefix(variable, "DESKTOP"))
+  else if(var == VAR_DESKTOP)
     result = g_strdup(g_get_user_special_dir(G_USER_DIRECTORY_DESKTOP));
-  else if(_has_prefix(variable, "STARS"))
+  else if(var == VAR_STARS)
     result = g_strdup_printf("%d", params->data->stars);
-  else if(_has_prefix(variable, "RATING.ICONS") || _has_prefix(variable, "RATING_ICONS") || _has_prefix(variable, "Xmp.xmp.Rating"))
+  else if(var == VAR_RATING_ICONS)
   {
     switch(params->data->stars)
     {
@@ -502,9 +828,7 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
         break;
     }
   }
-  else if((_has_prefix(variable, "LABELS.ICONS") || _has_prefix(variable, "LABELS_ICONS") ||
-           _has_prefix(variable, "LABELS.COLORICONS") || _has_prefix(variable, "LABELS_COLORICONS"))
-          && g_strcmp0(params->jobcode, "infos") == 0)
+  else if(var == VAR_LABELS_ICONS && g_strcmp0(params->jobcode, "infos") == 0)
   {
     escape = FALSE;
     GList *res = dt_metadata_get(params->imgid, "Xmp.darktable.colorlabels", NULL);
@@ -518,7 +842,7 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
     }
     g_list_free(res);
   }
-  else if(_has_prefix(variable, "LABELS"))
+  else if(var == VAR_LABELS)
   {
     // TODO: currently we concatenate all the color labels with a ',' as a separator. Maybe it's better to
     // only use the first/last label?
@@ -536,79 +860,44 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
     }
     g_list_free(res);
   }
-  else if(_has_prefix(variable, "TITLE") || _has_prefix(variable, "Xmp.dc.title"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.title", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
-  else if(_has_prefix(variable, "DESCRIPTION") || _has_prefix(variable, "Xmp.dc.description"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.description", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
-  else if(_has_prefix(variable, "CREATOR") || _has_prefix(variable, "Xmp.dc.creator"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.creator", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
-  else if(_has_prefix(variable, "PUBLISHER") || _has_prefix(variable, "Xmp.dc.publisher"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.publisher", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
-  else if(_has_prefix(variable, "RIGHTS") || _has_prefix(variable, "Xmp.dc.rights"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.rights", NULL);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
-  else if(_has_prefix(variable, "OPENCL.ACTIVATED") || _has_prefix(variable, "OPENCL_ACTIVATED"))
+  else if(var == VAR_TITLE)
+    result = _variables_get_metadata(params, "Xmp.dc.title");
+  else if(var == VAR_DESCRIPTION)
+    result = _variables_get_metadata(params, "Xmp.dc.description");
+  else if(var == VAR_CREATOR)
+    result = _variables_get_metadata(params, "Xmp.dc.creator");
+  else if(var == VAR_PUBLISHER)
+    result = _variables_get_metadata(params, "Xmp.dc.publisher");
+  else if(var == VAR_RIGHTS)
+    result = _variables_get_metadata(params, "Xmp.dc.rights");
+  else if(var == VAR_OPENCL_ACTIVATED)
   {
     if(dt_opencl_is_enabled())
       result = g_strdup(_("yes"));
     else
       result = g_strdup(_("no"));
   }
-  else if(_has_prefix(variable, "WIDTH.MAX") || _has_prefix(variable, "MAX_WIDTH"))
+  else if(var == VAR_WIDTH_MAX)
     result = g_strdup_printf("%d", params->data->max_width);
-  else if(_has_prefix(variable, "WIDTH.SENSOR") || _has_prefix(variable, "SENSOR_WIDTH"))
+  else if(var == VAR_WIDTH_SENSOR)
     result = g_strdup_printf("%d", params->data->sensor_width);
-  else if(_has_prefix(variable, "WIDTH.RAW") || _has_prefix(variable, "RAW_WIDTH"))
+  else if(var == VAR_WIDTH_RAW)
     result = g_strdup_printf("%d", params->data->raw_width);
-  else if(_has_prefix(variable, "WIDTH.CROP") || _has_prefix(variable, "CROP_WIDTH"))
+  else if(var == VAR_WIDTH_CROP)
     result = g_strdup_printf("%d", params->data->crop_width);
-  else if(_has_prefix(variable, "WIDTH.EXPORT") || _has_prefix(variable, "EXPORT_WIDTH"))
+  else if(var == VAR_WIDTH_EXPORT)
     result = g_strdup_printf("%d", params->data->export_width);
-  else if(_has_prefix(variable, "HEIGHT.MAX") || _has_prefix(variable, "MAX_HEIGHT"))
+  else if(var == VAR_HEIGHT_MAX)
     result = g_strdup_printf("%d", params->data->max_height);
-  else if(_has_prefix(variable, "HEIGHT.SENSOR") || _has_prefix(variable, "SENSOR_HEIGHT"))
+  else if(var == VAR_HEIGHT_SENSOR)
     result = g_strdup_printf("%d", params->data->sensor_height);
-  else if(_has_prefix(variable, "HEIGHT.RAW") || _has_prefix(variable, "RAW_HEIGHT"))
+  else if(var == VAR_HEIGHT_RAW)
     result = g_strdup_printf("%d", params->data->raw_height);
-  else if(_has_prefix(variable, "HEIGHT.CROP") || _has_prefix(variable, "CROP_HEIGHT"))
+  else if(var == VAR_HEIGHT_CROP)
     result = g_strdup_printf("%d", params->data->crop_height);
-  else if(_has_prefix(variable, "HEIGHT.EXPORT") || _has_prefix(variable, "EXPORT_HEIGHT"))
+  else if(var == VAR_HEIGHT_EXPORT)
     result = g_strdup_printf("%d", params->data->export_height);
-  else if (_has_prefix(variable, "CATEGORY"))
+  else if (var == VAR_CATEGORY)
   {
     // CATEGORY should be followed by n [0,9] and "(category)". category can contain 0 or more '|'
     if (g_ascii_isdigit(*variable[0]))
@@ -635,7 +924,7 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
       }
     }
   }
-  else if(_has_prefix(variable, "TAGS") || _has_prefix(variable, "IMAGE.TAGS"))
+  else if(var == VAR_TAGS)
   {
     GList *tags_list = dt_tag_get_list_export(params->imgid, params->data->tags_flags);
     char *tags = dt_util_glist_to_str(", ", tags_list);
@@ -643,7 +932,7 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
     result = g_strdup(tags);
     g_free(tags);
   }
-  else if(_has_prefix(variable, "SIDECAR_TXT") && g_strcmp0(params->jobcode, "infos") == 0
+  else if(var == VAR_SIDECAR_TXT && g_strcmp0(params->jobcode, "infos") == 0
           && (params->data->flags & DT_IMAGE_HAS_TXT))
   {
     char *path = dt_image_get_text_path(params->imgid);
@@ -658,15 +947,10 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
       g_free(path);
     }
   }
-  else if(_has_prefix(variable, "DARKTABLE.VERSION") || _has_prefix(variable, "DARKTABLE_VERSION"))
+  else if(var == VAR_DARKTABLE_VERSION)
     result = g_strdup(darktable_package_version);
-  else if(_has_prefix(variable, "DARKTABLE.NAME") || _has_prefix(variable, "DARKTABLE_NAME"))
+  else if(var == VAR_DARKTABLE_NAME)
     result = g_strdup(PACKAGE_NAME);
-  else
-  {
-    // go past what looks like an invalid variable. we only expect to see [a-zA-Z]* in a variable name.
-    while(g_ascii_isalpha(**variable)) (*variable)++;
-  }
   if(!result) result = g_strdup("");
 
   if(params->escape_markup && escape)
@@ -683,13 +967,10 @@ static char *_get_base_value(dt_variables_params_t *params, char **variable)
 // http://www.tldp.org/LDP/abs/html/parameter-substitution.html
 // https://www.gnu.org/software/bash/manual/html_node/Shell-Parameter-Expansion.html
 // the descriptions in the comments are referring to the bash behaviour, dt doesn't do it 100% like that!
-static char *_variable_get_value(dt_variables_params_t *params, char **variable)
+static char *_variable_evaluate(dt_variables_params_t *params, const dt_variables_var_t var, char **variable)
 {
-  // invariant: the variable starts with "$(" which we can skip
-  (*variable) += 2;
-
   // first get the value of the variable
-  char *base_value = _get_base_value(params, variable); // this is never going to be NULL!
+  char *base_value = _get_base_value(params, var, variable); // this is never going to be NULL!
   const size_t base_value_length = strlen(base_value);
 
   // ... and now see if we have to change it
@@ -825,7 +1106,7 @@ static char *_variable_get_value(dt_variables_params_t *params, char **variable)
         if(mode == '/' || mode == '#' || mode == '%') (*variable)++;
         char *pattern = _expand_source(params, variable, '/');
         const size_t pattern_length = strlen(pattern);
-        (*variable)++;
+        if(**variable) (*variable)++;
         char *replacement = _expand_source(params, variable, ')');
         const size_t replacement_length = strlen(replacement);
 
@@ -945,6 +1226,15 @@ static char *_variable_get_value(dt_variables_params_t *params, char **variable)
   return base_value;
 }
 
+static char *_variable_get_value(dt_variables_params_t *params, char **variable)
+{
+  // invariant: the variable starts with "$(" which we can skip
+  (*variable) += 2;
+
+  const dt_variables_var_t var = _variable_lookup(variable, NULL);
+  return _variable_evaluate(params, var, variable);
+}
+
 static void _grow_buffer(char **result, char **result_iter, size_t *result_length, size_t extra_space)
 {
   const size_t used_length = *result_iter - *result;
@@ -1013,13 +1303,188 @@ static char *_expand_source(dt_variables_params_t *params, char **source, char e
   return result;
 }
 
-char *dt_variables_expand(dt_variables_params_t *params, gchar *source, gboolean iterate)
+static gboolean _parse_variable(char **variable, dt_variables_token_t *token, dt_variables_source_t *sources);
+
+// walks over source like _expand_source() does, without evaluating anything
+static void _parse_source(char **source, const char extra_stop, dt_variables_source_t *sources)
+{
+  char *source_iter = *source;
+  while(*source_iter && *source_iter != extra_stop)
+  {
+    if(*source_iter == '\\' && source_iter[1])
+      source_iter += 2;
+    else if(*source_iter == '$' && source_iter[1] == '(')
+    {
+      char *variable = source_iter;
+      // without its closing ')' the variable is copied over as text
+      source_iter = _parse_variable(&variable, NULL, sources) ? variable : source_iter + 1;
+    }
+    else
+      source_iter++;
+  }
+  *source = source_iter;
+}
+
+// walks over a variable like _variable_get_value() does, without evaluating it. returns FALSE where the
+// evaluation would fail because of a missing ')'.
+static gboolean _parse_variable(char **variable, dt_variables_token_t *token, dt_variables_source_t *sources)
+{
+  // invariant: the variable starts with "$(" which we can skip
+  (*variable) += 2;
+
+  const dt_variables_var_t var = _variable_lookup(variable, sources);
+  if(token)
+  {
+    token->var = var;
+    token->args = *variable;
+  }
+
+  // the arguments read by _get_base_value()
+  if(var == VAR_SEQUENCE && g_ascii_isdigit(**variable))
+    (*variable)++;
+  else if(var == VAR_CATEGORY && g_ascii_isdigit(**variable))
+  {
+    (*variable)++;
+    if(**variable == '(')
+    {
+      char *end = strchr(*variable, ')');
+      if(end) *variable = end + 1;
+    }
+  }
+
+  // and the operation applied by _variable_evaluate()
+  const char operation = **variable;
+  if(operation != '\0' && operation != ')') (*variable)++;
+  switch(operation)
+  {
+    case '-':
+    case '+':
+    case '#':
+    case '%':
+      _parse_source(variable, ')', sources);
+      break;
+    case ':':
+      strtol(*variable, variable, 10);
+      if(**variable == ':')
+      {
+        (*variable)++;
+        strtol(*variable, variable, 10);
+      }
+      break;
+    case '/':
+      if(**variable == '/' || **variable == '#' || **variable == '%') (*variable)++;
+      _parse_source(variable, '/', sources);
+      if(**variable) (*variable)++;
+      _parse_source(variable, ')', sources);
+      break;
+    case '^':
+    case ',':
+      if(**variable == operation) (*variable)++;
+      break;
+  }
+
+  if(**variable != ')') return FALSE;
+  (*variable)++;
+  return TRUE;
+}
+
+static void _template_add_text(dt_variables_template_t *tmpl, GString *text)
 {
-  _init_expansion(params, iterate);
+  if(!text->len) return;
+  dt_variables_token_t *token = g_malloc0(sizeof(dt_variables_token_t));
+  token->text = g_strndup(text->str, text->len);
+  tmpl->tokens = g_list_prepend(tmpl->tokens, token);
+  g_string_truncate(text, 0);
+}
 
-  char *result = _expand_source(params, &source, '\0');
+static void _template_free_token(gpointer data)
+{
+  dt_variables_token_t *token = (dt_variables_token_t *)data;
+  g_free(token->text);
+  g_free(token);
+}
 
-  _cleanup_expansion(params);
+dt_variables_template_t *dt_variables_template_new(const gchar *source)
+{
+  dt_variables_template_t *tmpl = g_malloc0(sizeof(dt_variables_template_t));
+  tmpl->source = g_strdup(source ? source : "");
+
+  // split the source into text and the variables at its top level, the same way _expand_source() goes
+  // through it
+  GString *text = g_string_new(NULL);
+  char *source_iter = tmpl->source;
+  while(*source_iter)
+  {
+    if(*source_iter == '\\' && source_iter[1])
+    {
+      g_string_append_c(text, source_iter[1]);
+      source_iter += 2;
+      continue;
+    }
+    if(*source_iter == '$' && source_iter[1] == '(')
+    {
+      dt_variables_token_t *token = g_malloc0(sizeof(dt_variables_token_t));
+      char *variable = source_iter;
+      if(_parse_variable(&variable, token, &tmpl->sources))
+      {
+        _template_add_text(tmpl, text);
+        tmpl->tokens = g_list_prepend(tmpl->tokens, token);
+        source_iter = variable;
+        continue;
+      }
+      // the error case of missing closing ')', the '$' is just text
+      g_free(token);
+    }
+    g_string_append_c(text, *source_iter++);
+  }
+  _template_add_text(tmpl, text);
+  g_string_free(text, TRUE);
+
+  tmpl->tokens = g_list_reverse(tmpl->tokens);
+  return tmpl;
+}
+
+void dt_variables_template_free(dt_variables_template_t *tmpl)
+{
+  if(!tmpl) return;
+  g_list_free_full(tmpl->tokens, _template_free_token);
+  g_free(tmpl->source);
+  g_free(tmpl);
+}
+
+const gchar *dt_variables_template_get_source(const dt_variables_template_t *tmpl)
+{
+  return tmpl->source;
+}
+
+char *dt_variables_template_expand(dt_variables_params_t *params, const dt_variables_template_t *tmpl,
+                                   gboolean iterate)
+{
+  _init_expansion(params, iterate, tmpl->sources);
+
+  GString *result = g_string_new(NULL);
+  for(const GList *iter = tmpl->tokens; iter; iter = g_list_next(iter))
+  {
+    const dt_variables_token_t *token = (dt_variables_token_t *)iter->data;
+    if(token->text)
+      g_string_append(result, token->text);
+    else
+    {
+      char *variable = token->args;
+      char *value = _variable_evaluate(params, token->var, &variable);
+      if(value) g_string_append(result, value);
+      g_free(value);
+    }
+  }
+
+  return g_string_free(result, FALSE);
+}
+
+char *dt_variables_expand(dt_variables_params_t *params, gchar *source, gboolean iterate)
+{
+  dt_variables_template_t *tmpl = dt_variables_template_new(source);
+  char *result = dt_variables_template_expand(params, tmpl, iterate);
+  dt_variables_template_free(tmpl);
 
   return result;
 }
@@ -1030,12 +1495,21 @@ void dt_variables_params_init(dt_variables_params_t **params)
   (*params)->data = g_malloc0(sizeof(dt_variables_data_t));
   (*params)->data->time = g_date_time_new_now_local();
   (*params)->data->exif_time[0] = 0;
+  (*params)->data->show_msec = dt_conf_get_bool("lighttable/ui/milliseconds");
+  (*params)->data->metadata = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  _reset_image_data((*params)->data);
   (*params)->sequence = -1;
   (*params)->img = NULL;
 }
 
 void dt_variables_params_destroy(dt_variables_params_t *params)
 {
+  _reset_image_data(params->data);
+  if(params->data->time)
+    g_date_time_unref(params->data->time);
+  g_free(params->data->homedir);
+  g_free(params->data->pictures_folder);
+  g_hash_table_destroy(params->data->metadata);
   g_free(params->data);
   g_free(params);
 }
@@ -1044,15 +1518,19 @@ void dt_variables_set_max_width_height(dt_variables_params_t *params, int max_wi
 {
   params->data->max_width = max_width;
   params->data->max_height = max_height;
+  // the export size of the image depends on it
+  params->data->cached_imgid = 0;
 }
 
 void dt_variables_set_upscale(dt_variables_params_t *params, gboolean upscale)
 {
   params->data->upscale = upscale;
+  params->data->cached_imgid = 0;
 }
 
 void dt_variables_set_time(dt_variables_params_t *params, const char *time)
 {
+  if(params->data->time) g_date_time_unref(params->data->time);
   params->data->time = dt_datetime_exif_to_gdatetime(time, darktable.utc_tz);
 }
 
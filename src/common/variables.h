@@ -63,6 +63,20 @@ void dt_variables_set_tags_flags(dt_variables_params_t *params, uint32_t flags);
 
 /** expands variables in string. the result should be freed with g_free(). */
 char *dt_variables_expand(dt_variables_params_t *params, gchar *source, gboolean iterate);
+
+/** a string with variables parsed once, to be expanded for many images. the data of an image is gathered
+ * only for the variables the template uses and is kept in the params for further expansions of that image. */
+typedef struct dt_variables_template_t dt_variables_template_t;
+
+/** parses source into a new template, to be freed with dt_variables_template_free(). */
+dt_variables_template_t *dt_variables_template_new(const gchar *source);
+/** frees a template, NULL is fine. */
+void dt_variables_template_free(dt_variables_template_t *tmpl);
+/** the string the template was parsed from. */
+const gchar *dt_variables_template_get_source(const dt_variables_template_t *tmpl);
+/** expands the variables of a template, same as dt_variables_expand(). the result should be freed with g_free(). */
+char *dt_variables_template_expand(dt_variables_params_t *params, const dt_variables_template_t *tmpl,
+                                   gboolean iterate);
 /** reset sequence number */
 void dt_variables_reset_sequence(dt_variables_params_t *params);
 
@@ -192,8 +192,9 @@ typedef struct dt_control_t
   pthread_t *thread, kick_on_workers_thread, update_gphoto_thread;
   dt_job_t **job;
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  GQueue queues[DT_JOB_QUEUE_MAX];
+  GHashTable *queued_fg; // jobs of DT_JOB_QUEUE_SYSTEM_FG -> their link in the queue, for deduping
+  size_t jobs_memory, jobs_gpu_memory; // declared by the jobs running right now
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
@@ -59,157 +59,231 @@ typedef struct dt_control_crawler_result_t
 } dt_control_crawler_result_t;
 
 
-GList *dt_control_crawler_run()
+// one image of the film roll being crawled
+typedef struct dt_control_crawler_entry_t
 {
-  sqlite3_stmt *stmt, *inner_stmt;
-  GList *result = NULL;
-  gboolean look_for_xmp = (dt_image_get_xmp_mode() != DT_WRITE_XMP_NEVER);
+  int id, version, flags, new_flags;
+  time_t timestamp;
+  gchar *image_path;
+  gboolean missing, newer_xmp;
+  time_t timestamp_xmp;
+  gchar xmp_path[PATH_MAX];
+} dt_control_crawler_entry_t;
 
-  sqlite3_prepare_v2(dt_database_get(darktable.db),
-                     "SELECT i.id, write_timestamp, version, folder || '" G_DIR_SEPARATOR_S "' || filename, flags "
-                     "FROM main.images i, main.film_rolls f ON i.film_id = f.id ORDER BY f.id, filename",
-                     -1, &stmt, NULL);
-  sqlite3_prepare_v2(dt_database_get(darktable.db), "UPDATE main.images SET flags = ?1 WHERE id = ?2", -1,
-                     &inner_stmt, NULL);
+static gboolean _crawler_file_exists_ext(char *extra_path, const size_t len, const char *ext, const char *EXT)
+{
+  memcpy(extra_path + len, ext, 3);
+  if(g_file_test(extra_path, G_FILE_TEST_EXISTS)) return TRUE;
+  memcpy(extra_path + len, EXT, 3);
+  return g_file_test(extra_path, G_FILE_TEST_EXISTS);
+}
 
-  // let's wrap this into a transaction, it might make it a little faster.
-  dt_database_start_transaction(darktable.db);
+// only touches the file system and e, so the images of a film roll can be checked in parallel
+static void _crawler_check(dt_control_crawler_entry_t *e, const gboolean look_for_xmp)
+{
+  const gchar *image_path = e->image_path;
 
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  // if the image is missing we ignore it.
+  if(!g_file_test(image_path, G_FILE_TEST_EXISTS))
   {
-    const int id = sqlite3_column_int(stmt, 0);
-    const time_t timestamp = sqlite3_column_int(stmt, 1);
-    const int version = sqlite3_column_int(stmt, 2);
-    const gchar *image_path = (char *)sqlite3_column_text(stmt, 3);
-    int flags = sqlite3_column_int(stmt, 4);
-
-    // if the image is missing we ignore it.
-    if(!g_file_test(image_path, G_FILE_TEST_EXISTS))
-    {
-      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is missing.\n", image_path, id);
-      continue;
-    }
+    e->missing = TRUE;
+    return;
+  }
 
-    // no need to look for xmp files if none get written anyway.
-    if(look_for_xmp)
-    {
-      // construct the xmp filename for this image
-      gchar xmp_path[PATH_MAX] = { 0 };
-      g_strlcpy(xmp_path, image_path, sizeof(xmp_path));
-      dt_image_path_append_version_no_db(version, xmp_path, sizeof(xmp_path));
-      size_t len = strlen(xmp_path);
-      if(len + 4 >= PATH_MAX) continue;
-      xmp_path[len++] = '.';
-      xmp_path[len++] = 'x';
-      xmp_path[len++] = 'm';
-      xmp_path[len++] = 'p';
-      xmp_path[len] = '\0';
-
-      // on Windows the encoding might not be UTF8
-      gchar *xmp_path_locale = dt_util_normalize_path(xmp_path);
-      int stat_res = -1;
+  // no need to look for xmp files if none get written anyway.
+  if(look_for_xmp)
+  {
+    // construct the xmp filename for this image
+    gchar *xmp_path = e->xmp_path;
+    g_strlcpy(xmp_path, image_path, PATH_MAX);
+    dt_image_path_append_version_no_db(e->version, xmp_path, PATH_MAX);
+    size_t len = strlen(xmp_path);
+    if(len + 4 >= PATH_MAX) return;
+    xmp_path[len++] = '.';
+    xmp_path[len++] = 'x';
+    xmp_path[len++] = 'm';
+    xmp_path[len++] = 'p';
+    xmp_path[len] = '\0';
+
+    // on Windows the encoding might not be UTF8
+    gchar *xmp_path_locale = dt_util_normalize_path(xmp_path);
+    int stat_res = -1;
 #ifdef _WIN32
-      // UTF8 paths fail in this context, but converting to UTF16 works
-      struct _stati64 statbuf;
-      if(xmp_path_locale) // in Windows dt_util_normalize_path returns NULL if file does not exist
-      {
-        wchar_t *wfilename = g_utf8_to_utf16(xmp_path_locale, -1, NULL, NULL, NULL);
-        stat_res = _wstati64(wfilename, &statbuf);
-        g_free(wfilename);
-      }
+    // UTF8 paths fail in this context, but converting to UTF16 works
+    struct _stati64 statbuf;
+    if(xmp_path_locale) // in Windows dt_util_normalize_path returns NULL if file does not exist
+    {
+      wchar_t *wfilename = g_utf8_to_utf16(xmp_path_locale, -1, NULL, NULL, NULL);
+      stat_res = _wstati64(wfilename, &statbuf);
+      g_free(wfilename);
+    }
  #else
-      struct stat statbuf;
-      stat_res = stat(xmp_path_locale, &statbuf);
+    struct stat statbuf;
+    stat_res = stat(xmp_path_locale, &statbuf);
 #endif
-      g_free(xmp_path_locale);
-      if(stat_res) continue; // TODO: shall we report these?
-
-      // step 1: check if the xmp is newer than our db entry
-      // FIXME: allow for a few seconds difference?
-      if(timestamp < statbuf.st_mtime)
-      {
-        dt_control_crawler_result_t *item
-            = (dt_control_crawler_result_t *)malloc(sizeof(dt_control_crawler_result_t));
-        item->id = id;
-        item->timestamp_xmp = statbuf.st_mtime;
-        item->timestamp_db = timestamp;
-        item->image_path = g_strdup(image_path);
-        item->xmp_path = g_strdup(xmp_path);
-
-        result = g_list_prepend(result, item);
-        dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is a newer xmp file.\n", xmp_path, id);
-      }
-      // older timestamps are the case for all images after the db upgrade. better not report these
-      //       else if(timestamp > statbuf.st_mtime)
-      //         printf("`%s' (%d) has an older xmp file.\n", image_path, id);
-    }
-
-    // step 2: check if the image has associated files (.txt, .wav)
-    size_t len = strlen(image_path);
-    const char *c = image_path + len;
-    while((c > image_path) && (*c != '.')) c--;
-    len = c - image_path + 1;
-
-    char *extra_path = (char *)calloc(len + 3 + 1, sizeof(char));
-    g_strlcpy(extra_path, image_path, len + 1);
+    g_free(xmp_path_locale);
+    if(stat_res) return; // TODO: shall we report these?
 
-    extra_path[len] = 't';
-    extra_path[len + 1] = 'x';
-    extra_path[len + 2] = 't';
-    gboolean has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
-
-    if(!has_txt)
+    // step 1: check if the xmp is newer than our db entry
+    // FIXME: allow for a few seconds difference?
+    // older timestamps are the case for all images after the db upgrade. better not report these
+    if(e->timestamp < statbuf.st_mtime)
     {
-      extra_path[len] = 'T';
-      extra_path[len + 1] = 'X';
-      extra_path[len + 2] = 'T';
-      has_txt = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+      e->newer_xmp = TRUE;
+      e->timestamp_xmp = statbuf.st_mtime;
     }
+  }
+
+  // step 2: check if the image has associated files (.txt, .wav)
+  size_t len = strlen(image_path);
+  const char *c = image_path + len;
+  while((c > image_path) && (*c != '.')) c--;
+  len = c - image_path + 1;
+
+  char *extra_path = (char *)calloc(len + 3 + 1, sizeof(char));
+  g_strlcpy(extra_path, image_path, len + 1);
+  const gboolean has_txt = _crawler_file_exists_ext(extra_path, len, "txt", "TXT");
+  const gboolean has_wav = _crawler_file_exists_ext(extra_path, len, "wav", "WAV");
+  free(extra_path);
+
+  // TODO: decide if we want to remove the flag for images that lost their extra file. currently we do (the
+  // else cases)
+  int new_flags = e->flags;
+  if(has_txt)
+    new_flags |= DT_IMAGE_HAS_TXT;
+  else
+    new_flags &= ~DT_IMAGE_HAS_TXT;
+  if(has_wav)
+    new_flags |= DT_IMAGE_HAS_WAV;
+  else
+    new_flags &= ~DT_IMAGE_HAS_WAV;
+  e->new_flags = new_flags;
+}
 
-    extra_path[len] = 'w';
-    extra_path[len + 1] = 'a';
-    extra_path[len + 2] = 'v';
-    gboolean has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+// crawl one film roll, prepending the images with a newer xmp to result
+static void _crawler_film(const int film_id, const gboolean look_for_xmp, sqlite3_stmt *images_stmt,
+                          sqlite3_stmt *flags_stmt, GList **result)
+{
+  GArray *entries = g_array_new(FALSE, TRUE, sizeof(dt_control_crawler_entry_t));
+  sqlite3_bind_int(images_stmt, 1, film_id);
+  while(sqlite3_step(images_stmt) == SQLITE_ROW)
+  {
+    dt_control_crawler_entry_t e = { 0 };
+    e.id = sqlite3_column_int(images_stmt, 0);
+    e.timestamp = sqlite3_column_int(images_stmt, 1);
+    e.version = sqlite3_column_int(images_stmt, 2);
+    e.image_path = g_strdup((char *)sqlite3_column_text(images_stmt, 3));
+    e.flags = e.new_flags = sqlite3_column_int(images_stmt, 4);
+    g_array_append_val(entries, e);
+  }
+  sqlite3_reset(images_stmt);
+  sqlite3_clear_bindings(images_stmt);
+
+  // the time goes into waiting for the file system, on a network share even more so
+  const int count = entries->len;
+  dt_control_crawler_entry_t *e = (dt_control_crawler_entry_t *)entries->data;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(count, e, look_for_xmp) \
+  schedule(dynamic)
+#endif
+  for(int k = 0; k < count; k++) _crawler_check(e + k, look_for_xmp);
 
-    if(!has_wav)
+  for(int k = 0; k < count; k++)
+  {
+    if(e[k].missing)
+      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is missing.\n", e[k].image_path, e[k].id);
+    if(e[k].newer_xmp)
     {
-      extra_path[len] = 'W';
-      extra_path[len + 1] = 'A';
-      extra_path[len + 2] = 'V';
-      has_wav = g_file_test(extra_path, G_FILE_TEST_EXISTS);
+      dt_control_crawler_result_t *item
+          = (dt_control_crawler_result_t *)malloc(sizeof(dt_control_crawler_result_t));
+      item->id = e[k].id;
+      item->timestamp_xmp = e[k].timestamp_xmp;
+      item->timestamp_db = e[k].timestamp;
+      item->image_path = g_strdup(e[k].image_path);
+      item->xmp_path = g_strdup(e[k].xmp_path);
+
+      *result = g_list_prepend(*result, item);
+      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is a newer xmp file.\n", e[k].xmp_path, e[k].id);
     }
-
-    // TODO: decide if we want to remove the flag for images that lost their extra file. currently we do (the
-    // else cases)
-    int new_flags = flags;
-    if(has_txt)
-      new_flags |= DT_IMAGE_HAS_TXT;
-    else
-      new_flags &= ~DT_IMAGE_HAS_TXT;
-    if(has_wav)
-      new_flags |= DT_IMAGE_HAS_WAV;
-    else
-      new_flags &= ~DT_IMAGE_HAS_WAV;
-    if(flags != new_flags)
+    if(e[k].flags != e[k].new_flags)
     {
-      sqlite3_bind_int(inner_stmt, 1, new_flags);
-      sqlite3_bind_int(inner_stmt, 2, id);
-      sqlite3_step(inner_stmt);
-      sqlite3_reset(inner_stmt);
-      sqlite3_clear_bindings(inner_stmt);
+      sqlite3_bind_int(flags_stmt, 1, e[k].new_flags);
+      sqlite3_bind_int(flags_stmt, 2, e[k].id);
+      sqlite3_step(flags_stmt);
+      sqlite3_reset(flags_stmt);
+      sqlite3_clear_bindings(flags_stmt);
     }
-
-    free(extra_path);
+    g_free(e[k].image_path);
   }
+  g_array_free(entries, TRUE);
+}
 
-  dt_database_release_transaction(darktable.db);
+static GList *_crawler_run(dt_job_t *job)
+{
+  sqlite3_stmt *stmt, *images_stmt, *flags_stmt;
+  GList *result = NULL;
+  const gboolean look_for_xmp = (dt_image_get_xmp_mode() != DT_WRITE_XMP_NEVER);
 
+  GArray *films = g_array_new(FALSE, FALSE, sizeof(int));
+  sqlite3_prepare_v2(dt_database_get(darktable.db), "SELECT id FROM main.film_rolls ORDER BY id", -1, &stmt,
+                     NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int film_id = sqlite3_column_int(stmt, 0);
+    g_array_append_val(films, film_id);
+  }
   sqlite3_finalize(stmt);
-  sqlite3_finalize(inner_stmt);
+
+  sqlite3_prepare_v2(dt_database_get(darktable.db),
+                     "SELECT i.id, write_timestamp, version, folder || '" G_DIR_SEPARATOR_S "' || filename, flags "
+                     "FROM main.images i, main.film_rolls f ON i.film_id = f.id WHERE f.id = ?1 ORDER BY filename",
+                     -1, &images_stmt, NULL);
+  sqlite3_prepare_v2(dt_database_get(darktable.db), "UPDATE main.images SET flags = ?1 WHERE id = ?2", -1,
+                     &flags_stmt, NULL);
+
+  // film roll by film roll, so the library is never held up for long. the flags change for a few images at
+  // most, no transaction is kept open across the file system checks.
+  const int nb_films = films->len;
+  for(int k = 0; k < nb_films && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED; k++)
+  {
+    _crawler_film(g_array_index(films, int, k), look_for_xmp, images_stmt, flags_stmt, &result);
+    dt_control_job_set_progress(job, (double)(k + 1) / nb_films);
+  }
+
+  sqlite3_finalize(images_stmt);
+  sqlite3_finalize(flags_stmt);
+  g_array_free(films, TRUE);
 
   return g_list_reverse(result); // list was built in reverse order, so un-reverse it
 }
 
+static gboolean _crawler_show_image_list(gpointer user_data)
+{
+  dt_control_crawler_show_image_list((GList *)user_data);
+  return FALSE;
+}
+
+static int32_t _crawler_job_run(dt_job_t *job)
+{
+  const double start = dt_get_wtime();
+  GList *images = _crawler_run(job);
+  dt_print(DT_DEBUG_CONTROL, "[crawler] took %f seconds, %d newer xmp files\n", dt_get_wtime() - start,
+           g_list_length(images));
+
+  // the popup only once everything has been looked at. it's built on the gui thread.
+  if(images) g_idle_add(_crawler_show_image_list, images);
+  return 0;
+}
+
+void dt_control_crawler_start()
+{
+  dt_job_t *job = dt_control_job_create(&_crawler_job_run, "crawl library");
+  if(!job) return;
+  dt_control_job_add_progress(job, _("checking sidecar files"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
 
 /********************* the gui stuff *********************/
 
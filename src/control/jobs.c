@@ -18,6 +18,8 @@
 
 #include "control/jobs.h"
 #include "control/control.h"
+#include "common/resource_limits.h"
+#include "common/trace.h"
 
 #define DT_CONTROL_FG_PRIORITY 4
 #define DT_CONTROL_MAX_JOBS 30
@@ -47,10 +49,17 @@ typedef struct _dt_job_t
   unsigned char priority;
   dt_job_queue_t queue;
 
+  // estimated needs, see dt_control_job_set_resources()
+  size_t memory;
+  size_t gpu_memory;
+
   dt_job_state_change_callback state_changed_cb;
 
   dt_progress_t *progress;
 
+  // dt_atomic_int * to raise on cancellation, protected by state_mutex
+  GSList *cancel_flags;
+
   char description[DT_CONTROL_DESCRIPTION_LEN];
 } _dt_job_t;
 
@@ -63,13 +72,34 @@ typedef struct _dt_job_t
 static inline int dt_control_job_equal(_dt_job_t *j1, _dt_job_t *j2)
 {
   if(!j1 || !j2) return 0;
-  if(j1->params_size != 0 && j1->params_size == j2->params_size)
+  if(j1->params_size != j2->params_size) return 0;
+  if(j1->params_size != 0)
     return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb
             && j1->queue == j2->queue && (memcmp(j1->params, j2->params, j1->params_size) == 0));
   return (j1->execute == j2->execute && j1->state_changed_cb == j2->state_changed_cb && j1->queue == j2->queue
           && (g_strcmp0(j1->description, j2->description) == 0));
 }
 
+/** hash matching dt_control_job_equal(), so that queued jobs can be found without walking the queue */
+static guint _control_job_hash(gconstpointer key)
+{
+  const _dt_job_t *job = (const _dt_job_t *)key;
+  guint hash = g_direct_hash(job->execute) ^ (g_direct_hash(job->state_changed_cb) * 31u) ^ job->queue;
+  if(job->params_size != 0)
+  {
+    const unsigned char *p = (const unsigned char *)job->params;
+    for(size_t k = 0; k < job->params_size; k++) hash = hash * 33u + p[k];
+  }
+  else
+    hash = hash * 33u + g_str_hash(job->description);
+  return hash;
+}
+
+static gboolean _control_job_hash_equal(gconstpointer a, gconstpointer b)
+{
+  return dt_control_job_equal((_dt_job_t *)a, (_dt_job_t *)b);
+}
+
 static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
 {
   if(!job) return;
@@ -80,9 +110,41 @@ static void dt_control_job_set_state(_dt_job_t *job, dt_job_state_t state)
     job->progress = NULL;
   }
   job->state = state;
-  /* pass state change to callback */
-  if(job->state_changed_cb) job->state_changed_cb(job, state);
+  if(state == DT_JOB_STATE_CANCELLED)
+    for(GSList *f = job->cancel_flags; f; f = g_slist_next(f)) dt_atomic_set_int((dt_atomic_int *)f->data, TRUE);
+  const dt_job_state_change_callback cb = job->state_changed_cb;
   dt_pthread_mutex_unlock(&job->state_mutex);
+  /* pass state change to callback, without the lock so it may look at the job from another thread */
+  if(cb) cb(job, state);
+}
+
+void dt_control_job_add_cancel_flag(_dt_job_t *job, dt_atomic_int *flag)
+{
+  if(!job || !flag) return;
+  dt_pthread_mutex_lock(&job->state_mutex);
+  job->cancel_flags = g_slist_prepend(job->cancel_flags, flag);
+  if(job->state == DT_JOB_STATE_CANCELLED) dt_atomic_set_int(flag, TRUE);
+  dt_pthread_mutex_unlock(&job->state_mutex);
+}
+
+void dt_control_job_remove_cancel_flag(_dt_job_t *job, dt_atomic_int *flag)
+{
+  if(!job || !flag) return;
+  dt_pthread_mutex_lock(&job->state_mutex);
+  job->cancel_flags = g_slist_remove(job->cancel_flags, flag);
+  dt_pthread_mutex_unlock(&job->state_mutex);
+}
+
+static __thread _dt_job_t *_current_job = NULL;
+
+dt_job_t *dt_control_job_get_current()
+{
+  return _current_job;
+}
+
+void dt_control_job_set_current(_dt_job_t *job)
+{
+  _current_job = job;
 }
 
 dt_job_state_t dt_control_job_get_state(_dt_job_t *job)
@@ -111,6 +173,13 @@ void dt_control_job_set_params_with_size(dt_job_t *job, void *params, size_t par
   job->params_destroy = callback;
 }
 
+void dt_control_job_set_resources(_dt_job_t *job, size_t memory, size_t gpu_memory)
+{
+  if(!job || dt_control_job_get_state(job) != DT_JOB_STATE_INITIALIZED) return;
+  job->memory = memory;
+  job->gpu_memory = gpu_memory;
+}
+
 void *dt_control_job_get_params(const _dt_job_t *job)
 {
   if(!job) return NULL;
@@ -138,10 +207,12 @@ dt_job_t *dt_control_job_create(dt_job_execute_callback execute, const char *msg
 void dt_control_job_dispose(_dt_job_t *job)
 {
   if(!job) return;
+  // the callback still sees a complete job
+  dt_control_job_set_state(job, DT_JOB_STATE_DISPOSED);
   if(job->progress) dt_control_progress_destroy(darktable.control, job->progress);
   job->progress = NULL;
-  dt_control_job_set_state(job, DT_JOB_STATE_DISPOSED);
   if(job->params_destroy) job->params_destroy(job->params);
+  g_slist_free(job->cancel_flags);
   dt_pthread_mutex_destroy(&job->state_mutex);
   dt_pthread_mutex_destroy(&job->wait_mutex);
   free(job);
@@ -212,7 +283,11 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
     dt_control_job_set_state(job, DT_JOB_STATE_RUNNING);
 
     /* execute job */
+    const double begin = dt_trace_begin();
+    _current_job = job;
     job->result = job->execute(job);
+    _current_job = NULL;
+    dt_trace_complete("job", job->description, begin, "\"reserved\":%d", res);
 
     dt_control_job_set_state(job, DT_JOB_STATE_FINISHED);
     dt_print(DT_DEBUG_CONTROL, "[run_job-] %02d %f ", res, dt_get_wtime());
@@ -224,6 +299,21 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
   return 0;
 }
 
+// can the job start next to the ones already running? call with queue_mutex held
+static gboolean _control_job_admit(dt_control_t *control, const _dt_job_t *job)
+{
+  if(job->memory && control->jobs_memory
+     && control->jobs_memory + job->memory > dt_jobs_memory_budget())
+    return FALSE;
+  // without opencl the jobs run on the cpu and only the host memory counts
+  if(job->gpu_memory && control->jobs_gpu_memory)
+  {
+    const size_t gpu_budget = dt_jobs_gpu_budget();
+    if(gpu_budget && control->jobs_gpu_memory + job->gpu_memory > gpu_budget) return FALSE;
+  }
+  return TRUE;
+}
+
 static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
 {
   /*
@@ -235,6 +325,7 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
    *   * user background
    *   * system background
    * - the jobs that didn't get picked this round get their priority incremented
+   * - a queue head that would exceed the memory budgets waits for running jobs to finish
    */
 
   dt_pthread_mutex_lock(&control->queue_mutex);
@@ -245,10 +336,10 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   int max_priority = -1;
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(control->queues[i] == NULL) continue;
+    if(g_queue_is_empty(&control->queues[i])) continue;
     if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
-    if(_job->priority > max_priority)
+    _dt_job_t *_job = (_dt_job_t *)g_queue_peek_head(&control->queues[i]);
+    if(_job->priority > max_priority && _control_job_admit(control, _job))
     {
       max_priority = _job->priority;
       job = _job;
@@ -267,10 +358,11 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   // invariant -> job is the one we are looking for
 
   // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
+  g_queue_pop_head(&control->queues[winner_queue]);
+  if(winner_queue == DT_JOB_QUEUE_SYSTEM_FG) g_hash_table_remove(control->queued_fg, job);
   if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
+  control->jobs_memory += job->memory;
+  control->jobs_gpu_memory += job->gpu_memory;
 
   // and place it in scheduled job array (for job deduping)
   control->job[dt_control_get_threadid()] = job;
@@ -278,8 +370,8 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   // increment the priorities of the others
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
+    if(i == winner_queue || g_queue_is_empty(&control->queues[i])) continue;
+    ((_dt_job_t *)g_queue_peek_head(&control->queues[i]))->priority++;
   }
 
   dt_pthread_mutex_unlock(&control->queue_mutex);
@@ -297,7 +389,12 @@ static void dt_control_job_execute(_dt_job_t *job)
   dt_control_job_set_state(job, DT_JOB_STATE_RUNNING);
 
   /* execute job */
+  const double begin = dt_trace_begin();
+  _dt_job_t *const outer = _current_job; // jobs run synchronously may nest
+  _current_job = job;
   job->result = job->execute(job);
+  _current_job = outer;
+  dt_trace_complete("job", job->description, begin, "\"queue\":%d", job->queue);
 
   dt_control_job_set_state(job, DT_JOB_STATE_FINISHED);
 
@@ -324,8 +421,19 @@ static int32_t dt_control_run_job(dt_control_t *control)
   dt_pthread_mutex_lock(&control->queue_mutex);
   control->job[dt_control_get_threadid()] = NULL;
   if(job->queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = FALSE;
+  control->jobs_memory -= job->memory;
+  control->jobs_gpu_memory -= job->gpu_memory;
+  const gboolean released = job->memory || job->gpu_memory;
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
+  // jobs held back for memory may fit now
+  if(released)
+  {
+    dt_pthread_mutex_lock(&control->cond_mutex);
+    pthread_cond_broadcast(&control->cond);
+    dt_pthread_mutex_unlock(&control->cond_mutex);
+  }
+
   // and free it
   dt_control_job_dispose(job);
 
@@ -392,10 +500,9 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
 
   dt_pthread_mutex_lock(&control->queue_mutex);
 
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
+  GQueue *queue = &control->queues[queue_id];
 
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %u | ", g_queue_get_length(queue));
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -424,40 +531,34 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     }
 
     // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    _dt_job_t *other_job = NULL;
+    GList *iter = NULL;
+    if(g_hash_table_lookup_extended(control->queued_fg, job, (gpointer *)&other_job, (gpointer *)&iter))
     {
-      _dt_job_t *other_job = (_dt_job_t *)iter->data;
-      if(dt_control_job_equal(job, other_job))
-      {
-        dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
-        dt_control_job_print(other_job);
-        dt_print(DT_DEBUG_CONTROL, "\n");
+      dt_print(DT_DEBUG_CONTROL, "[add_job] found job already in queue: ");
+      dt_control_job_print(other_job);
+      dt_print(DT_DEBUG_CONTROL, "\n");
 
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
+      g_queue_delete_link(queue, iter);
+      g_hash_table_remove(control->queued_fg, other_job);
 
-        job_for_disposal = job;
+      job_for_disposal = job;
 
-        job = other_job;
-        break; // there can't be any further copy in the list
-      }
+      job = other_job;
     }
 
     // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
+    g_queue_push_head(queue, job);
+    g_hash_table_insert(control->queued_fg, job, g_queue_peek_head_link(queue));
 
     // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
+    if(g_queue_get_length(queue) > DT_CONTROL_MAX_JOBS)
     {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
+      _dt_job_t *last = (_dt_job_t *)g_queue_pop_tail(queue);
+      g_hash_table_remove(control->queued_fg, last);
+      dt_control_job_set_state(last, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(last);
     }
-
-    control->queue_length[queue_id] = length;
   }
   else
   {
@@ -468,8 +569,7 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    g_queue_push_tail(queue, job);
   }
   dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
   dt_pthread_mutex_unlock(&control->queue_mutex);
@@ -596,8 +696,11 @@ void dt_control_job_set_progress(dt_job_t *job, double value)
 
 double dt_control_job_get_progress(dt_job_t *job)
 {
-  if(!job || !job->progress) return -1.0;
-  return dt_control_progress_get_progress(job->progress);
+  if(!job) return -1.0;
+  dt_pthread_mutex_lock(&job->state_mutex);
+  const double progress = job->progress ? dt_control_progress_get_progress(job->progress) : -1.0;
+  dt_pthread_mutex_unlock(&job->state_mutex);
+  return progress;
 }
 
 
@@ -608,6 +711,8 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  for(int k = 0; k < DT_JOB_QUEUE_MAX; k++) g_queue_init(&control->queues[k]);
+  control->queued_fg = g_hash_table_new(_control_job_hash, _control_job_hash_equal);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -643,6 +748,8 @@ void dt_control_jobs_cleanup(dt_control_t *control)
 {
   free(control->job);
   free(control->thread);
+  g_hash_table_destroy(control->queued_fg);
+  control->queued_fg = NULL;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include "common/atomic.h"
+
 #include <glib.h>
 #include <inttypes.h>
 #include <stddef.h>
@@ -65,6 +67,15 @@ void dt_control_job_set_state_callback(dt_job_t *job, dt_job_state_change_callba
 /** cancel a job, running or in queue. */
 void dt_control_job_cancel(dt_job_t *job);
 dt_job_state_t dt_control_job_get_state(dt_job_t *job);
+/** set *flag to TRUE once the job gets cancelled, right away if it already is. lets long running
+  * code deep down (a pixelpipe's shutdown flag, ...) stop without knowing about jobs.
+  * remove the flag again before it goes out of scope. */
+void dt_control_job_add_cancel_flag(dt_job_t *job, dt_atomic_int *flag);
+void dt_control_job_remove_cancel_flag(dt_job_t *job, dt_atomic_int *flag);
+/** the job run by the calling thread, NULL if none. helper threads started by a job may
+  * take over their job with dt_control_job_set_current(). */
+dt_job_t *dt_control_job_get_current();
+void dt_control_job_set_current(dt_job_t *job);
 /** wait for a job to finish execution. */
 void dt_control_job_wait(dt_job_t *job);
 /** set job params and a callback to destroy those params */
@@ -76,6 +87,11 @@ void dt_control_job_set_params_with_size(dt_job_t *job, void *params, size_t par
 /** get job params. WARNING: you must not free them. dt_control_job_dispose() will take care of that */
 void *dt_control_job_get_params(const dt_job_t *job);
 
+/** declare the memory (host and opencl) the job will need while running. the scheduler
+  * holds it back while the other running jobs already use up the budgets from
+  * resource_limits.h. a single job is always admitted, however big. */
+void dt_control_job_set_resources(dt_job_t *job, size_t memory, size_t gpu_memory);
+
 void dt_control_job_add_progress(dt_job_t *job, const char *message, gboolean cancellable);
 void dt_control_job_set_progress_message(dt_job_t *job, const char *message);
 void dt_control_job_set_progress(dt_job_t *job, double value);
@@ -16,6 +16,8 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE // for syscall()
+
 #include "control/jobs/control_jobs.h"
 #include "common/collection.h"
 #include "common/darktable.h"
@@ -30,23 +32,31 @@
 #include "common/imageio_dng.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
+#include "common/resource_limits.h"
 #include "common/tags.h"
 #include "common/undo.h"
 #include "common/grouping.h"
 #include "common/import_session.h"
 #include "common/utility.h"
+#include "common/atomic.h"
 #include "common/datetime.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/pixelpipe_hb.h"
 
 #include "gui/gtk.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <gio/gio.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #ifndef _WIN32
 #include <glob.h>
 #endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 #ifdef __APPLE__
 #include "osx/osx.h"
 #endif
@@ -62,6 +72,16 @@
 // short to avoid the impression that the import has gotten stuck.  Setting this too low will impact the
 // overall time for a large import.
 #define PROGRESS_UPDATE_INTERVAL 0.5
+// While importing, a few threads read the headers of the next files so that the metadata parsing (which
+// exiv2 only allows one thread at a time) finds them in the page cache instead of waiting on the card.
+#define IMPORT_PREFETCH_THREADS 4
+#define IMPORT_PREFETCH_AHEAD   32
+#define IMPORT_PREFETCH_BYTES   (2 << 20)
+// Copying from a card is done by a few threads in parallel, with large buffers, while the import job reads
+// the metadata of the files already copied. The names are picked this many files ahead.
+#define IMPORT_COPY_THREADS 4
+#define IMPORT_COPY_AHEAD   16
+#define IMPORT_COPY_BUFFER  (4 << 20)
 
 typedef struct dt_control_datetime_t
 {
@@ -269,6 +289,19 @@ static int32_t dt_control_write_sidecar_files_job_run(dt_job_t *job)
   return 0;
 }
 
+// 4 x float buffers of the largest sensor in the list, 0 if none is known
+static size_t _images_float_buffer_size(const GList *imgs)
+{
+  size_t largest = 0;
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    dt_image_hot_t hot;
+    if(dt_image_cache_get_hot(darktable.image_cache, GPOINTER_TO_INT(l->data), &hot))
+      largest = MAX(largest, (size_t)hot.width * hot.height);
+  }
+  return largest * 4 * sizeof(float);
+}
+
 typedef struct dt_control_merge_hdr_t
 {
   uint32_t first_imgid;
@@ -291,10 +324,19 @@ typedef struct dt_control_merge_hdr_t
   gboolean abort;
 } dt_control_merge_hdr_t;
 
+// one bracket as it comes out of the pipe, waiting to be merged
+typedef struct dt_control_merge_hdr_slot_t
+{
+  float *pixels;
+  int wd;
+  int ht;
+  gboolean ready;
+} dt_control_merge_hdr_slot_t;
+
 typedef struct dt_control_merge_hdr_format_t
 {
   dt_imageio_module_data_t parent;
-  dt_control_merge_hdr_t *d;
+  dt_control_merge_hdr_slot_t *slot;
 } dt_control_merge_hdr_format_t;
 
 static int dt_control_merge_hdr_bpp(dt_imageio_module_data_t *data)
@@ -332,6 +374,7 @@ static float envelope(const float xx)
   }
 }
 
+// the "format" the brackets are exported to: keep a copy of the raw data for the merge
 static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const char *filename,
                                         const void *const ivoid,
                                         dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
@@ -339,8 +382,21 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
                                         dt_dev_pixelpipe_t *pipe, const gboolean export_masks)
 {
   dt_control_merge_hdr_format_t *data = (dt_control_merge_hdr_format_t *)datai;
-  dt_control_merge_hdr_t *d = data->d;
+  dt_control_merge_hdr_slot_t *slot = data->slot;
+  const size_t size = (size_t)datai->width * datai->height;
+  slot->pixels = dt_alloc_align_float(size);
+  if(!slot->pixels) return 1;
+  memcpy(slot->pixels, ivoid, size * sizeof(float));
+  slot->wd = datai->width;
+  slot->ht = datai->height;
+  return 0;
+}
 
+// add one bracket to the accumulation buffers. this has to see the brackets in
+// order, the white level and the clipped pixels depend on the ones before.
+static int _merge_hdr_accumulate(dt_control_merge_hdr_t *d, const int imgid, const void *const ivoid,
+                                 const int width, const int height)
+{
   // just take a copy. also do it after blocking read, so filters will make sense.
   const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
   const dt_image_t image = *img;
@@ -360,10 +416,10 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
     roi.y = image.crop_y;
     for(int j=0;j<6;j++)
       for(int i = 0; i < 6; i++) d->first_xtrans[j][i] = FCxtrans(j, i, &roi, image.buf_dsc.xtrans);
-    d->pixels = calloc((size_t)datai->width * datai->height, sizeof(float));
-    d->weight = calloc((size_t)datai->width * datai->height, sizeof(float));
-    d->wd = datai->width;
-    d->ht = datai->height;
+    d->pixels = calloc((size_t)width * height, sizeof(float));
+    d->weight = calloc((size_t)width * height, sizeof(float));
+    d->wd = width;
+    d->ht = height;
     d->orientation = image.orientation;
     for(int i = 0; i < 3; i++)
       d->wb_coeffs[i] = image.wb_coeffs[i];
@@ -378,7 +434,7 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
     d->abort = TRUE;
     return 1;
   }
-  else if(datai->width != d->wd || datai->height != d->ht || d->first_filter != image.buf_dsc.filters
+  else if(width != d->wd || height != d->ht || d->first_filter != image.buf_dsc.filters
           || d->orientation != image.orientation)
   {
     dt_control_log(_("images have to be of same size and orientation!"));
@@ -469,48 +525,140 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
   return 0;
 }
 
-static int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
+#define DT_CONTROL_MERGE_HDR_MAX_WORKERS 4
+
+typedef struct dt_control_merge_hdr_feed_t
 {
-  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
-  GList *t = params->index;
-  const guint total = g_list_length(t);
-  char message[512] = { 0 };
-  double fraction = 0;
-  snprintf(message, sizeof(message), ngettext("merging %d image", "merging %d images", total), total);
+  dt_job_t *job;
+  int *imgs;
+  dt_control_merge_hdr_slot_t *slots;
+  int total;
+  int window;     // brackets allowed in flight ahead of the merge
+  int omp_threads;
+  gboolean is_scaling;
 
-  dt_control_job_set_progress_message(job, message);
+  GMutex lock;
+  GCond cond;
+  int next;       // next bracket to be picked by a worker
+  int merged;     // brackets merged so far
+  gboolean abort;
+} dt_control_merge_hdr_feed_t;
 
-  dt_control_merge_hdr_t d = (dt_control_merge_hdr_t){.epsw = 1e-8f, .abort = FALSE };
+static gpointer _merge_hdr_feed_worker(gpointer data)
+{
+  dt_control_merge_hdr_feed_t *feed = (dt_control_merge_hdr_feed_t *)data;
+  dt_control_job_set_current(feed->job);
+#ifdef _OPENMP
+  omp_set_num_threads(feed->omp_threads);
+#endif
 
   dt_imageio_module_format_t buf = (dt_imageio_module_format_t){.mime = dt_control_merge_hdr_mime,
                                                                 .levels = dt_control_merge_hdr_levels,
                                                                 .bpp = dt_control_merge_hdr_bpp,
                                                                 .write_image = dt_control_merge_hdr_process };
 
-  dt_control_merge_hdr_format_t dat = (dt_control_merge_hdr_format_t){.parent = { 0 }, .d = &d };
-
-  int num = 1;
-  while(t)
+  g_mutex_lock(&feed->lock);
+  while(TRUE)
   {
-    if(d.abort) goto end;
+    while(!feed->abort && feed->next < feed->total && feed->next >= feed->merged + feed->window)
+      g_cond_wait(&feed->cond, &feed->lock);
+    if(feed->abort || feed->next >= feed->total) break;
+    const int i = feed->next++;
+    g_mutex_unlock(&feed->lock);
 
-    const uint32_t imgid = GPOINTER_TO_INT(t->data);
+    dt_control_merge_hdr_format_t dat = (dt_control_merge_hdr_format_t){.parent = { 0 }, .slot = &feed->slots[i] };
+    dt_imageio_export_with_flags(feed->imgs[i], "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE,
+                                 FALSE, TRUE, feed->is_scaling, FALSE, "pre:rawprepare", FALSE, FALSE,
+                                 DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL, NULL, i + 1, feed->total, NULL);
 
-    const gboolean is_scaling =
-      dt_conf_is_equal("plugins/lighttable/export/resizing", "scaling");
+    g_mutex_lock(&feed->lock);
+    feed->slots[i].ready = TRUE;
+    g_cond_broadcast(&feed->cond);
+  }
+  // the merge waits on every bracket, mark the ones we won't do
+  if(feed->abort)
+    for(int i = feed->next; i < feed->total; i++) feed->slots[i].ready = TRUE;
+  feed->next = feed->total;
+  g_cond_broadcast(&feed->cond);
+  g_mutex_unlock(&feed->lock);
 
-    dt_imageio_export_with_flags(imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE, FALSE, TRUE, is_scaling,
-                                 FALSE, "pre:rawprepare", FALSE, FALSE, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL,
-                                 NULL, num, total, NULL);
+  dt_control_job_set_current(NULL);
+  return NULL;
+}
 
-    t = g_list_next(t);
+static int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  GList *t = params->index;
+  const guint total = g_list_length(t);
+  char message[512] = { 0 };
+  double fraction = 0;
+  snprintf(message, sizeof(message), ngettext("merging %d image", "merging %d images", total), total);
+
+  dt_control_job_set_progress_message(job, message);
+
+  dt_control_merge_hdr_t d = (dt_control_merge_hdr_t){.epsw = 1e-8f, .abort = FALSE };
+
+  // the brackets are read and run through the pipe by a few threads side by side,
+  // while this one merges them in order as soon as they are ready.
+  dt_control_merge_hdr_feed_t feed = { 0 };
+  feed.job = job;
+  feed.total = total;
+  feed.imgs = g_malloc_n(total, sizeof(int));
+  feed.slots = g_malloc0_n(total, sizeof(dt_control_merge_hdr_slot_t));
+  feed.is_scaling = dt_conf_is_equal("plugins/lighttable/export/resizing", "scaling");
+  int n = 0;
+  for(const GList *l = t; l; l = g_list_next(l)) feed.imgs[n++] = GPOINTER_TO_INT(l->data);
+  g_mutex_init(&feed.lock);
+  g_cond_init(&feed.cond);
+
+  // each bracket in flight holds a float buffer the size of the sensor
+  const size_t bracket = _images_float_buffer_size(t) / 4;
+  int workers = CLAMP(darktable.num_openmp_threads / 4, 1, DT_CONTROL_MERGE_HDR_MAX_WORKERS);
+  if(bracket) workers = MIN(workers, (int)MAX(1, dt_get_available_mem() / (4 * bracket)));
+  workers = MAX(1, MIN(workers, (int)total));
+  feed.window = workers + 1;
+  feed.omp_threads = MAX(1, darktable.num_openmp_threads / workers);
+
+  GThread **threads = g_malloc_n(workers, sizeof(GThread *));
+  for(int i = 0; i < workers; i++) threads[i] = g_thread_new("merge hdr", _merge_hdr_feed_worker, &feed);
+
+  for(int i = 0; i < total; i++)
+  {
+    g_mutex_lock(&feed.lock);
+    while(!feed.slots[i].ready) g_cond_wait(&feed.cond, &feed.lock);
+    g_mutex_unlock(&feed.lock);
+
+    dt_control_merge_hdr_slot_t *slot = &feed.slots[i];
+    if(!d.abort && dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) d.abort = TRUE;
+    // a bracket that failed to export is skipped, as before
+    if(!d.abort && slot->pixels)
+      _merge_hdr_accumulate(&d, feed.imgs[i], slot->pixels, slot->wd, slot->ht);
+    dt_free_align(slot->pixels);
+    slot->pixels = NULL;
+
+    g_mutex_lock(&feed.lock);
+    feed.merged = i + 1;
+    if(d.abort) feed.abort = TRUE;
+    g_cond_broadcast(&feed.cond);
+    g_mutex_unlock(&feed.lock);
+
+    if(d.abort) break;
 
     /* update the progress bar */
     fraction += 1.0 / (total + 1);
     dt_control_job_set_progress(job, fraction);
-    num++;
   }
 
+  for(int i = 0; i < workers; i++) g_thread_join(threads[i]);
+  g_free(threads);
+  // brackets done ahead of an abort
+  for(int i = 0; i < total; i++) dt_free_align(feed.slots[i].pixels);
+  g_free(feed.slots);
+  g_free(feed.imgs);
+  g_cond_clear(&feed.cond);
+  g_mutex_clear(&feed.lock);
+
   if(d.abort) goto end;
 
 // normalize by white level to make clipping at 1.0 work as expected
@@ -577,36 +725,19 @@ static int32_t dt_control_duplicate_images_job_run(dt_job_t *job)
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
   GList *t = params->index;
   const guint total = g_list_length(t);
-  double fraction = 0.0f;
   char message[512] = { 0 };
 
   dt_undo_start_group(darktable.undo, DT_UNDO_DUPLICATE);
 
   snprintf(message, sizeof(message), ngettext("duplicating %d image", "duplicating %d images", total), total);
   dt_control_job_set_progress_message(job, message);
-  while(t)
-  {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    const int newimgid = dt_image_duplicate(imgid);
-    if(newimgid != -1)
-    {
-      if(GPOINTER_TO_INT(params->data))
-        dt_history_delete_on_image(newimgid);
-      else
-        dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL, TRUE, TRUE);
-
-      // a duplicate should keep the change time stamp of the original
-      dt_image_cache_set_change_timestamp_from_image(darktable.image_cache, newimgid, imgid);
-
-      dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, NULL);
-    }
-    t = g_list_next(t);
-    fraction += 1.0 / total;
-    dt_control_job_set_progress(job, fraction);
-  }
+  GList *dups = dt_image_duplicate_images(t, GPOINTER_TO_INT(params->data));
+  g_list_free(dups);
+  dt_control_job_set_progress(job, 1.0);
 
   dt_undo_end_group(darktable.undo);
 
+  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED);
   dt_control_queue_redraw_center();
   return 0;
@@ -1263,6 +1394,9 @@ static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
   return 0;
 }
 
+// images per batch of dt_exif_read_list() and per database transaction
+#define DT_REFRESH_EXIF_BATCH 64
+
 static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1273,36 +1407,75 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
   char message[512] = { 0 };
   snprintf(message, sizeof(message), ngettext("refreshing info for %d image", "refreshing info for %d images", total), total);
   dt_control_job_set_progress_message(job, message);
-  while(t)
+  const gboolean ignore_rating = dt_conf_get_bool("ui_last/ignore_exif_rating");
+
+  // the metadata of a batch is read in parallel into copies of the images, which then go back to the cache and
+  // the library in one transaction. the sidecars follow, in parallel again.
+  dt_image_t *batch = g_new(dt_image_t, DT_REFRESH_EXIF_BATCH);
+  char(*paths)[PATH_MAX] = g_malloc(sizeof(*paths) * DT_REFRESH_EXIF_BATCH);
+  const char **path_ptrs = g_new(const char *, DT_REFRESH_EXIF_BATCH);
+  int *results = g_new(int, DT_REFRESH_EXIF_BATCH);
+  int32_t ids[DT_REFRESH_EXIF_BATCH];
+
+  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    if(imgid >= 0)
+    int count = 0;
+    for(; t && count < DT_REFRESH_EXIF_BATCH; t = g_list_next(t))
     {
-      gboolean from_cache = TRUE;
-      char sourcefile[PATH_MAX];
-      dt_image_full_path(imgid, sourcefile, sizeof(sourcefile), &from_cache);
-
-      dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
-      if(img)
+      const int imgid = GPOINTER_TO_INT(t->data);
+      if(imgid < 0)
       {
-        const uint32_t flags = img->flags;
-        dt_exif_read(img, sourcefile);
-        if(dt_conf_get_bool("ui_last/ignore_exif_rating"))
-          img->flags = flags;
-        dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_SAFE);
+        fprintf(stderr,"[dt_control_refresh_exif_run] illegal imgid %i\n", imgid);
+        continue;
       }
-      else
+      const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+      if(!img)
+      {
         fprintf(stderr,"[dt_control_refresh_exif_run] couldn't dt_image_cache_get for imgid %i\n", imgid);
+        continue;
+      }
+      batch[count] = *img;
+      dt_image_cache_read_release(darktable.image_cache, img);
 
-      DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
+      gboolean from_cache = TRUE;
+      dt_image_full_path(imgid, paths[count], sizeof(paths[count]), &from_cache);
+      path_ptrs[count] = paths[count];
+      ids[count] = imgid;
+      count++;
     }
-    else
-      fprintf(stderr,"[dt_control_refresh_exif_run] illegal imgid %i\n", imgid);
+    if(!count) continue;
 
-    t = g_list_next(t);
-    fraction += 1.0 / total;
+    dt_exif_read_list(batch, path_ptrs, results, count);
+
+    dt_database_start_transaction(darktable.db);
+    for(int k = 0; k < count; k++)
+    {
+      dt_image_t *img = dt_image_cache_get(darktable.image_cache, ids[k], 'w');
+      if(!img) continue;
+      const uint32_t flags = img->flags;
+      dt_cache_entry_t *entry = img->cache_entry;
+      *img = batch[k];
+      img->cache_entry = entry;
+      if(ignore_rating) img->flags = flags;
+      dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
+    }
+    dt_database_release_transaction(darktable.db);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) default(none) dt_omp_firstprivate(ids, count)
+#endif
+    for(int k = 0; k < count; k++) dt_image_write_sidecar_file(ids[k]);
+
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
+    fraction += (double)count / total;
     dt_control_job_set_progress(job, fraction);
   }
+
+  g_free(results);
+  g_free(path_ptrs);
+  g_free(paths);
+  g_free(batch);
+
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
                              g_list_copy(params->index));
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -1312,6 +1485,158 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 }
 
 
+// export a single image, returns TRUE if its tags changed
+static gboolean _export_image(dt_job_t *job, dt_control_export_t *settings, dt_imageio_module_format_t *mformat,
+                              dt_imageio_module_storage_t *mstorage, dt_imageio_module_data_t *fdata,
+                              dt_export_metadata_t *metadata, const int imgid, const int num, const int total,
+                              const guint tagid, const guint etagid)
+{
+  gboolean tag_change = FALSE;
+
+  // remove 'changed' tag from image
+  if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+  // make sure the 'exported' tag is set on the image
+  if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+
+  /* register export timestamp in cache */
+  dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+
+  // check if image still exists:
+  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
+  if(image)
+  {
+    char imgfilename[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+    if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+    {
+      dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+      fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
+      // dt_image_remove(imgid);
+      dt_image_cache_read_release(darktable.image_cache, image);
+    }
+    else
+    {
+      dt_image_cache_read_release(darktable.image_cache, image);
+      if(mstorage->store(mstorage, settings->sdata, imgid, mformat, fdata, num, total, settings->high_quality,
+                         settings->upscale, settings->export_masks, settings->icc_type, settings->icc_filename,
+                         settings->icc_intent, metadata) != 0)
+        dt_control_job_cancel(job);
+    }
+  }
+
+  return tag_change;
+}
+
+// start decoding an upcoming image into the full mipmap cache while the current one is
+// processed and written. only one image is kept ahead per pipe, which the full cache quota
+// (two buffers per worker thread) always has room for.
+static void _export_prefetch(const int imgid)
+{
+  dt_mipmap_cache_get(darktable.mipmap_cache, NULL, imgid, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+}
+
+typedef struct _export_parallel_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *fdata;
+  dt_export_metadata_t *metadata;
+  int *imgs;
+  int total;
+  int workers;
+  int omp_threads;
+  int numa_nodes;
+  gboolean prefetch;
+  guint tagid, etagid;
+  dt_atomic_int started;
+  dt_atomic_int next;
+  dt_atomic_int done;
+  dt_atomic_int tag_change;
+} _export_parallel_t;
+
+static gpointer _export_parallel_worker(gpointer data)
+{
+  _export_parallel_t *p = (_export_parallel_t *)data;
+  dt_control_job_set_current(p->job);
+
+  int omp_threads = p->omp_threads;
+  if(p->numa_nodes > 1)
+  {
+    // spread the workers over the nodes and keep each one, its openmp team and its
+    // pixelpipe buffers on one of them
+    const int index = dt_atomic_add_int(&p->started, 1);
+    const int node = index % p->numa_nodes;
+    const int node_workers = (p->workers - node + p->numa_nodes - 1) / p->numa_nodes;
+    const int cpus = dt_numa_bind_thread(node);
+    if(cpus > 0) omp_threads = MAX(1, cpus / node_workers);
+  }
+
+#ifdef _OPENMP
+  // only take our share of the cores, the other workers run their own pipes
+  omp_set_num_threads(omp_threads);
+#endif
+
+  // every worker writes through its own format data (one jpeg struct per thread etc)
+  dt_imageio_module_data_t *fdata = p->mformat->get_params(p->mformat);
+  memcpy(fdata, p->fdata, p->mformat->params_size(p->mformat));
+
+  while(dt_control_job_get_state(p->job) != DT_JOB_STATE_CANCELLED)
+  {
+    const int i = dt_atomic_add_int(&p->next, 1);
+    if(i >= p->total) break;
+
+    // the other workers take the images in between
+    if(p->prefetch && i + p->workers < p->total) _export_prefetch(p->imgs[i + p->workers]);
+
+    if(_export_image(p->job, p->settings, p->mformat, p->mstorage, fdata, p->metadata, p->imgs[i], i + 1,
+                     p->total, p->tagid, p->etagid))
+      dt_atomic_set_int(&p->tag_change, TRUE);
+
+    const int done = dt_atomic_add_int(&p->done, 1) + 1;
+    char message[512] = { 0 };
+    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), done, p->total,
+             p->mstorage->name(p->mstorage));
+    dt_control_job_set_progress_message(p->job, message);
+    dt_control_job_set_progress(p->job, (double)done / p->total);
+  }
+
+  p->mformat->free_params(p->mformat, fdata);
+  dt_control_job_set_current(NULL);
+  return NULL;
+}
+
+// estimated footprint of one export: input, a working copy and the output buffer
+static size_t _export_image_memory(const GList *imgs)
+{
+  return _images_float_buffer_size(imgs) * 3;
+}
+
+// how many images to export side by side. each one runs a full export pipe, so
+// we need both spare cores and enough memory to hold all of them at once.
+static int _export_parallel_count(dt_imageio_module_format_t *mformat, dt_imageio_module_data_t *fdata,
+                                  dt_imageio_module_storage_t *mstorage, const GList *imgs, const int total)
+{
+  if(total < 2) return 1;
+  // storages and formats that keep state across images stay sequential
+  if(!mstorage->parallel_store || !mstorage->parallel_store(mstorage)) return 1;
+  if((mformat->flags(fdata) & FORMAT_FLAGS_SINGLE_STREAM)) return 1;
+
+  const int requested = dt_conf_get_int("plugins/lighttable/export/parallel_images");
+  if(requested == 1) return 1;
+
+  // give every pipe at least two cores
+  int count = MAX(1, darktable.num_openmp_threads / 2);
+
+  const size_t per_image = _export_image_memory(imgs);
+  if(per_image > 0) count = MIN(count, (int)MAX(1, dt_get_available_mem() / per_image));
+
+  if(requested > 1) count = MIN(count, requested);
+  return CLAMP(count, 1, total);
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1383,53 +1708,66 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  // the copy format never looks at the pixels
+  const gboolean prefetch = strcmp(mformat->mime(fdata), "x-copy") != 0;
+
+  const int workers = _export_parallel_count(mformat, fdata, mstorage, t, total);
+  if(workers > 1)
+  {
+    _export_parallel_t p = { 0 };
+    p.job = job;
+    p.settings = settings;
+    p.mformat = mformat;
+    p.mstorage = mstorage;
+    p.fdata = fdata;
+    p.metadata = &metadata;
+    p.total = total;
+    p.workers = workers;
+    p.prefetch = prefetch;
+    p.omp_threads = MAX(1, darktable.num_openmp_threads / workers);
+    p.numa_nodes = dt_conf_get_bool("plugins/lighttable/export/numa_pinning") ? dt_numa_nodes() : 1;
+    p.tagid = tagid;
+    p.etagid = etagid;
+    p.imgs = g_malloc_n(total, sizeof(int));
+    int k = 0;
+    for(const GList *l = t; l; l = g_list_next(l)) p.imgs[k++] = GPOINTER_TO_INT(l->data);
+
+    dt_print(DT_DEBUG_PERF, "[export_job] exporting %d images with %d workers of %d threads on %d numa nodes\n",
+             total, workers, p.omp_threads, p.numa_nodes);
+
+    // opencl devices are handed out per pipe, so each worker picks up a free gpu
+    // if there is one and falls back to the cpu otherwise
+    GThread **threads = g_malloc_n(workers, sizeof(GThread *));
+    for(int i = 0; i < workers; i++) threads[i] = g_thread_new("export", _export_parallel_worker, &p);
+    for(int i = 0; i < workers; i++) g_thread_join(threads[i]);
+    g_free(threads);
+    g_free(p.imgs);
+
+    tag_change = dt_atomic_get_int(&p.tag_change);
+  }
+  else
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
+    while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+    {
+      const int imgid = GPOINTER_TO_INT(t->data);
+      t = g_list_next(t);
+      const guint num = total - g_list_length(t);
 
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
+      if(prefetch && t) _export_prefetch(GPOINTER_TO_INT(t->data));
 
-    // remove 'changed' tag from image
-    if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-    // make sure the 'exported' tag is set on the image
-    if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+      // progress message
+      char message[512] = { 0 };
+      snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
+      // update the message. initialize_store() might have changed the number of images
+      dt_control_job_set_progress_message(job, message);
 
-    /* register export timestamp in cache */
-    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+      if(_export_image(job, settings, mformat, mstorage, fdata, &metadata, imgid, num, total, tagid, etagid))
+        tag_change = TRUE;
 
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
-    {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-      }
+      fraction += 1.0 / total;
+      if(fraction > 1.0) fraction = 1.0;
+      dt_control_job_set_progress(job, fraction);
     }
-
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
   }
   g_list_free_full(metadata.list, g_free);
 
@@ -1438,6 +1776,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
 end:
   // all threads free their fdata
   mformat->free_params(mformat, fdata);
+  // the scratch buffers kept for the pipe of the next image are not needed anymore
+  dt_dev_pixelpipe_scratch_flush_parked();
 
   // notify the user via the window manager
   dt_ui_notify_user();
@@ -1503,9 +1843,15 @@ static dt_job_t *_control_gpx_apply_job_create(const gchar *filename, int32_t fi
 
 void dt_control_merge_hdr()
 {
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
-                     dt_control_generic_images_job_create(&dt_control_merge_hdr_job_run, N_("merge hdr image"), 0,
-                                                          NULL, PROGRESS_CANCELLABLE, TRUE));
+  dt_job_t *job = dt_control_generic_images_job_create(&dt_control_merge_hdr_job_run, N_("merge hdr image"), 0,
+                                                       NULL, PROGRESS_CANCELLABLE, TRUE);
+  if(job)
+  {
+    // the accumulation buffers plus the raw being added
+    const dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+    dt_control_job_set_resources(job, _images_float_buffer_size(params->index) * 2, 0);
+  }
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG, job);
 }
 
 void dt_control_gpx_apply(const gchar *filename, int32_t filmid, const gchar *tz, GList *imgs)
@@ -1834,18 +2180,19 @@ static void dt_control_export_cleanup(void *p)
   dt_control_image_enumerator_cleanup(params);
 }
 
-void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
-                       gboolean high_quality, gboolean upscale, gboolean export_masks, char *style, gboolean style_append,
-                       dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
-                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export)
+dt_job_t *dt_control_export_job_create(GList *imgid_list, int max_width, int max_height, int format_index,
+                                       int storage_index, gboolean high_quality, gboolean upscale,
+                                       gboolean export_masks, const char *style, gboolean style_append,
+                                       dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export)
 {
   dt_job_t *job = dt_control_job_create(&dt_control_export_job_run, "export");
-  if(!job) return;
+  if(!job) return NULL;
   dt_control_image_enumerator_t *params = dt_control_export_alloc();
   if(!params)
   {
     dt_control_job_dispose(job);
-    return;
+    return NULL;
   }
   dt_control_job_set_params(job, params, dt_control_export_cleanup);
 
@@ -1865,7 +2212,7 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
     dt_control_log(_("failed to get parameters from storage module `%s', aborting export.."),
                    mstorage->name(mstorage));
     dt_control_job_dispose(job);
-    return;
+    return NULL;
   }
   data->sdata = sdata;
   data->high_quality = high_quality;
@@ -1878,13 +2225,37 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
   data->icc_intent = icc_intent;
   data->metadata_export = g_strdup(metadata_export);
 
+  // enough for one image at a time, the job itself only adds workers within the budget
+  const size_t memory = _export_image_memory(imgid_list);
+  dt_control_job_set_resources(job, memory, memory);
+
   dt_control_job_add_progress(job, _("export images"), TRUE);
+  return job;
+}
+
+void dt_control_export_job_dispatch(dt_job_t *job)
+{
+  if(!job) return;
+  // the job may be gone as soon as it is queued
+  const dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  dt_imageio_module_storage_t *mstorage = dt_imageio_get_storage_by_index(params->data->storage_index);
   dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_EXPORT, job);
 
   // tell the storage that we got its params for an export so it can reset itself to a safe state
   mstorage->export_dispatched(mstorage);
 }
 
+void dt_control_export(GList *imgid_list, int max_width, int max_height, int format_index, int storage_index,
+                       gboolean high_quality, gboolean upscale, gboolean export_masks, char *style, gboolean style_append,
+                       dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export)
+{
+  dt_control_export_job_dispatch(dt_control_export_job_create(imgid_list, max_width, max_height, format_index,
+                                                              storage_index, high_quality, upscale, export_masks,
+                                                              style, style_append, icc_type, icc_filename,
+                                                              icc_intent, metadata_export));
+}
+
 static void _add_datetime_offset(const uint32_t imgid, const char *odt,
                                  const long int offset, char *ndt)
 {
@@ -2041,19 +2412,172 @@ void dt_control_write_sidecar_files()
                                                           FALSE));
 }
 
-static int _control_import_image_copy(const char *filename,
-                                      char **prev_filename, char **prev_output,
-                                      struct dt_import_session_t *session, GList **imgs)
+typedef struct _import_copy_t
+{
+  gchar *filename;
+  gchar *output;
+  gboolean verify;
+  gboolean ok;
+} _import_copy_t;
+
+static void _import_copy_free(_import_copy_t *c)
+{
+  g_free(c->filename);
+  g_free(c->output);
+  free(c);
+}
+
+static gboolean _import_read_exif_time(const char *filename, char *exif_time)
+{
+  exif_time[0] = '\0';
+  // the capture time is at the start of all formats we know, try to get away without reading the whole file
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return FALSE;
+  uint8_t *data = g_malloc(IMPORT_PREFETCH_BYTES);
+  const size_t size = fread(data, 1, IMPORT_PREFETCH_BYTES, f);
+  const gboolean whole = feof(f);
+  fclose(f);
+  dt_exif_get_datetime_taken(data, size, exif_time);
+  g_free(data);
+  if(exif_time[0] || whole) return TRUE;
+
+  gchar *contents = NULL;
+  gsize length = 0;
+  if(!g_file_get_contents(filename, &contents, &length, NULL)) return FALSE;
+  dt_exif_get_datetime_taken((uint8_t *)contents, length, exif_time);
+  g_free(contents);
+  return TRUE;
+}
+
+static gboolean _import_write(const int fd, const char *buf, const ssize_t len)
 {
-  char *data = NULL;
-  gsize size = 0;
-  char exif_time[DT_DATETIME_LENGTH];
-  gboolean res = TRUE;
-  if(!g_file_get_contents(filename, &data, &size, NULL))
+  for(ssize_t done = 0; done < len;)
   {
-    dt_print(DT_DEBUG_CONTROL, "[import_from] failed to read file `%s`\n", filename);
-    return -1;
+    const ssize_t n = write(fd, buf + done, len - done);
+    if(n < 0 && errno == EINTR) continue;
+    if(n <= 0) return FALSE;
+    done += n;
+  }
+  return TRUE;
+}
+
+static gboolean _import_checksum_file(const int fd, char *buf, GChecksum *checksum)
+{
+  for(;;)
+  {
+    const ssize_t len = read(fd, buf, IMPORT_COPY_BUFFER);
+    if(len < 0 && errno == EINTR) continue;
+    if(len <= 0) return len == 0;
+    g_checksum_update(checksum, (const guchar *)buf, len);
+  }
+}
+
+// copies src over the (already created) dst. with verify the source is checksummed while it is read and
+// compared against the checksum of what ends up on the disk.
+static gboolean _import_copy_file(const char *src, const char *dst, char *buf, const gboolean verify)
+{
+  const int in = g_open(src, O_RDONLY | O_BINARY, 0);
+  if(in < 0) return FALSE;
+  const int out = g_open(dst, O_WRONLY | O_TRUNC | O_BINARY, 0);
+  if(out < 0)
+  {
+    close(in);
+    return FALSE;
+  }
+#if defined(POSIX_FADV_SEQUENTIAL) && !defined(__APPLE__)
+  posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  gboolean ok = TRUE;
+  gboolean copied = FALSE;
+#if defined(__linux__) && defined(SYS_copy_file_range)
+  // let the kernel move the data if it can do that between the two file systems
+  if(!verify)
+  {
+    size_t total = 0;
+    for(;;)
+    {
+      const ssize_t n = syscall(SYS_copy_file_range, in, NULL, out, NULL, IMPORT_COPY_BUFFER, 0);
+      if(n < 0 && errno == EINTR) continue;
+      if(n > 0)
+      {
+        total += n;
+        continue;
+      }
+      // not supported for this pair of files, do it ourselves
+      if(n < 0 && !total && (errno == EXDEV || errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+        break;
+      ok = n == 0;
+      copied = TRUE;
+      break;
+    }
+  }
+#endif
+
+  GChecksum *checksum = verify ? g_checksum_new(G_CHECKSUM_MD5) : NULL;
+  while(ok && !copied)
+  {
+    const ssize_t len = read(in, buf, IMPORT_COPY_BUFFER);
+    if(len < 0 && errno == EINTR) continue;
+    if(len <= 0)
+    {
+      ok = len == 0;
+      break;
+    }
+    if(checksum) g_checksum_update(checksum, (const guchar *)buf, len);
+    ok = _import_write(out, buf, len);
   }
+  close(in);
+
+  if(ok && checksum)
+  {
+    // read back from the disk, not from the page cache
+#ifdef _WIN32
+    ok = _commit(out) == 0;
+#else
+    ok = fsync(out) == 0;
+#endif
+#if defined(POSIX_FADV_DONTNEED) && !defined(__APPLE__)
+    posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  }
+  ok &= close(out) == 0;
+
+  if(ok && checksum)
+  {
+    GChecksum *written = g_checksum_new(G_CHECKSUM_MD5);
+    const int fd = g_open(dst, O_RDONLY | O_BINARY, 0);
+    ok = fd >= 0 && _import_checksum_file(fd, buf, written)
+         && !g_strcmp0(g_checksum_get_string(checksum), g_checksum_get_string(written));
+    if(fd >= 0) close(fd);
+    g_checksum_free(written);
+    if(!ok) dt_print(DT_DEBUG_CONTROL, "[import_from] verification of `%s' failed\n", dst);
+  }
+  if(checksum) g_checksum_free(checksum);
+  return ok;
+}
+
+// runs in the copy thread pool, hands the file over to the import job once it is done
+static void _import_copy(gpointer data, gpointer user_data)
+{
+  _import_copy_t *c = (_import_copy_t *)data;
+  GAsyncQueue *copied = (GAsyncQueue *)user_data;
+  char *buf = g_malloc(IMPORT_COPY_BUFFER);
+  c->ok = _import_copy_file(c->filename, c->output, buf, c->verify);
+  g_free(buf);
+  if(!c->ok)
+  {
+    dt_print(DT_DEBUG_CONTROL, "[import_from] failed to copy `%s' to `%s'\n", c->filename, c->output);
+    g_unlink(c->output);
+  }
+  g_async_queue_push(copied, c);
+}
+
+// picks the output name, in the order of the files to keep the session's sequence numbers
+static _import_copy_t *_control_import_copy_prepare(const char *filename,
+                                                    char **prev_filename, char **prev_output,
+                                                    struct dt_import_session_t *session)
+{
   char *output = NULL;
   if(dt_has_same_path_basename(filename, *prev_filename))
   {
@@ -2062,9 +2586,13 @@ static int _control_import_image_copy(const char *filename,
   }
   else
   {
+    char exif_time[DT_DATETIME_LENGTH];
+    if(!_import_read_exif_time(filename, exif_time))
+    {
+      dt_print(DT_DEBUG_CONTROL, "[import_from] failed to read file `%s`\n", filename);
+      return NULL;
+    }
     char *basename = g_path_get_basename(filename);
-    dt_exif_get_datetime_taken((uint8_t *)data, size, exif_time);
-
     if(exif_time[0])
       dt_import_session_set_exif_time(session, exif_time);
     dt_import_session_set_filename(session, basename);
@@ -2075,48 +2603,59 @@ static int _control_import_image_copy(const char *filename,
     output = g_build_filename(output_path, fname, NULL);
     g_free(basename);
   }
+  g_free(*prev_output);
+  *prev_output = output;
+  *prev_filename = (char *)filename;
 
-  if(!g_file_set_contents(output, data, size, NULL))
+  // create the file right away, the session looks for existing files to find unused names
+  FILE *f = g_fopen(output, "wb");
+  if(!f)
   {
     dt_print(DT_DEBUG_CONTROL, "[import_from] failed to write file %s\n", output);
-    res = FALSE;
+    return NULL;
   }
+  fclose(f);
+
+  _import_copy_t *c = calloc(1, sizeof(_import_copy_t));
+  c->filename = g_strdup(filename);
+  c->output = g_strdup(output);
+  c->verify = dt_conf_get_bool("session/verify_copy");
+  return c;
+}
+
+static int _control_import_image_copied(const _import_copy_t *c, struct dt_import_session_t *session,
+                                        GList **imgs)
+{
+  if(!c->ok) return -1;
+  const int32_t imgid = dt_image_import(dt_import_session_film_id(session), c->output, FALSE, FALSE);
+  if(!imgid) dt_control_log(_("error loading file `%s'"), c->output);
   else
   {
-    const int32_t imgid = dt_image_import(dt_import_session_film_id(session), output, FALSE, FALSE);
-    if(!imgid) dt_control_log(_("error loading file `%s'"), output);
-    else
+    GError *error = NULL;
+    GFile *gfile = g_file_new_for_path(c->filename);
+    GFileInfo *info = g_file_query_info(gfile,
+                              G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                              G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                              G_FILE_QUERY_INFO_NONE, NULL, &error);
+    const char *fn = g_file_info_get_name(info);
+    // FIXME set a routine common with import.c
+    const time_t datetime = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+    char dt_txt[DT_DATETIME_LENGTH];
+    dt_metadata_unix_time_to_text(dt_txt, sizeof(dt_txt), &datetime);
+    char *id = g_strconcat(fn, "-", dt_txt, NULL);
+    dt_metadata_set(imgid, "Xmp.darktable.image_id", id, FALSE);
+    g_free(id);
+    g_object_unref(info);
+    g_object_unref(gfile);
+    *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(imgid));
+    if((imgid & 3) == 3)
     {
-      GError *error = NULL;
-      GFile *gfile = g_file_new_for_path(filename);
-      GFileInfo *info = g_file_query_info(gfile,
-                                G_FILE_ATTRIBUTE_STANDARD_NAME ","
-                                G_FILE_ATTRIBUTE_TIME_MODIFIED,
-                                G_FILE_QUERY_INFO_NONE, NULL, &error);
-      const char *fn = g_file_info_get_name(info);
-      // FIXME set a routine common with import.c
-      const time_t datetime = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
-      char dt_txt[DT_DATETIME_LENGTH];
-      dt_metadata_unix_time_to_text(dt_txt, sizeof(dt_txt), &datetime);
-      char *id = g_strconcat(fn, "-", dt_txt, NULL);
-      dt_metadata_set(imgid, "Xmp.darktable.image_id", id, FALSE);
-      g_free(id);
-      g_object_unref(info);
-      g_object_unref(gfile);
-      *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(imgid));
-      if((imgid & 3) == 3)
-      {
-        dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
-                                   NULL);
-        dt_control_queue_redraw_center();
-      }
+      dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
+                                 NULL);
+      dt_control_queue_redraw_center();
     }
   }
-  g_free(data);
-  g_free(*prev_output);
-  *prev_output = output;
-  *prev_filename = (char *)filename;
-  return res ? dt_import_session_film_id(session) : -1;
+  return dt_import_session_film_id(session);
 }
 
 static void _collection_update(double *last_update, double *update_interval)
@@ -2154,6 +2693,26 @@ static int _control_import_image_insitu(const char *filename, GList **imgs, doub
   return filmid;
 }
 
+static void _import_prefetch_read(const char *filename)
+{
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return;
+  char buf[64 << 10];
+  size_t total = 0, got = 0;
+  while(total < IMPORT_PREFETCH_BYTES && (got = fread(buf, 1, sizeof(buf), f)) > 0) total += got;
+  fclose(f);
+}
+
+static void _import_prefetch(gpointer data, gpointer user_data)
+{
+  const char *filename = (const char *)data;
+  _import_prefetch_read(filename);
+  // and the sidecar, if any
+  gchar *xmp = g_strconcat(filename, ".xmp", NULL);
+  _import_prefetch_read(xmp);
+  g_free(xmp);
+}
+
 static int _sort_filename(gchar *a, gchar *b)
 {
   return g_strcmp0(a, b);
@@ -2234,11 +2793,44 @@ static int32_t _control_import_job_run(dt_job_t *job)
   double update_interval = INIT_UPDATE_INTERVAL;
   char *prev_filename = NULL;
   char *prev_output = NULL;
+  GThreadPool *prefetch = NULL;
+  GThreadPool *copy = NULL;
+  GAsyncQueue *copied = NULL;
+  if(data->session)
+  {
+    // files are copied by a few threads while this one imports the ones already copied
+    copied = g_async_queue_new();
+    copy = g_thread_pool_new(_import_copy, copied, IMPORT_COPY_THREADS, TRUE, NULL);
+  }
+  else
+    prefetch = g_thread_pool_new(_import_prefetch, NULL, IMPORT_PREFETCH_THREADS, TRUE, NULL);
+  GList *ahead = t;
+  int pushed = 0, done = 0;
   for(GList *img = t; img; img = g_list_next(img))
   {
     if(data->session)
     {
-      filmid = _control_import_image_copy((char *)img->data, &prev_filename, &prev_output, data->session, &imgs);
+      // name and queue the next files, in order
+      for(; ahead && pushed < done + IMPORT_COPY_AHEAD; ahead = g_list_next(ahead), pushed++)
+      {
+        _import_copy_t *c = _control_import_copy_prepare((char *)ahead->data, &prev_filename, &prev_output,
+                                                         data->session);
+        if(!c)
+        {
+          // keep the count of files in the queue right
+          c = calloc(1, sizeof(_import_copy_t));
+          c->ok = FALSE;
+          g_async_queue_push(copied, c);
+        }
+        else
+          g_thread_pool_push(copy, c, NULL);
+      }
+      done++;
+
+      // whichever finished first
+      _import_copy_t *c = (_import_copy_t *)g_async_queue_pop(copied);
+      filmid = _control_import_image_copied(c, data->session, &imgs);
+      _import_copy_free(c);
       if(filmid != -1 && first_filmid == -1)
       {
         first_filmid = filmid;
@@ -2250,7 +2842,13 @@ static int32_t _control_import_job_run(dt_job_t *job)
       }
     }
     else
+    {
+      for(; ahead && pushed < done + IMPORT_PREFETCH_AHEAD; ahead = g_list_next(ahead), pushed++)
+        g_thread_pool_push(prefetch, ahead->data, NULL);
+      done++;
+
       filmid = _control_import_image_insitu((char *)img->data, &imgs, &last_coll_update, &update_interval);
+    }
     if(filmid != -1)
       cntr++;
     fraction += 1.0 / total;
@@ -2264,8 +2862,18 @@ static int32_t _control_import_job_run(dt_job_t *job)
       g_usleep(100);
     }
   }
+  // drop what is still queued, the import is done with it
+  if(prefetch) g_thread_pool_free(prefetch, TRUE, TRUE);
+  // all copies have been waited for in the loop
+  if(copy) g_thread_pool_free(copy, FALSE, TRUE);
+  if(copied) g_async_queue_unref(copied);
   g_free(prev_output);
 
+  // render the thumbnails nobody asked for yet once the import is through, behind any other work
+  if(cntr && darktable.gui && dt_conf_get_bool("ui_last/import_background_thumbnails"))
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG,
+                       dt_image_generate_thumbnails_job_create(imgs, DT_MIPMAP_NONE));
+
   dt_control_log(ngettext("imported %d image", "imported %d images", cntr), cntr);
   dt_control_queue_redraw_center();
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -46,6 +46,14 @@ void dt_control_export(GList *imgid_list, int max_width, int max_height, int for
                        char *style, gboolean style_append,
                        dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
                        dt_iop_color_intent_t icc_intent, const gchar *metadata_export);
+/** the two halves of dt_control_export(): the job is created unqueued so a state callback can still be set,
+ * dispatching queues it. returns NULL when the export can't be set up. */
+dt_job_t *dt_control_export_job_create(GList *imgid_list, int max_width, int max_height, int format_index,
+                                       int storage_index, gboolean high_quality, gboolean upscale,
+                                       gboolean export_masks, const char *style, gboolean style_append,
+                                       dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                                       dt_iop_color_intent_t icc_intent, const gchar *metadata_export);
+void dt_control_export_job_dispatch(dt_job_t *job);
 void dt_control_merge_hdr();
 void dt_control_import(GList *imgs, const char *datetime_override, const gboolean inplace);
 void dt_control_seed_denoise();
@@ -18,7 +18,14 @@
 
 #include "control/jobs/image_jobs.h"
 #include "common/darktable.h"
+#include "common/atomic.h"
+#include "common/debug.h"
+#include "common/history.h"
 #include "common/image_cache.h"
+#include "common/styles.h"
+#include "control/conf.h"
+#include "dtgtk/thumbtable.h"
+#include "gui/gtk.h"
 
 typedef struct dt_image_load_t
 {
@@ -66,6 +73,9 @@ typedef struct dt_image_import_t
 {
   uint32_t film_id;
   gchar *filename;
+  // tethered imports only
+  dt_mipmap_size_t mip;
+  gchar *style;
 } dt_image_import_t;
 
 static int32_t dt_image_import_job_run(dt_job_t *job)
@@ -92,14 +102,15 @@ static void dt_image_import_job_cleanup(void *p)
   dt_image_import_t *params = p;
 
   g_free(params->filename);
+  g_free(params->style);
 
   free(params);
 }
 
-dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename)
+static dt_job_t *_import_job_create(dt_job_execute_callback execute, uint32_t filmid, const char *filename)
 {
   dt_image_import_t *params;
-  dt_job_t *job = dt_control_job_create(&dt_image_import_job_run, "import image");
+  dt_job_t *job = dt_control_job_create(execute, "import image");
   if(!job) return NULL;
   params = (dt_image_import_t *)calloc(1, sizeof(dt_image_import_t));
   if(!params)
@@ -114,6 +125,289 @@ dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename)
   return job;
 }
 
+dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename)
+{
+  return _import_job_create(&dt_image_import_job_run, filmid, filename);
+}
+
+static int32_t dt_image_tethered_import_job_run(dt_job_t *job)
+{
+  char message[512] = { 0 };
+  dt_image_import_t *params = dt_control_job_get_params(job);
+
+  snprintf(message, sizeof(message), _("importing image %s"), params->filename);
+  dt_control_job_set_progress_message(job, message);
+
+  const int32_t id = dt_image_import(params->film_id, params->filename, TRUE, TRUE);
+  if(!id) return 0;
+
+  // show the embedded preview right away, before the style alters the image
+  dt_mipmap_cache_set_preview_only(darktable.mipmap_cache, id, TRUE);
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, id, params->mip, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  dt_mipmap_cache_set_preview_only(darktable.mipmap_cache, id, FALSE);
+  DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_VIEWMANAGER_THUMBTABLE_ACTIVATE, id);
+  dt_control_queue_redraw_center();
+  dt_control_job_set_progress(job, 0.5);
+
+  if(params->style && *params->style) dt_styles_apply_to_image(params->style, FALSE, FALSE, id);
+
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'r');
+  const gboolean embedded = img && (img->flags & DT_IMAGE_THUMBNAIL_EMBEDDED);
+  if(img) dt_image_cache_read_release(darktable.image_cache, img);
+
+  // render the processed preview here rather than leaving it to the thumbnail queues
+  if(embedded || (params->style && *params->style))
+  {
+    snprintf(message, sizeof(message), _("processing image %s"), params->filename);
+    dt_control_job_set_progress_message(job, message);
+
+    dt_mipmap_cache_set_replacing(darktable.mipmap_cache, id, TRUE);
+    dt_mipmap_cache_remove(darktable.mipmap_cache, id);
+    dt_history_hash_set_mipmap(id);
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, id, params->mip, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    dt_mipmap_cache_set_replacing(darktable.mipmap_cache, id, FALSE);
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, id);
+  }
+
+  dt_control_queue_redraw();
+  dt_control_job_set_progress(job, 1.0);
+  return 0;
+}
+
+dt_job_t *dt_image_tethered_import_job_create(uint32_t filmid, const char *filename, dt_mipmap_size_t mip,
+                                              const char *style)
+{
+  dt_job_t *job = _import_job_create(&dt_image_tethered_import_job_run, filmid, filename);
+  if(!job) return NULL;
+  dt_image_import_t *params = dt_control_job_get_params(job);
+  params->mip = mip;
+  params->style = g_strdup(style);
+  return job;
+}
+
+typedef struct dt_image_refresh_thumbnails_t
+{
+  GList *imgs;
+  dt_mipmap_size_t mip;
+  gboolean missing; // only generate the ones not there yet
+  gboolean embedded; // replace the embedded previews the mipmap cache has waiting
+  dt_atomic_int done;
+  dt_atomic_int cancelled;
+} dt_image_refresh_thumbnails_t;
+
+// selects the images whose thumbnails are behind their history, all collected ones or the given ones
+static GList *_refresh_thumbnails_stale(GList *imgs)
+{
+  GList *stale = NULL;
+  sqlite3_stmt *stmt;
+  if(imgs)
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT 1 FROM main.history_hash"
+                                " WHERE imgid = ?1 AND mipmap_hash IS NOT current_hash",
+                                -1, &stmt, NULL);
+    for(const GList *l = imgs; l; l = g_list_next(l))
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(l->data));
+      if(sqlite3_step(stmt) == SQLITE_ROW) stale = g_list_prepend(stale, l->data);
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+    }
+  }
+  else
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT c.imgid"
+                                " FROM memory.collected_images AS c, main.history_hash AS h"
+                                " WHERE h.imgid = c.imgid AND h.mipmap_hash IS NOT h.current_hash"
+                                " ORDER BY c.rowid DESC",
+                                -1, &stmt, NULL);
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+      stale = g_list_prepend(stale, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  }
+  sqlite3_finalize(stmt);
+  return imgs ? g_list_reverse(stale) : stale;
+}
+
+static void _refresh_thumbnail(gpointer data, gpointer user_data)
+{
+  dt_image_refresh_thumbnails_t *params = (dt_image_refresh_thumbnails_t *)user_data;
+  const int32_t imgid = GPOINTER_TO_INT(data);
+
+  if(!dt_atomic_get_int(&params->cancelled))
+  {
+    // only the sizes we have (in memory or on disk) are worth rendering again, and the one asked for
+    gboolean levels[DT_MIPMAP_F] = { FALSE };
+    for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
+    {
+      dt_mipmap_buffer_t buf;
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_TESTLOCK, 'r');
+      levels[k] = buf.buf != NULL || dt_mipmap_cache_on_disk(darktable.mipmap_cache, imgid, k);
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    }
+    if(params->mip < DT_MIPMAP_F) levels[params->mip] = TRUE;
+
+    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+    // mark it first, an edit in between makes it stale again and it will be rendered lazily
+    dt_history_hash_set_mipmap(imgid);
+    for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F && !dt_atomic_get_int(&params->cancelled); k++)
+    {
+      if(!levels[k]) continue;
+      dt_mipmap_buffer_t buf;
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    }
+    DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
+  }
+  dt_atomic_add_int(&params->done, 1);
+}
+
+static void _replace_thumbnail(gpointer data, gpointer user_data)
+{
+  dt_image_refresh_thumbnails_t *params = (dt_image_refresh_thumbnails_t *)user_data;
+  const int32_t imgid = GPOINTER_TO_INT(data);
+
+  // the image might be gone, or got processed thumbnails some other way meanwhile
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  const gboolean embedded = img && (img->flags & DT_IMAGE_THUMBNAIL_EMBEDDED);
+  if(img) dt_image_cache_read_release(darktable.image_cache, img);
+  if(!embedded)
+  {
+    dt_atomic_add_int(&params->done, 1);
+    return;
+  }
+
+  dt_mipmap_cache_set_replacing(darktable.mipmap_cache, imgid, TRUE);
+  _refresh_thumbnail(data, user_data);
+  dt_mipmap_cache_set_replacing(darktable.mipmap_cache, imgid, FALSE);
+}
+
+static void _generate_thumbnail(gpointer data, gpointer user_data)
+{
+  dt_image_refresh_thumbnails_t *params = (dt_image_refresh_thumbnails_t *)user_data;
+  const int32_t imgid = GPOINTER_TO_INT(data);
+
+  if(!dt_atomic_get_int(&params->cancelled)
+     && !dt_mipmap_cache_on_disk(darktable.mipmap_cache, imgid, params->mip))
+  {
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, params->mip, DT_MIPMAP_TESTLOCK, 'r');
+    const gboolean resident = buf.buf != NULL;
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    if(!resident)
+    {
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    }
+  }
+  dt_atomic_add_int(&params->done, 1);
+}
+
+static int32_t dt_image_refresh_thumbnails_job_run(dt_job_t *job)
+{
+  dt_image_refresh_thumbnails_t *params = dt_control_job_get_params(job);
+  if(params->missing && params->mip >= DT_MIPMAP_F) return 0;
+  GList *stale = params->embedded ? dt_mipmap_cache_take_replace_pending(darktable.mipmap_cache)
+               : params->missing  ? g_list_copy(params->imgs)
+                                  : _refresh_thumbnails_stale(params->imgs);
+  const int total = g_list_length(stale);
+  if(!total) return 0;
+
+  // each render is multithreaded already, a few at once keep the cores busy between pipeline stages.
+  // extracting embedded previews is not, the first phase of two phase thumbnails runs on all cores.
+  const gboolean previews = params->missing && dt_conf_get_bool("plugins/lighttable/thumbnail_two_phase");
+  const int threads = previews ? MAX(darktable.num_openmp_threads, 1)
+                               : CLAMP(darktable.num_openmp_threads / 4, 1, 4);
+  GThreadPool *pool = g_thread_pool_new(params->embedded  ? _replace_thumbnail
+                                        : params->missing ? _generate_thumbnail
+                                                          : _refresh_thumbnail,
+                                        params, threads, TRUE, NULL);
+  for(const GList *l = stale; l; l = g_list_next(l)) g_thread_pool_push(pool, l->data, NULL);
+
+  char message[512] = { 0 };
+  int done = 0;
+  while((done = dt_atomic_get_int(&params->done)) < total)
+  {
+    if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) dt_atomic_set_int(&params->cancelled, 1);
+    if(params->embedded)
+      snprintf(message, sizeof(message),
+               ngettext("replacing %d/%d thumbnail", "replacing %d/%d thumbnails", total), done, total);
+    else if(params->missing)
+      snprintf(message, sizeof(message),
+               ngettext("generating %d/%d thumbnail", "generating %d/%d thumbnails", total), done, total);
+    else
+      snprintf(message, sizeof(message),
+               ngettext("refreshing %d/%d thumbnail", "refreshing %d/%d thumbnails", total), done, total);
+    dt_control_job_set_progress_message(job, message);
+    dt_control_job_set_progress(job, (double)done / total);
+    g_usleep(100000);
+  }
+  g_thread_pool_free(pool, FALSE, TRUE);
+  g_list_free(stale);
+
+  dt_control_job_set_progress(job, 1.0);
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
+static void dt_image_refresh_thumbnails_job_cleanup(void *p)
+{
+  dt_image_refresh_thumbnails_t *params = p;
+  g_list_free(params->imgs);
+  free(params);
+}
+
+static dt_job_t *_thumbnails_job_create(GList *imgs, dt_mipmap_size_t mip, const gboolean missing,
+                                        const gboolean embedded)
+{
+  dt_job_t *job = dt_control_job_create(&dt_image_refresh_thumbnails_job_run, "%s",
+                                        embedded  ? "replace thumbnails"
+                                        : missing ? "generate thumbnails"
+                                                  : "refresh thumbnails");
+  if(!job) return NULL;
+  dt_image_refresh_thumbnails_t *params
+      = (dt_image_refresh_thumbnails_t *)calloc(1, sizeof(dt_image_refresh_thumbnails_t));
+  if(!params)
+  {
+    dt_control_job_dispose(job);
+    return NULL;
+  }
+  if(mip == DT_MIPMAP_NONE && darktable.gui && dt_ui_thumbtable(darktable.gui->ui))
+  {
+    const int size = dt_ui_thumbtable(darktable.gui->ui)->thumb_size * darktable.gui->ppd;
+    mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, size, size);
+  }
+  dt_control_job_add_progress(job,
+                              embedded  ? _("replace thumbnails")
+                              : missing ? _("generate thumbnails")
+                                        : _("refresh thumbnails"),
+                              TRUE);
+  dt_control_job_set_params(job, params, dt_image_refresh_thumbnails_job_cleanup);
+  params->imgs = g_list_copy(imgs);
+  params->mip = mip;
+  params->missing = missing;
+  params->embedded = embedded;
+  return job;
+}
+
+dt_job_t *dt_image_refresh_thumbnails_job_create(GList *imgs, dt_mipmap_size_t mip)
+{
+  return _thumbnails_job_create(imgs, mip, FALSE, FALSE);
+}
+
+dt_job_t *dt_image_generate_thumbnails_job_create(GList *imgs, dt_mipmap_size_t mip)
+{
+  return _thumbnails_job_create(imgs, mip, TRUE, FALSE);
+}
+
+dt_job_t *dt_image_replace_thumbnails_job_create(void)
+{
+  return _thumbnails_job_create(NULL, DT_MIPMAP_NONE, FALSE, TRUE);
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -27,6 +27,23 @@ dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
 
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
+// import a tethered shot: its embedded preview of size mip is shown right away, then the style (if any) is
+// applied and the processed preview rendered by the job itself. meant for DT_JOB_QUEUE_USER_FG.
+dt_job_t *dt_image_tethered_import_job_create(uint32_t filmid, const char *filename, dt_mipmap_size_t mip,
+                                              const char *style);
+
+// re-render the thumbnails out of sync with the history of their image, for the whole collection if imgs
+// is NULL. mip is the size to render in any case, DT_MIPMAP_NONE for the one of the lighttable.
+dt_job_t *dt_image_refresh_thumbnails_job_create(GList *imgs, dt_mipmap_size_t mip);
+
+// render the thumbnails of size mip the given images don't have yet, neither in memory nor on disk.
+// DT_MIPMAP_NONE for the size of the lighttable.
+dt_job_t *dt_image_generate_thumbnails_job_create(GList *imgs, dt_mipmap_size_t mip);
+
+// render processed thumbnails for the images still showing their embedded preview, as collected by the
+// mipmap cache in the first phase of two phase thumbnails.
+dt_job_t *dt_image_replace_thumbnails_job_create(void);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -264,7 +264,11 @@ static void _refine_with_detail_mask(struct dt_iop_module_t *self, struct dt_dev
   lum = dt_alloc_align_float(bufsize);
   if((tmp == NULL) || (lum == NULL)) goto error;
 
-  dt_masks_calc_detail_mask(p->rawdetail_mask_data, lum, tmp, iwidth, iheight, threshold, detail);
+  gboolean free_raw = FALSE;
+  float *raw = dt_dev_get_rawdetail_mask(p, &free_raw);
+  if(raw == NULL) goto error;
+  dt_masks_calc_detail_mask(raw, lum, tmp, iwidth, iheight, threshold, detail);
+  if(free_raw) dt_free_align(raw);
   dt_free_align(tmp);
   tmp = NULL;
 
@@ -659,6 +663,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 
   // check if we should store the mask for export or use in subsequent modules
   // TODO: should we skip raster masks?
+  dt_dev_pixelpipe_raster_mask_changed(piece->pipe, piece);
   if(piece->pipe->store_all_raster_masks || dt_iop_is_raster_mask_used(self, 0))
   {
     g_hash_table_replace(piece->raster_masks, GINT_TO_POINTER(0), _mask);
@@ -703,7 +708,11 @@ static void _refine_with_detail_mask_cl(struct dt_iop_module_t *self, struct dt_
   if(blur == NULL) goto error;
 
   {
-    const int err = dt_opencl_write_host_to_device(devid, p->rawdetail_mask_data, tmp, iwidth, iheight, sizeof(float));
+    gboolean free_raw = FALSE;
+    float *raw = dt_dev_get_rawdetail_mask(p, &free_raw);
+    if(raw == NULL) goto error;
+    const int err = dt_opencl_write_host_to_device(devid, raw, tmp, iwidth, iheight, sizeof(float));
+    if(free_raw) dt_free_align(raw);
     if(err != CL_SUCCESS) goto error;
   }
 
@@ -1011,14 +1020,22 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
     // get the drawn mask if there is one
     dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, d->mask_id);
 
+    gboolean drawn_on_device = FALSE;
     if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
-
-      if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+      // simple shapes are drawn next to the blend kernels unless the host has to refine them
+      drawn_on_device = d->details == 0.0f
+                        && dt_masks_group_render_roi_cl(self, piece, form, roi_out, dev_mask_1,
+                                                        d->mask_combine & DEVELOP_COMBINE_MASKS_POS);
+      if(!drawn_on_device)
       {
-        // if we have a mask and this flag is set -> invert the mask
-        dt_iop_image_invert(mask, 1.0f, owidth, oheight, 1); //mask[k] = 1.0f - mask[k]
+        dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+
+        if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+        {
+          // if we have a mask and this flag is set -> invert the mask
+          dt_iop_image_invert(mask, 1.0f, owidth, oheight, 1); //mask[k] = 1.0f - mask[k]
+        }
       }
     }
     else if((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
@@ -1039,8 +1056,11 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
     // write mask from host to device
     dev_mask_2 = dt_opencl_alloc_device(devid, owidth, oheight, sizeof(float));
     if(dev_mask_2 == NULL) goto error;
-    err = dt_opencl_write_host_to_device(devid, mask, dev_mask_1, owidth, oheight, sizeof(float));
-    if(err != CL_SUCCESS) goto error;
+    if(!drawn_on_device)
+    {
+      err = dt_opencl_write_host_to_device(devid, mask, dev_mask_1, owidth, oheight, sizeof(float));
+      if(err != CL_SUCCESS) goto error;
+    }
 
     // The following call to clFinish() works around a bug in some OpenCL
     // drivers (namely AMD).
@@ -1229,6 +1249,7 @@ int dt_develop_blend_process_cl(struct dt_iop_module_t *self, struct dt_dev_pixe
 
   // check if we should store the mask for export or use in subsequent modules
   // TODO: should we skip raster masks?
+  dt_dev_pixelpipe_raster_mask_changed(piece->pipe, piece);
   if(piece->pipe->store_all_raster_masks || dt_iop_is_raster_mask_used(self, 0))
   {
     //  get back final mask from the device to store it for later use
@@ -1288,6 +1309,8 @@ dt_blendop_cl_global_t *dt_develop_blend_init_cl_global(void)
   b->kernel_blendop_mask_tone_curve = dt_opencl_create_kernel(program, "blendop_mask_tone_curve");
   b->kernel_blendop_set_mask = dt_opencl_create_kernel(program, "blendop_set_mask");
   b->kernel_blendop_display_channel = dt_opencl_create_kernel(program, "blendop_display_channel");
+  b->kernel_blendop_mask_shape = dt_opencl_create_kernel(program, "blendop_mask_shape");
+  b->kernel_blendop_mask_shape_write = dt_opencl_create_kernel(program, "blendop_mask_shape_write");
 
   const int program_rcd = 31;
   b->kernel_calc_Y0_mask = dt_opencl_create_kernel(program_rcd, "calc_Y0_mask");
@@ -1321,6 +1344,8 @@ void dt_develop_blend_free_cl_global(dt_blendop_cl_global_t *b)
   dt_opencl_free_kernel(b->kernel_blendop_mask_tone_curve);
   dt_opencl_free_kernel(b->kernel_blendop_set_mask);
   dt_opencl_free_kernel(b->kernel_blendop_display_channel);
+  dt_opencl_free_kernel(b->kernel_blendop_mask_shape);
+  dt_opencl_free_kernel(b->kernel_blendop_mask_shape_write);
   dt_opencl_free_kernel(b->kernel_calc_Y0_mask);
   dt_opencl_free_kernel(b->kernel_calc_scharr_mask);
   dt_opencl_free_kernel(b->kernel_write_scharr_mask);
@@ -228,6 +228,8 @@ typedef struct dt_blendop_cl_global_t
   int kernel_blendop_mask_tone_curve;
   int kernel_blendop_set_mask;
   int kernel_blendop_display_channel;
+  int kernel_blendop_mask_shape;
+  int kernel_blendop_mask_shape_write;
   int kernel_calc_Y0_mask;
   int kernel_calc_scharr_mask;
   int kernel_write_scharr_mask;
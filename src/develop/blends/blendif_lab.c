@@ -256,16 +256,18 @@ void dt_develop_blendif_lab_make_mask(struct dt_dev_pixelpipe_iop_t *piece, cons
     float parameters[DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_SIZE] DT_ALIGNED_ARRAY;
     dt_develop_blendif_process_parameters(parameters, d);
 
-    // allocate space for a temporary mask buffer to split the computation of every channel
-    float *const restrict temp_mask = dt_alloc_align_float(buffsize);
-    if(!temp_mask)
+    // the channels are combined one row at a time into a per-thread line, which stays in the cache
+    // until the global opacity is applied to the mask
+    size_t padded_width;
+    float *const restrict temp_buf = dt_alloc_perthread_float(owidth, &padded_width);
+    if(!temp_buf)
     {
       return;
     }
 
 #ifdef _OPENMP
 #pragma omp parallel default(none) \
-  dt_omp_firstprivate(temp_mask, mask, a, b, oheight, owidth, iwidth, yoffs, xoffs, buffsize, \
+  dt_omp_firstprivate(temp_buf, padded_width, mask, a, b, oheight, owidth, iwidth, yoffs, xoffs, \
                       blendif, parameters, mask_inclusive, mask_inversed, global_opacity)
 #endif
     {
@@ -275,64 +277,65 @@ void dt_develop_blendif_lab_make_mask(struct dt_dev_pixelpipe_iop_t *piece, cons
       _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
 #endif
 
-      // initialize the parametric mask
-#ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(temp_mask:64)
-#endif
-      for(size_t x = 0; x < buffsize; x++) temp_mask[x] = 1.0f;
-
-      // combine channels
 #ifdef _OPENMP
 #pragma omp for schedule(static)
 #endif
       for(size_t y = 0; y < oheight; y++)
       {
-        const size_t start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
-        _blendif_combine_channels(a + start, temp_mask + (y * owidth), owidth, blendif, parameters);
-      }
+        float *const restrict temp_mask = dt_get_perthread(temp_buf, padded_width);
+        float *const restrict mask_row = mask + y * owidth;
+
+        // initialize the parametric mask
 #ifdef _OPENMP
-#pragma omp for schedule(static)
+#pragma omp simd aligned(temp_mask:64)
 #endif
-      for(size_t y = 0; y < oheight; y++)
-      {
-        const size_t start = (y * owidth) * DT_BLENDIF_LAB_CH;
-        _blendif_combine_channels(b + start, temp_mask + (y * owidth), owidth, blendif >> DEVELOP_BLENDIF_L_out,
+        for(size_t x = 0; x < owidth; x++) temp_mask[x] = 1.0f;
+
+        // combine channels
+        const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
+        _blendif_combine_channels(a + a_start, temp_mask, owidth, blendif, parameters);
+        const size_t b_start = (y * owidth) * DT_BLENDIF_LAB_CH;
+        _blendif_combine_channels(b + b_start, temp_mask, owidth, blendif >> DEVELOP_BLENDIF_L_out,
                                   parameters + DEVELOP_BLENDIF_PARAMETER_ITEMS * DEVELOP_BLENDIF_L_out);
-      }
 
-      // apply global opacity
-      if(mask_inclusive)
-      {
-        if(mask_inversed)
+        // apply global opacity
+        if(mask_inclusive)
         {
+          if(mask_inversed)
+          {
 #ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
+#pragma omp simd aligned(temp_mask:64)
 #endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - mask[x]) * temp_mask[x];
-        }
-        else
-        {
+            for(size_t x = 0; x < owidth; x++)
+              mask_row[x] = global_opacity * (1.0f - mask_row[x]) * temp_mask[x];
+          }
+          else
+          {
 #ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
+#pragma omp simd aligned(temp_mask:64)
 #endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - (1.0f - mask[x]) * temp_mask[x]);
+            for(size_t x = 0; x < owidth; x++)
+              mask_row[x] = global_opacity * (1.0f - (1.0f - mask_row[x]) * temp_mask[x]);
+          }
         }
-      }
-      else
-      {
-        if(mask_inversed)
+        else
         {
+          if(mask_inversed)
+          {
 #ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
+#pragma omp simd aligned(temp_mask:64)
 #endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * (1.0f - mask[x] * temp_mask[x]);
-        }
-        else
-        {
+            for(size_t x = 0; x < owidth; x++)
+              mask_row[x] = global_opacity * (1.0f - mask_row[x] * temp_mask[x]);
+          }
+          else
+          {
 #ifdef _OPENMP
-#pragma omp for simd schedule(static) aligned(mask, temp_mask:64)
+#pragma omp simd aligned(temp_mask:64)
 #endif
-          for(size_t x = 0; x < buffsize; x++) mask[x] = global_opacity * mask[x] * temp_mask[x];
+            for(size_t x = 0; x < owidth; x++)
+              mask_row[x] = global_opacity * mask_row[x] * temp_mask[x];
+          }
         }
       }
 
@@ -341,7 +344,7 @@ void dt_develop_blendif_lab_make_mask(struct dt_dev_pixelpipe_iop_t *piece, cons
 #endif
     }
 
-    dt_free_align(temp_mask);
+    dt_free_align(temp_buf);
   }
 }
 
@@ -1495,36 +1498,41 @@ void dt_develop_blendif_lab_blend(struct dt_dev_pixelpipe_iop_t *piece,
     const dt_aligned_pixel_t min = { 0.0f, -1.0f, -1.0f, 0.0f };
     const dt_aligned_pixel_t max = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-    float *tmp_buffer = dt_alloc_align_float((size_t)owidth * oheight * DT_BLENDIF_LAB_CH);
+    // the blend writes b in place, so every row of it is set aside just before it gets overwritten
+    size_t padded_row;
+    float *tmp_buffer = dt_alloc_perthread_float((size_t)owidth * DT_BLENDIF_LAB_CH, &padded_row);
     if (tmp_buffer != NULL)
     {
-      dt_iop_image_copy(tmp_buffer, b, (size_t)owidth * oheight * DT_BLENDIF_LAB_CH);
       if((d->blend_mode & DEVELOP_BLEND_REVERSE) == DEVELOP_BLEND_REVERSE)
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_LAB_CH;
           const size_t m_start = y * owidth;
-          blend(tmp_buffer + b_start, a + a_start, b + b_start, mask + m_start, owidth, min, max);
+          float *const restrict tmp_row = dt_get_perthread(tmp_buffer, padded_row);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_LAB_CH);
+          blend(tmp_row, a + a_start, b + b_start, mask + m_start, owidth, min, max);
         }
       }
       else
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(a, b, tmp_buffer, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
+  dt_omp_firstprivate(a, b, tmp_buffer, padded_row, mask, blend, oheight, owidth, iwidth, xoffs, yoffs, min, max)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = ((y + yoffs) * iwidth + xoffs) * DT_BLENDIF_LAB_CH;
           const size_t b_start = y * owidth * DT_BLENDIF_LAB_CH;
           const size_t m_start = y * owidth;
-          blend(a + a_start, tmp_buffer + b_start, b + b_start, mask + m_start, owidth, min, max);
+          float *const restrict tmp_row = dt_get_perthread(tmp_buffer, padded_row);
+          memcpy(tmp_row, b + b_start, sizeof(float) * owidth * DT_BLENDIF_LAB_CH);
+          blend(a + a_start, tmp_row, b + b_start, mask + m_start, owidth, min, max);
         }
       }
       dt_free_align(tmp_buffer);
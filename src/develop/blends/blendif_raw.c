@@ -416,34 +416,39 @@ void dt_develop_blendif_raw_blend(struct dt_dev_pixelpipe_iop_t *piece,
   {
     _blend_row_func *const blend = _choose_blend_func(d->blend_mode);
 
-    float *tmp_buffer = dt_alloc_align_float((size_t)owidth * oheight);
+    // the blend writes b in place, so every row of it is set aside just before it gets overwritten
+    size_t padded_row;
+    float *tmp_buffer = dt_alloc_perthread_float(owidth, &padded_row);
     if (tmp_buffer != NULL)
     {
-      dt_iop_image_copy(tmp_buffer, b, (size_t)owidth * oheight);
       if((d->blend_mode & DEVELOP_BLEND_REVERSE) == DEVELOP_BLEND_REVERSE)
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(blend, a, b, tmp_buffer, mask, oheight, owidth, iwidth, xoffs, yoffs)
+  dt_omp_firstprivate(blend, a, b, tmp_buffer, padded_row, mask, oheight, owidth, iwidth, xoffs, yoffs)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = (y + yoffs) * iwidth + xoffs;
           const size_t bm_start = y * owidth;
-          blend(tmp_buffer + bm_start, a + a_start, b + bm_start, mask + bm_start, owidth);
+          float *const restrict tmp_row = dt_get_perthread(tmp_buffer, padded_row);
+          memcpy(tmp_row, b + bm_start, sizeof(float) * owidth);
+          blend(tmp_row, a + a_start, b + bm_start, mask + bm_start, owidth);
         }
       }
       else
       {
 #ifdef _OPENMP
 #pragma omp parallel for schedule(static) default(none) \
-  dt_omp_firstprivate(blend, a, b, tmp_buffer, mask, oheight, owidth, iwidth, xoffs, yoffs)
+  dt_omp_firstprivate(blend, a, b, tmp_buffer, padded_row, mask, oheight, owidth, iwidth, xoffs, yoffs)
 #endif
         for(size_t y = 0; y < oheight; y++)
         {
           const size_t a_start = (y + yoffs) * iwidth + xoffs;
           const size_t bm_start = y * owidth;
-          blend(a + a_start, tmp_buffer + bm_start, b + bm_start, mask + bm_start, owidth);
+          float *const restrict tmp_row = dt_get_perthread(tmp_buffer, padded_row);
+          memcpy(tmp_row, b + bm_start, sizeof(float) * owidth);
+          blend(a + a_start, tmp_row, b + bm_start, mask + bm_start, owidth);
         }
       }
       dt_free_align(tmp_buffer);
@@ -31,6 +31,7 @@
 #include "common/imageio.h"
 #include "common/mipmap_cache.h"
 #include "common/opencl.h"
+#include "common/presets.h"
 #include "common/tags.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -140,6 +141,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
   dt_pthread_mutex_destroy(&dev->pipe_mutex);
   dt_pthread_mutex_destroy(&dev->preview_pipe_mutex);
   dt_pthread_mutex_destroy(&dev->preview2_pipe_mutex);
+  if(dev->gui_attached) dt_masks_render_cache_flush();
   dev->proxy.chroma_adaptation = NULL;
   dev->proxy.wb_coeffs[0] = 0.f;
   if(dev->pipe)
@@ -177,8 +179,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
   g_list_free_full(dev->iop_order_list, free);
   while(dev->allprofile_info)
   {
-    dt_ioppr_cleanup_profile_info((dt_iop_order_iccprofile_info_t *)dev->allprofile_info->data);
-    dt_free_align(dev->allprofile_info->data);
+    dt_ioppr_release_profile_info((dt_iop_order_iccprofile_info_t *)dev->allprofile_info->data);
     dev->allprofile_info = g_list_delete_link(dev->allprofile_info, dev->allprofile_info);
   }
   dt_pthread_mutex_destroy(&dev->history_mutex);
@@ -201,13 +202,26 @@ void dt_dev_cleanup(dt_develop_t *dev)
 float dt_dev_get_preview_downsampling()
 {
   const char *preview_downsample = dt_conf_get_string_const("preview_downsampling");
-  const float downsample = (g_strcmp0(preview_downsample, "original") == 0) ? 1.0f
+  // auto starts from the full preview, each run of the preview pipe then adapts it
+  const float downsample = (g_strcmp0(preview_downsample, "original") == 0
+                            || g_strcmp0(preview_downsample, "auto") == 0) ? 1.0f
         : (g_strcmp0(preview_downsample, "to 1/2")==0) ? 0.5f
         : (g_strcmp0(preview_downsample, "to 1/3")==0) ? 1/3.0f
         : 0.25f;
   return downsample;
 }
 
+// with automatic downsampling, reduce the preview as long as it still covers the largest of its consumers
+static float _dev_auto_preview_downsampling(const dt_develop_t *dev)
+{
+  const int longest = MAX(dev->preview_pipe->processed_width, dev->preview_pipe->processed_height);
+  if(longest <= 0 || dev->preview_consumers_size <= 0) return 1.0f;
+  const float steps[] = { 0.25f, 1 / 3.0f, 0.5f };
+  for(int k = 0; k < 3; k++)
+    if(longest * steps[k] >= dev->preview_consumers_size) return steps[k];
+  return 1.0f;
+}
+
 void dt_dev_process_image(dt_develop_t *dev)
 {
   if(!dev->gui_attached || dev->pipe->processing) return;
@@ -235,6 +249,8 @@ void dt_dev_process_preview2(dt_develop_t *dev)
 
 void dt_dev_invalidate(dt_develop_t *dev)
 {
+  // a result computed for the old state would just be thrown away
+  if(dev->pipe) dt_dev_pixelpipe_cancel(dev->pipe);
   dev->image_status = DT_DEV_PIXELPIPE_DIRTY;
   dev->timestamp++;
   if(dev->preview_pipe) dev->preview_pipe->input_timestamp = dev->timestamp;
@@ -243,6 +259,8 @@ void dt_dev_invalidate(dt_develop_t *dev)
 
 void dt_dev_invalidate_all(dt_develop_t *dev)
 {
+  // the preview pipes are cheap and keep the view responsive, so only the full pipe is cancelled
+  if(dev->pipe) dt_dev_pixelpipe_cancel(dev->pipe);
   dev->image_status = dev->preview_status = dev->preview2_status = DT_DEV_PIXELPIPE_DIRTY;
   dev->timestamp++;
 }
@@ -323,6 +341,8 @@ restart:
   dt_times_t start;
   dt_get_times(&start);
   dt_dev_pixelpipe_change(dev->preview_pipe, dev);
+  if(!g_strcmp0(dt_conf_get_string_const("preview_downsampling"), "auto"))
+    dev->preview_downsampling = _dev_auto_preview_downsampling(dev);
   if(dt_dev_pixelpipe_process(
          dev->preview_pipe, dev, 0, 0, dev->preview_pipe->processed_width * dev->preview_downsampling,
          dev->preview_pipe->processed_height * dev->preview_downsampling, dev->preview_downsampling))
@@ -490,6 +510,63 @@ restart:
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW2_PIPE_FINISHED);
 }
 
+// scale down factor for a first coarse pass of the full pipe, 1 for none
+static int _dev_progressive_factor(dt_develop_t *dev, const float scale)
+{
+  const int delay = dt_conf_get_int("darkroom/ui/progressive_delay");
+  if(delay <= 0 || dev->average_delay < delay || dev->image_loading) return 1;
+  // only if zoomed in beyond fitting the image to the screen
+  const float fit = dt_dev_get_zoom_scale(dev, DT_ZOOM_FIT, 1.0f, 0) * darktable.gui->ppd;
+  return scale > 1.01f * fit ? 4 : 1;
+}
+
+// stretch the coarse output of the full pipe to the size of the final one, so it can be shown instead
+static void _dev_upscale_output_backbuf(dt_dev_pixelpipe_t *pipe, const int width, const int height)
+{
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const int cw = pipe->output_backbuf_width;
+  const int ch = pipe->output_backbuf_height;
+  const uint8_t *const in = pipe->output_backbuf;
+  uint8_t *const out = g_try_malloc(sizeof(uint8_t) * 4 * width * height);
+  if(in && out && cw > 0 && ch > 0)
+  {
+    const float sx = (float)cw / width;
+    const float sy = (float)ch / height;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(in, out, width, height, cw, ch, sx, sy) \
+    schedule(static)
+#endif
+    for(int j = 0; j < height; j++)
+    {
+      const float fy = CLAMP((j + 0.5f) * sy - 0.5f, 0.0f, ch - 1.0f);
+      const int y0 = (int)fy;
+      const int y1 = MIN(y0 + 1, ch - 1);
+      const float wy = fy - y0;
+      for(int i = 0; i < width; i++)
+      {
+        const float fx = CLAMP((i + 0.5f) * sx - 0.5f, 0.0f, cw - 1.0f);
+        const int x0 = (int)fx;
+        const int x1 = MIN(x0 + 1, cw - 1);
+        const float wx = fx - x0;
+        for(int c = 0; c < 4; c++)
+        {
+          const float top = (1.0f - wx) * in[4 * ((size_t)y0 * cw + x0) + c] + wx * in[4 * ((size_t)y0 * cw + x1) + c];
+          const float bot = (1.0f - wx) * in[4 * ((size_t)y1 * cw + x0) + c] + wx * in[4 * ((size_t)y1 * cw + x1) + c];
+          out[4 * ((size_t)j * width + i) + c] = (uint8_t)((1.0f - wy) * top + wy * bot + 0.5f);
+        }
+      }
+    }
+    g_free(pipe->output_backbuf);
+    pipe->output_backbuf = out;
+    pipe->output_backbuf_width = width;
+    pipe->output_backbuf_height = height;
+  }
+  else
+    g_free(out);
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -595,6 +672,20 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  // slow zoomed in views get a coarse version first, the preview is too blurry at that scale
+  const int coarse = _dev_progressive_factor(dev, scale);
+  if(coarse > 1
+     && !dt_dev_pixelpipe_process(dev->pipe, dev, x / coarse, y / coarse, wd / coarse, ht / coarse,
+                                  scale / coarse)
+     && dev->pipe->changed == DT_DEV_PIPE_UNCHANGED)
+  {
+    _dev_upscale_output_backbuf(dev->pipe, wd, ht);
+    dev->pipe->backbuf_scale = scale;
+    dev->pipe->backbuf_zoom_x = zoom_x;
+    dev->pipe->backbuf_zoom_y = zoom_y;
+    dt_control_queue_redraw_center();
+  }
+
   dt_get_times(&start);
   if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
   {
@@ -1491,31 +1582,9 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
     }
   }
 
-  // select all presets from one of the following table and add them into memory.history. Note that
-  // this is appended to possibly already present default modules.
-  const char *preset_table[2] = { "data.presets", "main.legacy_presets" };
+  // add all presets of one of data.presets or main.legacy_presets matching the image into memory.history.
+  // Note that this is appended to possibly already present default modules.
   const int legacy = (image->flags & DT_IMAGE_NO_LEGACY_PRESETS) ? 0 : 1;
-  char query[1024];
-  snprintf(query, sizeof(query),
-           "INSERT INTO memory.history"
-           " SELECT ?1, 0, op_version, operation, op_params,"
-           "       enabled, blendop_params, blendop_version, multi_priority, multi_name"
-           " FROM %s"
-           " WHERE ( (autoapply=1"
-           "          AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
-           "          AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
-           "          AND ?8 BETWEEN exposure_min AND exposure_max"
-           "          AND ?9 BETWEEN aperture_min AND aperture_max"
-           "          AND ?10 BETWEEN focal_length_min AND focal_length_max"
-           "          AND (format = 0 OR (format&?11 != 0 AND ~format&?12 != 0)))"
-           "        OR (name = ?13))"
-           "   AND operation NOT IN"
-           "        ('ioporder', 'metadata', 'modulegroups', 'export', 'tagging', 'collect', '%s')"
-           " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
-           preset_table[legacy],
-           is_display_referred?"":"basecurve");
-  // query for all modules at once:
-  sqlite3_stmt *stmt;
   const char *workflow_preset = has_matrix && is_display_referred
                                 ? _("display-referred default")
                                 : (has_matrix && is_scene_referred
@@ -1530,23 +1599,39 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
   if(dt_image_monochrome_flags(image)) excluded |= FOR_NOT_MONO;
   else excluded |= FOR_NOT_COLOR;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, image->exif_model, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, image->exif_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, image->camera_alias, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, image->camera_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 6, image->exif_lens, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, fmaxf(0.0f, fminf(1000000, image->exif_exposure)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, fmaxf(0.0f, fminf(1000000, image->exif_aperture)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, fmaxf(0.0f, fminf(1000000, image->exif_focal_length)));
-  // 0: dontcare, 1: ldr, 2: raw plus monochrome & color
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, iformat);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 12, excluded);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 13, workflow_preset, -1, SQLITE_TRANSIENT);
-  sqlite3_step(stmt);
+  // the presets are matched in memory, in the order they have to be applied
+  GList *presets = dt_presets_autoapply_get(image, legacy, workflow_preset, iformat, excluded);
+  const char *not_applied[] = { "ioporder", "metadata", "modulegroups", "export", "tagging", "collect",
+                                is_display_referred ? NULL : "basecurve", NULL };
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO memory.history"
+                              " VALUES (?1, 0, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)",
+                              -1, &stmt, NULL);
+  for(const GList *l = presets; l; l = g_list_next(l))
+  {
+    const dt_presets_autoapply_t *preset = (dt_presets_autoapply_t *)l->data;
+
+    gboolean skip = !preset->operation;
+    for(int k = 0; !skip && not_applied[k]; k++) skip = !strcmp(preset->operation, not_applied[k]);
+    if(skip) continue;
+
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, preset->op_version);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, preset->operation, -1, SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 4, preset->op_params, preset->op_params_size, SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 5, preset->enabled);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 6, preset->blendop_params, preset->blendop_params_size, SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, preset->blendop_version);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 8, preset->multi_priority);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 9, preset->multi_name, -1, SQLITE_TRANSIENT);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
   sqlite3_finalize(stmt);
+  dt_presets_autoapply_free(presets);
 
   // now we want to auto-apply the iop-order list if one corresponds and none are
   // still applied. Note that we can already have an iop-order list set when
@@ -1554,37 +1639,19 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
 
   if(!dt_ioppr_has_iop_order_list(imgid))
   {
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT op_params"
-                                " FROM data.presets"
-                                " WHERE autoapply=1"
-                                "       AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
-                                "       AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
-                                "       AND ?8 BETWEEN exposure_min AND exposure_max"
-                                "       AND ?9 BETWEEN aperture_min AND aperture_max"
-                                "       AND ?10 BETWEEN focal_length_min AND focal_length_max"
-                                "       AND (format = 0 OR (format&?11 != 0 AND ~format&?12 != 0))"
-                                "       AND operation = 'ioporder'"
-                                " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, image->exif_model, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, image->exif_maker, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, image->camera_alias, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, image->camera_maker, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 6, image->exif_lens, -1, SQLITE_TRANSIENT);
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso)));
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, fmaxf(0.0f, fminf(1000000, image->exif_exposure)));
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, fmaxf(0.0f, fminf(1000000, image->exif_aperture)));
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, fmaxf(0.0f, fminf(1000000, image->exif_focal_length)));
-    // 0: dontcare, 1: ldr, 2: raw plus monochrome & color
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 11, iformat);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 12, excluded);
-    if(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      const char *params = (char *)sqlite3_column_blob(stmt, 0);
-      const int32_t params_len = sqlite3_column_bytes(stmt, 0);
-      GList *iop_list = dt_ioppr_deserialize_iop_order_list(params, params_len);
+    // the first matching iop-order preset of data.presets
+    GList *order_presets = dt_presets_autoapply_get(image, FALSE, NULL, iformat, excluded);
+    const dt_presets_autoapply_t *order_preset = NULL;
+    for(const GList *l = order_presets; l && !order_preset; l = g_list_next(l))
+    {
+      const dt_presets_autoapply_t *preset = (dt_presets_autoapply_t *)l->data;
+      if(preset->operation && !strcmp(preset->operation, "ioporder")) order_preset = preset;
+    }
+
+    if(order_preset)
+    {
+      GList *iop_list = dt_ioppr_deserialize_iop_order_list((const char *)order_preset->op_params,
+                                                          order_preset->op_params_size);
       dt_ioppr_write_iop_order_list(iop_list, imgid);
       g_list_free_full(iop_list, free);
       dt_ioppr_set_default_iop_order(dev, imgid);
@@ -1601,7 +1668,7 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
       g_list_free_full(iop_list, free);
       dt_ioppr_set_default_iop_order(dev, imgid);
     }
-    sqlite3_finalize(stmt);
+    dt_presets_autoapply_free(order_presets);
   }
 
   image->flags |= DT_IMAGE_AUTO_PRESETS_APPLIED | DT_IMAGE_NO_LEGACY_PRESETS;
@@ -2619,13 +2686,211 @@ gchar *dt_history_item_get_name_html(const struct dt_iop_module_t *module)
   return label;
 }
 
+// grid points along the longer side of the sampled areas
+#define DT_DEV_DISTORT_GRID_CELLS 128
+
+// the geometry the gui transforms through: modules moving points also distort masks
+static uint64_t _distort_grid_hash(const dt_develop_t *dev, const dt_dev_pixelpipe_t *pipe)
+{
+  uint64_t hash = 5381;
+  GList *pieces = pipe->nodes;
+  for(GList *modules = pipe->iop; modules && pieces; modules = g_list_next(modules), pieces = g_list_next(pieces))
+  {
+    const dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(piece->enabled && module->distort_mask
+       && !(dev->gui_module && dev->gui_module != module
+            && (dev->gui_module->operation_tags_filter() & module->operation_tags())))
+    {
+      const int dims[4] = { piece->buf_in.width, piece->buf_in.height, piece->buf_out.width, piece->buf_out.height };
+      hash = ((hash << 5) + hash) ^ piece->hash;
+      for(int k = 0; k < 4; k++) hash = ((hash << 5) + hash) ^ dims[k];
+    }
+  }
+  hash = ((hash << 5) + hash) ^ pipe->iwidth;
+  hash = ((hash << 5) + hash) ^ pipe->iheight;
+  return hash;
+}
+
+static void _distort_grid_free(dt_dev_distort_grid_t *grid)
+{
+  dt_free_align(grid->forw);
+  dt_free_align(grid->back);
+  grid->forw = grid->back = NULL;
+}
+
+// transform a regular grid of gw x gh points spaced step from x0 / y0, NULL if any of them goes astray
+static float *_distort_grid_sample(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const int gw, const int gh,
+                                   const float x0, const float y0, const float step, const gboolean back)
+{
+  float *pts = dt_alloc_align_float((size_t)2 * gw * gh);
+  if(!pts) return NULL;
+  for(int j = 0; j < gh; j++)
+    for(int i = 0; i < gw; i++)
+    {
+      pts[2 * ((size_t)j * gw + i)] = x0 + i * step;
+      pts[2 * ((size_t)j * gw + i) + 1] = y0 + j * step;
+    }
+
+  gboolean ok = back ? dt_dev_distort_backtransform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, pts, (size_t)gw * gh)
+                     : dt_dev_distort_transform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, pts, (size_t)gw * gh);
+  for(size_t k = 0; ok && k < (size_t)2 * gw * gh; k++)
+    if(!isfinite(pts[k])) ok = FALSE;
+  if(!ok)
+  {
+    dt_free_align(pts);
+    return NULL;
+  }
+  return pts;
+}
+
+static gboolean _distort_grid_build(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, dt_dev_distort_grid_t *grid)
+{
+  _distort_grid_free(grid);
+  if(pipe->iwidth <= 0 || pipe->iheight <= 0) return FALSE;
+
+  grid->fstep = (float)MAX(pipe->iwidth, pipe->iheight) / (DT_DEV_DISTORT_GRID_CELLS - 1);
+  grid->fw = (int)ceilf(pipe->iwidth / grid->fstep) + 1;
+  grid->fh = (int)ceilf(pipe->iheight / grid->fstep) + 1;
+  grid->forw = _distort_grid_sample(dev, pipe, grid->fw, grid->fh, 0.0f, 0.0f, grid->fstep, FALSE);
+  if(!grid->forw) return FALSE;
+
+  // the backward grid covers where the input image ends up
+  float xmin = FLT_MAX, ymin = FLT_MAX, xmax = -FLT_MAX, ymax = -FLT_MAX;
+  for(size_t k = 0; k < (size_t)grid->fw * grid->fh; k++)
+  {
+    xmin = fminf(xmin, grid->forw[2 * k]);
+    xmax = fmaxf(xmax, grid->forw[2 * k]);
+    ymin = fminf(ymin, grid->forw[2 * k + 1]);
+    ymax = fmaxf(ymax, grid->forw[2 * k + 1]);
+  }
+  grid->bx = floorf(xmin);
+  grid->by = floorf(ymin);
+  grid->bstep = fmaxf(fmaxf(xmax - grid->bx, ymax - grid->by) / (DT_DEV_DISTORT_GRID_CELLS - 1), 1e-3f);
+  grid->bw = (int)ceilf((xmax - grid->bx) / grid->bstep) + 1;
+  grid->bh = (int)ceilf((ymax - grid->by) / grid->bstep) + 1;
+  grid->back = _distort_grid_sample(dev, pipe, grid->bw, grid->bh, grid->bx, grid->by, grid->bstep, TRUE);
+  if(!grid->back)
+  {
+    _distort_grid_free(grid);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// interpolate the points inside the grid, returns how many lie outside and are left for the modules.
+// their indices are collected at the start of outside.
+static size_t _distort_grid_interpolate(const float *const restrict map, const int gw, const int gh,
+                                        const float x0, const float y0, const float step,
+                                        float *const restrict points, const size_t points_count,
+                                        size_t *const restrict outside)
+{
+  const float istep = 1.0f / step;
+  size_t n_out = 0;
+  for(size_t k = 0; k < points_count; k++)
+  {
+    const float fx = (points[2 * k] - x0) * istep;
+    const float fy = (points[2 * k + 1] - y0) * istep;
+    if(!(fx >= 0.0f && fy >= 0.0f && fx <= gw - 1 && fy <= gh - 1))
+    {
+      outside[n_out++] = k;
+      continue;
+    }
+    const int i = MIN((int)fx, gw - 2);
+    const int j = MIN((int)fy, gh - 2);
+    const float wx = fx - i;
+    const float wy = fy - j;
+    const float *const m0 = map + 2 * ((size_t)j * gw + i);
+    const float *const m1 = m0 + 2 * gw;
+    for(int c = 0; c < 2; c++)
+    {
+      const float top = m0[c] + wx * (m0[2 + c] - m0[c]);
+      const float bot = m1[c] + wx * (m1[2 + c] - m1[c]);
+      points[2 * k + c] = top + wy * (bot - top);
+    }
+  }
+  return n_out;
+}
+
+// the points transformed by the modules themselves, for the ones outside the grid
+static int _distort_grid_exact(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, float *points,
+                               const size_t *const outside, const size_t n_out, const gboolean back)
+{
+  float *pts = dt_alloc_align_float(2 * n_out);
+  if(!pts) return 0;
+  for(size_t k = 0; k < n_out; k++)
+  {
+    pts[2 * k] = points[2 * outside[k]];
+    pts[2 * k + 1] = points[2 * outside[k] + 1];
+  }
+  const int ok = back ? dt_dev_distort_backtransform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, pts, n_out)
+                      : dt_dev_distort_transform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, pts, n_out);
+  for(size_t k = 0; k < n_out; k++)
+  {
+    points[2 * outside[k]] = pts[2 * k];
+    points[2 * outside[k] + 1] = pts[2 * k + 1];
+  }
+  dt_free_align(pts);
+  return ok;
+}
+
+// transform through the composed distortion of the pipe. the grid only gets built once the points transformed
+// with the same geometry would have paid for it, so dragging a geometry module doesn't resample it every time.
+static int _distort_grid_transform(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, float *points,
+                                   const size_t points_count, const gboolean back)
+{
+  dt_dev_distort_grid_t *grid = &pipe->distort_grid;
+  const uint64_t hash = _distort_grid_hash(dev, pipe);
+
+  if(!grid->forw || grid->hash != hash)
+  {
+    if(grid->pending_hash != hash)
+    {
+      grid->pending_hash = hash;
+      grid->pending_points = 0;
+    }
+    grid->pending_points += points_count;
+    const size_t cost = (size_t)2 * DT_DEV_DISTORT_GRID_CELLS * DT_DEV_DISTORT_GRID_CELLS;
+    if(grid->pending_points < cost || !_distort_grid_build(dev, pipe, grid))
+    {
+      return back ? dt_dev_distort_backtransform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, points, points_count)
+                  : dt_dev_distort_transform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, points, points_count);
+    }
+    grid->hash = hash;
+  }
+
+  size_t *outside = dt_alloc_align(64, sizeof(size_t) * MAX(points_count, 1));
+  if(!outside)
+    return back ? dt_dev_distort_backtransform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, points, points_count)
+                : dt_dev_distort_transform_locked(dev, pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, points, points_count);
+
+  const size_t n_out = back
+    ? _distort_grid_interpolate(grid->back, grid->bw, grid->bh, grid->bx, grid->by, grid->bstep, points, points_count, outside)
+    : _distort_grid_interpolate(grid->forw, grid->fw, grid->fh, 0.0f, 0.0f, grid->fstep, points, points_count, outside);
+  const int ok = n_out ? _distort_grid_exact(dev, pipe, points, outside, n_out, back) : 1;
+  dt_free_align(outside);
+  return ok;
+}
+
 int dt_dev_distort_transform(dt_develop_t *dev, float *points, size_t points_count)
 {
-  return dt_dev_distort_transform_plus(dev, dev->preview_pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, points, points_count);
+  dt_pthread_mutex_lock(&dev->history_mutex);
+  const int success = _distort_grid_transform(dev, dev->preview_pipe, points, points_count, FALSE);
+  if(success && dev->preview_downsampling != 1.0f)
+    for(size_t idx = 0; idx < 2 * points_count; idx++)
+      points[idx] *= dev->preview_downsampling;
+  dt_pthread_mutex_unlock(&dev->history_mutex);
+  return 1;
 }
 int dt_dev_distort_backtransform(dt_develop_t *dev, float *points, size_t points_count)
 {
-  return dt_dev_distort_backtransform_plus(dev, dev->preview_pipe, 0.0f, DT_DEV_TRANSFORM_DIR_ALL, points, points_count);
+  dt_pthread_mutex_lock(&dev->history_mutex);
+  if(dev->preview_downsampling != 1.0f)
+    for(size_t idx = 0; idx < 2 * points_count; idx++)
+      points[idx] /= dev->preview_downsampling;
+  const int success = _distort_grid_transform(dev, dev->preview_pipe, points, points_count, TRUE);
+  dt_pthread_mutex_unlock(&dev->history_mutex);
+  return success;
 }
 
 // only call directly or indirectly from dt_dev_distort_transform_plus, so that it runs with the history locked
@@ -163,6 +163,7 @@ typedef struct dt_develop_t
   uint32_t preview2_average_delay;
   struct dt_iop_module_t *gui_module; // this module claims gui expose/event callbacks.
   float preview_downsampling;         // < 1.0: optionally downsample preview
+  int preview_consumers_size;         // largest size in pixels the preview is shown at, for automatic downsampling
 
   // width, height: dimensions of window
   int32_t width, height;
@@ -340,6 +341,7 @@ typedef struct dt_develop_t
 
   int mask_form_selected_id; // select a mask inside an iop
   gboolean darkroom_skip_mouse_events; // skip mouse events for masks
+  gboolean mask_interactive; // a shape is dragged, only the preview pipe follows it until released
 } dt_develop_t;
 
 void dt_dev_init(dt_develop_t *dev, int32_t gui_attached);
@@ -467,9 +469,10 @@ gchar *dt_history_item_get_name_html(const struct dt_iop_module_t *module);
 /*
  * distort functions
  */
-/** apply all transforms to the specified points (in preview pipe space) */
+/** apply all transforms to the specified points (in preview pipe space). for the gui: the result is
+    interpolated in the composed distortion of the preview pipe once that pays off, see dt_dev_distort_grid_t */
 int dt_dev_distort_transform(dt_develop_t *dev, float *points, size_t points_count);
-/** reverse apply all transforms to the specified points (in preview pipe space) */
+/** reverse apply all transforms to the specified points (in preview pipe space), interpolated the same way */
 int dt_dev_distort_backtransform(dt_develop_t *dev, float *points, size_t points_count);
 /** same fct, but we can specify iop with priority between pmin and pmax */
 int dt_dev_distort_transform_plus(dt_develop_t *dev, struct dt_dev_pixelpipe_t *pipe, const double iop_order, const int transf_direction,
@@ -333,10 +333,38 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *module_name)
       fprintf(stderr, "[iop_load_module] failed to initialize introspection for operation `%s'\n", module_name);
   }
 
-  if(module->init_global) module->init_global(module);
+  // init_global() (kernels, lookup tables, databases) is deferred to dt_iop_init_global(), most modules are
+  // never used in a session and don't need to pay for it at startup
   return 0;
 }
 
+// serializes the deferred init_global() calls of all module types
+static GMutex _init_global_lock;
+
+void dt_iop_init_global(dt_iop_module_t *module)
+{
+  dt_iop_module_so_t *so = module->so;
+  if(!so) return;
+
+  if(!g_atomic_int_get(&so->global_inited))
+  {
+    g_mutex_lock(&_init_global_lock);
+    if(!g_atomic_int_get(&so->global_inited))
+    {
+      if(so->init_global)
+      {
+        dt_times_t start;
+        dt_get_times(&start);
+        so->init_global(so);
+        dt_show_times_f(&start, "[iop_init_global]", "module `%s'", so->op);
+      }
+      g_atomic_int_set(&so->global_inited, TRUE);
+    }
+    g_mutex_unlock(&_init_global_lock);
+  }
+  module->global_data = so->data;
+}
+
 int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt_develop_t *dev)
 {
   module->actions = DT_ACTION_TYPE_IOP_INSTANCE;
@@ -1161,6 +1189,8 @@ static void _iop_gui_update_label(dt_iop_module_t *module)
 
 void dt_iop_gui_init(dt_iop_module_t *module)
 {
+  // the throwaway instance used to register the accelerators doesn't need the global data
+  if(!darktable.control->accel_initialising) dt_iop_init_global(module);
   ++darktable.gui->reset;
   --darktable.bauhaus->skip_accel;
   if(module->gui_init) module->gui_init(module);
@@ -1204,7 +1234,12 @@ void dt_iop_cleanup_histogram(gpointer data, gpointer user_data)
 
 static void _init_presets(dt_iop_module_so_t *module_so)
 {
-  if(module_so->init_presets) module_so->init_presets(module_so);
+  // the built-in presets are already in the db if this darktable version wrote them
+  if(module_so->init_presets && !dt_gui_presets_builtin_current(TRUE))
+  {
+    dt_gui_presets_builtin_remove(module_so->op);
+    module_so->init_presets(module_so);
+  }
 
   // this seems like a reasonable place to check for and update legacy
   // presets.
@@ -1214,9 +1249,12 @@ static void _init_presets(dt_iop_module_so_t *module_so)
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(
       dt_database_get(darktable.db),
-      "SELECT name, op_version, op_params, blendop_version, blendop_params FROM data.presets WHERE operation = ?1",
+      "SELECT name, op_version, op_params, blendop_version, blendop_params FROM data.presets"
+      " WHERE operation = ?1 AND (op_version < ?2 OR blendop_version < ?3 OR IFNULL(LENGTH(blendop_params), 0) = 0)",
       -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, module_so->op, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, module_version);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, dt_develop_blend_version());
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -1470,6 +1508,7 @@ void dt_iop_load_modules_so(void)
 {
   darktable.iop = dt_module_load_modules("/plugins", sizeof(dt_iop_module_so_t), dt_iop_load_module_so,
                                          _init_module_so, NULL);
+  dt_gui_presets_builtin_written(TRUE);
 }
 
 int dt_iop_load_module(dt_iop_module_t *module, dt_iop_module_so_t *module_so, dt_develop_t *dev)
@@ -1549,7 +1588,7 @@ void dt_iop_unload_modules_so()
   while(darktable.iop)
   {
     dt_iop_module_so_t *module = (dt_iop_module_so_t *)darktable.iop->data;
-    if(module->cleanup_global) module->cleanup_global(module);
+    if(module->cleanup_global && module->global_inited) module->cleanup_global(module);
     if(module->module) g_module_close(module->module);
     free(darktable.iop->data);
     darktable.iop = g_list_delete_link(darktable.iop, darktable.iop);
@@ -1720,6 +1759,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
                           dt_develop_blend_params_t *blendop_params, dt_dev_pixelpipe_t *pipe,
                           dt_dev_pixelpipe_iop_t *piece)
 {
+  // commit_params() and process() of the module may rely on its global data
+  dt_iop_init_global(module);
+
   // 1. commit params
 
   memcpy(piece->blendop_data, blendop_params, sizeof(dt_develop_blend_params_t));
@@ -1736,6 +1778,9 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
   if(module->flags() & IOP_FLAGS_ALLOW_TILING)
     piece->process_tiling_ready = 1;
 
+  // only commit_params knows whether these params leave the image as it is.
+  piece->identity = FALSE;
+
   if(darktable.unmuted & DT_DEBUG_PARAMS && module->so->get_introspection())
     _iop_validate_params(module->so->get_introspection()->field, params, TRUE);
 
@@ -2983,9 +3028,8 @@ void dt_iop_refresh_center(dt_iop_module_t *module)
   dt_develop_t *dev = module->dev;
   if (dev && dev->gui_attached)
   {
-    // invalidate the pixelpipe cache except for the output of the prior module
-    const uint64_t hash = dt_dev_pixelpipe_cache_basichash_prior(dev->pipe->image.id, dev->pipe, module);
-    dt_dev_pixelpipe_cache_flush_all_but(&dev->pipe->cache, hash);
+    // invalidate the pixelpipe cache from this module on, the prior outputs are still valid
+    dt_dev_pixelpipe_cache_flush_downstream(&dev->pipe->cache, dev->pipe->image.id, dev->pipe, module);
     dev->pipe->changed |= DT_DEV_PIPE_SYNCH; //ensure that commit_params gets called to pick up any GUI changes
     dt_dev_invalidate(dev);
     dt_control_queue_redraw_center();
@@ -2998,9 +3042,8 @@ void dt_iop_refresh_preview(dt_iop_module_t *module)
   dt_develop_t *dev = module->dev;
   if (dev && dev->gui_attached)
   {
-    // invalidate the pixelpipe cache except for the output of the prior module
-    const uint64_t hash = dt_dev_pixelpipe_cache_basichash_prior(dev->pipe->image.id, dev->preview_pipe, module);
-    dt_dev_pixelpipe_cache_flush_all_but(&dev->preview_pipe->cache, hash);
+    // invalidate the pixelpipe cache from this module on, the prior outputs are still valid
+    dt_dev_pixelpipe_cache_flush_downstream(&dev->preview_pipe->cache, dev->pipe->image.id, dev->preview_pipe, module);
     dev->pipe->changed |= DT_DEV_PIPE_SYNCH; //ensure that commit_params gets called to pick up any GUI changes
     dt_dev_invalidate_all(dev);
     dt_control_queue_redraw();
@@ -3013,9 +3056,8 @@ void dt_iop_refresh_preview2(dt_iop_module_t *module)
   dt_develop_t *dev = module->dev;
   if (dev && dev->gui_attached)
   {
-    // invalidate the pixelpipe cache except for the output of the prior module
-    const uint64_t hash = dt_dev_pixelpipe_cache_basichash_prior(dev->pipe->image.id, dev->preview2_pipe, module);
-    dt_dev_pixelpipe_cache_flush_all_but(&dev->preview2_pipe->cache, hash);
+    // invalidate the pixelpipe cache from this module on, the prior outputs are still valid
+    dt_dev_pixelpipe_cache_flush_downstream(&dev->preview2_pipe->cache, dev->pipe->image.id, dev->preview2_pipe, module);
     dev->pipe->changed |= DT_DEV_PIPE_SYNCH; //ensure that commit_params gets called to pick up any GUI changes
     dt_dev_invalidate_all(dev);
     dt_control_queue_redraw();
@@ -166,6 +166,8 @@ typedef struct dt_iop_module_so_t
   /** other stuff that may be needed by the module, not only in gui mode. inited only once, has to be
    * read-only then. */
   dt_iop_global_data_t *data;
+  /** set once init_global() ran, which is deferred to the first use of the module. */
+  gint global_inited;
   /** gui is also only inited once at startup. */
 //  dt_iop_gui_data_t *gui_data;
   /** which results in this widget here, too. */
@@ -359,6 +361,8 @@ dt_iop_module_t *dt_iop_gui_duplicate(dt_iop_module_t *base, gboolean copy_param
 
 void dt_iop_gui_update_header(dt_iop_module_t *module);
 
+/** runs the deferred init_global() of the module type on first use and points global_data to it. */
+void dt_iop_init_global(dt_iop_module_t *module);
 /** commits params and updates piece hash. */
 void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
                           struct dt_develop_blend_params_t *blendop_params, struct dt_dev_pixelpipe_t *pipe,
@@ -20,6 +20,7 @@
 #include <assert.h> // for assert
 #include <glib.h> // for MIN, MAX, CLAMP, inline
 #include <math.h> // for round, floorf, fmaxf
+#include <string.h> // for memset
 #include "common/darktable.h"        // for darktable, darktable_t, dt_code...
 #include "common/imageio.h"          // for FILTERS_ARE_4BAYER
 #include "common/interpolation.h"    // for dt_interpolation_new, dt_interp...
@@ -90,6 +91,66 @@ void dt_iop_flip_and_zoom_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *
   }
 }
 
+void dt_iop_downsample_8(const uint8_t *in, int32_t iw, int32_t ih, uint8_t *out, int32_t ow, int32_t oh,
+                         uint32_t *width, uint32_t *height)
+{
+  // DO NOT UPSCALE !!!
+  const float scale = fmaxf(1.0, fmaxf(iw / (float)ow, ih / (float)oh));
+  const uint32_t wd = *width = MIN(ow, iw / scale);
+  const uint32_t ht = *height = MIN(oh, ih / scale);
+  if(!wd || !ht) return;
+
+  // one input row wide accumulator per thread, holding the weighted sum of the rows under one output row
+  const size_t stride = (size_t)4 * iw;
+  size_t padded_size;
+  float *const restrict rows = dt_alloc_perthread_float(stride, &padded_size);
+  if(!rows)
+  {
+    dt_iop_flip_and_zoom_8(in, iw, ih, out, ow, oh, ORIENTATION_NONE, width, height);
+    return;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, iw, ih, wd, ht, scale, stride, rows, padded_size) \
+  schedule(static)
+#endif
+  for(uint32_t j = 0; j < ht; j++)
+  {
+    float *const restrict acc = dt_get_perthread(rows, padded_size);
+    memset(acc, 0, sizeof(float) * stride);
+
+    const float y0 = j * scale;
+    const float y1 = fminf(ih, (j + 1) * scale);
+    for(int y = y0; y < y1; y++)
+    {
+      const float wy = fminf(y + 1, y1) - fmaxf(y, y0);
+      const uint8_t *const restrict row = in + stride * y;
+#ifdef _OPENMP
+#pragma omp simd aligned(acc: 64)
+#endif
+      for(size_t k = 0; k < stride; k++) acc[k] += wy * row[k];
+    }
+
+    uint8_t *const restrict out2 = out + (size_t)4 * wd * j;
+    for(uint32_t i = 0; i < wd; i++)
+    {
+      const float x0 = i * scale;
+      const float x1 = fminf(iw, (i + 1) * scale);
+      float sum[4] = { 0.0f };
+      for(int x = x0; x < x1; x++)
+      {
+        const float wx = fminf(x + 1, x1) - fmaxf(x, x0);
+        for(int c = 0; c < 4; c++) sum[c] += wx * acc[4 * x + c];
+      }
+      const float norm = 1.0f / ((x1 - x0) * (y1 - y0));
+      for(int c = 0; c < 4; c++) out2[4 * i + c] = CLAMP((int)(sum[c] * norm + 0.5f), 0, 255);
+    }
+  }
+
+  dt_free_align(rows);
+}
+
 void dt_iop_clip_and_zoom_8(const uint8_t *i, int32_t ix, int32_t iy, int32_t iw, int32_t ih, int32_t ibw,
                             int32_t ibh, uint8_t *o, int32_t ox, int32_t oy, int32_t ow, int32_t oh,
                             int32_t obw, int32_t obh)
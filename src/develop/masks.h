@@ -327,6 +327,15 @@ int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece
                           float **buffer, int *roi, float scale);
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                               const dt_iop_roi_t *roi, float *buffer);
+#ifdef HAVE_OPENCL
+/** render the group on the device into the image dev_mask, inverted if requested. only groups of circles,
+    ellipses and gradients behind an affine distortion are supported, returns FALSE for the host to take over */
+gboolean dt_masks_group_render_roi_cl(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                      dt_masks_form_t *form, const dt_iop_roi_t *roi, cl_mem dev_mask,
+                                      const gboolean invert);
+#endif
+/** drop the rendered masks kept for the interactive pipes */
+void dt_masks_render_cache_flush(void);
 
 // returns current masks version
 int dt_masks_version(void);
@@ -435,6 +444,11 @@ void dt_masks_blur_9x9_coeff(float *coeffs, const float sigma);
 void dt_masks_blur_9x9(float *const src, float *const out, const int width, const int height, const float sigma);
 void dt_masks_calc_rawdetail_mask(float *const src, float *const out, float *const tmp, const int width,
                                   const int height, const dt_aligned_pixel_t wb);
+// box average a mask down by factor into ceil(width / factor) x ceil(height / factor), and interpolate it back
+void dt_masks_downsample_mask(const float *const src, float *const out, const int width, const int height,
+                              const int factor);
+void dt_masks_upsample_mask(const float *const src, float *const out, const int width, const int height,
+                            const int factor);
 void dt_masks_calc_detail_mask(float *const src, float *const out, float *const tmp, const int width, const int height, const float threshold, const gboolean detail);
 
 void dt_masks_blur_approx_weighed(float *const src, float *const out, float *const weight, const int width, const int height);
@@ -2759,46 +2759,81 @@ static int _brush_get_mask(const dt_iop_module_t *const module, const dt_dev_pix
   return 1;
 }
 
-/** we write a falloff segment respecting limits of buffer */
-static inline void _brush_falloff_roi(float *buffer, const int *p0, const int *p1, int bw, int bh, float hardness,
-                                      float density)
+/** size of the tiles the falloff rays are binned into, each tile is stamped by one thread */
+#define DT_BRUSH_TILE 64
+
+typedef struct dt_brush_falloff_ray_t
+{
+  float x0, y0;       // start on the brush line
+  float lx, ly;       // step along the ray
+  int l, solid;       // number of steps, and how many of them are at full density
+  float density, dop; // opacity on the solid part, and its decrease per step after that
+} dt_brush_falloff_ray_t;
+
+static inline void _brush_falloff_ray_init(dt_brush_falloff_ray_t *r, const int *p0, const int *p1,
+                                           const float hardness, const float density)
 {
   // segment length (increase by 1 to avoid division-by-zero special case handling)
-  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
-  const int solid = hardness * l;
-
-  const float lx = (float)(p1[0] - p0[0]) / (float)l;
-  const float ly = (float)(p1[1] - p0[1]) / (float)l;
+  r->l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
+  r->solid = hardness * r->l;
+  r->x0 = p0[0];
+  r->y0 = p0[1];
+  r->lx = (float)(p1[0] - p0[0]) / (float)r->l;
+  r->ly = (float)(p1[1] - p0[1]) / (float)r->l;
+  r->density = density;
+  r->dop = density / (float)(r->l - r->solid);
+}
 
-  const int dx = lx <= 0 ? -1 : 1;
-  const int dy = ly <= 0 ? -1 : 1;
-  const int dpx = dx;
-  const int dpy = dy * bw;
+/** first and last step of a ray whose stamp may touch [lo, hi] along one axis */
+static inline void _brush_falloff_ray_clip(const float start, const float step, const int lo, const int hi,
+                                           int *first, int *last)
+{
+  // a stamp covers the pixel of the step and its neighbour, keep one more pixel for the truncation
+  const float a = lo - 2 - start, b = hi + 2 - start;
+  if(step > 0.0f)
+  {
+    *first = MAX(*first, (int)floorf(a / step));
+    *last = MIN(*last, (int)ceilf(b / step));
+  }
+  else if(step < 0.0f)
+  {
+    *first = MAX(*first, (int)floorf(b / step));
+    *last = MIN(*last, (int)ceilf(a / step));
+  }
+  else if(a > 0.0f || b < 0.0f)
+    *last = -1;
+}
 
-  float fx = p0[0];
-  float fy = p0[1];
+/** we write the part of a falloff ray which lies within the tile [tx0, tx1[ x [ty0, ty1[ of the buffer */
+static inline void _brush_falloff_tile(float *buffer, const dt_brush_falloff_ray_t *r, const int bw,
+                                       const int bh, const int tx0, const int ty0, const int tx1, const int ty1)
+{
+  int first = 0, last = r->l - 1;
+  _brush_falloff_ray_clip(r->x0, r->lx, tx0, tx1 - 1, &first, &last);
+  _brush_falloff_ray_clip(r->y0, r->ly, ty0, ty1 - 1, &first, &last);
 
-  float op = density;
-  const float dop = density / (float)(l - solid);
+  const int dx = r->lx <= 0 ? -1 : 1;
+  const int dy = r->ly <= 0 ? -1 : 1;
 
-  for(int i = 0; i < l; i++)
+  float fx = r->x0 + first * r->lx;
+  float fy = r->y0 + first * r->ly;
+  for(int i = first; i <= last; i++, fx += r->lx, fy += r->ly)
   {
     const int x = fx;
     const int y = fy;
+    if((unsigned)x >= (unsigned)bw || (unsigned)y >= (unsigned)bh) continue;
 
-    fx += lx;
-    fy += ly;
-    if(i > solid) op -= dop;
-
-    if(x < 0 || x >= bw || y < 0 || y >= bh) continue;
+    const gboolean in_x = x >= tx0 && x < tx1;
+    const gboolean in_y = y >= ty0 && y < ty1;
+    if(!in_x && !in_y) continue;
 
+    const float op = i > r->solid ? r->density - r->dop * (i - r->solid) : r->density;
     float *buf = buffer + (size_t)y * bw + x;
 
-    *buf = MAX(*buf, op);
-    if(x + dx >= 0 && x + dx < bw)
-      buf[dpx] = MAX(buf[dpx], op); // this one is to avoid gaps due to int rounding
-    if(y + dy >= 0 && y + dy < bh)
-      buf[dpy] = MAX(buf[dpy], op); // this one is to avoid gaps due to int rounding
+    if(in_x && in_y) *buf = MAX(*buf, op);
+    // these ones are to avoid gaps due to int rounding
+    if(in_y && x + dx >= tx0 && x + dx < tx1) buf[dx] = MAX(buf[dx], op);
+    if(in_x && y + dy >= ty0 && y + dy < ty1) buf[dy * bw] = MAX(buf[dy * bw], op);
   }
 }
 
@@ -2877,16 +2912,28 @@ static int _brush_get_mask_roi(const dt_iop_module_t *const module, const dt_dev
     return 1;
   }
 
-  // now we fill the falloff
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(nb_corner, border_count, width, height) \
-  shared(buffer, points, border, payload) schedule(static)
-#else
-#pragma omp parallel for shared(buffer)
-#endif
-#endif
+  // now we fill the falloff. the rays from the brush line to its border are binned into the tiles of the
+  // roi they reach, so that every tile can be stamped by a single thread.
+  const int nb_rays_max = border_count - nb_corner * 3;
+  const int tiles_x = (width + DT_BRUSH_TILE - 1) / DT_BRUSH_TILE;
+  const int tiles_y = (height + DT_BRUSH_TILE - 1) / DT_BRUSH_TILE;
+  const int nb_tiles = tiles_x * tiles_y;
+  dt_brush_falloff_ray_t *rays = dt_alloc_align(64, sizeof(dt_brush_falloff_ray_t) * MAX(nb_rays_max, 1));
+  int *tile_rect = dt_alloc_align(64, sizeof(int) * 4 * MAX(nb_rays_max, 1));
+  int *tile_start = calloc(nb_tiles + 1, sizeof(int));
+  if(!rays || !tile_rect || !tile_start)
+  {
+    dt_free_align(rays);
+    dt_free_align(tile_rect);
+    free(tile_start);
+    dt_free_align(points);
+    dt_free_align(border);
+    dt_free_align(payload);
+    return 0;
+  }
+
+  int nb_rays = 0;
+  size_t nb_refs = 0;
   for(int i = nb_corner * 3; i < border_count; i++)
   {
     const int p0[] = { points[i * 2], points[i * 2 + 1] };
@@ -2896,8 +2943,65 @@ static int _brush_get_mask_roi(const dt_iop_module_t *const module, const dt_dev
        || MIN(p0[1], p1[1]) >= height)
       continue;
 
-    _brush_falloff_roi(buffer, p0, p1, width, height, payload[i * 2], payload[i * 2 + 1]);
+    _brush_falloff_ray_init(rays + nb_rays, p0, p1, payload[i * 2], payload[i * 2 + 1]);
+
+    // tiles touched by the ray, including the neighbours stamped against rounding gaps
+    int *rect = tile_rect + 4 * nb_rays;
+    rect[0] = CLAMP(MIN(p0[0], p1[0]) - 1, 0, width - 1) / DT_BRUSH_TILE;
+    rect[1] = CLAMP(MAX(p0[0], p1[0]) + 1, 0, width - 1) / DT_BRUSH_TILE;
+    rect[2] = CLAMP(MIN(p0[1], p1[1]) - 1, 0, height - 1) / DT_BRUSH_TILE;
+    rect[3] = CLAMP(MAX(p0[1], p1[1]) + 1, 0, height - 1) / DT_BRUSH_TILE;
+    for(int ty = rect[2]; ty <= rect[3]; ty++)
+      for(int tx = rect[0]; tx <= rect[1]; tx++) tile_start[ty * tiles_x + tx + 1]++;
+    nb_refs += (size_t)(rect[1] - rect[0] + 1) * (rect[3] - rect[2] + 1);
+    nb_rays++;
+  }
+  for(int t = 0; t < nb_tiles; t++) tile_start[t + 1] += tile_start[t];
+
+  int *refs = dt_alloc_align(64, sizeof(int) * MAX(nb_refs, 1));
+  int *fill = malloc(sizeof(int) * nb_tiles);
+  if(!refs || !fill)
+  {
+    dt_free_align(refs);
+    free(fill);
+    dt_free_align(rays);
+    dt_free_align(tile_rect);
+    free(tile_start);
+    dt_free_align(points);
+    dt_free_align(border);
+    dt_free_align(payload);
+    return 0;
   }
+  memcpy(fill, tile_start, sizeof(int) * nb_tiles);
+  for(int r = 0; r < nb_rays; r++)
+  {
+    const int *rect = tile_rect + 4 * r;
+    for(int ty = rect[2]; ty <= rect[3]; ty++)
+      for(int tx = rect[0]; tx <= rect[1]; tx++) refs[fill[ty * tiles_x + tx]++] = r;
+  }
+  free(fill);
+  dt_free_align(tile_rect);
+
+  // tiles without any ray are left alone
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, rays, refs, tile_start, nb_tiles, tiles_x, width, height) \
+  schedule(dynamic)
+#endif
+  for(int t = 0; t < nb_tiles; t++)
+  {
+    if(tile_start[t] == tile_start[t + 1]) continue;
+    const int tx0 = (t % tiles_x) * DT_BRUSH_TILE;
+    const int ty0 = (t / tiles_x) * DT_BRUSH_TILE;
+    const int tx1 = MIN(tx0 + DT_BRUSH_TILE, width);
+    const int ty1 = MIN(ty0 + DT_BRUSH_TILE, height);
+    for(int r = tile_start[t]; r < tile_start[t + 1]; r++)
+      _brush_falloff_tile(buffer, rays + refs[r], width, height, tx0, ty0, tx1, ty1);
+  }
+
+  dt_free_align(refs);
+  dt_free_align(rays);
+  free(tile_start);
 
   dt_free_align(points);
   dt_free_align(border);
@@ -51,6 +51,9 @@
   This raw detail mask (RM) is not scaled but only cropped to the roi of the writing module (demosaic
   or rawprepare).
   The pipe gets roi copy of the writing module so we can later scale/distort the LM.
+  While editing, the RM may be kept box averaged at half or quarter resolution (see the
+  plugins/darkroom/masks/detail_resolution preference), dt_dev_get_rawdetail_mask() interpolates it
+  back to the roi when a module needs it.
 
   Calculating the RM is done for performance and lower mem pressure reasons, so we don't have to
   pass full data to the module. Also the RM can be used by other modules.
@@ -473,6 +476,68 @@ void dt_masks_calc_rawdetail_mask(float *const restrict src, float *const restri
   dt_masks_extend_border(mask, width, height, 1);
 }
 
+void dt_masks_downsample_mask(const float *const restrict src, float *const restrict out,
+                              const int width, const int height, const int factor)
+{
+  const int swidth = (width + factor - 1) / factor;
+  const int sheight = (height + factor - 1) / factor;
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) \
+  dt_omp_firstprivate(src, out, width, height, factor, swidth, sheight) \
+  schedule(static)
+#endif
+  for(int row = 0; row < sheight; row++)
+  {
+    const int y0 = row * factor;
+    const int y1 = MIN(y0 + factor, height);
+    for(int col = 0; col < swidth; col++)
+    {
+      const int x0 = col * factor;
+      const int x1 = MIN(x0 + factor, width);
+      float sum = 0.0f;
+      for(int y = y0; y < y1; y++)
+        for(int x = x0; x < x1; x++)
+          sum += src[(size_t)y * width + x];
+      out[(size_t)row * swidth + col] = sum / (float)((y1 - y0) * (x1 - x0));
+    }
+  }
+}
+
+void dt_masks_upsample_mask(const float *const restrict src, float *const restrict out,
+                            const int width, const int height, const int factor)
+{
+  const int swidth = (width + factor - 1) / factor;
+  const int sheight = (height + factor - 1) / factor;
+  // the small pixels sit in the center of the block of pixels they were averaged from
+  const float scale = 1.0f / factor;
+  const float offset = 0.5f * (factor - 1);
+#ifdef _OPENMP
+  #pragma omp parallel for default(none) \
+  dt_omp_firstprivate(src, out, width, height, swidth, sheight, scale, offset) \
+  schedule(static)
+#endif
+  for(int row = 0; row < height; row++)
+  {
+    const float fy = CLAMPS((row - offset) * scale, 0.0f, sheight - 1);
+    const int y0 = MIN((int)fy, sheight - 1);
+    const int y1 = MIN(y0 + 1, sheight - 1);
+    const float wy = fy - y0;
+    const float *const s0 = src + (size_t)y0 * swidth;
+    const float *const s1 = src + (size_t)y1 * swidth;
+    float *const o = out + (size_t)row * width;
+    for(int col = 0; col < width; col++)
+    {
+      const float fx = CLAMPS((col - offset) * scale, 0.0f, swidth - 1);
+      const int x0 = MIN((int)fx, swidth - 1);
+      const int x1 = MIN(x0 + 1, swidth - 1);
+      const float wx = fx - x0;
+      const float top = s0[x0] + wx * (s0[x1] - s0[x0]);
+      const float bot = s1[x0] + wx * (s1[x1] - s1[x0]);
+      o[col] = top + wy * (bot - top);
+    }
+  }
+}
+
 static inline float calcBlendFactor(float val, float threshold)
 {
     // sigmoid function
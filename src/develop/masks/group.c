@@ -401,183 +401,130 @@ error:
   return 0;
 }
 
-static void _combine_masks_union(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                 const float opacity, const int inverted)
-{
-  if (inverted)
-  {
 #ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
+#pragma omp declare simd
 #endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * (1.0f - newmask[index]);
-      dest[index] = MAX(dest[index], mask);
-    }
+static inline int both_positive(const float val1, const float val2)
+{
+  // this needs to be a separate inline function to convince the compiler to vectorize
+  return (val1 > 0.0f) && (val2 > 0.0f);
+}
+
+static inline void _combine_row_union(float *const restrict dest, const float *const restrict newmask,
+                                      const int count, const float opacity, const int inverted)
+{
+  for(int i = 0; i < count; i++)
+  {
+    const float mask = opacity * (inverted ? 1.0f - newmask[i] : newmask[i]);
+    dest[i] = MAX(dest[i], mask);
   }
-  else
+}
+
+static inline void _combine_row_intersect(float *const restrict dest, const float *const restrict newmask,
+                                          const int count, const float opacity, const int inverted)
+{
+  for(int i = 0; i < count; i++)
   {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * newmask[index];
-      dest[index] = MAX(dest[index], mask);
-    }
+    const float mask = opacity * (inverted ? 1.0f - newmask[i] : newmask[i]);
+    dest[i] = MIN(MAX(dest[i], 0.0f), MAX(mask, 0.0f));
   }
 }
 
-static void _combine_masks_intersect(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                     const float opacity, const int inverted)
+static inline void _combine_row_difference(float *const restrict dest, const float *const restrict newmask,
+                                           const int count, const float opacity, const int inverted)
 {
-  if (inverted)
+  for(int i = 0; i < count; i++)
   {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * (1.0f - newmask[index]);
-      dest[index] = MIN(MAX(dest[index], 0.0f), MAX(mask, 0.0f));
-    }
+    const float mask = opacity * (inverted ? 1.0f - newmask[i] : newmask[i]);
+    dest[i] *= (1.0f - mask * both_positive(dest[i], mask));
   }
-  else
+}
+
+static inline void _combine_row_exclusion(float *const restrict dest, const float *const restrict newmask,
+                                          const int count, const float opacity, const int inverted)
+{
+  for(int i = 0; i < count; i++)
   {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * newmask[index];
-      dest[index] = MIN(MAX(dest[index], 0.0f), MAX(mask, 0.0f));
-    }
+    const float mask = opacity * (inverted ? 1.0f - newmask[i] : newmask[i]);
+    const float pos = both_positive(dest[i], mask);
+    const float neg = (1.0f - pos);
+    const float b1 = dest[i];
+    dest[i] = pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + neg * MAX(b1, mask);
   }
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd
-#endif
-static inline int both_positive(const float val1, const float val2)
+static inline void _combine_row_copy(float *const restrict dest, const float *const restrict newmask,
+                                     const int count, const float opacity, const int inverted)
 {
-  // this needs to be a separate inline function to convince the compiler to vectorize
-  return (val1 > 0.0f) && (val2 > 0.0f);
+  for(int i = 0; i < count; i++)
+    dest[i] = opacity * (inverted ? (1.0f - newmask[i]) : newmask[i]);
 }
 
-static void _combine_masks_difference(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                      const float opacity, const int inverted)
+// combine the shape in newmask with dest within the rectangle rect = { x, y, width, height } of the roi
+static void _combine_masks(float *const restrict dest, const float *const restrict newmask, const int width,
+                           const int *const rect, const float opacity, const int inverted, const int state)
 {
-  if (inverted)
-  {
+  const int x0 = rect[0];
+  const int y0 = rect[1];
+  const int rw = rect[2];
+  const int rh = rect[3];
 #ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(dest, newmask, width, x0, y0, rw, rh, opacity, inverted, state) \
+  schedule(static)
 #endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * (1.0f - newmask[index]);
-      dest[index] *= (1.0f - mask * both_positive(dest[index],mask));
-    }
-  }
-  else
+  for(int j = y0; j < y0 + rh; j++)
   {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * newmask[index];
-      dest[index] *= (1.0f - mask * both_positive(dest[index],mask));
-    }
+    const size_t row = (size_t)j * width + x0;
+    if(state & DT_MASKS_STATE_UNION)
+      _combine_row_union(dest + row, newmask + row, rw, opacity, inverted);
+    else if(state & DT_MASKS_STATE_INTERSECTION)
+      _combine_row_intersect(dest + row, newmask + row, rw, opacity, inverted);
+    else if(state & DT_MASKS_STATE_DIFFERENCE)
+      _combine_row_difference(dest + row, newmask + row, rw, opacity, inverted);
+    else if(state & DT_MASKS_STATE_EXCLUSION)
+      _combine_row_exclusion(dest + row, newmask + row, rw, opacity, inverted);
+    else // if we are here, this mean that we just have to copy the shape and null other parts
+      _combine_row_copy(dest + row, newmask + row, rw, opacity, inverted);
   }
 }
 
-static void _combine_masks_exclusion(float *const restrict dest, float *const restrict newmask, const size_t npixels,
-                                     const float opacity, const int inverted)
+static void _clear_rect(float *const restrict buffer, const int width, const int x, const int y, const int w,
+                        const int h)
 {
-  if (inverted)
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * (1.0f - newmask[index]);
-      const float pos = both_positive(dest[index], mask);
-      const float neg = (1.0f - pos);
-      const float b1 = dest[index];
-      dest[index] = pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + neg * MAX(b1, mask);
-    }
-  }
-  else
-  {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(npixels, opacity) \
-  dt_omp_sharedconst(dest, newmask) aligned(dest, newmask : 64) \
-  schedule(simd:static)
-#else
-#pragma omp parallel for shared(dest, newmask)
-#endif
-#endif
-    for(int index = 0; index < npixels; index++)
-    {
-      const float mask = opacity * newmask[index];
-      const float pos = both_positive(dest[index], mask);
-      const float neg = (1.0f - pos);
-      const float b1 = dest[index];
-      dest[index] = pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + neg * MAX(b1, mask);
-    }
-  }
+  if(w <= 0 || h <= 0) return;
+  for(int j = y; j < y + h; j++) memset(buffer + (size_t)j * width + x, 0, sizeof(float) * w);
+}
+
+// the part of the roi a shape can be non-zero in, from its area plus a margin for the interpolation grids
+// of the shapes. the whole roi for shapes covering everything, or when inverted.
+#define DT_MASKS_GROUP_RECT_MARGIN 16
+
+static void _group_shape_rect(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                              dt_masks_form_t *const sel, const dt_iop_roi_t *const roi, const int inverted,
+                              int *const rect)
+{
+  rect[0] = rect[1] = 0;
+  rect[2] = roi->width;
+  rect[3] = roi->height;
+
+  if(inverted || !(sel->type & (DT_MASKS_CIRCLE | DT_MASKS_ELLIPSE | DT_MASKS_PATH | DT_MASKS_BRUSH))
+     || (sel->type & DT_MASKS_GROUP))
+    return;
+
+  int fw, fh, fl, ft;
+  if(!dt_masks_get_area((dt_iop_module_t *)module, (dt_dev_pixelpipe_iop_t *)piece, sel, &fw, &fh, &fl, &ft))
+    return;
+
+  const int x0 = CLAMP((int)floorf(fl * roi->scale) - roi->x - DT_MASKS_GROUP_RECT_MARGIN, 0, roi->width);
+  const int y0 = CLAMP((int)floorf(ft * roi->scale) - roi->y - DT_MASKS_GROUP_RECT_MARGIN, 0, roi->height);
+  const int x1 = CLAMP((int)ceilf((fl + fw) * roi->scale) - roi->x + DT_MASKS_GROUP_RECT_MARGIN, 0, roi->width);
+  const int y1 = CLAMP((int)ceilf((ft + fh) * roi->scale) - roi->y + DT_MASKS_GROUP_RECT_MARGIN, 0, roi->height);
+
+  rect[0] = x0;
+  rect[1] = y0;
+  rect[2] = MAX(x1 - x0, 0);
+  rect[3] = MAX(y1 - y0, 0);
 }
 
 static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
@@ -591,10 +538,9 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
 
   const int width = roi->width;
   const int height = roi->height;
-  const size_t npixels = (size_t)width * height;
 
   // we need to allocate a zeroed temporary buffer for intermediate creation of individual shapes
-  float *const restrict bufs = dt_alloc_align_float(npixels);
+  float *const restrict bufs = dt_calloc_align_float((size_t)width * height);
   if(bufs == NULL) return 0;
 
   // and we get all masks
@@ -605,56 +551,40 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
 
     if(sel)
     {
-      // ensure that we start with a zeroed buffer regardless of what was previously written into 'bufs'
-      memset(bufs, 0, npixels*sizeof(float));
-      const int ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
       const float op = fpt->opacity;
       const int state = fpt->state;
+      // first see if we need to invert this shape
+      const int inverted = (state & DT_MASKS_STATE_INVERSE);
+
+      // small shapes only need to be combined within their bounding box, outside of it they are zero
+      int rect[4];
+      _group_shape_rect(module, piece, sel, roi, inverted, rect);
+
+      const int ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
 
       if(ok)
       {
-        // first see if we need to invert this shape
-        const int inverted = (state & DT_MASKS_STATE_INVERSE);
+        _combine_masks(buffer, bufs, width, rect, op, inverted, state);
 
-        if(state & DT_MASKS_STATE_UNION)
-        {
-          _combine_masks_union(buffer, bufs, npixels, op, inverted);
-        }
-        else if(state & DT_MASKS_STATE_INTERSECTION)
-        {
-          _combine_masks_intersect(buffer, bufs, npixels, op, inverted);
-        }
-        else if(state & DT_MASKS_STATE_DIFFERENCE)
-        {
-          _combine_masks_difference(buffer, bufs, npixels, op, inverted);
-        }
-        else if(state & DT_MASKS_STATE_EXCLUSION)
-        {
-          _combine_masks_exclusion(buffer, bufs, npixels, op, inverted);
-        }
-        else // if we are here, this mean that we just have to copy the shape and null other parts
+        // intersections and copies null the parts outside of the shape
+        if(!(state & (DT_MASKS_STATE_UNION | DT_MASKS_STATE_DIFFERENCE | DT_MASKS_STATE_EXCLUSION)))
         {
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for simd default(none) \
-          dt_omp_firstprivate(npixels, op, inverted) \
-          dt_omp_sharedconst(buffer, bufs) schedule(simd:static) aligned(buffer, bufs : 64)
-#else
-#pragma omp parallel for shared(bufs, buffer)
-#endif
-#endif
-          for(int index = 0; index < npixels; index++)
-          {
-            buffer[index] = op * (inverted ? (1.0f - bufs[index]) : bufs[index]);
-          }
+          _clear_rect(buffer, width, 0, 0, width, rect[1]);
+          _clear_rect(buffer, width, 0, rect[1] + rect[3], width, height - rect[1] - rect[3]);
+          _clear_rect(buffer, width, 0, rect[1], rect[0], rect[3]);
+          _clear_rect(buffer, width, rect[0] + rect[2], rect[1], width - rect[0] - rect[2], rect[3]);
         }
 
         if(darktable.unmuted & DT_DEBUG_PERF)
-          dt_print(DT_DEBUG_MASKS, "[masks %d] combine took %0.04f sec\n", nb_ok, dt_get_wtime() - start);
+          dt_print(DT_DEBUG_MASKS, "[masks %d] combine took %0.04f sec (%dx%d of %dx%d)\n", nb_ok,
+                   dt_get_wtime() - start, rect[2], rect[3], width, height);
         start = dt_get_wtime();
 
         nb_ok++;
       }
+
+      // ensure that the next shape starts with a zeroed buffer
+      _clear_rect(bufs, width, rect[0], rect[1], rect[2], rect[3]);
     }
   }
   // and we free the intermediate buffer
@@ -663,19 +593,348 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
   return nb_ok != 0;
 }
 
+// rendered masks of the interactive pipes, so that changing anything but the shapes or the distortions up
+// to a module doesn't rasterize all of its shapes again. full and preview pipes share the entries.
+#define DT_MASKS_RENDER_CACHE_ENTRIES 8
+
+typedef struct dt_masks_render_cache_entry_t
+{
+  uint64_t hash;
+  int width, height;
+  float *buf;
+} dt_masks_render_cache_entry_t;
+
+static dt_masks_render_cache_entry_t _render_cache[DT_MASKS_RENDER_CACHE_ENTRIES];
+static int _render_cache_next = 0;
+static GMutex _render_cache_lock;
+
+static inline uint64_t _hash_bytes(uint64_t hash, const void *data, const size_t size)
+{
+  const char *str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+// same contents as dt_masks_group_get_hash_buffer(), but looking up the shapes where rendering does
+static uint64_t _form_hash(dt_develop_t *dev, dt_masks_form_t *form, uint64_t hash)
+{
+  hash = _hash_bytes(hash, &form->type, sizeof(dt_masks_type_t));
+  hash = _hash_bytes(hash, &form->formid, sizeof(int));
+  hash = _hash_bytes(hash, &form->version, sizeof(int));
+  hash = _hash_bytes(hash, form->source, sizeof(float) * 2);
+
+  for(GList *forms = form->points; forms; forms = g_list_next(forms))
+  {
+    if(form->type & DT_MASKS_GROUP)
+    {
+      dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
+      dt_masks_form_t *f = dt_masks_get_from_id(dev, grpt->formid);
+      if(f)
+      {
+        hash = _hash_bytes(hash, &grpt->state, sizeof(int));
+        hash = _hash_bytes(hash, &grpt->opacity, sizeof(float));
+        hash = _form_hash(dev, f, hash);
+      }
+    }
+    else if(form->functions)
+      hash = _hash_bytes(hash, forms->data, form->functions->point_struct_size);
+  }
+  return hash;
+}
+
+// everything the rendered mask depends on: the shapes, the distortions up to the module, the image
+// and the region of interest
+static uint64_t _render_hash(const dt_iop_module_t *const module, const dt_dev_pixelpipe_iop_t *const piece,
+                             dt_masks_form_t *const form, const dt_iop_roi_t *const roi)
+{
+  const dt_dev_pixelpipe_t *const pipe = piece->pipe;
+  uint64_t hash = _form_hash(module->dev, form, 5381);
+
+  // the shapes are distorted like dt_dev_distort_transform_plus(.., DT_DEV_TRANSFORM_DIR_BACK_INCL, ..) does,
+  // hash those modules like dt_dev_hash_distort_plus() without taking the history lock from within the pipe
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    const dt_dev_pixelpipe_iop_t *const p = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(p->module->iop_order > module->iop_order) break;
+    if(p->enabled && (p->module->operation_tags() & IOP_TAG_DISTORT))
+      hash = ((hash << 5) + hash) ^ p->hash;
+  }
+
+  hash = _hash_bytes(hash, &pipe->image.id, sizeof(pipe->image.id));
+  hash = _hash_bytes(hash, &pipe->iwidth, sizeof(pipe->iwidth));
+  hash = _hash_bytes(hash, &pipe->iheight, sizeof(pipe->iheight));
+  hash = _hash_bytes(hash, &pipe->iscale, sizeof(pipe->iscale));
+  hash = _hash_bytes(hash, roi, sizeof(dt_iop_roi_t));
+  return hash;
+}
+
+static gboolean _render_cache_get(const uint64_t hash, const dt_iop_roi_t *const roi, float *buffer)
+{
+  gboolean found = FALSE;
+  g_mutex_lock(&_render_cache_lock);
+  for(int k = 0; k < DT_MASKS_RENDER_CACHE_ENTRIES; k++)
+  {
+    const dt_masks_render_cache_entry_t *e = &_render_cache[k];
+    if(e->buf && e->hash == hash && e->width == roi->width && e->height == roi->height)
+    {
+      memcpy(buffer, e->buf, sizeof(float) * roi->width * roi->height);
+      found = TRUE;
+      break;
+    }
+  }
+  g_mutex_unlock(&_render_cache_lock);
+  return found;
+}
+
+static void _render_cache_put(const uint64_t hash, const dt_iop_roi_t *const roi, const float *const buffer)
+{
+  const size_t size = sizeof(float) * roi->width * roi->height;
+  float *copy = dt_alloc_align(64, size);
+  if(!copy) return;
+  memcpy(copy, buffer, size);
+
+  g_mutex_lock(&_render_cache_lock);
+  dt_masks_render_cache_entry_t *e = &_render_cache[_render_cache_next];
+  _render_cache_next = (_render_cache_next + 1) % DT_MASKS_RENDER_CACHE_ENTRIES;
+  dt_free_align(e->buf);
+  e->buf = copy;
+  e->hash = hash;
+  e->width = roi->width;
+  e->height = roi->height;
+  g_mutex_unlock(&_render_cache_lock);
+}
+
+void dt_masks_render_cache_flush(void)
+{
+  g_mutex_lock(&_render_cache_lock);
+  for(int k = 0; k < DT_MASKS_RENDER_CACHE_ENTRIES; k++)
+  {
+    dt_free_align(_render_cache[k].buf);
+    _render_cache[k].buf = NULL;
+  }
+  _render_cache_next = 0;
+  g_mutex_unlock(&_render_cache_lock);
+}
+
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                               const dt_iop_roi_t *roi, float *buffer)
 {
   const double start = dt_get_wtime();
   if(!form) return 0;
 
+  // exports and thumbnails render each mask only once
+  const gboolean cached = (piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW
+                                                | DT_DEV_PIXELPIPE_PREVIEW2)) != 0;
+  const uint64_t hash = cached ? _render_hash(module, piece, form, roi) : 0;
+  if(cached && _render_cache_get(hash, roi, buffer))
+  {
+    dt_print(DT_DEBUG_MASKS, "[masks] render all masks: reused cached mask for %s\n", module->op);
+    return 1;
+  }
+
   const int ok = dt_masks_get_mask_roi(module, piece, form, roi, buffer);
+  if(ok && cached) _render_cache_put(hash, roi, buffer);
 
   if(darktable.unmuted & DT_DEBUG_PERF)
     dt_print(DT_DEBUG_MASKS, "[masks] render all masks took %0.04f sec\n", dt_get_wtime() - start);
   return ok;
 }
 
+#ifdef HAVE_OPENCL
+// the pipe's distortion up to the module as an affine map from roi pixels to input image coordinates,
+// probed on a 4x4 grid. FALSE if it is not affine within a twentieth of a pixel of the roi.
+static gboolean _group_affine_backtransform(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                            const dt_iop_roi_t *roi, float origin[2], float step_x[2],
+                                            float step_y[2])
+{
+  const int probes = 4;
+  const float iscale = 1.0f / roi->scale;
+  float points[2 * 4 * 4];
+  for(int j = 0; j < probes; j++)
+    for(int i = 0; i < probes; i++)
+    {
+      points[2 * (j * probes + i)] = ((float)i * roi->width / (probes - 1) + roi->x) * iscale;
+      points[2 * (j * probes + i) + 1] = ((float)j * roi->height / (probes - 1) + roi->y) * iscale;
+    }
+
+  if(!dt_dev_distort_backtransform_plus(module->dev, piece->pipe, module->iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL,
+                                        points, probes * probes))
+    return FALSE;
+
+  const float *const p00 = points;
+  const float *const p10 = points + 2 * (probes - 1);
+  const float *const p01 = points + 2 * (probes - 1) * probes;
+  for(int c = 0; c < 2; c++)
+  {
+    origin[c] = p00[c];
+    step_x[c] = (p10[c] - p00[c]) / MAX(roi->width, 1);
+    step_y[c] = (p01[c] - p00[c]) / MAX(roi->height, 1);
+  }
+
+  const float tolerance = 0.05f * iscale;
+  for(int j = 0; j < probes; j++)
+    for(int i = 0; i < probes; i++)
+    {
+      const float x = (float)i * roi->width / (probes - 1);
+      const float y = (float)j * roi->height / (probes - 1);
+      const float *const pt = points + 2 * (j * probes + i);
+      for(int c = 0; c < 2; c++)
+        if(!(fabsf(origin[c] + x * step_x[c] + y * step_y[c] - pt[c]) <= tolerance)) return FALSE;
+    }
+  return TRUE;
+}
+
+// the parameters blendop_mask_shape() evaluates the shape with, -1 for shapes it can't draw
+static int _group_shape_params_cl(const dt_dev_pixelpipe_iop_t *piece, const dt_masks_form_t *form, float p[8])
+{
+  if(!form->points) return -1;
+  const float wi = piece->pipe->iwidth, hi = piece->pipe->iheight;
+  const float mindim = MIN(wi, hi);
+  const dt_masks_type_t type = form->type & ~(DT_MASKS_CLONE | DT_MASKS_NON_CLONE);
+
+  if(type == DT_MASKS_CIRCLE)
+  {
+    const dt_masks_point_circle_t *circle = (dt_masks_point_circle_t *)form->points->data;
+    const float radius = circle->radius * mindim;
+    const float total = (circle->radius + circle->border) * mindim;
+    const float radius2 = radius * radius;
+    const float total2 = total * total;
+    p[0] = circle->center[0] * wi;
+    p[1] = circle->center[1] * hi;
+    p[2] = total2;
+    p[3] = total2 - radius2;
+    return 0;
+  }
+  else if(type == DT_MASKS_ELLIPSE)
+  {
+    const dt_masks_point_ellipse_t *ellipse = (dt_masks_point_ellipse_t *)form->points->data;
+    const gboolean proportional = ellipse->flags & DT_MASKS_ELLIPSE_PROPORTIONAL;
+    const float a = ellipse->radius[0] * mindim;
+    const float b = ellipse->radius[1] * mindim;
+    const float ta = (proportional ? ellipse->radius[0] * (1.0f + ellipse->border)
+                                   : ellipse->radius[0] + ellipse->border) * mindim;
+    const float tb = (proportional ? ellipse->radius[1] * (1.0f + ellipse->border)
+                                   : ellipse->radius[1] + ellipse->border) * mindim;
+    const float alpha = (ellipse->rotation / 180.0f) * M_PI;
+    p[0] = ellipse->center[0] * wi;
+    p[1] = ellipse->center[1] * hi;
+    p[2] = a * a;
+    p[3] = b * b;
+    p[4] = ta * ta;
+    p[5] = tb * tb;
+    p[6] = cosf(alpha);
+    p[7] = sinf(alpha);
+    return 1;
+  }
+  else if(type == DT_MASKS_GRADIENT)
+  {
+    const dt_masks_point_gradient_t *gradient = (dt_masks_point_gradient_t *)form->points->data;
+    const float v = (-gradient->rotation / 180.0f) * M_PI;
+    const float sinv = sinf(v);
+    const float cosv = cosf(v);
+    p[0] = cosv;
+    p[1] = sinv;
+    p[2] = cosv * gradient->anchor[0] * wi + sinv * gradient->anchor[1] * hi;
+    p[3] = sinv * gradient->anchor[0] * wi - cosv * gradient->anchor[1] * hi;
+    p[4] = 1.0f / sqrtf(wi * wi + hi * hi);
+    p[5] = gradient->curvature;
+    p[6] = fmaxf(gradient->compression, 0.001f);
+    p[7] = gradient->state == DT_MASKS_GRADIENT_STATE_LINEAR ? 1.0f : 0.0f;
+    return 2;
+  }
+  return -1;
+}
+
+gboolean dt_masks_group_render_roi_cl(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                      dt_masks_form_t *form, const dt_iop_roi_t *roi, cl_mem dev_mask,
+                                      const gboolean invert)
+{
+  if(!form || !(form->type & DT_MASKS_GROUP) || !form->points) return FALSE;
+
+  // everything the host would draw has to be known to the device
+  for(GList *fpts = form->points; fpts; fpts = g_list_next(fpts))
+  {
+    const dt_masks_point_group_t *fpt = (dt_masks_point_group_t *)fpts->data;
+    const dt_masks_form_t *sel = dt_masks_get_from_id(module->dev, fpt->formid);
+    float p[8];
+    if(sel && _group_shape_params_cl(piece, sel, p) < 0) return FALSE;
+  }
+
+  float origin[2], step_x[2], step_y[2];
+  if(!_group_affine_backtransform(module, piece, roi, origin, step_x, step_y)) return FALSE;
+
+  const double start = dt_get_wtime();
+  const int devid = piece->pipe->devid;
+  const int width = roi->width;
+  const int height = roi->height;
+  const size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+  const int kernel = darktable.opencl->blendop->kernel_blendop_mask_shape;
+  cl_int err = CL_SUCCESS;
+  int nb_ok = 0;
+
+  cl_mem dev_buf = dt_opencl_alloc_device_buffer(devid, sizeof(float) * width * height);
+  if(dev_buf == NULL) return FALSE;
+
+  for(GList *fpts = form->points; fpts && err == CL_SUCCESS; fpts = g_list_next(fpts))
+  {
+    const dt_masks_point_group_t *fpt = (dt_masks_point_group_t *)fpts->data;
+    const dt_masks_form_t *sel = dt_masks_get_from_id(module->dev, fpt->formid);
+    if(!sel) continue;
+
+    float p[8] = { 0.0f };
+    const int shape = _group_shape_params_cl(piece, sel, p);
+    cl_mem dev_params = dt_opencl_copy_host_to_device_constant(devid, sizeof(p), p);
+    if(dev_params == NULL)
+    {
+      err = -999;
+      break;
+    }
+    const int state = fpt->state;
+    const float opacity = fpt->opacity;
+    const int first = (nb_ok == 0);
+    dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), (void *)&dev_buf);
+    dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, kernel, 3, 2 * sizeof(float), (void *)origin);
+    dt_opencl_set_kernel_arg(devid, kernel, 4, 2 * sizeof(float), (void *)step_x);
+    dt_opencl_set_kernel_arg(devid, kernel, 5, 2 * sizeof(float), (void *)step_y);
+    dt_opencl_set_kernel_arg(devid, kernel, 6, sizeof(int), (void *)&shape);
+    dt_opencl_set_kernel_arg(devid, kernel, 7, sizeof(cl_mem), (void *)&dev_params);
+    dt_opencl_set_kernel_arg(devid, kernel, 8, sizeof(int), (void *)&state);
+    dt_opencl_set_kernel_arg(devid, kernel, 9, sizeof(float), (void *)&opacity);
+    dt_opencl_set_kernel_arg(devid, kernel, 10, sizeof(int), (void *)&first);
+    err = dt_opencl_enqueue_kernel_2d(devid, kernel, sizes);
+    dt_opencl_release_mem_object(dev_params);
+    nb_ok++;
+  }
+
+  if(err == CL_SUCCESS && nb_ok > 0)
+  {
+    const int kernel_write = darktable.opencl->blendop->kernel_blendop_mask_shape_write;
+    const int inv = invert;
+    dt_opencl_set_kernel_arg(devid, kernel_write, 0, sizeof(cl_mem), (void *)&dev_buf);
+    dt_opencl_set_kernel_arg(devid, kernel_write, 1, sizeof(cl_mem), (void *)&dev_mask);
+    dt_opencl_set_kernel_arg(devid, kernel_write, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, kernel_write, 3, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, kernel_write, 4, sizeof(int), (void *)&inv);
+    err = dt_opencl_enqueue_kernel_2d(devid, kernel_write, sizes);
+  }
+  dt_opencl_release_mem_object(dev_buf);
+
+  if(err != CL_SUCCESS || nb_ok == 0)
+  {
+    if(err != CL_SUCCESS)
+      dt_print(DT_DEBUG_OPENCL, "[masks] couldn't render the masks of %s on the device: %d\n", module->op, err);
+    return FALSE;
+  }
+
+  if(darktable.unmuted & DT_DEBUG_PERF)
+    dt_print(DT_DEBUG_MASKS, "[masks] render %d masks on the device took %0.04f sec\n", nb_ok,
+             dt_get_wtime() - start);
+  return TRUE;
+}
+#endif
+
 static GSList *_group_setup_mouse_actions(const struct dt_masks_form_t *const form)
 {
   GSList *lm = NULL;
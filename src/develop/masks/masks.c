@@ -1015,6 +1015,13 @@ int dt_masks_events_mouse_enter(struct dt_iop_module_t *module)
   return 0;
 }
 
+static inline gboolean _gui_dragging(const dt_masks_form_gui_t *gui)
+{
+  return !gui->creation
+         && (gui->form_dragging || gui->source_dragging || gui->form_rotating || gui->point_dragging >= 0
+             || gui->feather_dragging >= 0 || gui->seg_dragging >= 0 || gui->point_border_dragging >= 0);
+}
+
 int dt_masks_events_mouse_moved(struct dt_iop_module_t *module, double x, double y, double pressure, int which)
 {
   // record mouse position even if there are no masks visible
@@ -1046,6 +1053,15 @@ int dt_masks_events_mouse_moved(struct dt_iop_module_t *module, double x, double
 
   if(gui) _set_hinter_message(gui, form);
 
+  if(rep && gui && _gui_dragging(gui) && dt_conf_get_bool("plugins/darkroom/masks/interactive_preview"))
+  {
+    // the shapes are read from the forms of develop, so the preview pipe picks up the new position
+    // right away. the full pipe only follows when the shape is released and a history item is added.
+    darktable.develop->mask_interactive = TRUE;
+    darktable.develop->preview_pipe->changed |= DT_DEV_PIPE_SYNCH;
+    dt_dev_invalidate_preview(darktable.develop);
+  }
+
   return rep;
 }
 
@@ -1066,10 +1082,18 @@ int dt_masks_events_button_released(struct dt_iop_module_t *module, double x, do
     dt_dev_masks_selection_change(darktable.develop, module,
                                   darktable.develop->mask_form_selected_id, FALSE);
 
+  int rep = 0;
   if(form->functions)
-    return form->functions->button_released(module, pzx, pzy, which, state, form, 0, gui, 0);
+    rep = form->functions->button_released(module, pzx, pzy, which, state, form, 0, gui, 0);
 
-  return 0;
+  if(darktable.develop->mask_interactive)
+  {
+    // back to the full pipe, which the release has invalidated when the shape was changed
+    darktable.develop->mask_interactive = FALSE;
+    dt_control_queue_redraw_center();
+  }
+
+  return rep;
 }
 
 int dt_masks_events_button_pressed(struct dt_iop_module_t *module, double x, double y, double pressure,
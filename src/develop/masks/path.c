@@ -2735,33 +2735,145 @@ static int _path_crop_to_roi(float *path, const int point_count, float xmin, flo
   return 1;
 }
 
-/** we write a falloff segment respecting limits of buffer */
-static void _path_falloff_roi(float *buffer, int *p0, int *p1, int bw, int bh)
+/** rows of the mask each thread fills with the falloff; the triangles touching a band are collected first */
+#define DT_PATH_FALLOFF_BAND 16
+
+typedef struct dt_path_falloff_triangle_t
 {
-  // segment length
-  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
+  float x[3], y[3];     // vertices, sorted from top to bottom
+  float v0, dvdx, dvdy; // plane of the falloff: v0 + dvdx * x + dvdy * y
+} dt_path_falloff_triangle_t;
 
-  const float lx = p1[0] - p0[0];
-  const float ly = p1[1] - p0[1];
+static inline gboolean _path_falloff_triangle(dt_path_falloff_triangle_t *t, const int *a, const float va,
+                                              const int *b, const float vb, const int *c, const float vc)
+{
+  const float det = (float)(b[0] - a[0]) * (c[1] - a[1]) - (float)(c[0] - a[0]) * (b[1] - a[1]);
+  if(det == 0.0f) return FALSE;
 
-  const int dx = lx < 0 ? -1 : 1;
-  const int dy = ly < 0 ? -1 : 1;
-  const int dpy = dy * bw;
+  t->dvdx = ((vb - va) * (c[1] - a[1]) - (vc - va) * (b[1] - a[1])) / det;
+  t->dvdy = ((vc - va) * (b[0] - a[0]) - (vb - va) * (c[0] - a[0])) / det;
+  // falloff at the origin, the plane is the same whatever the vertex order
+  t->v0 = va - t->dvdx * a[0] - t->dvdy * a[1];
 
-  for(int i = 0; i < l; i++)
+  const int *v[3] = { a, b, c };
+  if(v[0][1] > v[1][1]) { const int *tmp = v[0]; v[0] = v[1]; v[1] = tmp; }
+  if(v[1][1] > v[2][1]) { const int *tmp = v[1]; v[1] = v[2]; v[2] = tmp; }
+  if(v[0][1] > v[1][1]) { const int *tmp = v[0]; v[0] = v[1]; v[1] = tmp; }
+  for(int k = 0; k < 3; k++)
   {
-    // position
-    const int x = (int)((float)i * lx / (float)l) + p0[0];
-    const int y = (int)((float)i * ly / (float)l) + p0[1];
-    const float op = 1.0f - (float)i / (float)l;
-    float *buf = buffer + (size_t)y * bw + x;
-    if(x >= 0 && x < bw && y >= 0 && y < bh)
-      buf[0] = MAX(buf[0], op);
-    if(x + dx >= 0 && x + dx < bw && y >= 0 && y < bh)
-      buf[dx] = MAX(buf[dx], op); // this one is to avoid gap due to int rounding
-    if(x >= 0 && x < bw && y + dy >= 0 && y + dy < bh)
-      buf[dpy] = MAX(buf[dpy], op); // this one is to avoid gap due to int rounding
+    t->x[k] = v[k][0];
+    t->y[k] = v[k][1];
   }
+  return TRUE;
+}
+
+/** we write the falloff between the path and its border into the buffer. consecutive segments from a path
+    point to its border point span a quad, which is filled as two triangles with the opacity falling off
+    linearly from 1 on the path to 0 on the border. the rows of the buffer are split into bands, each of
+    which is rasterized by one thread only. */
+static void _path_falloff_roi(float *buffer, const int *dpoints, const int nb_segments, const int bw, const int bh)
+{
+  if(nb_segments < 2) return;
+
+  dt_path_falloff_triangle_t *tri = dt_alloc_align(64, sizeof(dt_path_falloff_triangle_t) * 2 * nb_segments);
+  if(!tri) return;
+
+  int nb_tri = 0;
+  for(int n = 0; n < nb_segments; n++)
+  {
+    const int *s0 = dpoints + 4 * n;
+    const int *s1 = dpoints + 4 * ((n + 1) % nb_segments);
+    // s[0..1] lies on the path, s[2..3] on the border
+    nb_tri += _path_falloff_triangle(tri + nb_tri, s0, 1.0f, s0 + 2, 0.0f, s1 + 2, 0.0f);
+    nb_tri += _path_falloff_triangle(tri + nb_tri, s0, 1.0f, s1 + 2, 0.0f, s1, 1.0f);
+  }
+
+  // bucket the triangles by the bands they touch
+  const int nb_bands = (bh + DT_PATH_FALLOFF_BAND - 1) / DT_PATH_FALLOFF_BAND;
+  int *band_start = calloc(nb_bands + 1, sizeof(int));
+  if(!band_start)
+  {
+    dt_free_align(tri);
+    return;
+  }
+  size_t nb_refs = 0;
+  for(int k = 0; k < nb_tri; k++)
+  {
+    if(tri[k].y[2] < 0 || tri[k].y[0] >= bh) continue;
+    const int b0 = MAX((int)tri[k].y[0], 0) / DT_PATH_FALLOFF_BAND;
+    const int b1 = MIN((int)tri[k].y[2], bh - 1) / DT_PATH_FALLOFF_BAND;
+    for(int b = b0; b <= b1; b++) band_start[b + 1]++;
+    nb_refs += b1 - b0 + 1;
+  }
+  for(int b = 0; b < nb_bands; b++) band_start[b + 1] += band_start[b];
+
+  int *refs = dt_alloc_align(64, sizeof(int) * MAX(nb_refs, 1));
+  int *fill = malloc(sizeof(int) * nb_bands);
+  if(!refs || !fill)
+  {
+    dt_free_align(refs);
+    free(fill);
+    free(band_start);
+    dt_free_align(tri);
+    return;
+  }
+  memcpy(fill, band_start, sizeof(int) * nb_bands);
+  for(int k = 0; k < nb_tri; k++)
+  {
+    if(tri[k].y[2] < 0 || tri[k].y[0] >= bh) continue;
+    const int b0 = MAX((int)tri[k].y[0], 0) / DT_PATH_FALLOFF_BAND;
+    const int b1 = MIN((int)tri[k].y[2], bh - 1) / DT_PATH_FALLOFF_BAND;
+    for(int b = b0; b <= b1; b++) refs[fill[b]++] = k;
+  }
+  free(fill);
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, tri, refs, band_start, nb_bands, bw, bh) \
+  schedule(dynamic)
+#endif
+  for(int b = 0; b < nb_bands; b++)
+  {
+    const int row0 = b * DT_PATH_FALLOFF_BAND;
+    const int row1 = MIN(row0 + DT_PATH_FALLOFF_BAND, bh) - 1;
+    for(int r = band_start[b]; r < band_start[b + 1]; r++)
+    {
+      const dt_path_falloff_triangle_t *t = tri + refs[r];
+      const int y0 = MAX((int)t->y[0], row0);
+      const int y1 = MIN((int)t->y[2], row1);
+      // the long edge from the top to the bottom vertex bounds one side of all rows,
+      // the two short ones through the middle vertex the other
+      const float dlong = (t->x[2] - t->x[0]) / (t->y[2] - t->y[0]);
+      const float dtop = t->y[1] > t->y[0] ? (t->x[1] - t->x[0]) / (t->y[1] - t->y[0]) : 0.0f;
+      const float dbottom = t->y[2] > t->y[1] ? (t->x[2] - t->x[1]) / (t->y[2] - t->y[1]) : 0.0f;
+      for(int y = y0; y <= y1; y++)
+      {
+        const float xa = t->x[0] + dlong * (y - t->y[0]);
+        float xb;
+        if(y < t->y[1])
+          xb = t->x[0] + dtop * (y - t->y[0]);
+        else if(y > t->y[1] || t->y[2] > t->y[1])
+          xb = t->x[1] + dbottom * (y - t->y[1]);
+        else // flat bottom
+          xb = t->x[1];
+
+        // pixels within the span, the clamping keeps the truncations below from rounding towards zero
+        const float lo = MAX(MIN(xa, xb), 0.0f);
+        const float hi = MIN(MAX(xa, xb), (float)bw);
+        if(hi < lo) continue;
+        const int x0 = (int)lo + ((float)(int)lo < lo);
+        const int x1 = MIN((int)hi, bw - 1);
+        float *row = buffer + (size_t)y * bw;
+        const float vy = t->v0 + t->dvdy * y;
+        for(int x = x0; x <= x1; x++)
+          row[x] = MAX(row[x], CLAMPS(vy + t->dvdx * x, 0.0f, 1.0f));
+      }
+    }
+  }
+
+  dt_free_align(refs);
+  free(band_start);
+  dt_free_align(tri);
 }
 
 // build a stamp which can be combined with other shapes in the same group
@@ -3094,17 +3206,7 @@ static int _path_get_mask_roi(const dt_iop_module_t *const module, const dt_dev_
       }
     }
 
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(width, height, dindex) \
-  shared(buffer, dpoints)
-#else
-#pragma omp parallel for shared(buffer)
-#endif
-#endif
-    for(int n = 0; n < dindex; n += 4)
-      _path_falloff_roi(buffer, dpoints + n, dpoints + n + 2, width, height);
+    _path_falloff_roi(buffer, dpoints, dindex / 4, width, height);
 
     dt_free_align(dpoints);
 
@@ -54,6 +54,8 @@ typedef struct dt_dev_histogram_collection_params_t
   uint32_t bins_count;
   /** in most cases, bins_count-1. */
   float mul;
+  /** only take every sampling-th pixel of every sampling-th row, 0 or 1 for all of them. */
+  int sampling;
 } dt_dev_histogram_collection_params_t;
 
 // params used to collect histogram during last histogram capture
@@ -17,11 +17,17 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/file_location.h"
+#include "common/math.h"
+#include "control/conf.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
 #include "libs/colorpicker.h"
+#include <float.h>
+#include <glib/gstdio.h>
 #include <stdlib.h>
+#include <zlib.h>
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -33,9 +39,15 @@
 //   ping, pong, and priority buffer (focused plugin)
 // - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
 
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
+#define DT_PIPECACHE_INVALID ((uint64_t)-1)
+
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memlimit)
 {
   cache->entries = entries;
+  // with a memory budget lines are allocated on demand
+  cache->memlimit = memlimit;
+  if(memlimit) size = 0;
+  cache->allmem = 0;
   cache->data = (void **)calloc(entries, sizeof(void *));
   cache->size = (size_t *)calloc(entries, sizeof(size_t));
   cache->dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
@@ -44,7 +56,12 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
 #endif
   cache->basichash = (uint64_t *)calloc(entries, sizeof(uint64_t));
   cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+  cache->used = (int64_t *)calloc(entries, sizeof(int64_t));
+  cache->cost = (float *)calloc(entries, sizeof(float));
+  cache->halfcount = (size_t *)calloc(entries, sizeof(size_t));
+  // the keys point into cache->hash, so they stay valid as long as the cache lives
+  cache->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+  cache->lastused = -1;
   for(int k = 0; k < entries; k++)
   {
     cache->size[k] = size;
@@ -52,15 +69,17 @@ int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, si
     { // allow 0 initial buffer size (yet unknown dimensions)
       cache->data[k] = (void *)dt_alloc_align(64, size);
       if(!cache->data[k]) goto alloc_memory_fail;
+      cache->allmem += size;
 #ifdef _DEBUG
       memset(cache->data[k], 0x5d, size);
 #endif
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
     else cache->data[k] = 0;
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
+    cache->basichash[k] = DT_PIPECACHE_INVALID;
+    cache->hash[k] = DT_PIPECACHE_INVALID;
     cache->used[k] = 0;
+    cache->cost[k] = 0.0f;
   }
   cache->queries = cache->misses = 0;
   return 1;
@@ -77,6 +96,7 @@ alloc_memory_fail:
     cache->size[k] = 0;
     cache->data[k] = NULL;
   }
+  cache->allmem = 0;
   return 0;
 }
 
@@ -88,7 +108,152 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
   free(cache->basichash);
   free(cache->hash);
   free(cache->used);
+  free(cache->cost);
+  free(cache->halfcount);
   free(cache->size);
+  if(cache->index) g_hash_table_destroy(cache->index);
+  cache->index = NULL;
+  cache->allmem = 0;
+}
+
+// returns the line holding the given hash or -1
+static inline int _cache_lookup(const dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  if(hash == DT_PIPECACHE_INVALID) return -1;
+  return GPOINTER_TO_INT(g_hash_table_lookup(cache->index, &hash)) - 1;
+}
+
+// keep the hash index in sync when (re)assigning a cache line
+static void _cache_set_hash(dt_dev_pixelpipe_cache_t *cache, const int k, const uint64_t basichash,
+                            const uint64_t hash)
+{
+  if(_cache_lookup(cache, cache->hash[k]) == k) g_hash_table_remove(cache->index, &cache->hash[k]);
+
+  // there must be only one line per hash
+  const int other = _cache_lookup(cache, hash);
+  if(other >= 0 && other != k)
+  {
+    g_hash_table_remove(cache->index, &cache->hash[other]);
+    cache->basichash[other] = DT_PIPECACHE_INVALID;
+    cache->hash[other] = DT_PIPECACHE_INVALID;
+  }
+
+  cache->basichash[k] = basichash;
+  cache->hash[k] = hash;
+  if(hash != DT_PIPECACHE_INVALID) g_hash_table_replace(cache->index, &cache->hash[k], GINT_TO_POINTER(k + 1));
+}
+
+static void _cache_free_line(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  _cache_set_hash(cache, k, DT_PIPECACHE_INVALID, DT_PIPECACHE_INVALID);
+  dt_free_align(cache->data[k]);
+  cache->data[k] = NULL;
+  cache->allmem -= cache->size[k];
+  cache->size[k] = 0;
+  cache->cost[k] = 0.0f;
+  cache->halfcount[k] = 0;
+}
+
+// bytes of the float buffer the line holds
+static inline size_t _cache_float_size(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  return cache->halfcount[k] ? cache->halfcount[k] * sizeof(float) : cache->size[k];
+}
+
+// back from half floats, FALSE if there is no memory for the float buffer
+static gboolean _cache_expand(dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  const size_t n = cache->halfcount[k];
+  float *const buf = dt_alloc_align_float(n);
+  if(!buf) return FALSE;
+  const uint16_t *const half = (const uint16_t *)cache->data[k];
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(n, buf, half) \
+  schedule(static)
+#endif
+  for(size_t i = 0; i < n; i++) buf[i] = dt_half_to_float(half[i]);
+
+  dt_free_align(cache->data[k]);
+  cache->allmem = cache->allmem - cache->size[k] + n * sizeof(float);
+  cache->data[k] = buf;
+  cache->size[k] = n * sizeof(float);
+  cache->halfcount[k] = 0;
+  return TRUE;
+}
+
+// cost-aware eviction score, lines cheap to recompute, big and not used for long go first
+static inline double _cache_score(const dt_dev_pixelpipe_cache_t *cache, const int k)
+{
+  const double age = MAX(1.0, (double)cache->queries - (double)cache->used[k]);
+  const double mbytes = MAX(1.0, cache->size[k] / (1024.0 * 1024.0));
+  return (cache->cost[k] + 1e-3) / (mbytes * age);
+}
+
+static int _cache_get_victim(const dt_dev_pixelpipe_cache_t *cache, const size_t size)
+{
+  // plain least recently used line if we have a fixed number of lines
+  if(!cache->memlimit)
+  {
+    int victim = 0;
+    for(int k = 1; k < cache->entries; k++)
+      if(cache->used[k] < cache->used[victim]) victim = k;
+    return victim;
+  }
+
+  const gboolean fits = cache->allmem + size <= cache->memlimit;
+  int victim = -1;
+  int empty = -1;
+  double score = DBL_MAX;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    // the input of the module currently processed
+    if(k == cache->lastused) continue;
+
+    double s;
+    if(!cache->data[k])
+    {
+      if(empty < 0) empty = k;
+      // only grow if we stay within budget
+      if(!fits) continue;
+      s = -1.0;
+    }
+    else if(cache->hash[k] == DT_PIPECACHE_INVALID)
+      // reuse stale lines first, try to avoid a reallocation
+      s = cache->size[k] >= size ? -3.0 : -2.0;
+    else
+      s = _cache_score(cache, k);
+
+    if(s < score)
+    {
+      score = s;
+      victim = k;
+    }
+  }
+  if(victim < 0) victim = (empty >= 0) ? empty : 0;
+  return victim;
+}
+
+// free lines until all of them fit into the budget again
+static void _cache_trim(dt_dev_pixelpipe_cache_t *cache, const int keep)
+{
+  while(cache->memlimit && cache->allmem > cache->memlimit)
+  {
+    int victim = -1;
+    double score = DBL_MAX;
+    for(int k = 0; k < cache->entries; k++)
+    {
+      if(k == keep || k == cache->lastused || !cache->data[k]) continue;
+      const double s = (cache->hash[k] == DT_PIPECACHE_INVALID) ? -1.0 : _cache_score(cache, k);
+      if(s < score)
+      {
+        score = s;
+        victim = k;
+      }
+    }
+    if(victim < 0) return;
+    _cache_free_line(cache, victim);
+  }
 }
 
 uint64_t dt_dev_pixelpipe_cache_basichash(int imgid, struct dt_dev_pixelpipe_t *pipe, int module)
@@ -170,9 +335,7 @@ uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
   // search for hash in cache
-  for(int32_t k = 0; k < cache->entries; k++)
-    if(cache->hash[k] == hash) return 1;
-  return 0;
+  return _cache_lookup(cache, hash) >= 0;
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t basichash,
@@ -193,69 +356,74 @@ int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const u
 {
   cache->queries++;
   *data = NULL;
-  int max_used = -1, max = 0;
-  size_t sz = 0;
-  for(int k = 0; k < cache->entries; k++)
-  {
-    // search for hash in cache
-    if(cache->used[k] > max_used)
-    {
-      max_used = cache->used[k];
-      max = k;
-    }
-    cache->used[k]++; // age all entries
-    if(cache->hash[k] == hash)
-    {
-      *data = cache->data[k];
-      *dsc = &cache->dsc[k];
-      sz = cache->size[k];
-      cache->used[k] = weight; // this is the MRU entry
 
-      ASAN_POISON_MEMORY_REGION(*data, sz);
-      ASAN_UNPOISON_MEMORY_REGION(*data, size);
-    }
-  }
+  // a negative weight makes the line look younger than it is
+  const int64_t stamp = (int64_t)cache->queries - weight;
 
-  if(!*data || sz < size)
+  const int k = _cache_lookup(cache, hash);
+  if(k >= 0 && cache->data[k] && _cache_float_size(cache, k) >= size
+     && (!cache->halfcount[k] || _cache_expand(cache, k)))
   {
-    // kill LRU entry
-    // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
-    // weight);
-    if(cache->size[max] < size)
-    {
-      dt_free_align(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(64, size);
-      cache->size[max] = size;
-    }
-    *data = cache->data[max];
-    sz = cache->size[max];
+    // expanding might have taken us beyond budget
+    _cache_trim(cache, k);
+    *data = cache->data[k];
+    *dsc = &cache->dsc[k];
+    cache->used[k] = stamp; // this is the MRU entry
+    cache->lastused = k;
 
-    ASAN_POISON_MEMORY_REGION(*data, sz);
+    ASAN_POISON_MEMORY_REGION(*data, cache->size[k]);
     ASAN_UNPOISON_MEMORY_REGION(*data, size);
+    return 0;
+  }
 
-    // first, update our copy, then update the pointer to point at our copy
-    cache->dsc[max] = **dsc;
-    *dsc = &cache->dsc[max];
+  // a line with matching hash but too small buffer is of no use
+  if(k >= 0) _cache_set_hash(cache, k, DT_PIPECACHE_INVALID, DT_PIPECACHE_INVALID);
 
-    cache->basichash[max] = basichash;
-    cache->hash[max] = hash;
-    cache->used[max] = weight;
-    cache->misses++;
-    return 1;
+  // kill victim entry
+  const int max = _cache_get_victim(cache, size);
+  // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
+  // weight);
+  if(cache->size[max] < size || !cache->data[max])
+  {
+    dt_free_align(cache->data[max]);
+    cache->allmem -= cache->size[max];
+    cache->data[max] = (void *)dt_alloc_align(64, size);
+    cache->size[max] = cache->data[max] ? size : 0;
+    cache->allmem += cache->size[max];
   }
-  else
-    return 0;
+  cache->halfcount[max] = 0;
+  *data = cache->data[max];
+  const size_t sz = cache->size[max];
+
+  ASAN_POISON_MEMORY_REGION(*data, sz);
+  ASAN_UNPOISON_MEMORY_REGION(*data, size);
+
+  // first, update our copy, then update the pointer to point at our copy
+  cache->dsc[max] = **dsc;
+  *dsc = &cache->dsc[max];
+
+  _cache_set_hash(cache, max, basichash, hash);
+  cache->used[max] = stamp;
+  cache->cost[max] = 0.0f;
+  cache->misses++;
+
+  _cache_trim(cache, max);
+  cache->lastused = max;
+  return 1;
 }
 
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
+  g_hash_table_remove_all(cache->index);
   for(int k = 0; k < cache->entries; k++)
   {
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
+    cache->basichash[k] = DT_PIPECACHE_INVALID;
+    cache->hash[k] = DT_PIPECACHE_INVALID;
+    cache->used[k] = cache->queries;
+    cache->cost[k] = 0.0f;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
+  cache->lastused = -1;
 }
 
 void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint64_t basichash)
@@ -264,11 +432,50 @@ void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint6
   {
     if (cache->basichash[k] == basichash)
       continue;
-    cache->basichash[k] = -1;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
+    _cache_set_hash(cache, k, DT_PIPECACHE_INVALID, DT_PIPECACHE_INVALID);
+    cache->used[k] = cache->queries;
+    cache->cost[k] = 0.0f;
+    ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+  }
+}
+
+void dt_dev_pixelpipe_cache_flush_downstream(dt_dev_pixelpipe_cache_t *cache, int imgid,
+                                             struct dt_dev_pixelpipe_t *pipe,
+                                             const struct dt_iop_module_t *const module)
+{
+  // the outputs of all nodes before the module and the pipe input stay valid
+  GHashTable *keep = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+  GList *modules = pipe->iop;
+  for(int k = 0; modules; k++, modules = g_list_next(modules))
+  {
+    uint64_t *basichash = g_new(uint64_t, 1);
+    *basichash = dt_dev_pixelpipe_cache_basichash(imgid, pipe, k);
+    g_hash_table_add(keep, basichash);
+    if(module == (dt_iop_module_t *)modules->data) break;
+  }
+
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(g_hash_table_contains(keep, &cache->basichash[k])) continue;
+    _cache_set_hash(cache, k, DT_PIPECACHE_INVALID, DT_PIPECACHE_INVALID);
+    cache->used[k] = cache->queries;
+    cache->cost[k] = 0.0f;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
+  g_hash_table_destroy(keep);
+}
+
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const float cost)
+{
+  if(!data) return;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(cache->data[k] == data)
+    {
+      cache->cost[k] = cost;
+      return;
+    }
+  }
 }
 
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
@@ -277,32 +484,455 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
   {
     if(cache->data[k] == data)
     {
-      cache->used[k] = -cache->entries;
+      cache->used[k] = (int64_t)cache->queries + cache->entries;
     }
   }
 }
 
+void dt_dev_pixelpipe_cache_compact(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  if(!cache->memlimit || !data) return;
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(cache->data[k] != data) continue;
+    if(cache->halfcount[k] || cache->hash[k] == DT_PIPECACHE_INVALID || cache->dsc[k].datatype != TYPE_FLOAT)
+      return;
+
+    const size_t n = cache->size[k] / sizeof(float);
+    uint16_t *const half = (uint16_t *)dt_alloc_align(64, n * sizeof(uint16_t));
+    if(!half) return;
+    const float *const buf = (const float *)data;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(n, buf, half) \
+    schedule(static)
+#endif
+    for(size_t i = 0; i < n; i++) half[i] = dt_float_to_half(buf[i]);
+
+    dt_free_align(cache->data[k]);
+    cache->allmem = cache->allmem - cache->size[k] + n * sizeof(uint16_t);
+    cache->data[k] = half;
+    cache->size[k] = n * sizeof(uint16_t);
+    cache->halfcount[k] = n;
+    return;
+  }
+}
+
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data)
 {
   for(int k = 0; k < cache->entries; k++)
   {
     if(cache->data[k] == data)
     {
-      cache->basichash[k] = -1;
-      cache->hash[k] = -1;
+      _cache_set_hash(cache, k, DT_PIPECACHE_INVALID, DT_PIPECACHE_INVALID);
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
   }
 }
 
+// shared pool: buffers are copied in and out, the reference count only protects a buffer
+// while it is being copied out without holding the lock.
+
+typedef struct _shared_buffer_t
+{
+  uint64_t key;
+  void *data;
+  size_t size;
+  dt_iop_buffer_dsc_t dsc;
+  int refs;         // readers currently copying from this buffer
+  gboolean dead;    // removed from the pool, free once refs drops to zero
+  uint64_t used;    // stamp of last use
+} _shared_buffer_t;
+
+static struct
+{
+  GMutex lock;
+  GHashTable *buffers; // key -> _shared_buffer_t
+  size_t allmem;
+  uint64_t stamp;
+} _shared_pool;
+
+static void _shared_buffer_free(_shared_buffer_t *buf)
+{
+  dt_free_align(buf->data);
+  free(buf);
+}
+
+// called with the lock held
+static void _shared_pool_remove(_shared_buffer_t *buf)
+{
+  g_hash_table_remove(_shared_pool.buffers, &buf->key);
+  _shared_pool.allmem -= buf->size;
+  if(buf->refs > 0)
+    buf->dead = TRUE;
+  else
+    _shared_buffer_free(buf);
+}
+
+// called with the lock held
+static void _shared_pool_trim(const size_t memlimit)
+{
+  while(_shared_pool.allmem > memlimit)
+  {
+    _shared_buffer_t *victim = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, _shared_pool.buffers);
+    while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      _shared_buffer_t *buf = (_shared_buffer_t *)value;
+      if(!victim || buf->used < victim->used) victim = buf;
+    }
+    if(!victim) return;
+    _shared_pool_remove(victim);
+  }
+}
+
+uint64_t dt_dev_pixelpipe_cache_shared_key(const dt_dev_pixelpipe_t *pipe, const uint64_t hash)
+{
+  // pipes only compute the same data for the same hash if they start from the same input
+  uint64_t h = hash;
+  const int64_t ident[] = { (int64_t)(uintptr_t)pipe->input, pipe->iwidth, pipe->iheight,
+                            (int64_t)(pipe->iscale * 1e6f) };
+  for(size_t i = 0; i < sizeof(ident) / sizeof(ident[0]); i++) h = ((h << 5) + h) ^ ident[i];
+  return h;
+}
+
+gboolean dt_dev_pixelpipe_cache_shared_available(const uint64_t key)
+{
+  g_mutex_lock(&_shared_pool.lock);
+  const gboolean found = _shared_pool.buffers && g_hash_table_contains(_shared_pool.buffers, &key);
+  g_mutex_unlock(&_shared_pool.lock);
+  return found;
+}
+
+gboolean dt_dev_pixelpipe_cache_shared_get(const uint64_t key, void *data, const size_t size,
+                                           dt_iop_buffer_dsc_t *dsc)
+{
+  g_mutex_lock(&_shared_pool.lock);
+  _shared_buffer_t *buf = _shared_pool.buffers ? g_hash_table_lookup(_shared_pool.buffers, &key) : NULL;
+  if(!buf || buf->size != size)
+  {
+    g_mutex_unlock(&_shared_pool.lock);
+    return FALSE;
+  }
+  buf->refs++;
+  buf->used = ++_shared_pool.stamp;
+  g_mutex_unlock(&_shared_pool.lock);
+
+  memcpy(data, buf->data, size);
+  *dsc = buf->dsc;
+
+  g_mutex_lock(&_shared_pool.lock);
+  buf->refs--;
+  if(buf->dead && buf->refs == 0) _shared_buffer_free(buf);
+  g_mutex_unlock(&_shared_pool.lock);
+  return TRUE;
+}
+
+void dt_dev_pixelpipe_cache_shared_put(const uint64_t key, const void *data, const size_t size,
+                                       const dt_iop_buffer_dsc_t *dsc, const size_t memlimit)
+{
+  if(size > memlimit) return;
+
+  g_mutex_lock(&_shared_pool.lock);
+  if(!_shared_pool.buffers) _shared_pool.buffers = g_hash_table_new(g_int64_hash, g_int64_equal);
+  _shared_buffer_t *old = g_hash_table_lookup(_shared_pool.buffers, &key);
+  if(old) old->used = ++_shared_pool.stamp;
+  g_mutex_unlock(&_shared_pool.lock);
+  if(old) return;
+
+  // copy outside of the lock, the other pipes shouldn't wait for us
+  _shared_buffer_t *buf = calloc(1, sizeof(_shared_buffer_t));
+  buf->data = dt_alloc_align(64, size);
+  if(!buf->data)
+  {
+    free(buf);
+    return;
+  }
+  memcpy(buf->data, data, size);
+  buf->key = key;
+  buf->size = size;
+  buf->dsc = *dsc;
+
+  g_mutex_lock(&_shared_pool.lock);
+  if(g_hash_table_contains(_shared_pool.buffers, &key))
+  {
+    // someone was faster
+    _shared_buffer_free(buf);
+  }
+  else
+  {
+    buf->used = ++_shared_pool.stamp;
+    // make room first, so we never free the new buffer
+    _shared_pool_trim(memlimit - size);
+    g_hash_table_insert(_shared_pool.buffers, &buf->key, buf);
+    _shared_pool.allmem += size;
+  }
+  g_mutex_unlock(&_shared_pool.lock);
+}
+
+void dt_dev_pixelpipe_cache_shared_flush()
+{
+  g_mutex_lock(&_shared_pool.lock);
+  if(_shared_pool.buffers) _shared_pool_trim(0);
+  g_mutex_unlock(&_shared_pool.lock);
+}
+
+// disk tier: one zlib compressed file per buffer below $cachedir/pixelpipe, the bytes of the pixel data
+// are split into planes first as this makes float data compress a lot better.
+
+#define DT_PIPECACHE_DISK_MAGIC 0x43505444u // "DTPC"
+#define DT_PIPECACHE_DISK_VERSION 1
+#define DT_PIPECACHE_DISK_CHUNK (4u << 20)
+
+typedef struct _disk_cache_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t hash;
+  dt_iop_roi_t roi;
+  uint64_t size;
+  dt_iop_buffer_dsc_t dsc;
+} _disk_cache_header_t;
+
+typedef struct _disk_cache_file_t
+{
+  gchar *path;
+  goffset size;
+  time_t mtime;
+} _disk_cache_file_t;
+
+gboolean dt_dev_pixelpipe_cache_disk_checkpoint(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module)
+{
+  if(!module) return FALSE;
+  // the preview pipes are cheap and the colorpicker needs them to be processed anyway
+  if(!(pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_EXPORT))) return FALSE;
+  if(!dt_conf_get_bool("cache_pixelpipe_disk")) return FALSE;
+
+  const char *modules = dt_conf_get_string_const("cache_pixelpipe_disk_modules");
+  if(!modules || !modules[0]) return FALSE;
+
+  gchar **ops = g_strsplit(modules, ",", -1);
+  gboolean found = FALSE;
+  for(gchar **op = ops; *op && !found; op++)
+    found = !g_strcmp0(g_strstrip(*op), module->op);
+  g_strfreev(ops);
+  return found;
+}
+
+uint64_t dt_dev_pixelpipe_cache_disk_hash(const dt_dev_pixelpipe_t *pipe, const uint64_t hash)
+{
+  // the in-memory hashes only need to be unique within a session, for the disk we also need to
+  // know that this is still the same input file processed by the same version of darktable.
+  uint64_t h = hash;
+  const char *str = darktable_package_version;
+  for(; *str; str++) h = ((h << 5) + h) ^ *str;
+  for(str = pipe->image.filename; *str; str++) h = ((h << 5) + h) ^ *str;
+  const int64_t ident[] = { pipe->image.film_id, pipe->image.import_timestamp, pipe->iwidth, pipe->iheight,
+                            (int64_t)(pipe->iscale * 1e6f) };
+  for(size_t i = 0; i < sizeof(ident) / sizeof(ident[0]); i++) h = ((h << 5) + h) ^ ident[i];
+  return h;
+}
+
+static void _disk_cache_dirname(char *dirname, const size_t size)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(dirname, size, "%s/pixelpipe", cachedir);
+}
+
+static void _disk_cache_filename(char *filename, const size_t size, const uint64_t diskhash)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _disk_cache_dirname(dirname, sizeof(dirname));
+  snprintf(filename, size, "%s/%016" PRIx64 ".dtpc", dirname, diskhash);
+}
+
+static void _disk_cache_shuffle(uint8_t *out, const uint8_t *in, const size_t n, const size_t elem)
+{
+  const size_t count = n / elem;
+  for(size_t b = 0; b < elem; b++)
+    for(size_t i = 0; i < count; i++) out[b * count + i] = in[i * elem + b];
+  memcpy(out + count * elem, in + count * elem, n - count * elem);
+}
+
+static void _disk_cache_unshuffle(uint8_t *out, const uint8_t *in, const size_t n, const size_t elem)
+{
+  const size_t count = n / elem;
+  for(size_t b = 0; b < elem; b++)
+    for(size_t i = 0; i < count; i++) out[i * elem + b] = in[b * count + i];
+  memcpy(out + count * elem, in + count * elem, n - count * elem);
+}
+
+static inline size_t _disk_cache_elem(const dt_iop_buffer_dsc_t *dsc)
+{
+  return (dsc->datatype == TYPE_UINT16) ? sizeof(uint16_t) : sizeof(float);
+}
+
+static gint _disk_cache_sort_mtime(gconstpointer a, gconstpointer b)
+{
+  const _disk_cache_file_t *fa = (const _disk_cache_file_t *)a;
+  const _disk_cache_file_t *fb = (const _disk_cache_file_t *)b;
+  return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+static void _disk_cache_free_file(gpointer data)
+{
+  _disk_cache_file_t *file = (_disk_cache_file_t *)data;
+  g_free(file->path);
+  g_free(file);
+}
+
+// remove the least recently used files until we are within the configured size
+static void _disk_cache_prune(const char *dirname)
+{
+  const size_t limit = (size_t)MAX(0, dt_conf_get_int("cache_pixelpipe_disk_size")) * 1024lu * 1024lu;
+  GDir *dir = g_dir_open(dirname, 0, NULL);
+  if(!dir) return;
+
+  GList *files = NULL;
+  size_t total = 0;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_suffix(name, ".dtpc")) continue;
+    gchar *path = g_build_filename(dirname, name, NULL);
+    GStatBuf st;
+    if(g_stat(path, &st) == 0)
+    {
+      _disk_cache_file_t *file = g_malloc(sizeof(_disk_cache_file_t));
+      file->path = path;
+      file->size = st.st_size;
+      file->mtime = st.st_mtime;
+      files = g_list_prepend(files, file);
+      total += st.st_size;
+    }
+    else
+      g_free(path);
+  }
+  g_dir_close(dir);
+
+  files = g_list_sort(files, _disk_cache_sort_mtime);
+  for(GList *f = files; f && total > limit; f = g_list_next(f))
+  {
+    _disk_cache_file_t *file = (_disk_cache_file_t *)f->data;
+    if(g_unlink(file->path) == 0) total -= file->size;
+  }
+  g_list_free_full(files, _disk_cache_free_file);
+}
+
+gboolean dt_dev_pixelpipe_cache_disk_available(const uint64_t diskhash)
+{
+  char filename[PATH_MAX] = { 0 };
+  _disk_cache_filename(filename, sizeof(filename), diskhash);
+  return g_file_test(filename, G_FILE_TEST_IS_REGULAR);
+}
+
+gboolean dt_dev_pixelpipe_cache_disk_read(const uint64_t diskhash, const dt_iop_roi_t *roi, void *data,
+                                          const size_t size, dt_iop_buffer_dsc_t *dsc)
+{
+  char filename[PATH_MAX] = { 0 };
+  _disk_cache_filename(filename, sizeof(filename), diskhash);
+
+  gzFile f = gzopen(filename, "rb");
+  if(!f) return FALSE;
+
+  gboolean ok = FALSE;
+  uint8_t *tmp = NULL;
+  _disk_cache_header_t header;
+  if(gzread(f, &header, sizeof(header)) != sizeof(header)
+     || header.magic != DT_PIPECACHE_DISK_MAGIC || header.version != DT_PIPECACHE_DISK_VERSION
+     || header.hash != diskhash || header.size != size || memcmp(&header.roi, roi, sizeof(dt_iop_roi_t)))
+    goto end;
+
+  tmp = dt_alloc_align(64, DT_PIPECACHE_DISK_CHUNK);
+  if(!tmp) goto end;
+
+  const size_t elem = _disk_cache_elem(&header.dsc);
+  for(size_t pos = 0; pos < size; pos += DT_PIPECACHE_DISK_CHUNK)
+  {
+    const size_t n = MIN(DT_PIPECACHE_DISK_CHUNK, size - pos);
+    if(gzread(f, tmp, n) != (int)n) goto end;
+    _disk_cache_unshuffle((uint8_t *)data + pos, tmp, n, elem);
+  }
+  *dsc = header.dsc;
+  ok = TRUE;
+
+end:
+  gzclose(f);
+  dt_free_align(tmp);
+  if(ok)
+    // keep recently used files when pruning
+    g_utime(filename, NULL);
+  else
+    g_unlink(filename);
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] %s %s\n", ok ? "read" : "failed to read", filename);
+  return ok;
+}
+
+void dt_dev_pixelpipe_cache_disk_write(const uint64_t diskhash, const dt_iop_roi_t *roi, const void *data,
+                                       const size_t size, const dt_iop_buffer_dsc_t *dsc)
+{
+  char dirname[PATH_MAX] = { 0 };
+  char filename[PATH_MAX] = { 0 };
+  _disk_cache_dirname(dirname, sizeof(dirname));
+  if(g_mkdir_with_parents(dirname, 0750)) return;
+  _disk_cache_filename(filename, sizeof(filename), diskhash);
+  if(g_file_test(filename, G_FILE_TEST_IS_REGULAR)) return;
+
+  uint8_t *tmp = dt_alloc_align(64, DT_PIPECACHE_DISK_CHUNK);
+  if(!tmp) return;
+
+  // write to a temporary file first, so that concurrent readers never see partial data
+  gchar *tmpname = g_strdup_printf("%s.%p", filename, (void *)tmp);
+  gzFile f = gzopen(tmpname, "wb1");
+  gboolean ok = (f != NULL);
+
+  if(ok)
+  {
+    _disk_cache_header_t header = { .magic = DT_PIPECACHE_DISK_MAGIC,
+                                    .version = DT_PIPECACHE_DISK_VERSION,
+                                    .hash = diskhash,
+                                    .roi = *roi,
+                                    .size = size,
+                                    .dsc = *dsc };
+    ok = gzwrite(f, &header, sizeof(header)) == sizeof(header);
+
+    const size_t elem = _disk_cache_elem(dsc);
+    for(size_t pos = 0; ok && pos < size; pos += DT_PIPECACHE_DISK_CHUNK)
+    {
+      const size_t n = MIN(DT_PIPECACHE_DISK_CHUNK, size - pos);
+      _disk_cache_shuffle(tmp, (const uint8_t *)data + pos, n, elem);
+      ok = gzwrite(f, tmp, n) == (int)n;
+    }
+    ok = (gzclose(f) == Z_OK) && ok;
+  }
+
+  if(ok && g_rename(tmpname, filename) == 0)
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] wrote %s\n", filename);
+  else
+    g_unlink(tmpname);
+
+  g_free(tmpname);
+  dt_free_align(tmp);
+
+  _disk_cache_prune(dirname);
+}
+
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
 {
   for(int k = 0; k < cache->entries; k++)
   {
+    if(cache->memlimit && !cache->data[k]) continue;
     printf("pixelpipe cacheline %d ", k);
-    printf("used %d by %" PRIu64 " (%" PRIu64 ")", cache->used[k], cache->hash[k], cache->basichash[k]);
+    printf("age %" PRId64 " by %" PRIu64 " (%" PRIu64 ")", (int64_t)cache->queries - cache->used[k],
+           cache->hash[k], cache->basichash[k]);
+    if(cache->memlimit) printf(" %zuMB cost %.3fs", cache->size[k] / (1024 * 1024), cache->cost[k]);
     printf("\n");
   }
+  if(cache->memlimit)
+    printf("cache memory %zuMB of %zuMB\n", cache->allmem / (1024 * 1024), cache->memlimit / (1024 * 1024));
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
 }
 
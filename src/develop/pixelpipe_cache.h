@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
@@ -27,18 +28,31 @@ struct dt_iop_roi_t;
 /**
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ * cache lines are found through a hash index. in the default mode the cache holds a fixed
+ * number of preallocated lines and evicts the least recently used one.
+ * if a memory budget is given, lines are allocated on demand up to that budget and the line
+ * that is cheapest to recompute (per byte and age) is evicted first. such lines may also be kept
+ * in half floats while nobody needs them, they are expanded again when found.
  */
 
+// maximum number of lines of a cache with memory budget
+#define DT_PIPECACHE_MAX_LINES 64
+
 typedef struct dt_dev_pixelpipe_cache_t
 {
-  int32_t entries;
+  int32_t entries;   // number of cache lines (upper bound if memlimit is set)
+  size_t memlimit;   // total bytes budget for all lines, 0 for fixed preallocated lines
+  size_t allmem;     // bytes currently allocated by all lines
   void **data;
   size_t *size;
   struct dt_iop_buffer_dsc_t *dsc;
   uint64_t *basichash;
   uint64_t *hash;
-  int32_t *used;
+  int64_t *used;     // query stamp of last use, higher is more recent
+  float *cost;       // time in seconds it took to produce the line
+  size_t *halfcount; // number of floats of a line stored as half floats, 0 for plain lines
+  GHashTable *index; // hash -> line + 1
+  int32_t lastused;  // line returned by the last query, never evicted by the next one
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
@@ -48,9 +62,11 @@ typedef struct dt_dev_pixelpipe_cache_t
 } dt_dev_pixelpipe_cache_t;
 
 /** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
+  if memlimit is non-zero, lines are allocated on demand and evicted by cost as soon as all lines
+  together take more than memlimit bytes, entries is only the maximum number of lines then.
   \param[out] returns 0 if fail to allocate mem cache.
 */
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memlimit);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
 /** creates a hopefully unique hash from the complete module stack up to the module-th. */
@@ -86,12 +102,53 @@ void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
 /** invalidates all cachelines except those containing items for the given module/parameter combination */
 void dt_dev_pixelpipe_cache_flush_all_but(dt_dev_pixelpipe_cache_t *cache, uint64_t basichash);
 
+/** invalidates all cachelines holding the output of the given module or any module after it */
+void dt_dev_pixelpipe_cache_flush_downstream(dt_dev_pixelpipe_cache_t *cache, int imgid,
+                                             struct dt_dev_pixelpipe_t *pipe,
+                                             const struct dt_iop_module_t *const module);
+
+/** record how long it took to produce the content of this buffer, used for cost-aware eviction. */
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, void *data, const float cost);
+
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** stores the line holding this float buffer in half floats until it is requested again, halving its memory.
+  only for caches with memory budget, the pointer is not valid anymore afterwards. */
+void dt_dev_pixelpipe_cache_compact(dt_dev_pixelpipe_cache_t *cache, void *data);
+
 /** mark the given cache line pointer as invalid. */
 void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *data);
 
+/** persistent disk tier for the outputs of expensive checkpoint modules (see cache_pixelpipe_disk*). */
+/** returns TRUE if the output of module in this pipe should go to the disk cache. */
+gboolean dt_dev_pixelpipe_cache_disk_checkpoint(const struct dt_dev_pixelpipe_t *pipe,
+                                                const struct dt_iop_module_t *module);
+/** extends the full hash by the data identifying the image and darktable version across sessions. */
+uint64_t dt_dev_pixelpipe_cache_disk_hash(const struct dt_dev_pixelpipe_t *pipe, const uint64_t hash);
+/** returns TRUE if a buffer for this disk hash exists on disk. */
+gboolean dt_dev_pixelpipe_cache_disk_available(const uint64_t diskhash);
+/** reads the buffer into data, returns TRUE on success. */
+gboolean dt_dev_pixelpipe_cache_disk_read(const uint64_t diskhash, const struct dt_iop_roi_t *roi, void *data,
+                                          const size_t size, struct dt_iop_buffer_dsc_t *dsc);
+/** writes the buffer to disk and prunes the disk cache to its maximum size. */
+void dt_dev_pixelpipe_cache_disk_write(const uint64_t diskhash, const struct dt_iop_roi_t *roi, const void *data,
+                                       const size_t size, const struct dt_iop_buffer_dsc_t *dsc);
+
+/** process-wide pool of refcounted buffers shared between pipes working on the same input. */
+/** extends the full hash by the identity of the pipe input buffer. */
+uint64_t dt_dev_pixelpipe_cache_shared_key(const struct dt_dev_pixelpipe_t *pipe, const uint64_t hash);
+/** returns TRUE if the pool holds a buffer for key. */
+gboolean dt_dev_pixelpipe_cache_shared_available(const uint64_t key);
+/** copies the pooled buffer into data, returns TRUE on success. */
+gboolean dt_dev_pixelpipe_cache_shared_get(const uint64_t key, void *data, const size_t size,
+                                           struct dt_iop_buffer_dsc_t *dsc);
+/** adds a copy of data to the pool, evicting least recently used buffers beyond memlimit bytes. */
+void dt_dev_pixelpipe_cache_shared_put(const uint64_t key, const void *data, const size_t size,
+                                       const struct dt_iop_buffer_dsc_t *dsc, const size_t memlimit);
+/** drops all buffers not currently read. */
+void dt_dev_pixelpipe_cache_shared_flush();
+
 /** print out cache lines/hashes (debug). */
 void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache);
 
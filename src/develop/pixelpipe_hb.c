@@ -20,6 +20,8 @@
 #include "common/histogram.h"
 #include "common/imageio.h"
 #include "common/opencl.h"
+#include "common/resource_limits.h"
+#include "common/trace.h"
 #include "common/iop_order.h"
 #include "control/control.h"
 #include "control/signal.h"
@@ -106,34 +108,351 @@ static char *_pipe_type_to_str(int pipe_type)
   return r;
 }
 
+// structured records of every node of a process call, written as json lines to
+// pixelpipe/report_file with -d perf. totals per module are kept for a summary at cleanup.
+typedef struct _pipe_report_total_t
+{
+  int calls, hits, tiled;
+  double time;
+  size_t bytes;
+} _pipe_report_total_t;
+
+static GMutex _report_lock;
+static FILE *_report_file = NULL;
+static gboolean _report_opened = FALSE;
+
+static inline gboolean _pipe_report_enabled(void)
+{
+  return (darktable.unmuted & DT_DEBUG_PERF) != 0;
+}
+
+// call with _report_lock held
+static FILE *_pipe_report_get_file(void)
+{
+  if(!_report_opened)
+  {
+    _report_opened = TRUE;
+    gchar *path = dt_conf_get_string("pixelpipe/report_file");
+    if(path && *path)
+    {
+      _report_file = g_fopen(path, "a");
+      if(!_report_file) fprintf(stderr, "[pixelpipe] can't open report file `%s'\n", path);
+    }
+    g_free(path);
+  }
+  return _report_file;
+}
+
+static void _pipe_report(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module, const dt_iop_roi_t *roi_in,
+                         const dt_iop_roi_t *roi_out, const char *cache, const gboolean gpu,
+                         const gboolean tiled, const double time, const size_t bytes_in,
+                         const size_t bytes_out)
+{
+  if(!module || !_pipe_report_enabled()) return;
+
+  const gboolean hit = strcmp(cache, "miss") != 0;
+  gchar *key = g_strdup_printf("%s %d", module->op, module->multi_priority);
+  if(!pipe->report)
+    pipe->report = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  _pipe_report_total_t *total = g_hash_table_lookup(pipe->report, key);
+  if(!total)
+  {
+    total = g_malloc0(sizeof(_pipe_report_total_t));
+    g_hash_table_insert(pipe->report, key, total);
+  }
+  else
+    g_free(key);
+  total->calls++;
+  total->hits += hit;
+  total->tiled += tiled;
+  total->time += time;
+  total->bytes += bytes_out;
+
+  g_mutex_lock(&_report_lock);
+  FILE *f = _pipe_report_get_file();
+  if(f)
+  {
+    char stime[G_ASCII_DTOSTR_BUF_SIZE], sin[G_ASCII_DTOSTR_BUF_SIZE], sout[G_ASCII_DTOSTR_BUF_SIZE];
+    // locale independent, json wants a decimal point
+    g_ascii_formatd(stime, sizeof(stime), "%.6f", time);
+    g_ascii_formatd(sin, sizeof(sin), "%.6f", roi_in->scale);
+    g_ascii_formatd(sout, sizeof(sout), "%.6f", roi_out->scale);
+    fprintf(f,
+            "{\"pipe\":\"%s\",\"image\":%d,\"module\":\"%s\",\"instance\":%d,"
+            "\"roi_in\":{\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,\"scale\":%s},"
+            "\"roi_out\":{\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,\"scale\":%s},"
+            "\"device\":\"%s\",\"devid\":%d,\"time\":%s,\"bytes_in\":%zu,\"bytes_out\":%zu,"
+            "\"tiling\":%s,\"cache\":\"%s\"}\n",
+            _pipe_type_to_str(pipe->type), pipe->image.id, module->op, module->multi_priority,
+            roi_in->x, roi_in->y, roi_in->width, roi_in->height, sin,
+            roi_out->x, roi_out->y, roi_out->width, roi_out->height, sout,
+            hit ? "none" : (gpu ? "GPU" : "CPU"), gpu ? pipe->devid : -1, stime, bytes_in, bytes_out,
+            tiled ? "true" : "false", cache);
+    fflush(f);
+  }
+  g_mutex_unlock(&_report_lock);
+}
+
+void dt_dev_pixelpipe_report_write(const char *line)
+{
+  g_mutex_lock(&_report_lock);
+  FILE *f = _pipe_report_get_file();
+  if(f)
+  {
+    fprintf(f, "%s\n", line);
+    fflush(f);
+  }
+  g_mutex_unlock(&_report_lock);
+}
+
+static void _pipe_report_summary(dt_dev_pixelpipe_t *pipe)
+{
+  if(!pipe->report) return;
+
+  g_mutex_lock(&_report_lock);
+  FILE *f = _pipe_report_get_file();
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, pipe->report);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const _pipe_report_total_t *total = (_pipe_report_total_t *)value;
+    dt_print(DT_DEBUG_PERF, "[pixelpipe] summary `%s': %d calls, %d from cache, %d tiled, %.3f secs [%s]\n",
+             (char *)key, total->calls, total->hits, total->tiled, total->time,
+             _pipe_type_to_str(pipe->type));
+    if(f)
+    {
+      char stime[G_ASCII_DTOSTR_BUF_SIZE];
+      g_ascii_formatd(stime, sizeof(stime), "%.6f", total->time);
+      gchar **op = g_strsplit((char *)key, " ", 2);
+      fprintf(f,
+              "{\"summary\":true,\"pipe\":\"%s\",\"module\":\"%s\",\"instance\":%s,\"calls\":%d,"
+              "\"cache_hits\":%d,\"tiled\":%d,\"time\":%s,\"bytes_out\":%zu}\n",
+              _pipe_type_to_str(pipe->type), op[0], op[1] ? op[1] : "0", total->calls, total->hits,
+              total->tiled, stime, total->bytes);
+      g_strfreev(op);
+    }
+  }
+  if(f) fflush(f);
+  g_mutex_unlock(&_report_lock);
+
+  g_hash_table_destroy(pipe->report);
+  pipe->report = NULL;
+}
+
+// the pipe running on this thread, lets dt_iop_alloc_image_buffers() find the scratch arena
+static __thread dt_dev_pixelpipe_t *_current_pipe = NULL;
+
+// idle scratch buffers an export pipe leaves for the one of the next image
+static dt_dev_pixelpipe_scratch_t _scratch_parked[DT_DEV_PIXELPIPE_SCRATCH_SLOTS];
+static GMutex _scratch_parked_lock;
+
+dt_dev_pixelpipe_t *dt_dev_pixelpipe_current(void)
+{
+  return _current_pipe;
+}
+
+static void _scratch_release_idle(dt_dev_pixelpipe_scratch_t *scratch)
+{
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+  {
+    if(scratch[k].buf && !scratch[k].in_use)
+    {
+      dt_free_align(scratch[k].buf);
+      scratch[k].buf = NULL;
+      scratch[k].size = 0;
+    }
+  }
+}
+
+void *dt_dev_pixelpipe_scratch_alloc(dt_dev_pixelpipe_t *pipe, const size_t size)
+{
+  dt_dev_pixelpipe_scratch_t *scratch = pipe->scratch;
+
+  // best fit among the idle buffers
+  int best = -1;
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+    if(scratch[k].buf && !scratch[k].in_use && scratch[k].size >= size
+       && (best < 0 || scratch[k].size < scratch[best].size))
+      best = k;
+  if(best >= 0)
+  {
+    scratch[best].in_use = TRUE;
+    pipe->scratch_in_use += scratch[best].size;
+    pipe->scratch_peak = MAX(pipe->scratch_peak, pipe->scratch_in_use);
+    return scratch[best].buf;
+  }
+
+  // none is large enough: take an empty slot, or replace an idle buffer which is too small
+  int slot = -1;
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS && slot < 0; k++)
+    if(!scratch[k].buf) slot = k;
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS && slot < 0; k++)
+    if(!scratch[k].in_use) slot = k;
+
+  if(slot >= 0 && scratch[slot].buf)
+  {
+    dt_free_align(scratch[slot].buf);
+    scratch[slot].buf = NULL;
+    scratch[slot].size = 0;
+  }
+
+  void *buf = dt_alloc_align(64, size);
+  if(!buf)
+  {
+    // don't let the retained buffers be the reason for running out of memory
+    _scratch_release_idle(scratch);
+    buf = dt_alloc_align(64, size);
+  }
+  // with all slots in use the buffer is simply not retained
+  if(buf && slot >= 0)
+  {
+    scratch[slot].buf = buf;
+    scratch[slot].size = size;
+    scratch[slot].in_use = TRUE;
+    pipe->scratch_in_use += size;
+  }
+  // a buffer not retained can't be told apart when it is given back, it only counts for the peak
+  if(buf) pipe->scratch_peak = MAX(pipe->scratch_peak, pipe->scratch_in_use + (slot >= 0 ? 0 : size));
+  return buf;
+}
+
+void dt_dev_pixelpipe_scratch_free(dt_dev_pixelpipe_t *pipe, void *buf)
+{
+  if(!buf) return;
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+  {
+    if(pipe->scratch[k].buf == buf)
+    {
+      pipe->scratch[k].in_use = FALSE;
+      pipe->scratch_in_use -= MIN(pipe->scratch[k].size, pipe->scratch_in_use);
+      return;
+    }
+  }
+  dt_free_align(buf);
+}
+
+// keep at most budget bytes of idle scratch buffers, dropping the largest first
+static void _scratch_trim(dt_dev_pixelpipe_t *pipe, const size_t budget)
+{
+  dt_dev_pixelpipe_scratch_t *scratch = pipe->scratch;
+  while(TRUE)
+  {
+    size_t idle = 0;
+    int largest = -1;
+    for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+    {
+      if(!scratch[k].buf || scratch[k].in_use) continue;
+      idle += scratch[k].size;
+      if(largest < 0 || scratch[k].size > scratch[largest].size) largest = k;
+    }
+    if(idle <= budget || largest < 0) return;
+    dt_free_align(scratch[largest].buf);
+    scratch[largest].buf = NULL;
+    scratch[largest].size = 0;
+  }
+}
+
+static void _scratch_adopt_parked(dt_dev_pixelpipe_t *pipe)
+{
+  g_mutex_lock(&_scratch_parked_lock);
+  int slot = 0;
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+  {
+    if(!_scratch_parked[k].buf) continue;
+    pipe->scratch[slot++] = _scratch_parked[k];
+    _scratch_parked[k].buf = NULL;
+    _scratch_parked[k].size = 0;
+  }
+  g_mutex_unlock(&_scratch_parked_lock);
+}
+
+static void _scratch_cleanup(dt_dev_pixelpipe_t *pipe)
+{
+  if(pipe->type & DT_DEV_PIXELPIPE_EXPORT)
+  {
+    // batch exports run one pipe per image, hand the buffers on to the next one
+    g_mutex_lock(&_scratch_parked_lock);
+    for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+    {
+      if(!pipe->scratch[k].buf || pipe->scratch[k].in_use) continue;
+      for(int i = 0; i < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; i++)
+      {
+        if(_scratch_parked[i].buf) continue;
+        _scratch_parked[i] = pipe->scratch[k];
+        pipe->scratch[k].buf = NULL;
+        break;
+      }
+    }
+    g_mutex_unlock(&_scratch_parked_lock);
+  }
+
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++)
+    dt_free_align(pipe->scratch[k].buf);
+  memset(pipe->scratch, 0, sizeof(pipe->scratch));
+}
+
+void dt_dev_pixelpipe_scratch_flush_parked(void)
+{
+  g_mutex_lock(&_scratch_parked_lock);
+  _scratch_release_idle(_scratch_parked);
+  g_mutex_unlock(&_scratch_parked_lock);
+}
+
+static void _raster_mask_cache_drop(dt_dev_pixelpipe_raster_mask_t *entry)
+{
+  dt_free_align(entry->buf);
+  memset(entry, 0, sizeof(dt_dev_pixelpipe_raster_mask_t));
+}
+
+static void _raster_mask_cache_cleanup(dt_dev_pixelpipe_t *pipe)
+{
+  for(int k = 0; k < DT_DEV_PIXELPIPE_RASTER_MASKS; k++)
+    _raster_mask_cache_drop(&pipe->raster_mask_cache[k]);
+  pipe->raster_mask_cache_next = 0;
+}
+
 int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height, int levels,
                                  gboolean store_masks)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 2);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_EXPORT;
   pipe->levels = levels;
   pipe->store_all_raster_masks = store_masks;
+  _scratch_adopt_parked(pipe);
   return res;
 }
 
 int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 2);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
 
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 0);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, sizeof(float) * 4 * width * height, 0, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
 
+// memory budget of the darkroom pipe caches, a fraction of the memory available to darktable
+// unless set in darktablerc. a negative setting falls back to a fixed number of lines.
+static size_t _pipe_cache_memlimit(const gboolean preview)
+{
+  const int mb = dt_conf_get_int("cache_pixelpipe_memory");
+  if(mb < 0) return 0;
+  const size_t limit = (mb > 0) ? (size_t)mb * 1024lu * 1024lu : dt_get_available_mem() / 4;
+  // the preview pipes work on downscaled buffers
+  return preview ? limit / 4 : limit;
+}
+
 int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 8);
+  const size_t memlimit = _pipe_cache_memlimit(TRUE);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, memlimit ? DT_PIPECACHE_MAX_LINES : 8, memlimit);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
   return res;
 }
@@ -141,7 +460,8 @@ int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 int dt_dev_pixelpipe_init_preview2(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
+  const size_t memlimit = _pipe_cache_memlimit(TRUE);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, memlimit ? DT_PIPECACHE_MAX_LINES : 5, memlimit);
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW2;
   return res;
 }
@@ -149,12 +469,13 @@ int dt_dev_pixelpipe_init_preview2(dt_dev_pixelpipe_t *pipe)
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 8);
+  const size_t memlimit = _pipe_cache_memlimit(FALSE);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, memlimit ? DT_PIPECACHE_MAX_LINES : 8, memlimit);
   pipe->type = DT_DEV_PIXELPIPE_FULL;
   return res;
 }
 
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries)
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memlimit)
 {
   pipe->devid = -1;
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
@@ -162,7 +483,8 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size, memlimit)) return 0;
+  pipe->cache_quota = memlimit;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.0f;
@@ -175,10 +497,12 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->output_imgid = 0;
 
   pipe->rawdetail_mask_data = NULL;
+  pipe->rawdetail_mask_downscale = 1;
   pipe->want_detail_mask = DT_DEV_DETAIL_MASK_NONE;
 
   pipe->processing = 0;
   dt_atomic_set_int(&pipe->shutdown,FALSE);
+  dt_atomic_set_int(&pipe->cancel, FALSE);
   pipe->opencl_error = 0;
   pipe->tiling = 0;
   pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
@@ -194,9 +518,16 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
   pipe->store_all_raster_masks = FALSE;
+  pipe->dirty_from = -1;
+  pipe->nodes_recomputed = pipe->nodes_reused = 0;
+  pipe->report = NULL;
   pipe->work_profile_info = NULL;
   pipe->input_profile_info = NULL;
   pipe->output_profile_info = NULL;
+  memset(pipe->scratch, 0, sizeof(pipe->scratch));
+  memset(pipe->raster_mask_cache, 0, sizeof(pipe->raster_mask_cache));
+  pipe->raster_mask_cache_next = 0;
+  memset(&pipe->distort_grid, 0, sizeof(pipe->distort_grid));
 
   return 1;
 }
@@ -229,6 +560,9 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   dt_dev_pixelpipe_cleanup_nodes(pipe);
   // so now it's safe to clean up cache:
   dt_dev_pixelpipe_cache_cleanup(&(pipe->cache));
+  dt_memory_budget_claim(pipe, NULL, 0);
+  if(pipe->type & DT_DEV_PIXELPIPE_FULL) dt_dev_pixelpipe_cache_shared_flush();
+  _pipe_report_summary(pipe);
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
   dt_pthread_mutex_destroy(&(pipe->backbuf_mutex));
   dt_pthread_mutex_destroy(&(pipe->busy_mutex));
@@ -243,6 +577,10 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   pipe->output_imgid = 0;
 
   dt_dev_clear_rawdetail_mask(pipe);
+  _scratch_cleanup(pipe);
+  dt_free_align(pipe->distort_grid.forw);
+  dt_free_align(pipe->distort_grid.back);
+  memset(&pipe->distort_grid, 0, sizeof(pipe->distort_grid));
 
   if(pipe->forms)
   {
@@ -259,6 +597,8 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
   //        (this is a circular dependency on busy_mutex and the gdk mutex)
   // [[does the above still apply?]]
   dt_pthread_mutex_lock(&pipe->busy_mutex); // block until the pipe has shut down
+  // the distorted raster masks refer to the pieces
+  _raster_mask_cache_cleanup(pipe);
   // destroy all nodes
   for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
   {
@@ -334,6 +674,7 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->pipe = pipe;
     piece->data = NULL;
     piece->hash = 0;
+    piece->dirty = TRUE;
     piece->process_cl_ready = 0;
     piece->process_tiling_ready = 0;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
@@ -453,10 +794,49 @@ void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
   dt_pthread_mutex_unlock(&pipe->busy_mutex);
 }
 
+// remember the state of all nodes before a synch
+static uint64_t *_pipe_dirty_snapshot(dt_dev_pixelpipe_t *pipe)
+{
+  const int nodes = g_list_length(pipe->nodes);
+  uint64_t *state = g_new(uint64_t, 2 * MAX(nodes, 1));
+  int k = 0;
+  for(GList *n = pipe->nodes; n; n = g_list_next(n), k++)
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)n->data;
+    state[2 * k] = piece->hash;
+    state[2 * k + 1] = piece->enabled;
+  }
+  return state;
+}
+
+// flag the nodes whose params or enabled state differ from the snapshot. flags of changes not
+// processed yet are kept, they are cleared by a successful process call.
+static void _pipe_dirty_update(dt_dev_pixelpipe_t *pipe, const uint64_t *state, const gboolean all)
+{
+  pipe->dirty_from = -1;
+  int k = 0;
+  for(GList *n = pipe->nodes; n; n = g_list_next(n), k++)
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)n->data;
+    piece->dirty |= all || state[2 * k] != piece->hash || state[2 * k + 1] != piece->enabled;
+    if(piece->dirty && pipe->dirty_from < 0) pipe->dirty_from = k;
+  }
+}
+
+static void _pipe_dirty_clear(dt_dev_pixelpipe_t *pipe)
+{
+  for(GList *n = pipe->nodes; n; n = g_list_next(n)) ((dt_dev_pixelpipe_iop_t *)n->data)->dirty = FALSE;
+  pipe->dirty_from = -1;
+}
+
 void dt_dev_pixelpipe_change(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->history_mutex);
 
+  // whatever comes in from now on supersedes the run we're preparing
+  dt_atomic_set_int(&pipe->cancel, FALSE);
+  uint64_t *state = _pipe_dirty_snapshot(pipe);
+
   dt_print(DT_DEBUG_PARAMS, "[pixelpipe] pipeline state changing for pipe %i, flag %i\n", pipe->type, pipe->changed);
   // case DT_DEV_PIPE_UNCHANGED: case DT_DEV_PIPE_ZOOMED:
   if(pipe->changed & DT_DEV_PIPE_TOP_CHANGED)
@@ -476,12 +856,28 @@ void dt_dev_pixelpipe_change(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev)
     dt_dev_pixelpipe_create_nodes(pipe, dev);
     dt_dev_pixelpipe_synch_all(pipe, dev);
   }
+  // after a rebuild the node list doesn't match the snapshot anymore
+  _pipe_dirty_update(pipe, state, pipe->changed & DT_DEV_PIPE_REMOVE);
+  g_free(state);
+  if(pipe->dirty_from >= 0)
+    dt_print(DT_DEBUG_PARAMS, "[pixelpipe] first changed node `%s' for pipe %i\n",
+             ((dt_dev_pixelpipe_iop_t *)g_list_nth_data(pipe->nodes, pipe->dirty_from))->module->op, pipe->type);
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
   dt_pthread_mutex_unlock(&dev->history_mutex);
   dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &pipe->processed_width,
                                   &pipe->processed_height);
 }
 
+void dt_dev_pixelpipe_cancel(dt_dev_pixelpipe_t *pipe)
+{
+  dt_atomic_set_int(&pipe->cancel, TRUE);
+}
+
+gboolean dt_dev_pixelpipe_cancelled(dt_dev_pixelpipe_t *pipe)
+{
+  return dt_atomic_get_int(&pipe->shutdown) || dt_atomic_get_int(&pipe->cancel);
+}
+
 // TODO:
 void dt_dev_pixelpipe_add_node(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int n)
 {
@@ -507,6 +903,21 @@ static void get_output_format(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe,
 }
 
 
+// the histograms of the preview pipe are drawn by the modules, a sample of this many pixels is enough for them
+#define HISTOGRAM_PREVIEW_PIXELS (1 << 18)
+
+static int _histogram_sampling(const dt_dev_pixelpipe_iop_t *piece,
+                               const dt_dev_histogram_collection_params_t *const histogram_params)
+{
+  if(histogram_params->sampling > 0 || !(piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW))
+    return histogram_params->sampling;
+
+  const dt_histogram_roi_t *roi = histogram_params->roi;
+  const size_t pixels = (size_t)(roi->width - roi->crop_width - roi->crop_x)
+                        * (roi->height - roi->crop_height - roi->crop_y);
+  return MAX((int)sqrtf((float)pixels / HISTOGRAM_PREVIEW_PIXELS), 1);
+}
+
 // helper to get per module histogram
 static void histogram_collect(dt_dev_pixelpipe_iop_t *piece, const void *pixel, const dt_iop_roi_t *roi,
                               uint32_t **histogram, uint32_t *histogram_max)
@@ -525,6 +936,8 @@ static void histogram_collect(dt_dev_pixelpipe_iop_t *piece, const void *pixel,
     histogram_params.roi = &histogram_roi;
   }
 
+  histogram_params.sampling = _histogram_sampling(piece, &histogram_params);
+
   const dt_iop_colorspace_type_t cst = piece->module->input_colorspace(piece->module, piece->pipe, piece);
 
   dt_histogram_helper(&histogram_params, &piece->histogram_stats, cst, piece->module->histogram_cst, pixel, histogram,
@@ -573,6 +986,8 @@ static void histogram_collect_cl(int devid, dt_dev_pixelpipe_iop_t *piece, cl_me
     histogram_params.roi = &histogram_roi;
   }
 
+  histogram_params.sampling = _histogram_sampling(piece, &histogram_params);
+
   const dt_iop_colorspace_type_t cst = piece->module->input_colorspace(piece->module, piece->pipe, piece);
 
   dt_histogram_helper(&histogram_params, &piece->histogram_stats, cst, piece->module->histogram_cst, pixel, histogram,
@@ -976,10 +1391,13 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
   const size_t bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
 
+  const size_t required = (size_t)MAX(roi_in->width, roi_out->width) * MAX(roi_in->height, roi_out->height)
+                          * MAX(in_bpp, bpp);
   const gboolean needs_tiling = (piece->process_tiling_ready &&
      !dt_tiling_piece_fits_host_memory(MAX(roi_in->width, roi_out->width),
                                        MAX(roi_in->height, roi_out->height), MAX(in_bpp, bpp),
-                                          tiling->factor, tiling->overhead));
+                                       dt_tiling_refined_factor(module, FALSE, tiling->factor),
+                                       tiling->overhead));
 
   /* process module on cpu. use tiling if needed and possible. */
   if(needs_tiling)
@@ -990,7 +1408,16 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   }
   else
   {
+    // what the module allocates from the scratch arena on top of its input and output
+    const size_t scratch_base = pipe->scratch_in_use;
+    pipe->scratch_peak = scratch_base;
     module->process(module, piece, input, *output, roi_in, roi_out);
+    // modules allocating their buffers elsewhere can't be measured this way
+    if(pipe->scratch_peak > scratch_base && !dt_atomic_get_int(&pipe->shutdown))
+      dt_tiling_record_peak(module, FALSE, required,
+                            (size_t)roi_in->width * roi_in->height * in_bpp
+                                + (size_t)roi_out->width * roi_out->height * bpp
+                                + pipe->scratch_peak - scratch_base);
     *pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_CPU);
     *pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
   }
@@ -1056,14 +1483,343 @@ static int pixelpipe_process_on_CPU(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev,
   return 0; //no errors
 }
 
+// all enabled nodes up to pos are covered by a buffer taken from cache
+static void _pipe_count_reused(dt_dev_pixelpipe_t *pipe, const int pos)
+{
+  GList *pieces = pipe->nodes;
+  for(int k = 0; k < pos && pieces; k++, pieces = g_list_next(pieces))
+    if(((dt_dev_pixelpipe_iop_t *)pieces->data)->enabled) pipe->nodes_reused++;
+}
+
+// the disk cache can't restore side products of the skipped modules, so don't use it if they are needed
+// modules asking for (nearly) all of their input to produce a small part of their output make
+// every module before them process much more than the final crop needs, point them out.
+static void _pipe_check_roi_growth(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                                   const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_out,
+                                   const dt_iop_roi_t *roi_in)
+{
+  const double full_in = (double)piece->buf_in.width * piece->buf_in.height * roi_in->scale * roi_in->scale;
+  const double full_out
+      = (double)piece->buf_out.width * piece->buf_out.height * roi_out->scale * roi_out->scale;
+  if(full_in <= 0.0 || full_out <= 0.0) return;
+
+  const double part_in = (double)roi_in->width * roi_in->height / full_in;
+  const double part_out = (double)roi_out->width * roi_out->height / full_out;
+  if(part_in > 0.95 && part_out < 0.5)
+    dt_print(DT_DEBUG_PERF, "[pixelpipe] `%s' needs %.0f%% of its input for %.0f%% of its output, "
+                            "all modules before it process the full frame [%s]
+",
+             module->op, 100.0 * MIN(part_in, 1.0), 100.0 * part_out, _pipe_type_to_str(pipe->type));
+}
+
+static gboolean _disk_cache_usable(dt_dev_pixelpipe_t *pipe, const int pos)
+{
+  if(pipe->store_all_raster_masks) return FALSE;
+  if(pipe->want_detail_mask & DT_DEV_DETAIL_MASK_REQUIRED) return FALSE;
+
+  GList *pieces = pipe->nodes;
+  for(int k = 0; k < pos && pieces; k++, pieces = g_list_next(pieces))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(piece->enabled && dt_iop_is_raster_mask_used(piece->module, 0)) return FALSE;
+  }
+  return TRUE;
+}
+
+// with the second window open the full and preview2 pipes start from the same full resolution
+// input, so up to the point where they diverge they compute the same buffers. the preview pipe
+// works on a downscaled mipmap and never matches.
+static gboolean _shared_cache_usable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                     const int pos)
+{
+  if(!module || !dev->gui_attached || !dev->second_window.second_wnd) return FALSE;
+  if(!(pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW2))) return FALSE;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+  if(pipe->cache.memlimit == 0) return FALSE;
+  // the pipes use different output profiles
+  if(module->iop_order >= dt_ioppr_get_iop_order(pipe->iop_order_list, "colorout", 0)) return FALSE;
+  // the focused module might have side effects (pickers, guides), leave it and everything after alone
+  if(dev->gui_module && module->iop_order >= dev->gui_module->iop_order) return FALSE;
+  return _disk_cache_usable(pipe, pos);
+}
+
+// the cache keeps the inputs of the modules after the one given by cache_pixelpipe_half_after in half floats
+static gboolean _half_float_storage(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module)
+{
+  if(pipe->cache.memlimit == 0) return FALSE;
+  const char *after = dt_conf_get_string_const("cache_pixelpipe_half_after");
+  if(!after || !*after) return FALSE;
+  const dt_iop_order_entry_t *const entry = dt_ioppr_get_iop_order_entry(pipe->iop_order_list, after, 0);
+  return entry && module->iop_order > entry->o.iop_order;
+}
+
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// pixels processed by all modules of a fused run in one go, small enough to stay in cache
+#define DT_PIXELPIPE_FUSED_CHUNK 4096
+// maximum number of modules in a fused run
+#define DT_PIXELPIPE_FUSED_MAX 32
+
+static inline gboolean _piece_skipped(dt_develop_t *dev, dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module != module
+             && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+// a module reporting its params as a no-op hands its input over unchanged, buffer and cache entry,
+// unless something needs its own output.
+static inline gboolean _piece_passthrough(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                          dt_dev_pixelpipe_iop_t *piece)
+{
+  if(!piece->identity || module == dev->gui_module) return FALSE;
+  if(piece->request_histogram & DT_REQUEST_ON) return FALSE;
+  if(piece->blendop_data
+     && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  if(dt_iop_is_raster_mask_used(module, 0)) return FALSE;
+  return module->input_colorspace(module, pipe, piece) == module->output_colorspace(module, pipe, piece);
+}
+
+// look at the whole pipe before running it: which modules run on the device, and where the data
+// has to come back to the host for a module without opencl code or for the end of the pipe. the
+// modules right before such a return write their output straight into host memory on devices
+// sharing it, which saves the copy back.
+static void _pixelpipe_plan_opencl(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  const gboolean preview = (pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+                           || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2;
+  int groups = 0, returns = 0;
+  dt_dev_pixelpipe_iop_t *prev = NULL;
+  gboolean prev_on_device = FALSE;
+
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    piece->cl_output_to_host = FALSE;
+    if(_piece_skipped(dev, module, piece) || _piece_passthrough(pipe, dev, module, piece)) continue;
+
+    const gboolean on_device = module->process_cl && piece->process_cl_ready
+                               && !(preview && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL));
+    if(on_device && !prev_on_device) groups++;
+    if(prev_on_device && !on_device)
+    {
+      prev->cl_output_to_host = TRUE;
+      returns++;
+    }
+    prev = piece;
+    prev_on_device = on_device;
+  }
+  if(prev_on_device) prev->cl_output_to_host = TRUE;
+
+  dt_print(DT_DEBUG_OPENCL, "[pixelpipe_plan] [%s] %d group(s) of modules on the device, %d return(s) to the host "
+                            "in between%s\n", _pipe_type_to_str(pipe->type), groups, returns,
+           dt_opencl_unified_memory(pipe->devid) ? ", written in place" : "");
+}
+
+// the modules that would run on the device decide whether it, another device or the cpu did best with
+// them lately. returns the device to use, -1 for the cpu.
+static int _pixelpipe_rebalance_opencl(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  const gboolean preview = (pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+                           || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2;
+  const char **ops = malloc(sizeof(char *) * g_list_length(pipe->nodes));
+  if(!ops) return pipe->devid;
+  int count = 0;
+
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_iop_module_t *module = piece->module;
+    if(_piece_skipped(dev, module, piece) || _piece_passthrough(pipe, dev, module, piece)) continue;
+    if(module->process_cl && piece->process_cl_ready
+       && !(preview && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL)))
+      ops[count++] = module->op;
+  }
+
+  const int devid = dt_opencl_rebalance_device(pipe->devid, pipe->type, ops, count);
+  free(ops);
+  return devid;
+}
+
+// can this module be run point-wise together with its neighbours? side products like histograms,
+// pickers, masks or blending need the full in- and output buffers, so they rule it out.
+static gboolean _pointwise_fusable(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, dt_iop_module_t *module,
+                                   dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  if(!module->process_pixels || piece->colors != 4) return FALSE;
+  if(module == dev->gui_module || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+  if(piece->request_histogram & DT_REQUEST_ON) return FALSE;
+  if(piece->blendop_data
+     && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  if(dt_iop_is_raster_mask_used(module, 0)) return FALSE;
+
+  const int cst = module->input_colorspace(module, pipe, piece);
+  if(cst == IOP_CS_RAW || cst != module->output_colorspace(module, pipe, piece)) return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  return !memcmp(&roi_in, roi, sizeof(dt_iop_roi_t));
+}
+
+// processes the run of point-wise modules ending at the given one in a single pass over the image,
+// instead of streaming a full buffer from one to the next. the intermediate results aren't cached.
+// returns -1 if there is no run of at least two modules, the error state of the pipe otherwise.
+static int _process_pointwise_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                  dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                  GList *modules, GList *pieces, int pos, const uint64_t basichash,
+                                  const uint64_t hash, const size_t bufsize)
+{
+  // no mixing with gpu buffers
+  if(pipe->devid >= 0 || !dt_conf_get_bool("pixelpipe_fuse_pointwise")) return -1;
+
+  dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+  dt_dev_pixelpipe_iop_t *steps[DT_PIXELPIPE_FUSED_MAX];
+  int nsteps = 0;
+  const int cst = module->input_colorspace(module, pipe, (dt_dev_pixelpipe_iop_t *)pieces->data);
+
+  // collect the run backwards, it starts from the first cached or non point-wise output
+  GList *first_module = modules, *first_piece = pieces;
+  int first_pos = pos;
+  for(; modules && nsteps < DT_PIXELPIPE_FUSED_MAX;
+      modules = g_list_previous(modules), pieces = g_list_previous(pieces), pos--)
+  {
+    dt_iop_module_t *m = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(_piece_skipped(dev, m, p) || _piece_passthrough(pipe, dev, m, p)) continue;
+    if(!_pointwise_fusable(pipe, dev, m, p, roi_out) || m->input_colorspace(m, pipe, p) != cst) break;
+    if(nsteps)
+    {
+      uint64_t bh, h;
+      dt_dev_pixelpipe_cache_fullhash(pipe->image.id, roi_out, pipe, pos, &bh, &h);
+      if(dt_dev_pixelpipe_cache_available(&(pipe->cache), h)) break;
+    }
+    steps[nsteps++] = p;
+    first_module = modules;
+    first_piece = pieces;
+    first_pos = pos;
+  }
+  if(nsteps < 2) return -1;
+
+  // in pipe order from now on
+  for(int k = 0; k < nsteps / 2; k++)
+  {
+    dt_dev_pixelpipe_iop_t *p = steps[k];
+    steps[k] = steps[nsteps - 1 - k];
+    steps[nsteps - 1 - k] = p;
+  }
+
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out,
+                                  g_list_previous(first_module), g_list_previous(first_piece), first_pos - 1))
+    return 1;
+
+  if(dt_atomic_get_int(&pipe->shutdown)) return 1;
+
+  dt_times_t start;
+  dt_get_times(&start);
+  const double trace_begin = dt_trace_begin();
+
+  const dt_iop_order_iccprofile_info_t *const work_profile
+      = (input_format->cst != IOP_CS_RAW) ? dt_ioppr_get_pipe_work_profile_info(pipe) : NULL;
+  dt_ioppr_transform_image_colorspace(steps[0]->module, input, input, roi_out->width, roi_out->height,
+                                      input_format->cst, cst, &input_format->cst, work_profile);
+
+  // formats and per run setup of all steps, in the order process() would do it
+  dt_iop_buffer_dsc_t dsc = *input_format;
+  for(int k = 0; k < nsteps; k++)
+  {
+    dt_dev_pixelpipe_iop_t *p = steps[k];
+    p->processed_roi_in = p->processed_roi_out = *roi_out;
+    p->dsc_in = p->dsc_out = dsc;
+    p->module->output_format(p->module, pipe, p, &p->dsc_out);
+    pipe->dsc = p->dsc_out;
+    if(p->module->process_pixels_setup) p->module->process_pixels_setup(p->module, p, roi_out);
+    pipe->dsc.cst = p->module->output_colorspace(p->module, pipe, p);
+    dsc = p->dsc_out = pipe->dsc;
+  }
+
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+  **out_format = dsc;
+
+  if(dt_atomic_get_int(&pipe->shutdown)) return 1;
+
+  const size_t npixels = (size_t)roi_out->width * roi_out->height;
+  if(input_format->datatype == TYPE_FLOAT && input_format->channels == 4
+     && bufsize == npixels * 4 * sizeof(float))
+  {
+    const float *const in = (const float *)input;
+    float *const out = (float *)*output;
+    const size_t nchunks = (npixels + DT_PIXELPIPE_FUSED_CHUNK - 1) / DT_PIXELPIPE_FUSED_CHUNK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(in, out, npixels, nchunks, nsteps) \
+    shared(steps) \
+    schedule(static)
+#endif
+    for(size_t c = 0; c < nchunks; c++)
+    {
+      const size_t offset = c * DT_PIXELPIPE_FUSED_CHUNK;
+      const size_t n = MIN(DT_PIXELPIPE_FUSED_CHUNK, npixels - offset);
+      const float *src = in + 4 * offset;
+      float *const dst = out + 4 * offset;
+      for(int k = 0; k < nsteps; k++)
+      {
+        steps[k]->module->process_pixels(steps[k]->module, steps[k], src, dst, n);
+        src = dst;
+      }
+    }
+  }
+  else
+  {
+    // unexpected input, fall back to the full buffer process() one step after the other
+    dt_print(DT_DEBUG_DEV, "[pixelpipe] unexpected input format for fused run up to `%s' [%s]\n",
+             module->op, _pipe_type_to_str(pipe->type));
+    void *tmp = dt_alloc_align(64, bufsize);
+    if(!tmp) return 1;
+    const void *src = input;
+    for(int k = 0; k < nsteps; k++)
+    {
+      steps[k]->module->process(steps[k]->module, steps[k], src, tmp, roi_out, roi_out);
+      memcpy(*output, tmp, bufsize);
+      src = *output;
+    }
+    dt_free_align(tmp);
+  }
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "processed %d fused point-wise modules up to `%s' on CPU [%s]",
+                  nsteps, module->op, _pipe_type_to_str(pipe->type));
+  dt_trace_complete("pixelpipe", module->op, trace_begin,
+                    "\"pipe\":\"%s\",\"fused\":%d,\"width\":%d,\"height\":%d,\"device\":\"CPU\"",
+                    _pipe_type_to_str(pipe->type), nsteps, roi_out->width, roi_out->height);
+  dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, dt_get_wtime() - start.clock);
+  // the fused run is reported as a whole under its last module
+  _pipe_report(pipe, module, roi_out, roi_out, "miss", FALSE, FALSE, dt_get_wtime() - start.clock,
+               bufsize, bufsize);
+  pipe->nodes_recomputed += nsteps;
+
+  if(dt_atomic_get_int(&pipe->shutdown)) return 1;
+  return 0;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
                                         const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos)
 {
-  if (dt_atomic_get_int(&pipe->shutdown))
+  if(dt_dev_pixelpipe_cancelled(pipe))
     return 1;
 
+  // other pipes may have started or finished since the last module
+  dt_omp_share_update();
+
   dt_iop_roi_t roi_in = *roi_out;
 
   char module_name[256] = { 0 };
@@ -1085,9 +1841,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     module = (dt_iop_module_t *)modules->data;
     piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
     // skip this module?
-    if(!piece->enabled
-       || (dev->gui_module && dev->gui_module != module
-           && dev->gui_module->operation_tags_filter() & module->operation_tags()))
+    if(_piece_skipped(dev, module, piece) || _piece_passthrough(pipe, dev, module, piece))
       return dt_dev_pixelpipe_process_rec(pipe, dev, output, cl_mem_output, out_format, &roi_in,
                                           g_list_previous(modules), g_list_previous(pieces), pos - 1);
   }
@@ -1121,6 +1875,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // dev->preview_pipe ? "[preview]" : "", hash);
 
     (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+    _pipe_count_reused(pipe, pos);
+    _pipe_report(pipe, module, roi_out, roi_out, "memory", FALSE, FALSE, 0.0, 0, bufsize);
 
     if(dt_atomic_get_int(&pipe->shutdown))
       return 1;
@@ -1140,6 +1896,48 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   if(pipe == dev->preview2_pipe && dev->preview2_loading) return 1;
   if(dev->gui_leaving) return 1;
 
+  // 2b) the other pipe on the same input might have computed this already
+  const gboolean shared = _shared_cache_usable(pipe, dev, module, pos);
+  const uint64_t sharedkey = shared ? dt_dev_pixelpipe_cache_shared_key(pipe, hash) : 0;
+  if(shared && dt_dev_pixelpipe_cache_shared_available(sharedkey))
+  {
+    dt_iop_buffer_dsc_t *const format = *out_format;
+    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+    if(*output && dt_dev_pixelpipe_cache_shared_get(sharedkey, *output, bufsize, *out_format))
+    {
+      dt_print(DT_DEBUG_DEV, "[pixelpipe] output of `%s' taken from shared cache [%s]\n", module->op,
+               _pipe_type_to_str(pipe->type));
+      _pipe_count_reused(pipe, pos);
+      _pipe_report(pipe, module, roi_out, roi_out, "shared", FALSE, FALSE, 0.0, 0, bufsize);
+      return 0;
+    }
+    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    *output = NULL;
+    *out_format = format;
+  }
+
+  // 2c) the output of expensive early modules might be found on disk from an earlier session
+  const gboolean disk_checkpoint = module && dt_dev_pixelpipe_cache_disk_checkpoint(pipe, module)
+                                   && _disk_cache_usable(pipe, pos);
+  const uint64_t diskhash = disk_checkpoint ? dt_dev_pixelpipe_cache_disk_hash(pipe, hash) : 0;
+  if(disk_checkpoint && dt_dev_pixelpipe_cache_disk_available(diskhash))
+  {
+    dt_iop_buffer_dsc_t *const format = *out_format;
+    (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format);
+    if(*output && dt_dev_pixelpipe_cache_disk_read(diskhash, roi_out, *output, bufsize, *out_format))
+    {
+      dt_print(DT_DEBUG_DEV, "[pixelpipe] output of `%s' read from disk cache [%s]\n", module->op,
+               _pipe_type_to_str(pipe->type));
+      _pipe_count_reused(pipe, pos);
+      _pipe_report(pipe, module, roi_out, roi_out, "disk", FALSE, FALSE, 0.0, 0, bufsize);
+      return 0;
+    }
+    // no luck, process as usual
+    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+    *output = NULL;
+    *out_format = format;
+  }
+
   // 3) input -> output
   if(!modules)
   {
@@ -1157,6 +1955,14 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       {
         *output = pipe->input;
       }
+      else if(roi_out->scale == 1.0f && roi_out->x == 0 && pipe->iwidth == roi_out->width && roi_out->y >= 0
+              && roi_out->y + roi_out->height <= pipe->iheight
+              && ((size_t)bpp * roi_out->y * pipe->iwidth) % 64 == 0)
+      {
+        // full rows are contiguous in the input as well, the first module reads them right from there
+        // instead of a copy in a cache line. modules expect their input aligned like anything we allocate.
+        *output = ((char *)pipe->input) + (size_t)bpp * roi_out->y * pipe->iwidth;
+      }
       else if(dt_dev_pixelpipe_cache_get(&(pipe->cache), basichash, hash, bufsize, output, out_format))
       {
         if(roi_in.scale == 1.0f)
@@ -1198,6 +2004,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 
     dt_show_times_f(&start, "[dev_pixelpipe]", "initing base buffer [%s]", _pipe_type_to_str(pipe->type));
+    dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, dt_get_wtime() - start.clock);
 
     if(dt_atomic_get_int(&pipe->shutdown))
       return 1;
@@ -1213,6 +2020,15 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     return 1;
   }
   module->modify_roi_in(module, piece, roi_out, &roi_in);
+  if(darktable.unmuted & DT_DEBUG_PERF) _pipe_check_roi_growth(pipe, module, piece, roi_out, &roi_in);
+
+  // point-wise modules might be processed together with their predecessors
+  if(_pointwise_fusable(pipe, dev, module, piece, roi_out))
+  {
+    const int err = _process_pointwise_run(pipe, dev, output, out_format, roi_out, modules, pieces, pos,
+                                           basichash, hash, bufsize);
+    if(err >= 0) return err;
+  }
 
   // recurse to get actual data of input buffer
 
@@ -1264,6 +2080,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
   dt_times_t start;
   dt_get_times(&start);
+  const double trace_begin = dt_trace_begin();
 
   dt_pixelpipe_flow_t pixelpipe_flow = (PIXELPIPE_FLOW_NONE | PIXELPIPE_FLOW_HISTOGRAM_NONE);
 
@@ -1360,6 +2177,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0)
   {
     int success_opencl = TRUE;
+    if(_pipe_report_enabled())
+      dt_opencl_events_set_module(pipe->devid, _pipe_type_to_str(pipe->type), module->op, module->multi_priority);
     dt_iop_colorspace_type_t input_cst_cl = input_format->cst;
 
     /* if input is on gpu memory only, remember this fact to later take appropriate action */
@@ -1368,7 +2187,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     /* pre-check if there is enough space on device for non-tiled processing */
     const gboolean fits_on_device = dt_opencl_image_fits_device(pipe->devid, MAX(roi_in.width, roi_out->width),
                                                                 MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                                                tiling.factor_cl, tiling.overhead);
+                                                                dt_tiling_refined_factor(module, TRUE, tiling.factor_cl),
+                                                                tiling.overhead);
 
     /* general remark: in case of opencl errors within modules or out-of-memory on GPU, we transparently
        fall back to the respective cpu module and continue in pixelpipe. If we encounter errors we set
@@ -1392,7 +2212,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       // cl_mem_input, *cl_mem_output);
       // fprintf(stderr, "[opencl_pixelpipe 1] module '%s'\n", module->op);
 
-      if(fits_on_device)
+      /* big exports may rather be tiled over several devices */
+      if(fits_on_device && !(piece->process_tiling_ready
+                             && dt_tiling_cl_spread_over_devices(module, piece, &roi_in, roi_out)))
       {
         /* image is small enough -> try to directly process entire image with opencl */
 
@@ -1433,7 +2255,14 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         /* try to allocate GPU memory for output */
         if(success_opencl)
         {
-          *cl_mem_output = dt_opencl_alloc_device(pipe->devid, roi_out->width, roi_out->height, bpp);
+          // the next module wants the data on the host anyway: if the device works on host memory, let it
+          // write there directly. not if histogram or picker borrow the host buffer in the meantime
+          if(piece->cl_output_to_host && dt_opencl_unified_memory(pipe->devid)
+             && !(piece->request_histogram & DT_REQUEST_ON) && !_request_color_pick(pipe, dev, module))
+            *cl_mem_output = dt_opencl_alloc_device_use_host_pointer(pipe->devid, roi_out->width, roi_out->height,
+                                                                     bpp, roi_out->width * bpp, *output);
+          if(*cl_mem_output == NULL)
+            *cl_mem_output = dt_opencl_alloc_device(pipe->devid, roi_out->width, roi_out->height, bpp);
           if(*cl_mem_output == NULL)
           {
             dt_print(DT_DEBUG_OPENCL, "[opencl_pixelpipe] couldn't allocate output buffer for module %s\n",
@@ -1491,8 +2320,17 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         /* now call process_cl of module; module should emit meaningful messages in case of error */
         if(success_opencl)
         {
+          size_t cl_base = 0;
+          const gboolean measure = dt_opencl_memory_measure_begin(pipe->devid, &cl_base);
           success_opencl
               = module->process_cl(module, piece, cl_mem_input, *cl_mem_output, &roi_in, roi_out);
+          if(measure && success_opencl)
+            dt_tiling_record_peak(module, TRUE,
+                                  (size_t)MAX(roi_in.width, roi_out->width) * MAX(roi_in.height, roi_out->height)
+                                      * MAX(in_bpp, bpp),
+                                  (size_t)roi_in.width * roi_in.height * in_bpp
+                                      + (size_t)roi_out->width * roi_out->height * bpp
+                                      + dt_opencl_memory_measure_end(pipe->devid, cl_base));
           pixelpipe_flow |= (PIXELPIPE_FLOW_PROCESSED_ON_GPU);
           pixelpipe_flow &= ~(PIXELPIPE_FLOW_PROCESSED_ON_CPU | PIXELPIPE_FLOW_PROCESSED_WITH_TILING);
 
@@ -1899,6 +2737,19 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     return 1;
 #endif // HAVE_OPENCL
 
+  // the module might have given up half way, don't keep its output
+  if(dt_dev_pixelpipe_cancelled(pipe))
+  {
+    dt_print(DT_DEBUG_DEV, "[pixelpipe] run cancelled after `%s' [%s]\n", module->op,
+             _pipe_type_to_str(pipe->type));
+    dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+#ifdef HAVE_OPENCL
+    dt_opencl_release_mem_object(*cl_mem_output);
+    *cl_mem_output = NULL;
+#endif
+    return 1;
+  }
+
   char histogram_log[32] = "";
   if(!(pixelpipe_flow & PIXELPIPE_FLOW_HISTOGRAM_NONE))
   {
@@ -1925,15 +2776,58 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   g_free(module_label);
   module_label = NULL;
 
+  dt_trace_complete("pixelpipe", module->op, trace_begin,
+                    "\"pipe\":\"%s\",\"instance\":%d,\"width\":%d,\"height\":%d,\"device\":\"%s\",\"tiling\":%s",
+                    _pipe_type_to_str(pipe->type), module->multi_priority, roi_out->width, roi_out->height,
+                    pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU ? "GPU" : "CPU",
+                    pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING ? "true" : "false");
+
+  // remember how expensive this output was, the cache prefers to keep those
+  dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), *output, dt_get_wtime() - start.clock);
+  _pipe_report(pipe, module, &roi_in, roi_out, "miss", pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU,
+               pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING, dt_get_wtime() - start.clock,
+               in_bpp * roi_in.width * roi_in.height, bufsize);
+  dt_opencl_throughput_record((pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) ? pipe->devid : -1, module->op,
+                              (size_t)roi_out->width * roi_out->height, dt_get_wtime() - start.clock);
+  pipe->nodes_recomputed++;
+  if(pipe->dirty_from >= 0 && pos - 1 < pipe->dirty_from)
+    dt_print(DT_DEBUG_PERF, "[pixelpipe] `%s' recomputed although upstream of the changed node [%s]\n",
+             module->op, _pipe_type_to_str(pipe->type));
+
   // in case we get this buffer from the cache in the future, cache some stuff:
   **out_format = piece->dsc_out = pipe->dsc;
 
-  if(module == darktable.develop->gui_module)
+  // offer expensive outputs to the other pipe, copying cheap ones around isn't worth it
+  const gboolean share = shared && dt_get_wtime() - start.clock > 0.01;
+
+  // keep the output of checkpoint modules for later sessions
+  if(disk_checkpoint || share)
+  {
+    gboolean on_host = TRUE;
+#ifdef HAVE_OPENCL
+    if(*cl_mem_output != NULL)
+      on_host = dt_opencl_copy_device_to_host(pipe->devid, *output, *cl_mem_output, roi_out->width,
+                                              roi_out->height, bpp) == CL_SUCCESS;
+#endif
+    if(on_host && share)
+      dt_dev_pixelpipe_cache_shared_put(sharedkey, *output, bufsize, *out_format, pipe->cache.memlimit / 2);
+    if(on_host && disk_checkpoint)
+      dt_dev_pixelpipe_cache_disk_write(diskhash, roi_out, *output, bufsize, *out_format);
+  }
+
+  if(module == darktable.develop->gui_module || pos - 1 == pipe->dirty_from)
   {
     // give the input buffer to the currently focused plugin more weight.
     // the user is likely to change that one soon, so keep it in cache.
+    // the same goes for the module changed last, it's likely changed again.
     dt_dev_pixelpipe_cache_reweight(&(pipe->cache), input);
   }
+  else if(input != *output && !(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU)
+          && _half_float_storage(pipe, module))
+  {
+    // the input is consumed, late display referred data keeps well enough in half floats until it's needed again
+    dt_dev_pixelpipe_cache_compact(&(pipe->cache), input);
+  }
 
   // warn on NaN or infinity
 #ifndef _DEBUG
@@ -2020,6 +2914,23 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   {
     return 1;
   }
+  if(dev->gui_attached && !dev->gui_leaving
+     && pipe == dev->pipe
+     && dev->preview_downsampling < 1.0f
+     && (strcmp(module->op, "gamma") == 0)
+     && roi_in.x == 0 && roi_in.y == 0
+     && roi_in.width >= (int)(pipe->processed_width * roi_in.scale) - 1
+     && roi_in.height >= (int)(pipe->processed_height * roi_in.scale) - 1)
+  {
+    // the full pipe shows the whole image: it gives the scopes more than the reduced preview, which still
+    // feeds them first so that they never wait for this pipe
+    const dt_iop_order_iccprofile_info_t *const display_profile
+      = dt_ioppr_add_profile_info_to_list(dev, darktable.color_profiles->display_type,
+                                          darktable.color_profiles->display_filename, INTENT_RELATIVE_COLORIMETRIC);
+    darktable.lib->proxy.histogram.process(darktable.lib->proxy.histogram.module, input,
+                                           roi_in.width, roi_in.height,
+                                           display_profile, dt_ioppr_get_histogram_profile_info(dev));
+  }
   if(dev->gui_attached && !dev->gui_leaving
      && pipe == dev->preview_pipe
      && (strcmp(module->op, "gamma") == 0)) // only gamma provides meaningful RGB data
@@ -2140,10 +3051,48 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
+// what the pipe holds between runs: its cache lines and the idle scratch buffers
+static void _pipe_memory_claim(dt_dev_pixelpipe_t *pipe)
+{
+  size_t held = pipe->cache.allmem;
+  for(int k = 0; k < DT_DEV_PIXELPIPE_SCRATCH_SLOTS; k++) held += pipe->scratch[k].size;
+  dt_memory_budget_claim(pipe, _pipe_type_to_str(pipe->type), held);
+}
+
+// a run has to make do with what the other pipes leave of the memory budget: the cache gets a smaller quota
+// and tiling sets in earlier (see dt_tiling_piece_fits_host_memory()). exports and thumbnails also wait a bit
+// for the others to give memory back, the darkroom pipes never block.
+static void _pipe_memory_plan(dt_dev_pixelpipe_t *pipe, const int width, const int height)
+{
+  // input and output of a module at the larger of the pipe's ends, in floats
+  const size_t pixels = MAX((size_t)pipe->iwidth * pipe->iheight, (size_t)width * height);
+  const size_t needed = 2 * 4 * sizeof(float) * pixels + pipe->cache.allmem;
+  if(pipe->type & (DT_DEV_PIXELPIPE_EXPORT | DT_DEV_PIXELPIPE_THUMBNAIL))
+  {
+    if(!dt_memory_budget_wait(pipe, needed, 10.0))
+      dt_print(DT_DEBUG_MEMORY, "[pixelpipe_process] [%s] starts beyond the memory budget\n",
+               _pipe_type_to_str(pipe->type));
+  }
+  // everybody else sees what the run will need until it's done
+  dt_memory_budget_claim(pipe, _pipe_type_to_str(pipe->type), needed);
+
+  if(pipe->cache_quota)
+  {
+    const size_t available = dt_memory_budget_available(pipe);
+    pipe->cache.memlimit = CLAMP(available / 2, MAX(pipe->cache_quota / 8, 1), pipe->cache_quota);
+    if(pipe->cache.memlimit < pipe->cache_quota)
+      dt_print(DT_DEBUG_MEMORY, "[pixelpipe_process] [%s] cache quota lowered to %luMB of %luMB\n",
+               _pipe_type_to_str(pipe->type), pipe->cache.memlimit / 1024lu / 1024lu,
+               pipe->cache_quota / 1024lu / 1024lu);
+  }
+}
+
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
                              float scale)
 {
   pipe->processing = 1;
+  // share the cores with the other pipes running right now instead of each taking all of them
+  dt_omp_share_begin();
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
                                        : -1; // try to get/lock opencl resource
@@ -2151,13 +3100,22 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
   dt_print(DT_DEBUG_OPENCL, "[pixelpipe_process] [%s] using device %d\n", _pipe_type_to_str(pipe->type),
            pipe->devid);
 
+  _pipe_memory_plan(pipe, width, height);
+
   if(darktable.unmuted & DT_DEBUG_MEMORY)
   {
     fprintf(stderr, "[memory] before pixelpipe process\n");
     dt_print_mem_usage();
+    dt_memory_budget_report();
   }
 
-  if(pipe->devid >= 0) dt_opencl_events_reset(pipe->devid);
+  if(pipe->devid >= 0) pipe->devid = _pixelpipe_rebalance_opencl(pipe, dev);
+
+  if(pipe->devid >= 0)
+  {
+    dt_opencl_events_reset(pipe->devid);
+    _pixelpipe_plan_opencl(pipe, dev);
+  }
 
   dt_iop_roi_t roi = (dt_iop_roi_t){ x, y, width, height, scale };
   // printf("pixelpipe homebrew process start\n");
@@ -2186,14 +3144,21 @@ restart:
 
   void *buf = NULL;
   void *cl_mem_out = NULL;
+  pipe->nodes_recomputed = pipe->nodes_reused = 0;
 
   dt_iop_buffer_dsc_t _out_format = { 0 };
   dt_iop_buffer_dsc_t *out_format = &_out_format;
 
   // run pixelpipe recursively and get error status
+  dt_dev_pixelpipe_t *const caller_pipe = _current_pipe;
+  _current_pipe = pipe;
   const int err =
     dt_dev_pixelpipe_process_rec_and_backcopy(pipe, dev, &buf, &cl_mem_out, &out_format, &roi, modules,
                                               pieces, pos);
+  _current_pipe = caller_pipe;
+  // keep what the next run will most likely ask for again, but not without bounds
+  _scratch_trim(pipe, dt_memory_budget_available(pipe) / 4);
+  _pipe_memory_claim(pipe);
 
   // get status summary of opencl queue by checking the eventlist
   const int oclerr = (pipe->devid >= 0) ? (dt_opencl_events_flush(pipe->devid, 1) != 0) : 0;
@@ -2205,6 +3170,8 @@ restart:
   {
     // Well, there were errors -> we might need to free an invalid opencl memory object
     dt_opencl_release_mem_object(cl_mem_out);
+    // the device may have run out of memory, don't keep any aside for reuse
+    dt_opencl_flush_pool(pipe->devid);
     dt_opencl_unlock_device(pipe->devid); // release opencl resource
     dt_pthread_mutex_lock(&pipe->busy_mutex);
     pipe->opencl_enabled = 0; // disable opencl for this pipe
@@ -2247,10 +3214,15 @@ restart:
   // ... and in case of other errors ...
   if(err)
   {
+    dt_omp_share_end();
     pipe->processing = 0;
     return 1;
   }
 
+  dt_print(DT_DEBUG_PERF, "[pixelpipe] %d nodes recomputed, %d reused from cache [%s]\n",
+           pipe->nodes_recomputed, pipe->nodes_reused, _pipe_type_to_str(pipe->type));
+  _pipe_dirty_clear(pipe);
+
   // terminate
   dt_pthread_mutex_lock(&pipe->backbuf_mutex);
   pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, 0);
@@ -2277,6 +3249,7 @@ restart:
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
   // printf("pixelpipe homebrew process end\n");
+  dt_omp_share_end();
   pipe->processing = 0;
   return 0;
 }
@@ -2325,7 +3298,60 @@ void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop
   dt_pthread_mutex_unlock(&pipe->busy_mutex);
 }
 
-float *dt_dev_get_raster_mask(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *raster_mask_source,
+static gboolean _raster_mask_piece_active(const dt_dev_pixelpipe_iop_t *module)
+{
+  return module->enabled
+         && !(module->module->dev->gui_module && module->module->dev->gui_module != module->module
+              && (module->module->dev->gui_module->operation_tags_filter() & module->module->operation_tags()));
+}
+
+static gboolean _raster_mask_piece_distorts(const dt_dev_pixelpipe_iop_t *module)
+{
+  return _raster_mask_piece_active(module)
+         && module->module->distort_mask
+         && !(!strcmp(module->module->op, "finalscale") // hack against pipes not using finalscale
+              && module->processed_roi_in.width == 0
+              && module->processed_roi_in.height == 0);
+}
+
+static uint64_t _raster_mask_roi_hash(uint64_t hash, const dt_iop_roi_t *roi)
+{
+  const int v[4] = { roi->x, roi->y, roi->width, roi->height };
+  for(int k = 0; k < 4; k++) hash = ((hash << 5) + hash) ^ v[k];
+  const float s = roi->scale;
+  uint32_t bits;
+  memcpy(&bits, &s, sizeof(bits));
+  return ((hash << 5) + hash) ^ bits;
+}
+
+void dt_dev_pixelpipe_raster_mask_changed(dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece)
+{
+  for(int k = 0; k < DT_DEV_PIXELPIPE_RASTER_MASKS; k++)
+    if(pipe->raster_mask_cache[k].source == piece)
+      _raster_mask_cache_drop(&pipe->raster_mask_cache[k]);
+}
+
+// the distorting pieces between the source and the target, FALSE if the mask passes unchanged
+static gboolean _raster_mask_chain_hash(GList *first, const dt_iop_module_t *target_module, uint64_t *hash)
+{
+  *hash = 5381;
+  gboolean distorted = FALSE;
+  for(GList *iter = first; iter; iter = g_list_next(iter))
+  {
+    const dt_dev_pixelpipe_iop_t *module = (dt_dev_pixelpipe_iop_t *)iter->data;
+    if(_raster_mask_piece_distorts(module))
+    {
+      *hash = ((*hash << 5) + *hash) ^ module->hash;
+      *hash = _raster_mask_roi_hash(*hash, &module->processed_roi_in);
+      *hash = _raster_mask_roi_hash(*hash, &module->processed_roi_out);
+      distorted = TRUE;
+    }
+    if(module->module == target_module) break;
+  }
+  return distorted;
+}
+
+float *dt_dev_get_raster_mask(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *raster_mask_source,
                               const int raster_mask_id, const dt_iop_module_t *target_module,
                               gboolean *free_mask)
 {
@@ -2349,48 +3375,68 @@ float *dt_dev_get_raster_mask(const dt_dev_pixelpipe_t *pipe, const dt_iop_modul
     if(source_piece && source_piece->enabled) // there might be stale masks from disabled modules left over. don't use those!
     {
       raster_mask = g_hash_table_lookup(source_piece->raster_masks, GINT_TO_POINTER(raster_mask_id));
-      if(raster_mask)
+      uint64_t hash = 0;
+      if(raster_mask && _raster_mask_chain_hash(g_list_next(source_iter), target_module, &hash))
       {
+        // all targets behind the same distortions share one transformed mask
+        for(int k = 0; k < DT_DEV_PIXELPIPE_RASTER_MASKS; k++)
+        {
+          const dt_dev_pixelpipe_raster_mask_t *entry = &pipe->raster_mask_cache[k];
+          if(entry->buf && entry->source == source_piece && entry->id == raster_mask_id
+             && entry->mask == raster_mask && entry->hash == hash)
+            return entry->buf;
+        }
+
+        const float *const source_mask = raster_mask;
         for(GList *iter = g_list_next(source_iter); iter; iter = g_list_next(iter))
         {
           dt_dev_pixelpipe_iop_t *module = (dt_dev_pixelpipe_iop_t *)iter->data;
 
-          if(module->enabled
-             && !(module->module->dev->gui_module && module->module->dev->gui_module != module->module
-                  && (module->module->dev->gui_module->operation_tags_filter() & module->module->operation_tags())))
+          if(_raster_mask_piece_distorts(module))
           {
-            if(module->module->distort_mask
-              && !(!strcmp(module->module->op, "finalscale") // hack against pipes not using finalscale
-                    && module->processed_roi_in.width == 0
-                    && module->processed_roi_in.height == 0))
+            float *transformed_mask = dt_alloc_align_float((size_t)module->processed_roi_out.width
+                                                            * module->processed_roi_out.height);
+            if(!transformed_mask)
             {
-              float *transformed_mask = dt_alloc_align_float((size_t)module->processed_roi_out.width
-                                                              * module->processed_roi_out.height);
-              module->module->distort_mask(module->module,
-                                          module,
-                                          raster_mask,
-                                          transformed_mask,
-                                          &module->processed_roi_in,
-                                          &module->processed_roi_out);
               if(*free_mask) dt_free_align(raster_mask);
-              *free_mask = TRUE;
-              raster_mask = transformed_mask;
+              *free_mask = FALSE;
+              return NULL;
             }
-            else if(!module->module->distort_mask &&
-                    (module->processed_roi_in.width != module->processed_roi_out.width ||
-                     module->processed_roi_in.height != module->processed_roi_out.height ||
-                     module->processed_roi_in.x != module->processed_roi_out.x ||
-                     module->processed_roi_in.y != module->processed_roi_out.y))
-              fprintf(stderr, "FIXME: module `%s' changed the roi from %d x %d @ %d / %d to %d x %d | %d / %d but doesn't have "
-                     "distort_mask() implemented!\n", module->module->op, module->processed_roi_in.width,
-                     module->processed_roi_in.height, module->processed_roi_in.x, module->processed_roi_in.y,
-                     module->processed_roi_out.width, module->processed_roi_out.height, module->processed_roi_out.x,
-                     module->processed_roi_out.y);
+            module->module->distort_mask(module->module,
+                                        module,
+                                        raster_mask,
+                                        transformed_mask,
+                                        &module->processed_roi_in,
+                                        &module->processed_roi_out);
+            if(*free_mask) dt_free_align(raster_mask);
+            *free_mask = TRUE;
+            raster_mask = transformed_mask;
           }
+          else if(_raster_mask_piece_active(module) && !module->module->distort_mask &&
+                  (module->processed_roi_in.width != module->processed_roi_out.width ||
+                   module->processed_roi_in.height != module->processed_roi_out.height ||
+                   module->processed_roi_in.x != module->processed_roi_out.x ||
+                   module->processed_roi_in.y != module->processed_roi_out.y))
+            fprintf(stderr, "FIXME: module `%s' changed the roi from %d x %d @ %d / %d to %d x %d | %d / %d but doesn't have "
+                   "distort_mask() implemented!\n", module->module->op, module->processed_roi_in.width,
+                   module->processed_roi_in.height, module->processed_roi_in.x, module->processed_roi_in.y,
+                   module->processed_roi_out.width, module->processed_roi_out.height, module->processed_roi_out.x,
+                   module->processed_roi_out.y);
 
           if(module->module == target_module)
             break;
         }
+
+        // hand the result over to the pipe for the next targets
+        dt_dev_pixelpipe_raster_mask_t *entry = &pipe->raster_mask_cache[pipe->raster_mask_cache_next];
+        pipe->raster_mask_cache_next = (pipe->raster_mask_cache_next + 1) % DT_DEV_PIXELPIPE_RASTER_MASKS;
+        _raster_mask_cache_drop(entry);
+        entry->source = source_piece;
+        entry->id = raster_mask_id;
+        entry->mask = source_mask;
+        entry->hash = hash;
+        entry->buf = raster_mask;
+        *free_mask = FALSE;
       }
     }
   }
@@ -2402,6 +3448,52 @@ void dt_dev_clear_rawdetail_mask(dt_dev_pixelpipe_t *pipe)
 {
   if(pipe->rawdetail_mask_data) dt_free_align(pipe->rawdetail_mask_data);
   pipe->rawdetail_mask_data = NULL;
+  pipe->rawdetail_mask_downscale = 1;
+}
+
+// exports always keep the detail mask at full resolution
+static int _rawdetail_mask_downscale(const dt_dev_pixelpipe_t *pipe)
+{
+  if(pipe->type & DT_DEV_PIXELPIPE_EXPORT) return 1;
+  if(dt_conf_is_equal("plugins/darkroom/masks/detail_resolution", "quarter")) return 4;
+  if(dt_conf_is_equal("plugins/darkroom/masks/detail_resolution", "half")) return 2;
+  return 1;
+}
+
+// takes ownership of the full resolution mask and keeps it at the configured resolution
+static void _rawdetail_mask_store(dt_dev_pixelpipe_t *pipe, float *mask, const dt_iop_roi_t *const roi_in)
+{
+  const int factor = _rawdetail_mask_downscale(pipe);
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+  float *small = factor > 1 ? dt_alloc_align_float((size_t)((width + factor - 1) / factor)
+                                                   * ((height + factor - 1) / factor))
+                            : NULL;
+  if(small)
+  {
+    dt_masks_downsample_mask(mask, small, width, height, factor);
+    dt_free_align(mask);
+    mask = small;
+  }
+  pipe->rawdetail_mask_data = mask;
+  pipe->rawdetail_mask_downscale = small ? factor : 1;
+  memcpy(&pipe->rawdetail_mask_roi, roi_in, sizeof(dt_iop_roi_t));
+}
+
+float *dt_dev_get_rawdetail_mask(const dt_dev_pixelpipe_t *pipe, gboolean *free_mask)
+{
+  *free_mask = FALSE;
+  if(!pipe->rawdetail_mask_data || pipe->rawdetail_mask_downscale <= 1) return pipe->rawdetail_mask_data;
+
+  const int width = pipe->rawdetail_mask_roi.width;
+  const int height = pipe->rawdetail_mask_roi.height;
+  float *mask = dt_alloc_align_float((size_t)width * height);
+  if(mask)
+  {
+    dt_masks_upsample_mask(pipe->rawdetail_mask_data, mask, width, height, pipe->rawdetail_mask_downscale);
+    *free_mask = TRUE;
+  }
+  return mask;
 }
 
 gboolean dt_dev_write_rawdetail_mask(dt_dev_pixelpipe_iop_t *piece, float *const rgb, const dt_iop_roi_t *const roi_in, const int mode)
@@ -2429,9 +3521,6 @@ gboolean dt_dev_write_rawdetail_mask(dt_dev_pixelpipe_iop_t *piece, float *const
   float *tmp = dt_alloc_align_float((size_t)width * height);
   if((mask == NULL) || (tmp == NULL)) goto error;
 
-  p->rawdetail_mask_data = mask;
-  memcpy(&p->rawdetail_mask_roi, roi_in, sizeof(dt_iop_roi_t));
-
   dt_aligned_pixel_t wb = { piece->pipe->dsc.temperature.coeffs[0],
                             piece->pipe->dsc.temperature.coeffs[1],
                             piece->pipe->dsc.temperature.coeffs[2] };
@@ -2441,7 +3530,8 @@ gboolean dt_dev_write_rawdetail_mask(dt_dev_pixelpipe_iop_t *piece, float *const
   }
   dt_masks_calc_rawdetail_mask(rgb, mask, tmp, width, height, wb);
   dt_free_align(tmp);
-  if(info) fprintf(stderr, " done\n");
+  _rawdetail_mask_store(p, mask, roi_in);
+  if(info) fprintf(stderr, " done, 1/%d\n", p->rawdetail_mask_downscale);
   return FALSE;
 
   error:
@@ -2522,12 +3612,11 @@ gboolean dt_dev_write_rawdetail_mask_cl(dt_dev_pixelpipe_iop_t *piece, cl_mem in
     if(err != CL_SUCCESS) goto error;
   }
 
-  p->rawdetail_mask_data = mask;
-  memcpy(&p->rawdetail_mask_roi, roi_in, sizeof(dt_iop_roi_t));
+  _rawdetail_mask_store(p, mask, roi_in);
 
   dt_opencl_release_mem_object(out);
   dt_opencl_release_mem_object(tmp);
-  if(info) fprintf(stderr, " done\n");
+  if(info) fprintf(stderr, " done, 1/%d\n", p->rawdetail_mask_downscale);
   return FALSE;
 
   error:
@@ -59,6 +59,7 @@ typedef struct dt_dev_pixelpipe_iop_t
   float iscale;        // input actually just downscaled buffer? iscale*iwidth = actual width
   int iwidth, iheight; // width and height of input buffer
   uint64_t hash;       // hash of params and enabled.
+  gboolean dirty;      // params or enabled state changed with the last synch
   int bpc;             // bits per channel, 32 means float
   int colors;          // how many colors per pixel
   dt_iop_roi_t buf_in,
@@ -66,6 +67,8 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_roi_t processed_roi_in, processed_roi_out; // the actual roi that was used for processing the piece
   int process_cl_ready;       // set this to 0 in commit_params to temporarily disable the use of process_cl
   int process_tiling_ready;   // set this to 0 in commit_params to temporarily disable tiling
+  gboolean identity;          // set this in commit_params if the params are a no-op, the pipe then forwards the input
+  gboolean cl_output_to_host; // planned: runs on the device and the next module (or the end of the pipe) wants the host
 
   // the following are used internally for caching:
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
@@ -83,6 +86,48 @@ typedef enum dt_dev_pixelpipe_change_t
   DT_DEV_PIPE_ZOOMED = 1 << 3 // zoom event, preview pipe does not need changes
 } dt_dev_pixelpipe_change_t;
 
+#define DT_DEV_PIXELPIPE_SCRATCH_SLOTS 16
+
+// a buffer the pipe keeps around for the temporaries of the modules' process(),
+// see dt_dev_pixelpipe_scratch_alloc()
+typedef struct dt_dev_pixelpipe_scratch_t
+{
+  void *buf;
+  size_t size;
+  gboolean in_use;
+} dt_dev_pixelpipe_scratch_t;
+
+// the composed distortion of all geometry modules of a pipe, sampled on grids over the input image and over
+// its distorted bounding box. dt_dev_distort_transform() and dt_dev_distort_backtransform() interpolate in it
+// instead of walking the modules. it is rebuilt when the geometry modules change.
+typedef struct dt_dev_distort_grid_t
+{
+  uint64_t hash;          // geometry the grids were sampled with
+  uint64_t pending_hash;  // geometry of the points transformed without grid so far
+  size_t pending_points;
+  // forward grid, spacing step, from the origin of the input image
+  int fw, fh;
+  float fstep;
+  float *forw;
+  // backward grid, spacing bstep, from bx / by
+  int bw, bh;
+  float bx, by, bstep;
+  float *back;
+} dt_dev_distort_grid_t;
+
+#define DT_DEV_PIXELPIPE_RASTER_MASKS 4
+
+// a raster mask passed through the distorting modules after its source, shared by all the consumers
+// seeing the same chain of distortions, see dt_dev_get_raster_mask()
+typedef struct dt_dev_pixelpipe_raster_mask_t
+{
+  const void *source;  // the source piece
+  int id;              // the mask id in its raster_masks
+  const float *mask;   // the undistorted mask it was made from
+  uint64_t hash;       // hash of the distorting pieces and their regions of interest
+  float *buf;
+} dt_dev_pixelpipe_raster_mask_t;
+
 /**
  * this encapsulates the pixelpipe.
  * a develop module will need several of these:
@@ -95,6 +140,8 @@ typedef struct dt_dev_pixelpipe_t
   dt_dev_pixelpipe_cache_t cache;
   // set to non-zero in order to obsolete old cache entries on next pixelpipe run
   int cache_obsolete;
+  // memory budget the cache was set up with, it gets less while other pipes hold much. 0 for fixed lines
+  size_t cache_quota;
   // input buffer
   float *input;
   // width and height of input buffer
@@ -135,6 +182,8 @@ typedef struct dt_dev_pixelpipe_t
   // as we have to scale the mask later ke keep roi at that stage
   float *rawdetail_mask_data;
   struct dt_iop_roi_t rawdetail_mask_roi;
+  // rawdetail_mask_data may be kept box averaged down by this factor, see dt_dev_get_rawdetail_mask()
+  int rawdetail_mask_downscale;
   int want_detail_mask;
 
   int output_imgid;
@@ -142,6 +191,8 @@ typedef struct dt_dev_pixelpipe_t
   int processing;
   // shutting down?
   dt_atomic_int shutdown;
+  // result of the running process call superseded by a newer change?
+  dt_atomic_int cancel;
   // opencl enabled for this pixelpipe?
   int opencl_enabled;
   // opencl error detected?
@@ -173,6 +224,23 @@ typedef struct dt_dev_pixelpipe_t
   GList *forms;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
+  // position of the first node changed by the last synch, -1 if none. all nodes before it
+  // keep their hashes and are taken from cache.
+  int dirty_from;
+  // statistics of the last process call, reported with -d perf
+  int nodes_recomputed, nodes_reused;
+  // per module totals of the structured -d perf report, summarized at cleanup
+  GHashTable *report;
+  // scratch buffers recycled across the modules and the runs of this pipe. only touched by the thread
+  // running the pipe, so they need no lock.
+  dt_dev_pixelpipe_scratch_t scratch[DT_DEV_PIXELPIPE_SCRATCH_SLOTS];
+  // bytes of scratch buffers handed out and the most at any time, for dt_tiling_record_peak()
+  size_t scratch_in_use, scratch_peak;
+  // distorted raster masks handed out by dt_dev_get_raster_mask(), replaced round robin
+  dt_dev_pixelpipe_raster_mask_t raster_mask_cache[DT_DEV_PIXELPIPE_RASTER_MASKS];
+  int raster_mask_cache_next;
+  // composed distortion for the gui, see dt_dev_distort_transform()
+  dt_dev_distort_grid_t distort_grid;
 } dt_dev_pixelpipe_t;
 
 struct dt_develop_t;
@@ -192,7 +260,8 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 // distortions)
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
 // inits the pixelpipe with given cacheline size and number of entries.
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// a non-zero memlimit gives the cache a byte budget, entries is the maximum number of lines then.
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memlimit);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
@@ -213,6 +282,14 @@ void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe);
 // wrapper for cleanup_nodes, create_nodes, synch_all and synch_top, decides upon changed event which one to
 // take on. also locks dev->history_mutex.
 void dt_dev_pixelpipe_change(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
+// tells the running process call that its result isn't wanted anymore, it stops as soon as possible
+// and returns failure. cleared by dt_dev_pixelpipe_change().
+void dt_dev_pixelpipe_cancel(dt_dev_pixelpipe_t *pipe);
+// to be polled by long running modules between steps, they may return early with incomplete output then.
+gboolean dt_dev_pixelpipe_cancelled(dt_dev_pixelpipe_t *pipe);
+// appends one json line to the -d perf report file (pixelpipe/report_file), if there is one.
+// used by other parts of the pipe, e.g. the opencl profiling, so that everything ends up in one file.
+void dt_dev_pixelpipe_report_write(const char *line);
 // cleanup all nodes except clean input/output
 void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe);
 // sync with develop_t history stack from scratch (new node added, have to pop old ones)
@@ -242,13 +319,30 @@ void dt_dev_pixelpipe_add_node(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *de
 void dt_dev_pixelpipe_remove_node(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int n);
 
 // helper function to pass a raster mask through a (so far) processed pipe
-float *dt_dev_get_raster_mask(const dt_dev_pixelpipe_t *pipe, const struct dt_iop_module_t *raster_mask_source,
+// the pipe running process() of a module on the calling thread, NULL outside of it
+dt_dev_pixelpipe_t *dt_dev_pixelpipe_current(void);
+// get a 64 byte aligned buffer of at least size bytes from the scratch arena of the pipe. the contents
+// are undefined. must be given back with dt_dev_pixelpipe_scratch_free() before process() returns.
+void *dt_dev_pixelpipe_scratch_alloc(dt_dev_pixelpipe_t *pipe, const size_t size);
+// give a buffer back to the arena. buffers not coming from it are freed with dt_free_align().
+void dt_dev_pixelpipe_scratch_free(dt_dev_pixelpipe_t *pipe, void *buf);
+// free the scratch buffers export pipes passed on for the next image, at the end of an export job
+void dt_dev_pixelpipe_scratch_flush_parked(void);
+
+// the returned mask is owned by the pipe unless free_mask is set. distorted masks are kept by the pipe
+// and shared by all targets behind the same distortions, until the source publishes a new mask.
+float *dt_dev_get_raster_mask(dt_dev_pixelpipe_t *pipe, const struct dt_iop_module_t *raster_mask_source,
                               const int raster_mask_id, const struct dt_iop_module_t *target_module,
                               gboolean *free_mask);
+// to be called by a module replacing or removing a mask in piece->raster_masks
+void dt_dev_pixelpipe_raster_mask_changed(dt_dev_pixelpipe_t *pipe, const struct dt_dev_pixelpipe_iop_t *piece);
 // some helper functions related to the details mask interface
 void dt_dev_clear_rawdetail_mask(dt_dev_pixelpipe_t *pipe);
 
 gboolean dt_dev_write_rawdetail_mask(dt_dev_pixelpipe_iop_t *piece, float *const rgb, const dt_iop_roi_t *const roi_in, const int mode);
+// the raw detail mask at the size of rawdetail_mask_roi, interpolated up if it is kept at a lower resolution.
+// free_mask tells if the caller has to free the result.
+float *dt_dev_get_rawdetail_mask(const dt_dev_pixelpipe_t *pipe, gboolean *free_mask);
 #ifdef HAVE_OPENCL
 gboolean dt_dev_write_rawdetail_mask_cl(dt_dev_pixelpipe_iop_t *piece, cl_mem in, const dt_iop_roi_t *const roi_in, const int mode);
 #endif
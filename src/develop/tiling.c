@@ -18,12 +18,15 @@
 
 
 #include "develop/tiling.h"
+#include "common/atomic.h"
 #include "common/opencl.h"
+#include "common/resource_limits.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/pixelpipe.h"
 
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -74,6 +77,12 @@ static inline int _max(int a, int b)
   return a > b ? a : b;
 }
 
+// host memory the pipe running on this thread may use, what the others leave of the budget
+static inline size_t _host_memory_available(void)
+{
+  return dt_memory_budget_available(dt_dev_pixelpipe_current());
+}
+
 
 static inline int _align_up(int n, int a)
 {
@@ -536,12 +545,65 @@ static int _nm_fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_d
 
 
 
+/* estimate oroi directly by sending points along the borders of iroi through the module's distortion and
+   taking their bounding box. the distortions of lens correction, perspective, liquify etc are smooth along
+   the borders, so this mostly hits within delta and saves the search. a plausible estimate which misses is
+   still left in oroi as the start of the search. */
+static gboolean _distort_fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                                 const dt_iop_roi_t *iroi, dt_iop_roi_t *oroi, int delta)
+{
+#define DT_TILING_BORDER_STEPS 16
+  float points[2 * 4 * DT_TILING_BORDER_STEPS];
+
+  // the points are in full resolution coordinates of the pipe
+  const float x0 = iroi->x / iroi->scale, y0 = iroi->y / iroi->scale;
+  const float x1 = (iroi->x + iroi->width) / iroi->scale, y1 = (iroi->y + iroi->height) / iroi->scale;
+  for(int i = 0; i < DT_TILING_BORDER_STEPS; i++)
+  {
+    const float t = (float)i / DT_TILING_BORDER_STEPS;
+    float *p = points + 8 * i;
+    p[0] = x0 + t * (x1 - x0); p[1] = y0; // top
+    p[2] = x1; p[3] = y0 + t * (y1 - y0); // right
+    p[4] = x1 - t * (x1 - x0); p[5] = y1; // bottom
+    p[6] = x0; p[7] = y1 - t * (y1 - y0); // left
+  }
+  if(!self->distort_transform(self, piece, points, 4 * DT_TILING_BORDER_STEPS)) return FALSE;
+
+  float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+  for(int i = 0; i < 4 * DT_TILING_BORDER_STEPS; i++)
+  {
+    if(!isfinite(points[2 * i]) || !isfinite(points[2 * i + 1])) return FALSE;
+    min_x = fminf(min_x, points[2 * i]);
+    max_x = fmaxf(max_x, points[2 * i]);
+    min_y = fminf(min_y, points[2 * i + 1]);
+    max_y = fmaxf(max_y, points[2 * i + 1]);
+  }
+#undef DT_TILING_BORDER_STEPS
+
+  dt_iop_roi_t estimate = *oroi;
+  estimate.x = floorf(min_x * oroi->scale);
+  estimate.y = floorf(min_y * oroi->scale);
+  estimate.width = ceilf(max_x * oroi->scale) - estimate.x;
+  estimate.height = ceilf(max_y * oroi->scale) - estimate.y;
+  if(estimate.width <= 0 || estimate.height <= 0) return FALSE;
+
+  *oroi = estimate;
+  dt_iop_roi_t iroi_probe = *iroi;
+  self->modify_roi_in(self, piece, oroi, &iroi_probe);
+  return abs((int)iroi_probe.x - (int)iroi->x) <= delta && abs((int)iroi_probe.y - (int)iroi->y) <= delta
+         && abs((int)iroi_probe.width - (int)iroi->width) <= delta
+         && abs((int)iroi_probe.height - (int)iroi->height) <= delta;
+}
+
 /* find a matching oroi_full by probing start value of oroi and get corresponding input roi into iroi_probe.
-   We search in two steps. first by a simplicistic iterative search which will succeed in most cases.
+   The module's distortion mostly gives it right away, if not we search in two steps. first by a
+   simplicistic iterative search which will succeed in most cases.
    If this does not converge, we do a downhill simplex (nelder-mead) fitting */
 static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                     const dt_iop_roi_t *iroi, dt_iop_roi_t *oroi, int delta, int iter)
 {
+  if(_distort_fit_output_to_input_roi(self, piece, iroi, oroi, delta)) return TRUE;
+
   dt_iop_roi_t iroi_probe = *iroi;
   dt_iop_roi_t save_oroi = *oroi;
 
@@ -579,14 +641,297 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
 }
 
 
+/* one tile of the cpu tiling: the rois handed to process() and where its good part goes */
+typedef struct _cpu_tile_t
+{
+  dt_iop_roi_t iroi, oroi;
+  size_t ioffs;            // of the tile's input in ivoid
+  size_t ooffs;            // of the tile's good part in ovoid
+  int origin_x, origin_y;  // of the good part in the tile's output
+  int good_wd, good_ht;
+} _cpu_tile_t;
+
+typedef struct _cpu_tiles_t
+{
+  struct dt_iop_module_t *self;
+  struct dt_dev_pixelpipe_iop_t *piece;
+  const void *ivoid;
+  void *ovoid;
+  const _cpu_tile_t *tiles;
+  int count;
+  int in_bpp, out_bpp;
+  size_t ipitch, opitch;
+  size_t in_size, out_size; // buffers large enough for any of the tiles
+  int omp_threads;
+  dt_job_t *job;
+  dt_atomic_int next;
+  dt_atomic_int failed;
+} _cpu_tiles_t;
+
+/* how many tiles process() may work on side by side, each with its own buffers and a slice of the
+   threads. memory for the tiles is divided by this before sizing them. */
+static int _cpu_concurrent_tiles(void)
+{
+#ifdef _OPENMP
+  const int requested = dt_conf_get_int("tiling_concurrent_tiles");
+  if(requested == 1) return 1;
+  // leave every tile at least two threads
+  const int count = MAX(1, omp_get_max_threads() / 2);
+  return requested > 1 ? MIN(count, requested) : count;
+#else
+  return 1;
+#endif
+}
+
+static void _process_cpu_tile(const _cpu_tiles_t *t, const _cpu_tile_t *tile, void *input, void *output)
+{
+  const int in_bpp = t->in_bpp;
+  const int out_bpp = t->out_bpp;
+  const size_t ipitch = t->ipitch;
+  const size_t opitch = t->opitch;
+  const char *const ivoid = (const char *)t->ivoid + tile->ioffs;
+  char *const ovoid = (char *)t->ovoid + tile->ooffs;
+  const size_t iwd = tile->iroi.width;
+  const size_t iht = tile->iroi.height;
+
+  /* prepare input tile buffer */
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(iht, in_bpp, ipitch, ivoid, iwd, input) \
+  schedule(static)
+#endif
+  for(size_t j = 0; j < iht; j++)
+    memcpy((char *)input + j * iwd * in_bpp, ivoid + j * ipitch, iwd * in_bpp);
+
+  /* call process() of module */
+  t->self->process(t->self, t->piece, input, output, &tile->iroi, &tile->oroi);
+
+  /* copy "good" part of tile to output buffer */
+  const size_t owd = tile->oroi.width;
+  const size_t origin_x = tile->origin_x;
+  const size_t origin_y = tile->origin_y;
+  const size_t good_wd = tile->good_wd;
+  const size_t good_ht = tile->good_ht;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(good_ht, good_wd, opitch, origin_x, origin_y, out_bpp, ovoid, owd, output) \
+  schedule(static)
+#endif
+  for(size_t j = 0; j < good_ht; j++)
+    memcpy(ovoid + j * opitch, (char *)output + ((j + origin_y) * owd + origin_x) * out_bpp,
+           good_wd * out_bpp);
+}
+
+static gpointer _cpu_tiles_worker(gpointer data)
+{
+  _cpu_tiles_t *t = (_cpu_tiles_t *)data;
+  dt_control_job_set_current(t->job);
+#ifdef _OPENMP
+  omp_set_num_threads(t->omp_threads);
+#endif
+
+  void *input = dt_alloc_align(64, t->in_size);
+  void *output = dt_alloc_align(64, t->out_size);
+  if(input && output)
+  {
+    for(int i = dt_atomic_add_int(&t->next, 1); i < t->count; i = dt_atomic_add_int(&t->next, 1))
+      _process_cpu_tile(t, t->tiles + i, input, output);
+  }
+  else
+    dt_atomic_set_int(&t->failed, TRUE);
+
+  if(input) dt_free_align(input);
+  if(output) dt_free_align(output);
+  return NULL;
+}
+
+/* runs process() on all tiles. processed_maximum starts from the pipe's value for every tile and
+   the last tile's result is kept. tiles run side by side only if process() leaves processed_maximum
+   alone, which the first tile tells, so they don't race for it. returns FALSE if buffers could not be
+   allocated. */
+static gboolean _process_cpu_tiles(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                   const void *const ivoid, void *const ovoid, const _cpu_tile_t *tiles,
+                                   const int count, const int concurrent, const int in_bpp, const int out_bpp,
+                                   const int ipitch, const int opitch, const char *caller)
+{
+  _cpu_tiles_t t = { .self = self, .piece = piece, .ivoid = ivoid, .ovoid = ovoid, .tiles = tiles,
+                     .count = count, .in_bpp = in_bpp, .out_bpp = out_bpp, .ipitch = ipitch,
+                     .opitch = opitch, .job = dt_control_job_get_current() };
+  for(int i = 0; i < count; i++)
+  {
+    t.in_size = MAX(t.in_size, (size_t)tiles[i].iroi.width * tiles[i].iroi.height * in_bpp);
+    t.out_size = MAX(t.out_size, (size_t)tiles[i].oroi.width * tiles[i].oroi.height * out_bpp);
+  }
+
+  void *input = dt_alloc_align(64, t.in_size);
+  void *output = dt_alloc_align(64, t.out_size);
+  if(input == NULL || output == NULL)
+  {
+    dt_print(DT_DEBUG_DEV, "%s could not alloc tile buffers for module '%s'\n", caller, self->op);
+    if(input) dt_free_align(input);
+    if(output) dt_free_align(output);
+    return FALSE;
+  }
+
+  /* store processed_maximum to be re-used and aggregated */
+  dt_aligned_pixel_t processed_maximum_saved;
+  dt_aligned_pixel_t processed_maximum_new = { 1.0f };
+  for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
+
+  piece->pipe->tiling = 1;
+  gboolean untouched = TRUE;
+  int i = 0;
+  for(; i < count && (i == 0 || !untouched || concurrent < 2); i++)
+  {
+    dt_print(DT_DEBUG_DEV, "%s tile %d with %d x %d at origin [%d, %d]\n", caller, i, tiles[i].iroi.width,
+             tiles[i].iroi.height, tiles[i].iroi.x, tiles[i].iroi.y);
+
+    /* take original processed_maximum as starting point */
+    for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
+
+    _process_cpu_tile(&t, tiles + i, input, output);
+
+    /* aggregate resulting processed_maximum */
+    /* TODO: check if there really can be differences between tiles and take
+             appropriate action (calculate minimum, maximum, average, ...?) */
+    for(int k = 0; k < 4; k++)
+    {
+      if(i > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
+        dt_print(DT_DEBUG_DEV, "%s processed_maximum[%d] differs between tiles in module '%s'\n", caller, k,
+                 self->op);
+      processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
+      if(processed_maximum_new[k] != processed_maximum_saved[k]) untouched = FALSE;
+    }
+  }
+
+  dt_free_align(input);
+  dt_free_align(output);
+
+  if(i < count)
+  {
+    /* the rest side by side, the calling thread being one of the workers */
+    const int workers = MIN(concurrent, count - i);
+#ifdef _OPENMP
+    const int omp_threads = omp_get_max_threads();
+    t.omp_threads = MAX(1, omp_threads / workers);
+#endif
+    dt_atomic_set_int(&t.next, i);
+    dt_print(DT_DEBUG_DEV, "%s processing %d tiles of module '%s' with %d workers\n", caller, count - i,
+             self->op, workers);
+
+    GThread **threads = g_new0(GThread *, workers);
+    for(int w = 1; w < workers; w++) threads[w] = g_thread_new("tiling", _cpu_tiles_worker, &t);
+    _cpu_tiles_worker(&t);
+    for(int w = 1; w < workers; w++) g_thread_join(threads[w]);
+    g_free(threads);
+#ifdef _OPENMP
+    omp_set_num_threads(omp_threads);
+#endif
+  }
+
+  /* copy back final processed_maximum */
+  for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
+  piece->pipe->tiling = 0;
+
+  if(dt_atomic_get_int(&t.failed))
+  {
+    dt_print(DT_DEBUG_DEV, "%s could not alloc tile buffers for module '%s'\n", caller, self->op);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+
+/* the roi tiler is free to lay out the tiles in other grids within the memory of a width x height tile. the
+   one with the least total input area adds the least overlap all tiles compute twice, which for the
+   distorting modules is much of their cost. border is the overlap on each side of a tile. */
+static void _pick_tile_grid(const int full_wd, const int full_ht, const int width, const int height,
+                            const int border, int *tiles_x, int *tiles_y)
+{
+  const double limit = (double)width * height;
+  const int count = *tiles_x * *tiles_y;
+  double best = count * ((double)full_wd / *tiles_x + 2 * border) * ((double)full_ht / *tiles_y + 2 * border);
+  for(int tx = 1; tx <= count; tx++)
+  {
+    const double wd = (double)full_wd / tx + 2 * border;
+    // the fewest rows of tiles that fit
+    const double ht = limit / wd - 2 * border;
+    if(ht < 1.0) continue;
+    const int ty = MAX(1, (int)ceil(full_ht / ht));
+    // more tiles than before only if they pay off, but not arbitrarily many
+    if(tx * ty > 2 * count) continue;
+    const double area = tx * ty * wd * ((double)full_ht / ty + 2 * border);
+    if(area < best)
+    {
+      best = area;
+      *tiles_x = tx;
+      *tiles_y = ty;
+    }
+  }
+}
+
+/* the last plans of the roi tiler: fitting the tiles is the expensive part and the same regions are
+   processed again and again while editing or in batch exports */
+#define DT_TILING_PLANS 8
+
+typedef struct _roi_plan_t
+{
+  const struct dt_iop_module_t *module;
+  uint64_t hash; // of the piece, its parameters decide about the rois
+  dt_iop_roi_t roi_in, roi_out, buf_in;
+  int tiles_x, tiles_y, tile_wd, tile_ht, overlap;
+  int count;
+  _cpu_tile_t *tiles;
+} _roi_plan_t;
+
+static _roi_plan_t _roi_plans[DT_TILING_PLANS];
+static int _roi_plans_next = 0;
+static GMutex _roi_plans_lock;
+
+static gboolean _roi_plan_matches(const _roi_plan_t *a, const _roi_plan_t *b)
+{
+  return a->module == b->module && a->hash == b->hash && !memcmp(&a->roi_in, &b->roi_in, sizeof(dt_iop_roi_t))
+         && !memcmp(&a->roi_out, &b->roi_out, sizeof(dt_iop_roi_t))
+         && !memcmp(&a->buf_in, &b->buf_in, sizeof(dt_iop_roi_t)) && a->tiles_x == b->tiles_x
+         && a->tiles_y == b->tiles_y && a->tile_wd == b->tile_wd && a->tile_ht == b->tile_ht
+         && a->overlap == b->overlap;
+}
+
+// a copy of the tiles of the plan, NULL if there is none
+static _cpu_tile_t *_roi_plan_lookup(const _roi_plan_t *key, int *count)
+{
+  _cpu_tile_t *tiles = NULL;
+  g_mutex_lock(&_roi_plans_lock);
+  for(int k = 0; k < DT_TILING_PLANS && !tiles; k++)
+    if(_roi_plans[k].tiles && _roi_plan_matches(_roi_plans + k, key))
+    {
+      *count = _roi_plans[k].count;
+      tiles = g_new(_cpu_tile_t, _roi_plans[k].count);
+      memcpy(tiles, _roi_plans[k].tiles, sizeof(_cpu_tile_t) * _roi_plans[k].count);
+    }
+  g_mutex_unlock(&_roi_plans_lock);
+  return tiles;
+}
+
+static void _roi_plan_store(const _roi_plan_t *key, const _cpu_tile_t *tiles, const int count)
+{
+  g_mutex_lock(&_roi_plans_lock);
+  _roi_plan_t *plan = _roi_plans + _roi_plans_next;
+  _roi_plans_next = (_roi_plans_next + 1) % DT_TILING_PLANS;
+  g_free(plan->tiles);
+  *plan = *key;
+  plan->count = count;
+  plan->tiles = g_new(_cpu_tile_t, count);
+  memcpy(plan->tiles, tiles, sizeof(_cpu_tile_t) * count);
+  g_mutex_unlock(&_roi_plans_lock);
+}
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
 static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                         const void *const ivoid, void *const ovoid,
                                         const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                         const int in_bpp)
 {
-  void *input = NULL;
-  void *output = NULL;
   dt_iop_buffer_dsc_t dsc;
   self->output_format(self, piece->pipe, piece, &dsc);
   const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
@@ -611,7 +956,7 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   }
 
   /* calculate optimal size of tiles */
-  float available = dt_get_available_mem();
+  float available = _host_memory_available();
   assert(available >= 500.0f * 1024.0f * 1024.0f);
   /* correct for size of ivoid and ovoid which are needed on top of tiling */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
@@ -626,6 +971,10 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   const float maxbuf = fmax(tiling.maxbuf, 1.0f);
   singlebuffer = fmax(available / factor, singlebuffer);
 
+  /* tiles processed side by side share the memory */
+  const int concurrent = _cpu_concurrent_tiles();
+  singlebuffer /= concurrent;
+
   int width = roi_in->width;
   int height = roi_in->height;
 
@@ -700,120 +1049,51 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
            "[default_process_tiling_ptp] (%d x %d) tiles with max dimensions %d x %d and overlap %d\n",
            tiles_x, tiles_y, width, height, overlap);
 
-  /* reserve input and output buffers for tiles */
-  input = dt_alloc_align(64, (size_t)width * height * in_bpp);
-  if(input == NULL)
-  {
-    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc input buffer for module '%s'\n",
-             self->op);
-    goto error;
-  }
-  output = dt_alloc_align(64, (size_t)width * height * out_bpp);
-  if(output == NULL)
-  {
-    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc output buffer for module '%s'\n",
-             self->op);
-    goto error;
-  }
-
-  /* store processed_maximum to be re-used and aggregated */
-  dt_aligned_pixel_t processed_maximum_saved;
-  dt_aligned_pixel_t processed_maximum_new = { 1.0f };
-  for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
-
-  /* iterate over tiles */
+  /* collect the tiles, their origin and the region of their effective part we want to store */
+  _cpu_tile_t *tiles = g_new(_cpu_tile_t, (size_t)tiles_x * tiles_y);
+  int count = 0;
   for(size_t tx = 0; tx < tiles_x; tx++)
   {
     const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
     for(size_t ty = 0; ty < tiles_y; ty++)
     {
-      piece->pipe->tiling = 1;
-
       const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
 
       /* no need to process end-tiles that are smaller than the total overlap area */
       if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
 
-      /* origin and region of effective part of tile, which we want to store later */
-      size_t origin[] = { 0, 0, 0 };
-      size_t region[] = { wd, ht, 1 };
-
-      /* roi_in and roi_out for process_cl on subbuffer */
-      dt_iop_roi_t iroi = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
-      dt_iop_roi_t oroi = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
+      _cpu_tile_t *tile = tiles + count++;
+      tile->iroi = (dt_iop_roi_t){ roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
+      tile->oroi = (dt_iop_roi_t){ roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
 
       /* offsets of tile into ivoid and ovoid */
-      const size_t ioffs = (ty * tile_ht) * ipitch + (tx * tile_wd) * in_bpp;
-      size_t ooffs = (ty * tile_ht) * opitch + (tx * tile_wd) * out_bpp;
-
-
-      dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] tile (%zu, %zu) with %zu x %zu at origin [%zu, %zu]\n",
-               tx, ty, wd, ht, tx * tile_wd, ty * tile_ht);
-
-/* prepare input tile buffer */
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ht, in_bpp, ipitch, ivoid, wd) \
-      dt_omp_sharedconst(ioffs) \
-      shared(input, width) \
-      schedule(static)
-#endif
-      for(size_t j = 0; j < ht; j++)
-        memcpy((char *)input + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch, (size_t)wd * in_bpp);
-
-      /* take original processed_maximum as starting point */
-      for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-
-      /* call process() of module */
-      self->process(self, piece, input, output, &iroi, &oroi);
-
-      /* aggregate resulting processed_maximum */
-      /* TODO: check if there really can be differences between tiles and take
-               appropriate action (calculate minimum, maximum, average, ...?) */
-      for(int k = 0; k < 4; k++)
-      {
-        if(tx + ty > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
-          dt_print(
-              DT_DEBUG_DEV,
-              "[default_process_tiling_ptp] processed_maximum[%d] differs between tiles in module '%s'\n", k,
-              self->op);
-        processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
-      }
+      tile->ioffs = (ty * tile_ht) * ipitch + (tx * tile_wd) * in_bpp;
+      tile->ooffs = (ty * tile_ht) * opitch + (tx * tile_wd) * out_bpp;
 
       /* correct origin and region of tile for overlap.
          make sure that we only copy back the "good" part. */
+      tile->origin_x = tile->origin_y = 0;
+      tile->good_wd = wd;
+      tile->good_ht = ht;
       if(tx > 0)
       {
-        origin[0] += overlap;
-        region[0] -= overlap;
-        ooffs += (size_t)overlap * out_bpp;
+        tile->origin_x += overlap;
+        tile->good_wd -= overlap;
+        tile->ooffs += (size_t)overlap * out_bpp;
       }
       if(ty > 0)
       {
-        origin[1] += overlap;
-        region[1] -= overlap;
-        ooffs += (size_t)overlap * opitch;
+        tile->origin_y += overlap;
+        tile->good_ht -= overlap;
+        tile->ooffs += (size_t)overlap * opitch;
       }
-
-/* copy "good" part of tile to output buffer */
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(opitch, out_bpp, ovoid, wd) \
-      shared(ooffs, output, width, origin, region) \
-      schedule(static)
-#endif
-      for(size_t j = 0; j < region[1]; j++)
-        memcpy((char *)ovoid + ooffs + j * opitch,
-               (char *)output + ((j + origin[1]) * wd + origin[0]) * out_bpp, (size_t)region[0] * out_bpp);
     }
   }
 
-  /* copy back final processed_maximum */
-  for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
-
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
-  piece->pipe->tiling = 0;
+  const gboolean ok = _process_cpu_tiles(self, piece, ivoid, ovoid, tiles, count, concurrent, in_bpp, out_bpp,
+                                         ipitch, opitch, "[default_process_tiling_ptp]");
+  g_free(tiles);
+  if(!ok) goto error;
   return;
 
 error:
@@ -821,8 +1101,6 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] fall back to standard processing for module '%s'\n",
            self->op);
@@ -839,9 +1117,6 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                                         const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                         const int in_bpp)
 {
-  void *input = NULL;
-  void *output = NULL;
-
   //_print_roi(roi_in, "module roi_in");
   //_print_roi(roi_out, "module roi_out");
 
@@ -877,7 +1152,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   }
 
   /* calculate optimal size of tiles */
-  float available = dt_get_available_mem();
+  float available = _host_memory_available();
   assert(available >= 500.0f * 1024.0f * 1024.0f);
   /* correct for size of ivoid and ovoid which are needed on top of tiling */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
@@ -892,6 +1167,10 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   const float maxbuf = fmax(tiling.maxbuf, 1.0f);
   singlebuffer = fmax(available / factor, singlebuffer);
 
+  /* tiles processed side by side share the memory */
+  const int concurrent = _cpu_concurrent_tiles();
+  singlebuffer /= concurrent;
+
   int width = _max(roi_in->width, roi_out->width);
   int height = _max(roi_in->height, roi_out->height);
 
@@ -958,6 +1237,11 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                   ? ceilf((float)roi_out->height / (float)_max(height - 2 * overlap_out, 1))
                   : 1;
 
+  /* other grids of about as many tiles may need less input in total */
+  if(tiles_x * tiles_y > 1)
+    _pick_tile_grid(_max(roi_in->width, roi_out->width), _max(roi_in->height, roi_out->height), width, height,
+                    overlap_in + inacc, &tiles_x, &tiles_y);
+
   /* sanity check: don't run wild on too many tiles */
   if(tiles_x * tiles_y > dt_conf_get_int("maximum_number_tiles"))
   {
@@ -982,178 +1266,124 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
            tiles_x, tiles_y, width, height);
 
 
-  /* store processed_maximum to be re-used and aggregated */
-  dt_aligned_pixel_t processed_maximum_saved;
-  dt_aligned_pixel_t processed_maximum_new = { 1.0f };
-  for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
-
-  /* iterate over tiles */
-  for(size_t tx = 0; tx < tiles_x; tx++)
-    for(size_t ty = 0; ty < tiles_y; ty++)
-    {
-      piece->pipe->tiling = 1;
-
-      /* the output dimensions of the good part of this specific tile */
-      const size_t wd = (tx + 1) * tile_wd > roi_out->width ? (size_t)roi_out->width - tx * tile_wd : tile_wd;
-      const size_t ht = (ty + 1) * tile_ht > roi_out->height ? (size_t)roi_out->height - ty * tile_ht : tile_ht;
-
-      /* roi_in and roi_out of good part: oroi_good easy to calculate based on number and dimension of tile.
-         iroi_good is calculated by modify_roi_in() of respective module */
-      dt_iop_roi_t iroi_good = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
-      dt_iop_roi_t oroi_good
-          = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
-
-      self->modify_roi_in(self, piece, &oroi_good, &iroi_good);
-
-      /* clamp iroi_good to not exceed roi_in */
-      iroi_good.x = _max(iroi_good.x, roi_in->x);
-      iroi_good.y = _max(iroi_good.y, roi_in->y);
-      iroi_good.width = _min(iroi_good.width, roi_in->width + roi_in->x - iroi_good.x);
-      iroi_good.height = _min(iroi_good.height, roi_in->height + roi_in->y - iroi_good.y);
-
-      //_print_roi(&iroi_good, "tile iroi_good");
-      //_print_roi(&oroi_good, "tile oroi_good");
-
-      /* now we need to calculate full region of this tile: increase input roi to take care of overlap
-         requirements
-         and alignment and add additional delta to correct for possible rounding errors in modify_roi_in()
-         -> generates first estimate of iroi_full */
-      const int x_in = iroi_good.x;
-      const int y_in = iroi_good.y;
-      const int width_in = iroi_good.width;
-      const int height_in = iroi_good.height;
-      const int new_x_in = _max(_align_down(x_in - overlap_in - delta, xyalign), roi_in->x);
-      const int new_y_in = _max(_align_down(y_in - overlap_in - delta, xyalign), roi_in->y);
-      const int new_width_in = _min(_align_up(width_in + overlap_in + delta + (x_in - new_x_in), xyalign),
-                                    roi_in->width + roi_in->x - new_x_in);
-      const int new_height_in = _min(_align_up(height_in + overlap_in + delta + (y_in - new_y_in), xyalign),
-                                     roi_in->height + roi_in->y - new_y_in);
-
-      /* iroi_full based on calculated numbers and dimensions. oroi_full just set as a starting point for the
-       * following iterative search */
-      dt_iop_roi_t iroi_full = { new_x_in, new_y_in, new_width_in, new_height_in, iroi_good.scale };
-      dt_iop_roi_t oroi_full = oroi_good; // a good starting point for optimization
-
-      //_print_roi(&iroi_full, "tile iroi_full before optimization");
-      //_print_roi(&oroi_full, "tile oroi_full before optimization");
-
-      /* try to find a matching oroi_full */
-      if(!_fit_output_to_input_roi(self, piece, &iroi_full, &oroi_full, delta, 10))
-      {
-        dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] can not handle requested roi's. tiling for "
-                               "module '%s' not possible.\n",
-                 self->op);
-        goto error;
-      }
-
-      //_print_roi(&iroi_full, "tile iroi_full after optimization");
-      //_print_roi(&oroi_full, "tile oroi_full after optimization");
-
-      /* make sure that oroi_full at least covers the range of oroi_good.
-         this step is needed due to the possibility of rounding errors */
-      oroi_full.x = _min(oroi_full.x, oroi_good.x);
-      oroi_full.y = _min(oroi_full.y, oroi_good.y);
-      oroi_full.width = _max(oroi_full.width, oroi_good.x + oroi_good.width - oroi_full.x);
-      oroi_full.height = _max(oroi_full.height, oroi_good.y + oroi_good.height - oroi_full.y);
-
-      /* clamp oroi_full to not exceed roi_out */
-      oroi_full.x = _max(oroi_full.x, roi_out->x);
-      oroi_full.y = _max(oroi_full.y, roi_out->y);
-      oroi_full.width = _min(oroi_full.width, roi_out->width + roi_out->x - oroi_full.x);
-      oroi_full.height = _min(oroi_full.height, roi_out->height + roi_out->y - oroi_full.y);
-
-      /* calculate final iroi_full */
-      self->modify_roi_in(self, piece, &oroi_full, &iroi_full);
-
-      /* clamp iroi_full to not exceed roi_in */
-      iroi_full.x = _max(iroi_full.x, roi_in->x);
-      iroi_full.y = _max(iroi_full.y, roi_in->y);
-      iroi_full.width = _min(iroi_full.width, roi_in->width + roi_in->x - iroi_full.x);
-      iroi_full.height = _min(iroi_full.height, roi_in->height + roi_in->y - iroi_full.y);
-
-
-      //_print_roi(&iroi_full, "tile iroi_full final");
-      //_print_roi(&oroi_full, "tile oroi_full final");
-
-      /* offsets of tile into ivoid and ovoid */
-      const size_t ioffs = ((size_t)iroi_full.y - roi_in->y) * ipitch + ((size_t)iroi_full.x - roi_in->x) * in_bpp;
-      size_t ooffs = ((size_t)oroi_good.y - roi_out->y) * opitch
-                     + ((size_t)oroi_good.x - roi_out->x) * out_bpp;
-
-      dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] tile (%zu, %zu) with %d x %d at origin [%d, %d]\n",
-               tx, ty, iroi_full.width, iroi_full.height, iroi_full.x, iroi_full.y);
-
-
-      /* prepare input tile buffer */
-      input = dt_alloc_align(64, (size_t)iroi_full.width * iroi_full.height * in_bpp);
-      if(input == NULL)
-      {
-        dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc input buffer for module '%s'\n",
-                 self->op);
-        goto error;
-      }
-      output = dt_alloc_align(64, (size_t)oroi_full.width * oroi_full.height * out_bpp);
-      if(output == NULL)
+  /* collect the tiles with all their rois, process() gets called for them later on. the same
+     regions come again and again, so the plan is kept */
+  const _roi_plan_t key = { .module = self, .hash = piece->hash, .roi_in = *roi_in, .roi_out = *roi_out,
+                            .buf_in = piece->buf_in, .tiles_x = tiles_x, .tiles_y = tiles_y,
+                            .tile_wd = tile_wd, .tile_ht = tile_ht, .overlap = overlap_in };
+  int count = 0;
+  _cpu_tile_t *tiles = _roi_plan_lookup(&key, &count);
+  if(tiles)
+    dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] reusing the plan of %d tiles\n", count);
+  else
+  {
+    tiles = g_new(_cpu_tile_t, (size_t)tiles_x * tiles_y);
+    for(size_t tx = 0; tx < tiles_x; tx++)
+      for(size_t ty = 0; ty < tiles_y; ty++)
       {
-        dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc output buffer for module '%s'\n",
-                 self->op);
-        goto error;
-      }
-
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
-      dt_omp_sharedconst(ioffs) shared(input, iroi_full) \
-      schedule(static)
-#endif
-      for(size_t j = 0; j < iroi_full.height; j++)
-        memcpy((char *)input + j * iroi_full.width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
-               (size_t)iroi_full.width * in_bpp);
-
-      /* take original processed_maximum as starting point */
-      for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
-
-      /* call process() of module */
-      self->process(self, piece, input, output, &iroi_full, &oroi_full);
+        /* the output dimensions of the good part of this specific tile */
+        const size_t wd = (tx + 1) * tile_wd > roi_out->width ? (size_t)roi_out->width - tx * tile_wd : tile_wd;
+        const size_t ht = (ty + 1) * tile_ht > roi_out->height ? (size_t)roi_out->height - ty * tile_ht : tile_ht;
+
+        /* roi_in and roi_out of good part: oroi_good easy to calculate based on number and dimension of tile.
+           iroi_good is calculated by modify_roi_in() of respective module */
+        dt_iop_roi_t iroi_good = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
+        dt_iop_roi_t oroi_good
+            = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
+
+        self->modify_roi_in(self, piece, &oroi_good, &iroi_good);
+
+        /* clamp iroi_good to not exceed roi_in */
+        iroi_good.x = _max(iroi_good.x, roi_in->x);
+        iroi_good.y = _max(iroi_good.y, roi_in->y);
+        iroi_good.width = _min(iroi_good.width, roi_in->width + roi_in->x - iroi_good.x);
+        iroi_good.height = _min(iroi_good.height, roi_in->height + roi_in->y - iroi_good.y);
+
+        //_print_roi(&iroi_good, "tile iroi_good");
+        //_print_roi(&oroi_good, "tile oroi_good");
+
+        /* now we need to calculate full region of this tile: increase input roi to take care of overlap
+           requirements
+           and alignment and add additional delta to correct for possible rounding errors in modify_roi_in()
+           -> generates first estimate of iroi_full */
+        const int x_in = iroi_good.x;
+        const int y_in = iroi_good.y;
+        const int width_in = iroi_good.width;
+        const int height_in = iroi_good.height;
+        const int new_x_in = _max(_align_down(x_in - overlap_in - delta, xyalign), roi_in->x);
+        const int new_y_in = _max(_align_down(y_in - overlap_in - delta, xyalign), roi_in->y);
+        const int new_width_in = _min(_align_up(width_in + overlap_in + delta + (x_in - new_x_in), xyalign),
+                                      roi_in->width + roi_in->x - new_x_in);
+        const int new_height_in = _min(_align_up(height_in + overlap_in + delta + (y_in - new_y_in), xyalign),
+                                       roi_in->height + roi_in->y - new_y_in);
+
+        /* iroi_full based on calculated numbers and dimensions. oroi_full just set as a starting point for the
+         * following iterative search */
+        dt_iop_roi_t iroi_full = { new_x_in, new_y_in, new_width_in, new_height_in, iroi_good.scale };
+        dt_iop_roi_t oroi_full = oroi_good; // a good starting point for optimization
+
+        //_print_roi(&iroi_full, "tile iroi_full before optimization");
+        //_print_roi(&oroi_full, "tile oroi_full before optimization");
+
+        /* try to find a matching oroi_full */
+        if(!_fit_output_to_input_roi(self, piece, &iroi_full, &oroi_full, delta, 10))
+        {
+          dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] can not handle requested roi's. tiling for "
+                                 "module '%s' not possible.\n",
+                   self->op);
+          g_free(tiles);
+          goto error;
+        }
 
-      /* aggregate resulting processed_maximum */
-      /* TODO: check if there really can be differences between tiles and take
-               appropriate action (calculate minimum, maximum, average, ...?) */
-      for(int k = 0; k < 4; k++)
-      {
-        if(tx + ty > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
-          dt_print(
-              DT_DEBUG_DEV,
-              "[default_process_tiling_roi] processed_maximum[%d] differs between tiles in module '%s'\n", k,
-              self->op);
-        processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
+        //_print_roi(&iroi_full, "tile iroi_full after optimization");
+        //_print_roi(&oroi_full, "tile oroi_full after optimization");
+
+        /* make sure that oroi_full at least covers the range of oroi_good.
+           this step is needed due to the possibility of rounding errors */
+        oroi_full.x = _min(oroi_full.x, oroi_good.x);
+        oroi_full.y = _min(oroi_full.y, oroi_good.y);
+        oroi_full.width = _max(oroi_full.width, oroi_good.x + oroi_good.width - oroi_full.x);
+        oroi_full.height = _max(oroi_full.height, oroi_good.y + oroi_good.height - oroi_full.y);
+
+        /* clamp oroi_full to not exceed roi_out */
+        oroi_full.x = _max(oroi_full.x, roi_out->x);
+        oroi_full.y = _max(oroi_full.y, roi_out->y);
+        oroi_full.width = _min(oroi_full.width, roi_out->width + roi_out->x - oroi_full.x);
+        oroi_full.height = _min(oroi_full.height, roi_out->height + roi_out->y - oroi_full.y);
+
+        /* calculate final iroi_full */
+        self->modify_roi_in(self, piece, &oroi_full, &iroi_full);
+
+        /* clamp iroi_full to not exceed roi_in */
+        iroi_full.x = _max(iroi_full.x, roi_in->x);
+        iroi_full.y = _max(iroi_full.y, roi_in->y);
+        iroi_full.width = _min(iroi_full.width, roi_in->width + roi_in->x - iroi_full.x);
+        iroi_full.height = _min(iroi_full.height, roi_in->height + roi_in->y - iroi_full.y);
+
+
+        //_print_roi(&iroi_full, "tile iroi_full final");
+        //_print_roi(&oroi_full, "tile oroi_full final");
+
+        /* offsets of tile into ivoid and ovoid */
+        _cpu_tile_t *tile = tiles + count++;
+        tile->iroi = iroi_full;
+        tile->oroi = oroi_full;
+        tile->ioffs = ((size_t)iroi_full.y - roi_in->y) * ipitch + ((size_t)iroi_full.x - roi_in->x) * in_bpp;
+        tile->ooffs = ((size_t)oroi_good.y - roi_out->y) * opitch + ((size_t)oroi_good.x - roi_out->x) * out_bpp;
+
+        /* the "good" part of the tile in its output */
+        tile->origin_x = oroi_good.x - oroi_full.x;
+        tile->origin_y = oroi_good.y - oroi_full.y;
+        tile->good_wd = oroi_good.width;
+        tile->good_ht = oroi_good.height;
       }
+    _roi_plan_store(&key, tiles, count);
+  }
 
-      /* copy "good" part of tile to output buffer */
-      const int origin_x = oroi_good.x - oroi_full.x;
-      const int origin_y = oroi_good.y - oroi_full.y;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(opitch, origin_x, origin_y, out_bpp, ovoid) \
-      shared(ooffs, output, oroi_good, oroi_full) \
-      schedule(static)
-#endif
-      for(size_t j = 0; j < oroi_good.height; j++)
-        memcpy((char *)ovoid + ooffs + j * opitch,
-               (char *)output + ((j + origin_y) * oroi_full.width + origin_x) * out_bpp,
-               (size_t)oroi_good.width * out_bpp);
-
-      dt_free_align(input);
-      dt_free_align(output);
-      input = output = NULL;
-    }
-
-  /* copy back final processed_maximum */
-  for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
-
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
-  piece->pipe->tiling = 0;
+  const gboolean ok = _process_cpu_tiles(self, piece, ivoid, ovoid, tiles, count, concurrent, in_bpp, out_bpp,
+                                         ipitch, opitch, "[default_process_tiling_roi]");
+  g_free(tiles);
+  if(!ok) goto error;
   return;
 
 error:
@@ -1161,8 +1391,6 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] fall back to standard processing for module '%s'\n",
            self->op);
@@ -1192,6 +1420,212 @@ void default_process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 
 #ifdef HAVE_OPENCL
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
+/* tiles of one image spread over several devices, see _default_process_tiling_cl_ptp_multi() */
+typedef struct _tiling_cl_multi_t
+{
+  struct dt_iop_module_t *self;
+  const void *ivoid;
+  void *ovoid;
+  const dt_iop_roi_t *roi_in;
+  const dt_iop_roi_t *roi_out;
+  int in_bpp, out_bpp, ipitch, opitch;
+  int width, height, tile_wd, tile_ht, overlap, tiles_x, tiles_y;
+  const float *processed_maximum;
+  dt_atomic_int *shutdown;
+  dt_atomic_int next;
+  dt_atomic_int failed;
+} _tiling_cl_multi_t;
+
+typedef struct _tiling_cl_worker_t
+{
+  _tiling_cl_multi_t *job;
+  int devid;
+  int tiles;
+  // the module finds its device through piece->pipe, so every worker runs on copies of both
+  dt_dev_pixelpipe_t pipe;
+  dt_dev_pixelpipe_iop_t piece;
+} _tiling_cl_worker_t;
+
+static gboolean _tiling_cl_multi_tile(_tiling_cl_worker_t *w, const size_t tx, const size_t ty)
+{
+  const _tiling_cl_multi_t *j = w->job;
+  const int devid = w->devid;
+
+  const size_t wd = tx * j->tile_wd + j->width > j->roi_in->width ? j->roi_in->width - tx * j->tile_wd : j->width;
+  const size_t ht = ty * j->tile_ht + j->height > j->roi_in->height ? j->roi_in->height - ty * j->tile_ht : j->height;
+
+  /* no need to process (end)tiles that are smaller than the total overlap area */
+  if((wd <= 2 * j->overlap && tx > 0) || (ht <= 2 * j->overlap && ty > 0)) return TRUE;
+
+  size_t origin[] = { 0, 0, 0 };
+  size_t region[] = { wd, ht, 1 };
+  dt_iop_roi_t iroi = { j->roi_in->x + tx * j->tile_wd, j->roi_in->y + ty * j->tile_ht, wd, ht, j->roi_in->scale };
+  dt_iop_roi_t oroi
+      = { j->roi_out->x + tx * j->tile_wd, j->roi_out->y + ty * j->tile_ht, wd, ht, j->roi_out->scale };
+  const size_t ioffs = (ty * j->tile_ht) * j->ipitch + (tx * j->tile_wd) * j->in_bpp;
+  size_t ooffs = (ty * j->tile_ht) * j->opitch + (tx * j->tile_wd) * j->out_bpp;
+
+  dt_print(DT_DEBUG_OPENCL,
+           "[default_process_tiling_cl_ptp] tile (%zu, %zu) with %zu x %zu at origin [%zu, %zu] on device %d\n",
+           tx, ty, wd, ht, tx * j->tile_wd, ty * j->tile_ht, devid);
+
+  cl_int err = CL_SUCCESS;
+  cl_mem input = dt_opencl_alloc_device(devid, wd, ht, j->in_bpp);
+  cl_mem output = input ? dt_opencl_alloc_device(devid, wd, ht, j->out_bpp) : NULL;
+  gboolean ok = input && output;
+
+  if(ok)
+    ok = (err = dt_opencl_write_host_to_device_raw(devid, (char *)j->ivoid + ioffs, input, origin, region,
+                                                   j->ipitch, CL_TRUE)) == CL_SUCCESS;
+  if(ok)
+  {
+    for(int k = 0; k < 4; k++) w->pipe.dsc.processed_maximum[k] = j->processed_maximum[k];
+    ok = j->self->process_cl(j->self, &w->piece, input, output, &iroi, &oroi);
+  }
+  if(ok)
+  {
+    /* only copy back the "good" part of the tile */
+    if(tx > 0)
+    {
+      origin[0] += j->overlap;
+      region[0] -= j->overlap;
+      ooffs += (size_t)j->overlap * j->out_bpp;
+    }
+    if(ty > 0)
+    {
+      origin[1] += j->overlap;
+      region[1] -= j->overlap;
+      ooffs += (size_t)j->overlap * j->opitch;
+    }
+    ok = (err = dt_opencl_read_host_from_device_raw(devid, (char *)j->ovoid + ooffs, output, origin, region,
+                                                    j->opitch, CL_TRUE)) == CL_SUCCESS;
+  }
+
+  dt_opencl_release_mem_object(input);
+  dt_opencl_release_mem_object(output);
+  dt_opencl_finish(devid);
+
+  if(!ok)
+    dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_ptp] tile (%zu, %zu) failed on device %d: %d\n", tx, ty,
+             devid, err);
+  else
+    w->tiles++;
+  return ok;
+}
+
+static gpointer _tiling_cl_multi_worker(gpointer data)
+{
+  _tiling_cl_worker_t *w = (_tiling_cl_worker_t *)data;
+  _tiling_cl_multi_t *j = w->job;
+
+  while(!dt_atomic_get_int(&j->failed))
+  {
+    const int t = dt_atomic_add_int(&j->next, 1);
+    if(t >= j->tiles_x * j->tiles_y) break;
+    if(dt_atomic_get_int(j->shutdown) || !_tiling_cl_multi_tile(w, t / j->tiles_y, t % j->tiles_y))
+      dt_atomic_set_int(&j->failed, TRUE);
+  }
+  return NULL;
+}
+
+/* exports run the tiles of one image on all devices that are free and at least as capable as the
+   pipe's own one. returns -1 if there is no such device and the caller should go on alone. */
+static int _default_process_tiling_cl_ptp_multi(struct dt_iop_module_t *self,
+                                                struct dt_dev_pixelpipe_iop_t *piece, _tiling_cl_multi_t *job)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  const int devid = piece->pipe->devid;
+  const cl_ulong available = dt_opencl_get_device_available(devid);
+
+  _tiling_cl_worker_t *workers = calloc(cl->num_devs, sizeof(_tiling_cl_worker_t));
+  if(!workers) return -1;
+  int count = 0;
+  workers[count++].devid = devid;
+  for(int dev = 0; dev < cl->num_devs; dev++)
+  {
+    if(dev == devid || dt_opencl_get_device_available(dev) < available
+       || cl->dev[dev].max_image_width < (size_t)job->width
+       || cl->dev[dev].max_image_height < (size_t)job->height)
+      continue;
+    if(dt_opencl_trylock_device(dev, piece->pipe->type))
+    {
+      dt_opencl_events_reset(dev);
+      dt_opencl_events_set_module(dev, cl->dev[devid].profile_pipe, self->op, self->multi_priority);
+      workers[count++].devid = dev;
+    }
+  }
+
+  if(count == 1)
+  {
+    free(workers);
+    return -1;
+  }
+
+  dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_ptp] spreading %d x %d tiles of module '%s' over %d devices\n",
+           job->tiles_x, job->tiles_y, self->op, count);
+
+  for(int k = 0; k < count; k++)
+  {
+    _tiling_cl_worker_t *w = &workers[k];
+    w->job = job;
+    memcpy(&w->pipe, piece->pipe, sizeof(dt_dev_pixelpipe_t));
+    w->pipe.devid = w->devid;
+    w->pipe.tiling = 1;
+    memcpy(&w->piece, piece, sizeof(dt_dev_pixelpipe_iop_t));
+    w->piece.pipe = &w->pipe;
+  }
+
+  GThread **threads = g_malloc_n(count, sizeof(GThread *));
+  for(int k = 1; k < count; k++) threads[k] = g_thread_new("tiling", _tiling_cl_multi_worker, &workers[k]);
+  _tiling_cl_multi_worker(&workers[0]);
+  for(int k = 1; k < count; k++)
+  {
+    g_thread_join(threads[k]);
+    if(dt_opencl_events_flush(workers[k].devid, TRUE) != CL_SUCCESS) dt_atomic_set_int(&job->failed, TRUE);
+    dt_opencl_unlock_device(workers[k].devid);
+  }
+  g_free(threads);
+
+  const gboolean ok = !dt_atomic_get_int(&job->failed);
+  for(int k = 0; k < count; k++)
+    if(ok && workers[k].tiles)
+    {
+      for(int c = 0; c < 4; c++) piece->pipe->dsc.processed_maximum[c] = workers[k].pipe.dsc.processed_maximum[c];
+      break;
+    }
+  if(!ok)
+  {
+    for(int c = 0; c < 4; c++) piece->pipe->dsc.processed_maximum[c] = job->processed_maximum[c];
+    dt_print(DT_DEBUG_OPENCL,
+             "[default_process_tiling_opencl_ptp] couldn't run process_cl() for module '%s' on %d devices\n",
+             self->op, count);
+  }
+
+  free(workers);
+  return ok;
+}
+
+/* the next tile of the ptp loop after (tx, ty) that gets processed, with its size. FALSE if there is none. */
+static gboolean _tiling_cl_ptp_next_tile(size_t *tx, size_t *ty, const int tiles_x, const int tiles_y,
+                                         const int tile_wd, const int tile_ht, const int width, const int height,
+                                         const int overlap, const dt_iop_roi_t *const roi_in, size_t *wd,
+                                         size_t *ht)
+{
+  for(size_t n = *tx * tiles_y + *ty + 1; n < (size_t)tiles_x * tiles_y; n++)
+  {
+    const size_t x = n / tiles_y;
+    const size_t y = n % tiles_y;
+    *wd = x * tile_wd + width > roi_in->width ? roi_in->width - x * tile_wd : width;
+    *ht = y * tile_ht + height > roi_in->height ? roi_in->height - y * tile_ht : height;
+    /* same rule as in the loop: (end)tiles smaller than the total overlap area are skipped */
+    if((*wd <= 2 * overlap && x > 0) || (*ht <= 2 * overlap && y > 0)) continue;
+    *tx = x;
+    *ty = y;
+    return TRUE;
+  }
+  return FALSE;
+}
+
 static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                           const void *const ivoid, void *const ovoid,
                                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
@@ -1204,6 +1638,9 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   cl_mem pinned_output = NULL;
   void *input_buffer = NULL;
   void *output_buffer = NULL;
+  cl_mem next_input = NULL;
+  cl_event input_event = NULL;
+  cl_event next_event = NULL;
 
   dt_iop_buffer_dsc_t dsc;
   self->output_format(self, piece->pipe, piece, &dsc);
@@ -1228,8 +1665,12 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
             ? 0.85f
             : 1.0f; // avoid problems when pinned buffer size gets too close to max_mem_alloc size
 
+  /* without pinned memory the input of the next tile is uploaded on the transfer queue while the
+     kernels of the current one run. that takes one more input buffer on the device. */
+  const int prefetch = !use_pinned_memory && dt_opencl_has_transfer_queue(devid);
+
   const float available = (float)dt_opencl_get_device_available(devid);
-  const float factor = fmax(tiling.factor_cl + pinned_buffer_overhead, 1.0f);
+  const float factor = fmax(tiling.factor_cl + pinned_buffer_overhead + (prefetch ? 1 : 0), 1.0f);
   const float singlebuffer = fmin(fmax((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * (float)(dt_opencl_get_device_memalloc(devid)));
   const float maxbuf = fmax(tiling.maxbuf_cl, 1.0f);
@@ -1262,6 +1703,11 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
     width = height = floorf(sqrtf((float)width * height));
   }
 
+  /* to spread the image over several devices cut it into at least two bands per device */
+  const gboolean spread = dt_tiling_cl_spread_over_devices(self, piece, roi_in, roi_out);
+  if(spread)
+    height = _min(height, roi_in->height / (2 * darktable.opencl->num_devs) + 2 * tiling.overlap + 1);
+
 
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
@@ -1320,6 +1766,22 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   dt_aligned_pixel_t processed_maximum_new = { 1.0f };
   for_four_channels(k) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
 
+  /* an export may put the other gpus to work on the tiles of this image */
+  if(tiles_x * tiles_y > 1 && (spread || ((piece->pipe->type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT
+                                            && darktable.opencl->num_devs > 1
+                                            && dt_conf_get_bool("opencl_tiling_multiple_devices"))))
+  {
+    _tiling_cl_multi_t job = { .self = self, .ivoid = ivoid, .ovoid = ovoid, .roi_in = roi_in,
+                               .roi_out = roi_out, .in_bpp = in_bpp, .out_bpp = out_bpp, .ipitch = ipitch,
+                               .opitch = opitch, .width = width, .height = height, .tile_wd = tile_wd,
+                               .tile_ht = tile_ht, .overlap = overlap, .tiles_x = tiles_x, .tiles_y = tiles_y,
+                               .processed_maximum = processed_maximum_saved, .shutdown = &piece->pipe->shutdown };
+    dt_atomic_set_int(&job.next, 0);
+    dt_atomic_set_int(&job.failed, FALSE);
+    const int res = _default_process_tiling_cl_ptp_multi(self, piece, &job);
+    if(res >= 0) return res;
+  }
+
   /* reserve pinned input and output memory for host<->device data transfer */
   if(use_pinned_memory)
   {
@@ -1406,38 +1868,75 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
                "[default_process_tiling_cl_ptp] tile (%zu, %zu) with %zu x %zu at origin [%zu, %zu]\n", tx, ty, wd,
                ht, tx * tile_wd, ty * tile_ht);
 
-      /* get input and output buffers */
-      input = dt_opencl_alloc_device(devid, wd, ht, in_bpp);
-      if(input == NULL) goto error;
-      output = dt_opencl_alloc_device(devid, wd, ht, out_bpp);
-      if(output == NULL) goto error;
-
-      if(use_pinned_memory)
+      /* get input and output buffers, the input of this tile may be on its way already */
+      if(next_input)
       {
+        input = next_input;
+        input_event = next_event;
+        next_input = NULL;
+        next_event = NULL;
+      }
+      else
+      {
+        input = dt_opencl_alloc_device(devid, wd, ht, in_bpp);
+        if(input == NULL) goto error;
+
+        if(use_pinned_memory)
+        {
 /* prepare pinned input tile buffer: copy part of input image */
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
-        dt_omp_sharedconst(ioffs, wd, ht) shared(input_buffer, width) \
-        schedule(static)
+          dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
+          dt_omp_sharedconst(ioffs, wd, ht) shared(input_buffer, width) \
+          schedule(static)
 #endif
-        for(size_t j = 0; j < ht; j++)
-          memcpy((char *)input_buffer + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch,
-                 (size_t)wd * in_bpp);
-
-        /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, origin, region,
-                                                 wd * in_bpp, CL_TRUE);
-        if(err != CL_SUCCESS) goto error;
+          for(size_t j = 0; j < ht; j++)
+            memcpy((char *)input_buffer + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch,
+                   (size_t)wd * in_bpp);
+
+          /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, origin, region,
+                                                   wd * in_bpp, CL_TRUE);
+          if(err != CL_SUCCESS) goto error;
+        }
+        else if(prefetch)
+        {
+          /* the first tile: nothing to overlap with yet */
+          err = dt_opencl_write_host_to_device_async(devid, (char *)ivoid + ioffs, input, origin, region, ipitch,
+                                                     &input_event);
+          if(err != CL_SUCCESS) goto error;
+        }
+        else
+        {
+          /* blocking direct memory transfer: host input image -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, origin, region, ipitch,
+                                                   CL_TRUE);
+          if(err != CL_SUCCESS) goto error;
+        }
       }
-      else
+      output = dt_opencl_alloc_device(devid, wd, ht, out_bpp);
+      if(output == NULL) goto error;
+
+      /* start the upload of the next tile, it overlaps with the kernels of this one */
+      size_t ntx = tx, nty = ty, nwd = 0, nht = 0;
+      if(prefetch
+         && _tiling_cl_ptp_next_tile(&ntx, &nty, tiles_x, tiles_y, tile_wd, tile_ht, width, height, overlap,
+                                     roi_in, &nwd, &nht))
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, origin, region, ipitch,
-                                                 CL_TRUE);
+        const size_t norigin[] = { 0, 0, 0 };
+        const size_t nregion[] = { nwd, nht, 1 };
+        next_input = dt_opencl_alloc_device(devid, nwd, nht, in_bpp);
+        if(next_input == NULL) goto error;
+        err = dt_opencl_write_host_to_device_async(devid, (char *)ivoid + (nty * tile_ht) * ipitch
+                                                              + (ntx * tile_wd) * in_bpp,
+                                                   next_input, norigin, nregion, ipitch, &next_event);
         if(err != CL_SUCCESS) goto error;
       }
 
+      /* kernels of this tile start once its input is complete */
+      err = dt_opencl_wait_for_transfer(devid, &input_event);
+      if(err != CL_SUCCESS) goto error;
+
       /* take original processed_maximum as starting point */
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
@@ -1532,6 +2031,11 @@ error:
   dt_opencl_release_mem_object(pinned_output);
   dt_opencl_release_mem_object(input);
   dt_opencl_release_mem_object(output);
+  /* uploads still in flight must not land in buffers handed out again */
+  dt_opencl_finish_transfers(devid);
+  dt_opencl_wait_for_transfer(devid, &input_event);
+  dt_opencl_wait_for_transfer(devid, &next_event);
+  dt_opencl_release_mem_object(next_input);
   piece->pipe->tiling = 0;
   dt_print(
       DT_DEBUG_OPENCL,
@@ -1543,6 +2047,100 @@ error:
 
 /* more elaborate tiling algorithm for roi_in != roi_out: slower than the ptp variant,
    more tiles and larger overlap */
+/* full input and output region plus the good part of the output of roi tile (tx, ty). FALSE if the
+   requested roi's can not be matched. */
+static gboolean _tiling_cl_roi_tile(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                    const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                                    const size_t tx, const size_t ty, const int tile_wd, const int tile_ht,
+                                    const int overlap_in, const int delta, const unsigned int xyalign,
+                                    dt_iop_roi_t *iroi, dt_iop_roi_t *oroi, dt_iop_roi_t *oroi_good_out)
+{
+  /* the output dimensions of the good part of this specific tile */
+  const size_t wd = (tx + 1) * tile_wd > roi_out->width ? (size_t)roi_out->width - tx * tile_wd : tile_wd;
+  const size_t ht = (ty + 1) * tile_ht > roi_out->height ? (size_t)roi_out->height - ty * tile_ht : tile_ht;
+
+  /* roi_in and roi_out of good part: oroi_good easy to calculate based on number and dimension of tile.
+     iroi_good is calculated by modify_roi_in() of respective module */
+  dt_iop_roi_t iroi_good = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
+  dt_iop_roi_t oroi_good
+      = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
+
+  self->modify_roi_in(self, piece, &oroi_good, &iroi_good);
+
+  /* clamp iroi_good to not exceed roi_in */
+  iroi_good.x = _max(iroi_good.x, roi_in->x);
+  iroi_good.y = _max(iroi_good.y, roi_in->y);
+  iroi_good.width = _min(iroi_good.width, roi_in->width + roi_in->x - iroi_good.x);
+  iroi_good.height = _min(iroi_good.height, roi_in->height + roi_in->y - iroi_good.y);
+
+  //_print_roi(&iroi_good, "tile iroi_good");
+  //_print_roi(&oroi_good, "tile oroi_good");
+
+  /* now we need to calculate full region of this tile: increase input roi to take care of overlap
+     requirements
+     and alignment and add additional delta to correct for possible rounding errors in modify_roi_in()
+     -> generates first estimate of iroi_full */
+  const int x_in = iroi_good.x;
+  const int y_in = iroi_good.y;
+  const int width_in = iroi_good.width;
+  const int height_in = iroi_good.height;
+  const int new_x_in = _max(_align_down(x_in - overlap_in - delta, xyalign), roi_in->x);
+  const int new_y_in = _max(_align_down(y_in - overlap_in - delta, xyalign), roi_in->y);
+  const int new_width_in = _min(_align_up(width_in + overlap_in + delta + (x_in - new_x_in), xyalign),
+                                roi_in->width + roi_in->x - new_x_in);
+  const int new_height_in = _min(_align_up(height_in + overlap_in + delta + (y_in - new_y_in), xyalign),
+                                 roi_in->height + roi_in->y - new_y_in);
+
+  /* iroi_full based on calculated numbers and dimensions. oroi_full just set as a starting point for the
+   * following iterative search */
+  dt_iop_roi_t iroi_full = { new_x_in, new_y_in, new_width_in, new_height_in, iroi_good.scale };
+  dt_iop_roi_t oroi_full = oroi_good; // a good starting point for optimization
+
+  //_print_roi(&iroi_full, "tile iroi_full before optimization");
+  //_print_roi(&oroi_full, "tile oroi_full before optimization");
+
+  /* try to find a matching oroi_full */
+  if(!_fit_output_to_input_roi(self, piece, &iroi_full, &oroi_full, delta, 10))
+  {
+    dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_roi] can not handle requested roi's. tiling "
+                              "for module '%s' not possible.\n",
+             self->op);
+    return FALSE;
+  }
+
+
+  /* make sure that oroi_full at least covers the range of oroi_good.
+     this step is needed due to the possibility of rounding errors */
+  oroi_full.x = _min(oroi_full.x, oroi_good.x);
+  oroi_full.y = _min(oroi_full.y, oroi_good.y);
+  oroi_full.width = _max(oroi_full.width, oroi_good.x + oroi_good.width - oroi_full.x);
+  oroi_full.height = _max(oroi_full.height, oroi_good.y + oroi_good.height - oroi_full.y);
+
+  /* clamp oroi_full to not exceed roi_out */
+  oroi_full.x = _max(oroi_full.x, roi_out->x);
+  oroi_full.y = _max(oroi_full.y, roi_out->y);
+  oroi_full.width = _min(oroi_full.width, roi_out->width + roi_out->x - oroi_full.x);
+  oroi_full.height = _min(oroi_full.height, roi_out->height + roi_out->y - oroi_full.y);
+
+
+  /* calculate final iroi_full */
+  self->modify_roi_in(self, piece, &oroi_full, &iroi_full);
+
+  /* clamp iroi_full to not exceed roi_in */
+  iroi_full.x = _max(iroi_full.x, roi_in->x);
+  iroi_full.y = _max(iroi_full.y, roi_in->y);
+  iroi_full.width = _min(iroi_full.width, roi_in->width + roi_in->x - iroi_full.x);
+  iroi_full.height = _min(iroi_full.height, roi_in->height + roi_in->y - iroi_full.y);
+
+  //_print_roi(&iroi_full, "tile iroi_full");
+  //_print_roi(&oroi_full, "tile oroi_full");
+
+  *iroi = iroi_full;
+  *oroi = oroi_full;
+  *oroi_good_out = oroi_good;
+  return TRUE;
+}
+
 static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                           const void *const ivoid, void *const ovoid,
                                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
@@ -1555,6 +2153,9 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   cl_mem pinned_output = NULL;
   void *input_buffer = NULL;
   void *output_buffer = NULL;
+  cl_mem next_input = NULL;
+  cl_event input_event = NULL;
+  cl_event next_event = NULL;
 
 
   //_print_roi(roi_in, "module roi_in");
@@ -1592,8 +2193,12 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
             ? 0.85f
             : 1.0f; // avoid problems when pinned buffer size gets too close to max_mem_alloc size
 
+  /* without pinned memory the input of the next tile is uploaded on the transfer queue while the
+     kernels of the current one run. that takes one more input buffer on the device. */
+  const int prefetch = !use_pinned_memory && dt_opencl_has_transfer_queue(devid);
+
   const float available = (float)dt_opencl_get_device_available(devid);
-  const float factor = fmax(tiling.factor_cl + pinned_buffer_overhead, 1.0f);
+  const float factor = fmax(tiling.factor_cl + pinned_buffer_overhead + (prefetch ? 1 : 0), 1.0f);
   const float singlebuffer = fmin(fmax((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * (float)(dt_opencl_get_device_memalloc(devid)));
   const float maxbuf = fmax(tiling.maxbuf_cl, 1.0f);
@@ -1759,85 +2364,10 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
     {
       piece->pipe->tiling = 1;
 
-      /* the output dimensions of the good part of this specific tile */
-      const size_t wd = (tx + 1) * tile_wd > roi_out->width ? (size_t)roi_out->width - tx * tile_wd : tile_wd;
-      const size_t ht = (ty + 1) * tile_ht > roi_out->height ? (size_t)roi_out->height - ty * tile_ht : tile_ht;
-
-      /* roi_in and roi_out of good part: oroi_good easy to calculate based on number and dimension of tile.
-         iroi_good is calculated by modify_roi_in() of respective module */
-      dt_iop_roi_t iroi_good = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
-      dt_iop_roi_t oroi_good
-          = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
-
-      self->modify_roi_in(self, piece, &oroi_good, &iroi_good);
-
-      /* clamp iroi_good to not exceed roi_in */
-      iroi_good.x = _max(iroi_good.x, roi_in->x);
-      iroi_good.y = _max(iroi_good.y, roi_in->y);
-      iroi_good.width = _min(iroi_good.width, roi_in->width + roi_in->x - iroi_good.x);
-      iroi_good.height = _min(iroi_good.height, roi_in->height + roi_in->y - iroi_good.y);
-
-      //_print_roi(&iroi_good, "tile iroi_good");
-      //_print_roi(&oroi_good, "tile oroi_good");
-
-      /* now we need to calculate full region of this tile: increase input roi to take care of overlap
-         requirements
-         and alignment and add additional delta to correct for possible rounding errors in modify_roi_in()
-         -> generates first estimate of iroi_full */
-      const int x_in = iroi_good.x;
-      const int y_in = iroi_good.y;
-      const int width_in = iroi_good.width;
-      const int height_in = iroi_good.height;
-      const int new_x_in = _max(_align_down(x_in - overlap_in - delta, xyalign), roi_in->x);
-      const int new_y_in = _max(_align_down(y_in - overlap_in - delta, xyalign), roi_in->y);
-      const int new_width_in = _min(_align_up(width_in + overlap_in + delta + (x_in - new_x_in), xyalign),
-                                    roi_in->width + roi_in->x - new_x_in);
-      const int new_height_in = _min(_align_up(height_in + overlap_in + delta + (y_in - new_y_in), xyalign),
-                                     roi_in->height + roi_in->y - new_y_in);
-
-      /* iroi_full based on calculated numbers and dimensions. oroi_full just set as a starting point for the
-       * following iterative search */
-      dt_iop_roi_t iroi_full = { new_x_in, new_y_in, new_width_in, new_height_in, iroi_good.scale };
-      dt_iop_roi_t oroi_full = oroi_good; // a good starting point for optimization
-
-      //_print_roi(&iroi_full, "tile iroi_full before optimization");
-      //_print_roi(&oroi_full, "tile oroi_full before optimization");
-
-      /* try to find a matching oroi_full */
-      if(!_fit_output_to_input_roi(self, piece, &iroi_full, &oroi_full, delta, 10))
-      {
-        dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_roi] can not handle requested roi's. tiling "
-                                  "for module '%s' not possible.\n",
-                 self->op);
+      dt_iop_roi_t iroi_full, oroi_full, oroi_good;
+      if(!_tiling_cl_roi_tile(self, piece, roi_in, roi_out, tx, ty, tile_wd, tile_ht, overlap_in, delta, xyalign,
+                              &iroi_full, &oroi_full, &oroi_good))
         goto error;
-      }
-
-
-      /* make sure that oroi_full at least covers the range of oroi_good.
-         this step is needed due to the possibility of rounding errors */
-      oroi_full.x = _min(oroi_full.x, oroi_good.x);
-      oroi_full.y = _min(oroi_full.y, oroi_good.y);
-      oroi_full.width = _max(oroi_full.width, oroi_good.x + oroi_good.width - oroi_full.x);
-      oroi_full.height = _max(oroi_full.height, oroi_good.y + oroi_good.height - oroi_full.y);
-
-      /* clamp oroi_full to not exceed roi_out */
-      oroi_full.x = _max(oroi_full.x, roi_out->x);
-      oroi_full.y = _max(oroi_full.y, roi_out->y);
-      oroi_full.width = _min(oroi_full.width, roi_out->width + roi_out->x - oroi_full.x);
-      oroi_full.height = _min(oroi_full.height, roi_out->height + roi_out->y - oroi_full.y);
-
-
-      /* calculate final iroi_full */
-      self->modify_roi_in(self, piece, &oroi_full, &iroi_full);
-
-      /* clamp iroi_full to not exceed roi_in */
-      iroi_full.x = _max(iroi_full.x, roi_in->x);
-      iroi_full.y = _max(iroi_full.y, roi_in->y);
-      iroi_full.width = _min(iroi_full.width, roi_in->width + roi_in->x - iroi_full.x);
-      iroi_full.height = _min(iroi_full.height, roi_in->height + roi_in->y - iroi_full.y);
-
-      //_print_roi(&iroi_full, "tile iroi_full");
-      //_print_roi(&oroi_full, "tile oroi_full");
 
       /* offsets of tile into ivoid and ovoid */
       const size_t ioffs = ((size_t)iroi_full.y - roi_in->y) * ipitch + ((size_t)iroi_full.x - roi_in->x) * in_bpp;
@@ -1860,38 +2390,78 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       size_t oorigin[] = { oroi_good.x - oroi_full.x, oroi_good.y - oroi_full.y, 0 };
       size_t oregion[] = { oroi_good.width, oroi_good.height, 1 };
 
-      /* get opencl input and output buffers */
-      input = dt_opencl_alloc_device(devid, iroi_full.width, iroi_full.height, in_bpp);
-      if(input == NULL) goto error;
-
-      output = dt_opencl_alloc_device(devid, oroi_full.width, oroi_full.height, out_bpp);
-      if(output == NULL) goto error;
-
-      if(use_pinned_memory)
+      /* get opencl input and output buffers, the input of this tile may be on its way already */
+      if(next_input)
+      {
+        input = next_input;
+        input_event = next_event;
+        next_input = NULL;
+        next_event = NULL;
+      }
+      else
       {
+        input = dt_opencl_alloc_device(devid, iroi_full.width, iroi_full.height, in_bpp);
+        if(input == NULL) goto error;
+
+        if(use_pinned_memory)
+        {
 /* prepare pinned input tile buffer: copy part of input image */
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
-        dt_omp_sharedconst(ioffs) shared(input_buffer, width, iroi_full) schedule(static)
+          dt_omp_firstprivate(in_bpp, ipitch, ivoid) \
+          dt_omp_sharedconst(ioffs) shared(input_buffer, width, iroi_full) schedule(static)
 #endif
-        for(size_t j = 0; j < iroi_full.height; j++)
-          memcpy((char *)input_buffer + j * iroi_full.width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
-                 (size_t)iroi_full.width * in_bpp);
-
-        /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, iorigin, iregion,
-                                                 (size_t)iroi_full.width * in_bpp, CL_TRUE);
-        if(err != CL_SUCCESS) goto error;
+          for(size_t j = 0; j < iroi_full.height; j++)
+            memcpy((char *)input_buffer + j * iroi_full.width * in_bpp, (char *)ivoid + ioffs + j * ipitch,
+                   (size_t)iroi_full.width * in_bpp);
+
+          /* blocking memory transfer: pinned host input buffer -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, (char *)input_buffer, input, iorigin, iregion,
+                                                   (size_t)iroi_full.width * in_bpp, CL_TRUE);
+          if(err != CL_SUCCESS) goto error;
+        }
+        else if(prefetch)
+        {
+          /* the first tile: nothing to overlap with yet */
+          err = dt_opencl_write_host_to_device_async(devid, (char *)ivoid + ioffs, input, iorigin, iregion,
+                                                     ipitch, &input_event);
+          if(err != CL_SUCCESS) goto error;
+        }
+        else
+        {
+          /* blocking direct memory transfer: host input image -> opencl/device tile */
+          err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, iorigin, iregion,
+                                                   ipitch, CL_TRUE);
+          if(err != CL_SUCCESS) goto error;
+        }
       }
-      else
+
+      output = dt_opencl_alloc_device(devid, oroi_full.width, oroi_full.height, out_bpp);
+      if(output == NULL) goto error;
+
+      /* start the upload of the next tile, it overlaps with the kernels of this one */
+      const size_t ntx = ty + 1 < tiles_y ? tx : tx + 1;
+      const size_t nty = ty + 1 < tiles_y ? ty + 1 : 0;
+      if(prefetch && ntx < tiles_x)
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
-        err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, iorigin, iregion,
-                                                 ipitch, CL_TRUE);
+        dt_iop_roi_t niroi, noroi, noroi_good;
+        if(!_tiling_cl_roi_tile(self, piece, roi_in, roi_out, ntx, nty, tile_wd, tile_ht, overlap_in, delta,
+                                xyalign, &niroi, &noroi, &noroi_good))
+          goto error;
+        const size_t nioffs = ((size_t)niroi.y - roi_in->y) * ipitch + ((size_t)niroi.x - roi_in->x) * in_bpp;
+        const size_t norigin[] = { 0, 0, 0 };
+        const size_t nregion[] = { niroi.width, niroi.height, 1 };
+        next_input = dt_opencl_alloc_device(devid, niroi.width, niroi.height, in_bpp);
+        if(next_input == NULL) goto error;
+        err = dt_opencl_write_host_to_device_async(devid, (char *)ivoid + nioffs, next_input, norigin, nregion,
+                                                   ipitch, &next_event);
         if(err != CL_SUCCESS) goto error;
       }
 
+      /* kernels of this tile start once its input is complete */
+      err = dt_opencl_wait_for_transfer(devid, &input_event);
+      if(err != CL_SUCCESS) goto error;
+
       /* take original processed_maximum as starting point */
       for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
@@ -1969,6 +2539,11 @@ error:
   dt_opencl_release_mem_object(pinned_output);
   dt_opencl_release_mem_object(input);
   dt_opencl_release_mem_object(output);
+  /* uploads still in flight must not land in buffers handed out again */
+  dt_opencl_finish_transfers(devid);
+  dt_opencl_wait_for_transfer(devid, &input_event);
+  dt_opencl_wait_for_transfer(devid, &next_event);
+  dt_opencl_release_mem_object(next_input);
   piece->pipe->tiling = 0;
   dt_print(
       DT_DEBUG_OPENCL,
@@ -2048,10 +2623,102 @@ void default_tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpi
   return;
 }
 
+gboolean dt_tiling_cl_spread_over_devices(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                          const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+#ifdef HAVE_OPENCL
+  // smaller images are not worth the extra transfers
+  const size_t min_pixels = 16lu * 1024lu * 1024lu;
+  return (piece->pipe->type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT
+         && darktable.opencl->num_devs > 1 && (size_t)roi_in->width * roi_in->height >= min_pixels
+         && !memcmp(roi_in, roi_out, sizeof(struct dt_iop_roi_t)) && !(self->flags() & IOP_FLAGS_TILING_FULL_ROI)
+         && dt_conf_get_bool("opencl_tiling_multiple_devices");
+#else
+  return FALSE;
+#endif
+}
+
+/* measured factors by module and version, mirrored in darktablerc so they survive the session. a factor
+   follows a higher measurement right away and a lower one only slowly, as the memory needed depends on
+   the parameters as well. */
+typedef struct _measured_factor_t
+{
+  float cpu, cl; // 0 while unknown
+} _measured_factor_t;
+
+static GMutex _measured_lock;
+static GHashTable *_measured = NULL;
+
+static gchar *_measured_conf_key(const struct dt_iop_module_t *self, const gboolean opencl)
+{
+  return g_strdup_printf("tiling_measured/%s_v%d/factor%s", self->op, self->version(), opencl ? "_cl" : "");
+}
+
+// call with _measured_lock held
+static _measured_factor_t *_measured_get(struct dt_iop_module_t *self)
+{
+  if(!_measured) _measured = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  gchar *key = g_strdup_printf("%s_v%d", self->op, self->version());
+  _measured_factor_t *m = g_hash_table_lookup(_measured, key);
+  if(m)
+  {
+    g_free(key);
+    return m;
+  }
+
+  m = g_malloc0(sizeof(_measured_factor_t));
+  for(int cl = 0; cl < 2; cl++)
+  {
+    gchar *conf = _measured_conf_key(self, cl);
+    if(dt_conf_key_exists(conf)) *(cl ? &m->cl : &m->cpu) = dt_conf_get_float(conf);
+    g_free(conf);
+  }
+  g_hash_table_insert(_measured, key, m);
+  return m;
+}
+
+void dt_tiling_record_peak(struct dt_iop_module_t *self, const gboolean opencl, const size_t required,
+                           const size_t used)
+{
+  if(required == 0) return;
+  const float sample = (float)used / required;
+
+  g_mutex_lock(&_measured_lock);
+  _measured_factor_t *m = _measured_get(self);
+  float *factor = opencl ? &m->cl : &m->cpu;
+  const float old = *factor;
+  *factor = old > 0.0f ? fmaxf(sample, 0.9f * old + 0.1f * sample) : sample;
+  const gboolean changed = fabsf(*factor - old) > 0.05f * old;
+  const float value = *factor;
+  g_mutex_unlock(&_measured_lock);
+
+  if(changed)
+  {
+    gchar *conf = _measured_conf_key(self, opencl);
+    dt_conf_set_float(conf, value);
+    g_free(conf);
+    dt_print(DT_DEBUG_DEV, "[tiling] module '%s' measured %s factor %.2f\n", self->op,
+             opencl ? "opencl" : "cpu", value);
+  }
+}
+
+float dt_tiling_refined_factor(struct dt_iop_module_t *self, const gboolean opencl, const float factor)
+{
+  g_mutex_lock(&_measured_lock);
+  const _measured_factor_t *m = _measured_get(self);
+  const float measured = opencl ? m->cl : m->cpu;
+  g_mutex_unlock(&_measured_lock);
+
+  // a little headroom for what wasn't seen yet
+  return measured > 0.0f ? 1.1f * measured : factor;
+}
+
 int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
                                      const float factor, const size_t overhead)
 {
-  const size_t available = dt_get_available_mem();
+  // what the other pipes leave, while they hold much we tile earlier
+  const size_t available = _host_memory_available();
   const size_t total = factor * width * height * bpp + overhead;
 
   if(total <= available)
@@ -74,6 +74,20 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
 int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, const unsigned bpp,
                                      const float factor, const size_t overhead);
 
+/** remember how much memory process() (or process_cl() with opencl) of a module really needed when run
+ * untiled: used is input, output and every buffer allocated on top of them at the peak, required the size
+ * the factors of dt_develop_tiling_t are relative to. kept per module version across sessions. */
+void dt_tiling_record_peak(struct dt_iop_module_t *self, const gboolean opencl, const size_t required,
+                           const size_t used);
+
+/** the factor (or factor_cl) estimated by the module's tiling_callback(), replaced by the measured one once
+ * the module was seen running */
+float dt_tiling_refined_factor(struct dt_iop_module_t *self, const gboolean opencl, const float factor);
+
+/** exports of big images may run a module tiled over several opencl devices even if it would fit on one */
+gboolean dt_tiling_cl_spread_over_devices(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                          const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -1054,70 +1054,48 @@ static void _thumbs_prefetch(dt_culling_t *table)
   }
   dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, maxw, maxh);
 
-  // prefetch next image
-  gchar *query;
-  sqlite3_stmt *stmt;
-  dt_thumbnail_t *last = (dt_thumbnail_t *)g_list_last(table->list)->data;
-  if(table->navigate_inside_selection)
-  {
-    query = g_strdup_printf(
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m, main.selected_images AS s "
-                          "WHERE m.imgid = s.imgid"
-                          " AND m.rowid > (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid "
-                          "LIMIT 1",
-                          last->imgid);
-  }
-  else
-  {
-    query = g_strdup_printf(
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m "
-                          "WHERE m.rowid > (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid "
-                          "LIMIT 1",
-                          last->imgid);
-  }
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const int id = sqlite3_column_int(stmt, 0);
-    if(id > 0) dt_mipmap_cache_get(darktable.mipmap_cache, NULL, id, mip, DT_MIPMAP_PREFETCH, 'r');
-  }
-  sqlite3_finalize(stmt);
-  g_free(query);
-
-  // prefetch previous image
-  dt_thumbnail_t *prev = (dt_thumbnail_t *)(table->list)->data;
-  if(table->navigate_inside_selection)
-  {
-    query = g_strdup_printf(
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m, main.selected_images AS s "
-                          "WHERE m.imgid = s.imgid"
-                          " AND m.rowid < (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid DESC "
-                          "LIMIT 1",
-                          prev->imgid);
-  }
-  else
-  {
-    query = g_strdup_printf(
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m "
-                          "WHERE m.rowid < (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid DESC "
-                          "LIMIT 1",
-                          prev->imgid);
-  }
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const int id = sqlite3_column_int(stmt, 0);
-    if(id > 0) dt_mipmap_cache_get(darktable.mipmap_cache, NULL, id, mip, DT_MIPMAP_PREFETCH, 'r');
+  // prefetch as many images on each side as the slideshow renders ahead, the mipmap cache bounds the memory
+  const int ahead = CLAMP(dt_conf_get_int("slideshow_render_ahead"), 1, 4);
+  const dt_thumbnail_t *last = (dt_thumbnail_t *)g_list_last(table->list)->data;
+  const dt_thumbnail_t *first = (dt_thumbnail_t *)(table->list)->data;
+  for(int dir = 0; dir < 2; dir++)
+  {
+    const char *cmp = dir ? "<" : ">";
+    const char *order = dir ? "DESC" : "ASC";
+    gchar *query;
+    if(table->navigate_inside_selection)
+    {
+      query = g_strdup_printf(
+                            "SELECT m.imgid "
+                            "FROM memory.collected_images AS m, main.selected_images AS s "
+                            "WHERE m.imgid = s.imgid"
+                            " AND m.rowid %s (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=?1) "
+                            "ORDER BY m.rowid %s "
+                            "LIMIT ?2",
+                            cmp, order);
+    }
+    else
+    {
+      query = g_strdup_printf(
+                            "SELECT m.imgid "
+                            "FROM memory.collected_images AS m "
+                            "WHERE m.rowid %s (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=?1) "
+                            "ORDER BY m.rowid %s "
+                            "LIMIT ?2",
+                            cmp, order);
+    }
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, dir ? first->imgid : last->imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, ahead);
+    while(sqlite3_step(stmt) == SQLITE_ROW)
+    {
+      const int id = sqlite3_column_int(stmt, 0);
+      if(id > 0) dt_mipmap_cache_get(darktable.mipmap_cache, NULL, id, mip, DT_MIPMAP_PREFETCH, 'r');
+    }
+    sqlite3_finalize(stmt);
+    g_free(query);
   }
-  sqlite3_finalize(stmt);
 }
 
 static gboolean _thumbs_recreate_list_at(dt_culling_t *table, const int offset)
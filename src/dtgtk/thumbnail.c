@@ -161,8 +161,29 @@ static void _image_get_infos(dt_thumbnail_t *thumb)
 
   const int old_rating = thumb->rating;
   thumb->rating = 0;
-  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
-  if(img)
+  // the compact copy is enough for all of this, and doesn't lock the image
+  dt_image_hot_t hot;
+  const gboolean has_hot = dt_image_cache_get_hot(darktable.image_cache, thumb->imgid, &hot);
+  const dt_image_t *img = has_hot ? NULL : dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
+  if(has_hot)
+  {
+    thumb->has_localcopy = (hot.flags & DT_IMAGE_LOCAL_COPY);
+    thumb->rating = hot.flags & DT_IMAGE_REJECTED ? DT_VIEW_REJECT : (hot.flags & DT_VIEW_RATINGS_MASK);
+    thumb->is_bw = hot.flags & (DT_IMAGE_MONOCHROME | DT_IMAGE_MONOCHROME_PREVIEW | DT_IMAGE_MONOCHROME_BAYER);
+    thumb->is_bw_flow = (hot.flags & (DT_IMAGE_MONOCHROME | DT_IMAGE_MONOCHROME_BAYER))
+                        || ((hot.flags & DT_IMAGE_MONOCHROME_PREVIEW) && (hot.flags & DT_IMAGE_MONOCHROME_WORKFLOW));
+    thumb->is_hdr = (hot.flags & DT_IMAGE_HDR) != 0;
+    if(!thumb->is_hdr && thumb->filename)
+    {
+      const char *ext = thumb->filename + strlen(thumb->filename);
+      while(ext > thumb->filename && *ext != '.') ext--;
+      thumb->is_hdr = !g_ascii_strcasecmp(ext, ".exr") || !g_ascii_strcasecmp(ext, ".hdr")
+                      || !g_ascii_strcasecmp(ext, ".pfm");
+    }
+
+    thumb->groupid = hot.group_id;
+  }
+  else if(img)
   {
     thumb->has_localcopy = (img->flags & DT_IMAGE_LOCAL_COPY);
     thumb->rating = img->flags & DT_IMAGE_REJECTED ? DT_VIEW_REJECT : (img->flags & DT_VIEW_RATINGS_MASK);
@@ -182,23 +203,35 @@ static void _image_get_infos(dt_thumbnail_t *thumb)
 
   // colorlabels
   thumb->colorlabels = 0;
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.get_color);
-  DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.get_color);
-  DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_color, 1, thumb->imgid);
-  while(sqlite3_step(darktable.view_manager->statements.get_color) == SQLITE_ROW)
+  if(has_hot)
   {
-    const int col = sqlite3_column_int(darktable.view_manager->statements.get_color, 0);
     // we reuse CPF_* flags, as we'll pass them to the paint fct after
-    if(col == 0)
-      thumb->colorlabels |= CPF_DIRECTION_UP;
-    else if(col == 1)
-      thumb->colorlabels |= CPF_DIRECTION_DOWN;
-    else if(col == 2)
-      thumb->colorlabels |= CPF_DIRECTION_LEFT;
-    else if(col == 3)
-      thumb->colorlabels |= CPF_DIRECTION_RIGHT;
-    else if(col == 4)
-      thumb->colorlabels |= CPF_BG_TRANSPARENT;
+    if(hot.colorlabels & (1 << 0)) thumb->colorlabels |= CPF_DIRECTION_UP;
+    if(hot.colorlabels & (1 << 1)) thumb->colorlabels |= CPF_DIRECTION_DOWN;
+    if(hot.colorlabels & (1 << 2)) thumb->colorlabels |= CPF_DIRECTION_LEFT;
+    if(hot.colorlabels & (1 << 3)) thumb->colorlabels |= CPF_DIRECTION_RIGHT;
+    if(hot.colorlabels & (1 << 4)) thumb->colorlabels |= CPF_BG_TRANSPARENT;
+  }
+  else
+  {
+    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.get_color);
+    DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.get_color);
+    DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.get_color, 1, thumb->imgid);
+    while(sqlite3_step(darktable.view_manager->statements.get_color) == SQLITE_ROW)
+    {
+      const int col = sqlite3_column_int(darktable.view_manager->statements.get_color, 0);
+      // we reuse CPF_* flags, as we'll pass them to the paint fct after
+      if(col == 0)
+        thumb->colorlabels |= CPF_DIRECTION_UP;
+      else if(col == 1)
+        thumb->colorlabels |= CPF_DIRECTION_DOWN;
+      else if(col == 2)
+        thumb->colorlabels |= CPF_DIRECTION_LEFT;
+      else if(col == 3)
+        thumb->colorlabels |= CPF_DIRECTION_RIGHT;
+      else if(col == 4)
+        thumb->colorlabels |= CPF_BG_TRANSPARENT;
+    }
   }
   if(thumb->w_color)
   {
@@ -232,6 +265,91 @@ static gboolean _thumb_expose_again(gpointer user_data)
   return FALSE;
 }
 
+// the surface of a thumbnail prepared by a worker (mipmap to display profile and scaling), so that the gui
+// thread only has to paint it. it is handed back to the gui thread once the job is done or discarded and it
+// is only freed there.
+typedef struct dt_thumbnail_surface_request_t
+{
+  dt_thumbnail_t *thumb; // NULL once the thumbnail is gone or wants another surface
+  int imgid;
+  int width;
+  int height;
+  cairo_surface_t *surface;
+  dt_view_surface_value_t res;
+  gboolean delivered; // the worker is done with it
+} dt_thumbnail_surface_request_t;
+
+static void _thumb_surface_request_free(dt_thumbnail_surface_request_t *req)
+{
+  if(req->surface && cairo_surface_get_reference_count(req->surface) > 0) cairo_surface_destroy(req->surface);
+  free(req);
+}
+
+// forget the pending surface of the thumbnail, if the worker still has it it will free it
+static void _thumb_surface_request_drop(dt_thumbnail_t *thumb)
+{
+  dt_thumbnail_surface_request_t *req = thumb->surf_request;
+  if(!req) return;
+  thumb->surf_request = NULL;
+  if(req->delivered)
+    _thumb_surface_request_free(req);
+  else
+    req->thumb = NULL;
+}
+
+static gboolean _thumb_surface_request_deliver(gpointer user_data)
+{
+  dt_thumbnail_surface_request_t *req = (dt_thumbnail_surface_request_t *)user_data;
+  if(!req->thumb)
+  {
+    _thumb_surface_request_free(req);
+    return FALSE;
+  }
+  req->delivered = TRUE;
+  if(req->thumb->w_image) gtk_widget_queue_draw(req->thumb->w_image);
+  return FALSE;
+}
+
+static int32_t _thumb_surface_request_job_run(dt_job_t *job)
+{
+  dt_thumbnail_surface_request_t *req = dt_control_job_get_params(job);
+  req->res = dt_view_image_get_surface(req->imgid, req->width, req->height, &req->surface, FALSE);
+  return 0;
+}
+
+// called once the job is done, or discarded without having run
+static void _thumb_surface_request_job_done(void *data)
+{
+  g_idle_add(_thumb_surface_request_deliver, data);
+}
+
+static void _thumb_surface_request(dt_thumbnail_t *thumb, const int width, const int height)
+{
+  dt_thumbnail_surface_request_t *req = thumb->surf_request;
+  if(req && req->imgid == thumb->imgid && req->width == width && req->height == height) return;
+  _thumb_surface_request_drop(thumb);
+
+  req = (dt_thumbnail_surface_request_t *)calloc(1, sizeof(dt_thumbnail_surface_request_t));
+  req->thumb = thumb;
+  req->imgid = thumb->imgid;
+  req->width = width;
+  req->height = height;
+  req->res = DT_VIEW_SURFACE_KO;
+  thumb->surf_request = req;
+
+  dt_job_t *job = dt_control_job_create(&_thumb_surface_request_job_run, "thumbnail surface %d %dx%d",
+                                        thumb->imgid, width, height);
+  if(!job)
+  {
+    thumb->surf_request = NULL;
+    free(req);
+    return;
+  }
+  dt_control_job_set_params(job, req, _thumb_surface_request_job_done);
+  // the thumbnails queued last are the ones shown now, the stack of this queue serves them first
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+}
+
 static void _thumb_set_image_size(dt_thumbnail_t *thumb, int image_w, int image_h)
 {
   int imgbox_w = 0;
@@ -370,12 +488,8 @@ static void _get_dimensions_for_img_to_fit(dt_thumbnail_t *thumb, int max_width,
   if(ar < 0.001)
   {
     // let's try with the aspect_ratio store in image structure, even if it's less accurate
-    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
-    if(img)
-    {
-      ar = img->aspect_ratio;
-      dt_image_cache_read_release(darktable.image_cache, img);
-    }
+    dt_image_hot_t hot;
+    if(dt_image_cache_get_hot(darktable.image_cache, thumb->imgid, &hot)) ar = hot.aspect_ratio;
   }
 
   if(ar > 0.001)
@@ -405,15 +519,12 @@ static void _get_dimensions_for_zoomed_img(dt_thumbnail_t *thumb, int max_width,
   // calling dt_thumbnail_get_zoom100 is used to get the max zoom, but also to ensure that final_width and
   // height are available.
   const float zoom_100 = dt_thumbnail_get_zoom100(thumb);
-  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
-  if(img)
+  dt_image_hot_t hot;
+  if(dt_image_cache_get_hot(darktable.image_cache, thumb->imgid, &hot) && hot.final_width > 0
+     && hot.final_height > 0)
   {
-    if(img->final_width > 0 && img->final_height > 0)
-    {
-      iw = img->final_width;
-      ih = img->final_height;
-    }
-    dt_image_cache_read_release(darktable.image_cache, img);
+    iw = hot.final_width;
+    ih = hot.final_height;
   }
 
   // scale first to "img to fit", then apply the zoom ratio to get the resulting final (zoomed) image
@@ -605,26 +716,37 @@ static gboolean _event_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_
     }
     else
     {
-      cairo_surface_t *img_surf = NULL;
+      int surf_w = image_w;
+      int surf_h = image_h;
       if(thumb->zoomable)
       {
         if(thumb->zoom > 1.0f)
           thumb->zoom = MIN(thumb->zoom, dt_thumbnail_get_zoom100(thumb));
-        res = dt_view_image_get_surface(thumb->imgid, image_w * thumb->zoom, image_h * thumb->zoom, &img_surf, FALSE);
+        surf_w = image_w * thumb->zoom;
+        surf_h = image_h * thumb->zoom;
       }
-      else
+
+      // the surface is prepared by a worker, until it is there we keep painting the one we have
+      dt_thumbnail_surface_request_t *req = thumb->surf_request;
+      if(!req || !req->delivered || req->imgid != thumb->imgid || req->width != surf_w || req->height != surf_h)
       {
-        res = dt_view_image_get_surface(thumb->imgid, image_w, image_h, &img_surf, FALSE);
+        _thumb_surface_request(thumb, surf_w, surf_h);
+        if(!thumb->img_surf) thumb->busy = TRUE;
+        _thumb_draw_image(thumb, cr);
+        return TRUE;
       }
 
+      res = req->res;
       if(res == DT_VIEW_SURFACE_OK || res == DT_VIEW_SURFACE_SMALLER)
       {
         // if we succeed to get an image (even a smaller one)
         cairo_surface_t *tmp_surf = thumb->img_surf;
-        thumb->img_surf = img_surf;
+        thumb->img_surf = req->surface;
+        req->surface = NULL;
         if(tmp_surf && cairo_surface_get_reference_count(tmp_surf) > 0)
           cairo_surface_destroy(tmp_surf);
       }
+      _thumb_surface_request_drop(thumb);
       thumb->img_surf_preview = FALSE;
     }
 
@@ -1013,14 +1135,7 @@ void dt_thumbnail_update_selection(dt_thumbnail_t *thumb)
   if(!thumb) return;
   if(!gtk_widget_is_visible(thumb->w_main)) return;
 
-  gboolean selected = FALSE;
-  /* clear and reset statements */
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(darktable.view_manager->statements.is_selected);
-  DT_DEBUG_SQLITE3_RESET(darktable.view_manager->statements.is_selected);
-  /* bind imgid to prepared statements */
-  DT_DEBUG_SQLITE3_BIND_INT(darktable.view_manager->statements.is_selected, 1, thumb->imgid);
-  /* lets check if imgid is selected */
-  if(sqlite3_step(darktable.view_manager->statements.is_selected) == SQLITE_ROW) selected = TRUE;
+  const gboolean selected = dt_selection_is_selected(darktable.selection, thumb->imgid);
 
   // if there's a change, update the thumb
   if(selected != thumb->selected)
@@ -1102,7 +1217,8 @@ static void _dt_mipmaps_updated_callback(gpointer instance, int imgid, gpointer
     }
   }
 
-  // reset surface
+  // reset surface, one still being prepared is from the old mipmap
+  _thumb_surface_request_drop(thumb);
   thumb->img_surf_dirty = TRUE;
   gtk_widget_queue_draw(thumb->w_main);
 }
@@ -1537,6 +1653,7 @@ void dt_thumbnail_destroy(dt_thumbnail_t *thumb)
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_dt_preview_updated_callback), thumb);
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_dt_image_info_changed_callback), thumb);
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_dt_collection_changed_callback), thumb);
+  _thumb_surface_request_drop(thumb);
   if(thumb->img_surf && cairo_surface_get_reference_count(thumb->img_surf) > 0)
     cairo_surface_destroy(thumb->img_surf);
   thumb->img_surf = NULL;
@@ -1914,6 +2031,7 @@ void dt_thumbnail_set_drop(dt_thumbnail_t *thumb, gboolean accept_drop)
 // force the image to be reloaded from cache if any
 void dt_thumbnail_image_refresh(dt_thumbnail_t *thumb)
 {
+  _thumb_surface_request_drop(thumb);
   thumb->img_surf_dirty = TRUE;
 
   // we ensure that the image is not completely outside the thumbnail, otherwise the image_draw is not triggered
@@ -2052,6 +2170,64 @@ void dt_thumbnail_reload_infos(dt_thumbnail_t *thumb)
   gtk_label_set_markup(GTK_LABEL(thumb->w_bottom), lb);
   g_free(lb);
 }
+
+void dt_thumbnail_set_image(dt_thumbnail_t *thumb, const int imgid, const int rowid)
+{
+  _thumb_surface_request_drop(thumb);
+  if(thumb->img_surf && cairo_surface_get_reference_count(thumb->img_surf) > 0)
+    cairo_surface_destroy(thumb->img_surf);
+  thumb->img_surf = NULL;
+  thumb->img_surf_dirty = TRUE;
+  thumb->img_surf_preview = FALSE;
+  thumb->busy = FALSE;
+
+  thumb->imgid = imgid;
+  thumb->rowid = rowid;
+  thumb->zoom = 1.0f;
+  thumb->zoomx = 0.0;
+  thumb->zoomy = 0.0;
+  thumb->mouse_over = (dt_control_get_mouse_over_id() == imgid);
+  if(!thumb->mouse_over) _set_flag(thumb->w_bottom_eb, GTK_STATE_FLAG_PRELIGHT, FALSE);
+  dt_thumbnail_set_group_border(thumb, DT_THUMBNAIL_BORDER_NONE);
+
+  // same infos as dt_thumbnail_new() reads
+  g_free(thumb->filename);
+  thumb->filename = NULL;
+  thumb->has_audio = FALSE;
+  thumb->has_localcopy = FALSE;
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
+  if(img)
+  {
+    thumb->filename = g_strdup(img->filename);
+    if(thumb->over != DT_THUMBNAIL_OVERLAYS_NONE)
+    {
+      thumb->has_audio = (img->flags & DT_IMAGE_HAS_WAV);
+      thumb->has_localcopy = (img->flags & DT_IMAGE_LOCAL_COPY);
+    }
+    dt_image_cache_read_release(darktable.image_cache, img);
+  }
+  gchar *lb = NULL;
+  if(thumb->over == DT_THUMBNAIL_OVERLAYS_ALWAYS_EXTENDED
+     || thumb->over == DT_THUMBNAIL_OVERLAYS_HOVER_EXTENDED
+     || thumb->over == DT_THUMBNAIL_OVERLAYS_MIXED
+     || thumb->over == DT_THUMBNAIL_OVERLAYS_HOVER_BLOCK)
+  {
+    _thumb_update_extended_infos_line(thumb);
+    lb = g_strdup(thumb->info_line);
+  }
+  gtk_label_set_markup(GTK_LABEL(thumb->w_bottom), lb);
+  g_free(lb);
+
+  _image_get_infos(thumb);
+  _dt_active_images_callback(NULL, thumb);
+  _dt_selection_changed_callback(NULL, thumb);
+  _image_update_group_tooltip(thumb);
+  _thumb_write_extension(thumb);
+  // this also sets the tooltips and the history one of the altered icon
+  _thumb_update_icons(thumb);
+
+  gtk_widget_queue_draw(thumb->w_main);
+}
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -96,6 +96,7 @@ typedef struct
   cairo_surface_t *img_surf; // cached surface at exact dimensions to speed up redraw
   gboolean img_surf_preview; // if TRUE, the image is originated from preview pipe
   gboolean img_surf_dirty;   // if TRUE, we need to recreate the surface on next drawing code
+  struct dt_thumbnail_surface_request_t *surf_request; // surface being prepared off the gui thread
 
   GtkWidget *w_cursor;    // GtkDrawingArea -- triangle to show current image(s) in filmstrip
   GtkWidget *w_bottom_eb; // GtkEventBox -- background of the bottom infos area (contains w_bottom)
@@ -171,6 +172,9 @@ void dt_thumbnail_set_overlay(dt_thumbnail_t *thumb, dt_thumbnail_overlay_t over
 // force reloading image infos
 void dt_thumbnail_reload_infos(dt_thumbnail_t *thumb);
 
+// show another image in an existing thumbnail, reusing all its widgets
+void dt_thumbnail_set_image(dt_thumbnail_t *thumb, const int imgid, const int rowid);
+
 // force image position refresh (only in the case of zoomed image)
 void dt_thumbnail_image_refresh_position(dt_thumbnail_t *thumb);
 // get the maximal zoom value (to show 1:1 image)
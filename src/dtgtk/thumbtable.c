@@ -23,10 +23,12 @@
 #include "common/debug.h"
 #include "common/history.h"
 #include "common/image_cache.h"
+#include "common/mipmap_cache.h"
 #include "common/ratings.h"
 #include "common/selection.h"
 #include "common/undo.h"
 #include "control/control.h"
+#include "control/jobs.h"
 #include "gui/accelerators.h"
 #include "gui/drag_and_drop.h"
 #include "views/view.h"
@@ -51,6 +53,68 @@ static void _list_remove_thumb(gpointer user_data)
   dt_thumbnail_destroy(thumb);
 }
 
+// building the widgets of a thumbnail is the main cost of scrolling, so the ones scrolled out of view are
+// kept for the images scrolled in. at most one screen of them is kept.
+static void _thumbs_pool_release(dt_thumbtable_t *table, dt_thumbnail_t *thumb)
+{
+  if(g_list_length(table->pool) >= table->rows * table->thumbs_per_row)
+  {
+    _list_remove_thumb(thumb);
+    return;
+  }
+  gtk_widget_hide(thumb->w_main);
+  table->pool = g_list_prepend(table->pool, thumb);
+}
+
+// the pooled thumbnails are built for the current overlays, tooltips and timeouts, drop them when these change
+static void _thumbs_pool_flush(dt_thumbtable_t *table)
+{
+  g_list_free_full(table->pool, _list_remove_thumb);
+  table->pool = NULL;
+}
+
+// get a thumbnail for the image at the given position, from the pool if possible
+static dt_thumbnail_t *_thumbs_acquire(dt_thumbtable_t *table, const int imgid, const int rowid, const int posx,
+                                       const int posy, const int margin_start, const int margin_top)
+{
+  dt_thumbnail_t *thumb = NULL;
+  if(table->pool)
+  {
+    thumb = (dt_thumbnail_t *)table->pool->data;
+    table->pool = g_list_delete_link(table->pool, table->pool);
+    dt_thumbnail_set_image(thumb, imgid, rowid);
+    dt_thumbnail_resize(thumb, table->thumb_size, table->thumb_size, FALSE, IMG_TO_FIT);
+  }
+  else
+  {
+    thumb = dt_thumbnail_new(table->thumb_size, table->thumb_size, IMG_TO_FIT, imgid, rowid, table->overlays,
+                             DT_THUMBNAIL_CONTAINER_LIGHTTABLE, table->show_tooltips);
+  }
+
+  if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
+  {
+    thumb->single_click = TRUE;
+    thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
+  }
+  else
+  {
+    thumb->single_click = FALSE;
+    thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_NORMAL;
+  }
+  thumb->x = posx;
+  thumb->y = posy;
+  gtk_widget_set_margin_start(thumb->w_image_box, margin_start);
+  gtk_widget_set_margin_top(thumb->w_image_box, margin_top);
+  if(gtk_widget_get_parent(thumb->w_main))
+  {
+    gtk_layout_move(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
+    gtk_widget_show(thumb->w_main);
+  }
+  else
+    gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
+  return thumb;
+}
+
 // get the class name associated with the overlays mode
 static gchar *_thumbs_get_overlays_class(dt_thumbnail_overlay_t over)
 {
@@ -122,6 +186,7 @@ static void _thumbs_update_overlays_mode(dt_thumbtable_t *table)
 void dt_thumbtable_set_overlays_mode(dt_thumbtable_t *table, dt_thumbnail_overlay_t over)
 {
   if(!table) return;
+  _thumbs_pool_flush(table);
   // we ensure the tooltips change in any cases
   gchar *txt = g_strdup_printf("plugins/lighttable/tooltips/%d/%d", table->mode, table->prefs_size);
   dt_conf_set_bool(txt, table->show_tooltips);
@@ -177,6 +242,7 @@ void dt_thumbtable_set_overlays_block_timeout(dt_thumbtable_t *table, const int
   g_free(txt);
 
   table->overlays_block_timeout = timeout;
+  _thumbs_pool_flush(table);
 
   // we need to change the overlay timeout for each thumbnails
   for(const GList *l = table->list; l; l = g_list_next(l))
@@ -216,30 +282,28 @@ static dt_thumbnail_t *_thumb_get_under_mouse(dt_thumbtable_t *table)
 static int _thumb_get_imgid(int rowid)
 {
   int id = -1;
-  sqlite3_stmt *stmt;
-  gchar *query = g_strdup_printf("SELECT imgid FROM memory.collected_images WHERE rowid=%d", rowid);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "SELECT imgid FROM memory.collected_images WHERE rowid=?1");
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, rowid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     id = sqlite3_column_int(stmt, 0);
   }
-  g_free(query);
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
   return id;
 }
 // get rowid from imgid
 static int _thumb_get_rowid(int imgid)
 {
   int id = -1;
-  sqlite3_stmt *stmt;
-  gchar *query = g_strdup_printf("SELECT rowid FROM memory.collected_images WHERE imgid=%d", imgid);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "SELECT rowid FROM memory.collected_images WHERE imgid=?1");
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     id = sqlite3_column_int(stmt, 0);
   }
-  g_free(query);
-  sqlite3_finalize(stmt);
+  dt_database_release_cached(darktable.db, stmt);
   return id;
 }
 
@@ -481,8 +545,7 @@ static int _thumbs_remove_unneeded(dt_thumbtable_t *table)
            && (th->x + table->thumb_size <= 0 || th->x > table->view_width)))
     {
       table->list = g_list_remove_link(table->list, l);
-      gtk_container_remove(GTK_CONTAINER(gtk_widget_get_parent(th->w_main)), th->w_main);
-      dt_thumbnail_destroy(th);
+      _thumbs_pool_release(table, th);
       g_list_free(l);
       l = table->list;
       changed++;
@@ -533,22 +596,9 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
     {
       if(posy < table->view_height) // we don't load invisible thumbs
       {
-        dt_thumbnail_t *thumb = dt_thumbnail_new(
-            table->thumb_size, table->thumb_size, IMG_TO_FIT, sqlite3_column_int(stmt, 1),
-            sqlite3_column_int(stmt, 0), table->overlays,
-            DT_THUMBNAIL_CONTAINER_LIGHTTABLE, table->show_tooltips);
-
-        if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        {
-          thumb->single_click = TRUE;
-          thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
-        }
-        thumb->x = posx;
-        thumb->y = posy;
+        dt_thumbnail_t *thumb = _thumbs_acquire(table, sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 0),
+                                                posx, posy, old_margin_start, old_margin_top);
         table->list = g_list_prepend(table->list, thumb);
-        gtk_widget_set_margin_start(thumb->w_image_box, old_margin_start);
-        gtk_widget_set_margin_top(thumb->w_image_box, old_margin_top);
-        gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
         changed++;
       }
       _pos_get_previous(table, &posx, &posy);
@@ -589,21 +639,9 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
     {
       if(posy + table->thumb_size >= 0) // we don't load invisible thumbs
       {
-        dt_thumbnail_t *thumb = dt_thumbnail_new
-          (table->thumb_size, table->thumb_size, IMG_TO_FIT, sqlite3_column_int(stmt, 1),
-           sqlite3_column_int(stmt, 0), table->overlays,
-           DT_THUMBNAIL_CONTAINER_LIGHTTABLE, table->show_tooltips);
-        if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        {
-          thumb->single_click = TRUE;
-          thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
-        }
-        thumb->x = posx;
-        thumb->y = posy;
+        dt_thumbnail_t *thumb = _thumbs_acquire(table, sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 0),
+                                                posx, posy, old_margin_start, old_margin_top);
         table->list = g_list_append(table->list, thumb);
-        gtk_widget_set_margin_start(thumb->w_image_box, old_margin_start);
-        gtk_widget_set_margin_top(thumb->w_image_box, old_margin_top);
-        gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
         changed++;
       }
       _pos_get_next(table, &posx, &posy);
@@ -615,6 +653,134 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
   return changed;
 }
 
+// at most that many prefetch jobs are queued, each for at most one screen of thumbnails
+#define DT_THUMBTABLE_PREFETCH_INFLIGHT 2
+// and we never look further ahead than that many screens
+#define DT_THUMBTABLE_PREFETCH_SCREENS 4
+
+typedef struct _thumbs_prefetch_t
+{
+  dt_thumbtable_t *table;
+  int generation;
+  dt_mipmap_size_t mip;
+  GList *imgs;       // imgids in scroll order
+  int generate;      // the first ones may be generated, the others only read from the disk cache
+} _thumbs_prefetch_t;
+
+static void _thumbs_prefetch_cleanup(void *data)
+{
+  _thumbs_prefetch_t *params = (_thumbs_prefetch_t *)data;
+  dt_atomic_sub_int(&params->table->prefetch_inflight, 1);
+  g_list_free(params->imgs);
+  free(params);
+}
+
+static int32_t _thumbs_prefetch_job_run(dt_job_t *job)
+{
+  _thumbs_prefetch_t *params = dt_control_job_get_params(job);
+  int k = 0;
+  for(const GList *l = params->imgs; l; l = g_list_next(l), k++)
+  {
+    // direction changed or view reloaded, the rest is of no use
+    if(dt_atomic_get_int(&params->table->prefetch_generation) != params->generation
+       || dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED)
+      break;
+
+    const int imgid = GPOINTER_TO_INT(l->data);
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, params->mip, DT_MIPMAP_TESTLOCK, 'r');
+    if(!buf.buf && (k < params->generate || dt_mipmap_cache_on_disk(darktable.mipmap_cache, imgid, params->mip)))
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+  return 0;
+}
+
+// queues the thumbnails of the next screens in scroll direction, the faster the scroll the more
+static void _thumbs_prefetch(dt_thumbtable_t *table, const int move)
+{
+  if(table->mode == DT_THUMBTABLE_MODE_ZOOM || !table->list || move == 0) return;
+
+  const int direction = move < 0 ? 1 : -1;
+  const int view = table->mode == DT_THUMBTABLE_MODE_FILMSTRIP ? table->view_width : table->view_height;
+  const int per_screen = MAX(1, table->thumbs_per_row * table->rows);
+  dt_thumbnail_t *first = (dt_thumbnail_t *)table->list->data;
+  dt_thumbnail_t *last = (dt_thumbnail_t *)g_list_last(table->list)->data;
+
+  const double now = dt_get_wtime();
+  const double dt = now - table->prefetch_time;
+  table->prefetch_time = now;
+  if(dt > 0.0 && dt < 1.0 && view > 0)
+    table->prefetch_speed = 0.7 * table->prefetch_speed + 0.3 * (abs(move) / (double)view) / dt;
+  else
+    table->prefetch_speed = 0.0;
+
+  if(direction != table->prefetch_direction)
+  {
+    dt_atomic_add_int(&table->prefetch_generation, 1);
+    table->prefetch_direction = direction;
+    table->prefetch_rowid = 0;
+  }
+
+  // look half a second ahead, and at least at the next screen
+  const int screens = CLAMP(1 + (int)(table->prefetch_speed * 0.5), 1, DT_THUMBTABLE_PREFETCH_SCREENS);
+  const int edge = direction > 0 ? last->rowid : first->rowid;
+  const int target = edge + direction * screens * per_screen;
+  int from = table->prefetch_rowid;
+  if(from == 0 || (direction > 0 ? from < edge : from > edge)) from = edge;
+  if(direction > 0 ? from >= target : from <= target) return;
+  if(dt_atomic_get_int(&table->prefetch_inflight) >= DT_THUMBTABLE_PREFETCH_INFLIGHT) return;
+
+  // the largest size shown now is the one to load
+  dt_mipmap_size_t mip = DT_MIPMAP_0;
+  for(const GList *l = table->list; l; l = g_list_next(l))
+  {
+    const dt_thumbnail_t *th = (dt_thumbnail_t *)l->data;
+    if(th->img_width > 0 && th->img_height > 0)
+      mip = MAX(mip, dt_mipmap_cache_get_matching_size(darktable.mipmap_cache,
+                                                       th->img_width * darktable.gui->ppd,
+                                                       th->img_height * darktable.gui->ppd));
+  }
+
+  sqlite3_stmt *stmt;
+  gchar *query = g_strdup_printf("SELECT rowid, imgid"
+                                 " FROM memory.collected_images"
+                                 " WHERE rowid %s %d"
+                                 " ORDER BY rowid %s LIMIT %d",
+                                 direction > 0 ? ">" : "<", from, direction > 0 ? "" : "DESC",
+                                 MIN(per_screen, abs(target - from)));
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  GList *imgs = NULL;
+  int rowid = from;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    rowid = sqlite3_column_int(stmt, 0);
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 1)));
+  }
+  sqlite3_finalize(stmt);
+  g_free(query);
+  if(!imgs) return;
+  table->prefetch_rowid = rowid;
+
+  _thumbs_prefetch_t *params = (_thumbs_prefetch_t *)calloc(1, sizeof(_thumbs_prefetch_t));
+  dt_job_t *job = params ? dt_control_job_create(&_thumbs_prefetch_job_run, "prefetch thumbnails") : NULL;
+  if(!job)
+  {
+    free(params);
+    g_list_free(imgs);
+    return;
+  }
+  params->table = table;
+  params->generation = dt_atomic_get_int(&table->prefetch_generation);
+  params->mip = mip;
+  params->imgs = g_list_reverse(imgs);
+  // only the next screen is worth generating, further ones are read from disk if there
+  params->generate = abs(from - edge) < per_screen ? per_screen - abs(from - edge) : 0;
+  dt_atomic_add_int(&table->prefetch_inflight, 1);
+  dt_control_job_set_params(job, params, _thumbs_prefetch_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
 // move all thumbs from the table.
 // if clamp, we verify that the move is allowed (collection bounds, etc...)
 static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean clamp)
@@ -719,6 +885,8 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
   // if there has been changed, we recompute thumbs area
   if(changed > 0) _pos_compute_area(table);
 
+  _thumbs_prefetch(table, table->mode == DT_THUMBTABLE_MODE_FILMSTRIP ? posx : posy);
+
   // we update the offset
   if(table->mode == DT_THUMBTABLE_MODE_FILEMANAGER)
   {
@@ -1299,6 +1467,7 @@ static void _dt_pref_change_callback(gpointer instance, gpointer user_data)
   dt_thumbtable_t *table = (dt_thumbtable_t *)user_data;
 
   _thumbs_ask_for_discard(table);
+  _thumbs_pool_flush(table);
 
   dt_thumbtable_full_redraw(table, TRUE);
 
@@ -1967,6 +2136,10 @@ void dt_thumbtable_full_redraw(dt_thumbtable_t *table, gboolean force)
 
     const double start = dt_get_wtime();
     table->dragging = FALSE;
+    // whatever was prefetched for the old layout is of no use now
+    dt_atomic_add_int(&table->prefetch_generation, 1);
+    table->prefetch_direction = 0;
+    table->prefetch_rowid = 0;
     sqlite3_stmt *stmt;
     dt_print(DT_DEBUG_LIGHTTABLE,
              "reload thumbs from db. force=%d w=%d h=%d zoom=%d rows=%d size=%d offset=%d centering=%d...\n",
@@ -2061,21 +2234,9 @@ void dt_thumbtable_full_redraw(dt_thumbtable_t *table, gboolean force)
       }
       else
       {
-        // we create a completely new thumb
-        dt_thumbnail_t *thumb
-            = dt_thumbnail_new(table->thumb_size, table->thumb_size, IMG_TO_FIT, nid, nrow, table->overlays,
-                               DT_THUMBNAIL_CONTAINER_LIGHTTABLE, table->show_tooltips);
-        if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        {
-          thumb->single_click = TRUE;
-          thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
-        }
-        thumb->x = posx;
-        thumb->y = posy;
+        // we need a new thumb, possibly one from the pool
+        dt_thumbnail_t *thumb = _thumbs_acquire(table, nid, nrow, posx, posy, old_margin_start, old_margin_top);
         newlist = g_list_prepend(newlist, thumb);
-        gtk_widget_set_margin_start(thumb->w_image_box, old_margin_start);
-        gtk_widget_set_margin_top(thumb->w_image_box, old_margin_top);
-        gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
         nbnew++;
       }
       _pos_get_next(table, &posx, &posy);
@@ -2084,7 +2245,8 @@ void dt_thumbtable_full_redraw(dt_thumbtable_t *table, gboolean force)
     }
 
     // now we cleanup all remaining thumbs from old table->list and set it again
-    g_list_free_full(table->list, _list_remove_thumb);
+    for(GList *l = table->list; l; l = g_list_next(l)) _thumbs_pool_release(table, (dt_thumbnail_t *)l->data);
+    g_list_free(table->list);
     table->list = g_list_reverse(newlist);  // list was built in reverse order, so un-reverse it
 
     _pos_compute_area(table);
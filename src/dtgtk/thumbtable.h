@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 /** a class to manage a table of thumbnail for lighttable and filmstrip.  */
+#include "common/atomic.h"
 #include "dtgtk/thumbnail.h"
 #include <gtk/gtk.h>
 
@@ -59,6 +60,8 @@ typedef struct dt_thumbtable_t
   // for filmstrip and filemanager, this is all the images drawn at screen (even partially)
   // for zoommable, this is all the images in the row drawn at screen. We don't load laterals images on fly.
   GList *list;
+  // thumbnails scrolled out of view, hidden in the main widget until they are reused for other images
+  GList *pool;
 
   // rowid of the main shown image inside 'memory.collected_images'
   // for filmstrip this is the image in the center.
@@ -105,6 +108,14 @@ typedef struct dt_thumbtable_t
   // let's remember previous thumbnail generation settings to detect if they change
   int pref_embedded;
   int pref_hq;
+
+  // thumbnails ahead of the scroll direction are loaded in the background
+  int prefetch_direction;            // 1 towards the end of the collection, -1 towards the start
+  int prefetch_rowid;                // last rowid queued in that direction
+  double prefetch_time;              // time of the last move
+  double prefetch_speed;             // smoothed scroll speed, in screens per second
+  dt_atomic_int prefetch_generation; // bumped to drop what is still queued
+  dt_atomic_int prefetch_inflight;   // number of queued prefetch jobs
 } dt_thumbtable_t;
 
 dt_thumbtable_t *dt_thumbtable_new();
@@ -37,6 +37,10 @@
 #include "config.h"              // for GETTEXT_PACKAGE, etc
 #include "control/conf.h"        // for dt_conf_get_bool
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #ifdef __APPLE__
 #include "osx/osx.h"
 #endif
@@ -45,7 +49,109 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+typedef struct dt_generate_cache_t
+{
+  dt_mipmap_size_t min_mip, max_mip;
+  int32_t *imgids;
+  gboolean *stale;  // the mips on disk were made before the last history change
+  size_t image_count;
+  size_t next;      // next image to pick, and progress, protected by lock
+  size_t counter, generated;
+  double start;
+  int threads;      // openmp threads for each worker
+  GMutex lock;
+} dt_generate_cache_t;
+
+static void _generate_image(const dt_generate_cache_t *g, const int32_t imgid, const gboolean stale)
+{
+  // don't let the outdated thumbnails be loaded as the new ones
+  if(stale) dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+
+  for(int k = g->max_mip; k >= g->min_mip && k >= 0; k--)
+  {
+    // if a valid thumbnail is already on disc - do nothing
+    if(dt_mipmap_cache_on_disk(darktable.mipmap_cache, imgid, k)) continue;
+
+    // else, generate thumbnail and store in mipmap cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+  // thumbnail in sync with image
+  dt_history_hash_set_mipmap(imgid);
+}
+
+static gboolean _image_done(const dt_generate_cache_t *g, const int32_t imgid, const gboolean stale)
+{
+  if(stale) return FALSE;
+  for(int k = g->max_mip; k >= g->min_mip && k >= 0; k--)
+    if(!dt_mipmap_cache_on_disk(darktable.mipmap_cache, imgid, k)) return FALSE;
+  return TRUE;
+}
+
+static gpointer _generate_worker(gpointer data)
+{
+  dt_generate_cache_t *g = (dt_generate_cache_t *)data;
+#ifdef _OPENMP
+  // the workers share the cores
+  omp_set_num_threads(g->threads);
+#endif
+
+  while(TRUE)
+  {
+    g_mutex_lock(&g->lock);
+    const size_t i = g->next++;
+    g_mutex_unlock(&g->lock);
+    if(i >= g->image_count) break;
+
+    const int32_t imgid = g->imgids[i];
+    const gboolean done = _image_done(g, imgid, g->stale[i]);
+    if(!done) _generate_image(g, imgid, g->stale[i]);
+
+    g_mutex_lock(&g->lock);
+    g->counter++;
+    if(!done) g->generated++;
+    const double elapsed = dt_get_wtime() - g->start;
+    const double rate = g->generated / MAX(elapsed, 1e-3);
+    // the images left are assumed to need generating, skipped ones only make the estimate pessimistic
+    const int eta = rate > 0.0 ? (int)((g->image_count - g->counter) / rate) : 0;
+    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d%s) %.2f images/s, eta %d:%02d:%02d\n", g->counter,
+            g->image_count, 100.0 * g->counter / (float)g->image_count, imgid, done ? ", up to date" : "", rate,
+            eta / 3600, (eta / 60) % 60, eta % 60);
+    g_mutex_unlock(&g->lock);
+  }
+  return NULL;
+}
+
+// each job holds the full image and a few pipe buffers, don't start more than fit in memory
+static int _generate_jobs_for_memory(const int jobs, const int32_t min_imgid, const int32_t max_imgid)
+{
+  sqlite3_stmt *stmt;
+  int64_t pixels = 0;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT MAX(width * height) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt,
+                              0);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
+  if(sqlite3_step(stmt) == SQLITE_ROW) pixels = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+  // the size isn't known before the image was loaded once
+  if(pixels <= 0) pixels = 50 * 1000 * 1000;
+
+  const size_t per_job = (size_t)pixels * 4 * sizeof(float) * 3;
+  const size_t available = dt_get_available_mem();
+  const int fit = (int)MAX(1, available / per_job);
+  if(fit < jobs)
+    fprintf(stderr, _("notice: running %d jobs instead of %d to stay within %zuMB of memory\n"), fit, jobs,
+            available / 1024lu / 1024lu);
+  return MIN(jobs, fit);
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid,
+                                    const int jobs)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -63,7 +169,7 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
 
   // some progress counter
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
+  size_t image_count = 0;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
@@ -87,41 +193,50 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // go through all images:
+  dt_generate_cache_t g = { .min_mip = min_mip, .max_mip = max_mip };
+  g.imgids = g_new(int32_t, MAX(image_count, 1));
+  g.stale = g_new(gboolean, MAX(image_count, 1));
+
+  // go through all images, an edit after the mips were written makes them outdated
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT i.id,"
+                              "       h.current_hash IS NOT NULL"
+                              "       AND (h.mipmap_hash IS NULL OR h.mipmap_hash != h.current_hash)"
+                              " FROM main.images AS i"
+                              " LEFT JOIN main.history_hash AS h ON h.imgid = i.id"
+                              " WHERE i.id >= ?1 AND i.id <= ?2", -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  while(sqlite3_step(stmt) == SQLITE_ROW && g.image_count < image_count)
   {
-    const int32_t imgid = sqlite3_column_int(stmt, 0);
-    const char *imgfilename = (const char*)sqlite3_column_text(stmt, 1);
-
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid, imgfilename);
-
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-      // if a valid thumbnail file is already on disc - do nothing
-      if(dt_util_test_image_file(filename)) continue;
+    g.imgids[g.image_count] = sqlite3_column_int(stmt, 0);
+    g.stale[g.image_count] = sqlite3_column_int(stmt, 1);
+    g.image_count++;
+  }
+  sqlite3_finalize(stmt);
 
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
-    }
+  const int workers = _generate_jobs_for_memory(jobs, min_imgid, max_imgid);
+  g.threads = MAX(1, darktable.num_openmp_threads / workers);
+  g.start = dt_get_wtime();
+  g_mutex_init(&g.lock);
 
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
+  if(workers == 1)
+    _generate_worker(&g);
+  else
+  {
+    GThread **threads = g_new(GThread *, workers);
+    for(int k = 0; k < workers; k++) threads[k] = g_thread_new("generate-cache", _generate_worker, &g);
+    for(int k = 0; k < workers; k++) g_thread_join(threads[k]);
+    g_free(threads);
   }
 
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
+  const double elapsed = dt_get_wtime() - g.start;
+  fprintf(stderr, _("done: %zu images generated, %zu up to date, in %.1fs (%.2f images/s)\n"), g.generated,
+          g.counter - g.generated, elapsed, g.generated / MAX(elapsed, 1e-3));
+
+  g_mutex_clear(&g.lock);
+  g_free(g.imgids);
+  g_free(g.stale);
 
   return 0;
 }
@@ -132,13 +247,17 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --jobs <N> (default = 1)]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on.\n"
+          "\n"
+          "With --jobs, N images are processed in parallel, fewer if they wouldn't\n"
+          "fit in the available memory.\n",
           progname);
 }
 
@@ -164,6 +283,7 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int jobs = 1;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -199,6 +319,11 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      jobs = MAX(atoi(arg[k]), 1);
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -252,7 +377,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, jobs))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
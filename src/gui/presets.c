@@ -59,13 +59,74 @@ static const char *_gui_presets_format_value_str[5]
     = { N_("non-raw"), N_("raw"), N_("HDR"), N_("monochrome"), N_("color") };
 static const int _gui_presets_format_flag[5] = { FOR_LDR, FOR_RAW, FOR_HDR, FOR_NOT_MONO, FOR_NOT_COLOR };
 
+// the built-in presets only change with darktable, the language of their names and the workflow settings.
+// data.db_info remembers those which wrote the presets of the processing modules and of the utility modules,
+// so they are only written again when one of them changes.
+static const char *_builtin_presets_key[2] = { "builtin_presets_lib", "builtin_presets_iop" };
+static int _builtin_presets_current[2] = { -1, -1 };
+
+static gchar *_builtin_presets_stamp(void)
+{
+  return g_strdup_printf("%s %s %s %s", darktable_package_version, g_get_language_names()[0],
+                         dt_conf_get_string_const("plugins/darkroom/workflow"),
+                         dt_conf_get_string_const("plugins/darkroom/chromatic-adaptation"));
+}
+
+gboolean dt_gui_presets_builtin_current(const gboolean iop)
+{
+  if(_builtin_presets_current[iop] < 0)
+  {
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT value FROM data.db_info WHERE key = ?1", -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, _builtin_presets_key[iop], -1, SQLITE_TRANSIENT);
+    gchar *stamp = _builtin_presets_stamp();
+    _builtin_presets_current[iop] = sqlite3_step(stmt) == SQLITE_ROW
+      && !g_strcmp0((const char *)sqlite3_column_text(stmt, 0), stamp);
+    sqlite3_finalize(stmt);
+    g_free(stamp);
+  }
+  return _builtin_presets_current[iop];
+}
+
+void dt_gui_presets_builtin_remove(const char *operation)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "DELETE FROM data.presets WHERE writeprotect = 1 AND operation = ?1", -1, &stmt,
+                              NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, operation, -1, SQLITE_TRANSIENT);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+void dt_gui_presets_builtin_written(const gboolean iop)
+{
+  if(dt_gui_presets_builtin_current(iop)) return;
+
+  gchar *stamp = _builtin_presets_stamp();
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO data.db_info (key, value) VALUES (?1, ?2)", -1, &stmt,
+                              NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, _builtin_presets_key[iop], -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, stamp, -1, SQLITE_TRANSIENT);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  dt_print(DT_DEBUG_PARAMS, "[presets] built-in %s presets written for `%s'\n", iop ? "processing" : "utility",
+           stamp);
+  g_free(stamp);
+}
+
 // this is also called for non-gui applications linking to libdarktable!
 // so beware, don't use any darktable.gui stuff here .. (or change this behaviour in darktable.c)
 void dt_gui_presets_init()
 {
-  // remove auto generated presets from plugins, not the user included ones.
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM data.presets WHERE writeprotect = 1", NULL,
-                        NULL, NULL);
+  // remove auto generated presets from plugins, not the user included ones. when only one kind of modules
+  // is out of date their presets are replaced module by module as they are loaded.
+  if(!dt_gui_presets_builtin_current(TRUE) && !dt_gui_presets_builtin_current(FALSE))
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM data.presets WHERE writeprotect = 1",
+                          NULL, NULL, NULL);
 }
 
 void dt_gui_presets_add_generic(const char *name, dt_dev_operation_t op, const int32_t version,
@@ -71,6 +71,14 @@ typedef struct dt_gui_presets_edit_dialog_t
 /** create a db table with presets for all operations. */
 void dt_gui_presets_init();
 
+/** whether the built-in presets of the processing (iop) or utility modules in the db are those of this
+ *  darktable version, so their init_presets() can be skipped. */
+gboolean dt_gui_presets_builtin_current(const gboolean iop);
+/** remove the built-in presets of an operation before writing them again. */
+void dt_gui_presets_builtin_remove(const char *operation);
+/** remember that all built-in presets of the processing or utility modules have been written. */
+void dt_gui_presets_builtin_written(const gboolean iop);
+
 /** add or replace a generic (i.e. non-exif specific) preset for this operation. */
 void dt_gui_presets_add_generic(const char *name, dt_dev_operation_t op, const int32_t version,
                                 const void *params, const int32_t params_size,
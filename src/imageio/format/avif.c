@@ -25,6 +25,7 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "bauhaus/bauhaus.h"
 #include "common/colorspaces.h"
@@ -41,7 +42,7 @@
 #define AVIF_MAX_TILE_SIZE 3072
 #define AVIF_DEFAULT_TILE_SIZE AVIF_MIN_TILE_SIZE * 2
 
-DT_MODULE(1)
+DT_MODULE(2)
 
 enum avif_compression_type_e
 {
@@ -55,6 +56,14 @@ enum avif_tiling_e
   AVIF_TILING_OFF
 };
 
+enum avif_speed_e
+{
+  AVIF_SPEED_BEST = 0,
+  AVIF_SPEED_BALANCED,
+  AVIF_SPEED_FAST,
+  AVIF_SPEED_FASTEST,
+};
+
 enum avif_color_mode_e
 {
   AVIF_COLOR_MODE_RGB = 0,
@@ -69,6 +78,7 @@ typedef struct dt_imageio_avif_t
   uint32_t compression_type;
   uint32_t quality;
   uint32_t tiling;
+  uint32_t speed;
 } dt_imageio_avif_t;
 
 typedef struct dt_imageio_avif_gui_t
@@ -78,6 +88,7 @@ typedef struct dt_imageio_avif_gui_t
   GtkWidget *compression_type;
   GtkWidget *quality;
   GtkWidget *tiling;
+  GtkWidget *speed;
 } dt_imageio_avif_gui_t;
 
 static const struct
@@ -115,6 +126,24 @@ static const char *avif_get_compression_string(enum avif_compression_type_e comp
   return "unknown";
 }
 
+/* encoder speed for each preset, lossless and lossy. balanced is what was always used. */
+static int avif_encoder_speed(enum avif_speed_e speed, enum avif_compression_type_e comp)
+{
+  switch(speed)
+  {
+    case AVIF_SPEED_BEST:
+      return AVIF_SPEED_SLOWEST + 1;
+    case AVIF_SPEED_FAST:
+      return 8;
+    case AVIF_SPEED_FASTEST:
+      return AVIF_SPEED_FASTEST;
+    case AVIF_SPEED_BALANCED:
+    default:
+      /* It isn't recommend to use the extremities */
+      return comp == AVIF_COMP_LOSSLESS ? AVIF_SPEED_SLOWEST + 1 : AVIF_SPEED_DEFAULT;
+  }
+}
+
 /* Lookup table for tiling choices */
 static int floor_log2(int i)
 {
@@ -196,6 +225,28 @@ void init(dt_imageio_module_format_t *self)
                                 dt_imageio_avif_t,
                                 quality,
                                 int);
+
+  /* encoder speed */
+  luaA_enum(darktable.lua_state.state,
+            enum avif_speed_e);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_e,
+                  AVIF_SPEED_BEST);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_e,
+                  AVIF_SPEED_BALANCED);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_e,
+                  AVIF_SPEED_FAST);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_e,
+                  AVIF_SPEED_FASTEST);
+
+  dt_lua_register_module_member(darktable.lua_state.state,
+                                self,
+                                dt_imageio_avif_t,
+                                speed,
+                                enum avif_speed_e);
 #endif
 }
 
@@ -479,16 +530,11 @@ int write_image(struct dt_imageio_module_data_t *data,
   switch(d->compression_type)
   {
     case AVIF_COMP_LOSSLESS:
-      /* It isn't recommend to use the extremities */
-      encoder->speed = AVIF_SPEED_SLOWEST + 1;
-
       encoder->minQuantizer = AVIF_QUANTIZER_LOSSLESS;
       encoder->maxQuantizer = AVIF_QUANTIZER_LOSSLESS;
 
       break;
     case AVIF_COMP_LOSSY:
-      encoder->speed = AVIF_SPEED_DEFAULT;
-
       encoder->maxQuantizer = 100 - d->quality;
       encoder->maxQuantizer = CLAMP(encoder->maxQuantizer, 0, 63);
 
@@ -497,6 +543,14 @@ int write_image(struct dt_imageio_module_data_t *data,
       break;
   }
 
+  encoder->speed = avif_encoder_speed(d->speed, d->compression_type);
+
+  /*
+   * The encoder works with the share of the cores this export got, when
+   * several images are exported side by side each one only has a few.
+   */
+  encoder->maxThreads = MAX(1, omp_get_max_threads());
+
   /*
    * Tiling reduces the image quality but it has a negligible impact on
    * still images.
@@ -510,33 +564,34 @@ int write_image(struct dt_imageio_module_data_t *data,
     {
       size_t width_tile_size  = AVIF_DEFAULT_TILE_SIZE;
       size_t height_tile_size = AVIF_DEFAULT_TILE_SIZE;
-      size_t max_threads;
 
-      if(width >= 6144)
+      if(width >= 8192)
       {
-        width_tile_size = AVIF_MIN_TILE_SIZE * 4;
-      }
-      else if (width >= 8192) {
         width_tile_size = AVIF_MAX_TILE_SIZE;
       }
-      if(height >= 6144)
+      else if(width >= 6144)
       {
-        height_tile_size = AVIF_MIN_TILE_SIZE * 4;
+        width_tile_size = AVIF_MIN_TILE_SIZE * 4;
       }
-      else if (height >= 8192) {
+      if(height >= 8192)
+      {
         height_tile_size = AVIF_MAX_TILE_SIZE;
       }
+      else if(height >= 6144)
+      {
+        height_tile_size = AVIF_MIN_TILE_SIZE * 4;
+      }
 
       encoder->tileColsLog2 = floor_log2(width / width_tile_size) / 2;
       encoder->tileRowsLog2 = floor_log2(height / height_tile_size) / 2;
 
       /*
-       * This should be set to the final number of tiles, based on
-       * encoder->tileColsLog2 and encoder->tileRowsLog2.
+       * More threads than tiles don't help, the tiles are encoded in
+       * parallel.
        */
-      max_threads = (1 << encoder->tileRowsLog2) * (1 << encoder->tileColsLog2);
-
-      encoder->maxThreads = MIN(max_threads, dt_get_num_threads());
+      const int tiles = (1 << encoder->tileRowsLog2) * (1 << encoder->tileColsLog2);
+      encoder->maxThreads = MIN(tiles, encoder->maxThreads);
+      break;
     }
     case AVIF_TILING_OFF:
       break;
@@ -544,10 +599,11 @@ int write_image(struct dt_imageio_module_data_t *data,
 
   dt_print(DT_DEBUG_IMAGEIO,
            "[avif quality: %u => maxQuantizer: %u, minQuantizer: %u, "
-           "tileColsLog2: %u, tileRowsLog2: %u, threads: %u]\n",
+           "speed: %d, tileColsLog2: %u, tileRowsLog2: %u, threads: %u]\n",
            d->quality,
            encoder->maxQuantizer,
            encoder->minQuantizer,
+           encoder->speed,
            encoder->tileColsLog2,
            encoder->tileRowsLog2,
            encoder->maxThreads);
@@ -612,6 +668,37 @@ size_t params_size(dt_imageio_module_format_t *self)
   return sizeof(dt_imageio_avif_t);
 }
 
+void *legacy_params(dt_imageio_module_format_t *self,
+                    const void *const old_params,
+                    const size_t old_params_size,
+                    const int old_version,
+                    const int new_version,
+                    size_t *new_size)
+{
+  if(old_version == 1 && new_version == 2)
+  {
+    typedef struct dt_imageio_avif_v1_t
+    {
+      dt_imageio_module_data_t global;
+      uint32_t bit_depth;
+      uint32_t color_mode;
+      uint32_t compression_type;
+      uint32_t quality;
+      uint32_t tiling;
+    } dt_imageio_avif_v1_t;
+
+    const dt_imageio_avif_v1_t *o = (dt_imageio_avif_v1_t *)old_params;
+    dt_imageio_avif_t *n = (dt_imageio_avif_t *)malloc(sizeof(dt_imageio_avif_t));
+
+    memcpy(n, o, sizeof(dt_imageio_avif_v1_t));
+    n->speed = AVIF_SPEED_BALANCED;
+
+    *new_size = self->params_size(self);
+    return n;
+  }
+  return NULL;
+}
+
 void *get_params(dt_imageio_module_format_t *self)
 {
   dt_imageio_avif_t *d = (dt_imageio_avif_t *)calloc(1, sizeof(dt_imageio_avif_t));
@@ -643,6 +730,7 @@ void *get_params(dt_imageio_module_format_t *self)
   }
 
   d->tiling = !dt_conf_get_bool("plugins/imageio/format/avif/tiling");
+  d->speed = dt_conf_get_int("plugins/imageio/format/avif/speed");
 
   return d;
 }
@@ -661,6 +749,7 @@ int set_params(dt_imageio_module_format_t *self,
   dt_bauhaus_combobox_set(g->tiling, d->tiling);
   dt_bauhaus_combobox_set(g->compression_type, d->compression_type);
   dt_bauhaus_slider_set(g->quality, d->quality);
+  dt_bauhaus_combobox_set(g->speed, d->speed);
 
   return 0;
 }
@@ -730,6 +819,13 @@ static void tiling_changed(GtkWidget *widget, gpointer user_data)
   dt_conf_set_bool("plugins/imageio/format/avif/tiling", !tiling);
 }
 
+static void speed_changed(GtkWidget *widget, gpointer user_data)
+{
+  const enum avif_speed_e speed = dt_bauhaus_combobox_get(widget);
+
+  dt_conf_set_int("plugins/imageio/format/avif/speed", speed);
+}
+
 static void compression_type_changed(GtkWidget *widget, gpointer user_data)
 {
   const enum avif_compression_type_e compression_type = dt_bauhaus_combobox_get(widget);
@@ -764,6 +860,7 @@ void gui_init(dt_imageio_module_format_t *self)
   const enum avif_tiling_e tiling = !dt_conf_get_bool("plugins/imageio/format/avif/tiling");
   const enum avif_compression_type_e compression_type = dt_conf_get_int("plugins/imageio/format/avif/compression_type");
   const uint32_t quality = dt_conf_get_int("plugins/imageio/format/avif/quality");
+  const enum avif_speed_e speed = dt_conf_get_int("plugins/imageio/format/avif/speed");
 
   self->gui_data = (void *)gui;
 
@@ -837,6 +934,34 @@ void gui_init(dt_imageio_module_format_t *self)
                      TRUE,
                      0);
 
+  /*
+   * Encoder speed combo box
+   */
+  gui->speed = dt_bauhaus_combobox_new(NULL);
+  dt_bauhaus_widget_set_label(gui->speed,
+                              NULL,
+                              N_("encoding speed"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("best compression"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("balanced"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("fast"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("fastest"));
+  dt_bauhaus_combobox_set(gui->speed, speed);
+
+  gtk_widget_set_tooltip_text(gui->speed,
+          _("trade encoding time for file size.\n"
+            "\n"
+            "faster settings give larger files at the same quality."));
+
+  gtk_box_pack_start(GTK_BOX(self->widget),
+                     gui->speed,
+                     TRUE,
+                     TRUE,
+                     0);
+
   /*
    * Compression type combo box
    */
@@ -910,6 +1035,10 @@ void gui_init(dt_imageio_module_format_t *self)
                    "value-changed",
                    G_CALLBACK(tiling_changed),
                    (gpointer)self);
+  g_signal_connect(G_OBJECT(gui->speed),
+                   "value-changed",
+                   G_CALLBACK(speed_changed),
+                   NULL);
   g_signal_connect(G_OBJECT(gui->compression_type),
                    "value-changed",
                    G_CALLBACK(compression_type_changed),
@@ -933,12 +1062,14 @@ void gui_reset(dt_imageio_module_format_t *self)
   const enum avif_tiling_e tiling = !dt_confgen_get_bool("plugins/imageio/format/avif/tiling", DT_DEFAULT);
   const enum avif_compression_type_e compression_type = dt_confgen_get_int("plugins/imageio/format/avif/compression_type", DT_DEFAULT);
   const uint32_t quality = dt_confgen_get_int("plugins/imageio/format/avif/quality", DT_DEFAULT);
+  const enum avif_speed_e speed = dt_confgen_get_int("plugins/imageio/format/avif/speed", DT_DEFAULT);
 
   dt_bauhaus_combobox_set(gui->bit_depth, 0); //8bpp
   dt_bauhaus_combobox_set(gui->color_mode, color_mode);
   dt_bauhaus_combobox_set(gui->tiling, tiling);
   dt_bauhaus_combobox_set(gui->compression_type, compression_type);
   dt_bauhaus_slider_set(gui->quality, quality);
+  dt_bauhaus_combobox_set(gui->speed, speed);
 
   compression_type_changed(GTK_WIDGET(gui->compression_type), self);
   quality_changed(GTK_WIDGET(gui->quality), self);
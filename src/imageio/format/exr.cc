@@ -127,7 +127,7 @@ int write_image(dt_imageio_module_data_t *tmp, const char *filename, const void
 {
   const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
 
-  Imf::setGlobalThreadCount(dt_get_num_threads());
+  dt_imageio_exr_set_threads();
 
   Imf::Header header(exr->global.width, exr->global.height, 1, Imath::V2f(0, 0), 1, Imf::INCREASING_Y,
                      (Imf::Compression)exr->compression);
@@ -224,68 +224,23 @@ icc_end:
 
   Imf::OutputFile file(filename, header);
 
+  /* the slices always point at our float rgba buffer. openexr converts to half itself while it compresses the
+   * lines on its worker threads, no need for an intermediate copy of the whole image. */
   Imf::FrameBuffer data;
-  size_t stride;
+  const size_t stride = 4 * sizeof(float);
+  const float *in = (const float *)in_tmp;
 
-  if(pixel_type == Imf::PixelType::FLOAT)
-  {
-    stride = 4 * sizeof(float);
-    const float *in = (const float *)in_tmp;
-
-    data.insert("R", Imf::Slice(pixel_type, (char *)(in + 0), stride,
-                                stride * exr->global.width));
+  data.insert("R", Imf::Slice(Imf::FLOAT, (char *)(in + 0), stride,
+                              stride * exr->global.width));
 
-    data.insert("G", Imf::Slice(pixel_type, (char *)(in + 1), stride,
-                                stride * exr->global.width));
+  data.insert("G", Imf::Slice(Imf::FLOAT, (char *)(in + 1), stride,
+                              stride * exr->global.width));
 
-    data.insert("B", Imf::Slice(pixel_type, (char *)(in + 2), stride,
-                                stride * exr->global.width));
-
-    file.setFrameBuffer(data);
-    file.writePixels(exr->global.height);
-  }
-  else
-  {
-    const size_t width = exr->global.width;
-    const size_t height = exr->global.height;
-    stride = 3 * sizeof(unsigned short);
-    unsigned short *out = (unsigned short *)malloc(stride * width * height);
-    if(out == NULL)
-      return 1;
-
-#ifdef _OPENMP
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(in_tmp, out, width, height) \
-  schedule(simd:static) \
-  collapse(2)
-#endif
-    for(size_t y = 0; y < height; y++)
-    {
-      for(size_t x = 0; x < width; x++)
-      {
-        const float *in_pixel = (const float *)in_tmp + 4 * ((y * width) + x);
-        unsigned short *out_pixel = out + 3 * ((y * width) + x);
+  data.insert("B", Imf::Slice(Imf::FLOAT, (char *)(in + 2), stride,
+                              stride * exr->global.width));
 
-        out_pixel[0] = half(in_pixel[0]).bits();
-        out_pixel[1] = half(in_pixel[1]).bits();
-        out_pixel[2] = half(in_pixel[2]).bits();
-      }
-    }
-
-    data.insert("R", Imf::Slice(pixel_type, (char *)(out + 0), stride,
-                                stride * exr->global.width));
-
-    data.insert("G", Imf::Slice(pixel_type, (char *)(out + 1), stride,
-                                stride * exr->global.width));
-
-    data.insert("B", Imf::Slice(pixel_type, (char *)(out + 2), stride,
-                                stride * exr->global.width));
-
-    file.setFrameBuffer(data);
-    file.writePixels(exr->global.height);
-
-    free(out);
-  }
+  file.setFrameBuffer(data);
+  file.writePixels(exr->global.height);
 
   return 0;
 }
@@ -80,6 +80,16 @@ REQUIRED(int, write_image, struct dt_imageio_module_data_t *data, const char *fi
                            dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                            void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                            const gboolean export_masks);
+/* streaming variant of write_image: open the file and write headers, then take the image in bands of rows
+   (top to bottom, 4 channels of bpp each) and finish. with abort set, the partial file is removed.
+   formats implementing these get them used instead of write_image unless masks are exported. begin returning
+   -1 asks for the whole image through write_image instead. */
+OPTIONAL(int, write_image_begin, struct dt_imageio_module_data_t *data, const char *filename,
+                                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                                 void *exif, int exif_len, int imgid, int num, int total,
+                                 struct dt_dev_pixelpipe_t *pipe);
+OPTIONAL(int, write_image_rows, struct dt_imageio_module_data_t *data, const void *in, int first_row, int num_rows);
+OPTIONAL(int, write_image_finish, struct dt_imageio_module_data_t *data, const gboolean abort);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 OPTIONAL(int, levels, struct dt_imageio_module_data_t *data);
 
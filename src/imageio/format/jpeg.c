@@ -27,6 +27,7 @@
 #include "common/imageio_module.h"
 #include "control/conf.h"
 #include "imageio/format/imageio_format_api.h"
+#include <glib/gstdio.h>
 #include <inttypes.h>
 #include <setjmp.h>
 #include <stdio.h>
@@ -49,6 +50,7 @@ typedef struct dt_imageio_jpeg_t
   struct jpeg_decompress_struct dinfo;
   struct jpeg_compress_struct cinfo;
   FILE *f;
+  struct dt_imageio_jpeg_stream_t *stream;
 } dt_imageio_jpeg_t;
 
 typedef struct dt_imageio_jpeg_gui_data_t
@@ -301,6 +303,210 @@ read_icc_profile (j_decompress_ptr cinfo,
 #undef MAX_SEQ_NO
 
 
+// compression settings for the given quality. when encoding slices to be stitched together, all of them have to
+// share the standard huffman tables and restart after every MCU row.
+static void _set_compress_params(struct jpeg_compress_struct *cinfo, const int quality, const int width,
+                                 const int height, const gboolean slices)
+{
+  cinfo->image_width = width;
+  cinfo->image_height = height;
+  cinfo->input_components = 3;
+  cinfo->in_color_space = JCS_RGB;
+  jpeg_set_defaults(cinfo);
+  jpeg_set_quality(cinfo, quality, TRUE);
+  if(quality > 90) cinfo->comp_info[0].v_samp_factor = 1;
+  if(quality > 92) cinfo->comp_info[0].h_samp_factor = 1;
+  if(quality > 95) cinfo->dct_method = JDCT_FLOAT;
+  if(quality < 50) cinfo->dct_method = JDCT_IFAST;
+  if(quality < 80) cinfo->smoothing_factor = 20;
+  if(quality < 60) cinfo->smoothing_factor = 40;
+  if(quality < 40) cinfo->smoothing_factor = 60;
+  cinfo->optimize_coding = !slices;
+  if(slices) cinfo->restart_in_rows = 1;
+
+  const int resolution = dt_conf_get_int("metadata/resolution");
+  cinfo->density_unit = 1;
+  cinfo->X_density = resolution;
+  cinfo->Y_density = resolution;
+}
+
+static void _write_profile(struct jpeg_compress_struct *cinfo, dt_colorspaces_color_profile_type_t over_type,
+                           const char *over_filename, const int imgid)
+{
+  if(imgid <= 0) return;
+  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
+  uint32_t len = 0;
+  cmsSaveProfileToMem(out_profile, 0, &len);
+  if(len > 0)
+  {
+    unsigned char *buf = malloc(sizeof(unsigned char) * len);
+    cmsSaveProfileToMem(out_profile, buf, &len);
+    write_icc_profile(cinfo, buf, len);
+    free(buf);
+  }
+}
+
+// set up compression into the opened file and write the headers
+static void _start_compress(dt_imageio_jpeg_t *jpg, FILE *f, dt_colorspaces_color_profile_type_t over_type,
+                            const char *over_filename, const int imgid)
+{
+  jpeg_create_compress(&(jpg->cinfo));
+  jpeg_stdio_dest(&(jpg->cinfo), f);
+  _set_compress_params(&(jpg->cinfo), jpg->quality, jpg->global.width, jpg->global.height, FALSE);
+  jpeg_start_compress(&(jpg->cinfo), TRUE);
+  _write_profile(&(jpg->cinfo), over_type, over_filename, imgid);
+}
+
+// compress num_rows rows of 4 channel input, dropping alpha on the way
+static void _write_rows(struct jpeg_compress_struct *cinfo, uint8_t *row, const uint8_t *in, const int num_rows)
+{
+  for(int y = 0; y < num_rows && cinfo->next_scanline < cinfo->image_height; y++)
+  {
+    JSAMPROW tmp[1];
+    const uint8_t *buf = in + (size_t)y * cinfo->image_width * 4;
+    for(JDIMENSION i = 0; i < cinfo->image_width; i++)
+      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
+    tmp[0] = row;
+    jpeg_write_scanlines(cinfo, tmp, 1);
+  }
+}
+
+#ifdef MEM_SRCDST_SUPPORTED
+// images from this size on are cut into horizontal slices encoded on all threads
+#define DT_JPEG_SLICES_MIN_PIXELS (8 * 1024 * 1024)
+
+static gboolean _use_slices(const dt_imageio_jpeg_t *jpg)
+{
+  return dt_get_num_threads() > 1 && (size_t)jpg->global.width * jpg->global.height >= DT_JPEG_SLICES_MIN_PIXELS
+         && dt_conf_get_bool("plugins/imageio/format/jpeg/parallel");
+}
+
+// encode rows of the image as a jpeg of its own in memory, only the first slice carries the icc profile
+static int _encode_slice(const dt_imageio_jpeg_t *jpg, const uint8_t *in, const int height,
+                         dt_colorspaces_color_profile_type_t over_type, const char *over_filename, const int imgid,
+                         unsigned char **out, unsigned long *out_size)
+{
+  struct jpeg_compress_struct cinfo;
+  struct dt_imageio_jpeg_error_mgr jerr;
+  uint8_t *row = dt_alloc_align(64, sizeof(uint8_t) * 3 * jpg->global.width);
+  if(!row) return 1;
+
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&cinfo);
+    dt_free_align(row);
+    return 1;
+  }
+  jpeg_create_compress(&cinfo);
+  jpeg_mem_dest(&cinfo, out, out_size);
+  _set_compress_params(&cinfo, jpg->quality, jpg->global.width, height, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  _write_profile(&cinfo, over_type, over_filename, imgid);
+  _write_rows(&cinfo, row, in, height);
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  dt_free_align(row);
+  return 0;
+}
+
+// offset of the first entropy coded byte, behind the scan header, and of the frame header
+static size_t _find_scan(const unsigned char *b, const size_t size, size_t *sof)
+{
+  size_t pos = 2; // SOI
+  while(pos + 4 <= size && b[pos] == 0xff)
+  {
+    const int marker = b[pos + 1];
+    const size_t len = ((size_t)b[pos + 2] << 8) | b[pos + 3];
+    if(marker == 0xc0 || marker == 0xc1) *sof = pos;
+    pos += 2 + len;
+    if(marker == 0xda) return pos <= size ? pos : 0;
+  }
+  return 0;
+}
+
+// stitch the slices into one baseline jpeg: headers of the first one with the full height, then the scans of
+// all of them joined by restart markers, renumbered to run on across slice borders
+static int _write_slices(FILE *f, unsigned char **bufs, const unsigned long *sizes, const int nslices,
+                         const int height)
+{
+  size_t sof = 0;
+  const size_t header = _find_scan(bufs[0], sizes[0], &sof);
+  if(!header || !sof) return 1;
+  bufs[0][sof + 5] = (height >> 8) & 0xff;
+  bufs[0][sof + 6] = height & 0xff;
+  if(fwrite(bufs[0], 1, header, f) != header) return 1;
+
+  int rst = 0;
+  for(int i = 0; i < nslices; i++)
+  {
+    size_t dummy = 0;
+    const size_t start = i ? _find_scan(bufs[i], sizes[i], &dummy) : header;
+    // every slice ends in EOI
+    if(!start || sizes[i] < start + 2 || bufs[i][sizes[i] - 2] != 0xff || bufs[i][sizes[i] - 1] != 0xd9) return 1;
+    const size_t end = sizes[i] - 2;
+
+    if(i)
+    {
+      const unsigned char marker[2] = { 0xff, 0xd0 + (rst++ & 7) };
+      if(fwrite(marker, 1, 2, f) != 2) return 1;
+    }
+    // 0xff in entropy coded data is always followed by a stuffed 0x00, so this only hits markers
+    for(size_t k = start; k + 1 < end; k++)
+      if(bufs[i][k] == 0xff && bufs[i][k + 1] >= 0xd0 && bufs[i][k + 1] <= 0xd7) bufs[i][++k] = 0xd0 + (rst++ & 7);
+    if(fwrite(bufs[i] + start, 1, end - start, f) != end - start) return 1;
+  }
+  const unsigned char eoi[2] = { 0xff, 0xd9 };
+  return fwrite(eoi, 1, 2, f) != 2;
+}
+
+static int _write_image_sliced(dt_imageio_jpeg_t *jpg, const char *filename, const uint8_t *in,
+                               dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                               const int imgid)
+{
+  const int width = jpg->global.width;
+  const int height = jpg->global.height;
+  // slices have to start on MCU rows, which are 8 or 16 pixels high depending on chroma subsampling
+  const int mcu_rows = jpg->quality > 90 ? 8 : 16;
+  const int nthreads = dt_get_num_threads();
+  const int rows = mcu_rows * ((height + mcu_rows * nthreads - 1) / (mcu_rows * nthreads));
+  const int nslices = (height + rows - 1) / rows;
+
+  unsigned char **bufs = calloc(nslices, sizeof(unsigned char *));
+  unsigned long *sizes = calloc(nslices, sizeof(unsigned long));
+  int err = !bufs || !sizes;
+
+  if(!err)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(jpg, in, width, height, rows, nslices, bufs, sizes, over_type, over_filename, imgid) \
+  schedule(dynamic) reduction(|:err)
+#endif
+    for(int i = 0; i < nslices; i++)
+    {
+      const int first = i * rows;
+      err |= _encode_slice(jpg, in + (size_t)first * width * 4, MIN(rows, height - first), over_type,
+                           over_filename, i ? 0 : imgid, &bufs[i], &sizes[i]);
+    }
+  }
+
+  if(!err)
+  {
+    FILE *f = g_fopen(filename, "wb");
+    err = !f || _write_slices(f, bufs, sizes, nslices, height);
+    if(f) fclose(f);
+    if(err) g_unlink(filename);
+  }
+
+  for(int i = 0; bufs && i < nslices; i++) free(bufs[i]);
+  free(bufs);
+  free(sizes);
+  return err;
+}
+#endif // MEM_SRCDST_SUPPORTED
+
 int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
@@ -310,6 +516,15 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   const uint8_t *in = (const uint8_t *)in_tmp;
   struct dt_imageio_jpeg_error_mgr jerr;
 
+#ifdef MEM_SRCDST_SUPPORTED
+  if(_use_slices(jpg))
+  {
+    if(_write_image_sliced(jpg, filename, in, over_type, over_filename, imgid)) return 1;
+    dt_exif_write_blob(exif, exif_len, filename, 1);
+    return 0;
+  }
+#endif
+
   jpg->cinfo.err = jpeg_std_error(&jerr.pub);
   jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
   if(setjmp(jerr.setjmp_buffer))
@@ -317,65 +532,115 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
     jpeg_destroy_compress(&(jpg->cinfo));
     return 1;
   }
-  jpeg_create_compress(&(jpg->cinfo));
   FILE *f = g_fopen(filename, "wb");
   if(!f) return 1;
-  jpeg_stdio_dest(&(jpg->cinfo), f);
+  _start_compress(jpg, f, over_type, over_filename, imgid);
 
-  jpg->cinfo.image_width = jpg->global.width;
-  jpg->cinfo.image_height = jpg->global.height;
-  jpg->cinfo.input_components = 3;
-  jpg->cinfo.in_color_space = JCS_RGB;
-  jpeg_set_defaults(&(jpg->cinfo));
-  jpeg_set_quality(&(jpg->cinfo), jpg->quality, TRUE);
-  if(jpg->quality > 90) jpg->cinfo.comp_info[0].v_samp_factor = 1;
-  if(jpg->quality > 92) jpg->cinfo.comp_info[0].h_samp_factor = 1;
-  if(jpg->quality > 95) jpg->cinfo.dct_method = JDCT_FLOAT;
-  if(jpg->quality < 50) jpg->cinfo.dct_method = JDCT_IFAST;
-  if(jpg->quality < 80) jpg->cinfo.smoothing_factor = 20;
-  if(jpg->quality < 60) jpg->cinfo.smoothing_factor = 40;
-  if(jpg->quality < 40) jpg->cinfo.smoothing_factor = 60;
-  jpg->cinfo.optimize_coding = 1;
+  uint8_t *row = dt_alloc_align(64, sizeof(uint8_t) * 3 * jpg->global.width);
+  _write_rows(&(jpg->cinfo), row, in, jpg->global.height);
+  jpeg_finish_compress(&(jpg->cinfo));
+  dt_free_align(row);
+  jpeg_destroy_compress(&(jpg->cinfo));
+  fclose(f);
 
-  const int resolution = dt_conf_get_int("metadata/resolution");
-  jpg->cinfo.density_unit = 1;
-  jpg->cinfo.X_density = resolution;
-  jpg->cinfo.Y_density = resolution;
+  dt_exif_write_blob(exif, exif_len, filename, 1);
 
-  jpeg_start_compress(&(jpg->cinfo), TRUE);
+  return 0;
+}
+
+// state kept between write_image_begin() and write_image_finish()
+typedef struct dt_imageio_jpeg_stream_t
+{
+  struct dt_imageio_jpeg_error_mgr jerr;
+  FILE *f;
+  uint8_t *row;
+  char *filename;
+  void *exif;
+  int exif_len;
+} dt_imageio_jpeg_stream_t;
 
-  if(imgid > 0)
+static void _stream_cleanup(dt_imageio_jpeg_t *jpg, const gboolean remove)
+{
+  dt_imageio_jpeg_stream_t *s = jpg->stream;
+  jpeg_destroy_compress(&(jpg->cinfo));
+  if(s->f) fclose(s->f);
+  if(remove) g_unlink(s->filename);
+  dt_free_align(s->row);
+  g_free(s->filename);
+  free(s);
+  jpg->stream = NULL;
+}
+
+int write_image_begin(dt_imageio_module_data_t *jpg_tmp, const char *filename,
+                      dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                      void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+#ifdef MEM_SRCDST_SUPPORTED
+  // slices are encoded in parallel from the whole image
+  if(_use_slices(jpg)) return -1;
+#endif
+  dt_imageio_jpeg_stream_t *s = calloc(1, sizeof(dt_imageio_jpeg_stream_t));
+  if(!s) return 1;
+  s->f = g_fopen(filename, "wb");
+  s->row = dt_alloc_align(64, sizeof(uint8_t) * 3 * jpg->global.width);
+  if(!s->f || !s->row)
   {
-    cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
-    uint32_t len = 0;
-    cmsSaveProfileToMem(out_profile, 0, &len);
-    if(len > 0)
-    {
-      unsigned char *buf = malloc(sizeof(unsigned char) * len);
-      cmsSaveProfileToMem(out_profile, buf, &len);
-      write_icc_profile(&(jpg->cinfo), buf, len);
-      free(buf);
-    }
+    if(s->f) fclose(s->f);
+    dt_free_align(s->row);
+    free(s);
+    return 1;
   }
-
-  uint8_t *row = dt_alloc_align(64, sizeof(uint8_t) * 3 * jpg->global.width);
-  const uint8_t *buf;
-  while(jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  s->filename = g_strdup(filename);
+  s->exif = exif;
+  s->exif_len = exif_len;
+  jpg->stream = s;
+
+  jpg->cinfo.err = jpeg_std_error(&s->jerr.pub);
+  s->jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(s->jerr.setjmp_buffer))
   {
-    JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
-    for(int i = 0; i < jpg->global.width; i++)
-      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
-    tmp[0] = row;
-    jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
+    _stream_cleanup(jpg, TRUE);
+    return 1;
   }
-  jpeg_finish_compress(&(jpg->cinfo));
-  dt_free_align(row);
-  jpeg_destroy_compress(&(jpg->cinfo));
-  fclose(f);
+  _start_compress(jpg, s->f, over_type, over_filename, imgid);
+  return 0;
+}
 
-  dt_exif_write_blob(exif, exif_len, filename, 1);
+int write_image_rows(dt_imageio_module_data_t *jpg_tmp, const void *in, int first_row, int num_rows)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_stream_t *s = jpg->stream;
+  if(!s || (JDIMENSION)first_row != jpg->cinfo.next_scanline) return 1;
+  if(setjmp(s->jerr.setjmp_buffer))
+  {
+    _stream_cleanup(jpg, TRUE);
+    return 1;
+  }
+  _write_rows(&(jpg->cinfo), s->row, (const uint8_t *)in, num_rows);
+  return 0;
+}
 
+int write_image_finish(dt_imageio_module_data_t *jpg_tmp, const gboolean abort)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  dt_imageio_jpeg_stream_t *s = jpg->stream;
+  if(!s) return 1;
+  if(abort || jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  {
+    _stream_cleanup(jpg, TRUE);
+    return 1;
+  }
+  if(setjmp(s->jerr.setjmp_buffer))
+  {
+    _stream_cleanup(jpg, TRUE);
+    return 1;
+  }
+  jpeg_finish_compress(&(jpg->cinfo));
+  fclose(s->f);
+  s->f = NULL;
+  dt_exif_write_blob(s->exif, s->exif_len, s->filename, 1);
+  _stream_cleanup(jpg, FALSE);
   return 0;
 }
 
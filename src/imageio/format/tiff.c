@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <tiffio.h>
+#include <zlib.h>
 
 // it would be nice to save space by storing the masks as single channel float data,
 // but at least GIMP can't open TIFF files where not all layers have the same format.
@@ -57,6 +58,141 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
+// compression value 3 is zstd, which needs a libtiff built with it. without, fall back to deflate with predictor.
+static int _compression(const dt_imageio_tiff_t *d)
+{
+#ifdef COMPRESSION_ZSTD
+  if(d->compress == 3 && TIFFIsCODECConfigured(COMPRESSION_ZSTD)) return 3;
+#endif
+  return d->compress == 3 ? 2 : d->compress;
+}
+
+// http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
+// "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
+// "software vendors. This code should be considered obsolete. We recommend"
+// "that TIFF implementations recognize and read the obsolete code but only"
+// "write the official compression code (0x0008)."
+// http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
+// http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+static void _set_compression(TIFF *tif, const dt_imageio_tiff_t *d, const int bpp)
+{
+  const int compress = _compression(d);
+  if(compress == 1)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+  else if(compress >= 2)
+  {
+#ifdef COMPRESSION_ZSTD
+    if(compress == 3)
+    {
+      TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ZSTD);
+      // zstd goes from 1 to 22, stretch our 0-9 over the useful part of it
+      TIFFSetField(tif, TIFFTAG_ZSTD_LEVEL, MAX(1, 2 * d->compresslevel));
+    }
+    else
+#endif
+    {
+      TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
+      TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+    }
+    if(bpp == 32)
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
+    else
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+  }
+}
+
+// uncompressed size of the strips deflated in parallel
+#define DT_TIFF_STRIP_BYTES (256 * 1024)
+
+// what libtiff's predictors do to a row before compressing it, see tif_predict.c. tmp holds a row.
+static void _predict_row(uint8_t *row, uint8_t *tmp, const int width, const int layers, const int bpp)
+{
+  const size_t samples = (size_t)width * layers;
+  if(bpp == 8)
+  {
+    for(size_t k = samples - 1; k >= (size_t)layers; k--) row[k] -= row[k - layers];
+  }
+  else if(bpp == 16)
+  {
+    uint16_t *row16 = (uint16_t *)row;
+    for(size_t k = samples - 1; k >= (size_t)layers; k--) row16[k] -= row16[k - layers];
+  }
+  else
+  {
+    // floating point predictor: split the little endian floats into byte planes, most significant first,
+    // then difference the bytes
+    memcpy(tmp, row, samples * 4);
+    for(size_t k = 0; k < samples; k++)
+      for(int b = 0; b < 4; b++) row[(3 - b) * samples + k] = tmp[4 * k + b];
+    for(size_t k = samples * 4 - 1; k >= (size_t)layers; k--) row[k] -= row[k - layers];
+  }
+}
+
+// deflate the strips on all threads and hand them to libtiff ready compressed. strips go in batches,
+// so only a few of them are held in memory at a time.
+static int _write_deflate_strips(TIFF *tif, const dt_imageio_tiff_t *d, const void *in_void, const int layers,
+                                 const gboolean predictor)
+{
+  const int width = d->global.width;
+  const int height = d->global.height;
+  const int bpp = d->bpp;
+  const int level = d->compresslevel;
+  const size_t bytes = bpp / 8;
+  const size_t rowsize = (size_t)width * layers * bytes;
+  const int rows_per_strip = CLAMP(DT_TIFF_STRIP_BYTES / rowsize, 1, height);
+  const size_t stripsize = rowsize * rows_per_strip;
+  const size_t bound = compressBound(stripsize);
+  const int nstrips = (height + rows_per_strip - 1) / rows_per_strip;
+  const int batch = 4 * dt_get_num_threads();
+
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rows_per_strip);
+
+  uint8_t *raw = dt_alloc_align(64, batch * stripsize);
+  uint8_t *packed = dt_alloc_align(64, batch * bound);
+  uint8_t *tmp = dt_alloc_align(64, batch * rowsize);
+  uLongf *sizes = calloc(batch, sizeof(uLongf));
+  int err = !raw || !packed || !tmp || !sizes;
+
+  for(int first = 0; first < nstrips && !err; first += batch)
+  {
+    const int count = MIN(batch, nstrips - first);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in_void, width, height, layers, bytes, rowsize, rows_per_strip, stripsize, bound, first, \
+                      count, raw, packed, tmp, sizes, predictor, bpp, level) \
+  schedule(dynamic) reduction(|:err)
+#endif
+    for(int i = 0; i < count; i++)
+    {
+      const int y0 = (first + i) * rows_per_strip;
+      const int nrows = MIN(rows_per_strip, height - y0);
+      uint8_t *strip = raw + i * stripsize;
+      for(int y = 0; y < nrows; y++)
+      {
+        const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * bytes * width * (y0 + y);
+        uint8_t *row = strip + y * rowsize;
+        for(int x = 0; x < width; x++) memcpy(row + x * layers * bytes, in + x * 4 * bytes, layers * bytes);
+        if(predictor) _predict_row(row, tmp + i * rowsize, width, layers, bpp);
+      }
+      sizes[i] = bound;
+      err |= compress2(packed + i * bound, &sizes[i], strip, nrows * rowsize, level) != Z_OK;
+    }
+
+    for(int i = 0; i < count && !err; i++)
+      err |= TIFFWriteRawStrip(tif, first + i, packed + i * bound, sizes[i]) == -1;
+  }
+
+  dt_free_align(raw);
+  dt_free_align(packed);
+  dt_free_align(tmp);
+  free(sizes);
+  return err;
+}
+
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
@@ -126,28 +262,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 
   TIFFSetField(tif, TIFFTAG_DOCUMENTNAME, filename);
 
-  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
-  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
-  // "software vendors. This code should be considered obsolete. We recommend"
-  // "that TIFF implementations recognize and read the obsolete code but only"
-  // "write the official compression code (0x0008)."
-  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
-  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
-  if(d->compress == 1)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
-  else if(d->compress == 2)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-    if(d->bpp == 32)
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-    else
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
+  _set_compression(tif, d, d->bpp);
 
   if(profile != NULL)
   {
@@ -246,67 +361,79 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
   TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, RESUNIT_INCH);
 
-  const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
-  if((rowdata = malloc(rowsize)) == NULL)
+  const int compress = _compression(d);
+  if(G_BYTE_ORDER == G_LITTLE_ENDIAN && (compress == 1 || compress == 2))
   {
-    rc = 1;
-    goto exit;
+    if(_write_deflate_strips(tif, d, in_void, layers, compress == 2))
+    {
+      rc = 1;
+      goto exit;
+    }
   }
-
-  if(d->bpp == 32)
+  else
   {
-    for(int y = 0; y < d->global.height; y++)
+    const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
+    if((rowdata = malloc(rowsize)) == NULL)
     {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
+      rc = 1;
+      goto exit;
+    }
 
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+    if(d->bpp == 32)
+    {
+      for(int y = 0; y < d->global.height; y++)
       {
-        memcpy(out, in, sizeof(float) * layers);
-      }
+        float *in = (float *)in_void + (size_t)4 * y * d->global.width;
+        float *out = (float *)rowdata;
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
+        for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+        {
+          memcpy(out, in, sizeof(float) * layers);
+        }
+
+        if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
+        {
+          rc = 1;
+          goto exit;
+        }
       }
     }
-  }
-  else if(d->bpp == 16)
-  {
-    for(int y = 0; y < d->global.height; y++)
+    else if(d->bpp == 16)
     {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      for(int y = 0; y < d->global.height; y++)
       {
-        memcpy(out, in, sizeof(uint16_t) * layers);
-      }
+        uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
+        uint16_t *out = (uint16_t *)rowdata;
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
+        for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+        {
+          memcpy(out, in, sizeof(uint16_t) * layers);
+        }
+
+        if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
+        {
+          rc = 1;
+          goto exit;
+        }
       }
     }
-  }
-  else
-  {
-    for(int y = 0; y < d->global.height; y++)
+    else
     {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      for(int y = 0; y < d->global.height; y++)
       {
-        memcpy(out, in, sizeof(uint8_t) * layers);
-      }
+        uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
+        uint8_t *out = (uint8_t *)rowdata;
 
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
+        for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+        {
+          memcpy(out, in, sizeof(uint8_t) * layers);
+        }
+
+        if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
+        {
+          rc = 1;
+          goto exit;
+        }
       }
     }
   }
@@ -386,21 +513,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         else
           TIFFSetField(tif, TIFFTAG_PAGENAME, piece->module->name());
 
-        if(d->compress == 1)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_NONE);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
-        else if(d->compress == 2)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ADOBE_DEFLATE);
-          if(d->bpp == 32)
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
-          else
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
+        _set_compression(tif, d, d->bpp);
 
         TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
         TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
@@ -492,7 +605,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
         TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 32);
         TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
-        if(d->compress == 2) // override predictor set above assuming MASKS_USE_SAME_FORMAT
+        if(_compression(d) >= 2) // override predictor set above assuming MASKS_USE_SAME_FORMAT
             TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_FLOATINGPOINT);
         TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
         TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize(tif, 0));
@@ -635,14 +748,7 @@ void *get_params(dt_imageio_module_format_t *self)
   if(d->bpp != 16 && d->bpp != 32)
     d->bpp = 8;
 
-  // Drop redundant float case from existing config
-  // TODO: Move to legacy eventually
   d->compress = dt_conf_get_int("plugins/imageio/format/tiff/compress");
-  if(d->compress == 3)
-  {
-    d->compress = 2;
-    dt_conf_set_int("plugins/imageio/format/tiff/compress", d->compress);
-  }
 
   // TIFF compression level might actually be zero, handle this
   if(!dt_conf_key_exists("plugins/imageio/format/tiff/compresslevel"))
@@ -777,14 +883,7 @@ void gui_init(dt_imageio_module_format_t *self)
 
   const int bpp = dt_conf_get_int("plugins/imageio/format/tiff/bpp");
 
-  // Drop redundant float case from existing config
-  // TODO: Move to legacy eventually
   int compress = dt_conf_get_int("plugins/imageio/format/tiff/compress");
-  if(compress == 3)
-  {
-    compress = 2;
-    dt_conf_set_int("plugins/imageio/format/tiff/compress", compress);
-  }
 
   int shortmode = 0;
   if(dt_conf_key_exists("plugins/imageio/format/tiff/shortfile"))
@@ -818,6 +917,14 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_add(gui->compress, _("uncompressed"));
   dt_bauhaus_combobox_add(gui->compress, _("deflate"));
   dt_bauhaus_combobox_add(gui->compress, _("deflate with predictor"));
+#ifdef COMPRESSION_ZSTD
+  if(TIFFIsCODECConfigured(COMPRESSION_ZSTD))
+    dt_bauhaus_combobox_add(gui->compress, _("zstd with predictor"));
+  else if(compress == 3)
+    compress = 2;
+#else
+  if(compress == 3) compress = 2;
+#endif
   dt_bauhaus_combobox_set(gui->compress, compress);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->compress, TRUE, TRUE, 0);
 
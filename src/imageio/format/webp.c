@@ -28,10 +28,11 @@
 #include "imageio/format/imageio_format_api.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <webp/encode.h>
 
-DT_MODULE(2)
+DT_MODULE(3)
 
 typedef enum
 {
@@ -48,6 +49,17 @@ typedef enum
   hint_graphic
 } hint_t;
 
+typedef enum
+{
+  speed_best,
+  speed_balanced,
+  speed_fast,
+  speed_fastest
+} speed_t;
+
+// libwebp's method for each speed preset, 0 is fastest, 6 is slowest
+static const int webp_method[] = { 6, 4, 2, 0 };
+
 
 typedef struct dt_imageio_webp_t
 {
@@ -55,6 +67,7 @@ typedef struct dt_imageio_webp_t
   int comp_type;
   int quality;
   int hint;
+  int speed;
 } dt_imageio_webp_t;
 
 typedef struct dt_imageio_webp_gui_data_t
@@ -62,6 +75,7 @@ typedef struct dt_imageio_webp_gui_data_t
   GtkWidget *compression;
   GtkWidget *quality;
   GtkWidget *hint;
+  GtkWidget *speed;
 } dt_imageio_webp_gui_data_t;
 
 #define _stringify(a) #a
@@ -109,6 +123,12 @@ void init(dt_imageio_module_format_t *self)
   luaA_enum_value(darktable.lua_state.state, hint_t, hint_photo);
   luaA_enum_value(darktable.lua_state.state, hint_t, hint_graphic);
   dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_webp_t, hint, hint_t);
+  luaA_enum(darktable.lua_state.state, speed_t);
+  luaA_enum_value(darktable.lua_state.state, speed_t, speed_best);
+  luaA_enum_value(darktable.lua_state.state, speed_t, speed_balanced);
+  luaA_enum_value(darktable.lua_state.state, speed_t, speed_fast);
+  luaA_enum_value(darktable.lua_state.state, speed_t, speed_fastest);
+  dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_webp_t, speed, speed_t);
 #endif
 }
 void cleanup(dt_imageio_module_format_t *self)
@@ -145,7 +165,9 @@ int write_image(dt_imageio_module_data_t *webp, const char *filename, const void
   // TODO(jinxos): expose more config options in the UI
   config.lossless = webp_data->comp_type;
   config.image_hint = webp_data->hint;
-  config.method = 6;
+  config.method = webp_method[CLAMP(webp_data->speed, speed_best, speed_fastest)];
+  // lossy encoding can analyse and encode in separate threads, if this export has more than one core
+  config.thread_level = omp_get_max_threads() > 1;
 
   // these are to allow for large image export.
   // TODO(jinxos): these values should be adjusted as needed and ideally determined at runtime.
@@ -204,7 +226,7 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
                     const size_t old_params_size, const int old_version, const int new_version,
                     size_t *new_size)
 {
-  if(old_version == 1 && new_version == 2)
+  if(old_version == 1 && new_version == 3)
   {
     typedef struct dt_imageio_webp_v1_t
     {
@@ -228,6 +250,26 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     n->comp_type = o->comp_type;
     n->quality = o->quality;
     n->hint = o->hint;
+    n->speed = speed_best;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  else if(old_version == 2 && new_version == 3)
+  {
+    typedef struct dt_imageio_webp_v2_t
+    {
+      dt_imageio_module_data_t global;
+      int comp_type;
+      int quality;
+      int hint;
+    } dt_imageio_webp_v2_t;
+
+    const dt_imageio_webp_v2_t *o = (dt_imageio_webp_v2_t *)old_params;
+    dt_imageio_webp_t *n = (dt_imageio_webp_t *)malloc(sizeof(dt_imageio_webp_t));
+
+    memcpy(n, o, sizeof(dt_imageio_webp_v2_t));
+    // these were always encoded with the slowest method
+    n->speed = speed_best;
     *new_size = self->params_size(self);
     return n;
   }
@@ -243,6 +285,7 @@ void *get_params(dt_imageio_module_format_t *self)
   else
     d->quality = 100;
   d->hint = dt_conf_get_int("plugins/imageio/format/webp/hint");
+  d->speed = dt_conf_get_int("plugins/imageio/format/webp/speed");
   return d;
 }
 
@@ -254,6 +297,7 @@ int set_params(dt_imageio_module_format_t *self, const void *params, const int s
   dt_bauhaus_combobox_set(g->compression, d->comp_type);
   dt_bauhaus_slider_set(g->quality, d->quality);
   dt_bauhaus_combobox_set(g->hint, d->hint);
+  dt_bauhaus_combobox_set(g->speed, d->speed);
   return 0;
 }
 
@@ -311,6 +355,12 @@ static void hint_combobox_changed(GtkWidget *widget, gpointer user_data)
   dt_conf_set_int("plugins/imageio/format/webp/hint", hint);
 }
 
+static void speed_combobox_changed(GtkWidget *widget, gpointer user_data)
+{
+  const int speed = dt_bauhaus_combobox_get(widget);
+  dt_conf_set_int("plugins/imageio/format/webp/speed", speed);
+}
+
 void gui_init(dt_imageio_module_format_t *self)
 {
   dt_imageio_webp_gui_data_t *gui = (dt_imageio_webp_gui_data_t *)malloc(sizeof(dt_imageio_webp_gui_data_t));
@@ -318,6 +368,7 @@ void gui_init(dt_imageio_module_format_t *self)
   const int comp_type = dt_conf_get_int("plugins/imageio/format/webp/comp_type");
   const int quality = dt_conf_get_int("plugins/imageio/format/webp/quality");
   const int hint = dt_conf_get_int("plugins/imageio/format/webp/hint");
+  const int speed = dt_conf_get_int("plugins/imageio/format/webp/speed");
 
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
 
@@ -361,6 +412,18 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_set(gui->hint, hint);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->hint, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(gui->hint), "value-changed", G_CALLBACK(hint_combobox_changed), NULL);
+
+  gui->speed = dt_bauhaus_combobox_new(NULL);
+  dt_bauhaus_widget_set_label(gui->speed, NULL, N_("encoding speed"));
+  gtk_widget_set_tooltip_text(gui->speed, _("trade encoding time for file size.\n"
+                                            "faster settings give larger files at the same quality."));
+  dt_bauhaus_combobox_add(gui->speed, _("best compression"));
+  dt_bauhaus_combobox_add(gui->speed, _("balanced"));
+  dt_bauhaus_combobox_add(gui->speed, _("fast"));
+  dt_bauhaus_combobox_add(gui->speed, _("fastest"));
+  dt_bauhaus_combobox_set(gui->speed, speed);
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->speed, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->speed), "value-changed", G_CALLBACK(speed_combobox_changed), NULL);
 }
 
 void gui_cleanup(dt_imageio_module_format_t *self)
@@ -374,9 +437,11 @@ void gui_reset(dt_imageio_module_format_t *self)
   const int comp_type = dt_confgen_get_int("plugins/imageio/format/webp/comp_type", DT_DEFAULT);
   const int quality = dt_confgen_get_int("plugins/imageio/format/webp/quality", DT_DEFAULT);
   const int hint = dt_confgen_get_int("plugins/imageio/format/webp/hint", DT_DEFAULT);
+  const int speed = dt_confgen_get_int("plugins/imageio/format/webp/speed", DT_DEFAULT);
   dt_bauhaus_combobox_set(gui->compression, comp_type);
   dt_bauhaus_slider_set(gui->quality, quality);
   dt_bauhaus_combobox_set(gui->hint, hint);
+  dt_bauhaus_combobox_set(gui->speed, speed);
 }
 
 int flags(dt_imageio_module_data_t *data)
@@ -35,10 +35,18 @@
 #ifdef GDK_WINDOWING_QUARTZ
 #include "osx/osx.h"
 #endif
+#include <errno.h>
+#include <fcntl.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 DT_MODULE(3)
 
@@ -56,14 +64,155 @@ typedef struct disk_t
   GtkWidget *onsave_action;
 } disk_t;
 
+typedef enum dt_disk_fsync_t
+{
+  DT_DISK_FSYNC_NEVER = 0,
+  DT_DISK_FSYNC_FILE = 1,
+  DT_DISK_FSYNC_JOB = 2
+} dt_disk_fsync_t;
+
+// moves finished exports from a local temporary directory to their destination, so that the export
+// threads don't wait on slow (network) file systems. the token queue bounds how many files wait.
+typedef struct dt_disk_writer_t
+{
+  GThread *thread;
+  GAsyncQueue *queue;  // dt_disk_write_t, or the writer itself to stop
+  GAsyncQueue *tokens; // one entry per free slot
+  dt_disk_fsync_t fsync;
+  dt_pthread_mutex_t lock;
+  GList *written; // paths to sync at the end of the job
+} dt_disk_writer_t;
+
+typedef struct dt_disk_write_t
+{
+  gchar *tmpdir;     // holds the exported file, and any extra sizes written next to it
+  gchar *output_dir;
+} dt_disk_write_t;
+
 // saved params
 typedef struct dt_imageio_disk_t
 {
   char filename[DT_MAX_PATH_FOR_PARAMS];
   dt_disk_onconflict_actions_t onsave_action;
   dt_variables_params_t *vp;
+  dt_variables_template_t *filename_template; // the parsed pattern of the last file
+  dt_disk_writer_t *writer; // only while a job runs
 } dt_imageio_disk_t;
 
+// large enough for network file systems to see few, big requests
+#define DT_DISK_COPY_BUFFER (4 * 1024 * 1024)
+
+static int _sync_fd(const int fd)
+{
+#ifdef _WIN32
+  return _commit(fd);
+#else
+  return fsync(fd);
+#endif
+}
+
+static void _sync_file(const char *path)
+{
+  const int fd = g_open(path, O_RDONLY, 0);
+  if(fd < 0) return;
+  _sync_fd(fd);
+  close(fd);
+}
+
+static int _copy_file(const char *src, const char *dst, char *buf, const gboolean sync)
+{
+  const int in = g_open(src, O_RDONLY | O_BINARY, 0);
+  if(in < 0) return 1;
+  const int out = g_open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+  if(out < 0)
+  {
+    close(in);
+    return 1;
+  }
+  int err = 0;
+  for(;;)
+  {
+    const ssize_t len = read(in, buf, DT_DISK_COPY_BUFFER);
+    if(len < 0 && errno == EINTR) continue;
+    if(len <= 0)
+    {
+      err = len < 0;
+      break;
+    }
+    for(ssize_t done = 0; done < len && !err;)
+    {
+      const ssize_t n = write(out, buf + done, len - done);
+      if(n < 0 && errno == EINTR) continue;
+      if(n <= 0) err = 1;
+      else done += n;
+    }
+    if(err) break;
+  }
+  if(!err && sync) err = _sync_fd(out) != 0;
+  close(in);
+  err |= close(out) != 0;
+  return err;
+}
+
+// move everything from the temporary directory into the output directory
+static void _write_out(dt_disk_writer_t *w, dt_disk_write_t *job, char *buf)
+{
+  GDir *dir = g_dir_open(job->tmpdir, 0, NULL);
+  const gchar *name;
+  while(dir && (name = g_dir_read_name(dir)))
+  {
+    gchar *src = g_build_filename(job->tmpdir, name, NULL);
+    gchar *dst = g_build_filename(job->output_dir, name, NULL);
+    // a rename only works when the temporary directory is on the same file system
+    const gboolean moved = w->fsync != DT_DISK_FSYNC_FILE && g_rename(src, dst) == 0;
+    if(!moved && _copy_file(src, dst, buf, w->fsync == DT_DISK_FSYNC_FILE))
+    {
+      fprintf(stderr, "[imageio_storage_disk] could not write file: `%s'!\n", dst);
+      dt_control_log(_("could not export to file `%s'!"), dst);
+      g_unlink(dst);
+    }
+    else if(w->fsync == DT_DISK_FSYNC_JOB)
+    {
+      dt_pthread_mutex_lock(&w->lock);
+      w->written = g_list_prepend(w->written, dst);
+      dt_pthread_mutex_unlock(&w->lock);
+      dst = NULL;
+    }
+    g_unlink(src);
+    g_free(src);
+    g_free(dst);
+  }
+  if(dir) g_dir_close(dir);
+  g_rmdir(job->tmpdir);
+}
+
+static gpointer _writer_thread(gpointer data)
+{
+  dt_disk_writer_t *w = (dt_disk_writer_t *)data;
+  char *buf = g_malloc(DT_DISK_COPY_BUFFER);
+  for(;;)
+  {
+    gpointer item = g_async_queue_pop(w->queue);
+    if(item == w) break;
+    dt_disk_write_t *job = (dt_disk_write_t *)item;
+    _write_out(w, job, buf);
+    g_free(job->tmpdir);
+    g_free(job->output_dir);
+    free(job);
+    g_async_queue_push(w->tokens, GINT_TO_POINTER(1));
+  }
+  g_free(buf);
+  return NULL;
+}
+
+static dt_disk_fsync_t _fsync_policy(void)
+{
+  const char *policy = dt_conf_get_string_const("plugins/imageio/storage/disk/fsync");
+  if(!g_strcmp0(policy, "file")) return DT_DISK_FSYNC_FILE;
+  if(!g_strcmp0(policy, "job")) return DT_DISK_FSYNC_JOB;
+  return DT_DISK_FSYNC_NEVER;
+}
+
 
 const char *name(const struct dt_imageio_module_storage_t *self)
 {
@@ -233,6 +382,12 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
   dt_variables_set_upscale(d->vp, upscale);
 
+  // incremental export: leave files alone which were written from the same history with the same settings
+  gchar *fingerprint = dt_conf_get_bool("plugins/imageio/storage/disk/incremental")
+    ? dt_imageio_export_fingerprint(imgid, format, fdata, self, sdata, high_quality, upscale, icc_type,
+                                    icc_filename, icc_intent, metadata)
+    : NULL;
+
   gboolean fail = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
@@ -253,7 +408,13 @@ try_again:
     d->vp->imgid = imgid;
     d->vp->sequence = num;
 
-    gchar *result_filename = dt_variables_expand(d->vp, pattern, TRUE);
+    // the pattern is the same for all the images unless a fallback kicks in, parse it once for the export
+    if(!d->filename_template || strcmp(dt_variables_template_get_source(d->filename_template), pattern))
+    {
+      dt_variables_template_free(d->filename_template);
+      d->filename_template = dt_variables_template_new(pattern);
+    }
+    gchar *result_filename = dt_variables_template_expand(d->vp, d->filename_template, TRUE);
     g_strlcpy(filename, result_filename, sizeof(filename));
     g_free(result_filename);
 
@@ -294,6 +455,16 @@ try_again:
   failed:
     g_free(output_dir);
 
+    if(!fail && fingerprint && dt_imageio_export_is_up_to_date(imgid, filename, fingerprint))
+    {
+      dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+      fprintf(stderr, "[export_job] `%s' is up to date\n", filename);
+      dt_control_log(ngettext("%d/%d `%s' is up to date", "%d/%d `%s' is up to date", num),
+                     num, total, filename);
+      g_free(fingerprint);
+      return 0;
+    }
+
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME)
     {
       int seq = 1;
@@ -302,6 +473,12 @@ try_again:
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+      // the file only shows up once the writer gets to it, claim the name until then
+      if(d->writer && d->writer->thread)
+      {
+        FILE *f = g_fopen(filename, "wb");
+        if(f) fclose(f);
+      }
     }
 
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_SKIP)
@@ -312,31 +489,136 @@ try_again:
         fprintf(stderr, "[export_job] skipping `%s'\n", filename);
         dt_control_log(ngettext("%d/%d skipping `%s'", "%d/%d skipping `%s'", num),
                        num, total, filename);
+        g_free(fingerprint);
         return 0;
       }
     }
   } // end of critical block
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-  if(fail) return 1;
+  if(fail)
+  {
+    g_free(fingerprint);
+    return 1;
+  }
+
+  // with a writer thread, export into a temporary directory of its own and queue that
+  dt_disk_writer_t *w = d->writer;
+  gchar *tmpdir = w && w->thread ? g_dir_make_tmp("darktable-export-XXXXXX", NULL) : NULL;
+  gchar *basename = g_path_get_basename(filename);
+  gchar *written = tmpdir ? g_build_filename(tmpdir, basename, NULL) : g_strdup(filename);
+  g_free(basename);
 
   /* export image to file */
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality, upscale, TRUE, export_masks, icc_type,
+  if(dt_imageio_export(imgid, written, format, fdata, high_quality, upscale, TRUE, export_masks, icc_type,
                        icc_filename, icc_intent, self, sdata, num, total, metadata) != 0)
   {
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    if(tmpdir)
+    {
+      g_unlink(written);
+      g_rmdir(tmpdir);
+      if(d->onsave_action == DT_EXPORT_ONCONFLICT_UNIQUEFILENAME) g_unlink(filename);
+    }
+    g_free(tmpdir);
+    g_free(written);
+    g_free(fingerprint);
     return 1;
   }
 
+  if(fingerprint)
+  {
+    dt_imageio_export_set_fingerprint(imgid, filename, fingerprint);
+    g_free(fingerprint);
+  }
+
+  if(tmpdir)
+  {
+    dt_disk_write_t *job = malloc(sizeof(dt_disk_write_t));
+    job->tmpdir = tmpdir;
+    job->output_dir = g_path_get_dirname(filename);
+    // wait for a free slot, so the queue doesn't pile up temporary files
+    g_async_queue_pop(w->tokens);
+    g_async_queue_push(w->queue, job);
+    g_free(written);
+  }
+  else if(w && w->fsync == DT_DISK_FSYNC_FILE)
+  {
+    _sync_file(written);
+    g_free(written);
+  }
+  else if(w && w->fsync == DT_DISK_FSYNC_JOB)
+  {
+    dt_pthread_mutex_lock(&w->lock);
+    w->written = g_list_prepend(w->written, written);
+    dt_pthread_mutex_unlock(&w->lock);
+  }
+  else
+    g_free(written);
+
   fprintf(stderr, "[export_job] exported to `%s'\n", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
                  num, total, filename);
   return 0;
 }
 
+const char *extra_sizes(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
+{
+  return dt_conf_get_string_const("plugins/imageio/storage/disk/extra_sizes");
+}
+
+gboolean parallel_store(dt_imageio_module_storage_t *self)
+{
+  // the file name generation above is serialized, the rest only touches its own image
+  return TRUE;
+}
+
+int initialize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data,
+                     dt_imageio_module_format_t **format, dt_imageio_module_data_t **fdata, GList **images,
+                     const gboolean high_quality, const gboolean upscale)
+{
+  dt_imageio_disk_t *d = (dt_imageio_disk_t *)data;
+  dt_disk_writer_t *w = calloc(1, sizeof(dt_disk_writer_t));
+  if(!w) return 1;
+  w->fsync = _fsync_policy();
+  dt_pthread_mutex_init(&w->lock, NULL);
+
+  // the copy format writes straight to the target, there is nothing to hand over
+  const int slots = dt_conf_get_int("plugins/imageio/storage/disk/write_queue");
+  if(slots > 0 && strcmp((*format)->mime(*fdata), "x-copy"))
+  {
+    w->queue = g_async_queue_new();
+    w->tokens = g_async_queue_new();
+    for(int i = 0; i < slots; i++) g_async_queue_push(w->tokens, GINT_TO_POINTER(1));
+    w->thread = g_thread_new("disk writer", _writer_thread, w);
+  }
+  d->writer = w;
+  return 0;
+}
+
+void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
+{
+  dt_imageio_disk_t *d = (dt_imageio_disk_t *)data;
+  dt_disk_writer_t *w = d->writer;
+  if(!w) return;
+  d->writer = NULL;
+
+  if(w->thread)
+  {
+    g_async_queue_push(w->queue, w);
+    g_thread_join(w->thread);
+    g_async_queue_unref(w->queue);
+    g_async_queue_unref(w->tokens);
+  }
+  for(GList *iter = w->written; iter; iter = g_list_next(iter)) _sync_file((const char *)iter->data);
+  g_list_free_full(w->written, g_free);
+  dt_pthread_mutex_destroy(&w->lock);
+  free(w);
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
-  return sizeof(dt_imageio_disk_t) - sizeof(void *);
+  return offsetof(dt_imageio_disk_t, vp);
 }
 
 void init(dt_imageio_module_storage_t *self)
@@ -366,7 +648,9 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
 {
   if(!params) return;
   dt_imageio_disk_t *d = (dt_imageio_disk_t *)params;
+  finalize_store(self, params);
   dt_variables_params_destroy(d->vp);
+  dt_variables_template_free(d->filename_template);
   free(params);
 }
 
@@ -36,6 +36,7 @@
 #ifdef GDK_WINDOWING_QUARTZ
 #include "osx/osx.h"
 #endif
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -55,16 +56,13 @@ typedef struct dt_imageio_gallery_t
   char title[1024];
   char cached_dirname[DT_MAX_PATH_FOR_PARAMS]; // expanded during first img store, not stored in param struct.
   dt_variables_params_t *vp;
-  GList *l;
+  FILE *index; // index.html, written as the images come in
+  FILE *items; // the photoswipe items, appended to the index at the end
+  size_t count;
 } dt_imageio_gallery_t;
 
-// sorted list of all images
-typedef struct pair_t
-{
-  char line[4096];
-  char item[4096];
-  int pos;
-} pair_t;
+// longest edge of the thumbnails, scaled down from the export itself
+#define DT_GALLERY_THUMB_SIZE 200
 
 
 const char *name(const struct dt_imageio_module_storage_t *self)
@@ -202,9 +200,44 @@ void gui_reset(dt_imageio_module_storage_t *self)
   dt_conf_set_string("plugins/imageio/storage/gallery/title", gtk_entry_get_text(d->title_entry));
 }
 
-static gint sort_pos(pair_t *a, pair_t *b)
+static void _open_index(dt_imageio_gallery_t *d)
+{
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s/index.html", d->cached_dirname);
+  d->index = g_fopen(filename, "wb");
+  d->items = tmpfile();
+  if(!d->index || !d->items)
+  {
+    if(d->index) fclose(d->index);
+    if(d->items) fclose(d->items);
+    d->index = d->items = NULL;
+    return;
+  }
+
+  const char *title = d->title;
+  fprintf(d->index,
+          "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\" "
+          "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
+          "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
+          "  <head>\n"
+          "    <meta http-equiv=\"Content-type\" content=\"text/html;charset=UTF-8\" />\n"
+          "    <link rel=\"shortcut icon\" href=\"style/favicon.ico\" />\n"
+          "    <link rel=\"stylesheet\" href=\"style/style.css\" type=\"text/css\" />\n"
+          "    <link rel=\"stylesheet\" href=\"pswp/photoswipe.css\">\n"
+          "    <link rel=\"stylesheet\" href=\"pswp/default-skin/default-skin.css\">\n"
+          "    <script src=\"pswp/photoswipe.min.js\"></script>\n"
+          "    <script src=\"pswp/photoswipe-ui-default.min.js\"></script>\n"
+          "    <title>%s</title>\n"
+          "  </head>\n"
+          "  <body>\n"
+          "    <div class=\"title\">%s</div>\n"
+          "    <div class=\"page\">\n",
+          title, title);
+}
+
+const char *extra_sizes(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
 {
-  return a->pos - b->pos;
+  return G_STRINGIFY(DT_GALLERY_THUMB_SIZE);
 }
 
 int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int imgid,
@@ -279,8 +312,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
 
   sprintf(c, ".%s", ext);
 
-  // save image to list, in order:
-  pair_t *pair = malloc(sizeof(pair_t));
+  char line[4096], item[4096];
 
   char *title = NULL, *description = NULL;
   GList *res_title = NULL, *res_desc = NULL;
@@ -325,7 +357,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   gchar *esc_relfilename = g_strescape(relfilename, NULL);
   gchar *esc_relthumbfilename = g_strescape(relthumbfilename, NULL);
 
-  snprintf(pair->line, sizeof(pair->line),
+  snprintf(line, sizeof(line),
            "\n"
            "      <div><div class=\"dia\">\n"
            "      <img src=\"%s\" alt=\"img%d\" class=\"img\" onclick=\"openSwipe(%d)\"/></div>\n"
@@ -344,13 +376,12 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   {
     fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
-    free(pair);
     g_free(esc_relfilename);
     g_free(esc_relthumbfilename);
     return 1;
   }
 
-  snprintf(pair->item, sizeof(pair->item),
+  snprintf(item, sizeof(item),
            "{\n"
            "src: \"%s\",\n"
            "w: %d,\n"
@@ -362,33 +393,47 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   g_free(esc_relfilename);
   g_free(esc_relthumbfilename);
 
-  pair->pos = num;
-  d->l = g_list_insert_sorted(d->l, pair, (GCompareFunc)sort_pos);
-  free(pair);
-
-  /* also export thumbnail: */
-  // write with reduced resolution:
-  const int save_max_width = fdata->max_width;
-  const int save_max_height = fdata->max_height;
-  fdata->max_width = 200;
-  fdata->max_height = 200;
-  // alter filename with -thumb:
+  // images are stored one after the other, so the index can be written as they come
+  if(!d->index) _open_index(d);
+  if(d->index)
+  {
+    fputs(line, d->index);
+    fputs(item, d->items);
+    fflush(d->index);
+    d->count++;
+  }
+
+  /* thumbnail: */
+  // the export wrote it next to the image as name_<size>.ext, only move it to name-thumb.ext
   c = filename + strlen(filename);
   for(; c > filename && *c != '.' && *c != '/'; c--)
     ;
   if(c <= filename || *c == '/') c = filename + strlen(filename);
+  char scaledfilename[PATH_MAX] = { 0 };
+  snprintf(scaledfilename, sizeof(scaledfilename), "%.*s_%d%s", (int)(c - filename), filename,
+           DT_GALLERY_THUMB_SIZE, c);
   ext = format->extension(fdata);
   sprintf(c, "-thumb.%s", ext);
-  if(dt_imageio_export(imgid, filename, format, fdata, FALSE, TRUE, FALSE, export_masks, icc_type, icc_filename,
-                       icc_intent, self, sdata, num, total, NULL) != 0)
+
+  if(!g_file_test(scaledfilename, G_FILE_TEST_EXISTS) || g_rename(scaledfilename, filename) != 0)
   {
-    fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
-    dt_control_log(_("could not export to file `%s'!"), filename);
-    return 1;
+    // no scaled copy for images no larger than the thumbnail: export again at reduced resolution
+    const int save_max_width = fdata->max_width;
+    const int save_max_height = fdata->max_height;
+    fdata->max_width = DT_GALLERY_THUMB_SIZE;
+    fdata->max_height = DT_GALLERY_THUMB_SIZE;
+    const int failed = dt_imageio_export(imgid, filename, format, fdata, FALSE, TRUE, FALSE, export_masks, icc_type,
+                                         icc_filename, icc_intent, NULL, NULL, num, total, NULL);
+    // restore for next image:
+    fdata->max_width = save_max_width;
+    fdata->max_height = save_max_height;
+    if(failed)
+    {
+      fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
+      dt_control_log(_("could not export to file `%s'!"), filename);
+      return 1;
+    }
   }
-  // restore for next image:
-  fdata->max_width = save_max_width;
-  fdata->max_height = save_max_height;
 
   printf("[export_job] exported to `%s'\n", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
@@ -433,38 +478,9 @@ void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t
   sprintf(c, "/pswp/default-skin/preloader.gif");
   dt_copy_resource_file("/pswp/default-skin/preloader.gif", filename);
 
-  sprintf(c, "/index.html");
-
-  const char *title = d->title;
-
-  FILE *f = g_fopen(filename, "wb");
+  if(!d->index) _open_index(d);
+  FILE *f = d->index;
   if(!f) return;
-  fprintf(f,
-          "<!DOCTYPE html PUBLIC \"-//W3C//DTD XHTML 1.0 Transitional//EN\" "
-          "\"http://www.w3.org/TR/xhtml1/DTD/xhtml1-transitional.dtd\">\n"
-          "<html xmlns=\"http://www.w3.org/1999/xhtml\">\n"
-          "  <head>\n"
-          "    <meta http-equiv=\"Content-type\" content=\"text/html;charset=UTF-8\" />\n"
-          "    <link rel=\"shortcut icon\" href=\"style/favicon.ico\" />\n"
-          "    <link rel=\"stylesheet\" href=\"style/style.css\" type=\"text/css\" />\n"
-          "    <link rel=\"stylesheet\" href=\"pswp/photoswipe.css\">\n"
-          "    <link rel=\"stylesheet\" href=\"pswp/default-skin/default-skin.css\">\n"
-          "    <script src=\"pswp/photoswipe.min.js\"></script>\n"
-          "    <script src=\"pswp/photoswipe-ui-default.min.js\"></script>\n"
-          "    <title>%s</title>\n"
-          "  </head>\n"
-          "  <body>\n"
-          "    <div class=\"title\">%s</div>\n"
-          "    <div class=\"page\">\n",
-          title, title);
-
-  size_t count = 0;
-  for(GList *tmp = d->l; tmp; tmp = g_list_next(tmp))
-  {
-    pair_t *p = (pair_t *)tmp->data;
-    fprintf(f, "%s", p->line);
-    count++;
-  }
 
   fprintf(f, "        <p style=\"clear:both;\"></p>\n"
              "    </div>\n"
@@ -514,15 +530,13 @@ void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t
              "<script>\n"
              "var pswpElement = document.querySelectorAll('.pswp')[0];\n"
              "var items = [\n",
-          count,
+          d->count,
           darktable_package_string);
-  while(d->l)
-  {
-    pair_t *p = (pair_t *)d->l->data;
-    fprintf(f, "%s", p->item);
-    free(p);
-    d->l = g_list_delete_link(d->l, d->l);
-  }
+  rewind(d->items);
+  char buf[4096];
+  size_t len;
+  while((len = fread(buf, 1, sizeof(buf), d->items)) > 0) fwrite(buf, 1, len, f);
+  fclose(d->items);
   fprintf(f, "];\n"
              "function openSwipe(img)\n"
              "{\n"
@@ -537,11 +551,13 @@ void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t
              "</script>\n"
              "</html>\n");
   fclose(f);
+  d->index = d->items = NULL;
+  d->count = 0;
 }
 
 size_t params_size(dt_imageio_module_storage_t *self)
 {
-  return sizeof(dt_imageio_gallery_t) - 2 * sizeof(void *) - DT_MAX_PATH_FOR_PARAMS;
+  return offsetof(dt_imageio_gallery_t, cached_dirname);
 }
 
 void init(dt_imageio_module_storage_t *self)
@@ -557,7 +573,6 @@ void *get_params(dt_imageio_module_storage_t *self)
 {
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)calloc(1, sizeof(dt_imageio_gallery_t));
   d->vp = NULL;
-  d->l = NULL;
   dt_variables_params_init(&d->vp);
 
   const char *text = dt_conf_get_string_const("plugins/imageio/storage/gallery/file_directory");
@@ -573,6 +588,8 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
 {
   if(!params) return;
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)params;
+  if(d->index) fclose(d->index);
+  if(d->items) fclose(d->items);
   dt_variables_params_destroy(d->vp);
   free(params);
 }
@@ -84,8 +84,16 @@ REQUIRED(int, set_params, struct dt_imageio_module_storage_t *self, const void *
 
 OPTIONAL(void, export_dispatched, struct dt_imageio_module_storage_t *self);
 
+/* return TRUE if store() may be called from several threads at once, so that
+   an export job can process more than one image at a time. */
+OPTIONAL(gboolean, parallel_store, struct dt_imageio_module_storage_t *self);
+
 OPTIONAL(char *, ask_user_confirmation, struct dt_imageio_module_storage_t *self);
 
+/* comma separated maximum sizes of smaller copies to write next to each exported file, as name_<size>.ext.
+   they are scaled down from the export instead of processing the image again. */
+OPTIONAL(const char *, extra_sizes, struct dt_imageio_module_storage_t *self, struct dt_imageio_module_data_t *data);
+
 #ifdef FULL_API_H
 
 #pragma GCC visibility pop
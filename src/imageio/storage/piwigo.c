@@ -110,8 +110,33 @@ typedef struct dt_storage_piwigo_params_t
   int privacy;
   gboolean export_tags; // deprecated - let here not to change params size. to be removed on next version change
   gchar *tags;
+  struct _piwigo_uploader_t *uploader; // only while a job runs
 } dt_storage_piwigo_params_t;
 
+// an exported image waiting to be uploaded
+typedef struct _piwigo_upload_t
+{
+  gchar *fname;
+  gchar *author, *caption, *description, *tags;
+  int64_t album_id;
+  int num, total;
+} _piwigo_upload_t;
+
+// uploads run on a few threads of their own, each with its own logged in curl handle so the connection is
+// reused, while the export goes on with the next images. the token queue bounds how many files wait.
+typedef struct _piwigo_uploader_t
+{
+  GThread **threads;
+  int nthreads;
+  GAsyncQueue *queue;  // _piwigo_upload_t, or the uploader itself to stop a thread
+  GAsyncQueue *tokens; // one entry per free slot
+  gchar *server, *username, *password;
+  int privacy;
+} _piwigo_uploader_t;
+
+// attempts per image, with a growing pause in between
+#define PIWIGO_UPLOAD_ATTEMPTS 3
+
 /* low-level routine doing the HTTP POST request */
 static void _piwigo_api_post(_piwigo_api_context_t *ctx, GList *args, char *filename, gboolean isauth);
 
@@ -705,8 +730,9 @@ static gboolean _piwigo_api_create_new_album(dt_storage_piwigo_params_t *p)
   return TRUE;
 }
 
-static gboolean _piwigo_api_upload_photo(dt_storage_piwigo_params_t *p, gchar *fname,
-                                         gchar *author, gchar *caption, gchar *description)
+static gboolean _piwigo_api_upload_photo(_piwigo_api_context_t *api, const int64_t album_id, const int level,
+                                         const gchar *tags, gchar *fname, gchar *author, gchar *caption,
+                                         gchar *description)
 {
   GList *args = NULL;
   char cat[10];
@@ -714,8 +740,8 @@ static gboolean _piwigo_api_upload_photo(dt_storage_piwigo_params_t *p, gchar *f
 
   // upload picture
 
-  snprintf(cat, sizeof(cat), "%"PRId64, p->album_id);
-  snprintf(privacy, sizeof(privacy), "%d", p->privacy);
+  snprintf(cat, sizeof(cat), "%"PRId64, album_id);
+  snprintf(privacy, sizeof(privacy), "%d", level);
 
   args = _piwigo_query_add_arguments(args, "method", "pwg.images.addSimple");
   args = _piwigo_query_add_arguments(args, "image", fname);
@@ -731,14 +757,66 @@ static gboolean _piwigo_api_upload_photo(dt_storage_piwigo_params_t *p, gchar *f
   if(description && strlen(description)>0)
     args = _piwigo_query_add_arguments(args, "comment", description);
 
-  if(p->tags && strlen(p->tags)>0)
-    args = _piwigo_query_add_arguments(args, "tags", p->tags);
+  if(tags && strlen(tags)>0)
+    args = _piwigo_query_add_arguments(args, "tags", tags);
 
-  _piwigo_api_post(p->api, args, fname, FALSE);
+  _piwigo_api_post(api, args, fname, FALSE);
 
   g_list_free(args);
 
-  return !p->api->error_occured;
+  return !api->error_occured;
+}
+
+static void _piwigo_upload_free(_piwigo_upload_t *u)
+{
+  g_unlink(u->fname);
+  g_free(u->fname);
+  g_free(u->author);
+  g_free(u->caption);
+  g_free(u->description);
+  g_free(u->tags);
+  free(u);
+}
+
+static gpointer _piwigo_upload_thread(gpointer data)
+{
+  _piwigo_uploader_t *up = (_piwigo_uploader_t *)data;
+
+  _piwigo_api_context_t *api = _piwigo_ctx_init();
+  api->server = g_strdup(up->server);
+  api->username = g_strdup(up->username);
+  api->password = g_strdup(up->password);
+  _piwigo_api_authenticate(api);
+
+  for(;;)
+  {
+    gpointer item = g_async_queue_pop(up->queue);
+    if(item == up) break;
+    _piwigo_upload_t *u = (_piwigo_upload_t *)item;
+
+    gboolean status = FALSE;
+    for(int attempt = 0; attempt < PIWIGO_UPLOAD_ATTEMPTS && !status; attempt++)
+    {
+      if(attempt) g_usleep(G_USEC_PER_SEC << (attempt - 1));
+      status = _piwigo_api_upload_photo(api, u->album_id, up->privacy, u->tags, u->fname, u->author,
+                                        u->caption, u->description);
+    }
+
+    if(status)
+      dt_control_log(ngettext("%d/%d exported to piwigo webalbum", "%d/%d exported to piwigo webalbum", u->num),
+                     u->num, u->total);
+    else
+    {
+      fprintf(stderr, "[imageio_storage_piwigo] could not upload to piwigo!\n");
+      dt_control_log(_("could not upload to piwigo!"));
+    }
+
+    _piwigo_upload_free(u);
+    g_async_queue_push(up->tokens, GINT_TO_POINTER(1));
+  }
+
+  _piwigo_ctx_destroy(&api);
+  return NULL;
 }
 
 // Login button pressed...
@@ -942,8 +1020,52 @@ static gboolean _finalize_store(gpointer user_data)
   return FALSE;
 }
 
+int initialize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data,
+                     dt_imageio_module_format_t **format, dt_imageio_module_data_t **fdata, GList **images,
+                     const gboolean high_quality, const gboolean upscale)
+{
+  dt_storage_piwigo_params_t *p = (dt_storage_piwigo_params_t *)data;
+  const int nthreads = MIN(dt_conf_get_int("plugins/imageio/storage/piwigo/uploads"), g_list_length(*images));
+  if(nthreads < 1 || !p->api) return 0;
+
+  _piwigo_uploader_t *up = calloc(1, sizeof(_piwigo_uploader_t));
+  if(!up) return 0;
+  up->server = g_strdup(p->api->server);
+  up->username = g_strdup(p->api->username);
+  up->password = g_strdup(p->api->password);
+  up->privacy = p->privacy;
+  up->queue = g_async_queue_new();
+  up->tokens = g_async_queue_new();
+  // a couple of exports ahead of the uploads, each being a temporary file until it's sent
+  for(int i = 0; i < 2 * nthreads; i++) g_async_queue_push(up->tokens, GINT_TO_POINTER(1));
+  up->nthreads = nthreads;
+  up->threads = g_malloc_n(nthreads, sizeof(GThread *));
+  for(int i = 0; i < nthreads; i++) up->threads[i] = g_thread_new("piwigo upload", _piwigo_upload_thread, up);
+  p->uploader = up;
+  return 0;
+}
+
+// wait for the uploads still queued
+static void _piwigo_uploader_finish(dt_storage_piwigo_params_t *p)
+{
+  _piwigo_uploader_t *up = p->uploader;
+  if(!up) return;
+  p->uploader = NULL;
+
+  for(int i = 0; i < up->nthreads; i++) g_async_queue_push(up->queue, up);
+  for(int i = 0; i < up->nthreads; i++) g_thread_join(up->threads[i]);
+  g_free(up->threads);
+  g_async_queue_unref(up->queue);
+  g_async_queue_unref(up->tokens);
+  g_free(up->server);
+  g_free(up->username);
+  g_free(up->password);
+  free(up);
+}
+
 void finalize_store(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
 {
+  if(data) _piwigo_uploader_finish((dt_storage_piwigo_params_t *)data);
   g_main_context_invoke(NULL, _finalize_store, self->gui_data);
 }
 
@@ -956,6 +1078,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   dt_storage_piwigo_gui_data_t *ui = self->gui_data;
 
   gint result = 0;
+  _piwigo_upload_t *upload = NULL;
 
   const char *ext = format->extension(fdata);
 
@@ -1038,9 +1161,30 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
       if(!status) dt_control_log(_("cannot create a new piwigo album!"));
     }
 
-    if(status)
+    if(status && p->uploader)
     {
-      status = _piwigo_api_upload_photo(p, fname, author, caption, description);
+      // the album exists now, the upload itself is left to the upload threads
+      if(p->new_album)
+      {
+        p->new_album = FALSE;
+        _piwigo_refresh_albums(ui, p->album);
+      }
+      upload = calloc(1, sizeof(_piwigo_upload_t));
+      upload->fname = g_strdup(fname);
+      upload->author = author;
+      upload->caption = caption;
+      upload->description = description;
+      upload->tags = p->tags;
+      upload->album_id = p->album_id;
+      upload->num = num;
+      upload->total = total;
+      author = caption = description = NULL;
+      p->tags = NULL;
+    }
+    else if(status)
+    {
+      status = _piwigo_api_upload_photo(p->api, p->album_id, p->privacy, p->tags, fname, author, caption,
+                                        description);
       if(!status)
       {
         fprintf(stderr, "[imageio_storage_piwigo] could not upload to piwigo!\n");
@@ -1062,6 +1206,15 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   }
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
+  if(upload)
+  {
+    // wait for a free slot outside of the lock, the upload threads log success or failure themselves
+    dt_storage_piwigo_params_t *p = (dt_storage_piwigo_params_t *)sdata;
+    g_async_queue_pop(p->uploader->tokens);
+    g_async_queue_push(p->uploader->queue, upload);
+    return 0;
+  }
+
 cleanup:
 
   // And remove from filesystem..
@@ -1217,6 +1370,7 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
 
   if(p)
   {
+    _piwigo_uploader_finish(p);
     g_free(p->album);
     g_free(p->tags);
     _piwigo_ctx_destroy(&p->api);
@@ -246,15 +246,19 @@ public:
         if(filled >= maxFill())
         {
           grow();
+          // the slot found above is meaningless in the grown table
+          return lookupOffset(key, create);
         }
         // need to create an entry. Store the given key.
         keys[filled] = key;
         entries[h].keyIdx = filled;
+        entries[h].hash = key.hash;
         return filled++;
       }
 
-      // check if the cell has a matching key
-      if(keys[e.keyIdx] == key) return e.keyIdx;
+      // check if the cell has a matching key. comparing the cached hashes first
+      // avoids touching the keys array for most of the cells on the probe sequence.
+      if(e.hash == key.hash && keys[e.keyIdx] == key) return e.keyIdx;
 
       // increment the bucket with wraparound
       h = (h + 1) & capacity_bits;
@@ -299,7 +303,7 @@ public:
     for(size_t i = 0; i < oldCapacity; i++)
     {
       if(entries[i].keyIdx == -1) continue;
-      size_t h = keys[entries[i].keyIdx].hash & capacity_bits;
+      size_t h = entries[i].hash & capacity_bits;
       while(newEntries[h].keyIdx != -1)
       {
         h = (h + 1) & capacity_bits;
@@ -315,6 +319,7 @@ private:
   struct Entry
   {
     int keyIdx{ -1 };
+    unsigned hash{ 0 }; // copy of the key's hash, so probing and growing stay within the entries
   };
 
   Key *keys;
@@ -544,6 +549,9 @@ public:
     }
 
     /* Rewrite the offsets in the replay structure from the above generated table. */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
     for(int i = 0; i < nData; i++)
     {
       if(replay[i].table > 0)
@@ -575,46 +583,69 @@ public:
   /* Performs a Gaussian blur along each projected axis in the hyperplane. */
   void blur() const
   {
+    HashTable &table = hashTables[0];
+    const int size = table.size();
+
     // Prepare arrays
-    Value *newValue = new Value[hashTables[0].size()];
-    Value *oldValue = hashTables[0].getValues();
+    Value *newValue = new Value[size];
+    Value *oldValue = table.getValues();
     const Value *hashTableBase = oldValue;
-    const Key *keyBase = hashTables[0].getKeys();
+    const Key *keyBase = table.getKeys();
     const Value zero{ 0 };
 
+    // indices of the two neighbours of each vertex along the current axis. stepping +1 from
+    // vertex i reaches vertex n exactly when stepping -1 from n reaches i, so a single lookup
+    // per vertex and axis finds both neighbour tables.
+    int *next = new int[size];
+    int *prev = new int[size];
+
     // For each of d+1 axes,
     for(int j = 0; j <= D; j++)
     {
 #ifdef _OPENMP
-#pragma omp parallel for shared(j, oldValue, newValue)
+#pragma omp parallel shared(j, oldValue, newValue, next, prev)
 #endif
-      // For each vertex in the lattice,
-      for(int i = 0; i < hashTables[0].size(); i++) // blur point i in dimension j
       {
-        const Key &key = keyBase[i]; // keys to current vertex
-        // construct keys to the neighbors along the given axis.
-        Key neighbor1(key, j, +1);
-        Key neighbor2(key, j, -1);
-
-        const Value *oldVal = oldValue + i;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for(int i = 0; i < size; i++) prev[i] = -1;
 
-        const Value *vm1 = hashTables[0].lookup(neighbor1, false); // look up first neighbor
-        vm1 = vm1 ? vm1 - hashTableBase + oldValue : &zero;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        // For each vertex in the lattice, find its neighbour along the given axis
+        for(int i = 0; i < size; i++)
+        {
+          const Key neighbor(keyBase[i], j, +1);
+          const int n = table.lookupOffset(neighbor, false);
+          next[i] = n;
+          if(n >= 0) prev[n] = i;
+        }
 
-        const Value *vp1 = hashTables[0].lookup(neighbor2, false); // look up second neighbor
-        vp1 = vp1 ? vp1 - hashTableBase + oldValue : &zero;
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+        for(int i = 0; i < size; i++) // blur point i in dimension j
+        {
+          const Value *vm1 = next[i] >= 0 ? oldValue + next[i] : &zero;
+          const Value *vp1 = prev[i] >= 0 ? oldValue + prev[i] : &zero;
 
-        // Mix values of the three vertices
-        newValue[i].mix(vm1, oldVal, vp1);
+          // Mix values of the three vertices
+          newValue[i].mix(vm1, oldValue + i, vp1);
+        }
       }
       std::swap(newValue, oldValue);
       // the freshest data is now in oldValue, and newValue is ready to be written over
     }
 
+    delete[] next;
+    delete[] prev;
+
     // depending where we ended up, we may have to copy data
     if(oldValue != hashTableBase)
     {
-      std::copy(oldValue, oldValue + hashTables[0].size(), hashTables[0].getValues());
+      std::copy(oldValue, oldValue + size, table.getValues());
       delete[] oldValue;
     }
     else
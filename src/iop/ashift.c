@@ -505,12 +505,30 @@ typedef struct dt_iop_ashift_data_t
   float cb;
 } dt_iop_ashift_data_t;
 
+// the result of a line detection, kept to skip detecting again in the same buffer
+typedef struct dt_iop_ashift_detection_t
+{
+  uint64_t hash; // of the buffer contents and geometry, the enhancement and whether the image is raw
+  dt_iop_ashift_line_t *lines;
+  int lines_count;
+  int vertical_count;
+  int horizontal_count;
+  float vertical_weight;
+  float horizontal_weight;
+} dt_iop_ashift_detection_t;
+
+#define ASHIFT_DETECTIONS 8 // number of line detections remembered for the session
+
 typedef struct dt_iop_ashift_global_data_t
 {
   int kernel_ashift_bilinear;
   int kernel_ashift_bicubic;
   int kernel_ashift_lanczos2;
   int kernel_ashift_lanczos3;
+  // detections of recently analysed preview buffers, shared by all instances. re-opening an image or coming
+  // back to it gives the same buffer, so its lines don't need to be detected again.
+  dt_iop_ashift_detection_t detections[ASHIFT_DETECTIONS];
+  int next_detection;
 } dt_iop_ashift_global_data_t;
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
@@ -1607,6 +1625,45 @@ error:
   return FALSE;
 }
 
+// hash the contents of a buffer as 64-bit words (FNV-1a)
+static uint64_t _get_buffer_hash(uint64_t hash, const void *const buf, const size_t size)
+{
+  const uint64_t *const words = (const uint64_t *)buf;
+  const size_t nwords = size / sizeof(uint64_t);
+  for(size_t k = 0; k < nwords; k++) hash = (hash ^ words[k]) * 0x100000001b3ull;
+  const unsigned char *const tail = (const unsigned char *)buf + nwords * sizeof(uint64_t);
+  for(size_t k = 0; k < size % sizeof(uint64_t); k++) hash = (hash ^ tail[k]) * 0x100000001b3ull;
+  return hash;
+}
+
+static const dt_iop_ashift_detection_t *_find_detection(dt_iop_ashift_global_data_t *gd, const uint64_t hash)
+{
+  for(int k = 0; k < ASHIFT_DETECTIONS; k++)
+    if(gd->detections[k].lines && gd->detections[k].hash == hash) return &gd->detections[k];
+  return NULL;
+}
+
+static void _store_detection(dt_iop_ashift_global_data_t *gd, const uint64_t hash, const dt_iop_ashift_line_t *lines,
+                             const int lines_count, const int vertical_count, const int horizontal_count,
+                             const float vertical_weight, const float horizontal_weight)
+{
+  dt_iop_ashift_line_t *copy = malloc(sizeof(dt_iop_ashift_line_t) * lines_count);
+  if(copy == NULL) return;
+  memcpy(copy, lines, sizeof(dt_iop_ashift_line_t) * lines_count);
+
+  // replace the oldest one
+  dt_iop_ashift_detection_t *d = &gd->detections[gd->next_detection];
+  gd->next_detection = (gd->next_detection + 1) % ASHIFT_DETECTIONS;
+  free(d->lines);
+  d->hash = hash;
+  d->lines = copy;
+  d->lines_count = lines_count;
+  d->vertical_count = vertical_count;
+  d->horizontal_count = horizontal_count;
+  d->vertical_weight = vertical_weight;
+  d->horizontal_weight = horizontal_weight;
+}
+
 // get image from buffer, analyze for structure and save results
 static int _get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhance)
 {
@@ -1652,11 +1709,39 @@ static int _get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhan
   float vertical_weight;
   float horizontal_weight;
 
-  // get new structural data
-  if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
-                  &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
-                  enhance, dt_image_is_raw(&module->dev->image_storage)))
-    goto error;
+  // the same buffer analysed the same way gives the same lines
+  dt_iop_ashift_global_data_t *gd = (dt_iop_ashift_global_data_t *)module->global_data;
+  const int is_raw = dt_image_is_raw(&module->dev->image_storage);
+  const int geometry[4] = { width, height, x_off, y_off };
+  uint64_t hash = _get_buffer_hash(0xcbf29ce484222325ull, buffer, sizeof(float) * 4 * (size_t)width * height);
+  hash = _get_buffer_hash(hash, geometry, sizeof(geometry));
+  hash = _get_buffer_hash(hash, &scale, sizeof(scale));
+  hash = _get_buffer_hash(hash, &enhance, sizeof(enhance));
+  hash = _get_buffer_hash(hash, &is_raw, sizeof(is_raw));
+
+  const dt_iop_ashift_detection_t *detection = _find_detection(gd, hash);
+  if(detection)
+  {
+    lines = malloc(sizeof(dt_iop_ashift_line_t) * detection->lines_count);
+    if(lines == NULL) goto error;
+    memcpy(lines, detection->lines, sizeof(dt_iop_ashift_line_t) * detection->lines_count);
+    lines_count = detection->lines_count;
+    vertical_count = detection->vertical_count;
+    horizontal_count = detection->horizontal_count;
+    vertical_weight = detection->vertical_weight;
+    horizontal_weight = detection->horizontal_weight;
+  }
+  else
+  {
+    // get new structural data
+    if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
+                    &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
+                    enhance, is_raw))
+      goto error;
+
+    _store_detection(gd, hash, lines, lines_count, vertical_count, horizontal_count,
+                     vertical_weight, horizontal_weight);
+  }
 
   // save new structural data
   g->lines_in_width = width;
@@ -5527,7 +5612,7 @@ void reload_defaults(dt_iop_module_t *module)
 void init_global(dt_iop_module_so_t *module)
 {
   dt_iop_ashift_global_data_t *gd
-      = (dt_iop_ashift_global_data_t *)malloc(sizeof(dt_iop_ashift_global_data_t));
+      = (dt_iop_ashift_global_data_t *)calloc(1, sizeof(dt_iop_ashift_global_data_t));
   module->data = gd;
 
   const int program = 2; // basic.cl, from programs.conf
@@ -5544,6 +5629,7 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_ashift_bicubic);
   dt_opencl_free_kernel(gd->kernel_ashift_lanczos2);
   dt_opencl_free_kernel(gd->kernel_ashift_lanczos3);
+  for(int k = 0; k < ASHIFT_DETECTIONS; k++) free(gd->detections[k].lines);
   free(module->data);
   module->data = NULL;
 }
@@ -37,11 +37,6 @@
 #include <math.h>
 #include <memory.h>
 #include <stdlib.h>
-#if defined(__SSE__)
-#include <xmmintrin.h>
-#endif
-
-//#define USE_NEW_CL  //uncomment to use the new, more memory-efficient OpenCL code (not yet finished)
 
 #define INSET DT_PIXEL_APPLY_DPI(5)
 #define INFL .3f
@@ -109,10 +104,7 @@ typedef struct dt_iop_atrous_gui_data_t
 
 typedef struct dt_iop_atrous_global_data_t
 {
-  int kernel_zero;
-  int kernel_decompose;
-  int kernel_synthesize;
-  int kernel_addbuffers;
+  int kernel_decompose_synthesize;
 } dt_iop_atrous_global_data_t;
 
 typedef struct dt_iop_atrous_data_t
@@ -254,8 +246,7 @@ static int get_scales(float (*thrs)[4], float (*boost)[4], float *sharp, const d
 /* just process the supplied image buffer, upstream default_process_tiling() does the rest */
 static void process_wavelets(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                              const void *const i, void *const o, const dt_iop_roi_t *const roi_in,
-                             const dt_iop_roi_t *const roi_out, const eaw_decompose_t decompose,
-                             const eaw_synthesize_t synthesize)
+                             const dt_iop_roi_t *const roi_out)
 {
   dt_iop_atrous_data_t *d = (dt_iop_atrous_data_t *)piece->data;
   dt_aligned_pixel_t thrs[MAX_NUM_SCALES];
@@ -284,11 +275,10 @@ static void process_wavelets(struct dt_iop_module_t *self, struct dt_dev_pixelpi
   }
 
   float *const restrict out = (float*)o;
-  float *restrict detail = NULL;
   float *restrict tmp = NULL;
   float *restrict tmp2 = NULL;
 
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &tmp, 4, &tmp2, 4, &detail, 0))
+  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &tmp, 4, &tmp2, 0))
   {
     dt_iop_copy_image_roi(out, i, piece->colors, roi_in, roi_out, TRUE);
     return;
@@ -301,11 +291,10 @@ static void process_wavelets(struct dt_iop_module_t *self, struct dt_dev_pixelpi
   memset(out, 0, sizeof(float) * 4 * width * height);
 
   // now do the wavelet decomposition, immediately synthesizing the detail scale into the final output so
-  // that we don't need to store it past the current scale's iteration
+  // that we don't need to store it at all
   for(int scale = 0; scale < max_scale; scale++)
   {
-    decompose(buf2, buf1, detail, scale, sharp[scale], width, height);
-    synthesize(out, out, detail, thrs[scale], boost[scale], width, height);
+    eaw_decompose_and_synthesize(buf2, buf1, out, thrs[scale], boost[scale], scale, sharp[scale], width, height);
     if(scale == 0) buf1 = (float *)tmp2; // now switch to second scratch for buffer ping-pong between buf1 and buf2
     float *buf3 = buf2;
     buf2 = buf1;
@@ -322,30 +311,21 @@ static void process_wavelets(struct dt_iop_module_t *self, struct dt_dev_pixelpi
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
     dt_iop_alpha_copy(i, o, width, height);
 
-  dt_free_align(detail);
-  dt_free_align(tmp);
-  dt_free_align(tmp2);
+  dt_iop_image_free(tmp);
+  dt_iop_image_free(tmp2);
   return;
 }
 
 void process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
              void *const o, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  process_wavelets(self, piece, i, o, roi_in, roi_out, eaw_decompose, eaw_synthesize);
+  process_wavelets(self, piece, i, o, roi_in, roi_out);
 }
 
-#if defined(__SSE2__)
-void process_sse2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
-                  void *const o, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
-{
-  process_wavelets(self, piece, i, o, roi_in, roi_out, eaw_decompose_sse2, eaw_synthesize_sse2);
-}
-#endif
-
 #ifdef HAVE_OPENCL
 
-#ifdef USE_NEW_CL
-/* this version is adapted to the new global tiling mechanism. it no longer does tiling by itself. */
+/* this version is adapted to the new global tiling mechanism. it no longer does tiling by itself. each scale
+   is synthesized right away, so no detail scale needs to be kept around. */
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -371,144 +351,21 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   cl_mem dev_filter = NULL;
   cl_mem dev_tmp = NULL;
   cl_mem dev_tmp2 = NULL;
-  cl_mem dev_detail = NULL;
-
-  float m[] = { 0.0625f, 0.25f, 0.375f, 0.25f, 0.0625f }; // 1/16, 4/16, 6/16, 4/16, 1/16
-  float mm[5][5];
-  for(int j = 0; j < 5; j++)
-    for(int i = 0; i < 5; i++) mm[j][i] = m[i] * m[j];
-
-  dev_filter = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * 25, mm);
-  if(dev_filter == NULL) goto error;
-
-  /* allocate space for two temporary buffer to participate_in in the buffer ping-pong below.  We need dev_out
-     to accumulate the result and dev_in needs to stay unchanged for blendops */
-  dev_tmp = dt_opencl_alloc_device(devid, roi_out->width, roi_out->height, sizeof(float) * 4);
-  if(dev_tmp == NULL) goto error;
-  dev_tmp2 = dt_opencl_alloc_device(devid, roi_out->width, roi_out->height, sizeof(float) * 4);
-  if(dev_tmp2 == NULL) goto error;
-
-  /* allocate a buffer for storing the detail information. */
-  dev_detail = dt_opencl_alloc_device(devid, roi_out->width, roi_out->height, sizeof(float) * 4);
-  if(dev_detail == NULL) goto error;
+  cl_mem dev_accum = NULL;
 
   const int width = roi_out->width;
   const int height = roi_out->height;
   size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
 
-  // clear dev_out to zeros, as we will be incrementally accumulating results there
-  dt_opencl_set_kernel_arg(devid, gd->kernel_zero, 0, sizeof(cl_mem), (void *)&dev_out);
-  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_zero, sizes);
-  if(err != CL_SUCCESS) goto error;
-
-  // the buffers for the buffer ping-pong.  We start with dev_in as the input half for the first
-  // scale, then switch to using dev_tmp and dev_tmp2 as the two scratch buffers
-  void* dev_buf1 = &dev_in;
-  void* dev_buf2 = &dev_tmp;
-
-  /* decompose image into detail scales and coarse (the latter is left in dev_tmp or dev_out) */
-  for(int s = 0; s < max_scale; s++)
+  if(max_scale < 1)
   {
-    const int scale = s;
-
-    // run the decomposition
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 0, sizeof(cl_mem), (void *)&dev_buf2); //this scale's output
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 1, sizeof(cl_mem), (void *)&dev_buf1); //this scale's input
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 2, sizeof(cl_mem), (void *)&dev_detail);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 3, sizeof(int), (void *)&width);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 4, sizeof(int), (void *)&height);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 5, sizeof(unsigned int), (void *)&scale);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 6, sizeof(float), (void *)&sharp[s]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 7, sizeof(cl_mem), (void *)&dev_filter);
-
-    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_decompose, sizes);
-    if(err != CL_SUCCESS) goto error;
-
-    // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(darktable.opencl->micro_nap);
-
-    // now immediately run the synthesis for the current scale, accumulating the details into dev_out
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 0, sizeof(cl_mem), (void *)&dev_out);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 1, sizeof(cl_mem), (void *)&dev_out);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 2, sizeof(cl_mem), (void *)&dev_detail);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 3, sizeof(int), (void *)&width);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 4, sizeof(int), (void *)&height);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 5, sizeof(float), (void *)&thrs[scale][0]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 6, sizeof(float), (void *)&thrs[scale][1]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 7, sizeof(float), (void *)&thrs[scale][2]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 8, sizeof(float), (void *)&thrs[scale][3]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 9, sizeof(float), (void *)&boost[scale][0]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 10, sizeof(float), (void *)&boost[scale][1]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 11, sizeof(float), (void *)&boost[scale][2]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 12, sizeof(float), (void *)&boost[scale][3]);
-
-    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_synthesize, sizes);
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
     if(err != CL_SUCCESS) goto error;
-
-    // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(darktable.opencl->micro_nap);
-
-    // swap scratch buffers
-    if (scale == 0) dev_buf1 = dev_tmp2;
-    void* tmp = dev_buf2;
-    dev_buf2 = dev_buf1;
-    dev_buf1 = tmp;
-  }
-
-  // add the residue (the coarse scale from the final decomposition) to the accumulated details
-  dt_opencl_set_kernel_arg(devid, gd->kernel_addbuffers, 0, sizeof(cl_mem), (void*)&dev_out);
-  dt_opencl_set_kernel_arg(devid, gd->kernel_addbuffers, 1, sizeof(cl_mem), (void*)&dev_buf1);
-
-  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_addbuffers, sizes);
-  if(err != CL_SUCCESS) goto error;
-
-  if(!darktable.opencl->async_pixelpipe || (piece->pipe->type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT)
-    dt_opencl_finish(devid);
-
-  dt_opencl_release_mem_object(dev_filter);
-  dt_opencl_release_mem_object(dev_tmp);
-  dt_opencl_release_mem_object(dev_tmp2);
-  dt_opencl_release_mem_object(dev_detail);
-  return TRUE;
-
-error:
-  dt_opencl_release_mem_object(dev_filter);
-  dt_opencl_release_mem_object(dev_tmp);
-  dt_opencl_release_mem_object(dev_tmp2);
-  dt_opencl_release_mem_object(dev_detail);
-  dt_print(DT_DEBUG_OPENCL, "[opencl_atrous] couldn't enqueue kernel! %d\n", err);
-  return FALSE;
-}
-
-#else // ======== old, memory-hungry implementation ========================================================
-
-/* this version is adapted to the new global tiling mechanism. it no longer does tiling by itself. */
-int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
-               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
-{
-  dt_iop_atrous_data_t *d = (dt_iop_atrous_data_t *)piece->data;
-  dt_aligned_pixel_t thrs[MAX_NUM_SCALES];
-  dt_aligned_pixel_t boost[MAX_NUM_SCALES];
-  float sharp[MAX_NUM_SCALES];
-  const int max_scale = get_scales(thrs, boost, sharp, d, roi_in, piece);
-
-  if(self->dev->gui_attached && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
-  {
-    dt_iop_atrous_gui_data_t *g = (dt_iop_atrous_gui_data_t *)self->gui_data;
-    g->num_samples = get_samples(g->sample, d, roi_in, piece);
-    // dt_control_queue_redraw_widget(GTK_WIDGET(g->area));
-    // tries to acquire gdk lock and this prone to deadlock:
-    // dt_control_queue_draw(GTK_WIDGET(g->area));
+    return TRUE;
   }
 
-  dt_iop_atrous_global_data_t *gd = (dt_iop_atrous_global_data_t *)self->global_data;
-
-  const int devid = piece->pipe->devid;
-  cl_int err = -999;
-  cl_mem dev_filter = NULL;
-  cl_mem dev_tmp = NULL;
-  cl_mem *dev_detail = calloc(max_scale, sizeof(cl_mem));
-
   float m[] = { 0.0625f, 0.25f, 0.375f, 0.25f, 0.0625f }; // 1/16, 4/16, 6/16, 4/16, 1/16
   float mm[5][5];
   for(int j = 0; j < 5; j++)
@@ -518,89 +375,59 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dev_filter = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * 25, mm);
   if(dev_filter == NULL) goto error;
 
-  /* allocate space for a temporary buffer. we don't want to use dev_in in the buffer ping-pong below, as we
+  /* two temporary buffers for the ping-pong of the coarse scales. we don't want to use dev_in for it, as we
      need to keep it for blendops */
-  dev_tmp = dt_opencl_alloc_device(devid, roi_out->width, roi_out->height, sizeof(float) * 4);
+  dev_tmp = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
   if(dev_tmp == NULL) goto error;
+  dev_tmp2 = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
+  if(dev_tmp2 == NULL) goto error;
 
-  /* allocate space to store detail information. Requires a number of additional buffers, each with full image
-   * size */
-  for(int k = 0; k < max_scale; k++)
+  /* the accumulated details ping-pong between dev_out and this one, images can't be read and written by
+     the same kernel */
+  if(max_scale > 1)
   {
-    dev_detail[k] = dt_opencl_alloc_device(devid, roi_out->width, roi_out->height, sizeof(float) * 4);
-    if(dev_detail[k] == NULL) goto error;
+    dev_accum = dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
+    if(dev_accum == NULL) goto error;
   }
 
-  const int width = roi_out->width;
-  const int height = roi_out->height;
-  size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
-  size_t origin[] = { 0, 0, 0 };
-  size_t region[] = { width, height, 1 };
-
-  // copy original input from dev_in -> dev_out as starting point
-  err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
-  if(err != CL_SUCCESS) goto error;
-
-  /* decompose image into detail scales and coarse (the latter is left in dev_tmp or dev_out) */
+  cl_mem dev_coarse_in = dev_in;
   for(int s = 0; s < max_scale; s++)
   {
     const int scale = s;
-
-    if(s & 1)
-    {
-      dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 0, sizeof(cl_mem), (void *)&dev_tmp);
-      dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 1, sizeof(cl_mem), (void *)&dev_out);
-    }
-    else
-    {
-      dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 0, sizeof(cl_mem), (void *)&dev_out);
-      dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 1, sizeof(cl_mem), (void *)&dev_tmp);
-    }
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 2, sizeof(cl_mem), (void *)&dev_detail[s]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 3, sizeof(int), (void *)&width);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 4, sizeof(int), (void *)&height);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 5, sizeof(unsigned int), (void *)&scale);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 6, sizeof(float), (void *)&sharp[s]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose, 7, sizeof(cl_mem), (void *)&dev_filter);
-
-    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_decompose, sizes);
+    const int first = (s == 0);
+    const int last = (s == max_scale - 1);
+    cl_mem dev_coarse_out = (s & 1) ? dev_tmp2 : dev_tmp;
+    // arranged for the last scale to write the final image to dev_out
+    cl_mem dev_accum_out = ((max_scale - 1 - s) & 1) ? dev_accum : dev_out;
+    cl_mem dev_accum_in = first ? dev_in : (dev_accum_out == dev_out ? dev_accum : dev_out);
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 0, sizeof(cl_mem), (void *)&dev_coarse_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 1, sizeof(cl_mem), (void *)&dev_coarse_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 2, sizeof(cl_mem), (void *)&dev_accum_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 3, sizeof(cl_mem), (void *)&dev_accum_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 4, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 5, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 6, sizeof(unsigned int), (void *)&scale);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 7, sizeof(float), (void *)&sharp[s]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 8, sizeof(cl_mem), (void *)&dev_filter);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 9, sizeof(float), (void *)&thrs[scale][0]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 10, sizeof(float), (void *)&thrs[scale][1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 11, sizeof(float), (void *)&thrs[scale][2]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 12, sizeof(float), (void *)&thrs[scale][3]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 13, sizeof(float), (void *)&boost[scale][0]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 14, sizeof(float), (void *)&boost[scale][1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 15, sizeof(float), (void *)&boost[scale][2]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 16, sizeof(float), (void *)&boost[scale][3]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 17, sizeof(int), (void *)&first);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_decompose_synthesize, 18, sizeof(int), (void *)&last);
+
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_decompose_synthesize, sizes);
     if(err != CL_SUCCESS) goto error;
 
     // indirectly give gpu some air to breathe (and to do display related stuff)
     dt_iop_nap(darktable.opencl->micro_nap);
-  }
-
-  /* now synthesize again */
-  for(int scale = max_scale - 1; scale >= 0; scale--)
-  {
-    if(scale & 1)
-    {
-      dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 0, sizeof(cl_mem), (void *)&dev_tmp);
-      dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 1, sizeof(cl_mem), (void *)&dev_out);
-    }
-    else
-    {
-      dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 0, sizeof(cl_mem), (void *)&dev_out);
-      dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 1, sizeof(cl_mem), (void *)&dev_tmp);
-    }
-
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 2, sizeof(cl_mem), (void *)&dev_detail[scale]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 3, sizeof(int), (void *)&width);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 4, sizeof(int), (void *)&height);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 5, sizeof(float), (void *)&thrs[scale][0]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 6, sizeof(float), (void *)&thrs[scale][1]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 7, sizeof(float), (void *)&thrs[scale][2]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 8, sizeof(float), (void *)&thrs[scale][3]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 9, sizeof(float), (void *)&boost[scale][0]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 10, sizeof(float), (void *)&boost[scale][1]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 11, sizeof(float), (void *)&boost[scale][2]);
-    dt_opencl_set_kernel_arg(devid, gd->kernel_synthesize, 12, sizeof(float), (void *)&boost[scale][3]);
-
-    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_synthesize, sizes);
-    if(err != CL_SUCCESS) goto error;
 
-    // indirectly give gpu some air to breathe (and to do display related stuff)
-    dt_iop_nap(darktable.opencl->micro_nap);
+    dev_coarse_in = dev_coarse_out;
   }
 
   if(!darktable.opencl->async_pixelpipe || (piece->pipe->type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT)
@@ -608,21 +435,18 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   dt_opencl_release_mem_object(dev_filter);
   dt_opencl_release_mem_object(dev_tmp);
-  for(int k = 0; k < max_scale; k++)
-    dt_opencl_release_mem_object(dev_detail[k]);
-  free(dev_detail);
+  dt_opencl_release_mem_object(dev_tmp2);
+  dt_opencl_release_mem_object(dev_accum);
   return TRUE;
 
 error:
   dt_opencl_release_mem_object(dev_filter);
   dt_opencl_release_mem_object(dev_tmp);
-  for(int k = 0; k < max_scale; k++)
-    dt_opencl_release_mem_object(dev_detail[k]);
-  free(dev_detail);
+  dt_opencl_release_mem_object(dev_tmp2);
+  dt_opencl_release_mem_object(dev_accum);
   dt_print(DT_DEBUG_OPENCL, "[opencl_atrous] couldn't enqueue kernel! %d\n", err);
   return FALSE;
 }
-#endif // USE_NEW_CL
 
 #endif // HAVE_OPENCL
 
@@ -637,8 +461,8 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   const int max_scale = get_scales(thrs, boost, sharp, d, roi_in, piece);
   const int max_filter_radius = 2 * (1 << max_scale); // 2 * 2^max_scale
 
-  tiling->factor = 5.0f;                // in + out + 2*tmp + details
-  tiling->factor_cl = 3.0f + max_scale; // in + out + tmp + scale buffers
+  tiling->factor = 4.0f;    // in + out + 2*tmp
+  tiling->factor_cl = 5.0f; // in + out + 2*tmp + accumulated details
   tiling->maxbuf = 1.0f;
   tiling->maxbuf_cl = 1.0f;
   tiling->overhead = 0;
@@ -668,23 +492,13 @@ void init_global(dt_iop_module_so_t *module)
   dt_iop_atrous_global_data_t *gd
       = (dt_iop_atrous_global_data_t *)malloc(sizeof(dt_iop_atrous_global_data_t));
   module->data = gd;
-  gd->kernel_decompose = dt_opencl_create_kernel(program, "eaw_decompose");
-  gd->kernel_synthesize = dt_opencl_create_kernel(program, "eaw_synthesize");
-#ifdef USE_NEW_CL
-  gd->kernel_zero = dt_opencl_create_kernel(program, "eaw_zero");
-  gd->kernel_addbuffers = dt_opencl_create_kernel(program, "eaw_addbuffers");
-#endif
+  gd->kernel_decompose_synthesize = dt_opencl_create_kernel(program, "eaw_decompose_synthesize");
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
 {
   dt_iop_atrous_global_data_t *gd = (dt_iop_atrous_global_data_t *)module->data;
-  dt_opencl_free_kernel(gd->kernel_decompose);
-  dt_opencl_free_kernel(gd->kernel_synthesize);
-#ifdef USE_NEW_CL
-  dt_opencl_free_kernel(gd->kernel_zero);
-  dt_opencl_free_kernel(gd->kernel_addbuffers);
-#endif
+  dt_opencl_free_kernel(gd->kernel_decompose_synthesize);
   free(module->data);
   module->data = NULL;
 }
@@ -163,7 +163,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     out[4*k+2] = in[4*k+2];
     out[4*k+3] = in[4*k+3];
   }
-  dt_free_align(blurlightness);
+  dt_iop_image_free(blurlightness);
 
 //  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
 //    dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
@@ -871,7 +871,8 @@ static inline void loop_switch(const float *const restrict in, float *const rest
 }
 
 // util to shift pixel index without headache
-#define SHF(ii, jj, c) ((i + ii) * width + j + jj) * ch + c
+// the detection only samples every OFF-th pixel of the image, so the chromaticities are kept on that grid only
+#define SHF(ii, jj, c) ((((i + ii) / OFF) * grid_width + (j + jj) / OFF) * ch + c)
 #define OFF 4
 
 static inline void auto_detect_WB(const float *const restrict in, dt_illuminant_t illuminant,
@@ -891,24 +892,27 @@ static inline void auto_detect_WB(const float *const restrict in, dt_illuminant_
    *
   */
 
-   float *const restrict temp = dt_alloc_sse_ps(width * height * ch);
+   const size_t grid_width = (width + OFF - 1) / OFF;
+   const size_t grid_height = (height + OFF - 1) / OFF;
+   float *const restrict temp = dt_alloc_sse_ps(grid_width * grid_height * ch);
 
    // Convert RGB to xy
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(width, height, ch, in, temp, RGB_to_XYZ) \
+  dt_omp_firstprivate(width, grid_width, grid_height, ch, in, temp, RGB_to_XYZ) \
   collapse(2) schedule(simd:static)
 #endif
-  for(size_t i = 0; i < height; i++)
-    for(size_t j = 0; j < width; j++)
+  for(size_t i = 0; i < grid_height; i++)
+    for(size_t j = 0; j < grid_width; j++)
     {
-      const size_t index = (i * width + j) * ch;
+      const size_t pixel = ((i * OFF) * width + j * OFF) * ch;
+      const size_t index = (i * grid_width + j) * ch;
       dt_aligned_pixel_t RGB;
       dt_aligned_pixel_t XYZ;
 
       // Clip negatives
       for_each_channel(c,aligned(in))
-        RGB[c] = fmaxf(in[index + c], 0.0f);
+        RGB[c] = fmaxf(in[pixel + c], 0.0f);
 
       // Convert to XYZ
       dot_product(RGB, RGB_to_XYZ, XYZ);
@@ -935,7 +939,7 @@ static inline void auto_detect_WB(const float *const restrict in, dt_illuminant_
   {
 #ifdef _OPENMP
 #pragma omp parallel for default(none) reduction(+:xyY, elements) \
-  dt_omp_firstprivate(width, height, temp, ch) \
+  dt_omp_firstprivate(width, height, grid_width, temp, ch) \
   schedule(simd:static)
 #endif
     for(size_t i = 2 * OFF; i < height - 4 * OFF; i += OFF)
@@ -1003,7 +1007,7 @@ static inline void auto_detect_WB(const float *const restrict in, dt_illuminant_
   {
     #ifdef _OPENMP
 #pragma omp parallel for default(none) reduction(+:xyY, elements) \
-  dt_omp_firstprivate(width, height, temp, ch) \
+  dt_omp_firstprivate(width, height, grid_width, temp, ch) \
   schedule(simd:static)
 #endif
     for(size_t i = 2 * OFF; i < height - 4 * OFF; i += OFF)
@@ -1308,7 +1312,13 @@ static const extraction_result_t _extract_patches(const float *const restrict in
   if(g->delta_E_in == NULL)
     g->delta_E_in = dt_alloc_sse_ps(g->checker->patches);
 
-  /* Get the average color over each patch */
+  /* Get the average color over each patch, they are independent */
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, width, height, radius_x, radius_y, patches, RGB_to_XYZ) \
+  shared(g) \
+  schedule(dynamic)
+#endif
   for(size_t k = 0; k < g->checker->patches; k++)
   {
     // center of the patch in the ideal reference
@@ -59,11 +59,28 @@ typedef struct dt_iop_colorout_data_t
   dt_colormatrix_t cmatrix;
   cmsHTRANSFORM *xform;
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
+  float *clut;                  // xform baked on a Lab grid of clut_level^3 points, or NULL
+  int clut_level;
 } dt_iop_colorout_data_t;
 
+// a baked transform, keyed by a hash of the profiles, intent, flags and grid size
+typedef struct dt_iop_colorout_clut_t
+{
+  uint64_t hash;
+  int level;
+  float *clut;
+} dt_iop_colorout_clut_t;
+
+#define COLOROUT_CLUTS 4 // number of baked transforms kept for the session
+
 typedef struct dt_iop_colorout_global_data_t
 {
   int kernel_colorout;
+  int kernel_colorout_clut;
+  // baking takes a while, and all pipes going to the same profile agree on the result
+  dt_pthread_mutex_t clut_lock;
+  dt_iop_colorout_clut_t cluts[COLOROUT_CLUTS];
+  int next_clut;
 } dt_iop_colorout_global_data_t;
 
 typedef struct dt_iop_colorout_params_t
@@ -213,15 +230,20 @@ void init_global(dt_iop_module_so_t *module)
 {
   const int program = 2; // basic.cl, from programs.conf
   dt_iop_colorout_global_data_t *gd
-      = (dt_iop_colorout_global_data_t *)malloc(sizeof(dt_iop_colorout_global_data_t));
+      = (dt_iop_colorout_global_data_t *)calloc(1, sizeof(dt_iop_colorout_global_data_t));
   module->data = gd;
   gd->kernel_colorout = dt_opencl_create_kernel(program, "colorout");
+  gd->kernel_colorout_clut = dt_opencl_create_kernel(program, "colorout_clut");
+  dt_pthread_mutex_init(&gd->clut_lock, NULL);
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
 {
   dt_iop_colorout_global_data_t *gd = (dt_iop_colorout_global_data_t *)module->data;
   dt_opencl_free_kernel(gd->kernel_colorout);
+  dt_opencl_free_kernel(gd->kernel_colorout_clut);
+  dt_pthread_mutex_destroy(&gd->clut_lock);
+  for(int k = 0; k < COLOROUT_CLUTS; k++) dt_free_align(gd->cluts[k].clut);
   free(module->data);
   module->data = NULL;
 }
@@ -303,6 +325,24 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
 
+  if(d->clut)
+  {
+    // the lcms2 transform baked into a grid
+    cl_mem dev_clut = dt_opencl_copy_host_to_device_constant
+      (devid, sizeof(float) * 3 * d->clut_level * d->clut_level * d->clut_level, d->clut);
+    if(dev_clut == NULL) goto error;
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorout_clut, 0, sizeof(cl_mem), (void *)&dev_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorout_clut, 1, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorout_clut, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorout_clut, 3, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorout_clut, 4, sizeof(cl_mem), (void *)&dev_clut);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_colorout_clut, 5, sizeof(int), (void *)&d->clut_level);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_colorout_clut, sizes);
+    dt_opencl_release_mem_object(dev_clut);
+    if(err != CL_SUCCESS) goto error;
+    return TRUE;
+  }
+
   float cmatrix[9];
   pack_3xSSE_to_3x3(d->cmatrix, cmatrix);
   dev_m = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * 9, cmatrix);
@@ -346,6 +386,83 @@ error:
 }
 #endif
 
+// the Lab range covered by a baked transform, which is the ICC Lab PCS range
+#define CLUT_L_MAX 100.0f
+#define CLUT_AB_MIN -128.0f
+#define CLUT_AB_RANGE 256.0f
+
+// apply the transform baked on a level^3 Lab grid, interpolating within a tetrahedron of the
+// enclosing cube like correct_pixel_tetrahedral() of the lut3d module
+__DT_CLONE_TARGETS__
+static void _apply_clut(const float *const in, float *const out, const size_t npixels,
+                        const float *const restrict clut, const int level)
+{
+  const int level2 = level * level;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clut, in, level, level2, out, npixels) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+  {
+    // position in the grid, Lab outside of it is clipped to its faces
+    const float pos[3] = { CLAMP(in[k] / CLUT_L_MAX, 0.0f, 1.0f) * (level - 1),
+                           CLAMP((in[k + 1] - CLUT_AB_MIN) / CLUT_AB_RANGE, 0.0f, 1.0f) * (level - 1),
+                           CLAMP((in[k + 2] - CLUT_AB_MIN) / CLUT_AB_RANGE, 0.0f, 1.0f) * (level - 1) };
+    const int x = MIN((int)pos[0], level - 2);
+    const int y = MIN((int)pos[1], level - 2);
+    const int z = MIN((int)pos[2], level - 2);
+    const float dx = pos[0] - x;
+    const float dy = pos[1] - y;
+    const float dz = pos[2] - z;
+
+    const int i000 = (x + y * level + z * level2) * 3;
+    const int i111 = i000 + (1 + level + level2) * 3;
+    int i1, i2;
+    float w0, w1, w2, w3;
+    if(dx > dy)
+    {
+      if(dy > dz)
+      {
+        i1 = i000 + 3; i2 = i000 + (1 + level) * 3;
+        w0 = 1.0f - dx; w1 = dx - dy; w2 = dy - dz; w3 = dz;
+      }
+      else if(dx > dz)
+      {
+        i1 = i000 + 3; i2 = i000 + (1 + level2) * 3;
+        w0 = 1.0f - dx; w1 = dx - dz; w2 = dz - dy; w3 = dy;
+      }
+      else
+      {
+        i1 = i000 + level2 * 3; i2 = i000 + (1 + level2) * 3;
+        w0 = 1.0f - dz; w1 = dz - dx; w2 = dx - dy; w3 = dy;
+      }
+    }
+    else
+    {
+      if(dz > dy)
+      {
+        i1 = i000 + level2 * 3; i2 = i000 + (level + level2) * 3;
+        w0 = 1.0f - dz; w1 = dz - dy; w2 = dy - dx; w3 = dx;
+      }
+      else if(dz > dx)
+      {
+        i1 = i000 + level * 3; i2 = i000 + (level + level2) * 3;
+        w0 = 1.0f - dy; w1 = dy - dz; w2 = dz - dx; w3 = dx;
+      }
+      else
+      {
+        i1 = i000 + level * 3; i2 = i000 + (1 + level) * 3;
+        w0 = 1.0f - dy; w1 = dy - dx; w2 = dx - dz; w3 = dz;
+      }
+    }
+
+    for(int c = 0; c < 3; c++)
+      out[k + c] = w0 * clut[i000 + c] + w1 * clut[i1 + c] + w2 * clut[i2 + c] + w3 * clut[i111 + c];
+    out[k + 3] = in[k + 3];
+  }
+}
+
 static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
                                               const void *const ivoid, void *const ovoid,
                                               const dt_iop_roi_t *const roi_in,
@@ -438,6 +555,10 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
     process_fastpath_apply_tonecurves(self, piece, in, out, roi_in, roi_out);
   }
+  else if(d->clut)
+  {
+    _apply_clut((const float *)ivoid, out, npixels, d->clut, d->clut_level);
+  }
   else
   {
 // fprintf(stderr,"Using xform codepath\n");
@@ -511,6 +632,10 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 
     process_fastpath_apply_tonecurves(self, piece, ivoid, ovoid, roi_in, roi_out);
   }
+  else if(d->clut)
+  {
+    _apply_clut((const float *)ivoid, out, npixels, d->clut, d->clut_level);
+  }
   else
   {
     // fprintf(stderr,"Using xform codepath\n");
@@ -569,6 +694,99 @@ static cmsHPROFILE _make_clipping_profile(cmsHPROFILE profile)
   return profile;
 }
 
+// hash a buffer as 64-bit words (FNV-1a)
+static uint64_t _hash_bytes(uint64_t hash, const void *const buf, const size_t size)
+{
+  const uint64_t *const words = (const uint64_t *)buf;
+  const size_t nwords = size / sizeof(uint64_t);
+  for(size_t k = 0; k < nwords; k++) hash = (hash ^ words[k]) * 0x100000001b3ull;
+  const unsigned char *const tail = (const unsigned char *)buf + nwords * sizeof(uint64_t);
+  for(size_t k = 0; k < size % sizeof(uint64_t); k++) hash = (hash ^ tail[k]) * 0x100000001b3ull;
+  return hash;
+}
+
+// hash the serialized profile, display profiles change contents without changing name
+static uint64_t _hash_profile(uint64_t hash, cmsHPROFILE profile)
+{
+  cmsUInt32Number size = 0;
+  if(!profile || !cmsSaveProfileToMem(profile, NULL, &size) || size == 0) return hash;
+  void *buf = malloc(size);
+  if(buf && cmsSaveProfileToMem(profile, buf, &size)) hash = _hash_bytes(hash, buf, size);
+  free(buf);
+  return hash;
+}
+
+// run the grid through the transform, one b plane at a time
+static void _bake_clut(cmsHTRANSFORM xform, float *const clut, const int level)
+{
+  const int level2 = level * level;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clut, level, level2, xform) \
+  schedule(static)
+#endif
+  for(int z = 0; z < level; z++)
+  {
+    float *const Lab = dt_alloc_align_float((size_t)4 * level2);
+    float *const rgb = dt_alloc_align_float((size_t)4 * level2);
+    if(Lab && rgb)
+    {
+      for(int y = 0; y < level; y++)
+        for(int x = 0; x < level; x++)
+        {
+          float *const px = Lab + (size_t)4 * (x + y * level);
+          px[0] = CLUT_L_MAX * x / (level - 1);
+          px[1] = CLUT_AB_MIN + CLUT_AB_RANGE * y / (level - 1);
+          px[2] = CLUT_AB_MIN + CLUT_AB_RANGE * z / (level - 1);
+          px[3] = 0.0f;
+        }
+      cmsDoTransform(xform, Lab, rgb, level2);
+      for(int k = 0; k < level2; k++)
+        for(int c = 0; c < 3; c++) clut[((size_t)z * level2 + k) * 3 + c] = rgb[4 * k + c];
+    }
+    dt_free_align(Lab);
+    dt_free_align(rgb);
+  }
+}
+
+// give the pipe the baked transform, from the ones of the session or by baking it now
+static void _get_clut(dt_iop_colorout_global_data_t *gd, dt_iop_colorout_data_t *d, const uint64_t hash,
+                      const int level)
+{
+  const size_t size = sizeof(float) * 3 * level * level * level;
+  d->clut = dt_alloc_align(64, size);
+  if(!d->clut) return;
+  d->clut_level = level;
+
+  dt_pthread_mutex_lock(&gd->clut_lock);
+  for(int k = 0; k < COLOROUT_CLUTS; k++)
+  {
+    if(gd->cluts[k].clut && gd->cluts[k].hash == hash && gd->cluts[k].level == level)
+    {
+      memcpy(d->clut, gd->cluts[k].clut, size);
+      dt_pthread_mutex_unlock(&gd->clut_lock);
+      return;
+    }
+  }
+  dt_pthread_mutex_unlock(&gd->clut_lock);
+
+  _bake_clut(d->xform, d->clut, level);
+
+  float *copy = dt_alloc_align(64, size);
+  if(!copy) return;
+  memcpy(copy, d->clut, size);
+
+  // replace the oldest one
+  dt_pthread_mutex_lock(&gd->clut_lock);
+  dt_iop_colorout_clut_t *c = &gd->cluts[gd->next_clut];
+  gd->next_clut = (gd->next_clut + 1) % COLOROUT_CLUTS;
+  dt_free_align(c->clut);
+  c->hash = hash;
+  c->level = level;
+  c->clut = copy;
+  dt_pthread_mutex_unlock(&gd->clut_lock);
+}
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -596,6 +814,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_free_align(d->clut);
+  d->clut = NULL;
   d->cmatrix[0][0] = NAN;
   d->lut[0][0] = -1.0f;
   d->lut[1][0] = -1.0f;
@@ -750,9 +970,28 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     }
   }
 
+  // the gamut check marks pixels with a color of its own, which can't be interpolated
+  const int clut_level = dt_conf_get_int("plugins/lighttable/export/lcms2_clut_size");
+  const gboolean bake = d->xform && clut_level >= 2 && d->mode != DT_PROFILE_GAMUTCHECK;
+  uint64_t clut_hash = 0xcbf29ce484222325ull;
+  if(bake)
+  {
+    clut_hash = _hash_profile(clut_hash, output);
+    clut_hash = _hash_profile(clut_hash, softproof);
+    clut_hash = _hash_bytes(clut_hash, &out_intent, sizeof(out_intent));
+    clut_hash = _hash_bytes(clut_hash, &transformFlags, sizeof(transformFlags));
+    clut_hash = _hash_bytes(clut_hash, &output_format, sizeof(output_format));
+  }
+
   if(out_type == DT_COLORSPACE_DISPLAY || out_type == DT_COLORSPACE_DISPLAY2)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
+  if(bake)
+  {
+    _get_clut((dt_iop_colorout_global_data_t *)self->global_data, d, clut_hash, clut_level);
+    if(d->clut) piece->process_cl_ready = 1;
+  }
+
   // now try to initialize unbounded mode:
   // we do extrapolation for input values above 1.0f.
   // unfortunately we can only do this if we got the computation
@@ -794,6 +1033,7 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  dt_free_align(d->clut);
 
   free(piece->data);
   piece->data = NULL;
@@ -603,6 +603,7 @@ static inline const short * hexmap(const int row, const int col, short (*const a
 /*
    Frank Markesteijn's algorithm for Fuji X-Trans sensors
  */
+__DT_CLONE_TARGETS__
 static void xtrans_markesteijn_interpolate(float *out, const float *const in,
                                            const dt_iop_roi_t *const roi_out,
                                            const dt_iop_roi_t *const roi_in,
@@ -660,15 +661,18 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
 
   // extra passes propagates out errors at edges, hence need more padding
   const int pad_tile = (passes == 1) ? 12 : 17;
+  // distribute the tiles of both axes over the threads, a single row of
+  // tiles doesn't give enough work to many cores
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(all_buffers, padded_buffer_size, dir, height, in, ndir, pad_tile, passes, roi_in, width, xtrans) \
   shared(sgrow, sgcol, allhex, out) \
-  schedule(static)
+  schedule(static) collapse(2)
 #endif
   // step through TSxTS cells of image, each tile overlapping the
   // prior as interpolation needs a substantial border
   for(int top = -pad_tile; top < height - pad_tile; top += TS - (pad_tile*2))
+    for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile*2))
   {
     char *const buffer = dt_get_perthread(all_buffers, padded_buffer_size);
     // rgb points to ndir TSxTS tiles of 3 channels (R, G, and B)
@@ -689,7 +693,6 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
     uint8_t (*const homosum)[TS][TS] = (uint8_t(*)[TS][TS])(buffer + TS * TS * (ndir * 3) * sizeof(float)
                                                             + TS * TS * ndir * sizeof(uint8_t));
 
-    for(int left = -pad_tile; left < width - pad_tile; left += TS - (pad_tile*2))
     {
       int mrow = MIN(top + TS, height + pad_tile);
       int mcol = MIN(left + TS, width + pad_tile);
@@ -1009,38 +1012,56 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
       }
 
       /* Build homogeneity maps from the derivatives:                   */
+      // one row at a time, with the columns innermost so that the
+      // threshold and neighbour comparisons vectorize
       memset(homo, 0, sizeof(uint8_t) * ndir * TS * TS);
       const int pad_homo = (passes == 1) ? 10 : 15;
       for(int row = pad_homo; row < mrow - pad_homo; row++)
+      {
+        float tr[TS];
         for(int col = pad_homo; col < mcol - pad_homo; col++)
         {
-          float tr = FLT_MAX;
+          float t = FLT_MAX;
           for(int d = 0; d < ndir; d++)
-            if(tr > drv[d][row][col]) tr = drv[d][row][col];
-          tr *= 8;
-          for(int d = 0; d < ndir; d++)
-            for(int v = -1; v <= 1; v++)
-              for(int h = -1; h <= 1; h++)
-                homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
+            t = fminf(t, drv[d][row][col]);
+          tr[col] = t * 8;
         }
+        for(int d = 0; d < ndir; d++)
+        {
+          const float *const up = drv[d][row - 1];
+          const float *const mid = drv[d][row];
+          const float *const down = drv[d][row + 1];
+          uint8_t *const hrow = homo[d][row];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+          for(int col = pad_homo; col < mcol - pad_homo; col++)
+          {
+            const float t = tr[col];
+            hrow[col] = (up[col - 1] <= t) + (up[col] <= t) + (up[col + 1] <= t)
+                        + (mid[col - 1] <= t) + (mid[col] <= t) + (mid[col + 1] <= t)
+                        + (down[col - 1] <= t) + (down[col] <= t) + (down[col + 1] <= t);
+          }
+        }
+      }
 
       /* Build 5x5 sum of homogeneity maps for each pixel & direction */
       for(int d = 0; d < ndir; d++)
         for(int row = pad_tile; row < mrow - pad_tile; row++)
         {
+          // vertical sums of 5 first, in a vectorizable pass
+          uint8_t colsum[TS];
+          for(int col = pad_tile - 2; col < mcol - pad_tile + 2; col++)
+            colsum[col] = homo[d][row - 2][col] + homo[d][row - 1][col] + homo[d][row][col]
+                          + homo[d][row + 1][col] + homo[d][row + 2][col];
           // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
+          // so can know homosum[d][row][col] will be 0
           int col = pad_tile-5;
-          uint8_t v5sum[5] = { 0 };
           homosum[d][row][col] = 0;
           // calculate by rolling through column sums
           for(col++; col < mcol - pad_tile; col++)
-          {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
-          }
+            homosum[d][row][col] = homosum[d][row][col - 1] + colsum[col + 2]
+                                   - ((col - 3 >= pad_tile - 2) ? colsum[col - 3] : 0);
         }
 
       /* Average the most homogeneous pixels for the final result:       */
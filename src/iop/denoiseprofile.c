@@ -25,11 +25,13 @@
 #include "common/nlmeans_core.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
+#include "develop/pixelpipe_cache.h"
 #include "develop/tiling.h"
 #include "dtgtk/drawingarea.h"
 #include "gui/accelerators.h"
@@ -320,6 +322,12 @@ typedef struct dt_iop_denoiseprofile_data_t
   gboolean fix_anscombe_and_nlmeans_norm; // backward compatibility options
   gboolean use_new_vst;                   // backward compatibility options
   dt_iop_denoiseprofile_wavelet_mode_t wavelet_color_mode; // switch between RGB and Y0U0V0 modes.
+  // decomposition of the last run in wavelets mode, see process_wavelets(): the detail bands followed
+  // by the residue, and the variance of each band
+  uint64_t wavelets_key;
+  int wavelets_scales;
+  float *wavelets_bands;
+  dt_aligned_pixel_t wavelets_sum_y2[DT_IOP_DENOISE_PROFILE_BANDS];
 } dt_iop_denoiseprofile_data_t;
 
 typedef struct dt_iop_denoiseprofile_global_data_t
@@ -1261,6 +1269,18 @@ static void variance_stabilizing_xform(dt_aligned_pixel_t thrs, const int scale,
     thrs[c] = adjt[c] * sb2 / std_x[c];
 }
 
+static inline uint64_t hash_bytes(uint64_t hash, const void *const data, const size_t size)
+{
+  const char *const str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+static size_t wavelets_cache_budget()
+{
+  return (size_t)MAX(0, dt_conf_get_int("plugins/darkroom/denoiseprofile/wavelets_cache_size")) * 1024 * 1024;
+}
+
 static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
                              const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
                              const dt_iop_roi_t *const roi_out, const eaw_dn_decompose_t decompose,
@@ -1308,12 +1328,6 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   float *restrict precond = NULL;
   float *restrict tmp = NULL;
 
-  if (!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &precond, 4, &tmp, 4, &buf, 0))
-  {
-    dt_iop_copy_image_roi(out, in, piece->colors, roi_in, roi_out, TRUE);
-    return;
-  }
-
   dt_aligned_pixel_t wb;  // the "unused" fourth element enables vectorization
   const dt_aligned_pixel_t wb_weights = { 2.0f, 1.0f, 2.0f, 0.0f };
   compute_wb_factors(wb,d,piece,wb_weights);
@@ -1351,53 +1365,135 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   const dt_aligned_pixel_t aa = { d->a[1] * wb[0], d->a[1] * wb[1], d->a[1] * wb[2], 0.0f };
   const dt_aligned_pixel_t bb = { d->b[1] * wb[0], d->b[1] * wb[1], d->b[1] * wb[2], 0.0f };
 
-  if(!d->use_new_vst)
-  {
-    precondition(in, precond, width, height, aa, bb);
-  }
-  else if(d->wavelet_color_mode == MODE_RGB)
-  {
-    precondition_v2(in, precond, width, height, d->a[1] * compensate_p, p, d->b[1], wb);
-  }
-  else
-  {
-    precondition_Y0U0V0(in, precond, width, height, d->a[1] * compensate_p, p, d->b[1], toY0U0V0);
+  // the decomposition is the expensive part, and it only depends on the input and the variance stabilizing
+  // transform. the darkroom pipes keep it, so that editing the band curves or the bias only runs the
+  // thresholding and the backtransform again.
+  const size_t band_size = (size_t)4 * npixels;
+  dt_iop_denoiseprofile_data_t *const cache = (dt_iop_denoiseprofile_data_t *)piece->data;
+  const gboolean use_cache = !piece->pipe->tiling
+                             && (piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW))
+                             && sizeof(float) * band_size * (max_scale + 1) <= wavelets_cache_budget();
+  uint64_t key = 0;
+  if(use_cache)
+  {
+    key = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_in, piece->pipe,
+                                      g_list_index(piece->pipe->nodes, piece));
+    key = hash_bytes(key, &decompose, sizeof(decompose));
+    key = hash_bytes(key, &max_scale, sizeof(max_scale));
+    key = hash_bytes(key, &d->use_new_vst, sizeof(d->use_new_vst));
+    key = hash_bytes(key, &d->wavelet_color_mode, sizeof(d->wavelet_color_mode));
+    key = hash_bytes(key, d->a, sizeof(d->a));
+    key = hash_bytes(key, d->b, sizeof(d->b));
+    key = hash_bytes(key, aa, sizeof(aa));
+    key = hash_bytes(key, bb, sizeof(bb));
+    key = hash_bytes(key, p, sizeof(p));
+    key = hash_bytes(key, wb, sizeof(wb));
+    key = hash_bytes(key, &compensate_p, sizeof(compensate_p));
+    key = hash_bytes(key, toY0U0V0, sizeof(toY0U0V0));
+  }
+  const gboolean cached = use_cache && cache->wavelets_bands && cache->wavelets_key == key
+                          && cache->wavelets_scales == max_scale;
+
+  if(!cached)
+  {
+    // drop what we had, a new decomposition only becomes valid once completed
+    if(cache->wavelets_bands) dt_free_align(cache->wavelets_bands);
+    cache->wavelets_bands = use_cache ? dt_alloc_align_float(band_size * (max_scale + 1)) : NULL;
+    cache->wavelets_key = 0;
+    cache->wavelets_scales = max_scale;
+
+    // the detail band goes straight to the cache if we keep it
+    if(!dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &precond, 4, &tmp, 0)
+       || (!cache->wavelets_bands && !dt_iop_alloc_image_buffers(self, roi_in, roi_out, 4, &buf, 0)))
+    {
+      dt_iop_image_free(tmp);
+      dt_iop_image_free(precond);
+      dt_iop_copy_image_roi(out, in, piece->colors, roi_in, roi_out, TRUE);
+      return;
+    }
   }
 
-  debug_dump_PFM(piece,"/tmp/transformed.pfm",precond,width,height,0);
-
-  float *restrict buf1 = precond;
-  float *restrict buf2 = tmp;
-
   // clear the output buffer, which will be accumulating all of the detail scales
   memset(out, 0, sizeof(float) * 4 * npixels);
 
-  for(int scale = 0; scale < max_scale; scale++)
+  if(cached)
   {
-    const float sigma = 1.0f;
-    const float varf = sqrtf(2.0f + 2.0f * 4.0f * 4.0f + 6.0f * 6.0f) / 16.0f; // about 0.5
-    const float sigma_band = powf(varf, scale) * sigma;
-    dt_aligned_pixel_t sum_y2;
-    decompose(buf2, buf1, buf, sum_y2, scale, 1.0f / (sigma_band * sigma_band), width, height);
-    debug_dump_PFM(piece,"/tmp/coarse_%d.pfm",buf2,width,height,scale);
-    debug_dump_PFM(piece,"/tmp/detail_%d.pfm",buf,width,height,scale);
-
-    const dt_aligned_pixel_t boost = { 1.0f, 1.0f, 1.0f, 1.0f };
-    dt_aligned_pixel_t thrs;
-    variance_stabilizing_xform(thrs, scale, max_scale, npixels, sum_y2, d);
-    synthesize(out, out, buf, thrs, boost, width, height);
+    for(int scale = 0; scale < max_scale; scale++)
+    {
+      const dt_aligned_pixel_t boost = { 1.0f, 1.0f, 1.0f, 1.0f };
+      dt_aligned_pixel_t thrs;
+      variance_stabilizing_xform(thrs, scale, max_scale, npixels, cache->wavelets_sum_y2[scale], d);
+      synthesize(out, out, cache->wavelets_bands + scale * band_size, thrs, boost, width, height);
+    }
 
-    float *buf3 = buf2;
-    buf2 = buf1;
-    buf1 = buf3;
+    const float *const restrict residue = cache->wavelets_bands + max_scale * band_size;
+#ifdef _OPENMP
+#pragma omp simd aligned(residue, out : 64)
+#endif
+    for (size_t k = 0; k < 4U * npixels; k++)
+      out[k] += residue[k];
   }
+  else
+  {
+    if(!d->use_new_vst)
+    {
+      precondition(in, precond, width, height, aa, bb);
+    }
+    else if(d->wavelet_color_mode == MODE_RGB)
+    {
+      precondition_v2(in, precond, width, height, d->a[1] * compensate_p, p, d->b[1], wb);
+    }
+    else
+    {
+      precondition_Y0U0V0(in, precond, width, height, d->a[1] * compensate_p, p, d->b[1], toY0U0V0);
+    }
 
-  // add in the final residue
+    debug_dump_PFM(piece,"/tmp/transformed.pfm",precond,width,height,0);
+
+    float *restrict buf1 = precond;
+    float *restrict buf2 = tmp;
+
+    gboolean cancelled = FALSE;
+    for(int scale = 0; scale < max_scale; scale++)
+    {
+      if(dt_dev_pixelpipe_cancelled(piece->pipe))
+      {
+        cancelled = TRUE;
+        break;
+      }
+      const float sigma = 1.0f;
+      const float varf = sqrtf(2.0f + 2.0f * 4.0f * 4.0f + 6.0f * 6.0f) / 16.0f; // about 0.5
+      const float sigma_band = powf(varf, scale) * sigma;
+      float *const detail = cache->wavelets_bands ? cache->wavelets_bands + scale * band_size : buf;
+      dt_aligned_pixel_t sum_y2;
+      decompose(buf2, buf1, detail, sum_y2, scale, 1.0f / (sigma_band * sigma_band), width, height);
+      debug_dump_PFM(piece,"/tmp/coarse_%d.pfm",buf2,width,height,scale);
+      debug_dump_PFM(piece,"/tmp/detail_%d.pfm",detail,width,height,scale);
+      if(cache->wavelets_bands) copy_pixel(cache->wavelets_sum_y2[scale], sum_y2);
+
+      const dt_aligned_pixel_t boost = { 1.0f, 1.0f, 1.0f, 1.0f };
+      dt_aligned_pixel_t thrs;
+      variance_stabilizing_xform(thrs, scale, max_scale, npixels, sum_y2, d);
+      synthesize(out, out, detail, thrs, boost, width, height);
+
+      float *buf3 = buf2;
+      buf2 = buf1;
+      buf1 = buf3;
+    }
+
+    // add in the final residue
 #ifdef _OPENMP
 #pragma omp simd aligned(buf1, out : 64)
 #endif
-  for (size_t k = 0; k < 4U * npixels; k++)
-    out[k] += buf1[k];
+    for (size_t k = 0; k < 4U * npixels; k++)
+      out[k] += buf1[k];
+
+    if(cache->wavelets_bands && !cancelled)
+    {
+      memcpy(cache->wavelets_bands + max_scale * band_size, buf1, sizeof(float) * band_size);
+      cache->wavelets_key = key;
+    }
+  }
 
   if(!d->use_new_vst)
   {
@@ -1412,9 +1508,9 @@ static void process_wavelets(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     backtransform_Y0U0V0(out, width, height, d->a[1] * compensate_p, p, d->b[1], d->bias - 0.5 * logf(in_scale), wb, toRGB);
   }
 
-  dt_free_align(buf);
-  dt_free_align(tmp);
-  dt_free_align(precond);
+  dt_iop_image_free(buf);
+  dt_iop_image_free(tmp);
+  dt_iop_image_free(precond);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, width, height);
 
@@ -1613,10 +1709,11 @@ static void process_nlmeans_cpu(dt_dev_pixelpipe_iop_t *piece,
                                       .patch_radius = P,
                                       .search_radius = K,
                                       .decimate = 0,
-                                      .norm = norm2 };
+                                      .norm = norm2,
+                                      .pipe = piece->pipe };
   denoiser(in,ovoid,roi_in,roi_out,&params);
 
-  dt_free_align(in);
+  dt_iop_image_free(in);
   nlmeans_backtransform(d,ovoid,roi_in,scale,compensate_p,wb,aa,bb,p);
 
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
@@ -1636,7 +1733,9 @@ static void process_nlmeans_sse(struct dt_iop_module_t *self, dt_dev_pixelpipe_i
                                 const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
                                 const dt_iop_roi_t *const roi_out)
 {
-  process_nlmeans_cpu(piece,ivoid,ovoid,roi_in,roi_out,nlmeans_denoise_sse2);
+  // the avx2 clone of the plain version beats the 4-wide intrinsics
+  process_nlmeans_cpu(piece,ivoid,ovoid,roi_in,roi_out,
+                      darktable.codepath.AVX2 ? nlmeans_denoise : nlmeans_denoise_sse2);
   return;
 }
 #endif
@@ -1755,6 +1854,7 @@ static void process_variance(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
   g->variance_B = var[2];
 
   memcpy(ovoid, ivoid, sizeof(float) * 4 * npixels);
+  dt_iop_image_free(in);
 }
 
 #if defined(HAVE_OPENCL) && !USE_NEW_IMPL_CL
@@ -2647,7 +2747,12 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
   if(d->mode == MODE_NLMEANS || d->mode == MODE_NLMEANS_AUTO)
     process_nlmeans_sse(self, piece, ivoid, ovoid, roi_in, roi_out);
   else if(d->mode == MODE_WAVELETS || d->mode == MODE_WAVELETS_AUTO)
-    process_wavelets(self, piece, ivoid, ovoid, roi_in, roi_out, eaw_dn_decompose_sse, eaw_synthesize_sse2);
+  {
+    if(darktable.codepath.AVX2)
+      process_wavelets(self, piece, ivoid, ovoid, roi_in, roi_out, eaw_dn_decompose, eaw_synthesize);
+    else
+      process_wavelets(self, piece, ivoid, ovoid, roi_in, roi_out, eaw_dn_decompose_sse, eaw_synthesize_sse2);
+  }
   else
     process_variance(self, piece, ivoid, ovoid, roi_in, roi_out);
 }
@@ -2903,6 +3008,9 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   dt_iop_denoiseprofile_params_t *default_params = (dt_iop_denoiseprofile_params_t *)self->default_params;
 
   piece->data = (void *)d;
+  d->wavelets_key = 0;
+  d->wavelets_scales = 0;
+  d->wavelets_bands = NULL;
   for(int ch = 0; ch < DT_DENOISE_PROFILE_NONE; ch++)
   {
     d->curve[ch] = dt_draw_curve_new(0.0, 1.0, CATMULL_ROM);
@@ -2915,6 +3023,7 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
 {
   dt_iop_denoiseprofile_data_t *d = (dt_iop_denoiseprofile_data_t *)(piece->data);
   for(int ch = 0; ch < DT_DENOISE_PROFILE_NONE; ch++) dt_draw_curve_destroy(d->curve[ch]);
+  if(d->wavelets_bands) dt_free_align(d->wavelets_bands);
   free(piece->data);
   piece->data = NULL;
 }
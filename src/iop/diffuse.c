@@ -47,9 +47,16 @@
 // Set to one to output intermediate image steps as PFM in /tmp
 #define DEBUG_DUMP_PFM 0
 
-DT_MODULE_INTROSPECTION(2, dt_iop_diffuse_params_t)
+DT_MODULE_INTROSPECTION(3, dt_iop_diffuse_params_t)
 
 #define MAX_NUM_SCALES 10
+
+typedef enum dt_iop_diffuse_solver_t
+{
+  DT_DIFFUSE_SOLVER_FULL = 0,      // $DESCRIPTION: "full resolution"
+  DT_DIFFUSE_SOLVER_MULTIGRID = 1, // $DESCRIPTION: "multigrid"
+} dt_iop_diffuse_solver_t;
+
 typedef struct dt_iop_diffuse_params_t
 {
   // global parameters
@@ -74,6 +81,10 @@ typedef struct dt_iop_diffuse_params_t
   // v2
   int radius_center;      // $MIN: 0 $MAX: 512 $DEFAULT: 0 $DESCRIPTION: "central radius"
 
+  // v3
+  dt_iop_diffuse_solver_t solver; // $DEFAULT: DT_DIFFUSE_SOLVER_FULL $DESCRIPTION: "solver"
+  float convergence;              // $MIN: 0. $MAX: 5. $DEFAULT: 0. $DESCRIPTION: "convergence threshold"
+
   // new versions add params mandatorily at the end, so we can memcpy old parameters at the beginning
 
 } dt_iop_diffuse_params_t;
@@ -81,7 +92,7 @@ typedef struct dt_iop_diffuse_params_t
 
 typedef struct dt_iop_diffuse_gui_data_t
 {
-  GtkWidget *iterations, *fourth, *third, *second, *radius, *radius_center, *sharpness, *threshold, *regularization, *first,
+  GtkWidget *iterations, *solver, *convergence, *fourth, *third, *second, *radius, *radius_center, *sharpness, *threshold, *regularization, *first,
       *anisotropy_first, *anisotropy_second, *anisotropy_third, *anisotropy_fourth, *regularization_first, *variance_threshold;
 } dt_iop_diffuse_gui_data_t;
 
@@ -91,6 +102,9 @@ typedef struct dt_iop_diffuse_global_data_t
   int kernel_diffuse_build_mask;
   int kernel_diffuse_inpaint_mask;
   int kernel_diffuse_pde;
+  int kernel_diffuse_downsample;
+  int kernel_diffuse_add_delta;
+  int kernel_diffuse_update_norm;
 } dt_iop_diffuse_global_data_t;
 
 
@@ -161,7 +175,7 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version, void *new_params,
                   const int new_version)
 {
-  if(old_version == 1 && new_version == 2)
+  if(old_version == 1 && new_version == 3)
   {
     typedef struct dt_iop_diffuse_params_v1_t
     {
@@ -199,6 +213,18 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
 
     return 0;
   }
+  if(old_version == 2 && new_version == 3)
+  {
+    dt_iop_diffuse_params_t *n = (dt_iop_diffuse_params_t *)new_params;
+    dt_iop_diffuse_params_t *d = (dt_iop_diffuse_params_t *)self->default_params;
+
+    *n = *d; // start with a fresh copy of default parameters
+
+    // v2 ends right before the solver settings
+    memcpy(n, old_params, offsetof(dt_iop_diffuse_params_t, solver));
+
+    return 0;
+  }
   return 1;
 }
 
@@ -529,9 +555,10 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   const int scales = CLAMP(diffusion_scales, 1, MAX_NUM_SCALES);
   const int max_filter_radius = (1 << scales);
 
-  // in + out + 2 * tmp + 2 * LF + s details + grey mask
-  tiling->factor = 6.25f + scales;
-  tiling->factor_cl = 6.25f + scales;
+  // in + out + 2 * tmp + 2 * LF + s details + grey mask (+ quarter size input of the multigrid solver)
+  const float coarse = data->solver == DT_DIFFUSE_SOLVER_MULTIGRID ? 0.25f : 0.f;
+  tiling->factor = 6.25f + scales + coarse;
+  tiling->factor_cl = 6.25f + scales + coarse;
 
   tiling->maxbuf = 1.0f;
   tiling->maxbuf_cl = 1.0f;
@@ -1087,6 +1114,130 @@ static inline void inpaint_mask(float *const restrict inpainted, const float *co
   }
 }
 
+// the multigrid solver runs all but a quarter of the iterations at half resolution, on images at least this large
+#define MULTIGRID_MIN_SIZE 64
+
+static inline gboolean use_multigrid(const dt_iop_diffuse_data_t *const data, const int has_mask,
+                                     const int iterations, const size_t width, const size_t height)
+{
+  // inpainting needs every pixel of the mask, keep it at full resolution
+  return data->solver == DT_DIFFUSE_SOLVER_MULTIGRID && !has_mask && iterations > 1
+         && width >= MULTIGRID_MIN_SIZE && height >= MULTIGRID_MIN_SIZE;
+}
+
+static inline int coarse_iterations(const int iterations)
+{
+  return iterations - MAX(1, iterations / 4);
+}
+
+static inline void downsample_half(const float *const restrict in, float *const restrict out,
+                                   const size_t width, const size_t height)
+{
+  const size_t cwidth = width / 2;
+  const size_t cheight = height / 2;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, out, width, cwidth, cheight) schedule(static)
+#endif
+  for(size_t i = 0; i < cheight; i++)
+    for(size_t j = 0; j < cwidth; j++)
+    {
+      const float *const top = in + (2 * i * width + 2 * j) * 4;
+      const float *const bottom = top + width * 4;
+      for_four_channels(c)
+        out[(i * cwidth + j) * 4 + c] = 0.25f * (top[c] + top[4 + c] + bottom[c] + bottom[4 + c]);
+    }
+}
+
+// out = in + what the coarse iterations changed, interpolated to full resolution
+static inline void add_upsampled_delta(const float *const restrict in, const float *const restrict coarse_out,
+                                       const float *const restrict coarse_in, float *const restrict out,
+                                       const size_t width, const size_t height)
+{
+  const size_t cwidth = width / 2;
+  const size_t cheight = height / 2;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, coarse_out, coarse_in, out, width, height, cwidth, cheight) schedule(static)
+#endif
+  for(size_t i = 0; i < height; i++)
+  {
+    const float fy = CLAMP((i + 0.5f) / 2.f - 0.5f, 0.f, cheight - 1.f);
+    const size_t y0 = (size_t)fy;
+    const size_t y1 = MIN(y0 + 1, cheight - 1);
+    const float wy = fy - y0;
+    for(size_t j = 0; j < width; j++)
+    {
+      const float fx = CLAMP((j + 0.5f) / 2.f - 0.5f, 0.f, cwidth - 1.f);
+      const size_t x0 = (size_t)fx;
+      const size_t x1 = MIN(x0 + 1, cwidth - 1);
+      const float wx = fx - x0;
+      const size_t k00 = (y0 * cwidth + x0) * 4, k01 = (y0 * cwidth + x1) * 4;
+      const size_t k10 = (y1 * cwidth + x0) * 4, k11 = (y1 * cwidth + x1) * 4;
+      const size_t k = (i * width + j) * 4;
+      for_four_channels(c)
+      {
+        const float top = (1.f - wx) * (coarse_out[k00 + c] - coarse_in[k00 + c])
+                          + wx * (coarse_out[k01 + c] - coarse_in[k01 + c]);
+        const float bottom = (1.f - wx) * (coarse_out[k10 + c] - coarse_in[k10 + c])
+                             + wx * (coarse_out[k11 + c] - coarse_in[k11 + c]);
+        out[k + c] = in[k + c] + (1.f - wy) * top + wy * bottom;
+      }
+    }
+  }
+}
+
+// mean absolute change of the RGB channels relative to their mean magnitude
+static inline float update_norm(const float *const restrict before, const float *const restrict after,
+                                const size_t width, const size_t height)
+{
+  double change = 0.;
+  double norm = 0.;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(before, after, width, height) \
+  reduction(+:change, norm) schedule(static)
+#endif
+  for(size_t k = 0; k < width * height * 4; k += 4)
+    for(int c = 0; c < 3; c++)
+    {
+      change += fabsf(after[k + c] - before[k + c]);
+      norm += fabsf(before[k + c]);
+    }
+  return norm > 0. ? change / norm : 0.f;
+}
+
+// run the iterations from in to out, cycling through temp1 and temp2. the result always lands in out, also
+// when the update falls below the convergence threshold before the last iteration.
+static inline void diffuse_iterations(const float *const in, float *const out, float *const temp1,
+                                      float *const temp2, const uint8_t *const restrict mask,
+                                      const size_t width, const size_t height,
+                                      const dt_iop_diffuse_data_t *const data, const float final_radius,
+                                      const float zoom, const int scales, const int has_mask,
+                                      float *const restrict HF[MAX_NUM_SCALES],
+                                      float *const restrict LF_odd, float *const restrict LF_even,
+                                      const int iterations, dt_dev_pixelpipe_t *pipe)
+{
+  const float *temp_in = in;
+  for(int it = 0; it < iterations; it++)
+  {
+    // each iteration is expensive, don't finish a result nobody waits for anymore
+    if(dt_dev_pixelpipe_cancelled(pipe)) break;
+
+    float *const temp_out = (it == iterations - 1) ? out : (it % 2 == 0) ? temp2 : temp1;
+
+    wavelets_process(temp_in, temp_out, mask, width, height,
+                     data, final_radius, zoom, scales, has_mask, HF, LF_odd, LF_even);
+
+    if(data->convergence > 0.f && temp_out != out
+       && update_norm(temp_in, temp_out, width, height) < data->convergence / 100.f)
+    {
+      dt_iop_image_copy_by_size(out, temp_out, width, height, 4);
+      break;
+    }
+
+    temp_in = temp_out;
+  }
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const restrict ivoid,
              void *const restrict ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -1098,11 +1249,9 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
   float *restrict in = DT_IS_ALIGNED((float *const restrict)ivoid);
   float *const restrict out = DT_IS_ALIGNED((float *const restrict)ovoid);
 
-  float *const restrict temp1 = dt_alloc_align_float((size_t)roi_out->width * roi_out->height * 4);
-  float *const restrict temp2 = dt_alloc_align_float((size_t)roi_out->width * roi_out->height * 4);
-
-  float *restrict temp_in = NULL;
-  float *restrict temp_out = NULL;
+  float *const restrict temp1 = dt_iop_image_alloc_scratch(roi_out->width, roi_out->height, 4);
+  float *const restrict temp2 = dt_iop_image_alloc_scratch(roi_out->width, roi_out->height, 4);
+  float *restrict coarse_in = NULL;
 
   uint8_t *const restrict mask = dt_alloc_align(64, sizeof(uint8_t) * roi_out->width * roi_out->height);
 
@@ -1119,13 +1268,13 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
   float *restrict HF[MAX_NUM_SCALES];
   for(int s = 0; s < scales; s++)
   {
-    HF[s] = dt_alloc_align_float(width * height * 4);
+    HF[s] = dt_iop_image_alloc_scratch(width, height, 4);
     if(!HF[s]) out_of_memory = TRUE;
   }
 
   // temp buffer for blurs. We will need to cycle between them for memory efficiency
-  float *const restrict LF_odd = dt_alloc_align_float(width * height * 4);
-  float *const restrict LF_even = dt_alloc_align_float(width * height * 4);
+  float *const restrict LF_odd = dt_iop_image_alloc_scratch(width, height, 4);
+  float *const restrict LF_even = dt_iop_image_alloc_scratch(width, height, 4);
 
   // PAUSE !
   // check that all buffers exist before processing,
@@ -1149,39 +1298,37 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     in = temp1;
   }
 
-  for(int it = 0; it < iterations; it++)
+  int full_iterations = iterations;
+  if(use_multigrid(data, has_mask, iterations, width, height)
+     && (coarse_in = dt_iop_image_alloc_scratch(width / 2, height / 2, 4)))
   {
-    if(it == 0)
-    {
-      temp_in = in;
-      temp_out = temp2;
-    }
-    else if(it % 2 == 0)
-    {
-      temp_in = temp1;
-      temp_out = temp2;
-    }
-    else
-    {
-      temp_in = temp2;
-      temp_out = temp1;
-    }
-
-    if(it == (int)iterations - 1)
-      temp_out = out;
+    // most of the iterations at half resolution, as if we were zoomed out, the whole buffers hold the half
+    // size images. then only refine what they changed at full resolution.
+    const size_t cwidth = width / 2;
+    const size_t cheight = height / 2;
+    const int cscales = CLAMP(num_steps_to_reach_equivalent_sigma(B_SPLINE_SIGMA, final_radius / 2.f), 1, scales);
+
+    downsample_half(in, coarse_in, width, height);
+    diffuse_iterations(coarse_in, out, temp1, temp2, mask, cwidth, cheight, data, final_radius / 2.f,
+                       scale * 2.f, cscales, has_mask, HF, LF_odd, LF_even, coarse_iterations(iterations),
+                       piece->pipe);
+    add_upsampled_delta(in, out, coarse_in, temp1, width, height);
 
-    wavelets_process(temp_in, temp_out, mask,
-                     roi_out->width, roi_out->height,
-                     data, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even);
+    in = temp1;
+    full_iterations = iterations - coarse_iterations(iterations);
   }
 
+  diffuse_iterations(in, out, temp1, temp2, mask, width, height, data, final_radius, scale, scales, has_mask,
+                     HF, LF_odd, LF_even, full_iterations, piece->pipe);
+
 error:
   if(mask) dt_free_align(mask);
-  if(temp1) dt_free_align(temp1);
-  if(temp2) dt_free_align(temp2);
-  if(LF_even) dt_free_align(LF_even);
-  if(LF_odd) dt_free_align(LF_odd);
-  for(int s = 0; s < scales; s++) if(HF[s]) dt_free_align(HF[s]);
+  dt_iop_image_free(temp1);
+  dt_iop_image_free(temp2);
+  dt_iop_image_free(coarse_in);
+  dt_iop_image_free(LF_even);
+  dt_iop_image_free(LF_odd);
+  for(int s = 0; s < scales; s++) dt_iop_image_free(HF[s]);
 }
 
 #if HAVE_OPENCL
@@ -1324,6 +1471,74 @@ static inline cl_int wavelets_process_cl(const int devid, cl_mem in, cl_mem reco
   return err;
 }
 
+static inline cl_int update_norm_cl(const int devid, dt_iop_diffuse_global_data_t *const gd, cl_mem before,
+                                    cl_mem after, cl_mem sums, float *const restrict host_sums, const int width,
+                                    const int height, float *const norm)
+{
+  const size_t sizes[] = { ROUNDUPHT(height), 1, 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 0, sizeof(cl_mem), (void *)&before);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 1, sizeof(cl_mem), (void *)&after);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 2, sizeof(cl_mem), (void *)&sums);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 3, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_update_norm, 4, sizeof(int), (void *)&height);
+  cl_int err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_diffuse_update_norm, sizes);
+  if(err != CL_SUCCESS) return err;
+
+  err = dt_opencl_read_buffer_from_device(devid, host_sums, sums, 0, sizeof(float) * 2 * height, CL_TRUE);
+  if(err != CL_SUCCESS) return err;
+
+  double change = 0.;
+  double total = 0.;
+  for(int y = 0; y < height; y++)
+  {
+    change += host_sums[2 * y];
+    total += host_sums[2 * y + 1];
+  }
+  *norm = total > 0. ? change / total : 0.f;
+  return CL_SUCCESS;
+}
+
+// same as diffuse_iterations() on the host
+static inline cl_int diffuse_iterations_cl(const int devid, dt_iop_diffuse_global_data_t *const gd, cl_mem in,
+                                           cl_mem out, cl_mem temp1, cl_mem temp2, cl_mem mask,
+                                           const size_t sizes[3], const int width, const int height,
+                                           const dt_iop_diffuse_data_t *const data, const float final_radius,
+                                           const float zoom, const int scales, const int has_mask,
+                                           cl_mem HF[MAX_NUM_SCALES], cl_mem LF_odd, cl_mem LF_even,
+                                           cl_mem sums, float *const restrict host_sums, const int iterations,
+                                           dt_dev_pixelpipe_t *pipe)
+{
+  cl_int err = CL_SUCCESS;
+  cl_mem temp_in = in;
+  for(int it = 0; it < iterations; it++)
+  {
+    // each iteration is expensive, don't finish a result nobody waits for anymore
+    if(dt_dev_pixelpipe_cancelled(pipe)) break;
+
+    cl_mem temp_out = (it == iterations - 1) ? out : (it % 2 == 0) ? temp2 : temp1;
+
+    err = wavelets_process_cl(devid, temp_in, temp_out, mask, sizes, width, height, data, gd, final_radius, zoom,
+                              scales, has_mask, HF, LF_odd, LF_even);
+    if(err != CL_SUCCESS) return err;
+
+    if(sums && temp_out != out)
+    {
+      float norm = 0.f;
+      err = update_norm_cl(devid, gd, temp_in, temp_out, sums, host_sums, width, height, &norm);
+      if(err != CL_SUCCESS) return err;
+      if(norm < data->convergence / 100.f)
+      {
+        size_t origin[] = { 0, 0, 0 };
+        size_t region[] = { width, height, 1 };
+        return dt_opencl_enqueue_copy_image(devid, temp_out, out, origin, origin, region);
+      }
+    }
+
+    temp_in = temp_out;
+  }
+  return err;
+}
+
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -1345,8 +1560,9 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   cl_mem temp1 = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(float) * 4);
   cl_mem temp2 = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(float) * 4);
 
-  cl_mem temp_in = NULL;
-  cl_mem temp_out = NULL;
+  cl_mem coarse_in = NULL;
+  cl_mem sums = NULL;
+  float *restrict host_sums = NULL;
 
   cl_mem mask = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(uint8_t));
 
@@ -1372,6 +1588,13 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   // PAUSE !
   // check that all buffers exist before processing,
   // because we use a lot of memory here.
+  if(data->convergence > 0.f)
+  {
+    sums = dt_opencl_alloc_device_buffer(devid, sizeof(float) * 2 * height);
+    host_sums = dt_alloc_align_float((size_t)2 * height);
+    if(!sums || !host_sums) out_of_memory = TRUE;
+  }
+
   if(!temp1 || !temp2 || !LF_odd || !LF_even || out_of_memory)
   {
     dt_control_log(_("diffuse/sharpen failed to allocate memory, check your RAM settings"));
@@ -1404,29 +1627,46 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     in = temp1;
   }
 
-  for(int it = 0; it < iterations; it++)
+  int full_iterations = iterations;
+  if(use_multigrid(data, has_mask, iterations, width, height)
+     && (coarse_in = dt_opencl_alloc_device(devid, width / 2, height / 2, sizeof(float) * 4)))
   {
-    if(it == 0)
-    {
-      temp_in = in;
-      temp_out = temp2;
-    }
-    else if(it % 2 == 0)
-    {
-      temp_in = temp1;
-      temp_out = temp2;
-    }
-    else
-    {
-      temp_in = temp2;
-      temp_out = temp1;
-    }
+    // see process(), the half size images live in the top-left corner of the full size buffers
+    const int cwidth = width / 2;
+    const int cheight = height / 2;
+    const size_t csizes[] = { ROUNDUPWD(cwidth), ROUNDUPHT(cheight), 1 };
+    const int cscales = CLAMP(num_steps_to_reach_equivalent_sigma(B_SPLINE_SIGMA, final_radius / 2.f), 1, scales);
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_downsample, 0, sizeof(cl_mem), (void *)&in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_downsample, 1, sizeof(cl_mem), (void *)&coarse_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_downsample, 2, sizeof(int), (void *)&cwidth);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_downsample, 3, sizeof(int), (void *)&cheight);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_diffuse_downsample, csizes);
+    if(err != CL_SUCCESS) goto error;
 
-    if(it == (int)iterations - 1) temp_out = dev_out;
-    err = wavelets_process_cl(devid, temp_in, temp_out, mask, sizes, width, height, data, gd, final_radius, scale, scales, has_mask, HF, LF_odd, LF_even);
+    err = diffuse_iterations_cl(devid, gd, coarse_in, dev_out, temp1, temp2, mask, csizes, cwidth, cheight, data,
+                                final_radius / 2.f, scale * 2.f, cscales, has_mask, HF, LF_odd, LF_even, sums,
+                                host_sums, coarse_iterations(iterations), piece->pipe);
     if(err != CL_SUCCESS) goto error;
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_add_delta, 0, sizeof(cl_mem), (void *)&in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_add_delta, 1, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_add_delta, 2, sizeof(cl_mem), (void *)&coarse_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_add_delta, 3, sizeof(cl_mem), (void *)&temp1);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_add_delta, 4, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_diffuse_add_delta, 5, sizeof(int), (void *)&height);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_diffuse_add_delta, sizes);
+    if(err != CL_SUCCESS) goto error;
+
+    in = temp1;
+    full_iterations = iterations - coarse_iterations(iterations);
   }
 
+  err = diffuse_iterations_cl(devid, gd, in, dev_out, temp1, temp2, mask, sizes, width, height, data,
+                              final_radius, scale, scales, has_mask, HF, LF_odd, LF_even, sums, host_sums,
+                              full_iterations, piece->pipe);
+  if(err != CL_SUCCESS) goto error;
+
   // cleanup and exit on success
   dt_opencl_release_mem_object(mask);
   dt_opencl_release_mem_object(temp1);
@@ -1434,6 +1674,9 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dt_opencl_release_mem_object(LF_even);
   dt_opencl_release_mem_object(LF_odd);
   for(int s = 0; s < scales; s++) dt_opencl_release_mem_object(HF[s]);
+  if(coarse_in) dt_opencl_release_mem_object(coarse_in);
+  if(sums) dt_opencl_release_mem_object(sums);
+  if(host_sums) dt_free_align(host_sums);
   return TRUE;
 
 error:
@@ -1443,6 +1686,9 @@ error:
   if(LF_even) dt_opencl_release_mem_object(LF_even);
   if(LF_odd) dt_opencl_release_mem_object(LF_odd);
   for(int s = 0; s < scales; s++) if(HF[s]) dt_opencl_release_mem_object(HF[s]);
+  if(coarse_in) dt_opencl_release_mem_object(coarse_in);
+  if(sums) dt_opencl_release_mem_object(sums);
+  if(host_sums) dt_free_align(host_sums);
 
   dt_print(DT_DEBUG_OPENCL, "[opencl_diffuse] couldn't enqueue kernel! %d\n", err);
   return FALSE;
@@ -1458,6 +1704,9 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_diffuse_inpaint_mask = dt_opencl_create_kernel(program, "inpaint_mask");
   gd->kernel_wavelets_decompose = dt_opencl_create_kernel(program, "diffuse_blur_bspline");
   gd->kernel_diffuse_pde = dt_opencl_create_kernel(program, "diffuse_pde");
+  gd->kernel_diffuse_downsample = dt_opencl_create_kernel(program, "diffuse_downsample");
+  gd->kernel_diffuse_add_delta = dt_opencl_create_kernel(program, "diffuse_add_delta");
+  gd->kernel_diffuse_update_norm = dt_opencl_create_kernel(program, "diffuse_update_norm");
 }
 
 
@@ -1468,6 +1717,9 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_diffuse_inpaint_mask);
   dt_opencl_free_kernel(gd->kernel_wavelets_decompose);
   dt_opencl_free_kernel(gd->kernel_diffuse_pde);
+  dt_opencl_free_kernel(gd->kernel_diffuse_downsample);
+  dt_opencl_free_kernel(gd->kernel_diffuse_add_delta);
+  dt_opencl_free_kernel(gd->kernel_diffuse_update_norm);
   free(module->data);
   module->data = NULL;
 }
@@ -1479,6 +1731,8 @@ void gui_update(struct dt_iop_module_t *self)
   dt_iop_diffuse_gui_data_t *g = (dt_iop_diffuse_gui_data_t *)self->gui_data;
   dt_iop_diffuse_params_t *p = (dt_iop_diffuse_params_t *)self->params;
   dt_bauhaus_slider_set_soft(g->iterations, p->iterations);
+  dt_bauhaus_combobox_set(g->solver, p->solver);
+  dt_bauhaus_slider_set_soft(g->convergence, p->convergence);
   dt_bauhaus_slider_set_soft(g->fourth, p->fourth);
   dt_bauhaus_slider_set_soft(g->third, p->third);
   dt_bauhaus_slider_set_soft(g->second, p->second);
@@ -1511,6 +1765,21 @@ void gui_init(struct dt_iop_module_t *self)
                                 "this is analogous to giving more time to the diffusion reaction.\n"
                                 "if you plan on sharpening or inpainting, more iterations help reconstruction."));
 
+  g->solver = dt_bauhaus_combobox_from_params(self, "solver");
+  gtk_widget_set_tooltip_text(g->solver,
+                              _("full resolution runs every iteration on the full image.\n"
+                                "multigrid runs most iterations at half resolution and refines\n"
+                                "the result at full resolution, which is much faster on large\n"
+                                "radii but may lose some of the finest details.\n"
+                                "inpainting always runs at full resolution."));
+
+  g->convergence = dt_bauhaus_slider_from_params(self, "convergence");
+  dt_bauhaus_slider_set_digits(g->convergence, 2);
+  dt_bauhaus_slider_set_format(g->convergence, "%.2f %%");
+  gtk_widget_set_tooltip_text(g->convergence,
+                              _("stop iterating once an iteration changes the image by less than this.\n"
+                                "zero always runs all the iterations."));
+
   g->radius_center = dt_bauhaus_slider_from_params(self, "radius_center");
   dt_bauhaus_slider_enable_soft_boundaries(g->radius_center, 0., 1024.);
   dt_bauhaus_slider_set_format(g->radius_center, "%.0f px");
@@ -28,6 +28,14 @@ static float slider2contrast(float slider)
 {
   return 0.005f * powf(slider, 1.1f);
 }
+
+// the smooth demosaicer only runs on the tiles where the blend mask lets it contribute. tiles get a border
+// large enough for VNG and the color smoothing to give the very same pixels as on the whole image.
+#define DUAL_TILE 128
+#define DUAL_BORDER 8
+// above this the vng pixels weigh less than 0.1% and the tile keeps the high frequency demosaic only
+#define DUAL_BLEND_HIGH 0.999f
+
 static void dual_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict rgb_data, const float *const restrict raw_data,
                           dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in, const uint32_t filters, const uint8_t (*const xtrans)[6],
                           const gboolean dual_mask, float dual_threshold)
@@ -39,37 +47,43 @@ static void dual_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict r
   // If the threshold is zero and we don't want to see the blend mask we don't do anything
   if(dual_threshold <= 0.0f) return;
 
+  const int tile_size = DUAL_TILE + 2 * DUAL_BORDER;
+  size_t raw_padded = 0, vng_padded = 0;
   float *blend = dt_alloc_align_float((size_t) width * height);
   float *tmp = dt_alloc_align_float((size_t) width * height);
-  float *vng_image = dt_alloc_align_float((size_t) 4 * width * height);
-  if(!blend || !tmp || !vng_image)
+  float *raw_tiles = dual_mask ? NULL : dt_alloc_perthread_float((size_t) tile_size * tile_size, &raw_padded);
+  float *vng_tiles = dual_mask ? NULL : dt_alloc_perthread_float((size_t) 4 * tile_size * tile_size, &vng_padded);
+  if(!blend || !tmp || (!dual_mask && (!raw_tiles || !vng_tiles)))
   {
     if(tmp) dt_free_align(tmp);
     if(blend) dt_free_align(blend);
-    if(vng_image) dt_free_align(vng_image);
+    if(raw_tiles) dt_free_align(raw_tiles);
+    if(vng_tiles) dt_free_align(vng_tiles);
     dt_control_log(_("[dual demosaic] can't allocate internal buffers"));
     return;
   }
   const gboolean info = ((darktable.unmuted & (DT_DEBUG_DEMOSAIC | DT_DEBUG_PERF)) && (piece->pipe->type == DT_DEV_PIXELPIPE_FULL));
 
-  vng_interpolate(vng_image, raw_data, roi_out, roi_in, filters, xtrans, FALSE);
-  color_smoothing(vng_image, roi_out, 2);
-
   dt_times_t start_blend = { 0 }, end_blend = { 0 };
   if(info) dt_get_times(&start_blend);
 
   const float contrastf = slider2contrast(dual_threshold);
 
+  // the mask only depends on the high frequency demosaic, so we know where the smooth one is needed up front
   dt_masks_calc_rawdetail_mask(rgb_data, blend, tmp, width, height, piece->pipe->dsc.temperature.coeffs);
   dt_masks_calc_detail_mask(blend, blend, tmp, width, height, contrastf, TRUE);
 
+  int skipped = 0;
+  const int tiles_x = (width + DUAL_TILE - 1) / DUAL_TILE;
+  const int tiles_y = (height + DUAL_TILE - 1) / DUAL_TILE;
+
   if(dual_mask)
   {
     piece->pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_PASSTHRU;
 #ifdef _OPENMP
   #pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(blend, rgb_data, vng_image, width, height) \
-  schedule(simd:static) aligned(blend, vng_image, rgb_data : 64)
+  dt_omp_firstprivate(blend, rgb_data, width, height) \
+  schedule(simd:static) aligned(blend, rgb_data : 64)
 #endif
     for(int idx = 0; idx < width * height; idx++)
     {
@@ -80,26 +94,73 @@ static void dual_demosaic(dt_dev_pixelpipe_iop_t *piece, float *const restrict r
   else
   {
 #ifdef _OPENMP
-  #pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(blend, rgb_data, vng_image, width, height) \
-  schedule(simd:static) aligned(blend, vng_image, rgb_data : 64)
+  #pragma omp parallel for default(none) \
+  dt_omp_firstprivate(blend, rgb_data, raw_data, raw_tiles, vng_tiles, raw_padded, vng_padded, width, height, \
+                      tiles_x, tiles_y, roi_in, filters, xtrans) \
+  reduction(+ : skipped) schedule(dynamic) collapse(2)
 #endif
-    for(int idx = 0; idx < width * height; idx++)
-    {
-      const int oidx = 4 * idx;
-      for(int c = 0; c < 4; c++)
-        rgb_data[oidx + c] = intp(blend[idx], rgb_data[oidx + c], vng_image[oidx + c]);
-    }
+    for(int ty = 0; ty < tiles_y; ty++)
+      for(int tx = 0; tx < tiles_x; tx++)
+      {
+        const int x0 = tx * DUAL_TILE;
+        const int y0 = ty * DUAL_TILE;
+        const int x1 = MIN(x0 + DUAL_TILE, width);
+        const int y1 = MIN(y0 + DUAL_TILE, height);
+
+        gboolean needed = FALSE;
+        for(int row = y0; row < y1 && !needed; row++)
+          for(int col = x0; col < x1; col++)
+            if(blend[(size_t)row * width + col] < DUAL_BLEND_HIGH)
+            {
+              needed = TRUE;
+              break;
+            }
+        if(!needed)
+        {
+          skipped++;
+          continue;
+        }
+
+        const int bx0 = MAX(0, x0 - DUAL_BORDER);
+        const int by0 = MAX(0, y0 - DUAL_BORDER);
+        const int tw = MIN(width, x1 + DUAL_BORDER) - bx0;
+        const int th = MIN(height, y1 + DUAL_BORDER) - by0;
+        float *const raw = dt_get_perthread(raw_tiles, raw_padded);
+        float *const vng = dt_get_perthread(vng_tiles, vng_padded);
+
+        for(int row = 0; row < th; row++)
+          memcpy(raw + (size_t)row * tw, raw_data + (size_t)(row + by0) * width + bx0, sizeof(float) * tw);
+
+        // keep the position in the sensor pattern
+        const dt_iop_roi_t tile_in = { .x = roi_in->x + bx0, .y = roi_in->y + by0, .width = tw, .height = th, .scale = 1.0f };
+        const dt_iop_roi_t tile_out = { .x = 0, .y = 0, .width = tw, .height = th, .scale = 1.0f };
+        vng_interpolate(vng, raw, &tile_out, &tile_in, filters, xtrans, FALSE);
+        color_smoothing(vng, &tile_out, 2);
+
+        for(int row = y0; row < y1; row++)
+          for(int col = x0; col < x1; col++)
+          {
+            const size_t idx = (size_t)row * width + col;
+            const float *const low = vng + 4 * ((size_t)(row - by0) * tw + col - bx0);
+            for(int c = 0; c < 4; c++)
+              rgb_data[4 * idx + c] = intp(blend[idx], rgb_data[4 * idx + c], low[c]);
+          }
+      }
   }
   if(info)
   {
     dt_get_times(&end_blend);
-    fprintf(stderr," [demosaic] CPU dual blending %.4f secs (%.4f CPU)\n", end_blend.clock - start_blend.clock, end_blend.user - start_blend.user);
+    fprintf(stderr," [demosaic] CPU dual blending %.4f secs (%.4f CPU), %i of %i tiles without vng\n",
+            end_blend.clock - start_blend.clock, end_blend.user - start_blend.user, skipped, tiles_x * tiles_y);
   }
   dt_free_align(tmp);
   dt_free_align(blend);
-  dt_free_align(vng_image);
+  if(raw_tiles) dt_free_align(raw_tiles);
+  if(vng_tiles) dt_free_align(vng_tiles);
 }
+#undef DUAL_TILE
+#undef DUAL_BORDER
+#undef DUAL_BLEND_HIGH
 
 #ifdef HAVE_OPENCL
 gboolean dual_demosaic_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem detail, cl_mem blend, cl_mem high_image, cl_mem low_image, cl_mem out, const int width, const int height, const int showmask)
@@ -472,6 +472,23 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   for(int k = 0; k < 3; k++) piece->pipe->dsc.processed_maximum[k] *= d->scale;
 }
 
+void process_pixels_setup(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                          const dt_iop_roi_t *const roi)
+{
+  const dt_iop_exposure_data_t *const d = (const dt_iop_exposure_data_t *const)piece->data;
+  process_common_setup(self, piece);
+  for(int k = 0; k < 3; k++) piece->pipe->dsc.processed_maximum[k] *= d->scale;
+}
+
+void process_pixels(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                    float *const out, const size_t npixels)
+{
+  const dt_iop_exposure_data_t *const d = (const dt_iop_exposure_data_t *const)piece->data;
+  const float black = d->black;
+  const float scale = d->scale;
+  for(size_t k = 0; k < 4 * npixels; k++) out[k] = (in[k] - black) * scale;
+}
+
 
 static float get_exposure_bias(const struct dt_iop_module_t *self)
 {
@@ -511,6 +528,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     d->deflicker = 1;
   }
+
+  // 0 EV without black level correction, nothing to do
+  piece->identity = !d->deflicker && d->params.exposure == 0.0f && d->params.black == 0.0f;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
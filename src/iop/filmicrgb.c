@@ -1185,12 +1185,108 @@ static int get_scales(const dt_iop_roi_t *roi_in, const dt_dev_pixelpipe_iop_t *
   return CLAMP(scales, 1, MAX_NUM_SCALES);
 }
 
+// pixels of the mask below this weight are left virtually untouched by the reconstruction
+#define SPARSE_MASK_THRESHOLD (1.f / 1024.f)
+// OpenCL flags the reconstruction area on a grid of tiles of this size
+#define SPARSE_TILE_SIZE 64
+
+static inline int reconstruction_overlap(const int scales, const int ratios_passes)
+{
+  /* Radius of the neighbourhood a reconstructed pixel depends on :
+   * the low frequencies at scale s are blurred over `2^(s+2) - 2` pixels, the high frequencies get another
+   * 2 pixels of inpainting blur, so the RGB pass spans `2^(scales+1)` pixels, and each pass over ratios
+   * runs on the output of the previous one.
+   */
+  return (1 + ratios_passes) << (scales + 1);
+}
+
+static gboolean sparse_reconstruction_bounds(const int x_min, const int x_max, const int y_min, const int y_max,
+                                             const int overlap, const int width, const int height,
+                                             dt_iop_roi_t *const area)
+{
+  // nothing reaches the threshold, or it's not worth the copies : reconstruct the full frame
+  if(x_max < x_min || y_max < y_min) return FALSE;
+
+  const int x = MAX(x_min - overlap, 0);
+  const int y = MAX(y_min - overlap, 0);
+  const int w = MIN(x_max + overlap + 1, width) - x;
+  const int h = MIN(y_max + overlap + 1, height) - y;
+  if(4 * (size_t)w * h > 3 * (size_t)width * height) return FALSE;
+
+  area->x = x;
+  area->y = y;
+  area->width = w;
+  area->height = h;
+  return TRUE;
+}
+
+static gboolean sparse_reconstruction_area(const float *const restrict mask, const int width, const int height,
+                                           const int overlap, dt_iop_roi_t *const area)
+{
+  /* The reconstruction is blended over the input by the mask, so it only needs to run around the pixels
+   * having a non-negligible mask weight. Since the neighbourhood is at least as large as the wavelets support,
+   * these pixels get exactly the same result as a full frame reconstruction.
+   */
+  int x_min = width, x_max = -1, y_min = height, y_max = -1;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(mask, width, height) \
+  schedule(static) reduction(min : x_min, y_min) reduction(max : x_max, y_max)
+#endif
+  for(int i = 0; i < height; i++)
+  {
+    const float *const restrict row = mask + (size_t)i * width;
+    int first = -1;
+    int last = -1;
+    for(int j = 0; j < width; j++)
+      if(row[j] > SPARSE_MASK_THRESHOLD)
+      {
+        if(first < 0) first = j;
+        last = j;
+      }
+
+    if(first < 0) continue;
+    x_min = MIN(x_min, first);
+    x_max = MAX(x_max, last);
+    y_min = MIN(y_min, i);
+    y_max = MAX(y_max, i);
+  }
+
+  return sparse_reconstruction_bounds(x_min, x_max, y_min, y_max, overlap, width, height, area);
+}
+
+static inline void copy_area(const float *const restrict in, float *const restrict out, const size_t width,
+                             const dt_iop_roi_t *const area, const size_t ch, const gboolean to_area)
+{
+  // copy the area of a full frame buffer to a buffer of the area size, or back
+  const size_t area_width = area->width;
+  const size_t area_height = area->height;
+  const size_t x = area->x;
+  const size_t y = area->y;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, out, width, area_width, area_height, x, y, ch, to_area) \
+  schedule(static)
+#endif
+  for(size_t i = 0; i < area_height; i++)
+  {
+    const size_t frame = ((y + i) * width + x) * ch;
+    const size_t cropped = i * area_width * ch;
+    if(to_area)
+      memcpy(out + cropped, in + frame, sizeof(float) * area_width * ch);
+    else
+      memcpy(out + frame, in + cropped, sizeof(float) * area_width * ch);
+  }
+}
+
+
 
 static inline gint reconstruct_highlights(const float *const restrict in, const float *const restrict mask,
                                           float *const restrict reconstructed,
                                           const dt_iop_filmicrgb_reconstruction_type_t variant, const size_t ch,
                                           const dt_iop_filmicrgb_data_t *const data, dt_dev_pixelpipe_iop_t *piece,
-                                          const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+                                          const dt_iop_roi_t *const roi_in, const size_t width,
+                                          const size_t height)
 {
   gint success = TRUE;
 
@@ -1198,13 +1294,13 @@ static inline gint reconstruct_highlights(const float *const restrict in, const
   const int scales = get_scales(roi_in, piece);
 
   // wavelets scales buffers
-  float *const restrict LF_even = dt_alloc_sse_ps(ch * roi_out->width * roi_out->height); // low-frequencies RGB
-  float *const restrict LF_odd = dt_alloc_sse_ps(ch * roi_out->width * roi_out->height);  // low-frequencies RGB
-  float *const restrict HF_RGB = dt_alloc_sse_ps(ch * roi_out->width * roi_out->height);  // high-frequencies RGB
-  float *const restrict HF_grey = dt_alloc_sse_ps(ch * roi_out->width * roi_out->height); // high-frequencies RGB backup
+  float *const restrict LF_even = dt_alloc_sse_ps(ch * width * height); // low-frequencies RGB
+  float *const restrict LF_odd = dt_alloc_sse_ps(ch * width * height);  // low-frequencies RGB
+  float *const restrict HF_RGB = dt_alloc_sse_ps(ch * width * height);  // high-frequencies RGB
+  float *const restrict HF_grey = dt_alloc_sse_ps(ch * width * height); // high-frequencies RGB backup
 
   // alloc a permanent reusable buffer for intermediate computations - avoid multiple alloc/free
-  float *const restrict temp = dt_alloc_sse_ps(dt_get_num_threads() * ch * roi_out->width);
+  float *const restrict temp = dt_alloc_sse_ps(dt_get_num_threads() * ch * width);
 
   if(!LF_even || !LF_odd || !HF_RGB || !HF_grey || !temp)
   {
@@ -1214,7 +1310,7 @@ static inline gint reconstruct_highlights(const float *const restrict in, const
   }
 
   // Init reconstructed with valid parts of image
-  init_reconstruct(in, mask, reconstructed, roi_out->width, roi_out->height);
+  init_reconstruct(in, mask, reconstructed, width, height);
 
   // structure inpainting vs. texture duplicating weight
   const float gamma = (data->reconstruct_structure_vs_texture);
@@ -1261,21 +1357,21 @@ static inline gint reconstruct_highlights(const float *const restrict in, const
     const int mult = 1 << s; // fancy-pants C notation for 2^s with integer type, don't be afraid
 
     // Compute wavelets low-frequency scales
-    blur_2D_Bspline(detail, LF, temp, roi_out->width, roi_out->height, mult);
+    blur_2D_Bspline(detail, LF, temp, width, height, mult);
 
     // Compute wavelets high-frequency scales and save the minimum of texture over the RGB channels
     // Note : HF_RGB = detail - LF, HF_grey = max(HF_RGB)
-    wavelets_detail_level(detail, LF, HF_RGB_temp, HF_grey, roi_out->width, roi_out->height, ch);
+    wavelets_detail_level(detail, LF, HF_RGB_temp, HF_grey, width, height, ch);
 
     // interpolate/blur/inpaint (same thing) the RGB high-frequency to fill holes
-    blur_2D_Bspline(HF_RGB_temp, HF_RGB, temp, roi_out->width, roi_out->height, 1);
+    blur_2D_Bspline(HF_RGB_temp, HF_RGB, temp, width, height, 1);
 
     // Reconstruct clipped parts
     if(variant == DT_FILMIC_RECONSTRUCT_RGB)
-      wavelets_reconstruct_RGB(HF_RGB, LF, HF_grey, mask, reconstructed, roi_out->width, roi_out->height, ch,
+      wavelets_reconstruct_RGB(HF_RGB, LF, HF_grey, mask, reconstructed, width, height, ch,
                                gamma, gamma_comp, beta, beta_comp, delta, s, scales);
     else if(variant == DT_FILMIC_RECONSTRUCT_RATIOS)
-      wavelets_reconstruct_ratios(HF_RGB, LF, HF_grey, mask, reconstructed, roi_out->width, roi_out->height, ch,
+      wavelets_reconstruct_ratios(HF_RGB, LF, HF_grey, mask, reconstructed, width, height, ch,
                                gamma, gamma_comp, beta, beta_comp, delta, s, scales);
   }
 
@@ -1289,6 +1385,7 @@ error:
 }
 
 
+__DT_CLONE_TARGETS__
 static inline void filmic_split_v1(const float *const restrict in, float *const restrict out,
                                    const dt_iop_order_iccprofile_info_t *const work_profile,
                                    const dt_iop_filmicrgb_data_t *const data,
@@ -1331,6 +1428,7 @@ static inline void filmic_split_v1(const float *const restrict in, float *const
 }
 
 
+__DT_CLONE_TARGETS__
 static inline void filmic_split_v2_v3(const float *const restrict in, float *const restrict out,
                                       const dt_iop_order_iccprofile_info_t *const work_profile,
                                       const dt_iop_filmicrgb_data_t *const data,
@@ -1373,6 +1471,7 @@ static inline void filmic_split_v2_v3(const float *const restrict in, float *con
 }
 
 
+__DT_CLONE_TARGETS__
 static inline void filmic_chroma_v1(const float *const restrict in, float *const restrict out,
                                     const dt_iop_order_iccprofile_info_t *const work_profile,
                                     const dt_iop_filmicrgb_data_t *const data,
@@ -1428,6 +1527,7 @@ static inline void filmic_chroma_v1(const float *const restrict in, float *const
 }
 
 
+__DT_CLONE_TARGETS__
 static inline void filmic_chroma_v2_v3(const float *const restrict in, float *const restrict out,
                                        const dt_iop_order_iccprofile_info_t *const work_profile,
                                        const dt_iop_filmicrgb_data_t *const data,
@@ -1620,34 +1720,75 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
   // if fast mode is not in use
   if(!run_fast && recover_highlights && mask && reconstructed)
   {
+    // restrict the reconstruction to the neighbourhood of the clipped areas when it's worth it
+    const int overlap = reconstruction_overlap(get_scales(roi_in, piece), data->high_quality_reconstruction);
+    dt_iop_roi_t area = { 0, 0, roi_out->width, roi_out->height, roi_out->scale };
+    gboolean sparse = sparse_reconstruction_area(mask, roi_out->width, roi_out->height, overlap, &area);
+    const size_t npixels = (size_t)area.width * area.height;
+
     // init the blown areas with noise to create particles
+    // it's done over the full frame so the noise doesn't depend on the reconstruction area
     float *const restrict inpainted =  dt_alloc_align_float((size_t)roi_out->width * roi_out->height * 4);
     inpaint_noise(in, mask, inpainted, data->noise_level / scale, data->reconstruct_threshold, data->noise_distribution,
                   roi_out->width, roi_out->height);
 
+    float *restrict area_inpainted = inpainted;
+    float *restrict area_mask = mask;
+    float *restrict area_reconstructed = reconstructed;
+
+    if(sparse)
+    {
+      area_inpainted = dt_alloc_align_float(npixels * 4);
+      area_mask = dt_alloc_align_float(npixels);
+      area_reconstructed = dt_alloc_align_float(npixels * 4);
+
+      if(area_inpainted && area_mask && area_reconstructed)
+      {
+        copy_area(inpainted, area_inpainted, roi_out->width, &area, 4, TRUE);
+        copy_area(mask, area_mask, roi_out->width, &area, 1, TRUE);
+      }
+      else
+      {
+        // fall back to the full frame
+        if(area_inpainted) dt_free_align(area_inpainted);
+        if(area_mask) dt_free_align(area_mask);
+        if(area_reconstructed) dt_free_align(area_reconstructed);
+        area_inpainted = inpainted;
+        area_mask = mask;
+        area_reconstructed = reconstructed;
+        area.x = area.y = 0;
+        area.width = roi_out->width;
+        area.height = roi_out->height;
+        sparse = FALSE;
+      }
+    }
+
     // diffuse particles with wavelets reconstruction
     // PASS 1 on RGB channels
-    const gint success_1 = reconstruct_highlights(inpainted, mask, reconstructed, DT_FILMIC_RECONSTRUCT_RGB, ch, data, piece, roi_in, roi_out);
+    const gint success_1 = reconstruct_highlights(area_inpainted, area_mask, area_reconstructed,
+                                                  DT_FILMIC_RECONSTRUCT_RGB, ch, data, piece, roi_in, area.width,
+                                                  area.height);
     gint success_2 = TRUE;
 
     dt_free_align(inpainted);
+    if(sparse) dt_free_align(area_inpainted);
 
     if(data->high_quality_reconstruction > 0 && success_1)
     {
-      float *const restrict norms = dt_alloc_align_float((size_t)roi_out->width * roi_out->height);
-      float *const restrict ratios = dt_alloc_align_float((size_t)roi_out->width * roi_out->height * 4);
+      float *const restrict norms = dt_alloc_align_float((size_t)area.width * area.height);
+      float *const restrict ratios = dt_alloc_align_float((size_t)area.width * area.height * 4);
 
       // reconstruct highlights PASS 2 on ratios
       if(norms && ratios)
       {
         for(int i = 0; i < data->high_quality_reconstruction; i++)
         {
-          compute_ratios(reconstructed, norms, ratios, work_profile, DT_FILMIC_METHOD_EUCLIDEAN_NORM_V1,
-                         roi_out->width, roi_out->height);
+          compute_ratios(area_reconstructed, norms, ratios, work_profile, DT_FILMIC_METHOD_EUCLIDEAN_NORM_V1,
+                         area.width, area.height);
           success_2 = success_2
-                      && reconstruct_highlights(ratios, mask, reconstructed, DT_FILMIC_RECONSTRUCT_RATIOS, ch,
-                                                data, piece, roi_in, roi_out);
-          restore_ratios(reconstructed, norms, roi_out->width, roi_out->height);
+                      && reconstruct_highlights(ratios, area_mask, area_reconstructed, DT_FILMIC_RECONSTRUCT_RATIOS,
+                                                ch, data, piece, roi_in, area.width, area.height);
+          restore_ratios(area_reconstructed, norms, area.width, area.height);
         }
       }
 
@@ -1655,6 +1796,18 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
       if(ratios) dt_free_align(ratios);
     }
 
+    if(sparse)
+    {
+      // outside of the area, the mask is too low for the reconstruction to be visible
+      if(success_1 && success_2)
+      {
+        dt_iop_image_copy_by_size(reconstructed, in, roi_out->width, roi_out->height, 4);
+        copy_area(area_reconstructed, reconstructed, roi_out->width, &area, 4, FALSE);
+      }
+      dt_free_align(area_mask);
+      dt_free_align(area_reconstructed);
+    }
+
     if(success_1 && success_2) in = reconstructed; // use reconstructed buffer as tonemapping input
   }
 
@@ -1689,12 +1842,10 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 static inline cl_int reconstruct_highlights_cl(cl_mem in, cl_mem mask, cl_mem reconstructed,
                                           const dt_iop_filmicrgb_reconstruction_type_t variant, dt_iop_filmicrgb_global_data_t *const gd,
                                           const dt_iop_filmicrgb_data_t *const data, dt_dev_pixelpipe_iop_t *piece,
-                                          const dt_iop_roi_t *const roi_in)
+                                          const dt_iop_roi_t *const roi_in, const int width, const int height)
 {
   cl_int err = -999;
   const int devid = piece->pipe->devid;
-  const int width = roi_in->width;
-  const int height = roi_in->height;
   size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
 
   // wavelets scales
@@ -1869,6 +2020,10 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   cl_mem mask = NULL;
   cl_mem ratios = NULL;
   cl_mem norms = NULL;
+  cl_mem area_inpainted = NULL;
+  cl_mem area_mask = NULL;
+  cl_mem area_reconstructed = NULL;
+  cl_mem tiles = NULL;
 
   // fetch working color profile
   const dt_iop_order_iccprofile_info_t *const work_profile = dt_ioppr_get_pipe_work_profile_info(piece->pipe);
@@ -1889,6 +2044,26 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   uint16_t is_clipped = 0;
   cl_mem clipped = dt_opencl_alloc_device(devid, 1, 1, sizeof(uint16_t));
 
+  // flags of the tiles having a non-negligible mask weight
+  const int tiles_width = (width + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+  const int tiles_height = (height + SPARSE_TILE_SIZE - 1) / SPARSE_TILE_SIZE;
+  const int tile_size = SPARSE_TILE_SIZE;
+  const float sparse_threshold = SPARSE_MASK_THRESHOLD;
+  uint16_t *const tile_flags = calloc((size_t)tiles_width * tiles_height, sizeof(uint16_t));
+  tiles = dt_opencl_alloc_device(devid, tiles_width, tiles_height, sizeof(uint16_t));
+  if(!tile_flags || !tiles)
+  {
+    free(tile_flags);
+    err = CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    goto error;
+  }
+  err = dt_opencl_write_host_to_device(devid, tile_flags, tiles, tiles_width, tiles_height, sizeof(uint16_t));
+  if(err != CL_SUCCESS)
+  {
+    free(tile_flags);
+    goto error;
+  }
+
   // build a mask of clipped pixels
   mask = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(float));
   dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_mask, 0, sizeof(cl_mem), (void *)&in);
@@ -1898,14 +2073,40 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_mask, 4, sizeof(float), (void *)&d->normalize);
   dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_mask, 5, sizeof(float), (void *)&d->reconstruct_feather);
   dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_mask, 6, sizeof(cl_mem), (void *)&clipped);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_mask, 7, sizeof(cl_mem), (void *)&tiles);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_mask, 8, sizeof(int), (void *)&tile_size);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_mask, 9, sizeof(float), (void *)&sparse_threshold);
   err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_filmic_mask, sizes);
-  if(err != CL_SUCCESS) goto error;
+  if(err != CL_SUCCESS)
+  {
+    free(tile_flags);
+    goto error;
+  }
 
   // read the number of clipped pixels
   dt_opencl_copy_device_to_host(devid, &is_clipped, clipped, 1, 1, sizeof(uint16_t));
   dt_opencl_release_mem_object(clipped);
   clipped = NULL;
 
+  // read the flagged tiles and get their bounding box in pixels
+  int x_min = width, x_max = -1, y_min = height, y_max = -1;
+  err = dt_opencl_copy_device_to_host(devid, tile_flags, tiles, tiles_width, tiles_height, sizeof(uint16_t));
+  dt_opencl_release_mem_object(tiles);
+  tiles = NULL;
+  if(err == CL_SUCCESS)
+  {
+    for(int i = 0; i < tiles_height; i++)
+      for(int j = 0; j < tiles_width; j++)
+      {
+        if(!tile_flags[(size_t)i * tiles_width + j]) continue;
+        x_min = MIN(x_min, j * SPARSE_TILE_SIZE);
+        x_max = MAX(x_max, MIN((j + 1) * SPARSE_TILE_SIZE, width) - 1);
+        y_min = MIN(y_min, i * SPARSE_TILE_SIZE);
+        y_max = MAX(y_max, MIN((i + 1) * SPARSE_TILE_SIZE, height) - 1);
+      }
+  }
+  free(tile_flags);
+
   // display mask and exit
   if(self->dev->gui_attached && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
   {
@@ -1928,7 +2129,13 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   if(!run_fast && is_clipped > 0)
   {
+    // restrict the reconstruction to the neighbourhood of the clipped areas when it's worth it
+    const int overlap = reconstruction_overlap(get_scales(roi_in, piece), d->high_quality_reconstruction);
+    dt_iop_roi_t area = { 0, 0, width, height, roi_in->scale };
+    gboolean sparse = sparse_reconstruction_bounds(x_min, x_max, y_min, y_max, overlap, width, height, &area);
+
     // Inpaint noise
+    // it's done over the full frame so the noise doesn't depend on the reconstruction area
     const float noise_level = d->noise_level / scale;
     inpainted = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(float) * 4);
     dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_inpaint_noise, 0, sizeof(cl_mem), (void *)&in);
@@ -1942,43 +2149,84 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_filmic_inpaint_noise, sizes);
     if(err != CL_SUCCESS) goto error;
 
-    // first step of highlight reconstruction in RGB
     reconstructed = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(float) * 4);
-    err = reconstruct_highlights_cl(inpainted, mask, reconstructed, DT_FILMIC_RECONSTRUCT_RGB, gd, d, piece, roi_in);
+
+    if(sparse)
+    {
+      area_inpainted = dt_opencl_alloc_device(devid, area.width, area.height, sizeof(float) * 4);
+      area_mask = dt_opencl_alloc_device(devid, area.width, area.height, sizeof(float));
+      area_reconstructed = dt_opencl_alloc_device(devid, area.width, area.height, sizeof(float) * 4);
+
+      if(area_inpainted && area_mask && area_reconstructed)
+      {
+        size_t origin[] = { area.x, area.y, 0 };
+        size_t area_origin[] = { 0, 0, 0 };
+        size_t region[] = { area.width, area.height, 1 };
+        err = dt_opencl_enqueue_copy_image(devid, inpainted, area_inpainted, origin, area_origin, region);
+        if(err != CL_SUCCESS) goto error;
+        err = dt_opencl_enqueue_copy_image(devid, mask, area_mask, origin, area_origin, region);
+        if(err != CL_SUCCESS) goto error;
+      }
+      else
+      {
+        // fall back to the full frame
+        dt_opencl_release_mem_object(area_inpainted);
+        dt_opencl_release_mem_object(area_mask);
+        dt_opencl_release_mem_object(area_reconstructed);
+        area_inpainted = area_mask = area_reconstructed = NULL;
+        area.x = area.y = 0;
+        area.width = width;
+        area.height = height;
+        sparse = FALSE;
+      }
+    }
+
+    cl_mem rec_in = sparse ? area_inpainted : inpainted;
+    cl_mem rec_mask = sparse ? area_mask : mask;
+    cl_mem rec_out = sparse ? area_reconstructed : reconstructed;
+    const int rec_width = area.width;
+    const int rec_height = area.height;
+    size_t rec_sizes[] = { ROUNDUPWD(rec_width), ROUNDUPHT(rec_height), 1 };
+
+    // first step of highlight reconstruction in RGB
+    err = reconstruct_highlights_cl(rec_in, rec_mask, rec_out, DT_FILMIC_RECONSTRUCT_RGB, gd, d, piece, roi_in,
+                                    rec_width, rec_height);
     if(err != CL_SUCCESS) goto error;
     dt_opencl_release_mem_object(inpainted);
-    inpainted = NULL;
+    dt_opencl_release_mem_object(area_inpainted);
+    inpainted = area_inpainted = NULL;
 
     if(d->high_quality_reconstruction > 0)
     {
-      ratios = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(float) * 4);
-      norms = dt_opencl_alloc_device(devid, sizes[0], sizes[1], sizeof(float));
+      ratios = dt_opencl_alloc_device(devid, rec_sizes[0], rec_sizes[1], sizeof(float) * 4);
+      norms = dt_opencl_alloc_device(devid, rec_sizes[0], rec_sizes[1], sizeof(float));
 
       if(norms && ratios)
       {
         for(int i = 0; i < d->high_quality_reconstruction; i++)
         {
           // break ratios and norms
-          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 0, sizeof(cl_mem), (void *)&reconstructed);
+          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 0, sizeof(cl_mem), (void *)&rec_out);
           dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 1, sizeof(cl_mem), (void *)&norms);
           dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 2, sizeof(cl_mem), (void *)&ratios);
           dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 3, sizeof(int), (void *)&d->preserve_color);
-          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 4, sizeof(int), (void *)&width);
-          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 5, sizeof(int), (void *)&height);
-          err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_filmic_compute_ratios, sizes);
+          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 4, sizeof(int), (void *)&rec_width);
+          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_compute_ratios, 5, sizeof(int), (void *)&rec_height);
+          err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_filmic_compute_ratios, rec_sizes);
           if(err != CL_SUCCESS) goto error;
 
           // second step of reconstruction over ratios
-          err = reconstruct_highlights_cl(ratios, mask, reconstructed, DT_FILMIC_RECONSTRUCT_RATIOS, gd, d, piece, roi_in);
+          err = reconstruct_highlights_cl(ratios, rec_mask, rec_out, DT_FILMIC_RECONSTRUCT_RATIOS, gd, d, piece,
+                                          roi_in, rec_width, rec_height);
           if(err != CL_SUCCESS) goto error;
 
           // restore ratios to RGB
-          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 0, sizeof(cl_mem), (void *)&reconstructed);
+          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 0, sizeof(cl_mem), (void *)&rec_out);
           dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 1, sizeof(cl_mem), (void *)&norms);
-          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 2, sizeof(cl_mem), (void *)&reconstructed);
-          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 3, sizeof(int), (void *)&width);
-          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 4, sizeof(int), (void *)&height);
-          err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_filmic_restore_ratios, sizes);
+          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 2, sizeof(cl_mem), (void *)&rec_out);
+          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 3, sizeof(int), (void *)&rec_width);
+          dt_opencl_set_kernel_arg(devid, gd->kernel_filmic_restore_ratios, 4, sizeof(int), (void *)&rec_height);
+          err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_filmic_restore_ratios, rec_sizes);
           if(err != CL_SUCCESS) goto error;
         }
       }
@@ -1989,6 +2237,22 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
       norms = NULL;
     }
 
+    if(sparse)
+    {
+      // outside of the area, the mask is too low for the reconstruction to be visible
+      size_t origin[] = { 0, 0, 0 };
+      size_t area_origin[] = { area.x, area.y, 0 };
+      size_t frame[] = { width, height, 1 };
+      size_t region[] = { area.width, area.height, 1 };
+      err = dt_opencl_enqueue_copy_image(devid, dev_in, reconstructed, origin, origin, frame);
+      if(err != CL_SUCCESS) goto error;
+      err = dt_opencl_enqueue_copy_image(devid, area_reconstructed, reconstructed, origin, area_origin, region);
+      if(err != CL_SUCCESS) goto error;
+      dt_opencl_release_mem_object(area_mask);
+      dt_opencl_release_mem_object(area_reconstructed);
+      area_mask = area_reconstructed = NULL;
+    }
+
     in = reconstructed;
   }
 
@@ -2070,6 +2334,10 @@ error:
   dt_opencl_release_mem_object(mask);
   dt_opencl_release_mem_object(ratios);
   dt_opencl_release_mem_object(norms);
+  dt_opencl_release_mem_object(area_inpainted);
+  dt_opencl_release_mem_object(area_mask);
+  dt_opencl_release_mem_object(area_reconstructed);
+  dt_opencl_release_mem_object(tiles);
   dt_print(DT_DEBUG_OPENCL, "[opencl_filmicrgb] couldn't enqueue kernel! %d\n", err);
   return FALSE;
 }
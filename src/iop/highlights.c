@@ -70,6 +70,7 @@ typedef struct dt_iop_highlights_global_data_t
   int kernel_highlights_1f_lch_bayer;
   int kernel_highlights_1f_lch_xtrans;
   int kernel_highlights_4f_clip;
+  int kernel_highlights_1f_inpaint_bayer;
 } dt_iop_highlights_global_data_t;
 
 
@@ -124,6 +125,8 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
   cl_int err = -999;
   cl_mem dev_xtrans = NULL;
+  cl_mem dev_tmp1 = NULL;
+  cl_mem dev_tmp2 = NULL;
 
   const int devid = piece->pipe->devid;
   const int width = roi_in->width;
@@ -216,6 +219,39 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     err = dt_opencl_enqueue_kernel_2d_with_local(devid, gd->kernel_highlights_1f_lch_xtrans, sizes, local);
     if(err != CL_SUCCESS) goto error;
   }
+  else if(d->mode == DT_IOP_HIGHLIGHTS_INPAINT && filters != 9u)
+  {
+    // bayer sensor raws with color inpainting: left/right and up/down passes of one line per work item,
+    // accumulating in ping-pong buffers as images can't be read and written at once
+    const float clips[4] = { 0.987f * d->clip * piece->pipe->dsc.processed_maximum[0],
+                             0.987f * d->clip * piece->pipe->dsc.processed_maximum[1],
+                             0.987f * d->clip * piece->pipe->dsc.processed_maximum[2], clip };
+    dev_tmp1 = dt_opencl_alloc_device(devid, width, height, sizeof(float));
+    dev_tmp2 = dt_opencl_alloc_device(devid, width, height, sizeof(float));
+    if(dev_tmp1 == NULL || dev_tmp2 == NULL) goto error;
+
+    const cl_mem acc_in[4] = { dev_in, dev_tmp1, dev_tmp2, dev_tmp1 };
+    const cl_mem acc_out[4] = { dev_tmp1, dev_tmp2, dev_tmp1, dev_out };
+    for(int pass = 0; pass < 4; pass++)
+    {
+      const int dim = pass / 2;
+      const int dir = (pass & 1) ? -1 : 1;
+      size_t sizes[] = { ROUNDUPWD(dim ? width : height), 1, 1 };
+      const int kernel = gd->kernel_highlights_1f_inpaint_bayer;
+      dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), (void *)&dev_in);
+      dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(cl_mem), (void *)&acc_in[pass]);
+      dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(cl_mem), (void *)&acc_out[pass]);
+      dt_opencl_set_kernel_arg(devid, kernel, 3, sizeof(int), (void *)&width);
+      dt_opencl_set_kernel_arg(devid, kernel, 4, sizeof(int), (void *)&height);
+      dt_opencl_set_kernel_arg(devid, kernel, 5, 4 * sizeof(float), (void *)&clips);
+      dt_opencl_set_kernel_arg(devid, kernel, 6, sizeof(uint32_t), (void *)&filters);
+      dt_opencl_set_kernel_arg(devid, kernel, 7, sizeof(int), (void *)&dim);
+      dt_opencl_set_kernel_arg(devid, kernel, 8, sizeof(int), (void *)&dir);
+      dt_opencl_set_kernel_arg(devid, kernel, 9, sizeof(int), (void *)&pass);
+      err = dt_opencl_enqueue_kernel_2d(devid, kernel, sizes);
+      if(err != CL_SUCCESS) goto error;
+    }
+  }
 
   // update processed maximum
   const float m = fmaxf(fmaxf(piece->pipe->dsc.processed_maximum[0], piece->pipe->dsc.processed_maximum[1]),
@@ -223,10 +259,14 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   for(int k = 0; k < 3; k++) piece->pipe->dsc.processed_maximum[k] = m;
 
   dt_opencl_release_mem_object(dev_xtrans);
+  dt_opencl_release_mem_object(dev_tmp1);
+  dt_opencl_release_mem_object(dev_tmp2);
   return TRUE;
 
 error:
   dt_opencl_release_mem_object(dev_xtrans);
+  dt_opencl_release_mem_object(dev_tmp1);
+  dt_opencl_release_mem_object(dev_tmp2);
   dt_print(DT_DEBUG_OPENCL, "[opencl_highlights] couldn't enqueue kernel! %d\n", err);
   return FALSE;
 }
@@ -256,6 +296,8 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
     tiling->xalign = 2;
     tiling->yalign = 2;
     tiling->overlap = (d->mode == DT_IOP_HIGHLIGHTS_LCH) ? 1 : 0;
+    // the OpenCL color inpainting accumulates in two more buffers
+    if(d->mode == DT_IOP_HIGHLIGHTS_INPAINT) tiling->factor_cl = 4.0f;
   }
   else
   {
@@ -520,6 +562,93 @@ static inline void interpolate_color(const void *const ivoid, void *const ovoid,
   }
 }
 
+// the directional passes only change clipped pixels inside the border and leave a copy of the input
+// everywhere else. so the input is copied once and only rows and columns with clipped pixels are walked,
+// which gives exactly the same result as walking all of them.
+static void process_inpaint_bayer(const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_out,
+                                  const float *const clips, const uint32_t filters)
+{
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const float *const in = (const float *)ivoid;
+  uint8_t *const rows = calloc(height, sizeof(uint8_t));
+  uint8_t *const cols = calloc(width, sizeof(uint8_t));
+
+  if(rows && cols)
+  {
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(in, rows, width, height, clips, filters) \
+    schedule(static)
+#endif
+    for(int j = 1; j < height - 1; j++)
+    {
+      const float *const row = in + (size_t)j * width;
+      for(int i = 1; i < width - 1; i++)
+      {
+        if(row[i] >= clips[FC(j, i, filters)] - 1e-5f)
+        {
+          rows[j] = 1;
+          break;
+        }
+      }
+    }
+    // only the rows with clipped pixels can have them in any column
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(in, rows, cols, width, height, clips, filters) \
+    schedule(static)
+#endif
+    for(int i = 1; i < width - 1; i++)
+    {
+      for(int j = 1; j < height - 1; j++)
+      {
+        if(rows[j] && in[(size_t)j * width + i] >= clips[FC(j, i, filters)] - 1e-5f)
+        {
+          cols[i] = 1;
+          break;
+        }
+      }
+    }
+    dt_iop_image_copy_by_size((float *)ovoid, in, width, height, 1);
+  }
+  else
+  {
+    // no memory for the flags, walk everything
+    if(rows) memset(rows, 1, height);
+    if(cols) memset(cols, 1, width);
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out, rows, height) \
+  schedule(dynamic, 16)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    if(rows && !rows[j]) continue;
+    interpolate_color(ivoid, ovoid, roi_out, 0, 1, j, clips, filters, 0);
+    interpolate_color(ivoid, ovoid, roi_out, 0, -1, j, clips, filters, 1);
+  }
+
+// up/down directions
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out, rows, cols, width) \
+  schedule(dynamic, 16)
+#endif
+  for(int i = 0; i < width; i++)
+  {
+    // the last pass also writes the unclipped pixels, needed unless the input was copied
+    if(rows && cols && !cols[i]) continue;
+    interpolate_color(ivoid, ovoid, roi_out, 1, 1, i, clips, filters, 2);
+    interpolate_color(ivoid, ovoid, roi_out, 1, -1, i, clips, filters, 3);
+  }
+
+  free(rows);
+  free(cols);
+}
+
 /*
  * these 2 constants were computed using following Sage code:
  *
@@ -857,32 +986,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
         }
       }
       else
-      {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-        dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out) \
-        shared(data, piece) \
-        schedule(static)
-#endif
-        for(int j = 0; j < roi_out->height; j++)
-        {
-          interpolate_color(ivoid, ovoid, roi_out, 0, 1, j, clips, filters, 0);
-          interpolate_color(ivoid, ovoid, roi_out, 0, -1, j, clips, filters, 1);
-        }
-
-// up/down directions
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-        dt_omp_firstprivate(clips, filters, ivoid, ovoid, roi_out) \
-        shared(data, piece) \
-        schedule(static)
-#endif
-        for(int i = 0; i < roi_out->width; i++)
-        {
-          interpolate_color(ivoid, ovoid, roi_out, 1, 1, i, clips, filters, 2);
-          interpolate_color(ivoid, ovoid, roi_out, 1, -1, i, clips, filters, 3);
-        }
-      }
+        process_inpaint_bayer(ivoid, ovoid, roi_out, clips, filters);
       break;
     }
     case DT_IOP_HIGHLIGHTS_LCH:
@@ -914,8 +1018,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   piece->process_cl_ready = 1;
 
-  // no OpenCL for DT_IOP_HIGHLIGHTS_INPAINT yet.
-  if(d->mode == DT_IOP_HIGHLIGHTS_INPAINT) piece->process_cl_ready = 0;
+  // no OpenCL for DT_IOP_HIGHLIGHTS_INPAINT on xtrans yet.
+  if(d->mode == DT_IOP_HIGHLIGHTS_INPAINT && pipe->image.buf_dsc.filters == 9u) piece->process_cl_ready = 0;
 }
 
 void init_global(dt_iop_module_so_t *module)
@@ -928,11 +1032,13 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_highlights_1f_lch_bayer = dt_opencl_create_kernel(program, "highlights_1f_lch_bayer");
   gd->kernel_highlights_1f_lch_xtrans = dt_opencl_create_kernel(program, "highlights_1f_lch_xtrans");
   gd->kernel_highlights_4f_clip = dt_opencl_create_kernel(program, "highlights_4f_clip");
+  gd->kernel_highlights_1f_inpaint_bayer = dt_opencl_create_kernel(program, "highlights_1f_inpaint_bayer");
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
 {
   dt_iop_highlights_global_data_t *gd = (dt_iop_highlights_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_highlights_1f_inpaint_bayer);
   dt_opencl_free_kernel(gd->kernel_highlights_4f_clip);
   dt_opencl_free_kernel(gd->kernel_highlights_1f_lch_bayer);
   dt_opencl_free_kernel(gd->kernel_highlights_1f_lch_xtrans);
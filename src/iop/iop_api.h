@@ -187,6 +187,16 @@ DEFAULT(void, process_tiling, struct dt_iop_module_t *self, struct dt_dev_pixelp
                                void *const o, const struct dt_iop_roi_t *const roi_in,
                                const struct dt_iop_roi_t *const roi_out, const int bpp);
 
+/** a point-wise variant of process() for modules where each output pixel only depends on the same
+  * input pixel. in and out hold npixels pixels of 4 floats each and might be the same buffer.
+  * consecutive modules providing it are run in one pass over small parts of the image, so it is
+  * called from several threads at once and must not modify piece. */
+OPTIONAL(void, process_pixels, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                               const float *const in, float *const out, const size_t npixels);
+/** called once per pipe run before process_pixels(), does what process() does besides the pixels. */
+OPTIONAL(void, process_pixels_setup, struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                     const struct dt_iop_roi_t *const roi);
+
 #if defined(__SSE__)
 /** a variant process(), that can contain SSE2 intrinsics. */
 /** can be provided by each IOP. */
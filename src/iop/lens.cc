@@ -26,6 +26,7 @@ extern "C" {
 #include "common/file_location.h"
 #include "common/imagebuf.h"
 #include "common/opencl.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -124,8 +125,26 @@ typedef struct dt_iop_lensfun_global_data_t
   int kernel_lens_distort_lanczos2;
   int kernel_lens_distort_lanczos3;
   int kernel_lens_vignette;
+  int kernel_lens_mesh;
+  // distortion maps shared by all pipes, most recently used first
+  dt_pthread_mutex_t map_lock;
+  GList *maps;
+  size_t map_bytes;
 } dt_iop_lensfun_global_data_t;
 
+// a distortion map holds what ApplySubpixelGeometryDistortion returns for a roi: red, green and blue
+// coordinates for each pixel, as fixed point offsets from the pixel itself.
+#define LENS_MAP_ONE 64.0f
+#define LENS_MAP_INVALID INT16_MIN
+
+typedef struct dt_iop_lensfun_map_t
+{
+  gchar *key;
+  int users;
+  size_t size;
+  int16_t *offsets; // NULL if the distortion doesn't fit, so we don't try again
+} dt_iop_lensfun_map_t;
+
 typedef struct dt_iop_lensfun_data_t
 {
   lfLens *lens;
@@ -140,6 +159,7 @@ typedef struct dt_iop_lensfun_data_t
   gboolean do_nan_checks;
   gboolean tca_override;
   lfLensCalibTCA custom_tca;
+  gchar *map_key; // all of the above that goes into a distortion map
 } dt_iop_lensfun_data_t;
 
 
@@ -367,6 +387,160 @@ static lfModifier * get_modifier(int *mods_done, int w, int h, const dt_iop_lens
   return mod;
 }
 
+static void _evict_maps(dt_iop_lensfun_global_data_t *gd, const size_t budget)
+{
+  GList *l = g_list_last(gd->maps);
+  while(l && gd->map_bytes > budget)
+  {
+    GList *prev = g_list_previous(l);
+    dt_iop_lensfun_map_t *map = (dt_iop_lensfun_map_t *)l->data;
+    if(map->users == 0)
+    {
+      gd->map_bytes -= map->size;
+      gd->maps = g_list_delete_link(gd->maps, l);
+      dt_free_align(map->offsets);
+      g_free(map->key);
+      free(map);
+    }
+    l = prev;
+  }
+}
+
+static size_t _map_budget()
+{
+  return (size_t)MAX(0, dt_conf_get_int("plugins/darkroom/lens/map_cache_size")) * 1024 * 1024;
+}
+
+static void _release_map(dt_iop_lensfun_global_data_t *gd, dt_iop_lensfun_map_t *map)
+{
+  if(!map) return;
+  dt_pthread_mutex_lock(&gd->map_lock);
+  map->users--;
+  _evict_maps(gd, _map_budget());
+  dt_pthread_mutex_unlock(&gd->map_lock);
+}
+
+/* the displacements only depend on the lens, its settings and the roi, so darkroom refreshes and exports of a
+   whole shoot keep asking for the same ones. get them from the cache or compute them once, NULL if the map
+   would not fit into the cache. give it back with _release_map(). */
+static dt_iop_lensfun_map_t *_acquire_map(dt_iop_lensfun_global_data_t *gd, const dt_iop_lensfun_data_t *d,
+                                          const lfModifier *modifier, const int mods_filter, const float orig_w,
+                                          const float orig_h, const dt_iop_roi_t *const roi_out)
+{
+  const size_t budget = _map_budget();
+  const size_t size = sizeof(int16_t) * 6 * roi_out->width * roi_out->height;
+  if(!d->map_key || size > budget / 2) return NULL;
+
+  gchar *key = g_strdup_printf("%s|%d|%.9g|%.9g|%d|%d|%d|%d", d->map_key, mods_filter, orig_w, orig_h,
+                               roi_out->x, roi_out->y, roi_out->width, roi_out->height);
+
+  dt_pthread_mutex_lock(&gd->map_lock);
+  for(GList *l = gd->maps; l; l = g_list_next(l))
+  {
+    dt_iop_lensfun_map_t *map = (dt_iop_lensfun_map_t *)l->data;
+    if(!strcmp(map->key, key))
+    {
+      gd->maps = g_list_remove_link(gd->maps, l);
+      gd->maps = g_list_concat(l, gd->maps);
+      map->users++;
+      dt_pthread_mutex_unlock(&gd->map_lock);
+      g_free(key);
+      if(map->offsets) return map;
+      _release_map(gd, map);
+      return NULL;
+    }
+  }
+  dt_pthread_mutex_unlock(&gd->map_lock);
+
+  int16_t *offsets = (int16_t *)dt_alloc_align(64, size);
+  if(!offsets)
+  {
+    g_free(key);
+    return NULL;
+  }
+
+  const size_t bufsize = (size_t)roi_out->width * 2 * 3;
+  size_t padded_bufsize;
+  float *const buf = dt_alloc_perthread_float(bufsize, &padded_bufsize);
+  gboolean fits = TRUE;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(padded_bufsize, roi_out, offsets) \
+  dt_omp_sharedconst(buf) \
+  shared(modifier) \
+  reduction(&&:fits) \
+  schedule(static)
+#endif
+  for(int y = 0; y < roi_out->height; y++)
+  {
+    float *bufptr = (float *)dt_get_perthread(buf, padded_bufsize);
+    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+    int16_t *row = offsets + (size_t)y * roi_out->width * 6;
+    for(int x = 0; x < roi_out->width; x++)
+      for(int c = 0; c < 6; c++)
+      {
+        const float v = bufptr[6 * x + c];
+        if(!isfinite(v))
+        {
+          row[6 * x + c] = LENS_MAP_INVALID;
+          continue;
+        }
+        const float off = roundf((v - (c & 1 ? roi_out->y + y : roi_out->x + x)) * LENS_MAP_ONE);
+        if(off <= LENS_MAP_INVALID || off > INT16_MAX)
+          fits = FALSE;
+        else
+          row[6 * x + c] = off;
+      }
+  }
+  dt_free_align(buf);
+
+  if(!fits)
+  {
+    dt_free_align(offsets);
+    offsets = NULL;
+  }
+
+  dt_iop_lensfun_map_t *map = (dt_iop_lensfun_map_t *)malloc(sizeof(dt_iop_lensfun_map_t));
+  map->key = key;
+  map->users = 1;
+  map->size = offsets ? size : sizeof(dt_iop_lensfun_map_t) + strlen(key);
+  map->offsets = offsets;
+
+  dt_pthread_mutex_lock(&gd->map_lock);
+  gd->maps = g_list_prepend(gd->maps, map);
+  gd->map_bytes += map->size;
+  _evict_maps(gd, budget);
+  dt_pthread_mutex_unlock(&gd->map_lock);
+
+  if(offsets) return map;
+  _release_map(gd, map);
+  return NULL;
+}
+
+// the distorted coordinates of row y of roi_out, from the map if there is one
+static inline void _distortion_row(const dt_iop_lensfun_map_t *map, const lfModifier *modifier,
+                                   const dt_iop_roi_t *const roi_out, const int y, float *const buf)
+{
+  if(!map)
+  {
+    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, buf);
+    return;
+  }
+
+  const int16_t *row = map->offsets + (size_t)y * roi_out->width * 6;
+  const float py = roi_out->y + y;
+  for(int x = 0; x < roi_out->width; x++)
+  {
+    const float px = roi_out->x + x;
+    for(int c = 0; c < 6; c++)
+    {
+      const int16_t off = row[6 * x + c];
+      buf[6 * x + c] = off == LENS_MAP_INVALID ? NAN : (c & 1 ? py : px) + off / LENS_MAP_ONE;
+    }
+  }
+}
+
 /* Why do we care about being a monochrome image or not?
  The lensfun library does not have an algorithm for distortion or tca correction specialized for monochrome images,
    the builtin correction works with subtle differences for the color channels leading to some colorizing of the images.
@@ -382,6 +556,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   const dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->global_data;
   dt_iop_lensfun_gui_data_t *g = (dt_iop_lensfun_gui_data_t *)self->gui_data;
 
   const int ch = piece->colors;
@@ -415,6 +590,8 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     // reverse direction (useful for renderings)
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      dt_iop_lensfun_map_t *map = _acquire_map(gd, d, modifier, used_lf_mask, orig_w, orig_h, roi_out);
+
       // acquire temp memory for distorted pixel coords
       const size_t bufsize = (size_t)roi_out->width * 2 * 3;
 
@@ -423,7 +600,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(padded_bufsize, ch, ch_width, d, interpolation, ivoid, mask_display, ovoid, roi_in, roi_out)	\
+      dt_omp_firstprivate(padded_bufsize, ch, ch_width, d, interpolation, ivoid, mask_display, ovoid, roi_in, roi_out, map)	\
       dt_omp_sharedconst(buf, raw_monochrome) \
       shared(modifier) \
       schedule(static)
@@ -431,7 +608,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
       for(int y = 0; y < roi_out->height; y++)
       {
         float *bufptr = (float*)dt_get_perthread(buf, padded_bufsize);
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+        _distortion_row(map, modifier, roi_out, y, bufptr);
 
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
@@ -472,6 +649,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
         }
       }
       dt_free_align(buf);
+      _release_map(gd, map);
     }
     else
     {
@@ -523,6 +701,8 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      dt_iop_lensfun_map_t *map = _acquire_map(gd, d, modifier, used_lf_mask, orig_w, orig_h, roi_out);
+
       // acquire temp memory for distorted pixel coords
       const size_t buf2size = (size_t)roi_out->width * 2 * 3;
       size_t padded_buf2size;
@@ -530,7 +710,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(padded_buf2size, ch, ch_width, d, interpolation, mask_display, ovoid, roi_in, roi_out) \
+      dt_omp_firstprivate(padded_buf2size, ch, ch_width, d, interpolation, mask_display, ovoid, roi_in, roi_out, map) \
       dt_omp_sharedconst(buf2, raw_monochrome) \
       shared(buf, modifier) \
       schedule(static)
@@ -538,8 +718,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
       for(int y = 0; y < roi_out->height; y++)
       {
         float *buf2ptr = (float*)dt_get_perthread(buf2, padded_buf2size);
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width,
-                                                  1, buf2ptr);
+        _distortion_row(map, modifier, roi_out, y, buf2ptr);
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
         for(int x = 0; x < roi_out->width; x++, buf2ptr += 6, out += ch)
@@ -577,6 +756,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
         }
       }
       dt_free_align(buf2);
+      _release_map(gd, map);
     }
     else
     {
@@ -595,6 +775,88 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 }
 
 #ifdef HAVE_OPENCL
+/* distortion and vignetting are smooth, so the GPU only needs them on a coarse mesh it interpolates to every
+   pixel. this keeps lensfun's work on the host and the transfer to the device small. */
+#define LENS_MESH_STEP 8
+
+static cl_int _mesh_to_device(const int devid, dt_iop_lensfun_global_data_t *gd, float *mesh,
+                              const int mesh_width, const int mesh_height, const int components,
+                              const dt_iop_roi_t *const roi, cl_mem dev_out)
+{
+  cl_mem dev_mesh = (cl_mem)dt_opencl_copy_host_to_device_constant(
+      devid, sizeof(float) * mesh_width * mesh_height * components, mesh);
+  if(dev_mesh == NULL) return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+
+  const int step = LENS_MESH_STEP;
+  size_t sizes[] = { (size_t)ROUNDUPWD(roi->width), (size_t)ROUNDUPHT(roi->height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_lens_mesh, 0, sizeof(cl_mem), (void *)&dev_mesh);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_lens_mesh, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_lens_mesh, 2, sizeof(int), (void *)&roi->width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_lens_mesh, 3, sizeof(int), (void *)&roi->height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_lens_mesh, 4, sizeof(int), (void *)&mesh_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_lens_mesh, 5, sizeof(int), (void *)&step);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_lens_mesh, 6, sizeof(int), (void *)&components);
+  const cl_int err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_lens_mesh, sizes);
+  dt_opencl_release_mem_object(dev_mesh);
+  return err;
+}
+
+// fills dev_out with the distorted coordinates of every pixel of roi, as ApplySubpixelGeometryDistortion does
+static cl_int _distortion_mesh_to_device(const int devid, dt_iop_lensfun_global_data_t *gd,
+                                         const lfModifier *modifier, const dt_iop_roi_t *const roi,
+                                         cl_mem dev_out)
+{
+  const int mesh_width = (roi->width + LENS_MESH_STEP - 1) / LENS_MESH_STEP + 1;
+  const int mesh_height = (roi->height + LENS_MESH_STEP - 1) / LENS_MESH_STEP + 1;
+  float *mesh = dt_alloc_align_float((size_t)mesh_width * mesh_height * 6);
+  if(mesh == NULL) return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(mesh, mesh_width, mesh_height, roi) \
+  shared(modifier) \
+  schedule(static)
+#endif
+  for(int j = 0; j < mesh_height; j++)
+    for(int i = 0; i < mesh_width; i++)
+      modifier->ApplySubpixelGeometryDistortion(roi->x + i * LENS_MESH_STEP, roi->y + j * LENS_MESH_STEP, 1, 1,
+                                                mesh + 6 * ((size_t)j * mesh_width + i));
+
+  const cl_int err = _mesh_to_device(devid, gd, mesh, mesh_width, mesh_height, 6, roi, dev_out);
+  dt_free_align(mesh);
+  return err;
+}
+
+// fills dev_out with the vignetting correction of a pixel at 0.5, for every pixel of roi
+static cl_int _vignette_mesh_to_device(const int devid, dt_iop_lensfun_global_data_t *gd,
+                                       const lfModifier *modifier, const unsigned int pixelformat,
+                                       const dt_iop_roi_t *const roi, cl_mem dev_out)
+{
+  const int mesh_width = (roi->width + LENS_MESH_STEP - 1) / LENS_MESH_STEP + 1;
+  const int mesh_height = (roi->height + LENS_MESH_STEP - 1) / LENS_MESH_STEP + 1;
+  float *mesh = dt_alloc_align_float((size_t)mesh_width * mesh_height * 4);
+  if(mesh == NULL) return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(mesh, mesh_width, mesh_height, pixelformat, roi) \
+  shared(modifier) \
+  schedule(static)
+#endif
+  for(int j = 0; j < mesh_height; j++)
+    for(int i = 0; i < mesh_width; i++)
+    {
+      float *p = mesh + 4 * ((size_t)j * mesh_width + i);
+      for(int k = 0; k < 4; k++) p[k] = 0.5f;
+      modifier->ApplyColorModification(p, roi->x + i * LENS_MESH_STEP, roi->y + j * LENS_MESH_STEP, 1, 1,
+                                       pixelformat, 4);
+    }
+
+  const cl_int err = _mesh_to_device(devid, gd, mesh, mesh_width, mesh_height, 4, roi, dev_out);
+  dt_free_align(mesh);
+  return err;
+}
+
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -665,8 +927,11 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
       return FALSE;
   }
 
-  tmpbuf = (float *)dt_alloc_align(64, tmpbuflen);
-  if(tmpbuf == NULL) goto error;
+  if(d->do_nan_checks)
+  {
+    tmpbuf = (float *)dt_alloc_align(64, tmpbuflen);
+    if(tmpbuf == NULL) goto error;
+  }
 
   dev_tmp = (cl_mem)dt_opencl_alloc_device(devid, width, height, sizeof(float) * 4);
   if(dev_tmp == NULL) goto error;
@@ -683,22 +948,30 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     // reverse direction (useful for renderings)
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      if(d->do_nan_checks)
+      {
+        // invalid coordinates can't be interpolated, compute every pixel on the host
+        dt_iop_lensfun_map_t *map = _acquire_map(gd, d, modifier, used_lf_mask, orig_w, orig_h, roi_out);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
-      dt_omp_sharedconst(raw_monochrome) \
-      shared(tmpbuf, d, modifier) \
-      schedule(static)
+        dt_omp_firstprivate(tmpbufwidth, roi_out, map) \
+        dt_omp_sharedconst(raw_monochrome) \
+        shared(tmpbuf, d, modifier) \
+        schedule(static)
 #endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
-      }
+        for(int y = 0; y < roi_out->height; y++)
+        {
+          float *pi = tmpbuf + (size_t)y * tmpbufwidth;
+          _distortion_row(map, modifier, roi_out, y, pi);
+        }
+        _release_map(gd, map);
 
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
-                                             (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
+        /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
+        err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
+                                               (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
+      }
+      else
+        err = _distortion_mesh_to_device(devid, gd, modifier, roi_out, dev_tmpbuf);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, ldkernel, 0, sizeof(cl_mem), (void *)&dev_in);
@@ -723,26 +996,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & LF_MODIFY_VIGNETTING)
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_out) \
-      shared(tmpbuf, modifier, d) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        /* Colour correction: vignetting */
-        // actually this way row stride does not matter.
-        float *buf = tmpbuf + (size_t)y * ch * roi_out->width;
-        for(int k = 0; k < ch * roi_out->width; k++) buf[k] = 0.5f;
-        modifier->ApplyColorModification(buf, roi_out->x, roi_out->y + y, roi_out->width, 1,
-                                         pixelformat, ch * roi_out->width);
-      }
-
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
-                                             (size_t)ch * roi_out->width * roi_out->height * sizeof(float),
-                                             CL_TRUE);
+      err = _vignette_mesh_to_device(devid, gd, modifier, pixelformat, roi_out, dev_tmpbuf);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, gd->kernel_lens_vignette, 0, sizeof(cl_mem), (void *)&dev_tmp);
@@ -765,25 +1019,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & LF_MODIFY_VIGNETTING)
     {
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, pixelformat, roi_in) \
-      shared(tmpbuf, modifier, d) \
-      schedule(static)
-#endif
-      for(int y = 0; y < roi_in->height; y++)
-      {
-        /* Colour correction: vignetting */
-        // actually this way row stride does not matter.
-        float *buf = tmpbuf + (size_t)y * ch * roi_in->width;
-        for(int k = 0; k < ch * roi_in->width; k++) buf[k] = 0.5f;
-        modifier->ApplyColorModification(buf, roi_in->x, roi_in->y + y, roi_in->width, 1,
-                                         pixelformat, ch * roi_in->width);
-      }
-
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(
-          devid, tmpbuf, dev_tmpbuf, 0, (size_t)ch * roi_in->width * roi_in->height * sizeof(float), CL_TRUE);
+      err = _vignette_mesh_to_device(devid, gd, modifier, pixelformat, roi_in, dev_tmpbuf);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, gd->kernel_lens_vignette, 0, sizeof(cl_mem), (void *)&dev_in);
@@ -802,22 +1038,30 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      if(d->do_nan_checks)
+      {
+        // invalid coordinates can't be interpolated, compute every pixel on the host
+        dt_iop_lensfun_map_t *map = _acquire_map(gd, d, modifier, used_lf_mask, orig_w, orig_h, roi_out);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
-      dt_omp_sharedconst(raw_monochrome) \
-      shared(tmpbuf, d, modifier) \
-      schedule(static)
+        dt_omp_firstprivate(tmpbufwidth, roi_out, map) \
+        dt_omp_sharedconst(raw_monochrome) \
+        shared(tmpbuf, d, modifier) \
+        schedule(static)
 #endif
-      for(int y = 0; y < roi_out->height; y++)
-      {
-        float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
-      }
+        for(int y = 0; y < roi_out->height; y++)
+        {
+          float *pi = tmpbuf + (size_t)y * tmpbufwidth;
+          _distortion_row(map, modifier, roi_out, y, pi);
+        }
+        _release_map(gd, map);
 
-      /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
-      err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
-                                             (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
+        /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
+        err = dt_opencl_write_buffer_to_device(devid, tmpbuf, dev_tmpbuf, 0,
+                                               (size_t)owidth * oheight * 2 * 3 * sizeof(float), CL_TRUE);
+      }
+      else
+        err = _distortion_mesh_to_device(devid, gd, modifier, roi_out, dev_tmpbuf);
       if(err != CL_SUCCESS) goto error;
 
       dt_opencl_set_kernel_arg(devid, ldkernel, 0, sizeof(cl_mem), (void *)&dev_tmp);
@@ -955,10 +1199,12 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
     return;
   }
 
+  dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->global_data;
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
+  const int mask_lf_mask = /*LF_MODIFY_TCA |*/ LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE;
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, /*LF_MODIFY_TCA |*/ LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE, FALSE);
+  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, mask_lf_mask, FALSE);
 
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
@@ -971,6 +1217,8 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 
   const struct dt_interpolation *const interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
 
+  dt_iop_lensfun_map_t *map = _acquire_map(gd, d, modifier, mask_lf_mask, orig_w, orig_h, roi_out);
+
   // acquire temp memory for distorted pixel coords
   const size_t bufsize = (size_t)roi_out->width * 2 * 3;
   size_t padded_bufsize;
@@ -978,7 +1226,7 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(padded_bufsize, d, in, interpolation, out, roi_in, roi_out) \
+  dt_omp_firstprivate(padded_bufsize, d, in, interpolation, out, roi_in, roi_out, map) \
   dt_omp_sharedconst(buf) \
   shared(modifier) \
   schedule(static)
@@ -986,7 +1234,7 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
   for(int y = 0; y < roi_out->height; y++)
   {
     float *bufptr = (float*)dt_get_perthread(buf, padded_bufsize);
-    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+    _distortion_row(map, modifier, roi_out, y, bufptr);
 
     // reverse transform the global coords from lf to our buffer
     float *_out = out + (size_t)y * roi_out->width;
@@ -1006,6 +1254,7 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
     }
   }
   dt_free_align(buf);
+  _release_map(gd, map);
   delete modifier;
 }
 
@@ -1223,6 +1472,13 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     d->do_nan_checks = FALSE;
   }
+
+  g_free(d->map_key);
+  d->map_key = d->lens->Maker && d->lens->Model
+    ? g_strdup_printf("%s|%s|%d|%.9g|%.9g|%.9g|%.9g|%.9g|%d|%d|%d|%d|%.9g|%.9g", d->lens->Maker, d->lens->Model,
+                      d->lens->Type, d->crop, d->focal, d->aperture, d->distance, d->scale, d->target_geom,
+                      d->inverse, d->modify_flags, d->tca_override, p->tca_r, p->tca_b)
+    : NULL;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1239,6 +1495,7 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     delete d->lens;
     d->lens = NULL;
   }
+  g_free(d->map_key);
   free(piece->data);
   piece->data = NULL;
 }
@@ -1254,6 +1511,8 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_lens_distort_lanczos2 = dt_opencl_create_kernel(program, "lens_distort_lanczos2");
   gd->kernel_lens_distort_lanczos3 = dt_opencl_create_kernel(program, "lens_distort_lanczos3");
   gd->kernel_lens_vignette = dt_opencl_create_kernel(program, "lens_vignette");
+  gd->kernel_lens_mesh = dt_opencl_create_kernel(program, "lens_mesh");
+  dt_pthread_mutex_init(&gd->map_lock, NULL);
 
   lfDatabase *dt_iop_lensfun_db = new lfDatabase;
   gd->db = (lfDatabase *)dt_iop_lensfun_db;
@@ -1343,6 +1602,8 @@ void reload_defaults(dt_iop_module_t *module)
       if(++cnt == 2) *c = '\0';
   if(img->exif_maker[0] || model[0])
   {
+    // the lens database is loaded on first use
+    dt_iop_init_global(module);
     dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)module->global_data;
 
     // just to be sure
@@ -1435,6 +1696,9 @@ void cleanup_global(dt_iop_module_so_t *module)
   dt_opencl_free_kernel(gd->kernel_lens_distort_lanczos2);
   dt_opencl_free_kernel(gd->kernel_lens_distort_lanczos3);
   dt_opencl_free_kernel(gd->kernel_lens_vignette);
+  dt_opencl_free_kernel(gd->kernel_lens_mesh);
+  _evict_maps(gd, 0);
+  dt_pthread_mutex_destroy(&gd->map_lock);
   free(module->data);
   module->data = NULL;
 }
@@ -475,6 +475,7 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
   piece->request_histogram |= (DT_REQUEST_ONLY_IN_GUI);
 
   piece->histogram_params.bins_count = 256;
+  piece->histogram_params.sampling = 0;
 
   if(p->mode == LEVELS_MODE_AUTOMATIC)
   {
@@ -486,6 +487,8 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
     if(!self->dev->gui_attached) piece->request_histogram &= ~(DT_REQUEST_ONLY_IN_GUI);
 
     piece->histogram_params.bins_count = 16384;
+    // the levels are computed from the percentiles of the preview histogram, don't sample it
+    piece->histogram_params.sampling = 1;
 
     /*
      * in principle, we do not need/want histogram in FULL pipe
@@ -256,6 +256,17 @@ typedef struct
   dt_liquify_path_data_t nodes[MAX_NODES];
 } dt_iop_liquify_params_t;
 
+typedef struct
+{
+  dt_iop_liquify_params_t params; // has to stay first, piece->data is used as the params
+
+  // darkroom pipes keep the last distortion map, so that processing again after a change
+  // upstream or computing the distorted masks does not rasterize all warps again
+  uint64_t map_key; // hash of the paths in piece coordinates and of roi_out
+  float complex *map;
+  cairo_rectangle_int_t map_extent;
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   int warp_kernel;
@@ -1207,18 +1218,62 @@ static float complex *create_global_distortion_map(const cairo_rectangle_int_t *
   return map;
 }
 
+static inline uint64_t hash_bytes(uint64_t hash, const void *const data, const size_t size)
+{
+  const char *const str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
+// hash everything of the paths which the distortion map depends on. hover and selection state are left
+// out, they change while the user merely moves the mouse.
+static uint64_t hash_paths(const dt_iop_liquify_params_t *const p)
+{
+  uint64_t hash = 5381;
+  for(int k = 0; k < MAX_NODES; k++)
+  {
+    const dt_liquify_path_data_t *const n = &p->nodes[k];
+    if(n->header.type == DT_LIQUIFY_PATH_INVALIDATED) continue;
+    hash = hash_bytes(hash, &n->header.type, sizeof(n->header.type));
+    hash = hash_bytes(hash, &n->header.node_type, sizeof(n->header.node_type));
+    hash = hash_bytes(hash, &n->header.prev, sizeof(n->header.prev));
+    hash = hash_bytes(hash, &n->header.idx, sizeof(n->header.idx));
+    hash = hash_bytes(hash, &n->header.next, sizeof(n->header.next));
+    hash = hash_bytes(hash, &n->warp, sizeof(n->warp));
+    hash = hash_bytes(hash, &n->node, sizeof(n->node));
+  }
+  return hash;
+}
+
+// the returned map belongs to the piece if it is cached there, release it with free_global_distortion_map()
 static float complex *build_global_distortion_map(struct dt_iop_module_t *module,
                                                    const dt_dev_pixelpipe_iop_t *piece,
                                                    const dt_iop_roi_t *roi_in,
                                                    const dt_iop_roi_t *roi_out,
                                                    cairo_rectangle_int_t *map_extent)
 {
+  dt_iop_liquify_data_t *const d = (dt_iop_liquify_data_t *)piece->data;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
   memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
 
+  // the paths in piece coordinates cover the params, the scale and all distortions before us
+  const gboolean use_cache = (piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW)) != 0;
+  uint64_t key = 0;
+  if(use_cache)
+  {
+    const int roi_rect[4] = { roi_out->x, roi_out->y, roi_out->width, roi_out->height };
+    key = hash_bytes(hash_paths(&copy_params), roi_rect, sizeof(roi_rect));
+    if(d->map && d->map_key == key)
+    {
+      *map_extent = d->map_extent;
+      return d->map;
+    }
+  }
+
   GList *interpolated = interpolate_paths(&copy_params);
   GSList *interpolated_in_roi = _get_map_extent(roi_out, interpolated, map_extent);
 
@@ -1226,9 +1281,23 @@ static float complex *build_global_distortion_map(struct dt_iop_module_t *module
 
   g_slist_free(interpolated_in_roi);
   g_list_free_full(interpolated, free);
+
+  if(use_cache && map)
+  {
+    if(d->map) dt_free_align((void *)d->map);
+    d->map = map;
+    d->map_key = key;
+    d->map_extent = *map_extent;
+  }
   return map;
 }
 
+static void free_global_distortion_map(const dt_dev_pixelpipe_iop_t *piece, const float complex *map)
+{
+  const dt_iop_liquify_data_t *const d = (dt_iop_liquify_data_t *)piece->data;
+  if(map != d->map) dt_free_align((void *)map);
+}
+
 // 1st pass: how large would the output be, given this input roi?
 // this is always called with the full buffer before processing.
 void modify_roi_out(struct dt_iop_module_t *module,
@@ -1442,7 +1511,7 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
     piece->colors = ch;
   }
 
-  dt_free_align((void *) map);
+  free_global_distortion_map(piece, map);
 
 }
 
@@ -1483,7 +1552,7 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
   if(map_extent.width != 0 && map_extent.height != 0)
     apply_global_distortion_map(module, piece, in, out, roi_in, roi_out, map, &map_extent);
 
-  dt_free_align((void *)map);
+  free_global_distortion_map(piece, map);
 }
 
 #ifdef HAVE_OPENCL
@@ -1644,7 +1713,7 @@ int process_cl(struct dt_iop_module_t *module,
   // 3. apply the map
   if(map_extent.width != 0 && map_extent.height != 0)
     err = apply_global_distortion_map_cl(module, piece, dev_in, dev_out, roi_in, roi_out, map, &map_extent);
-  dt_free_align((void *) map);
+  free_global_distortion_map(piece, map);
   if(err != CL_SUCCESS) goto error;
 
   return TRUE;
@@ -1688,11 +1757,13 @@ void init(dt_iop_module_t *module)
 
 void init_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(module->params_size);
+  piece->data = calloc(1, sizeof(dt_iop_liquify_data_t));
 }
 
 void cleanup_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  if(d->map) dt_free_align((void *)d->map);
   free(piece->data);
   piece->data = NULL;
 }
@@ -105,8 +105,21 @@ typedef struct dt_iop_lut3d_data_t
   dt_iop_lut3d_params_t params;
   float *clut;  // cube lut pointer
   uint16_t level; // cube_size
+  GMappedFile *clut_map; // the cache file clut points into, NULL if clut is allocated
 } dt_iop_lut3d_data_t;
 
+// the parsed lut files are kept under the cache dir, as this header followed by the 3 * level^3 floats
+#define DT_IOP_LUT3D_CACHE_MAGIC 0x4433544cu // "LT3D"
+#define DT_IOP_LUT3D_CACHE_VERSION 1
+
+typedef struct dt_iop_lut3d_cache_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t level;
+  uint32_t padding; // keeps the floats 16 bytes aligned in the mapping
+} dt_iop_lut3d_cache_header_t;
+
 typedef struct dt_iop_lut3d_global_data_t
 {
   int kernel_lut3d_tetrahedral;
@@ -1137,7 +1150,104 @@ void cleanup_global(dt_iop_module_so_t *module)
   module->data = NULL;
 }
 
-static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
+// the cache file of a lut file, named after its path, modification time and size so that an edited
+// file gets parsed again
+static gchar *_clut_cache_filename(const char *const fullpath)
+{
+  GStatBuf st;
+  if(g_stat(fullpath, &st)) return NULL;
+
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *dir = g_build_filename(cachedir, "lut3d", NULL);
+  if(g_mkdir_with_parents(dir, 0750))
+  {
+    g_free(dir);
+    return NULL;
+  }
+
+  gchar *key = g_strdup_printf("%s|%" G_GINT64_FORMAT "|%" G_GINT64_FORMAT, fullpath, (gint64)st.st_mtime,
+                               (gint64)st.st_size);
+  gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, key, -1);
+  gchar *name = g_strconcat(checksum, ".lut", NULL);
+  gchar *filename = g_build_filename(dir, name, NULL);
+  g_free(name);
+  g_free(checksum);
+  g_free(key);
+  g_free(dir);
+  return filename;
+}
+
+// map the parsed lut from the cache, returns its level or 0 if missing or invalid
+static uint16_t _clut_cache_load(const char *const cachefile, float **clut, GMappedFile **map)
+{
+  GMappedFile *mf = g_mapped_file_new(cachefile, FALSE, NULL);
+  if(!mf) return 0;
+
+  const char *contents = g_mapped_file_get_contents(mf);
+  const size_t len = g_mapped_file_get_length(mf);
+  dt_iop_lut3d_cache_header_t header;
+  if(len >= sizeof(header))
+  {
+    memcpy(&header, contents, sizeof(header));
+    if(header.magic == DT_IOP_LUT3D_CACHE_MAGIC && header.version == DT_IOP_LUT3D_CACHE_VERSION
+       && header.level >= 2 && header.level <= 256
+       && len == sizeof(header) + sizeof(float) * 3 * header.level * header.level * header.level)
+    {
+      *clut = (float *)(contents + sizeof(header));
+      *map = mf;
+      dt_print(DT_DEBUG_DEV, "[lut3d] using cached lut %s - level %d\n", cachefile, header.level);
+      return header.level;
+    }
+  }
+  g_mapped_file_unref(mf);
+  return 0;
+}
+
+// write the parsed lut to the cache. it goes to a temporary file first, so that other pipes
+// never map a partial one.
+static void _clut_cache_store(const char *const cachefile, const float *const clut, const uint16_t level)
+{
+  gchar *tmpfile = g_strconcat(cachefile, ".XXXXXX", NULL);
+  const int fd = g_mkstemp(tmpfile);
+  if(fd == -1)
+  {
+    g_free(tmpfile);
+    return;
+  }
+  FILE *f = fdopen(fd, "wb");
+  if(!f)
+  {
+    close(fd);
+    g_unlink(tmpfile);
+    g_free(tmpfile);
+    return;
+  }
+
+  const dt_iop_lut3d_cache_header_t header
+      = { DT_IOP_LUT3D_CACHE_MAGIC, DT_IOP_LUT3D_CACHE_VERSION, level, 0 };
+  const size_t nb = (size_t)3 * level * level * level;
+  const gboolean ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(clut, sizeof(float), nb, f) == nb;
+  if(fclose(f) || !ok || g_rename(tmpfile, cachefile))
+  {
+    fprintf(stderr, "[lut3d] could not write lut cache file %s\n", cachefile);
+    g_unlink(tmpfile);
+  }
+  g_free(tmpfile);
+}
+
+static void free_clut(dt_iop_lut3d_data_t *d)
+{
+  if(d->clut_map)
+    g_mapped_file_unref(d->clut_map);
+  else
+    dt_free_align(d->clut);
+  d->clut_map = NULL;
+  d->clut = NULL;
+  d->level = 0;
+}
+
+static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut, GMappedFile **map)
 {
   uint16_t level = 0;
   const char *filepath = p->filepath;
@@ -1154,18 +1264,25 @@ static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
     if (filepath[0] && lutfolder[0])
     {
       char *fullpath = g_build_filename(lutfolder, filepath, NULL);
-      if (g_str_has_suffix (filepath, ".png") || g_str_has_suffix (filepath, ".PNG"))
-      {
-        level = calculate_clut_haldclut(p, fullpath, clut);
-      }
-      else if (g_str_has_suffix (filepath, ".cube") || g_str_has_suffix (filepath, ".CUBE"))
-      {
-        level = calculate_clut_cube(fullpath, clut);
-      }
-      else if (g_str_has_suffix (filepath, ".3dl") || g_str_has_suffix (filepath, ".3DL"))
-      {
-        level = calculate_clut_3dl(fullpath, clut);
+      gchar *cachefile = _clut_cache_filename(fullpath);
+      if(cachefile) level = _clut_cache_load(cachefile, clut, map);
+      if(!level)
+      { // not parsed yet
+        if (g_str_has_suffix (filepath, ".png") || g_str_has_suffix (filepath, ".PNG"))
+        {
+          level = calculate_clut_haldclut(p, fullpath, clut);
+        }
+        else if (g_str_has_suffix (filepath, ".cube") || g_str_has_suffix (filepath, ".CUBE"))
+        {
+          level = calculate_clut_cube(fullpath, clut);
+        }
+        else if (g_str_has_suffix (filepath, ".3dl") || g_str_has_suffix (filepath, ".3DL"))
+        {
+          level = calculate_clut_3dl(fullpath, clut);
+        }
+        if(level && *clut && cachefile) _clut_cache_store(cachefile, *clut, level);
       }
+      g_free(cachefile);
       g_free(fullpath);
     }
     g_free(lutfolder);
@@ -1348,13 +1465,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if (strcmp(p->filepath, d->params.filepath) != 0 || strcmp(p->lutname, d->params.lutname) != 0 )
   { // new clut file
-    if (d->clut)
-    { // reset current clut if any
-      dt_free_align(d->clut);
-      d->clut = NULL;
-      d->level = 0;
-    }
-    d->level = calculate_clut(p, &d->clut);
+    // reset current clut if any
+    free_clut(d);
+    d->level = calculate_clut(p, &d->clut, &d->clut_map);
   }
   memcpy(&d->params, p, sizeof(dt_iop_lut3d_params_t));
 }
@@ -1366,16 +1479,14 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   memcpy(&d->params, self->default_params, sizeof(dt_iop_lut3d_params_t));
   d->clut = NULL;
   d->level = 0;
+  d->clut_map = NULL;
   d->params.filepath[0] = '\0';
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;;
-  if (d->clut)
-    dt_free_align(d->clut);
-  d->clut = NULL;
-  d->level = 0;
+  free_clut(d);
   free(piece->data);
   piece->data = NULL;
 }
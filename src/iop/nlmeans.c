@@ -450,7 +450,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                   void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  process_cpu(piece,ivoid,ovoid,roi_in,roi_out,nlmeans_denoise_sse2);
+  // the avx2 clone of the plain version beats the 4-wide intrinsics
+  process_cpu(piece,ivoid,ovoid,roi_in,roi_out,darktable.codepath.AVX2 ? nlmeans_denoise : nlmeans_denoise_sse2);
   return;
 }
 #endif
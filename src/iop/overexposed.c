@@ -337,7 +337,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 
 process_finish:
-  dt_free_align(img_tmp);
+  dt_iop_image_free(img_tmp);
 }
 
 #ifdef HAVE_OPENCL
@@ -28,10 +28,12 @@
 #include "common/heal.h"
 #include "common/imagebuf.h"
 #include "common/opencl.h"
+#include "control/conf.h"
 #include "develop/blend.h"
 #include "develop/imageop_math.h"
 #include "develop/imageop_gui.h"
 #include "develop/masks.h"
+#include "develop/pixelpipe_cache.h"
 #include "iop/iop_api.h"
 #include "dtgtk/drawingarea.h"
 #include "gui/accelerators.h"
@@ -95,6 +97,7 @@ typedef struct retouch_user_data_t
   int display_scale;
   int mask_display;
   int suppress_mask;
+  struct dt_iop_retouch_data_t *cache; // layers are processed incrementally if set
 } retouch_user_data_t;
 
 typedef struct dt_iop_retouch_params_t
@@ -172,7 +175,35 @@ typedef struct dt_iop_retouch_gui_data_t
   GtkWidget *sl_mask_opacity; // draw mask opacity
 } dt_iop_retouch_gui_data_t;
 
-typedef struct dt_iop_retouch_params_t dt_iop_retouch_data_t;
+// what a form did to its layer in the last run
+typedef struct rt_form_state_t
+{
+  int formid;
+  uint64_t hash;     // of the shape, opacity and settings of the form
+  gboolean applied;  // FALSE if the form left the layer alone
+  dt_iop_roi_t dest; // area written, it is read from the same area moved by (dx, dy)
+  int dx, dy;
+} rt_form_state_t;
+
+typedef struct rt_layer_cache_t
+{
+  float *raw;       // the layer before applying any form, not kept for the image itself (scale 0)
+  float *processed; // the layer with all of its forms applied
+  rt_form_state_t *forms;
+  int num_forms;
+  gboolean valid;
+} rt_layer_cache_t;
+
+typedef struct dt_iop_retouch_data_t
+{
+  dt_iop_retouch_params_t params; // has to stay first, piece->data is used as the params all over the module
+
+  // darkroom pipes keep the wavelet decomposition and the processed layers so that editing a form only
+  // recomputes the areas it affects
+  uint64_t cache_key;     // input, region of interest and number of scales of the cached layers
+  uint64_t decompose_key; // the above and the forms on the image itself, which are decomposed
+  rt_layer_cache_t layers[RETOUCH_NO_SCALES];
+} dt_iop_retouch_data_t;
 
 typedef struct dt_iop_retouch_global_data_t
 {
@@ -1999,13 +2030,27 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
   memcpy(piece->data, params, sizeof(dt_iop_retouch_params_t));
 }
 
+static void rt_free_layer_cache(dt_iop_retouch_data_t *d)
+{
+  for(int i = 0; i < RETOUCH_NO_SCALES; i++)
+  {
+    rt_layer_cache_t *lc = &d->layers[i];
+    if(lc->raw) dt_free_align(lc->raw);
+    if(lc->processed) dt_free_align(lc->processed);
+    free(lc->forms);
+    memset(lc, 0, sizeof(rt_layer_cache_t));
+  }
+  d->cache_key = d->decompose_key = 0;
+}
+
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(sizeof(dt_iop_retouch_data_t));
+  piece->data = calloc(1, sizeof(dt_iop_retouch_data_t));
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  rt_free_layer_cache((dt_iop_retouch_data_t *)piece->data);
   free(piece->data);
   piece->data = NULL;
 }
@@ -3236,171 +3281,457 @@ cleanup:
   if(img_dest) dt_free_align(img_dest);
 }
 
-static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int scale1)
+static inline uint64_t rt_hash_bytes(uint64_t hash, const void *const data, const size_t size)
 {
-  int scale = scale1;
-  retouch_user_data_t *usr_d = (retouch_user_data_t *)wt_p->user_data;
-  dt_iop_module_t *self = usr_d->self;
-  dt_dev_pixelpipe_iop_t *piece = usr_d->piece;
+  const char *const str = (const char *)data;
+  for(size_t i = 0; i < size; i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
 
-  // if preview a single scale, just process that scale and original image
-  // unless merge is activated
-  if(wt_p->merge_from_scale == 0 && wt_p->return_layer > 0 && scale != wt_p->return_layer && scale != 0) return;
-  // do not process the reconstructed image
-  if(scale > wt_p->scales + 1) return;
+static size_t rt_cache_budget()
+{
+  return (size_t)MAX(0, dt_conf_get_int("plugins/darkroom/retouch/cache_size")) * 1024 * 1024;
+}
 
+// a form of the current layer, in the order of the mask group
+typedef struct rt_layer_form_t
+{
+  int formid;
+  int index; // into p->rt_forms
+  dt_masks_form_t *form;
+  float opacity;
+} rt_layer_form_t;
+
+// collect the forms which are applied to the given scale; returns their number, *forms has to be freed
+static int rt_get_layer_forms(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_roi_t *roi_layer,
+                              const int scale, rt_layer_form_t **forms)
+{
   dt_develop_blend_params_t *bp = (dt_develop_blend_params_t *)piece->blendop_data;
   dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
-  dt_iop_roi_t *roi_layer = &usr_d->roi;
-  const int mask_display = usr_d->mask_display && (scale == usr_d->display_scale);
 
-  // when the requested scales is grather than max scales the residual image index will be different from the one
-  // defined by the user,
-  // so we need to adjust it here, otherwise we will be using the shapes from a scale on the residual image
-  if(wt_p->scales < p->num_scales && wt_p->return_layer == 0 && scale == wt_p->scales + 1)
+  *forms = NULL;
+  int num_forms = 0;
+
+  const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
+  if(!grp || !(grp->type & DT_MASKS_GROUP)) return 0;
+
+  *forms = malloc(sizeof(rt_layer_form_t) * MAX(1, g_list_length(grp->points)));
+  if(*forms == NULL) return 0;
+
+  for(const GList *pts = grp->points; pts; pts = g_list_next(pts))
   {
-    scale = p->num_scales + 1;
+    const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)pts->data;
+    if(grpt == NULL)
+    {
+      fprintf(stderr, "rt_process_forms: invalid form\n");
+      continue;
+    }
+    const int formid = grpt->formid;
+    if(formid == 0)
+    {
+      fprintf(stderr, "rt_process_forms: form is null\n");
+      continue;
+    }
+    const int index = rt_get_index_from_formid(p, formid);
+    if(index == -1)
+    {
+      // FIXME: we get this error when user go back in history, so forms are the same but the array has changed
+      fprintf(stderr, "rt_process_forms: missing form=%i from array\n", formid);
+      continue;
+    }
+
+    // only process current scale
+    if(p->rt_forms[index].scale != scale)
+    {
+      continue;
+    }
+
+    // get the spot
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, formid);
+    if(form == NULL)
+    {
+      fprintf(stderr, "rt_process_forms: missing form=%i from masks\n", formid);
+      continue;
+    }
+
+    // if the form is outside the roi, we just skip it
+    if(!rt_masks_form_is_in_roi(self, piece, form, roi_layer, roi_layer))
+    {
+      continue;
+    }
+
+    (*forms)[num_forms].formid = formid;
+    (*forms)[num_forms].index = index;
+    (*forms)[num_forms].form = form;
+    (*forms)[num_forms].opacity = grpt->opacity;
+    num_forms++;
   }
 
-  // iterate through all forms
-  if(!usr_d->suppress_mask)
+  return num_forms;
+}
+
+// build the scaled mask of a form and find out where it reads from and writes to.
+// returns NULL if the form does not change the layer.
+static float *rt_prepare_form(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_roi_t *roi_layer,
+                              const rt_layer_form_t *const lf, rt_form_state_t *const state)
+{
+  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+
+  state->applied = FALSE;
+
+  // get the mask
+  float *mask = NULL;
+  dt_iop_roi_t roi_mask = { 0 };
+
+  dt_masks_get_mask(self, piece, lf->form, &mask, &roi_mask.width, &roi_mask.height, &roi_mask.x, &roi_mask.y);
+  if(mask == NULL)
   {
-    const dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
-    if(grp && (grp->type & DT_MASKS_GROUP))
+    fprintf(stderr, "rt_process_forms: error retrieving mask\n");
+    return NULL;
+  }
+
+  // search the delta with the source
+  const dt_iop_retouch_algo_type_t algo = p->rt_forms[lf->index].algorithm;
+  float dx = 0.f, dy = 0.f;
+
+  if(algo != DT_IOP_RETOUCH_BLUR && algo != DT_IOP_RETOUCH_FILL)
+  {
+    if(!rt_masks_get_delta_to_destination(self, piece, roi_layer, lf->form, &dx, &dy,
+                                          p->rt_forms[lf->index].distort_mode))
     {
-      for(const GList *forms = grp->points; forms; forms = g_list_next(forms))
-      {
-        const dt_masks_point_group_t *grpt = (dt_masks_point_group_t *)forms->data;
-        if(grpt == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: invalid form\n");
-          continue;
-        }
-        const int formid = grpt->formid;
-        const float form_opacity = grpt->opacity;
-        if(formid == 0)
-        {
-          fprintf(stderr, "rt_process_forms: form is null\n");
-          continue;
-        }
-        const int index = rt_get_index_from_formid(p, formid);
-        if(index == -1)
-        {
-          // FIXME: we get this error when user go back in history, so forms are the same but the array has changed
-          fprintf(stderr, "rt_process_forms: missing form=%i from array\n", formid);
-          continue;
-        }
+      dt_free_align(mask);
+      return NULL;
+    }
+  }
 
-        // only process current scale
-        if(p->rt_forms[index].scale != scale)
-        {
-          continue;
-        }
+  // scale the mask
+  float *mask_scaled = NULL;
+  dt_iop_roi_t roi_mask_scaled = { 0 };
 
-        // get the spot
-        dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, formid);
-        if(form == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: missing form=%i from masks\n", formid);
-          continue;
-        }
+  rt_build_scaled_mask(mask, &roi_mask, &mask_scaled, &roi_mask_scaled, roi_layer, dx, dy, algo);
 
-        // if the form is outside the roi, we just skip it
-        if(!rt_masks_form_is_in_roi(self, piece, form, roi_layer, roi_layer))
-        {
-          continue;
-        }
+  // we don't need the original mask anymore
+  dt_free_align(mask);
 
-        // get the mask
-        float *mask = NULL;
-        dt_iop_roi_t roi_mask = { 0 };
+  if(mask_scaled == NULL)
+  {
+    return NULL;
+  }
 
-        dt_masks_get_mask(self, piece, form, &mask, &roi_mask.width, &roi_mask.height, &roi_mask.x, &roi_mask.y);
-        if(mask == NULL)
-        {
-          fprintf(stderr, "rt_process_forms: error retrieving mask\n");
-          continue;
-        }
+  if(!((dx != 0 || dy != 0 || algo == DT_IOP_RETOUCH_BLUR || algo == DT_IOP_RETOUCH_FILL)
+       && ((roi_mask_scaled.width > 2) && (roi_mask_scaled.height > 2))))
+  {
+    dt_free_align(mask_scaled);
+    return NULL;
+  }
 
-        // search the delta with the source
-        const dt_iop_retouch_algo_type_t algo = p->rt_forms[index].algorithm;
-        float dx = 0.f, dy = 0.f;
+  state->applied = TRUE;
+  state->dest = roi_mask_scaled;
+  state->dx = dx;
+  state->dy = dy;
 
-        if(algo != DT_IOP_RETOUCH_BLUR && algo != DT_IOP_RETOUCH_FILL)
-        {
-          if(!rt_masks_get_delta_to_destination(self, piece, roi_layer, form, &dx, &dy,
-                                                p->rt_forms[index].distort_mode))
-          {
-            if(mask) dt_free_align(mask);
-            continue;
-          }
-        }
+  return mask_scaled;
+}
 
-        // scale the mask
-        float *mask_scaled = NULL;
-        dt_iop_roi_t roi_mask_scaled = { 0 };
+// apply a form prepared by rt_prepare_form() to the layer
+static void rt_apply_form(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *layer,
+                          dt_iop_roi_t *roi_layer, dwt_params_t *const wt_p, const rt_layer_form_t *const lf,
+                          float *const mask_scaled, rt_form_state_t *const state, const int mask_display)
+{
+  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  const dt_iop_retouch_form_data_t *const fd = &p->rt_forms[lf->index];
+  const float form_opacity = lf->opacity;
 
-        rt_build_scaled_mask(mask, &roi_mask, &mask_scaled, &roi_mask_scaled, roi_layer, dx, dy, algo);
+  if(fd->algorithm == DT_IOP_RETOUCH_CLONE)
+  {
+    retouch_clone(layer, roi_layer, mask_scaled, &state->dest, state->dx, state->dy, form_opacity);
+  }
+  else if(fd->algorithm == DT_IOP_RETOUCH_HEAL)
+  {
+    retouch_heal(layer, roi_layer, mask_scaled, &state->dest, state->dx, state->dy, form_opacity);
+  }
+  else if(fd->algorithm == DT_IOP_RETOUCH_BLUR)
+  {
+    retouch_blur(self, layer, roi_layer, mask_scaled, &state->dest, form_opacity, fd->blur_type, fd->blur_radius,
+                 piece, wt_p->use_sse);
+  }
+  else if(fd->algorithm == DT_IOP_RETOUCH_FILL)
+  {
+    // add a brightness to the color so it can be fine-adjusted by the user
+    dt_aligned_pixel_t fill_color;
 
-        // we don't need the original mask anymore
-        if(mask)
-        {
-          dt_free_align(mask);
-          mask = NULL;
-        }
+    if(fd->fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
+    {
+      fill_color[0] = fill_color[1] = fill_color[2] = fd->fill_brightness;
+    }
+    else
+    {
+      fill_color[0] = fd->fill_color[0] + fd->fill_brightness;
+      fill_color[1] = fd->fill_color[1] + fd->fill_brightness;
+      fill_color[2] = fd->fill_color[2] + fd->fill_brightness;
+    }
+    fill_color[3] = 0.0f;
 
-        if(mask_scaled == NULL)
-        {
-          continue;
-        }
+    retouch_fill(layer, roi_layer, mask_scaled, &state->dest, form_opacity, fill_color);
+  }
+  else
+    fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", fd->algorithm);
 
-        if((dx != 0 || dy != 0 || algo == DT_IOP_RETOUCH_BLUR || algo == DT_IOP_RETOUCH_FILL)
-           && ((roi_mask_scaled.width > 2) && (roi_mask_scaled.height > 2)))
-        {
-          if(algo == DT_IOP_RETOUCH_CLONE)
-          {
-            retouch_clone(layer, roi_layer, mask_scaled, &roi_mask_scaled, dx, dy, form_opacity);
-          }
-          else if(algo == DT_IOP_RETOUCH_HEAL)
-          {
-            retouch_heal(layer, roi_layer, mask_scaled, &roi_mask_scaled, dx, dy, form_opacity);
-          }
-          else if(algo == DT_IOP_RETOUCH_BLUR)
-          {
-            retouch_blur(self, layer, roi_layer, mask_scaled, &roi_mask_scaled, form_opacity,
-                         p->rt_forms[index].blur_type, p->rt_forms[index].blur_radius, piece, wt_p->use_sse);
-          }
-          else if(algo == DT_IOP_RETOUCH_FILL)
-          {
-            // add a brightness to the color so it can be fine-adjusted by the user
-            dt_aligned_pixel_t fill_color;
+  if(mask_display)
+    rt_copy_mask_to_alpha(layer, roi_layer, wt_p->ch, mask_scaled, &state->dest, form_opacity);
+}
 
-            if(p->rt_forms[index].fill_mode == DT_IOP_RETOUCH_FILL_ERASE)
-            {
-              fill_color[0] = fill_color[1] = fill_color[2] = p->rt_forms[index].fill_brightness;
-            }
-            else
-            {
-              fill_color[0] = p->rt_forms[index].fill_color[0] + p->rt_forms[index].fill_brightness;
-              fill_color[1] = p->rt_forms[index].fill_color[1] + p->rt_forms[index].fill_brightness;
-              fill_color[2] = p->rt_forms[index].fill_color[2] + p->rt_forms[index].fill_brightness;
-            }
-            fill_color[3] = 0.0f;
+// everything the result of a form depends on, besides the layer itself
+static uint64_t rt_form_hash(dt_iop_retouch_params_t *p, const rt_layer_form_t *const lf)
+{
+  uint64_t hash = 5381;
+  const int length = dt_masks_group_get_hash_buffer_length(lf->form);
+  char *str = malloc(length);
+  if(str)
+  {
+    dt_masks_group_get_hash_buffer(lf->form, str);
+    hash = rt_hash_bytes(hash, str, length);
+    free(str);
+  }
+  hash = rt_hash_bytes(hash, &p->rt_forms[lf->index], sizeof(dt_iop_retouch_form_data_t));
+  hash = rt_hash_bytes(hash, &lf->opacity, sizeof(lf->opacity));
+  return hash;
+}
 
-            retouch_fill(layer, roi_layer, mask_scaled, &roi_mask_scaled, form_opacity, fill_color);
-          }
-          else
-            fprintf(stderr, "rt_process_forms: unknown algorithm %i\n", algo);
+static gboolean rt_rois_intersect(const dt_iop_roi_t *const a, const dt_iop_roi_t *const b)
+{
+  return a->x < b->x + b->width && b->x < a->x + a->width && a->y < b->y + b->height && b->y < a->y + a->height;
+}
 
-          if(mask_display)
-            rt_copy_mask_to_alpha(layer, roi_layer, wt_p->ch, mask_scaled, &roi_mask_scaled, form_opacity);
+// add the areas written and read by a form to the list of dirty areas
+static void rt_add_dirty(dt_iop_roi_t *const dirty, int *const num_dirty, const rt_form_state_t *const state)
+{
+  dirty[(*num_dirty)++] = state->dest;
+  dt_iop_roi_t *const src = &dirty[(*num_dirty)++];
+  *src = state->dest;
+  src->x += state->dx;
+  src->y += state->dy;
+}
+
+static gboolean rt_form_is_dirty(const dt_iop_roi_t *const dirty, const int num_dirty,
+                                 const rt_form_state_t *const state)
+{
+  dt_iop_roi_t src = state->dest;
+  src.x += state->dx;
+  src.y += state->dy;
+  for(int k = 0; k < num_dirty; k++)
+    if(rt_rois_intersect(&dirty[k], &state->dest) || rt_rois_intersect(&dirty[k], &src)) return TRUE;
+  return FALSE;
+}
+
+// apply the forms of one layer to lc->processed, which holds the result of the previous run if lc->valid.
+// every form reads and writes only within its mask area and the same area moved to its source, so the
+// result only needs recomputing (from the untouched layer in raw) where a form was added, changed or
+// removed, and where any form overlaps those areas, transitively.
+static void rt_process_layer_cached(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, dt_iop_roi_t *roi_layer,
+                                    dwt_params_t *const wt_p, rt_layer_cache_t *const lc, const float *const raw,
+                                    const int scale)
+{
+  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+
+  rt_layer_form_t *forms = NULL;
+  const int num_forms = rt_get_layer_forms(self, piece, roi_layer, scale, &forms);
+
+  rt_form_state_t *states = calloc(MAX(1, num_forms), sizeof(rt_form_state_t));
+  float **masks = calloc(MAX(1, num_forms), sizeof(float *));
+  gboolean *rerun = calloc(MAX(1, num_forms), sizeof(gboolean));
+  gboolean *matched = calloc(MAX(1, lc->num_forms), sizeof(gboolean));
+  // each cached form can add its old areas, each current one its new areas and those it had before
+  dt_iop_roi_t *dirty = malloc(sizeof(dt_iop_roi_t) * (2 * lc->num_forms + 4 * num_forms + 1));
+  int num_dirty = 0;
+
+  if(!states || !masks || !rerun || !matched || !dirty)
+  {
+    fprintf(stderr, "rt_process_layer_cached: error allocating memory\n");
+    lc->valid = FALSE;
+    goto cleanup;
+  }
+
+  gboolean full = !lc->valid;
+  if(!full)
+  {
+    // find the forms which are unchanged since the last run. they must keep their order.
+    int last = -1;
+    for(int i = 0; i < num_forms && !full; i++)
+    {
+      states[i].formid = forms[i].formid;
+      states[i].hash = rt_form_hash(p, &forms[i]);
+      rerun[i] = TRUE;
+      for(int j = 0; j < lc->num_forms; j++)
+      {
+        if(lc->forms[j].formid != states[i].formid || matched[j]) continue;
+        if(lc->forms[j].hash == states[i].hash)
+        {
+          states[i] = lc->forms[j];
+          matched[j] = TRUE;
+          rerun[i] = FALSE;
+          if(j < last) full = TRUE;
+          last = j;
         }
+        break;
+      }
+    }
+  }
 
-        if(mask) dt_free_align(mask);
-        if(mask_scaled) dt_free_align(mask_scaled);
+  if(full)
+  {
+    dirty[0] = *roi_layer;
+    num_dirty = 1;
+    for(int i = 0; i < num_forms; i++)
+    {
+      states[i].formid = forms[i].formid;
+      states[i].hash = rt_form_hash(p, &forms[i]);
+      rerun[i] = TRUE;
+    }
+  }
+  else
+  {
+    // the areas of removed or changed forms as they were
+    for(int j = 0; j < lc->num_forms; j++)
+      if(!matched[j] && lc->forms[j].applied) rt_add_dirty(dirty, &num_dirty, &lc->forms[j]);
+
+    // and of new or changed forms as they are now
+    for(int i = 0; i < num_forms; i++)
+    {
+      if(!rerun[i]) continue;
+      masks[i] = rt_prepare_form(self, piece, roi_layer, &forms[i], &states[i]);
+      if(states[i].applied) rt_add_dirty(dirty, &num_dirty, &states[i]);
+    }
+
+    // any form touching a dirty area has to be redone, which makes all of its area dirty
+    gboolean grown = TRUE;
+    while(grown)
+    {
+      grown = FALSE;
+      for(int i = 0; i < num_forms; i++)
+      {
+        if(rerun[i] || !states[i].applied || !rt_form_is_dirty(dirty, num_dirty, &states[i])) continue;
+        rerun[i] = TRUE;
+        rt_add_dirty(dirty, &num_dirty, &states[i]);
+        grown = TRUE;
       }
     }
   }
+
+  // restore the dirty areas from the untouched layer
+  for(int k = 0; k < num_dirty; k++)
+  {
+    const int x_from = MAX(dirty[k].x, roi_layer->x);
+    const int x_to = MIN(dirty[k].x + dirty[k].width, roi_layer->x + roi_layer->width);
+    const int y_from = MAX(dirty[k].y, roi_layer->y);
+    const int y_to = MIN(dirty[k].y + dirty[k].height, roi_layer->y + roi_layer->height);
+    if(x_to <= x_from) continue;
+
+    const size_t rowsize = sizeof(float) * 4 * (x_to - x_from);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(raw, lc, roi_layer, rowsize, x_from, y_from, y_to) \
+    schedule(static)
+#endif
+    for(int y = y_from; y < y_to; y++)
+    {
+      const size_t offs = (size_t)4 * ((size_t)(y - roi_layer->y) * roi_layer->width + (x_from - roi_layer->x));
+      memcpy(lc->processed + offs, raw + offs, rowsize);
+    }
+  }
+
+  // and redo the forms there, in their order
+  int num_rerun = 0;
+  for(int i = 0; i < num_forms; i++)
+  {
+    if(!rerun[i]) continue;
+    num_rerun++;
+    if(!masks[i]) masks[i] = rt_prepare_form(self, piece, roi_layer, &forms[i], &states[i]);
+    if(masks[i]) rt_apply_form(self, piece, lc->processed, roi_layer, wt_p, &forms[i], masks[i], &states[i], 0);
+  }
+
+  dt_print(DT_DEBUG_PERF, "[retouch] scale %i: %i of %i forms recomputed in %i areas\n", scale, num_rerun,
+           num_forms, full ? 1 : num_dirty);
+
+  // remember what the layer now holds
+  rt_form_state_t *const cached = realloc(lc->forms, sizeof(rt_form_state_t) * MAX(1, num_forms));
+  if(cached)
+  {
+    memcpy(cached, states, sizeof(rt_form_state_t) * num_forms);
+    lc->forms = cached;
+    lc->num_forms = num_forms;
+    lc->valid = TRUE;
+  }
+  else
+    lc->valid = FALSE;
+
+cleanup:
+  if(masks)
+    for(int i = 0; i < num_forms; i++)
+      if(masks[i]) dt_free_align(masks[i]);
+  free(masks);
+  free(states);
+  free(rerun);
+  free(matched);
+  free(dirty);
+  free(forms);
+}
+
+static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int scale1)
+{
+  int scale = scale1;
+  retouch_user_data_t *usr_d = (retouch_user_data_t *)wt_p->user_data;
+  dt_iop_module_t *self = usr_d->self;
+  dt_dev_pixelpipe_iop_t *piece = usr_d->piece;
+
+  // if preview a single scale, just process that scale and original image
+  // unless merge is activated
+  if(wt_p->merge_from_scale == 0 && wt_p->return_layer > 0 && scale != wt_p->return_layer && scale != 0) return;
+  // do not process the reconstructed image
+  if(scale > wt_p->scales + 1) return;
+
+  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_roi_t *roi_layer = &usr_d->roi;
+  const int mask_display = usr_d->mask_display && (scale == usr_d->display_scale);
+
+  // when the requested scales is grather than max scales the residual image index will be different from the one
+  // defined by the user,
+  // so we need to adjust it here, otherwise we will be using the shapes from a scale on the residual image
+  if(wt_p->scales < p->num_scales && wt_p->return_layer == 0 && scale == wt_p->scales + 1)
+  {
+    scale = p->num_scales + 1;
+  }
+
+  if(usr_d->suppress_mask) return;
+
+  if(usr_d->cache)
+  {
+    // the image itself has been processed before decomposing it
+    if(scale1 == 0) return;
+
+    // keep the freshly decomposed layer and redo all of its forms
+    rt_layer_cache_t *const lc = &usr_d->cache->layers[scale1];
+    const size_t size = (size_t)4 * roi_layer->width * roi_layer->height;
+    dt_iop_image_copy(lc->raw, layer, size);
+    lc->valid = FALSE;
+    rt_process_layer_cached(self, piece, roi_layer, wt_p, lc, lc->raw, scale);
+    dt_iop_image_copy(layer, lc->processed, size);
+    return;
+  }
+
+  // iterate through all forms
+  rt_layer_form_t *forms = NULL;
+  const int num_forms = rt_get_layer_forms(self, piece, roi_layer, scale, &forms);
+  for(int i = 0; i < num_forms; i++)
+  {
+    rt_form_state_t state = { 0 };
+    float *mask_scaled = rt_prepare_form(self, piece, roi_layer, &forms[i], &state);
+    if(mask_scaled == NULL) continue;
+
+    rt_apply_form(self, piece, layer, roi_layer, wt_p, &forms[i], mask_scaled, &state, mask_display);
+    dt_free_align(mask_scaled);
+  }
+  free(forms);
 }
 
 static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
@@ -3475,8 +3806,91 @@ static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
     if(g) g->first_scale_visible = dt_dwt_first_scale_visible(dwt_p);
   }
 
-  // decompose it
-  dwt_decompose(dwt_p, rt_process_forms);
+  // darkroom pipes keep the layers and only redo what changed, as long as the result is the retouched image
+  dt_iop_retouch_data_t *const d = (dt_iop_retouch_data_t *)piece->data;
+  const int scales = MIN(dwt_p->scales, dwt_get_max_scale(dwt_p));
+  const size_t layer_size = (size_t)4 * roi_rt->width * roi_rt->height;
+  const size_t num_layers = (scales > 0) ? 1 + 2 * (scales + 1) : 1;
+  gboolean use_cache = (piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW))
+                       && !usr_data.mask_display && !usr_data.suppress_mask
+                       && dwt_p->return_layer == 0 && dwt_p->merge_from_scale == 0;
+  if(use_cache && sizeof(float) * layer_size * num_layers > rt_cache_budget())
+  {
+    rt_free_layer_cache(d);
+    use_cache = FALSE;
+  }
+
+  if(use_cache)
+  {
+    uint64_t key = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_in, piece->pipe,
+                                               g_list_index(piece->pipe->nodes, piece));
+    key = rt_hash_bytes(key, roi_rt, sizeof(dt_iop_roi_t));
+    key = rt_hash_bytes(key, &scales, sizeof(scales));
+    key = rt_hash_bytes(key, &piece->iscale, sizeof(piece->iscale));
+    key = rt_hash_bytes(key, &piece->pipe->iwidth, sizeof(piece->pipe->iwidth));
+    key = rt_hash_bytes(key, &piece->pipe->iheight, sizeof(piece->pipe->iheight));
+    if(key != d->cache_key)
+    {
+      rt_free_layer_cache(d);
+      d->cache_key = key;
+    }
+
+    for(int s = 0; s <= scales + 1 && use_cache; s++)
+    {
+      rt_layer_cache_t *lc = &d->layers[s];
+      if(s == 1 && scales == 0) break;
+      if(!lc->processed) lc->processed = dt_alloc_align_float(layer_size);
+      if(s > 0 && !lc->raw) lc->raw = dt_alloc_align_float(layer_size);
+      if(!lc->processed || (s > 0 && !lc->raw)) use_cache = FALSE;
+    }
+    if(!use_cache) rt_free_layer_cache(d);
+  }
+
+  if(use_cache)
+  {
+    usr_data.cache = d;
+
+    // the image itself, the detail scales are decomposed from its result
+    rt_process_layer_cached(self, piece, roi_rt, dwt_p, &d->layers[0], (const float *)ivoid, 0);
+    dt_iop_image_copy(in_retouch, d->layers[0].processed, layer_size);
+
+    if(scales > 0)
+    {
+      uint64_t decompose_key = d->cache_key;
+      for(int i = 0; i < d->layers[0].num_forms; i++)
+        decompose_key = rt_hash_bytes(decompose_key, &d->layers[0].forms[i].hash, sizeof(uint64_t));
+
+      gboolean decomposed = d->layers[0].valid && d->decompose_key == decompose_key;
+      for(int s = 1; s <= scales + 1; s++) decomposed = decomposed && d->layers[s].raw && d->layers[s].valid;
+
+      if(decomposed)
+      {
+        // same as dwt_decompose() would do, reconstruct the image from the updated layers
+        dwt_p->scales = scales;
+        dt_iop_image_fill(in_retouch, 0.0f, roi_rt->width, roi_rt->height, 4);
+        for(int s = 1; s <= scales + 1; s++)
+        {
+          const int form_scale = (s == scales + 1 && scales < p->num_scales) ? p->num_scales + 1 : s;
+          rt_process_layer_cached(self, piece, roi_rt, dwt_p, &d->layers[s], d->layers[s].raw, form_scale);
+          dt_iop_image_add_image(in_retouch, d->layers[s].processed, roi_rt->width, roi_rt->height, 4);
+        }
+      }
+      else
+      {
+        d->decompose_key = 0;
+        for(int s = 1; s <= scales + 1; s++) d->layers[s].valid = FALSE;
+        dwt_decompose(dwt_p, rt_process_forms);
+        gboolean complete = TRUE;
+        for(int s = 1; s <= scales + 1; s++) complete = complete && d->layers[s].valid;
+        if(complete) d->decompose_key = decompose_key;
+      }
+    }
+  }
+  else
+  {
+    // decompose it
+    dwt_decompose(dwt_p, rt_process_forms);
+  }
 
   dt_aligned_pixel_t levels = { p->preview_levels[0], p->preview_levels[1], p->preview_levels[2] };
 
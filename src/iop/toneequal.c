@@ -81,6 +81,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/darktable.h"
 #include "common/fast_guided_filter.h"
+#include "common/imagebuf.h"
 #include "common/eigf.h"
 #include "common/interpolation.h"
 #include "common/luminance_mask.h"
@@ -916,6 +917,27 @@ static inline void display_luminance_mask(const float *const restrict in,
 }
 
 
+// the luminance mask only depends on the module's input and its mask parameters, not on the curve. hash just
+// these so that dragging the nodes re-applies the corrections to the cached mask.
+static uint64_t _luminance_mask_hash(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi_out,
+                                     const dt_iop_toneequalizer_data_t *const d)
+{
+  const int position = g_list_index(piece->pipe->nodes, piece);
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_out, piece->pipe, MAX(position, 0));
+
+  const struct
+  {
+    float feathering, contrast_boost, exposure_boost, quantization, scale;
+    int radius, iterations;
+    dt_iop_luminance_mask_method_t method;
+    dt_iop_toneequalizer_filter_t details;
+  } mask = { d->feathering, d->contrast_boost, d->exposure_boost, d->quantization, d->scale,
+             d->radius,     d->iterations,     d->method,         d->details };
+  const char *str = (const char *)&mask;
+  for(size_t i = 0; i < sizeof(mask); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash;
+}
+
 __DT_CLONE_TARGETS__
 static
 void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
@@ -942,9 +964,9 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   const size_t num_elem = width * height;
   const size_t ch = 4;
 
-  // Get the hash of the upstream pipe to track changes
+  // Get the hash of the upstream pipe and the mask parameters to track changes
   const int position = self->iop_order;
-  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_out, piece->pipe, position);
+  uint64_t hash = _luminance_mask_hash(piece, roi_out, d);
 
   // Sanity checks
   if(width < 1 || height < 1) return;
@@ -1018,14 +1040,14 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     }
     else // just to please GCC
     {
-      luminance = dt_alloc_sse_ps(num_elem);
+      luminance = dt_iop_image_alloc_scratch(num_elem, 1, 1);
     }
 
   }
   else
   {
     // no interactive editing/caching : just allocate a local temp buffer
-    luminance = dt_alloc_sse_ps(num_elem);
+    luminance = dt_iop_image_alloc_scratch(num_elem, 1, 1);
   }
 
   // Check if the luminance buffer exists
@@ -1103,7 +1125,7 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     apply_toneequalizer(in, luminance, out, roi_in, roi_out, ch, d);
   }
 
-  if(!cached) dt_free_align(luminance);
+  if(!cached) dt_iop_image_free(luminance);
 }
 
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
@@ -299,15 +299,16 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
                                          ivoid, ovoid, roi_in, roi_out))
     return;
 
-  // we create a raster mask as an example
+  // we create a raster mask as an example. the pipe has to drop what it derived from the previous one.
   float *mask = NULL;
+  dt_dev_pixelpipe_raster_mask_changed(piece->pipe, piece);
   if(piece->pipe->store_all_raster_masks || dt_iop_is_raster_mask_used(piece->module, mask_id))
   {
     // Attempt to allocate all of the buffers we need.  For this example, we need one buffer that is equal in
     // dimensions to the output buffer, has one color channel, and has been zero'd.  (See common/imagebuf.h for
     // more details on all of the options.)
     if (!dt_iop_alloc_image_buffers(module, roi_in, roi_out,
-                                    1/*ch per pixel*/ | DT_IMGSZ_OUTPUT | DT_IMGSZ_FULL | DT_IMGSZ_CLEARBUF, &mask,
+                                    1/*ch per pixel*/ | DT_IMGSZ_OUTPUT | DT_IMGSZ_FULL | DT_IMGSZ_CLEARBUF | DT_IMGSZ_KEEP, &mask,
                                     0 /* end of list of buffers to allocate */))
     {
       // Uh oh, we didn't have enough memory!  If multiple buffers were requested, any that had already
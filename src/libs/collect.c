@@ -1311,7 +1311,21 @@ static void tree_view(dt_lib_collect_rule_t *dr)
         const gboolean is_insensitive =
           dt_conf_is_equal("plugins/lighttable/tagging/case_sensitivity", "insensitive");
 
-        if(is_insensitive)
+        // with no other rule narrowing the collection the maintained counts are the answer
+        const gboolean all_images = !g_strcmp0(where_ext, "(1=1)");
+
+        if(all_images && is_insensitive)
+          query = g_strdup("SELECT name, 1 AS tagid, SUM(count) AS count"
+                           " FROM memory.tag_counts"
+                           " JOIN (SELECT lower(name) AS name, id AS tag_id FROM data.tags)"
+                           "   ON tagid = tag_id"
+                           "   GROUP BY name");
+        else if(all_images)
+          query = g_strdup("SELECT name, tagid, count"
+                           " FROM memory.tag_counts"
+                           " JOIN (SELECT name, id AS tag_id FROM data.tags)"
+                           "   ON tagid = tag_id");
+        else if(is_insensitive)
           query = g_strdup_printf("SELECT name, 1 AS tagid, SUM(count) AS count"
                                   " FROM (SELECT tagid, COUNT(*) as count"
                                   "   FROM main.images AS mi"
@@ -24,6 +24,7 @@
 #include "control/conf.h"
 #include "control/control.h"
 #include "control/jobs.h"
+#include "control/jobs/image_jobs.h"
 #include "dtgtk/button.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -283,6 +284,9 @@ static void paste_button_clicked(GtkWidget *widget, gpointer user_data)
 
   if(dt_history_paste_on_list(imgs, TRUE))
   {
+    // don't wait for the thumbnails to be scrolled into view to render them
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG,
+                       dt_image_refresh_thumbnails_job_create(imgs, DT_MIPMAP_NONE));
     dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF, imgs);
   }
   else
@@ -298,6 +302,8 @@ static void paste_parts_button_clicked(GtkWidget *widget, gpointer user_data)
 
   if(dt_history_paste_parts_on_list(imgs, TRUE))
   {
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG,
+                       dt_image_refresh_thumbnails_job_create(imgs, DT_MIPMAP_NONE));
     dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
                                imgs); // frees imgs
   }
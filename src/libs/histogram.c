@@ -18,7 +18,6 @@
 #include <stdint.h>
 
 #include "bauhaus/bauhaus.h"
-#include "common/atomic.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/histogram.h"
@@ -604,8 +603,10 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
   // RGB -> chromaticity (processor-heavy), count into bins by chromaticity
   // FIXME: if we do convert to histogram RGB, should it be an absolute colorimetric conversion (would mean knowing the histogram profile whitepoint and un-adapting its matrices) and then we have a meaningful whitepoint and could plot spectral locus -- or the reverse, adapt the spectral locus to the histogram profile PCS (always D50)?
   // FIXME: pre-allocate? -- use the same buffer as for waveform?
-  dt_atomic_int *const restrict binned = __builtin_assume_aligned(dt_alloc_align(64, sizeof(int) * diam_px * diam_px), 64);
-  memset(binned, 0, sizeof(int) * diam_px * diam_px);
+  // bin per thread, as with the waveform: with atomic adds on a shared buffer all the threads contend for the
+  // few cells where an image's colors gather
+  size_t bin_pad;
+  uint32_t *const restrict partial_binned = dt_calloc_perthread((size_t)diam_px * diam_px, sizeof(uint32_t), &bin_pad);
   // FIXME: move verbosed interleaved comments into a method note at the start, as the code itself is succinct and clear
   // FIXME: even with getting rid of the extra profile conversion hop there's no noticeable speedup -- maybe this loop is memory bound -- if can get rid of one of the output buffers and still no speedup, consider doing more work in this loop, such as atomic binning
   // FIXME: make 2x2 averaging be conditional on preprocessor define
@@ -616,7 +617,7 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
   // FIXME: instead of scaling, if chromaticity really depends only on XY, then make a lookup on startup of for each grid cell on graph output the minimum XY to populate that cell, then either brute-force scan that LUT, or start from position of last pixel and scan, or do an optimized search (1/2, 1/2, 1/2, etc.) -- would also find point sample pixel this way
 #if defined(_OPENMP)
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(input, binned, sample_max_x, sample_max_y, roi, rgb2ryb_ypp, diam_px, max_radius, max_diam, vs_prof, vs_type, vs_scale) \
+  dt_omp_firstprivate(input, partial_binned, bin_pad, sample_max_x, sample_max_y, roi, rgb2ryb_ypp, diam_px, max_radius, max_diam, vs_prof, vs_type, vs_scale) \
   schedule(static) collapse(2)
 #endif
   for(size_t y=0; y<sample_max_y; y+=2)
@@ -655,7 +656,10 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
 
       // clip any out-of-scale values, so there aren't light edges
       if(out_x >= 0 && out_x <= diam_px-1 && out_y >= 0 && out_y <= diam_px-1)
-        dt_atomic_add_int(binned + out_y * diam_px + out_x, 1);
+      {
+        uint32_t *const restrict binned = dt_get_perthread(partial_binned, bin_pad);
+        binned[out_y * diam_px + out_x]++;
+      }
     }
 
   dt_aligned_pixel_t RGB = {0.f}, chromaticity;
@@ -722,17 +726,25 @@ static void _lib_histogram_process_vectorscope(dt_lib_histogram_t *d, const floa
   const float gain = 1.f / 30.f;
   const float scale = gain * (diam_px * diam_px) / (sample_width * sample_height);
 
-  // loop appears to be too small to benefit w/OpenMP
-  // FIXME: is this still true?
+  const size_t nthreads = dt_get_num_threads();
+
+  // merging the per-thread bins makes this worth running in parallel
+#if defined(_OPENMP)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(partial_binned, bin_pad, nthreads, diam_px, out_stride, graph, lut, lutmax, scale) \
+  schedule(static)
+#endif
   for(size_t out_y = 0; out_y < diam_px; out_y++)
     for(size_t out_x = 0; out_x < diam_px; out_x++)
     {
-      const int count = binned[out_y * diam_px + out_x];
+      uint32_t count = 0;
+      for(size_t n = 0; n < nthreads; n++)
+        count += dt_get_bythread(partial_binned, bin_pad, n)[out_y * diam_px + out_x];
       const float intensity = lut[(int)(MIN(1.f, scale * count) * lutmax)];
       graph[out_y * out_stride + out_x] = intensity * 255.0f;
     }
 
-  dt_free_align(binned);
+  dt_free_align(partial_binned);
 }
 
 static void dt_lib_histogram_process(struct dt_lib_module_t *self, const float *const input,
@@ -1839,6 +1851,9 @@ void view_enter(struct dt_lib_module_t *self, struct dt_view_t *old_view, struct
   {
     DT_DEBUG_CONTROL_SIGNAL_CONNECT(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW_PIPE_FINISHED,
                               G_CALLBACK(_lib_histogram_preview_updated_callback), self);
+    // the full pipe feeds the scopes too when the preview is downsampled
+    DT_DEBUG_CONTROL_SIGNAL_CONNECT(darktable.signals, DT_SIGNAL_DEVELOP_UI_PIPE_FINISHED,
+                              G_CALLBACK(_lib_histogram_preview_updated_callback), self);
   }
   // button box should be hidden when enter view, unless mouse is over
   // histogram, in which case gtk kindly generates enter events
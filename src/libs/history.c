@@ -62,6 +62,8 @@ typedef struct dt_lib_history_t
   GList *previous_snapshot;
   int previous_history_end;
   GList *previous_iop_order_list;
+  // the items of the last recorded undo snapshot, to be shared with the next one
+  GList *last_snapshot;
 } dt_lib_history_t;
 
 /* 3 widgets in each history line */
@@ -73,6 +75,7 @@ typedef struct dt_lib_history_t
 static void _lib_history_compress_clicked_callback(GtkButton *widget, gpointer user_data);
 static gboolean _lib_history_compress_pressed_callback(GtkWidget *widget, GdkEventButton *e, gpointer user_data);
 static gboolean _lib_history_button_clicked_callback(GtkWidget *widget, GdkEventButton *e, gpointer user_data);
+static void _snapshot_free(GList *snapshot);
 static void _lib_history_create_style_button_clicked_callback(GtkWidget *widget, gpointer user_data);
 /* signal callback for history change */
 static void _lib_history_will_change_callback(gpointer instance, GList *history, int history_end,
@@ -129,6 +132,7 @@ void gui_init(dt_lib_module_t *self)
   d->previous_snapshot = NULL;
   d->previous_history_end = 0;
   d->previous_iop_order_list = NULL;
+  d->last_snapshot = NULL;
 
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
   dt_gui_add_help_link(self->widget, dt_get_help_url(self->plugin_name));
@@ -175,6 +179,8 @@ void gui_cleanup(dt_lib_module_t *self)
 {
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_lib_history_change_callback), self);
   DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_lib_history_module_remove_callback), self);
+  dt_lib_history_t *d = (dt_lib_history_t *)self->data;
+  _snapshot_free(d->last_snapshot);
   g_free(self->data);
   self->data = NULL;
 }
@@ -263,6 +269,128 @@ static void _reset_module_instance(GList *hist, dt_iop_module_t *module, int mul
   }
 }
 
+/*
+ * undo snapshots share the history items they have in common: consecutive snapshots mostly differ by the
+ * last item only, so each snapshot is a list of references to immutable items counted in _snapshot_refs.
+ * an item shared by several snapshots is duplicated before being modified (see _snapshot_item_writable).
+ */
+static GHashTable *_snapshot_refs = NULL;
+
+static void _snapshot_item_ref(dt_dev_history_item_t *item)
+{
+  if(!_snapshot_refs) _snapshot_refs = g_hash_table_new(NULL, NULL);
+  const int refs = GPOINTER_TO_INT(g_hash_table_lookup(_snapshot_refs, item));
+  g_hash_table_insert(_snapshot_refs, item, GINT_TO_POINTER(refs + 1));
+}
+
+static void _snapshot_item_unref(dt_dev_history_item_t *item)
+{
+  const int refs = _snapshot_refs ? GPOINTER_TO_INT(g_hash_table_lookup(_snapshot_refs, item)) : 0;
+  if(refs > 1)
+  {
+    g_hash_table_insert(_snapshot_refs, item, GINT_TO_POINTER(refs - 1));
+    return;
+  }
+
+  if(_snapshot_refs)
+  {
+    g_hash_table_remove(_snapshot_refs, item);
+    if(g_hash_table_size(_snapshot_refs) == 0)
+    {
+      g_hash_table_destroy(_snapshot_refs);
+      _snapshot_refs = NULL;
+    }
+  }
+  dt_dev_free_history_item(item);
+}
+
+static void _snapshot_free(GList *snapshot)
+{
+  for(GList *l = snapshot; l; l = g_list_next(l)) _snapshot_item_unref((dt_dev_history_item_t *)l->data);
+  g_list_free(snapshot);
+}
+
+static dt_dev_history_item_t *_history_item_duplicate(dt_dev_history_item_t *item)
+{
+  GList *single = g_list_prepend(NULL, item);
+  GList *copy = dt_history_duplicate(single);
+  dt_dev_history_item_t *new = (dt_dev_history_item_t *)copy->data;
+  g_list_free(single);
+  g_list_free(copy);
+  return new;
+}
+
+static gboolean _history_item_equal(const dt_dev_history_item_t *a, const dt_dev_history_item_t *b)
+{
+  if(a->module != b->module || a->enabled != b->enabled || a->iop_order != b->iop_order
+     || a->multi_priority != b->multi_priority || a->num != b->num || a->focus_hash != b->focus_hash
+     || strcmp(a->op_name, b->op_name) || strcmp(a->multi_name, b->multi_name))
+    return FALSE;
+
+  // masks are not compared, items having some are never shared
+  if(a->forms || b->forms) return FALSE;
+
+  // same logic as dt_history_duplicate()
+  const dt_iop_module_t *module = a->module ? a->module : dt_iop_get_module(a->op_name);
+  const int32_t params_size = module ? module->params_size : 0;
+
+  return (params_size <= 0 || memcmp(a->params, b->params, params_size) == 0)
+         && memcmp(a->blend_params, b->blend_params, sizeof(dt_develop_blend_params_t)) == 0;
+}
+
+// build a snapshot of history, reusing the items of reference at the same position when they are identical.
+// if take is set, history is consumed: its items are either moved to the snapshot or freed, otherwise only
+// the items which can't be shared are duplicated.
+static GList *_snapshot_from_history(GList *history, GList *reference, const gboolean take)
+{
+  GList *snapshot = NULL;
+  GList *ref = reference;
+
+  for(GList *l = history; l; l = g_list_next(l))
+  {
+    dt_dev_history_item_t *item = (dt_dev_history_item_t *)l->data;
+
+    if(ref && _history_item_equal(item, (dt_dev_history_item_t *)ref->data))
+    {
+      if(take) dt_dev_free_history_item(item);
+      item = (dt_dev_history_item_t *)ref->data;
+    }
+    else if(!take)
+      item = _history_item_duplicate(item);
+
+    _snapshot_item_ref(item);
+    snapshot = g_list_prepend(snapshot, item);
+
+    if(ref) ref = g_list_next(ref);
+  }
+  if(take) g_list_free(history);
+
+  return g_list_reverse(snapshot);
+}
+
+static GList *_snapshot_copy(GList *snapshot)
+{
+  for(GList *l = snapshot; l; l = g_list_next(l)) _snapshot_item_ref((dt_dev_history_item_t *)l->data);
+  return g_list_copy(snapshot);
+}
+
+// make the item of a snapshot list node private to this snapshot before changing it
+static dt_dev_history_item_t *_snapshot_item_writable(GList *node)
+{
+  dt_dev_history_item_t *item = (dt_dev_history_item_t *)node->data;
+
+  if(GPOINTER_TO_INT(g_hash_table_lookup(_snapshot_refs, item)) > 1)
+  {
+    dt_dev_history_item_t *copy = _history_item_duplicate(item);
+    _snapshot_item_unref(item);
+    _snapshot_item_ref(copy);
+    node->data = copy;
+    item = copy;
+  }
+
+  return item;
+}
+
 struct _cb_data
 {
   dt_iop_module_t *module;
@@ -273,14 +401,27 @@ static void _undo_items_cb(gpointer user_data, dt_undo_type_t type, dt_undo_data
 {
   struct _cb_data *udata = (struct _cb_data *)user_data;
   dt_undo_history_t *hdata = (dt_undo_history_t *)data;
-  _reset_module_instance(hdata->after_snapshot, udata->module, udata->multi_priority);
+
+  for(GList *l = hdata->after_snapshot; l; l = g_list_next(l))
+  {
+    const dt_dev_history_item_t *hit = (dt_dev_history_item_t *)l->data;
+
+    if(!hit->module && strcmp(hit->op_name, udata->module->op) == 0
+       && hit->multi_priority == udata->multi_priority)
+      _snapshot_item_writable(l)->module = udata->module;
+  }
 }
 
 static void _history_invalidate_cb(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item)
 {
   dt_iop_module_t *module = (dt_iop_module_t *)user_data;
   dt_undo_history_t *hist = (dt_undo_history_t *)item;
-  dt_dev_invalidate_history_module(hist->after_snapshot, module);
+
+  for(GList *l = hist->after_snapshot; l; l = g_list_next(l))
+  {
+    if(((dt_dev_history_item_t *)l->data)->module == module)
+      _snapshot_item_writable(l)->module = NULL;
+  }
 }
 
 static void _add_module_expander(GList *iop_list, dt_iop_module_t *module)
@@ -639,8 +780,8 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 static void _history_undo_data_free(gpointer data)
 {
   dt_undo_history_t *hist = (dt_undo_history_t *)data;
-  g_list_free_full(hist->before_snapshot, dt_dev_free_history_item);
-  g_list_free_full(hist->after_snapshot, dt_dev_free_history_item);
+  _snapshot_free(hist->before_snapshot);
+  _snapshot_free(hist->after_snapshot);
   g_list_free_full(hist->before_iop_order_list, free);
   g_list_free_full(hist->after_iop_order_list, free);
   free(data);
@@ -661,7 +802,7 @@ static void _lib_history_will_change_callback(gpointer instance, GList *history,
   {
     // history is about to change, here we want to record a snapshot of the history for the undo
     // record previous history
-    g_list_free_full(lib->previous_snapshot, free);
+    g_list_free_full(lib->previous_snapshot, dt_dev_free_history_item);
     g_list_free_full(lib->previous_iop_order_list, free);
     lib->previous_snapshot = history;
     lib->previous_history_end = history_end;
@@ -1022,11 +1163,12 @@ static void _lib_history_change_callback(gpointer instance, gpointer user_data)
   {
     /* record undo/redo history snapshot */
     dt_undo_history_t *hist = malloc(sizeof(dt_undo_history_t));
-    hist->before_snapshot = dt_history_duplicate(d->previous_snapshot);
+    hist->before_snapshot = _snapshot_from_history(d->previous_snapshot, d->last_snapshot, TRUE);
+    d->previous_snapshot = NULL;
     hist->before_end = d->previous_history_end;
     hist->before_iop_order_list = dt_ioppr_iop_order_copy_deep(d->previous_iop_order_list);
 
-    hist->after_snapshot = dt_history_duplicate(darktable.develop->history);
+    hist->after_snapshot = _snapshot_from_history(darktable.develop->history, hist->before_snapshot, FALSE);
     hist->after_end = darktable.develop->history_end;
     hist->after_iop_order_list = dt_ioppr_iop_order_copy_deep(darktable.develop->iop_order_list);
 
@@ -1041,6 +1183,10 @@ static void _lib_history_change_callback(gpointer instance, gpointer user_data)
       hist->request_mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
     }
 
+    // the next snapshot will most likely share its items with this one
+    _snapshot_free(d->last_snapshot);
+    d->last_snapshot = _snapshot_copy(hist->after_snapshot);
+
     dt_undo_record(darktable.undo, self, DT_UNDO_HISTORY, (dt_undo_data_t)hist,
                    _pop_undo, _history_undo_data_free);
   }
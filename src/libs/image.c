@@ -90,6 +90,8 @@ static void _group_helper_function(void)
   int new_group_id = darktable.gui->expanded_group_id;
   GList *imgs = NULL;
   sqlite3_stmt *stmt;
+  // one transaction for all the images, their sidecars written once done
+  dt_database_batch_begin(darktable.db);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images", -1,
                               &stmt, NULL);
   while(sqlite3_step(stmt) == SQLITE_ROW)
@@ -101,6 +103,7 @@ static void _group_helper_function(void)
   }
   imgs = g_list_reverse(imgs); // list was built in reverse order, so un-reverse it
   sqlite3_finalize(stmt);
+  dt_database_batch_commit(darktable.db);
   if(darktable.gui->grouping)
     darktable.gui->expanded_group_id = new_group_id;
   else
@@ -114,6 +117,7 @@ static void _ungroup_helper_function(void)
 {
   GList *imgs = NULL;
   sqlite3_stmt *stmt;
+  dt_database_batch_begin(darktable.db);
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT imgid FROM main.selected_images", -1,
                               &stmt, NULL);
   while(sqlite3_step(stmt) == SQLITE_ROW)
@@ -127,6 +131,7 @@ static void _ungroup_helper_function(void)
     }
   }
   sqlite3_finalize(stmt);
+  dt_database_batch_commit(darktable.db);
   if(imgs != NULL)
   {
     darktable.gui->expanded_group_id = -1;
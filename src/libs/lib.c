@@ -729,8 +729,12 @@ void dt_lib_init_presets(dt_lib_module_t *module)
     sqlite3_finalize(stmt);
   }
 
-  if(module->init_presets)
+  // the built-in presets are already in the db if this darktable version wrote them
+  if(module->init_presets && !dt_gui_presets_builtin_current(FALSE))
+  {
+    dt_gui_presets_builtin_remove(module->plugin_name);
     module->init_presets(module);
+  }
 
   DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_PRESETS_CHANGED,
                                 g_strdup(module->plugin_name));
@@ -1051,6 +1055,7 @@ void dt_lib_init(dt_lib_t *lib)
   memset(lib, 0, sizeof(dt_lib_t));
   darktable.lib->plugins = dt_module_load_modules("/plugins/lighttable", sizeof(dt_lib_module_t),
                                                   dt_lib_load_module, dt_lib_init_module, dt_lib_sort_plugins);
+  dt_gui_presets_builtin_written(FALSE);
 }
 
 void dt_lib_cleanup(dt_lib_t *lib)
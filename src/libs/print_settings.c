@@ -23,6 +23,7 @@
 #include "common/colorspaces.h"
 #include "common/cups_print.h"
 #include "common/file_location.h"
+#include "common/history.h"
 #include "common/image_cache.h"
 #include "common/metadata.h"
 #include "common/pdf.h"
@@ -275,13 +276,112 @@ static int write_image(dt_imageio_module_data_t *data, const char *filename, con
   return 0;
 }
 
+// the last images processed for printing, at print resolution and before the printer profile. printing
+// again with the same sizes, export profile and style (test prints, other printer profiles or papers of the
+// same size, more copies) takes them from here instead of running the pipe again.
+#define PRINT_CACHE_SIZE 4
+
+typedef struct _print_cache_entry_t
+{
+  int32_t imgid;
+  gchar *key;       // everything but the image the processed buffer depends on
+  guint8 *hash;     // the history at the time
+  int hash_len;
+  int width, height;
+  size_t size;
+  void *buf;        // 3 channels of 8 or 16 bit
+} _print_cache_entry_t;
+
+static GList *_print_cache = NULL; // most recent first
+static GMutex _print_cache_lock;
+
+static void _print_cache_entry_free(gpointer data)
+{
+  _print_cache_entry_t *e = (_print_cache_entry_t *)data;
+  g_free(e->key);
+  free(e->hash);
+  free(e->buf);
+  g_free(e);
+}
+
+static gchar *_print_cache_key(const dt_lib_print_job_t *params, const dt_image_box *img, const int bpp)
+{
+  return g_strdup_printf("%d %d %d %d %d %s %d %d %s", img->max_width, img->max_height, bpp,
+                         params->buf_icc_type, params->buf_icc_intent,
+                         params->buf_icc_profile ? params->buf_icc_profile : "",
+                         params->style_append, params->style != NULL, params->style ? params->style : "");
+}
+
+// returns a copy of the cached buffer, NULL if there is none
+static void *_print_cache_get(const int32_t imgid, const gchar *key, const dt_history_hash_values_t *hash,
+                              int *width, int *height)
+{
+  void *buf = NULL;
+  g_mutex_lock(&_print_cache_lock);
+  for(GList *l = _print_cache; l; l = g_list_next(l))
+  {
+    _print_cache_entry_t *e = (_print_cache_entry_t *)l->data;
+    if(e->imgid != imgid || strcmp(e->key, key) || e->hash_len != hash->current_len
+       || (hash->current_len && memcmp(e->hash, hash->current, hash->current_len)))
+      continue;
+    buf = malloc(e->size);
+    if(buf)
+    {
+      memcpy(buf, e->buf, e->size);
+      *width = e->width;
+      *height = e->height;
+      _print_cache = g_list_remove_link(_print_cache, l);
+      _print_cache = g_list_concat(l, _print_cache);
+    }
+    break;
+  }
+  g_mutex_unlock(&_print_cache_lock);
+  return buf;
+}
+
+static void _print_cache_put(const int32_t imgid, gchar *key, const dt_history_hash_values_t *hash,
+                             const void *buf, const int width, const int height, const int bpp)
+{
+  _print_cache_entry_t *e = g_malloc0(sizeof(_print_cache_entry_t));
+  e->size = (size_t)3 * (bpp == 8 ? 1 : 2) * width * height;
+  e->buf = malloc(e->size);
+  if(!e->buf)
+  {
+    g_free(e);
+    g_free(key);
+    return;
+  }
+  memcpy(e->buf, buf, e->size);
+  e->imgid = imgid;
+  e->key = key;
+  e->hash_len = hash->current_len;
+  if(e->hash_len)
+  {
+    e->hash = malloc(e->hash_len);
+    memcpy(e->hash, hash->current, e->hash_len);
+  }
+  e->width = width;
+  e->height = height;
+
+  g_mutex_lock(&_print_cache_lock);
+  _print_cache = g_list_prepend(_print_cache, e);
+  GList *last = g_list_nth(_print_cache, PRINT_CACHE_SIZE);
+  if(last)
+  {
+    last->prev->next = NULL;
+    last->prev = NULL;
+    g_list_free_full(last, _print_cache_entry_free);
+  }
+  g_mutex_unlock(&_print_cache_lock);
+}
+
 // export image imgid with given max_width & max_height, set iwidth & iheight with the
 // final image size as exported.
 static int _export_image(dt_job_t *job, dt_image_box *img)
 {
   dt_lib_print_job_t *params = dt_control_job_get_params(job);
 
-  dt_imageio_module_format_t buf;
+  dt_imageio_module_format_t buf = { 0 };
   buf.mime = mime;
   buf.levels = levels;
   buf.bpp = bpp;
@@ -306,10 +406,30 @@ static int _export_image(dt_job_t *job, dt_image_box *img)
   const gboolean export_masks = FALSE;
   const gboolean is_scaling = FALSE;
 
-  dt_imageio_export_with_flags
-    (img->imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE,
-     high_quality, upscale, is_scaling, FALSE, NULL, FALSE, export_masks, params->buf_icc_type,
-     params->buf_icc_profile, params->buf_icc_intent,  NULL, NULL, 1, 1, NULL);
+  dt_history_hash_values_t hash = { NULL, 0, NULL, 0, NULL, 0 };
+  dt_history_hash_read(img->imgid, &hash);
+  gchar *key = _print_cache_key(params, img, dat.bpp);
+
+  params->buf = _print_cache_get(img->imgid, key, &hash, &dat.head.width, &dat.head.height);
+  if(params->buf)
+  {
+    dt_print(DT_DEBUG_PRINT, "[print] image %d taken from the print cache\n", img->imgid);
+    g_free(key);
+  }
+  else
+  {
+    dt_imageio_export_with_flags
+      (img->imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE,
+       high_quality, upscale, is_scaling, FALSE, NULL, FALSE, export_masks, params->buf_icc_type,
+       params->buf_icc_profile, params->buf_icc_intent,  NULL, NULL, 1, 1, NULL);
+    if(params->buf)
+      _print_cache_put(img->imgid, key, &hash, params->buf, dat.head.width, dat.head.height, dat.bpp);
+    else
+      g_free(key);
+  }
+  free(hash.basic);
+  free(hash.auto_apply);
+  free(hash.current);
 
   img->exp_width = dat.head.width;
   img->exp_height = dat.head.height;
@@ -3020,6 +3140,11 @@ void gui_cleanup(dt_lib_module_t *self)
   g_free(ps->v_piccprofile);
   g_free(ps->v_style);
 
+  g_mutex_lock(&_print_cache_lock);
+  g_list_free_full(_print_cache, _print_cache_entry_free);
+  _print_cache = NULL;
+  g_mutex_unlock(&_print_cache_lock);
+
   free(self->data);
   self->data = NULL;
 }
@@ -15,7 +15,10 @@
     You should have received a copy of the GNU General Public License
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
+#include "bauhaus/bauhaus.h"
 #include "common/darktable.h"
+#include "common/debug.h"
+#include "common/styles.h"
 #include "control/conf.h"
 #include "gui/gtk.h"
 #include "gui/gtkentry.h"
@@ -33,6 +36,7 @@ typedef struct dt_lib_session_t
     GtkLabel *label1;   // Jobcode
     GtkEntry *entry1;   // Jobcode
     GtkButton *button1; // create new
+    GtkWidget *style;   // applied to each shot
   } gui;
 
   /** Data part of the module */
@@ -79,6 +83,33 @@ static void create_callback(GtkButton *button, gpointer user_data)
 #endif
 }
 
+static void _style_changed(GtkWidget *widget, dt_lib_module_t *self)
+{
+  if(darktable.gui->reset) return;
+  dt_conf_set_string("plugins/session/style",
+                     dt_bauhaus_combobox_get(widget) == 0 ? "" : dt_bauhaus_combobox_get_text(widget));
+}
+
+static void _styles_changed_callback(gpointer instance, dt_lib_module_t *self)
+{
+  dt_lib_session_t *lib = self->data;
+
+  ++darktable.gui->reset;
+  dt_bauhaus_combobox_clear(lib->gui.style);
+  dt_bauhaus_combobox_add(lib->gui.style, _("none"));
+  GList *styles = dt_styles_get_list("");
+  for(const GList *st_iter = styles; st_iter; st_iter = g_list_next(st_iter))
+    dt_bauhaus_combobox_add(lib->gui.style, ((dt_style_t *)st_iter->data)->name);
+  g_list_free_full(styles, dt_style_free);
+
+  // back to none if the style is gone
+  const char *style = dt_conf_get_string_const("plugins/session/style");
+  if(!*style || !dt_bauhaus_combobox_set_from_text(lib->gui.style, style))
+    dt_bauhaus_combobox_set(lib->gui.style, 0);
+  --darktable.gui->reset;
+  _style_changed(lib->gui.style, self);
+}
+
 void gui_init(dt_lib_module_t *self)
 {
   self->widget = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
@@ -111,7 +142,16 @@ void gui_init(dt_lib_module_t *self)
   gtk_box_pack_start(GTK_BOX(self->widget), GTK_WIDGET(hbox), TRUE, TRUE, 0);
   gtk_box_pack_start(GTK_BOX(self->widget), GTK_WIDGET(lib->gui.button1), TRUE, TRUE, 0);
 
+  lib->gui.style = dt_bauhaus_combobox_new(NULL);
+  dt_bauhaus_widget_set_label(lib->gui.style, NULL, N_("style"));
+  gtk_widget_set_tooltip_text(lib->gui.style, _("style applied to each image as it arrives from the camera"));
+  _styles_changed_callback(NULL, self);
+  g_signal_connect(G_OBJECT(lib->gui.style), "value-changed", G_CALLBACK(_style_changed), self);
+  gtk_box_pack_start(GTK_BOX(self->widget), lib->gui.style, TRUE, TRUE, 0);
+
   g_signal_connect(G_OBJECT(lib->gui.button1), "clicked", G_CALLBACK(create_callback), self);
+  DT_DEBUG_CONTROL_SIGNAL_CONNECT(darktable.signals, DT_SIGNAL_STYLE_CHANGED,
+                                  G_CALLBACK(_styles_changed_callback), self);
 
   const char *str = dt_conf_get_string_const("plugins/session/jobcode");
   gtk_entry_set_text(lib->gui.entry1, str);
@@ -119,6 +159,7 @@ void gui_init(dt_lib_module_t *self)
 
 void gui_cleanup(dt_lib_module_t *self)
 {
+  DT_DEBUG_CONTROL_SIGNAL_DISCONNECT(darktable.signals, G_CALLBACK(_styles_changed_callback), self);
   free(self->data);
   self->data = NULL;
 }
@@ -32,6 +32,8 @@
 DT_MODULE(1)
 
 #define DT_LIB_SNAPSHOTS_COUNT 4
+// number of snapshots kept decoded in memory, the others are read again from their file when shown
+#define DT_LIB_SNAPSHOTS_DECODED 2
 
 #define HANDLE_SIZE 0.02
 
@@ -42,6 +44,8 @@ typedef struct dt_lib_snapshot_t
   float zoom_x, zoom_y, zoom_scale;
   int32_t zoom, closeup;
   char filename[512];
+  cairo_surface_t *surface; // decoded file, NULL until shown
+  uint32_t shown;           // when it was last shown, the oldest decoded surface is dropped first
 } dt_lib_snapshot_t;
 
 
@@ -60,8 +64,9 @@ typedef struct dt_lib_snapshots_t
   /* snapshots */
   dt_lib_snapshot_t *snapshot;
 
-  /* snapshot cairo surface */
+  /* snapshot cairo surface, owned by the shown snapshot */
   cairo_surface_t *snapshot_image;
+  uint32_t shown_count;
 
 
   /* change snapshot overlay controls */
@@ -72,6 +77,36 @@ typedef struct dt_lib_snapshots_t
   GtkWidget *take_button;
 } dt_lib_snapshots_t;
 
+static void _snapshot_drop_surface(dt_lib_snapshots_t *d, dt_lib_snapshot_t *s)
+{
+  if(!s->surface) return;
+  if(d->snapshot_image == s->surface) d->snapshot_image = NULL;
+  cairo_surface_destroy(s->surface);
+  s->surface = NULL;
+}
+
+static cairo_surface_t *_snapshot_get_surface(dt_lib_snapshots_t *d, dt_lib_snapshot_t *s)
+{
+  if(!s->surface)
+  {
+    int decoded = 0;
+    for(uint32_t k = 0; k < d->size; k++)
+      if(d->snapshot[k].surface) decoded++;
+    while(decoded >= DT_LIB_SNAPSHOTS_DECODED)
+    {
+      dt_lib_snapshot_t *oldest = NULL;
+      for(uint32_t k = 0; k < d->size; k++)
+        if(d->snapshot[k].surface && (!oldest || d->snapshot[k].shown < oldest->shown))
+          oldest = d->snapshot + k;
+      _snapshot_drop_surface(d, oldest);
+      decoded--;
+    }
+    s->surface = dt_cairo_image_surface_create_from_png(s->filename);
+  }
+  s->shown = ++d->shown_count;
+  return s->surface;
+}
+
 /* callback for take snapshot */
 static void _lib_snapshots_add_button_clicked_callback(GtkWidget *widget, gpointer user_data);
 static void _lib_snapshots_toggled_callback(GtkToggleButton *widget, gpointer user_data);
@@ -347,6 +382,7 @@ void gui_reset(dt_lib_module_t *self)
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
   d->num_snapshots = 0;
   d->snapshot_image = NULL;
+  for(uint32_t k = 0; k < d->size; k++) _snapshot_drop_surface(d, d->snapshot + k);
 
   for(uint32_t k = 0; k < d->size; k++)
   {
@@ -427,6 +463,7 @@ void gui_cleanup(dt_lib_module_t *self)
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
 
+  for(uint32_t k = 0; k < d->size; k++) _snapshot_drop_surface(d, d->snapshot + k);
   g_free(d->snapshot);
 
   g_free(self->data);
@@ -456,6 +493,8 @@ static void _lib_snapshots_add_button_clicked_callback(GtkWidget *widget, gpoint
   GtkWidget *b = d->snapshot[0].button;
   d->snapshot[0] = last;
   d->snapshot[0].button = b;
+  /* its file is about to be written again */
+  _snapshot_drop_surface(d, d->snapshot + 0);
   const gchar *name = _("original");
   if(darktable.develop->history_end > 0)
   {
@@ -493,12 +532,8 @@ static void _lib_snapshots_toggled_callback(GtkToggleButton *widget, gpointer us
   /* get current snapshot index */
   int which = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(widget), "snapshot"));
 
-  /* free current snapshot image if exists */
-  if(d->snapshot_image)
-  {
-    cairo_surface_destroy(d->snapshot_image);
-    d->snapshot_image = NULL;
-  }
+  /* the shown surface stays decoded in its snapshot */
+  d->snapshot_image = NULL;
 
   /* check if snapshot is activated */
   if(gtk_toggle_button_get_active(widget))
@@ -511,15 +546,21 @@ static void _lib_snapshots_toggled_callback(GtkToggleButton *widget, gpointer us
     /* setup snapshot */
     d->selected = which;
     dt_lib_snapshot_t *s = d->snapshot + (which - 1);
-    dt_control_set_dev_zoom_y(s->zoom_y);
-    dt_control_set_dev_zoom_x(s->zoom_x);
-    dt_control_set_dev_zoom(s->zoom);
-    dt_control_set_dev_closeup(s->closeup);
-    dt_control_set_dev_zoom_scale(s->zoom_scale);
+    /* the image only has to be processed again if the snapshot was taken at another zoom */
+    if(dt_control_get_dev_zoom_y() != s->zoom_y || dt_control_get_dev_zoom_x() != s->zoom_x
+       || dt_control_get_dev_zoom() != s->zoom || dt_control_get_dev_closeup() != s->closeup
+       || dt_control_get_dev_zoom_scale() != s->zoom_scale)
+    {
+      dt_control_set_dev_zoom_y(s->zoom_y);
+      dt_control_set_dev_zoom_x(s->zoom_x);
+      dt_control_set_dev_zoom(s->zoom);
+      dt_control_set_dev_closeup(s->closeup);
+      dt_control_set_dev_zoom_scale(s->zoom_scale);
 
-    dt_dev_invalidate(darktable.develop);
+      dt_dev_invalidate(darktable.develop);
+    }
 
-    d->snapshot_image = dt_cairo_image_surface_create_from_png(s->filename);
+    d->snapshot_image = _snapshot_get_surface(d, s);
   }
 
   /* redraw center view */
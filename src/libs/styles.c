@@ -22,6 +22,7 @@
 #include "control/conf.h"
 #include "control/control.h"
 #include "control/jobs.h"
+#include "control/jobs/image_jobs.h"
 #include "dtgtk/button.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -226,6 +227,9 @@ static void _styles_row_activated_callback(GtkTreeView *view, GtkTreePath *path,
   if(name)
   {
     dt_styles_apply_to_list(name, list, gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(d->duplicate)));
+    // duplicates are not in the list, look at the whole collection
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG,
+                       dt_image_refresh_thumbnails_job_create(NULL, DT_MIPMAP_NONE));
     g_free(name);
   }
   g_list_free(list);
@@ -723,6 +727,8 @@ static gboolean entry_activated(GtkEntry *entry, gpointer user_data)
   {
     GList *imgs = dt_act_on_get_images(TRUE, TRUE, FALSE);
     dt_styles_apply_to_list(name, imgs, gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(d->duplicate)));
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG,
+                       dt_image_refresh_thumbnails_job_create(NULL, DT_MIPMAP_NONE));
     g_list_free(imgs);
   }
 
@@ -229,6 +229,51 @@ static int database_get_image(lua_State *L)
   return 1;
 }
 
+static void push_image_list(lua_State *L, const GList *imgs)
+{
+  lua_createtable(L, g_list_length((GList *)imgs), 0);
+  int i = 1;
+  for(const GList *l = imgs; l; l = g_list_next(l), i++)
+  {
+    int imgid = GPOINTER_TO_INT(l->data);
+    luaA_push(L, dt_lua_image_t, &imgid);
+    lua_seti(L, -2, i);
+  }
+}
+
+// all images at once, iterating with an index runs a query per image
+static int database_get_images(lua_State *L)
+{
+  GList *imgs = NULL;
+  sqlite3_stmt *stmt = NULL;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT id FROM main.images ORDER BY id DESC", -1,
+                              &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW) imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+  push_image_list(L, imgs);
+  g_list_free(imgs);
+  return 1;
+}
+
+// runs the function with its arguments, everything it writes to the database goes into one transaction
+static int database_batch(lua_State *L)
+{
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  dt_database_batch_begin(darktable.db);
+  const int status = lua_pcall(L, lua_gettop(L) - 1, LUA_MULTRET, 0);
+  dt_database_batch_commit(darktable.db);
+  if(status != LUA_OK) return lua_error(L);
+  return lua_gettop(L);
+}
+
+static int collection_get_images(lua_State *L)
+{
+  GList *imgs = dt_collection_get_all(darktable.collection, -1);
+  push_image_list(L, imgs);
+  g_list_free(imgs);
+  return 1;
+}
+
 static int collection_len(lua_State *L)
 {
   lua_pushinteger(L, dt_collection_get_count(darktable.collection));
@@ -292,6 +337,18 @@ int dt_lua_init_database(lua_State *L)
   lua_pushcfunction(L, database_get_image);
   lua_pushcclosure(L, dt_lua_type_member_common, 1);
   dt_lua_type_register_const_type(L, type_id, "get_image");
+  lua_pushcfunction(L, database_get_images);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "get_images");
+  lua_pushcfunction(L, dt_lua_image_get_properties);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "get_properties");
+  lua_pushcfunction(L, dt_lua_image_set_metadata);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "set_metadata");
+  lua_pushcfunction(L, database_batch);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "batch");
 
   /* database type */
   dt_lua_push_darktable_lib(L);
@@ -302,6 +359,9 @@ int dt_lua_init_database(lua_State *L)
   lua_pushcfunction(L, collection_len);
   lua_pushcfunction(L, collection_numindex);
   dt_lua_type_register_number_const_type(L, type_id);
+  lua_pushcfunction(L, collection_get_images);
+  lua_pushcclosure(L, dt_lua_type_member_common, 1);
+  dt_lua_type_register_const_type(L, type_id, "get_images");
 
   lua_pushcfunction(L, dt_lua_event_multiinstance_register);
   lua_pushcfunction(L, dt_lua_event_multiinstance_destroy);
@@ -127,11 +127,8 @@ static int generate_cache(lua_State *L)
 
   for(int k = max; k >= min && k >= 0; k--)
   {
-    char filename[PATH_MAX] = { 0 };
-    snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-    // if a valid thumbnail file is already on disc - do nothing
-    if(dt_util_test_image_file(filename)) continue;
+    // if a valid thumbnail is already on disc - do nothing
+    if(dt_mipmap_cache_on_disk(darktable.mipmap_cache, imgid, k)) continue;
     // else, generate thumbnail and store in mipmap cache.
     dt_mipmap_buffer_t buf;
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
@@ -224,18 +221,22 @@ static int group_leader_member(lua_State *L)
 }
 
 
+static int image_rating(const dt_image_t *image)
+{
+  int score = image->flags & DT_VIEW_RATINGS_MASK;
+  if(score > 6) score = 5;
+  if(score == DT_VIEW_REJECT) score = -1;
+  // check the reject flag just to be sure
+  if(image->flags & DT_IMAGE_REJECTED) score = -1;
+  return score;
+}
+
 static int rating_member(lua_State *L)
 {
   if(lua_gettop(L) != 3)
   {
     const dt_image_t *my_image = checkreadimage(L, 1);
-    int score = my_image->flags & DT_VIEW_RATINGS_MASK;
-    if(score > 6) score = 5;
-    if(score == DT_VIEW_REJECT) score = -1;
-    // check the reject flag just to be sure
-    if(my_image->flags & DT_IMAGE_REJECTED) score = -1;
-
-    lua_pushinteger(L, score);
+    lua_pushinteger(L, image_rating(my_image));
     releasereadimage(L, my_image);
     return 1;
   }
@@ -471,6 +472,123 @@ static int image_luaautoc_member(lua_State *L)
   }
 }
 
+GList *dt_lua_to_image_list(lua_State *L, int index)
+{
+  index = lua_absindex(L, index);
+  luaL_checktype(L, index, LUA_TTABLE);
+  GList *imgs = NULL;
+  const lua_Integer len = luaL_len(L, index);
+  for(lua_Integer i = 1; i <= len; i++)
+  {
+    lua_geti(L, index, i);
+    dt_lua_image_t imgid;
+    luaA_to(L, dt_lua_image_t, &imgid, -1);
+    lua_pop(L, 1);
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(imgid));
+  }
+  return g_list_reverse(imgs);
+}
+
+// one table of properties per image, each image taken from the cache once for all of them
+int dt_lua_image_get_properties(lua_State *L)
+{
+  GList *imgs = dt_lua_to_image_list(L, 1);
+  const gboolean all = lua_isnoneornil(L, 2);
+  if(!all) luaL_checktype(L, 2, LUA_TTABLE);
+  const lua_Integer n_names = all ? 0 : luaL_len(L, 2);
+  for(lua_Integer k = 1; k <= n_names; k++)
+  {
+    lua_geti(L, 2, k);
+    const char *name = lua_tostring(L, -1);
+    const gboolean known = name && (!strcmp(name, "id") || !strcmp(name, "rating")
+                                    || luaA_struct_has_member_name(L, dt_image_t, name));
+    lua_pop(L, 1);
+    if(!known)
+    {
+      g_list_free(imgs);
+      return luaL_error(L, "unknown image property at index %d", (int)k);
+    }
+  }
+
+  lua_createtable(L, g_list_length(imgs), 0);
+  int i = 1;
+  for(const GList *l = imgs; l; l = g_list_next(l), i++)
+  {
+    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, GPOINTER_TO_INT(l->data), 'r');
+    if(!image)
+    {
+      lua_pushnil(L);
+      lua_seti(L, -2, i);
+      continue;
+    }
+    lua_newtable(L);
+    lua_pushinteger(L, image->id);
+    lua_setfield(L, -2, "id");
+    lua_pushinteger(L, image_rating(image));
+    lua_setfield(L, -2, "rating");
+    if(all)
+    {
+      for(const char *member_name = luaA_struct_next_member_name(L, dt_image_t, LUAA_INVALID_MEMBER_NAME);
+          member_name != LUAA_INVALID_MEMBER_NAME;
+          member_name = luaA_struct_next_member_name(L, dt_image_t, member_name))
+      {
+        luaA_struct_push_member_name(L, dt_image_t, member_name, image);
+        lua_setfield(L, -2, member_name);
+      }
+    }
+    else
+    {
+      for(lua_Integer k = 1; k <= n_names; k++)
+      {
+        lua_geti(L, 2, k);
+        const char *name = lua_tostring(L, -1);
+        if(strcmp(name, "id") && strcmp(name, "rating"))
+        {
+          luaA_struct_push_member_name(L, dt_image_t, name, image);
+          lua_setfield(L, -3, name);
+        }
+        lua_pop(L, 1);
+      }
+    }
+    dt_image_cache_read_release(darktable.image_cache, image);
+    lua_seti(L, -2, i);
+  }
+  g_list_free(imgs);
+  return 1;
+}
+
+// the metadata of all images set in one transaction, the sidecars written afterwards
+int dt_lua_image_set_metadata(lua_State *L)
+{
+  GList *imgs = dt_lua_to_image_list(L, 1);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  GList *key_value = NULL;
+  lua_pushnil(L);
+  while(lua_next(L, 2))
+  {
+    const char *key = lua_type(L, -2) == LUA_TSTRING ? dt_metadata_get_key_by_subkey(lua_tostring(L, -2)) : NULL;
+    if(!key || !lua_isstring(L, -1))
+    {
+      lua_pop(L, 2);
+      g_list_free_full(key_value, g_free);
+      g_list_free(imgs);
+      return luaL_error(L, "invalid metadata, expecting string values for the metadata names");
+    }
+    key_value = g_list_append(key_value, g_strdup(key));
+    key_value = g_list_append(key_value, g_strdup(lua_tostring(L, -1)));
+    lua_pop(L, 1);
+  }
+
+  dt_database_batch_begin(darktable.db);
+  dt_metadata_set_list(imgs, key_value, FALSE);
+  dt_image_synch_xmps(imgs);
+  dt_database_batch_commit(darktable.db);
+
+  g_list_free_full(key_value, g_free);
+  g_list_free(imgs);
+  return 0;
+}
+
 int dt_lua_init_image(lua_State *L)
 {
   luaA_struct(L, dt_image_t);
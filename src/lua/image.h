@@ -25,6 +25,12 @@ typedef int dt_lua_image_t; // wrapper for dt_image_t id
 
 int dt_lua_init_image(lua_State *L);
 
+// the images of the table at index as a list of ids
+GList *dt_lua_to_image_list(lua_State *L, int index);
+// darktable.database.get_properties and set_metadata, taking a table of images
+int dt_lua_image_get_properties(lua_State *L);
+int dt_lua_image_set_metadata(lua_State *L);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -75,12 +75,129 @@ static int default_dimension_wrapper(struct dt_imageio_module_storage_t *self, d
   return 0;
 };
 
+// the processed image as the format would have written it, for store_buffer
+typedef struct
+{
+  dt_imageio_module_format_t *format;
+  uint8_t *buf;
+  size_t size;
+  int width, height, bpp;
+  uint8_t *exif;
+  int exif_len;
+} lua_storage_buffer_t;
+
+// the export runs on the thread calling store, write_image only gets the format's own data
+static __thread lua_storage_buffer_t *capture_buffer = NULL;
+
+static int capture_write_image(dt_imageio_module_data_t *data, const char *filename, const void *in,
+                               dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                               void *exif, int exif_len, int imgid, int num, int total,
+                               struct dt_dev_pixelpipe_t *pipe, const gboolean export_masks)
+{
+  lua_storage_buffer_t *b = capture_buffer;
+  b->width = data->width;
+  b->height = data->height;
+  b->bpp = b->format->bpp(data);
+  // 8 and 16 bit integer or 32 bit float per channel, 4 channels
+  b->size = (size_t)4 * b->width * b->height * (b->bpp / 8);
+  b->buf = g_try_malloc(b->size);
+  if(!b->buf) return 1;
+  memcpy(b->buf, in, b->size);
+  if(exif && exif_len > 0)
+  {
+    b->exif = g_malloc(exif_len);
+    memcpy(b->exif, exif, exif_len);
+    b->exif_len = exif_len;
+  }
+  return 0;
+}
+
+static int store_buffer(struct dt_imageio_module_storage_t *self, struct dt_imageio_module_data_t *self_data,
+                        const int imgid, dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata,
+                        const int num, const int total, const gboolean high_quality, const gboolean upscale,
+                        const gboolean export_masks, dt_colorspaces_color_profile_type_t icc_type,
+                        const gchar *icc_filename, dt_iop_color_intent_t icc_intent,
+                        dt_export_metadata_t *metadata)
+{
+  // the chosen format with its settings, the pixels are kept instead of being written
+  dt_imageio_module_format_t capture = *format;
+  capture.write_image = capture_write_image;
+  capture.write_image_begin = NULL;
+  capture.write_image_rows = NULL;
+  capture.write_image_finish = NULL;
+  lua_storage_buffer_t b = { .format = format };
+  capture_buffer = &b;
+  const int failed = dt_imageio_export(imgid, "unused", &capture, fdata, high_quality, upscale, TRUE, export_masks,
+                                       icc_type, icc_filename, icc_intent, self, self_data, num, total, metadata);
+  capture_buffer = NULL;
+  if(failed || !b.buf)
+  {
+    fprintf(stderr, "[%s] could not export image %d\n", self->name(self), imgid);
+    g_free(b.buf);
+    g_free(b.exif);
+    return 1;
+  }
+
+  lua_storage_t *d = (lua_storage_t *)self_data;
+
+  dt_lua_lock();
+  lua_State *L = darktable.lua_state.state;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, "dt_lua_storages");
+  lua_getfield(L, -1, self->plugin_name);
+  lua_getfield(L, -1, "store_buffer");
+
+  luaA_push_type(L, self->parameter_lua_type, self_data);
+  luaA_push(L, dt_lua_image_t, &imgid);
+  luaA_push_type(L, format->parameter_lua_type, fdata);
+  lua_pushlstring(L, (const char *)b.buf, b.size);
+  g_free(b.buf);
+  lua_newtable(L);
+  lua_pushinteger(L, b.width);
+  lua_setfield(L, -2, "width");
+  lua_pushinteger(L, b.height);
+  lua_setfield(L, -2, "height");
+  lua_pushinteger(L, b.bpp);
+  lua_setfield(L, -2, "bpp");
+  if(b.exif)
+  {
+    lua_pushlstring(L, (const char *)b.exif, b.exif_len);
+    lua_setfield(L, -2, "exif");
+    g_free(b.exif);
+  }
+  lua_pushinteger(L, num);
+  lua_pushinteger(L, total);
+  lua_pushboolean(L, high_quality);
+  push_lua_data(L, d);
+  dt_lua_goto_subtable(L, "extra");
+  dt_lua_treated_pcall(L, 9, 0);
+  lua_pop(L, 2);
+  dt_lua_unlock();
+  return 0;
+}
+
+static gboolean has_store_buffer(struct dt_imageio_module_storage_t *self)
+{
+  dt_lua_lock();
+  lua_State *L = darktable.lua_state.state;
+  lua_getfield(L, LUA_REGISTRYINDEX, "dt_lua_storages");
+  lua_getfield(L, -1, self->plugin_name);
+  lua_getfield(L, -1, "store_buffer");
+  const gboolean result = !lua_isnil(L, -1);
+  lua_pop(L, 3);
+  dt_lua_unlock();
+  return result;
+}
+
 static int store_wrapper(struct dt_imageio_module_storage_t *self, struct dt_imageio_module_data_t *self_data,
                          const int imgid, dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata,
                          const int num, const int total, const gboolean high_quality, const gboolean upscale,
                          const gboolean export_masks, dt_colorspaces_color_profile_type_t icc_type,
                          const gchar *icc_filename, dt_iop_color_intent_t icc_intent, dt_export_metadata_t *metadata)
 {
+  if(has_store_buffer(self))
+    return store_buffer(self, self_data, imgid, format, fdata, num, total, high_quality, upscale, export_masks,
+                        icc_type, icc_filename, icc_intent, metadata);
 
   /* construct a temporary file name */
   char tmpdir[PATH_MAX] = { 0 };
@@ -371,7 +488,7 @@ static dt_imageio_module_storage_t ref_storage = {
 
 static int register_storage(lua_State *L)
 {
-  lua_settop(L, 7);
+  lua_settop(L, 8);
   lua_getfield(L, LUA_REGISTRYINDEX, "dt_lua_storages");
   lua_newtable(L);
 
@@ -443,6 +560,13 @@ static int register_storage(lua_State *L)
   }
 
 
+  if(!lua_isnoneornil(L, 8))
+  {
+    luaL_checktype(L, 8, LUA_TFUNCTION);
+    lua_pushvalue(L, 8);
+    lua_setfield(L, -2, "store_buffer");
+  }
+
   lua_setfield(L, -2, plugin_name);
 
   char tmp[1024];
@@ -174,8 +174,26 @@ static int tag_delete(lua_State *L)
 }
 
 
+// a table of images gets tagged (or untagged) in one go, with a single transaction
+static int tag_images(lua_State *L, const int tag_index, const int images_index, const gboolean attach)
+{
+  dt_lua_tag_t tagid = 0;
+  luaA_to(L, dt_lua_tag_t, &tagid, tag_index);
+  GList *imgs = dt_lua_to_image_list(L, images_index);
+  dt_database_batch_begin(darktable.db);
+  const gboolean changed = attach ? dt_tag_attach_images(tagid, imgs, TRUE)
+                                  : dt_tag_detach_images(tagid, imgs, TRUE);
+  if(changed) dt_image_synch_xmps(imgs);
+  dt_database_batch_commit(darktable.db);
+  if(changed) DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+  g_list_free(imgs);
+  return 0;
+}
+
 int dt_lua_tag_attach(lua_State *L)
 {
+  if(lua_istable(L, 1)) return tag_images(L, 2, 1, TRUE);
+  if(lua_istable(L, 2)) return tag_images(L, 1, 2, TRUE);
   dt_lua_image_t imgid = -1;
   dt_lua_tag_t tagid = 0;
   if(luaL_testudata(L, 1, "dt_lua_image_t"))
@@ -198,6 +216,8 @@ int dt_lua_tag_attach(lua_State *L)
 
 int dt_lua_tag_detach(lua_State *L)
 {
+  if(lua_istable(L, 1)) return tag_images(L, 2, 1, FALSE);
+  if(lua_istable(L, 2)) return tag_images(L, 1, 2, FALSE);
   dt_lua_image_t imgid;
   dt_lua_tag_t tagid;
   if(luaL_testudata(L, 1, "dt_lua_image_t"))
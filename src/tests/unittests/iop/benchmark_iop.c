@@ -0,0 +1,437 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2022 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Micro-benchmark of the process() of a single iop, fed with tiled test
+ * images. Not a unit test, it is built next to them but not run by ctest.
+ *
+ * Please see ../README.md for more detailed documentation.
+ */
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/exif.h"
+#include "common/iop_order.h"
+#include "common/iop_profile.h"
+#include "common/opencl.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../util/testimg.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+typedef struct bench_size_t
+{
+  int width;
+  int height;
+} bench_size_t;
+
+typedef struct bench_options_t
+{
+  const char *op;
+  const char *params;  // hex or gz encoded, as in the xmp history
+  const char *preset;
+  const char *image;   // name of the test image pattern
+  GArray *sizes;       // bench_size_t
+  int warmup;
+  int iterations;
+  gboolean cpu;
+  gboolean opencl;
+} bench_options_t;
+
+#define BENCH_DEFAULT_SIZE 2048
+
+
+static void usage(const char *progname)
+{
+  fprintf(stderr,
+          "usage: %s [options] <operation> [-- <darktable options>]\n"
+          "\n"
+          "options:\n"
+          "  --params <hex|gz>     module params as stored in the xmp history\n"
+          "  --preset <name>       use the params of a preset instead\n"
+          "  --image <pattern>     rgb (default), grey, clipping or flat\n"
+          "  --size <W>x<H>        image size, can be given several times\n"
+          "                        (default %dx%d)\n"
+          "  --warmup <n>          untimed runs before measuring (default 2)\n"
+          "  --iterations <n>      timed runs (default 10)\n"
+          "  --cpu                 only benchmark the cpu code path\n"
+          "  --opencl              only benchmark the opencl code path\n",
+          progname, BENCH_DEFAULT_SIZE, BENCH_DEFAULT_SIZE);
+}
+
+/*
+ * TEST IMAGES
+ */
+
+static Testimg *_gen_pattern(const char *name)
+{
+  if(!strcmp(name, "rgb")) return testimg_gen_rgb_space(TESTIMG_STD_WIDTH);
+  if(!strcmp(name, "grey")) return testimg_gen_grey_space(TESTIMG_STD_WIDTH);
+  if(!strcmp(name, "clipping"))
+    return testimg_gen_grey_with_rgb_clipping(TESTIMG_STD_WIDTH);
+  if(!strcmp(name, "flat")) return testimg_gen_all_grey(1, 1, 0.18f);
+  return NULL;
+}
+
+// the test images are small, repeat them over a buffer of the benchmarked size
+static float *_tile_pattern(const Testimg *const ti, const int width,
+  const int height)
+{
+  float *buf = dt_alloc_align_float((size_t)width * height * 4);
+  if(!buf) return NULL;
+  for(int y = 0; y < height; y++)
+    for(int x = 0; x < width; x++)
+      memcpy(buf + 4 * ((size_t)y * width + x),
+             get_pixel(ti, x % ti->width, y % ti->height), 4 * sizeof(float));
+  return buf;
+}
+
+/*
+ * PARAMS
+ */
+
+static int _load_preset(dt_iop_module_t *module, const char *preset)
+{
+  int res = 1;
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT op_params, op_version"
+                              " FROM data.presets"
+                              " WHERE operation = ?1 AND name = ?2",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, module->op, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, preset, -1, SQLITE_TRANSIENT);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const void *blob = sqlite3_column_blob(stmt, 0);
+    const int len = sqlite3_column_bytes(stmt, 0);
+    const int version = sqlite3_column_int(stmt, 1);
+    if(version != module->version() || len != module->params_size)
+      fprintf(stderr, "[benchmark_iop] preset `%s' is for version %d of `%s'\n",
+              preset, version, module->op);
+    else
+    {
+      memcpy(module->params, blob, len);
+      res = 0;
+    }
+  }
+  else
+    fprintf(stderr, "[benchmark_iop] no preset `%s' for `%s'\n", preset,
+            module->op);
+  sqlite3_finalize(stmt);
+  return res;
+}
+
+static int _load_params(dt_iop_module_t *module, const bench_options_t *opt)
+{
+  memcpy(module->params, module->default_params, module->params_size);
+  memcpy(module->blend_params, module->default_blendop_params,
+         sizeof(dt_develop_blend_params_t));
+
+  if(opt->preset) return _load_preset(module, opt->preset);
+
+  if(opt->params)
+  {
+    int len = 0;
+    unsigned char *blob = dt_exif_xmp_decode(opt->params, strlen(opt->params),
+                                             &len);
+    if(!blob || len != module->params_size)
+    {
+      fprintf(stderr, "[benchmark_iop] params don't match version %d of `%s'"
+              " (%d bytes instead of %d)\n", module->version(), module->op,
+              len, module->params_size);
+      free(blob);
+      return 1;
+    }
+    memcpy(module->params, blob, len);
+    free(blob);
+  }
+  return 0;
+}
+
+/*
+ * BENCHMARK
+ */
+
+static int _cmp_double(const void *a, const void *b)
+{
+  const double da = *(const double *)a;
+  const double db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+static void _report(const char *op, const dt_iop_roi_t *const roi,
+  const char *device, double *times, const int count)
+{
+  if(count == 0) return;
+  qsort(times, count, sizeof(double), _cmp_double);
+  const double median = (count & 1)
+    ? times[count / 2]
+    : 0.5 * (times[count / 2 - 1] + times[count / 2]);
+  const double pixels = (double)roi->width * roi->height;
+  printf("%-20s %5dx%-5d %-6s median %10.3f ms %10.2f Mpx/s\n", op,
+         roi->width, roi->height, device, 1000.0 * median,
+         median > 0.0 ? pixels / median * 1e-6 : 0.0);
+}
+
+static void _bench_size(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe,
+  dt_dev_pixelpipe_iop_t *piece, const Testimg *const pattern,
+  const bench_size_t *size, const bench_options_t *opt)
+{
+  dt_iop_roi_t full = { 0, 0, size->width, size->height, 1.0f };
+  pipe->iwidth = piece->iwidth = size->width;
+  pipe->iheight = piece->iheight = size->height;
+  piece->buf_in = piece->buf_out = full;
+  dt_iop_commit_params(module, module->params, module->blend_params, pipe,
+                       piece);
+
+  // let the geometry modules tell the actual regions
+  dt_iop_roi_t roi_out = full, roi_in = full;
+  module->modify_roi_out(module, piece, &roi_out, &full);
+  module->modify_roi_in(module, piece, &roi_out, &roi_in);
+  piece->buf_out = roi_out;
+
+  float *in = _tile_pattern(pattern, roi_in.width, roi_in.height);
+  float *out = dt_alloc_align_float((size_t)roi_out.width * roi_out.height
+                                    * 4);
+  double *times = g_new(double, opt->iterations);
+  if(!in || !out)
+  {
+    fprintf(stderr, "[benchmark_iop] out of memory for %dx%d\n",
+            size->width, size->height);
+    goto error;
+  }
+
+  if(opt->cpu)
+  {
+    for(int k = 0; k < opt->warmup + opt->iterations; k++)
+    {
+      const double start = dt_get_wtime();
+      module->process(module, piece, in, out, &roi_in, &roi_out);
+      if(k >= opt->warmup) times[k - opt->warmup] = dt_get_wtime() - start;
+    }
+    _report(module->op, &roi_out, "cpu", times, opt->iterations);
+  }
+
+#ifdef HAVE_OPENCL
+  if(opt->opencl && module->process_cl && piece->process_cl_ready
+     && dt_opencl_is_enabled())
+  {
+    const int devid = dt_opencl_lock_device(pipe->type);
+    if(devid < 0)
+      fprintf(stderr, "[benchmark_iop] no opencl device available\n");
+    else
+    {
+      pipe->devid = devid;
+      cl_mem dev_in = dt_opencl_copy_host_to_device(devid, in, roi_in.width,
+                                                    roi_in.height,
+                                                    4 * sizeof(float));
+      cl_mem dev_out = dt_opencl_alloc_device(devid, roi_out.width,
+                                              roi_out.height,
+                                              4 * sizeof(float));
+      int done = 0;
+      if(dev_in && dev_out)
+      {
+        for(; done < opt->warmup + opt->iterations; done++)
+        {
+          const double start = dt_get_wtime();
+          const int ok = module->process_cl(module, piece, dev_in, dev_out,
+                                            &roi_in, &roi_out);
+          dt_opencl_finish(devid);
+          if(!ok) break;
+          if(done >= opt->warmup)
+            times[done - opt->warmup] = dt_get_wtime() - start;
+        }
+      }
+      if(done < opt->warmup + opt->iterations)
+        fprintf(stderr, "[benchmark_iop] opencl processing failed for %dx%d\n",
+                size->width, size->height);
+      else
+        _report(module->op, &roi_out, "opencl", times, opt->iterations);
+      dt_opencl_release_mem_object(dev_in);
+      dt_opencl_release_mem_object(dev_out);
+      dt_opencl_unlock_device(devid);
+      pipe->devid = -1;
+    }
+  }
+#endif
+
+error:
+  g_free(times);
+  dt_free_align(in);
+  dt_free_align(out);
+}
+
+static int _parse_size(const char *str, bench_size_t *size)
+{
+  return sscanf(str, "%dx%d", &size->width, &size->height) == 2
+         && size->width > 0 && size->height > 0;
+}
+
+int main(int argc, char *argv[])
+{
+  bench_options_t opt = { .image = "rgb", .warmup = 2, .iterations = 10,
+                          .cpu = TRUE, .opencl = TRUE };
+  opt.sizes = g_array_new(FALSE, FALSE, sizeof(bench_size_t));
+
+  int k = 1;
+  for(; k < argc; k++)
+  {
+    if(!strcmp(argv[k], "--"))
+    {
+      k++;
+      break;
+    }
+    else if(!strcmp(argv[k], "--params") && k + 1 < argc)
+      opt.params = argv[++k];
+    else if(!strcmp(argv[k], "--preset") && k + 1 < argc)
+      opt.preset = argv[++k];
+    else if(!strcmp(argv[k], "--image") && k + 1 < argc)
+      opt.image = argv[++k];
+    else if(!strcmp(argv[k], "--size") && k + 1 < argc)
+    {
+      bench_size_t size;
+      if(!_parse_size(argv[++k], &size))
+      {
+        usage(argv[0]);
+        exit(1);
+      }
+      g_array_append_val(opt.sizes, size);
+    }
+    else if(!strcmp(argv[k], "--warmup") && k + 1 < argc)
+      opt.warmup = MAX(atoi(argv[++k]), 0);
+    else if(!strcmp(argv[k], "--iterations") && k + 1 < argc)
+      opt.iterations = MAX(atoi(argv[++k]), 1);
+    else if(!strcmp(argv[k], "--cpu"))
+      opt.opencl = FALSE;
+    else if(!strcmp(argv[k], "--opencl"))
+      opt.cpu = FALSE;
+    else if(argv[k][0] != '-' && !opt.op)
+      opt.op = argv[k];
+    else
+    {
+      usage(argv[0]);
+      exit(1);
+    }
+  }
+
+  Testimg *pattern = _gen_pattern(opt.image);
+  if(!opt.op || !pattern)
+  {
+    usage(argv[0]);
+    exit(1);
+  }
+  if(opt.sizes->len == 0)
+  {
+    const bench_size_t size = { BENCH_DEFAULT_SIZE, BENCH_DEFAULT_SIZE };
+    g_array_append_val(opt.sizes, size);
+  }
+
+  // the remaining arguments go to darktable, e.g. --conf or -d perf
+  int m_argc = 0;
+  char **m_arg = malloc(sizeof(char *) * (5 + argc - k + 1));
+  m_arg[m_argc++] = "benchmark_iop";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=never";
+  for(; k < argc; k++) m_arg[m_argc++] = argv[k];
+  m_arg[m_argc] = NULL;
+
+  if(dt_init(m_argc, m_arg, FALSE, TRUE, NULL)) exit(1);
+
+  dt_iop_module_so_t *so = NULL;
+  for(GList *l = darktable.iop; l; l = g_list_next(l))
+    if(!strcmp(((dt_iop_module_so_t *)l->data)->op, opt.op))
+      so = (dt_iop_module_so_t *)l->data;
+  if(!so)
+  {
+    fprintf(stderr, "[benchmark_iop] unknown operation `%s'\n", opt.op);
+    exit(1);
+  }
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, FALSE);
+  dev.iop_order_list = dt_ioppr_get_iop_order_list_version(DT_IOP_ORDER_V30);
+
+  dt_iop_module_t *module = (dt_iop_module_t *)calloc(1, sizeof(dt_iop_module_t));
+  if(dt_iop_load_module_by_so(module, so, &dev))
+  {
+    fprintf(stderr, "[benchmark_iop] can't load `%s'\n", opt.op);
+    exit(1);
+  }
+  module->iop_order = dt_ioppr_get_iop_order(dev.iop_order_list, opt.op, 0);
+  dt_iop_reload_defaults(module);
+  if(_load_params(module, &opt)) exit(1);
+
+  // a pipe with just this module, working on rgb in linear rec2020
+  dt_dev_pixelpipe_t pipe;
+  dt_dev_pixelpipe_init_dummy(&pipe, 0, 0);
+  pipe.image = dev.image_storage;
+  pipe.iop_order_list = dt_ioppr_iop_order_copy_deep(dev.iop_order_list);
+  pipe.iscale = 1.0f;
+  pipe.dsc = (dt_iop_buffer_dsc_t){ .channels = 4, .datatype = TYPE_FLOAT,
+                                    .cst = IOP_CS_RGB };
+  dt_ioppr_set_pipe_input_profile_info(&dev, &pipe, DT_COLORSPACE_LIN_REC2020,
+                                       "", DT_INTENT_PERCEPTUAL, NULL);
+  dt_ioppr_set_pipe_work_profile_info(&dev, &pipe, DT_COLORSPACE_LIN_REC2020,
+                                      "", DT_INTENT_PERCEPTUAL);
+  dt_ioppr_set_pipe_output_profile_info(&dev, &pipe, DT_COLORSPACE_SRGB, "",
+                                        DT_INTENT_PERCEPTUAL);
+
+  dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)calloc(1, sizeof(dt_dev_pixelpipe_iop_t));
+  piece->enabled = TRUE;
+  piece->request_histogram = DT_REQUEST_NONE;
+  piece->colors = 4;
+  piece->iscale = 1.0f;
+  piece->module = module;
+  piece->pipe = &pipe;
+  piece->dsc_in = piece->dsc_out = pipe.dsc;
+  piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
+  dt_iop_init_pipe(module, &pipe, piece);
+  pipe.iop = g_list_append(pipe.iop, module);
+  pipe.nodes = g_list_append(pipe.nodes, piece);
+
+  for(guint s = 0; s < opt.sizes->len; s++)
+    _bench_size(module, &pipe, piece, pattern,
+                &g_array_index(opt.sizes, bench_size_t, s), &opt);
+
+  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_iop_cleanup_module(module);
+  free(module);
+  dt_dev_cleanup(&dev);
+  testimg_free(pattern);
+  g_array_free(opt.sizes, TRUE);
+
+  dt_cleanup();
+  free(m_arg);
+  return 0;
+}
+
@@ -136,6 +136,7 @@ static const test_t test_broken_variables = {
     {"$(FILE_NAME", "$(FILE_NAME"},
     {"x$(FILE_NAME", "x$(FILE_NAME"},
     {"x$(TITLE-$(FILE_NAME)", "x$(TITLE-abcdef12345abcdef"},
+    {"$(FILE_NAME/abc)", "$(FILE_NAME/abc)"},
 
     {NULL, NULL}
   }
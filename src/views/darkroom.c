@@ -519,6 +519,7 @@ void expose(
 
   if(dev->pipe->output_backbuf && // do we have an image?
     dev->pipe->output_imgid == dev->image_storage.id && // is the right image?
+    !(dev->mask_interactive && dev->preview_pipe->output_backbuf) && // or are shapes dragged on the preview?
     dev->pipe->backbuf_scale == backbuf_scale && // is this the zoom scale we want to display?
     dev->pipe->backbuf_zoom_x == zoom_x && dev->pipe->backbuf_zoom_y == zoom_y)
   {
@@ -1168,6 +1169,47 @@ static void _view_darkroom_filmstrip_activate_callback(gpointer instance, int32_
   }
 }
 
+// load the raw of the images around imgid in the background, in the direction of travel first
+static void _dev_prefetch_neighbours(const int32_t imgid, const int diff)
+{
+  const size_t budget = (size_t)dt_conf_get_int("plugins/darkroom/prefetch_memory") << 20;
+  if(!budget) return;
+
+  // leave the full buffer cache room for the image being edited and the thumbnails
+  const int slots = MIN(2, (int)darktable.mipmap_cache->mip_full.cache.cost_quota - 2);
+  if(slots <= 0) return;
+
+  const int step = diff < 0 ? -1 : 1;
+  sqlite3_stmt *stmt = dt_database_prepare_cached(darktable.db, dt_database_get(darktable.db),
+                                                  "SELECT imgid FROM memory.collected_images"
+                                                  " WHERE rowid=(SELECT rowid FROM memory.collected_images"
+                                                  "              WHERE imgid=?1)+?2");
+  size_t used = 0;
+  for(int k = 0; k < slots; k++)
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, k == 0 ? step : -step);
+    const int32_t id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    sqlite3_reset(stmt);
+    if(id <= 0 || id == imgid) continue;
+
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, id, 'r');
+    if(!img) continue;
+    // the layout of the buffer is only known once loaded, assume the largest before
+    const size_t bpp = img->buf_dsc.channels ? dt_iop_buffer_dsc_to_bpp(&img->buf_dsc) : 4 * sizeof(float);
+    const size_t size = (size_t)img->width * img->height * bpp;
+    dt_image_cache_read_release(darktable.image_cache, img);
+
+    if(used + size > budget) break;
+    used += size;
+
+    // the raw for the full pipe and the downscaled input of the preview pipe
+    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, id, DT_MIPMAP_FULL, DT_MIPMAP_PREFETCH, 'r');
+    dt_mipmap_cache_get(darktable.mipmap_cache, NULL, id, DT_MIPMAP_F, DT_MIPMAP_PREFETCH, 'r');
+  }
+  dt_database_release_cached(darktable.db, stmt);
+}
+
 static void dt_dev_jump_image(dt_develop_t *dev, int diff, gboolean by_key)
 {
   if(dev->image_loading) return;
@@ -1224,6 +1266,9 @@ static void dt_dev_jump_image(dt_develop_t *dev, int diff, gboolean by_key)
   _dev_change_image(dev, new_id);
   dt_thumbtable_set_offset(dt_ui_thumbtable(darktable.gui->ui), new_offset, TRUE);
 
+  // the next step is likely to go the same way
+  _dev_prefetch_neighbours(new_id, diff);
+
   // if it's a change by key_press, we set mouse_over to the active image
   if(by_key) dt_control_set_mouse_over_id(new_id);
 }
@@ -3003,7 +3048,7 @@ void enter(dt_view_t *self)
   // take a copy of the image struct for convenience.
 
   dt_dev_load_image(darktable.develop, dev->image_storage.id);
-
+  _dev_prefetch_neighbours(dev->image_storage.id, 1);
 
   /*
    * add IOP modules to plugin list
@@ -3133,6 +3178,8 @@ void leave(dt_view_t *self)
                                      G_CALLBACK(_display_module_trouble_message_callback),
                                      (gpointer)self);
 
+  darktable.develop->mask_interactive = FALSE;
+
   // store groups for next time:
   dt_conf_set_int("plugins/darkroom/groups", dt_dev_modulegroups_get(darktable.develop));
 
@@ -3857,6 +3904,12 @@ void configure(dt_view_t *self, int wd, int ht)
   dev->orig_width = wd;
   dev->orig_height = ht;
   dt_dev_configure(dev, wd, ht);
+
+  // the preview stands in for the image until the full pipe is done, and is shown by the navigation and the
+  // scopes which are at most as large as their panel
+  const int panels = MAX(dt_ui_panel_get_size(darktable.gui->ui, DT_UI_PANEL_LEFT),
+                         dt_ui_panel_get_size(darktable.gui->ui, DT_UI_PANEL_RIGHT));
+  dev->preview_consumers_size = MAX(MAX(dev->width, dev->height), panels) * darktable.gui->ppd;
 }
 
 void init_key_accels(dt_view_t *self)
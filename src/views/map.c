@@ -60,6 +60,28 @@ typedef struct dt_map_image_t
   int thumbnail;
 } dt_map_image_t;
 
+// the spatial index is a quadtree flattened in a sorted array: the points are ordered by the morton code of
+// their web mercator position, so each cell of each level is a contiguous run of points.
+#define DT_MAP_INDEX_DEPTH 16
+#define DT_MAP_INDEX_LEVELS (DT_MAP_INDEX_DEPTH + 1)
+// above this number of images in view dbscan gets too slow, the groups are the index cells instead
+#define DT_MAP_DBSCAN_MAX_POINTS 4000
+#define DT_MAP_MAX_VISIBLE_CELLS 4096
+
+typedef struct dt_map_index_point_t
+{
+  uint32_t code;
+  int imgid;
+  double longitude, latitude;
+} dt_map_index_point_t;
+
+typedef struct dt_map_index_cell_t
+{
+  uint32_t code;
+  int start;
+  int count;
+} dt_map_index_cell_t;
+
 typedef struct dt_map_t
 {
   gboolean entering;
@@ -91,6 +113,15 @@ typedef struct dt_map_t
     int time_out;
     GList *others;
   } loc;
+  struct
+  {
+    gboolean valid;
+    dt_map_index_point_t *points;
+    int count;
+    // occupied cells and their image count, per level, computed on first use
+    dt_map_index_cell_t *cells[DT_MAP_INDEX_LEVELS];
+    int nb_cells[DT_MAP_INDEX_LEVELS];
+  } index;
 } dt_map_t;
 
 #define UNCLASSIFIED -1
@@ -180,6 +211,7 @@ static void _dbscan(dt_geo_position_t *points, unsigned int num_points, double e
                     unsigned int minpts);
 static gboolean _view_map_prefs_changed(dt_map_t *lib);
 static void _view_map_build_main_query(dt_map_t *lib);
+static void _view_map_index_invalidate(dt_map_t *lib);
 
 /* center map to on the baricenter of the image list */
 static gboolean _view_map_center_on_image_list(dt_view_t *self, const char *table);
@@ -767,6 +799,7 @@ void cleanup(dt_view_t *self)
       g_free(lib->points);
       lib->points = NULL;
     }
+    _view_map_index_invalidate(lib);
     if(lib->images)
     {
       g_slist_free_full(lib->images, g_free);
@@ -857,6 +890,7 @@ static gboolean _view_map_redraw(gpointer user_data)
 {
   dt_view_t *self = (dt_view_t *)user_data;
   dt_map_t *lib = (dt_map_t *)self->data;
+  _view_map_index_invalidate(lib);
   g_signal_emit_by_name(lib->map, "changed");
   return FALSE; // remove the function again
 }
@@ -1268,6 +1302,141 @@ static void _view_map_get_bounding_box(dt_map_t *lib, dt_map_box_t *bbox)
   memcpy(bbox, &box, sizeof(dt_map_box_t));
 }
 
+static uint32_t _view_map_index_spread(uint32_t v)
+{
+  v &= 0xffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// web mercator position of a point on a 2^DT_MAP_INDEX_DEPTH grid, so the cells are squares on screen
+static void _view_map_index_position(const double lon, const double lat, uint32_t *x, uint32_t *y)
+{
+  const double grid = 1 << DT_MAP_INDEX_DEPTH;
+  const double rlat = CLAMP(lat, -85.0511, 85.0511) * M_PI / 180.0;
+  const double mx = (CLAMP(lon, -180.0, 180.0) + 180.0) / 360.0;
+  const double my = (1.0 - log(tan(M_PI / 4.0 + rlat / 2.0)) / M_PI) / 2.0;
+  *x = CLAMP((int)(mx * grid), 0, (int)grid - 1);
+  *y = CLAMP((int)(my * grid), 0, (int)grid - 1);
+}
+
+static inline uint32_t _view_map_index_code(const uint32_t x, const uint32_t y)
+{
+  return _view_map_index_spread(x) | (_view_map_index_spread(y) << 1);
+}
+
+static int _view_map_index_sort(const void *a, const void *b)
+{
+  const uint32_t ca = ((dt_map_index_point_t *)a)->code;
+  const uint32_t cb = ((dt_map_index_point_t *)b)->code;
+  return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
+
+static int _view_map_position_sort(const void *a, const void *b)
+{
+  // dbscan expects the points ordered by longitude
+  const double xa = ((dt_geo_position_t *)a)->x;
+  const double xb = ((dt_geo_position_t *)b)->x;
+  return xa < xb ? -1 : xa > xb ? 1 : 0;
+}
+
+static void _view_map_index_invalidate(dt_map_t *lib)
+{
+  g_free(lib->index.points);
+  lib->index.points = NULL;
+  lib->index.count = 0;
+  for(int l = 0; l < DT_MAP_INDEX_LEVELS; l++)
+  {
+    g_free(lib->index.cells[l]);
+    lib->index.cells[l] = NULL;
+    lib->index.nb_cells[l] = 0;
+  }
+  lib->index.valid = FALSE;
+}
+
+// load all the geotagged images once, panning and zooming then only walk the index
+static void _view_map_index_build(dt_map_t *lib)
+{
+  _view_map_index_invalidate(lib);
+
+  dt_times_t start;
+  dt_get_times(&start);
+
+  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->main_query);
+  DT_DEBUG_SQLITE3_RESET(lib->main_query);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 1, -180.0);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 2, 180.0);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 3, 90.0);
+  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 4, -90.0);
+
+  int allocated = 0;
+  while(sqlite3_step(lib->main_query) == SQLITE_ROW)
+  {
+    if(lib->index.count == allocated)
+    {
+      allocated = MAX(1024, 2 * allocated);
+      lib->index.points = g_renew(dt_map_index_point_t, lib->index.points, allocated);
+    }
+    dt_map_index_point_t *pt = &lib->index.points[lib->index.count++];
+    pt->imgid = sqlite3_column_int(lib->main_query, 0);
+    pt->longitude = sqlite3_column_double(lib->main_query, 1);
+    pt->latitude = sqlite3_column_double(lib->main_query, 2);
+    uint32_t x, y;
+    _view_map_index_position(pt->longitude, pt->latitude, &x, &y);
+    pt->code = _view_map_index_code(x, y);
+  }
+  if(lib->index.count)
+    qsort(lib->index.points, lib->index.count, sizeof(dt_map_index_point_t), _view_map_index_sort);
+
+  lib->index.valid = TRUE;
+  dt_show_times_f(&start, "[map]", "spatial index of %d images", lib->index.count);
+}
+
+static void _view_map_index_level(dt_map_t *lib, const int level)
+{
+  if(lib->index.cells[level] || !lib->index.count) return;
+
+  const int shift = 2 * (DT_MAP_INDEX_DEPTH - level);
+  const dt_map_index_point_t *pts = lib->index.points;
+  int nb = 1;
+  for(int i = 1; i < lib->index.count; i++)
+    if((pts[i].code >> shift) != (pts[i - 1].code >> shift)) nb++;
+
+  dt_map_index_cell_t *cells = g_new(dt_map_index_cell_t, nb);
+  int c = -1;
+  for(int i = 0; i < lib->index.count; i++)
+  {
+    const uint32_t code = pts[i].code >> shift;
+    if(c < 0 || cells[c].code != code)
+    {
+      c++;
+      cells[c].code = code;
+      cells[c].start = i;
+      cells[c].count = 0;
+    }
+    cells[c].count++;
+  }
+  lib->index.cells[level] = cells;
+  lib->index.nb_cells[level] = nb;
+}
+
+static const dt_map_index_cell_t *_view_map_index_find(const dt_map_t *lib, const int level, const uint32_t code)
+{
+  const dt_map_index_cell_t *cells = lib->index.cells[level];
+  int lo = 0, hi = lib->index.nb_cells[level] - 1;
+  while(lo <= hi)
+  {
+    const int mid = (lo + hi) / 2;
+    if(cells[mid].code == code) return &cells[mid];
+    if(cells[mid].code < code) lo = mid + 1;
+    else hi = mid - 1;
+  }
+  return NULL;
+}
+
 static void _view_map_changed_callback_delayed(gpointer user_data)
 {
   dt_view_t *self = (dt_view_t *)user_data;
@@ -1310,114 +1479,172 @@ static void _view_map_changed_callback_delayed(gpointer user_data)
     dt_conf_set_float("plugins/map/latitude", center_lat);
     dt_conf_set_int("plugins/map/zoom", zoom);
 
-    /* let's reset and reuse the main_query statement */
-    DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->main_query);
-    DT_DEBUG_SQLITE3_RESET(lib->main_query);
-
-    /* bind bounding box coords for the main query */
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 1, lib->bbox.lon1);
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 2, lib->bbox.lon2);
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 3, lib->bbox.lat1);
-    DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->main_query, 4, lib->bbox.lat2);
-
-    // count the images
+    if(!lib->index.valid) _view_map_index_build(lib);
+
+    const float epsilon_factor = dt_conf_get_int("plugins/map/epsilon_factor");
+    const int min_images = dt_conf_get_int("plugins/map/min_images_per_group");
+    // zoom varies from 0 (156412 m/pixel) to 20 (0.149 m/pixel)
+    // https://wiki.openstreetmap.org/wiki/Zoom_levels
+    // each time zoom increases by 1 the size is divided by 2
+    // epsilon factor = 100 => epsilon covers more or less a thumbnail surface
+    #define R 6371   // earth radius (km)
+    double epsilon = thumb_size * (((unsigned int)(156412000 >> zoom))
+                                * epsilon_factor * 0.01 * 0.000001 / R);
+
+    // the index level whose cells are about the size of a group on screen
+    const double group_pixels = MAX(1.0, thumb_size * epsilon_factor * 0.01);
+    int level = CLAMP((int)round(zoom + log2(TILESIZE / group_pixels)), 0, DT_MAP_INDEX_DEPTH);
+    uint32_t x1, y1, x2, y2;
+    _view_map_index_position(lib->bbox.lon1, lib->bbox.lat1, &x1, &y1);
+    _view_map_index_position(lib->bbox.lon2, lib->bbox.lat2, &x2, &y2);
+    while(level > 0 && (uint64_t)(((x2 >> (DT_MAP_INDEX_DEPTH - level)) - (x1 >> (DT_MAP_INDEX_DEPTH - level)) + 1))
+                       * ((y2 >> (DT_MAP_INDEX_DEPTH - level)) - (y1 >> (DT_MAP_INDEX_DEPTH - level)) + 1)
+                       > DT_MAP_MAX_VISIBLE_CELLS)
+      level--;
+    const int shift = DT_MAP_INDEX_DEPTH - level;
+    x1 >>= shift; x2 >>= shift; y1 >>= shift; y2 >>= shift;
+    _view_map_index_level(lib, level);
+
+    // count the images of the visible cells
     int img_count = 0;
-    while(sqlite3_step(lib->main_query) == SQLITE_ROW)
+    if(lib->index.count && x1 <= x2 && y1 <= y2)
     {
-      img_count++;
+      for(uint32_t y = y1; y <= y2; y++)
+        for(uint32_t x = x1; x <= x2; x++)
+        {
+          const dt_map_index_cell_t *cell = _view_map_index_find(lib, level, _view_map_index_code(x, y));
+          if(cell) img_count += cell->count;
+        }
     }
 
     if(lib->points)
       g_free(lib->points);
     lib->points = NULL;
-    lib->nb_points = img_count;
+    lib->nb_points = 0;
     if(img_count > 0)
       lib->points = (dt_geo_position_t *)calloc(img_count, sizeof(dt_geo_position_t));
     dt_geo_position_t *p = lib->points;
     if(p)
     {
-      DT_DEBUG_SQLITE3_RESET(lib->main_query);
-      /* make the image list */
-      int i = 0;
-      while(sqlite3_step(lib->main_query) == SQLITE_ROW && all_good && i < img_count)
-      {
-        p[i].imgid = sqlite3_column_int(lib->main_query, 0);
-        p[i].x = sqlite3_column_double(lib->main_query, 1) * M_PI / 180;
-        p[i].y = sqlite3_column_double(lib->main_query, 2) * M_PI / 180;
-        p[i].cluster_id = UNCLASSIFIED;
-        i++;
-      }
-
-      const float epsilon_factor = dt_conf_get_int("plugins/map/epsilon_factor");
-      const int min_images = dt_conf_get_int("plugins/map/min_images_per_group");
-      // zoom varies from 0 (156412 m/pixel) to 20 (0.149 m/pixel)
-      // https://wiki.openstreetmap.org/wiki/Zoom_levels
-      // each time zoom increases by 1 the size is divided by 2
-      // epsilon factor = 100 => epsilon covers more or less a thumbnail surface
-      #define R 6371   // earth radius (km)
-      double epsilon = thumb_size * (((unsigned int)(156412000 >> zoom))
-                                  * epsilon_factor * 0.01 * 0.000001 / R);
-
-      dt_times_t start;
-      dt_get_times(&start);
-      _dbscan(p, img_count, epsilon, min_images);
-      dt_show_times(&start, "[map] dbscan calculation");
-
-      // set the clusters
       GList *sel_imgs = dt_act_on_get_images(FALSE, FALSE, FALSE);
-      int group = -1;
-      for(i = 0; i< img_count; i++)
-      {
-        if(p[i].cluster_id == NOISE)
-        {
-          dt_map_image_t *entry = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
-          entry->imgid = p[i].imgid;
-          entry->group = p[i].cluster_id;
-          entry->group_count = 1;
-          entry->longitude = p[i].x * 180 / M_PI;
-          entry->latitude = p[i].y * 180 / M_PI;
-          entry->group_same_loc = TRUE;
-          if(sel_imgs)
-            entry->selected_in_group = g_list_find((GList *)sel_imgs,
-                                                   GINT_TO_POINTER(entry->imgid))
-                                       ? TRUE : FALSE;
-          lib->images = g_slist_prepend(lib->images, entry);
-        }
-        else if(p[i].cluster_id > group)
+      GHashTable *sel = g_hash_table_new(NULL, NULL);
+      for(GList *l = sel_imgs; l; l = g_list_next(l))
+        g_hash_table_add(sel, l->data);
+      g_list_free(sel_imgs);
+
+      // with too many images in view each occupied cell makes a group
+      const gboolean cell_groups = img_count > DT_MAP_DBSCAN_MAX_POINTS;
+      int group = 0;
+      int i = 0;
+      for(uint32_t y = y1; y <= y2; y++)
+        for(uint32_t x = x1; x <= x2; x++)
         {
-          group = p[i].cluster_id;
-          dt_map_image_t *entry = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
-          entry->imgid = p[i].imgid;
-          entry->group = p[i].cluster_id;
-          entry->group_same_loc = TRUE;
-          entry->selected_in_group = (sel_imgs && g_list_find((GList *)sel_imgs,
-                                                               GINT_TO_POINTER(p[i].imgid)))
-                                     ? TRUE : FALSE;
-          const double lon = p[i].x, lat = p[i].y;
-          for(int j = 0; j < img_count; j++)
+          const dt_map_index_cell_t *cell = _view_map_index_find(lib, level, _view_map_index_code(x, y));
+          if(!cell) continue;
+          dt_map_image_t *entry = NULL;
+          int first = i;
+          for(int k = cell->start; k < cell->start + cell->count; k++)
           {
-            if(p[j].cluster_id == group)
+            const dt_map_index_point_t *pt = &lib->index.points[k];
+            if(pt->longitude < lib->bbox.lon1 || pt->longitude > lib->bbox.lon2
+               || pt->latitude > lib->bbox.lat1 || pt->latitude < lib->bbox.lat2)
+              continue;
+            p[i].imgid = pt->imgid;
+            p[i].x = pt->longitude * M_PI / 180;
+            p[i].y = pt->latitude * M_PI / 180;
+            p[i].cluster_id = UNCLASSIFIED;
+            if(cell_groups)
             {
-              entry->group_count++;
-              entry->longitude += p[j].x;
-              entry->latitude += p[j].y;
-              if(entry->group_same_loc && (p[j].x != lon || p[j].y != lat))
+              if(!entry)
               {
-                entry->group_same_loc = FALSE;
+                entry = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
+                entry->imgid = pt->imgid;
+                entry->group = ++group;
+                entry->group_same_loc = TRUE;
+                first = i;
               }
-              if(sel_imgs && !entry->selected_in_group)
+              p[i].cluster_id = entry->group;
+              entry->group_count++;
+              entry->longitude += p[i].x;
+              entry->latitude += p[i].y;
+              if(entry->group_same_loc && (p[i].x != p[first].x || p[i].y != p[first].y))
+                entry->group_same_loc = FALSE;
+              if(!entry->selected_in_group && g_hash_table_contains(sel, GINT_TO_POINTER(pt->imgid)))
+                entry->selected_in_group = TRUE;
+            }
+            i++;
+          }
+          if(entry)
+          {
+            if(entry->group_count == 1)
+            {
+              entry->group = p[first].cluster_id = NOISE;
+              group--;
+            }
+            entry->latitude = entry->latitude  * 180 / M_PI / entry->group_count;
+            entry->longitude = entry->longitude * 180 / M_PI / entry->group_count;
+            lib->images = g_slist_prepend(lib->images, entry);
+          }
+        }
+      img_count = lib->nb_points = i;
+
+      if(!cell_groups && img_count > 0)
+      {
+        qsort(p, img_count, sizeof(dt_geo_position_t), _view_map_position_sort);
+
+        dt_times_t start;
+        dt_get_times(&start);
+        _dbscan(p, img_count, epsilon, min_images);
+        dt_show_times(&start, "[map] dbscan calculation");
+
+        // set the clusters
+        group = -1;
+        for(i = 0; i< img_count; i++)
+        {
+          if(p[i].cluster_id == NOISE)
+          {
+            dt_map_image_t *entry = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
+            entry->imgid = p[i].imgid;
+            entry->group = p[i].cluster_id;
+            entry->group_count = 1;
+            entry->longitude = p[i].x * 180 / M_PI;
+            entry->latitude = p[i].y * 180 / M_PI;
+            entry->group_same_loc = TRUE;
+            entry->selected_in_group = g_hash_table_contains(sel, GINT_TO_POINTER(entry->imgid));
+            lib->images = g_slist_prepend(lib->images, entry);
+          }
+          else if(p[i].cluster_id > group)
+          {
+            group = p[i].cluster_id;
+            dt_map_image_t *entry = (dt_map_image_t *)calloc(1, sizeof(dt_map_image_t));
+            entry->imgid = p[i].imgid;
+            entry->group = p[i].cluster_id;
+            entry->group_same_loc = TRUE;
+            entry->selected_in_group = g_hash_table_contains(sel, GINT_TO_POINTER(p[i].imgid));
+            const double lon = p[i].x, lat = p[i].y;
+            for(int j = 0; j < img_count; j++)
+            {
+              if(p[j].cluster_id == group)
               {
-                if(g_list_find((GList *)sel_imgs, GINT_TO_POINTER(p[j].imgid)))
+                entry->group_count++;
+                entry->longitude += p[j].x;
+                entry->latitude += p[j].y;
+                if(entry->group_same_loc && (p[j].x != lon || p[j].y != lat))
+                {
+                  entry->group_same_loc = FALSE;
+                }
+                if(!entry->selected_in_group
+                   && g_hash_table_contains(sel, GINT_TO_POINTER(p[j].imgid)))
                   entry->selected_in_group = TRUE;
               }
             }
+            entry->latitude = entry->latitude  * 180 / M_PI / entry->group_count;
+            entry->longitude = entry->longitude * 180 / M_PI / entry->group_count;
+            lib->images = g_slist_prepend(lib->images, entry);
           }
-          entry->latitude = entry->latitude  * 180 / M_PI / entry->group_count;
-          entry->longitude = entry->longitude * 180 / M_PI / entry->group_count;
-          lib->images = g_slist_prepend(lib->images, entry);
         }
       }
-      g_list_free(sel_imgs);
+      g_hash_table_destroy(sel);
     }
 
     needs_redraw = _view_map_draw_images(self);
@@ -2020,6 +2247,8 @@ void enter(dt_view_t *self)
   lib->start_drag_offset_y = 0;
   lib->loc.drag = FALSE;
   lib->entering = TRUE;
+  // images may have been removed or geotagged out of the map
+  _view_map_index_invalidate(lib);
 
   /* set the correct map source */
   _view_map_set_map_source_g_object(self, lib->map_source);
@@ -2100,6 +2329,7 @@ static gboolean _view_map_undo_callback(GtkAccelGroup *accel_group, GObject *acc
   dt_undo_do_undo(darktable.undo, DT_UNDO_MAP);
   dt_control_signal_unblock_by_func(darktable.signals, G_CALLBACK(_view_map_collection_changed), data);
   dt_control_signal_unblock_by_func(darktable.signals, G_CALLBACK(_view_map_geotag_changed), data);
+  _view_map_index_invalidate(lib);
   g_signal_emit_by_name(lib->map, "changed");
 
   return TRUE;
@@ -2117,6 +2347,7 @@ static gboolean _view_map_redo_callback(GtkAccelGroup *accel_group, GObject *acc
   dt_undo_do_redo(darktable.undo, DT_UNDO_MAP);
   dt_control_signal_unblock_by_func(darktable.signals, G_CALLBACK(_view_map_collection_changed), data);
   dt_control_signal_unblock_by_func(darktable.signals, G_CALLBACK(_view_map_geotag_changed), data);
+  _view_map_index_invalidate(lib);
   g_signal_emit_by_name(lib->map, "changed");
 
   return TRUE;
@@ -2515,6 +2746,8 @@ static void _view_map_collection_changed(gpointer instance, dt_collection_change
 {
   dt_view_t *self = (dt_view_t *)user_data;
   dt_map_t *lib = (dt_map_t *)self->data;
+  _view_map_index_invalidate(lib);
+
   // avoid to centre the map on collection while a location is active
   if(darktable.view_manager->proxy.map.view && !lib->loc.main.id)
   {
@@ -2544,6 +2777,7 @@ static void _view_map_geotag_changed(gpointer instance, GList *imgs, const int l
   {
     dt_view_t *self = (dt_view_t *)user_data;
     dt_map_t *lib = (dt_map_t *)self->data;
+    _view_map_index_invalidate(lib);
     if(darktable.view_manager->proxy.map.view) g_signal_emit_by_name(lib->map, "changed");
   }
 }
@@ -2673,6 +2907,7 @@ static void _drag_and_drop_received(GtkWidget *widget, GdkDragContext *context,
         dt_image_set_locations(imgs, &geoloc, TRUE);
         dt_control_signal_unblock_by_func(darktable.signals, G_CALLBACK(_view_map_collection_changed), self);
         DT_DEBUG_CONTROL_SIGNAL_RAISE(darktable.signals, DT_SIGNAL_GEOTAG_CHANGED, imgs, 0);
+        _view_map_index_invalidate(lib);
         g_signal_emit_by_name(lib->map, "changed");
         success = TRUE;
       }
@@ -2766,7 +3001,11 @@ static void _view_map_dnd_remove_callback(GtkWidget *widget, GdkDragContext *con
     }
   }
   gtk_drag_finish(context, success, FALSE, time);
-  if(success) g_signal_emit_by_name(lib->map, "changed");
+  if(success)
+  {
+    _view_map_index_invalidate(lib);
+    g_signal_emit_by_name(lib->map, "changed");
+  }
 }
 
 static gboolean _view_map_dnd_failed_callback(GtkWidget *widget, GdkDragContext *drag_context,
@@ -2806,14 +3045,14 @@ static void _view_map_build_main_query(dt_map_t *lib)
                               " (SELECT id, longitude, latitude "
                               "   FROM %s WHERE longitude >= ?1 AND longitude <= ?2"
                               "           AND latitude <= ?3 AND latitude >= ?4 "
-                              "           AND longitude NOT NULL AND latitude NOT NULL)"
-                              "   ORDER BY longitude ASC",  // critical to make dbscan work
+                              "           AND longitude NOT NULL AND latitude NOT NULL)",
                               lib->filter_images_drawn
                               ? "main.images i INNER JOIN memory.collected_images c ON i.id = c.imgid"
                               : "main.images");
 
   /* prepare the main query statement */
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), geo_query, -1, &lib->main_query, NULL);
+  _view_map_index_invalidate(lib);
 
   g_free(geo_query);
 }
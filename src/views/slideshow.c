@@ -41,13 +41,9 @@ typedef enum dt_slideshow_event_t
   S_REQUEST_STEP_BACK,
 } dt_slideshow_event_t;
 
-typedef enum dt_slideshow_slot_t
-{
-  S_LEFT      = 0,
-  S_CURRENT   = 1,
-  S_RIGHT     = 2,
-  S_SLOT_LAST = 3
-} dt_slideshow_slot_t;
+// most images kept rendered on each side of the current one
+#define S_MAX_AHEAD 4
+#define S_SLOTS (2 * S_MAX_AHEAD + 1)
 
 typedef struct _slideshow_buf_t
 {
@@ -56,6 +52,7 @@ typedef struct _slideshow_buf_t
   uint32_t height;
   int32_t rank;
   gboolean invalidated;
+  gboolean rendering; // a job is exporting this rank
 } dt_slideshow_buf_t;
 
 typedef struct dt_slideshow_t
@@ -63,8 +60,9 @@ typedef struct dt_slideshow_t
   int32_t col_count;
   uint32_t width, height;
 
-  // buffers
-  dt_slideshow_buf_t buf[S_SLOT_LAST];
+  // buffers, the window of ranks around the current one which is at index ahead
+  dt_slideshow_buf_t buf[S_SLOTS];
+  int ahead;
   gboolean init_phase;
 
   // state machine stuff for image transitions:
@@ -120,38 +118,63 @@ static int write_image(dt_imageio_module_data_t *datai, const char *filename, co
   return 0;
 }
 
+static inline dt_slideshow_buf_t *_current(dt_slideshow_t *d)
+{
+  return &d->buf[d->ahead];
+}
+
+static inline gboolean _in_collection(const dt_slideshow_t *d, const int32_t rank)
+{
+  return rank >= 0 && rank < d->col_count;
+}
+
+// the buffer of the rank leaving the window is reused for the one entering it
 static void shift_left(dt_slideshow_t *d)
 {
-  uint32_t *tmp_buf = d->buf[S_LEFT].buf;
+  const int last = 2 * d->ahead;
+  uint32_t *tmp_buf = d->buf[0].buf;
 
-  for(int k=S_LEFT; k<S_RIGHT; k++)
-  {
-    d->buf[k].buf         = d->buf[k+1].buf;
-    d->buf[k].rank        = d->buf[k+1].rank;
-    d->buf[k].width       = d->buf[k+1].width;
-    d->buf[k].height      = d->buf[k+1].height;
-    d->buf[k].invalidated = d->buf[k+1].invalidated;
-  }
-  d->buf[S_RIGHT].invalidated = TRUE;
-  d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
-  d->buf[S_RIGHT].buf = tmp_buf;
+  for(int k = 0; k < last; k++) d->buf[k] = d->buf[k + 1];
+
+  d->buf[last].buf = tmp_buf;
+  d->buf[last].rank = d->buf[last - 1].rank + 1;
+  d->buf[last].invalidated = TRUE;
+  d->buf[last].rendering = FALSE;
 }
 
 static void shift_right(dt_slideshow_t *d)
 {
-  uint32_t *tmp_buf = d->buf[S_RIGHT].buf;
+  const int last = 2 * d->ahead;
+  uint32_t *tmp_buf = d->buf[last].buf;
+
+  for(int k = last; k > 0; k--) d->buf[k] = d->buf[k - 1];
 
-  for(int k=S_RIGHT; k>S_LEFT; k--)
+  d->buf[0].buf = tmp_buf;
+  d->buf[0].rank = d->buf[1].rank - 1;
+  d->buf[0].invalidated = TRUE;
+  d->buf[0].rendering = FALSE;
+}
+
+static dt_slideshow_buf_t *_find_rank(dt_slideshow_t *d, const int32_t rank)
+{
+  for(int k = 0; k <= 2 * d->ahead; k++)
+    if(d->buf[k].rank == rank) return &d->buf[k];
+  return NULL;
+}
+
+// the next slot to render, closest to the current one first and forward before backward
+static dt_slideshow_buf_t *_next_to_render(dt_slideshow_t *d)
+{
+  for(int i = 0; i <= d->ahead; i++)
   {
-    d->buf[k].buf         = d->buf[k-1].buf;
-    d->buf[k].rank        = d->buf[k-1].rank;
-    d->buf[k].width       = d->buf[k-1].width;
-    d->buf[k].height      = d->buf[k-1].height;
-    d->buf[k].invalidated = d->buf[k-1].invalidated;
+    for(int dir = 1; dir >= -1; dir -= 2)
+    {
+      dt_slideshow_buf_t *slot = &d->buf[d->ahead + dir * i];
+      if(slot->invalidated && !slot->rendering && _in_collection(d, slot->rank)) return slot;
+      if(i == 0) break;
+    }
   }
-  d->buf[S_LEFT].invalidated = TRUE;
-  d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-  d->buf[S_LEFT].buf = tmp_buf;
+  return NULL;
 }
 
 static void requeue_job(dt_slideshow_t *d)
@@ -165,9 +188,9 @@ static void _set_delay(dt_slideshow_t *d, int value)
   dt_conf_set_int("slideshow_delay", d->delay);
 }
 
-static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
+static int process_image(dt_slideshow_t *d, const int32_t rank)
 {
-  dt_imageio_module_format_t buf;
+  dt_imageio_module_format_t buf = { 0 };
   buf.mime = mime;
   buf.levels = levels;
   buf.bpp = bpp;
@@ -179,16 +202,19 @@ static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
   dat.head.width = dat.head.max_width = d->width;
   dat.head.height = dat.head.max_height = d->height;
   dat.head.style[0] = '\0';
-  dat.rank = d->buf[slot].rank;
+  dat.rank = rank;
   dat.buf.buf = dt_alloc_align(64, sizeof(uint32_t) * d->width * d->height);
+  dat.buf.width = dat.buf.height = 0;
 
   d->exporting++;
 
-  const int32_t rank = dat.rank;
   const gchar *query = dt_collection_get_query(darktable.collection);
 
-  if(rank<0 || rank>=d->col_count || !query)
+  // the user may have moved on since the job picked this rank
+  if(!_in_collection(d, rank) || !_find_rank(d, rank) || !query)
   {
+    dt_slideshow_buf_t *slot = _find_rank(d, rank);
+    if(slot) slot->rendering = FALSE;
     d->exporting--;
     dt_pthread_mutex_unlock(&d->lock);
     goto error;
@@ -215,21 +241,23 @@ static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
     dt_imageio_export_with_flags(id, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, TRUE,
                                  high_quality, TRUE, FALSE, FALSE, NULL, FALSE, FALSE, DT_COLORSPACE_DISPLAY,
                                  NULL, DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
+  }
 
-    // lock to copy back into the slot the rendered buffer, not that this is done only if
-    // the slot rank is still the same as the local buffer rank. This can be false if the
-    // buffers have been shifted to advance to next image.
-    dt_pthread_mutex_lock(&d->lock);
-    if(dat.rank == d->buf[slot].rank)
-    {
-      memcpy(d->buf[slot].buf, dat.buf.buf, sizeof(uint32_t) * dat.buf.width * dat.buf.height);
-      d->buf[slot].width = dat.buf.width;
-      d->buf[slot].height = dat.buf.height;
-      d->buf[slot].invalidated = FALSE;
-    }
-    d->exporting--;
-    dt_pthread_mutex_unlock(&d->lock);
+  // lock to copy back the rendered buffer into the slot now holding its rank, which moves as the
+  // buffers are shifted. if the rank left the window meanwhile, the result is dropped.
+  dt_pthread_mutex_lock(&d->lock);
+  dt_slideshow_buf_t *slot = _find_rank(d, rank);
+  if(slot)
+  {
+    // without an image the slot stays empty rather than being picked again
+    if(id) memcpy(slot->buf, dat.buf.buf, sizeof(uint32_t) * dat.buf.width * dat.buf.height);
+    slot->width = id ? dat.buf.width : 0;
+    slot->height = id ? dat.buf.height : 0;
+    slot->invalidated = FALSE;
+    slot->rendering = FALSE;
   }
+  d->exporting--;
+  dt_pthread_mutex_unlock(&d->lock);
 
   dt_free_align(dat.buf.buf);
   return 0;
@@ -239,11 +267,16 @@ static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
   return 1;
 }
 
+// for the auto advance, the current and next images are what matters
 static gboolean _is_idle(dt_slideshow_t *d)
 {
-  return !((d->buf[S_LEFT].invalidated && d->buf[S_LEFT].rank <= d->col_count)
-           || (d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank <= d->col_count)
-           || (d->buf[S_RIGHT].invalidated && d->buf[S_RIGHT].rank <= d->col_count));
+  dt_pthread_mutex_lock(&d->lock);
+  const dt_slideshow_buf_t *current = _current(d);
+  const dt_slideshow_buf_t *next = current + 1;
+  const gboolean idle = !(current->invalidated && _in_collection(d, current->rank))
+                        && !(next->invalidated && _in_collection(d, next->rank));
+  dt_pthread_mutex_unlock(&d->lock);
+  return idle;
 }
 
 static gboolean auto_advance(gpointer user_data)
@@ -259,23 +292,26 @@ static int32_t process_job_run(dt_job_t *job)
 {
   dt_slideshow_t *d = dt_control_job_get_params(job);
 
-  if(d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank <= d->col_count)
-  {
-    process_image(d, S_CURRENT);
-    dt_control_queue_redraw_center();
-  }
-  else if(d->buf[S_RIGHT].invalidated && d->buf[S_RIGHT].rank <= d->col_count)
-  {
-    process_image(d, S_RIGHT);
-  }
-  else if(d->buf[S_LEFT].invalidated && d->buf[S_LEFT].rank >= 0)
-  {
-    process_image(d, S_LEFT);
-  }
+  // the work is picked when the job runs, so what a jump made stale is never started
+  dt_pthread_mutex_lock(&d->lock);
+  dt_slideshow_buf_t *slot = _next_to_render(d);
+  const int32_t rank = slot ? slot->rank : -1;
+  if(slot) slot->rendering = TRUE;
+  dt_pthread_mutex_unlock(&d->lock);
+
+  if(!slot) return 0;
+
+  process_image(d, rank);
+
+  dt_pthread_mutex_lock(&d->lock);
+  const gboolean shown = _current(d)->rank == rank;
+  const gboolean more = _next_to_render(d) != NULL;
+  dt_pthread_mutex_unlock(&d->lock);
+
+  if(shown) dt_control_queue_redraw_center();
 
   // any other slot to fill?
-  if(!_is_idle(d))
-    requeue_job(d);
+  if(more) requeue_job(d);
 
   return 0;
 }
@@ -290,7 +326,7 @@ static dt_job_t *process_job_create(dt_slideshow_t *d)
 
 static void _refresh_display(dt_slideshow_t *d)
 {
-  if(!d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank >= 0)
+  if(!_current(d)->invalidated && _current(d)->rank >= 0)
     dt_control_queue_redraw_center();
 }
 
@@ -301,11 +337,9 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
 
   if(event == S_REQUEST_STEP)
   {
-    if(d->buf[S_CURRENT].rank < d->col_count - 1)
+    if(_current(d)->rank < d->col_count - 1)
     {
       shift_left(d);
-      d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
-      d->buf[S_RIGHT].invalidated = d->buf[S_RIGHT].rank < d->col_count;
       _refresh_display(d);
       requeue_job(d);
     }
@@ -317,11 +351,9 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
   }
   else if(event == S_REQUEST_STEP_BACK)
   {
-    if(d->buf[S_CURRENT].rank > 0)
+    if(_current(d)->rank > 0)
     {
       shift_right(d);
-      d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-      d->buf[S_LEFT].invalidated = d->buf[S_LEFT].rank >= 0;
       _refresh_display(d);
       requeue_job(d);
     }
@@ -409,12 +441,19 @@ void enter(dt_view_t *self)
   d->width = rect.width * darktable.gui->ppd;
   d->height = rect.height * darktable.gui->ppd;
 
-  for(int k=S_LEFT; k<S_SLOT_LAST; k++)
+  // as many images ahead as asked for and fit into the memory cap, but at least next and previous
+  const size_t slot_size = sizeof(uint32_t) * d->width * d->height;
+  const size_t budget = (size_t)dt_conf_get_int("slideshow_render_ahead_memory") << 20;
+  d->ahead = CLAMP(dt_conf_get_int("slideshow_render_ahead"), 1, S_MAX_AHEAD);
+  while(d->ahead > 1 && (2 * d->ahead + 1) * slot_size > budget) d->ahead--;
+
+  for(int k = 0; k <= 2 * d->ahead; k++)
   {
-    d->buf[k].buf = dt_alloc_align(64, sizeof(uint32_t) * d->width * d->height);
+    d->buf[k].buf = dt_alloc_align(64, slot_size);
     d->buf[k].width =  d->width;
     d->buf[k].height = d->height;
     d->buf[k].invalidated = TRUE;
+    d->buf[k].rendering = FALSE;
   }
 
   // if one selected start with it, otherwise start at the current lighttable offset
@@ -434,9 +473,8 @@ void enter(dt_view_t *self)
     sqlite3_finalize(stmt);
   }
 
-  d->buf[S_CURRENT].rank = selrank == -1 ? dt_thumbtable_get_offset(dt_ui_thumbtable(darktable.gui->ui)) : selrank;
-  d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-  d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
+  const int32_t rank = selrank == -1 ? dt_thumbtable_get_offset(dt_ui_thumbtable(darktable.gui->ui)) : selrank;
+  for(int k = 0; k <= 2 * d->ahead; k++) d->buf[k].rank = rank + k - d->ahead;
 
   d->col_count = dt_collection_get_count(darktable.collection);
 
@@ -465,11 +503,11 @@ void leave(dt_view_t *self)
   // otherwise we will crash releasing lock and memory.
   while(d->exporting > 0) sleep(1);
 
-  dt_thumbtable_set_offset(dt_ui_thumbtable(darktable.gui->ui), d->buf[S_CURRENT].rank, FALSE);
+  dt_thumbtable_set_offset(dt_ui_thumbtable(darktable.gui->ui), _current(d)->rank, FALSE);
 
   dt_pthread_mutex_lock(&d->lock);
 
-  for(int k=S_LEFT; k<S_SLOT_LAST; k++)
+  for(int k = 0; k <= 2 * d->ahead; k++)
   {
     dt_free_align(d->buf[k].buf);
     d->buf[k].buf = NULL;
@@ -485,7 +523,7 @@ void expose(dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t
   dt_pthread_mutex_lock(&d->lock);
   cairo_paint(cr);
 
-  const dt_slideshow_buf_t *slot = &(d->buf[S_CURRENT]);
+  const dt_slideshow_buf_t *slot = _current(d);
 
   if(slot->buf && slot->rank >= 0 && !slot->invalidated)
   {
@@ -88,6 +88,9 @@ typedef struct dt_capture_t
   double live_view_zoom_cursor_x, live_view_zoom_cursor_y;
 
   gboolean busy;
+
+  /** the size of the previews shown in the center view, for tethered shots to get theirs right away */
+  dt_mipmap_size_t preview_mip;
 } dt_capture_t;
 
 /* signal handler for filmstrip image switching */
@@ -127,6 +130,8 @@ static void _view_capture_filmstrip_activate_callback(gpointer instance, int img
 void init(dt_view_t *self)
 {
   self->data = calloc(1, sizeof(dt_capture_t));
+  // until the center view is drawn
+  ((dt_capture_t *)self->data)->preview_mip = DT_MIPMAP_3;
 
   /* setup the tethering view proxy */
   darktable.view_manager->proxy.tethering.view = self;
@@ -225,6 +230,12 @@ static void _expose_tethered_mode(dt_view_t *self, cairo_t *cr, int32_t width, i
 
   if(cam->is_live_viewing == TRUE) // display the preview
   {
+    // frames are decoded no larger than they are shown, zoomed ones at full size
+    const int target_w = cam->live_view_zoom ? 0 : (width - (MARGIN * 2.0f)) * darktable.gui->ppd;
+    const int target_h = cam->live_view_zoom ? 0 : (height - (MARGIN * 2.0f) - BAR_HEIGHT) * darktable.gui->ppd;
+    cam->live_view_target_width = cam->live_view_rotation % 2 == 0 ? target_w : target_h;
+    cam->live_view_target_height = cam->live_view_rotation % 2 == 0 ? target_h : target_w;
+
     dt_pthread_mutex_lock(&cam->live_view_buffer_mutex);
     if(cam->live_view_buffer)
     {
@@ -333,6 +344,9 @@ static void _expose_tethered_mode(dt_view_t *self, cairo_t *cr, int32_t width, i
   {
     // FIXME: every time the mouse moves over the center view this redraws, which isn't necessary
     cairo_surface_t *surf = NULL;
+    lib->preview_mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache,
+                                                         (width - (MARGIN * 2.0f)) * darktable.gui->ppd,
+                                                         (height - (MARGIN * 2.0f)) * darktable.gui->ppd);
     const dt_view_surface_value_t res = dt_view_image_get_surface(lib->image_id, width - (MARGIN * 2.0f),
                                                                   height - (MARGIN * 2.0f), &surf, FALSE);
     if(res != DT_VIEW_SURFACE_OK)
@@ -356,7 +370,7 @@ static void _expose_tethered_mode(dt_view_t *self, cairo_t *cr, int32_t width, i
     }
 
     // update the histogram
-    dt_imageio_module_format_t format;
+    dt_imageio_module_format_t format = { 0 };
     _tethering_format_t dat;
     format.bpp = _tethering_bpp;
     format.write_image = _tethering_write_image;
@@ -490,9 +504,11 @@ static void _camera_capture_image_downloaded(const dt_camera_t *camera, const ch
 {
   dt_capture_t *lib = (dt_capture_t *)data;
 
-  /* create an import job of downloaded image */
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG,
-                     dt_image_import_job_create(dt_import_session_film_id(lib->session), filename));
+  /* import the downloaded image ahead of everything else, showing its embedded preview first */
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
+                     dt_image_tethered_import_job_create(dt_import_session_film_id(lib->session), filename,
+                                                         lib->preview_mip,
+                                                         dt_conf_get_string_const("plugins/session/style")));
 }
 
 
@@ -132,6 +132,18 @@ tmp_node:add_return("table or nil",[[The modified table of images to export or n
 [[If nil (or nothing) is returned, the original list of images will be exported]]..para()..
 [[If a table of images is returned, that table will be used instead. The table can be empty. The images parameter can be modified and returned]])
 darktable.register_storage:add_parameter("widget",types.lua_widget,[[A widget to display in the export section of darktable's UI]]):set_attribute("optional",true)
+tmp_node = darktable.register_storage:add_parameter("store_buffer","function",[[Called instead of store for each exported image when given. It receives the processed pixels in memory rather than the name of a temporary file, so nothing is written to disk.]]..para()..
+[[The pixels are what the chosen format would have encoded: 4 channels per pixel (RGBA) of 8 or 16 bit unsigned integers or 32 bit floats, row by row, in the byte order of the machine. The image table passed to finalize stays empty.]])
+tmp_node:set_attribute("optional",true)
+tmp_node:add_parameter("storage",types.dt_imageio_module_storage_t,[[The storage object used for the export.]])
+tmp_node:add_parameter("image",types.dt_lua_image_t,[[The exported image object.]])
+tmp_node:add_parameter("format",types.dt_imageio_module_format_t,[[The format object used for the export.]])
+tmp_node:add_parameter("pixels","string",[[The processed pixels.]])
+tmp_node:add_parameter("info","table",[[The width and height of the image, its bpp (bits per channel) and its exif data as a binary string (the raw Exif block as embedded in JPEG files), if any.]])
+tmp_node:add_parameter("number","integer",[[The number of the image out of the export series.]])
+tmp_node:add_parameter("total","integer",[[The total number of images in the export series.]])
+tmp_node:add_parameter("high_quality","boolean",[[True if the export is high quality.]])
+tmp_node:add_parameter("extra_data","table",[[An empty Lua table to take extra data. This table is common to the initialize, store and finalize calls in an export series.]])
 darktable.register_lib:set_text("Register a new lib object. A lib is a graphical element of darktable's user interface")
 darktable.register_lib:add_parameter("plugin_name","string","A unique name for your library")
 darktable.register_lib:add_parameter("name","string","A user-visible name for your library")
@@ -241,11 +253,11 @@ darktable.tags.delete:add_parameter("tag",types.dt_lua_tag_t,[[The tag to be del
 darktable.tags.delete:set_main_parent(darktable.tags)
 darktable.tags.attach:set_text([[Attach a tag to an image; the order of the parameters can be reversed.]])
 darktable.tags.attach:add_parameter("tag",types.dt_lua_tag_t,[[The tag to be attached.]])
-darktable.tags.attach:add_parameter("image",types.dt_lua_image_t,[[The image to attach the tag to.]])
+darktable.tags.attach:add_parameter("image",types.dt_lua_image_t,[[The image to attach the tag to, or a table of images to tag all at once.]])
 darktable.tags.attach:set_main_parent(darktable.tags)
 darktable.tags.detach:set_text([[Detach a tag from an image; the order of the parameters can be reversed.]])
 darktable.tags.detach:add_parameter("tag",types.dt_lua_tag_t,[[The tag to be detached.]])
-darktable.tags.detach:add_parameter("image",types.dt_lua_image_t,[[The image to detach the tag from.]])
+darktable.tags.detach:add_parameter("image",types.dt_lua_image_t,[[The image to detach the tag from, or a table of images to untag all at once.]])
 darktable.tags.detach:set_main_parent(darktable.tags)
 darktable.tags.get_tags:set_text([[Gets all tags attached to an image.]])
 darktable.tags.get_tags:add_parameter("image",types.dt_lua_image_t,[[The image to get the tags from.]])
@@ -390,10 +402,32 @@ darktable.database.copy_image:add_parameter("image",types.dt_lua_image_t,[[The i
 darktable.database.copy_image:add_parameter("film",types.dt_lua_film_t,[[The film to copy to]])
 darktable.database.copy_image:add_return(types.dt_lua_image_t,[[The new image]])
 darktable.database.copy_image:set_main_parent(darktable.database)
+darktable.database.get_images:set_text([[Returns all images of the database in one go, much faster than iterating the database with an index.]])
+darktable.database.get_images:add_return("table of "..my_tostring(types.dt_lua_image_t),[[The images, ordered by id.]])
+darktable.database.get_images:set_main_parent(darktable.database)
+darktable.database.get_properties:set_text([[Reads properties of many images at once, each image is looked up only once for all of them.]])
+darktable.database.get_properties:add_parameter("images","table of "..my_tostring(types.dt_lua_image_t),[[The images to read.]])
+tmp_node = darktable.database.get_properties:add_parameter("names","table of string",[[The names of the properties to read, as for the image object (id, rating and the fields of the image like exif_iso or filename). All fields when omitted.]])
+tmp_node:set_attribute("optional",true)
+darktable.database.get_properties:add_return("table of table",[[One table per image, in the order of the images, mapping property names to their values. id and rating are always present.]])
+darktable.database.get_properties:set_main_parent(darktable.database)
+darktable.database.set_metadata:set_text([[Sets metadata of many images in one transaction.]])
+darktable.database.set_metadata:add_parameter("images","table of "..my_tostring(types.dt_lua_image_t),[[The images to change.]])
+darktable.database.set_metadata:add_parameter("metadata","table of string",[[The values to set, indexed by metadata name (creator, publisher, title, description, rights, notes...).]])
+darktable.database.set_metadata:set_main_parent(darktable.database)
+darktable.database.batch:set_text([[Calls a function, all the changes it makes to the database are written in one transaction when it returns.]]..para()..
+[[Use it around loops changing many images one by one. The function must not yield, i.e. call ]]..my_tostring(darktable.control.sleep)..[[ or similar.]])
+darktable.database.batch:add_parameter("func","function",[[The function to call.]])
+darktable.database.batch:add_parameter("...","variable",[[Parameters to pass to the function.]])
+darktable.database.batch:add_return("variable",[[What the function returned.]])
+darktable.database.batch:set_main_parent(darktable.database)
 darktable.collection:set_text([[Allows to access the currently worked on images, i.e the ones selected by the collection lib. Filtering (rating etc) does not change that collection.]])
 
 
 darktable.collection["#"]:set_text([[Each image in the collection appears with a numerical index; you can iterate them using ipairs.]])
+darktable.collection.get_images:set_text([[Returns all images of the collection in one go, much faster than iterating the collection with an index.]])
+darktable.collection.get_images:add_return("table of "..my_tostring(types.dt_lua_image_t),[[The images, in the order of the collection.]])
+darktable.collection.get_images:set_main_parent(darktable.collection)
 
 
 for k, v in darktable.gui.views:unskipped_children() do